@@ -0,0 +1,493 @@
+/*
+ * wedge_replay.c
+ *
+ * Replays a trace of socket calls through the daemon's netlink transport (trunk/core/daemon/nlHandling.c)
+ * without loading the wedge. A socketpair stands in for the netlink socket: one thread frames each call the
+ * way fins_stack_wedge.c does, a daemon thread reads them with nl_link_recv() and answers every call with
+ * an nl_daemon_to_wedge reply, and a third thread reads the replies back the way nl_data_ready() does.
+ * Every payload is checked on both sides, so a framing or batching mistake fails the run.
+ *
+ * Trace lines are "call_type sock_index len reply_len", '#' starts a comment. Without a trace a mix of
+ * small calls with the odd multipart sendmsg is used.
+ *
+ * With -r the payload rings (trunk/core/daemon/ringHandling.c) are exercised as well. Each sock_index gets
+ * a slot in a pool allocated here in place of /dev/fins_ring, payloads of FINS_RING_MIN bytes or more go
+ * through the slot's rings, and the messages carry (len, ring, where) the way sendmsg and recvmsg do, so
+ * the ring protocol is tested without the module.
+ *
+ * usage: wedge_replay [-n repeats] [-w window] [-r] [trace]
+ *   -w is how many calls are outstanding at once, like that many threads blocked in the wedge
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+
+#include "nlHandling.h"
+#include "ringHandling.h"
+
+#define REPLAY_ACK 200
+#define REPLAY_CALLS_MAX 100000
+#define REPLAY_RECV_SIZE 65536
+#define REPLAY_SOCKBUF (4 * 1024 * 1024)
+
+struct replay_call {
+	uint32_t call_type;
+	int sock_index;
+	ssize_t len;
+	ssize_t reply_len;
+};
+
+struct replay_call *trace;
+int trace_num;
+int repeats = 1000;
+int window = 64;
+int total;
+
+int fds[2]; //fds[0] is the wedge end, fds[1] the daemon end
+struct nl_link *replay_link;
+sem_t window_sem;
+volatile int done;
+
+uint8_t *replied; //per call_id
+int bad;
+uint64_t wedge_dgrams;
+uint64_t reply_dgrams;
+uint64_t reply_msgs;
+
+int use_rings;
+struct fins_ring_slot *ring_pool;
+struct fins_ring ring_tx[FINS_RING_SLOTS]; //kept by the wedge thread
+struct fins_ring ring_rx[FINS_RING_SLOTS]; //kept by the daemon thread
+uint64_t ring_calls; //payloads that went through a ring
+uint64_t ring_replies;
+
+/** the data section after a header in -r mode: [u32 len][int ring][int where][data if where == -1] */
+#define RING_DESC_SIZE (sizeof(uint32_t) + 2 * sizeof(int))
+
+/** writes the descriptor at buf, the payload is already at buf + RING_DESC_SIZE. Returns the bytes used */
+ssize_t ring_pack(struct fins_ring *rings, uint8_t *buf, int ring, uint32_t len, uint64_t *counter) {
+	int where = -1;
+
+	if (len >= FINS_RING_MIN) {
+		where = ring_put(&rings[ring], buf + RING_DESC_SIZE, len);
+	}
+	memcpy(buf, &len, sizeof(uint32_t));
+	memcpy(buf + sizeof(uint32_t), &ring, sizeof(int));
+	memcpy(buf + sizeof(uint32_t) + sizeof(int), &where, sizeof(int));
+	if (where == -1) {
+		return RING_DESC_SIZE + len;
+	}
+	(*counter)++;
+	return RING_DESC_SIZE;
+}
+
+/** the other end: finds the payload of a descriptor in the slot's rx or tx ring, NULL if it is bogus */
+uint8_t *ring_unpack(uint8_t *buf, ssize_t len, int rx, uint32_t *data_len, int *where) {
+	int ring;
+
+	if (len < (ssize_t) RING_DESC_SIZE) {
+		return NULL;
+	}
+	memcpy(data_len, buf, sizeof(uint32_t));
+	memcpy(&ring, buf + sizeof(uint32_t), sizeof(int));
+	memcpy(where, buf + sizeof(uint32_t) + sizeof(int), sizeof(int));
+	if (*where == -1) {
+		return len - (ssize_t) RING_DESC_SIZE == (ssize_t) *data_len ? buf + RING_DESC_SIZE : NULL;
+	}
+	if (ring < 0 || ring >= FINS_RING_SLOTS || len != (ssize_t) RING_DESC_SIZE) {
+		return NULL;
+	}
+	return ring_get(rx ? ring_pool[ring].rx : ring_pool[ring].tx, *where, *data_len);
+}
+
+uint64_t replay_now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void replay_fill(uint8_t *buf, ssize_t len, uint32_t seed) {
+	ssize_t i;
+
+	for (i = 0; i < len; i++) {
+		buf[i] = (uint8_t) (seed + i * 31);
+	}
+}
+
+int replay_check(uint8_t *buf, ssize_t len, uint32_t seed) {
+	ssize_t i;
+
+	for (i = 0; i < len; i++) {
+		if (buf[i] != (uint8_t) (seed + i * 31)) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+int trace_load(char *path) {
+	FILE *file;
+	char line[256];
+	struct replay_call call;
+
+	file = fopen(path, "r");
+	if (file == NULL) {
+		perror(path);
+		return -1;
+	}
+
+	trace = (struct replay_call *) malloc(REPLAY_CALLS_MAX * sizeof(struct replay_call));
+	while (fgets(line, sizeof(line), file) != NULL && trace_num < REPLAY_CALLS_MAX) {
+		if (line[0] == '#' || line[0] == '\n') {
+			continue;
+		}
+		if (sscanf(line, "%u %d %zd %zd", &call.call_type, &call.sock_index, &call.len, &call.reply_len) != 4 || call.len < 0
+				|| call.reply_len < 0) {
+			fprintf(stderr, "bad trace line: %s", line);
+			fclose(file);
+			return -1;
+		}
+		trace[trace_num++] = call;
+	}
+	fclose(file);
+	return trace_num ? 0 : -1;
+}
+
+/** mostly small poll/recvmsg/sendmsg calls, every 50th a sendmsg big enough to need parts */
+void trace_default(void) {
+	int i;
+
+	trace_num = 100;
+	trace = (struct replay_call *) malloc(trace_num * sizeof(struct replay_call));
+	for (i = 0; i < trace_num; i++) {
+		trace[i].sock_index = i % 8;
+		switch (i % 4) {
+		case 0:
+			trace[i].call_type = 12; //poll_call
+			trace[i].len = sizeof(int);
+			trace[i].reply_len = sizeof(int);
+			break;
+		case 1:
+			trace[i].call_type = 8; //sendmsg_call
+			trace[i].len = (i % 50 == 1) ? 40000 : 64 + i;
+			trace[i].reply_len = 0;
+			break;
+		default:
+			trace[i].call_type = 9; //recvmsg_call
+			trace[i].len = 3 * sizeof(int);
+			trace[i].reply_len = 512;
+			break;
+		}
+	}
+}
+
+/** same framing as nl_send() in the wedge, one part per datagram */
+int wedge_send_part(unsigned int seq, int type, ssize_t msg_len, int pos, uint8_t *buf, ssize_t part_len) {
+	struct nlmsghdr nlh;
+	uint8_t hdr[NL_PART_HDR_SIZE];
+	struct iovec iov[3];
+	struct msghdr msg;
+
+	memset(&nlh, 0, sizeof(struct nlmsghdr));
+	nlh.nlmsg_len = NLMSG_LENGTH(NL_PART_HDR_SIZE + part_len);
+	nlh.nlmsg_type = type;
+	nlh.nlmsg_seq = seq;
+
+	*(ssize_t *) hdr = msg_len;
+	*(ssize_t *) (hdr + sizeof(ssize_t)) = part_len;
+	*(int *) (hdr + 2 * sizeof(ssize_t)) = pos;
+
+	iov[0].iov_base = &nlh;
+	iov[0].iov_len = NLMSG_HDRLEN;
+	iov[1].iov_base = hdr;
+	iov[1].iov_len = NL_PART_HDR_SIZE;
+	iov[2].iov_base = buf;
+	iov[2].iov_len = part_len;
+
+	memset(&msg, 0, sizeof(struct msghdr));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = 3;
+	if (sendmsg(fds[0], &msg, 0) == -1) {
+		perror("wedge sendmsg");
+		return -1;
+	}
+	wedge_dgrams++;
+	return 0;
+}
+
+int wedge_send(uint8_t *msg_buf, ssize_t msg_len) {
+	ssize_t part_max = NL_PART_SIZE - NL_PART_HDR_SIZE;
+	unsigned int seq = 0;
+	int pos = 0;
+
+	while (msg_len - pos > part_max) {
+		if (wedge_send_part(seq++, 0, msg_len, pos, msg_buf + pos, part_max)) {
+			return -1;
+		}
+		pos += part_max;
+	}
+	return wedge_send_part(seq, NLMSG_DONE, msg_len, pos, msg_buf + pos, msg_len - pos);
+}
+
+void *wedge_calls(void *local) {
+	struct nl_wedge_to_daemon *hdr;
+	struct replay_call *call;
+	uint8_t *buf;
+	ssize_t len;
+	int i;
+
+	buf = (uint8_t *) malloc(sizeof(struct nl_wedge_to_daemon) + RING_DESC_SIZE + 1024 * 1024);
+	for (i = 0; i < total; i++) {
+		call = &trace[i % trace_num];
+		if (call->len > 1024 * 1024) {
+			fprintf(stderr, "call %d too long: len=%zd\n", i, call->len);
+			exit(1);
+		}
+
+		hdr = (struct nl_wedge_to_daemon *) buf;
+		memset(hdr, 0, sizeof(struct nl_wedge_to_daemon));
+		hdr->sock_id = call->sock_index + 1000;
+		hdr->sock_index = call->sock_index;
+		hdr->call_type = call->call_type;
+		hdr->call_pid = getpid();
+		hdr->call_id = i;
+		hdr->call_index = i % window;
+
+		sem_wait(&window_sem);
+		if (use_rings) {
+			replay_fill(buf + sizeof(struct nl_wedge_to_daemon) + RING_DESC_SIZE, call->len, i);
+			len = ring_pack(ring_tx, buf + sizeof(struct nl_wedge_to_daemon), call->sock_index % FINS_RING_SLOTS, call->len, &ring_calls);
+		} else {
+			replay_fill(buf + sizeof(struct nl_wedge_to_daemon), call->len, i);
+			len = call->len;
+		}
+		if (wedge_send(buf, sizeof(struct nl_wedge_to_daemon) + len)) {
+			exit(1);
+		}
+	}
+	free(buf);
+	return NULL;
+}
+
+/** the daemon side: check the call, answer it like ack_send() with reply_len bytes after the header */
+void daemon_call(void *arg, uint8_t *msg, ssize_t len) {
+	struct nl_wedge_to_daemon *hdr = (struct nl_wedge_to_daemon *) msg;
+	struct nl_daemon_to_wedge *reply;
+	struct replay_call *call;
+	uint8_t *buf = (uint8_t *) arg;
+	uint8_t *data = msg + sizeof(struct nl_wedge_to_daemon);
+	ssize_t data_len = len - (ssize_t) sizeof(struct nl_wedge_to_daemon);
+	uint32_t ring_len;
+	int where = -1;
+
+	if (len < (ssize_t) sizeof(struct nl_wedge_to_daemon) || hdr->call_id >= (uint32_t) total) {
+		fprintf(stderr, "daemon: bad call, len=%zd\n", len);
+		bad++;
+		return;
+	}
+	call = &trace[hdr->call_id % trace_num];
+	if (use_rings) {
+		data = ring_unpack(data, data_len, 0, &ring_len, &where);
+		data_len = ring_len;
+	}
+	if (data == NULL || hdr->call_type != call->call_type || hdr->sock_index != call->sock_index || data_len != call->len
+			|| !replay_check(data, call->len, hdr->call_id)) {
+		fprintf(stderr, "daemon: call %u mangled, len=%zd\n", hdr->call_id, len);
+		bad++;
+	}
+	if (data != NULL && where != -1) {
+		ring_done(ring_pool[call->sock_index % FINS_RING_SLOTS].tx, where);
+	}
+
+	reply = (struct nl_daemon_to_wedge *) buf;
+	memset(reply, 0, sizeof(struct nl_daemon_to_wedge));
+	reply->call_type = hdr->call_type;
+	reply->call_id = hdr->call_id;
+	reply->call_index = hdr->call_index;
+	reply->ret = REPLAY_ACK;
+	reply->msg = call->reply_len;
+	if (use_rings) {
+		replay_fill(buf + sizeof(struct nl_daemon_to_wedge) + RING_DESC_SIZE, call->reply_len, ~hdr->call_id);
+		data_len = ring_pack(ring_rx, buf + sizeof(struct nl_daemon_to_wedge), call->sock_index % FINS_RING_SLOTS, call->reply_len,
+				&ring_replies);
+	} else {
+		replay_fill(buf + sizeof(struct nl_daemon_to_wedge), call->reply_len, ~hdr->call_id);
+		data_len = call->reply_len;
+	}
+
+	if (nl_link_send(replay_link, buf, sizeof(struct nl_daemon_to_wedge) + data_len, 0)) {
+		fprintf(stderr, "daemon: reply %u failed\n", hdr->call_id);
+		bad++;
+	}
+}
+
+void *daemon_thread(void *local) {
+	uint8_t *buf;
+
+	buf = (uint8_t *) malloc(sizeof(struct nl_daemon_to_wedge) + RING_DESC_SIZE + 1024 * 1024);
+	while (!done) {
+		if (nl_link_recv(replay_link, 100, daemon_call, buf) == -1) {
+			perror("nl_link_recv");
+			exit(1);
+		}
+	}
+	free(buf);
+	return NULL;
+}
+
+/** the wedge side of the replies, several to a datagram like nl_data_ready() takes them */
+void *wedge_replies(void *local) {
+	struct nl_daemon_to_wedge reply;
+	struct nlmsghdr *nlh;
+	uint8_t *buf;
+	uint8_t *data;
+	ssize_t len;
+	uint32_t ring_len;
+	int where = -1;
+	int remaining;
+	int got = 0;
+
+	buf = (uint8_t *) malloc(REPLAY_RECV_SIZE + 1024 * 1024);
+	while (got < total) {
+		remaining = recv(fds[0], buf, REPLAY_RECV_SIZE + 1024 * 1024, 0);
+		if (remaining < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("wedge recv");
+			exit(1);
+		}
+		reply_dgrams++;
+
+		for (nlh = (struct nlmsghdr *) buf; NLMSG_OK(nlh, remaining); nlh = NLMSG_NEXT(nlh, remaining)) {
+			reply_msgs++;
+			//netlink only aligns messages on 4, the header's sock_id wants 8
+			memcpy(&reply, NLMSG_DATA(nlh), sizeof(struct nl_daemon_to_wedge));
+			data = (uint8_t *) NLMSG_DATA(nlh) + sizeof(struct nl_daemon_to_wedge);
+			len = NLMSG_PAYLOAD(nlh, 0) - sizeof(struct nl_daemon_to_wedge);
+			if (use_rings && reply.call_id < (uint32_t) total) {
+				data = ring_unpack(data, len, 1, &ring_len, &where);
+				len = ring_len;
+			}
+			if (data == NULL || reply.call_id >= (uint32_t) total || replied[reply.call_id] || reply.ret != REPLAY_ACK
+					|| reply.call_type != trace[reply.call_id % trace_num].call_type || len != (ssize_t) reply.msg
+					|| !replay_check(data, len, ~reply.call_id)) {
+				fprintf(stderr, "wedge: reply %u mangled, len=%zd\n", reply.call_id, len);
+				bad++;
+				continue;
+			}
+			if (use_rings && where != -1) {
+				ring_done(ring_pool[trace[reply.call_id % trace_num].sock_index % FINS_RING_SLOTS].rx, where);
+			}
+			replied[reply.call_id] = 1;
+			got++;
+			sem_post(&window_sem);
+		}
+	}
+	free(buf);
+	return NULL;
+}
+
+int main(int argc, char *argv[]) {
+	struct nl_link_stats stats;
+	pthread_t wedge_thread, reply_thread, daemon;
+	uint64_t start, elapsed;
+	int size = REPLAY_SOCKBUF;
+	int opt;
+	int i;
+
+	while ((opt = getopt(argc, argv, "n:w:r")) != -1) {
+		switch (opt) {
+		case 'n':
+			repeats = atoi(optarg);
+			break;
+		case 'w':
+			window = atoi(optarg);
+			break;
+		case 'r':
+			use_rings = 1;
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n repeats] [-w window] [-r] [trace]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (optind < argc) {
+		if (trace_load(argv[optind])) {
+			return 2;
+		}
+	} else {
+		trace_default();
+	}
+	if (repeats < 1 || window < 1) {
+		fprintf(stderr, "repeats and window must be positive\n");
+		return 2;
+	}
+	total = trace_num * repeats;
+	replied = (uint8_t *) calloc(total, 1);
+	if (use_rings) {
+		ring_pool = (struct fins_ring_slot *) calloc(FINS_RING_SLOTS, sizeof(struct fins_ring_slot));
+		for (i = 0; i < FINS_RING_SLOTS; i++) {
+			ring_init(&ring_tx[i], ring_pool[i].tx);
+			ring_init(&ring_rx[i], ring_pool[i].rx);
+		}
+	}
+
+	if (socketpair(AF_UNIX, SOCK_DGRAM, 0, fds) == -1) {
+		perror("socketpair");
+		return 1;
+	}
+	setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+	setsockopt(fds[0], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	setsockopt(fds[1], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+	setsockopt(fds[1], SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+	replay_link = nl_link_create(fds[1], NULL);
+	sem_init(&window_sem, 0, window);
+
+	start = replay_now_ns();
+	pthread_create(&daemon, NULL, daemon_thread, NULL);
+	pthread_create(&reply_thread, NULL, wedge_replies, NULL);
+	pthread_create(&wedge_thread, NULL, wedge_calls, NULL);
+
+	pthread_join(wedge_thread, NULL);
+	pthread_join(reply_thread, NULL);
+	elapsed = replay_now_ns() - start;
+	done = 1;
+	pthread_join(daemon, NULL);
+
+	nl_link_stats(replay_link, &stats);
+	if (stats.recv_dgrams != wedge_dgrams || stats.recv_calls != (uint64_t) total || reply_msgs != (uint64_t) total) {
+		fprintf(stderr, "sent %llu datagrams, the daemon read %llu\n", (unsigned long long) wedge_dgrams, (unsigned long long) stats.recv_dgrams);
+		bad++;
+	}
+	printf("%d calls (%d in the trace x %d), window %d: %.3f s, %.0f calls/s\n", total, trace_num, repeats, window, elapsed / 1e9,
+			total / (elapsed / 1e9));
+	printf("wedge -> daemon: %llu datagrams, %llu calls, %.1f datagrams per recvmmsg()\n", (unsigned long long) stats.recv_dgrams,
+			(unsigned long long) stats.recv_calls, stats.recv_batches ? (double) stats.recv_dgrams / stats.recv_batches : 0);
+	printf("daemon -> wedge: %llu replies in %llu datagrams, %.1f per datagram\n", (unsigned long long) reply_msgs,
+			(unsigned long long) reply_dgrams, reply_dgrams ? (double) reply_msgs / reply_dgrams : 0);
+	if (use_rings) {
+		printf("rings: %llu calls and %llu replies carried by a ring, the rest inline\n", (unsigned long long) ring_calls,
+				(unsigned long long) ring_replies);
+	}
+	printf("%s\n", bad ? "FAILED" : "ok");
+
+	nl_link_free(replay_link);
+	close(fds[0]);
+	close(fds[1]);
+	free(replied);
+	free(ring_pool);
+	free(trace);
+	return bad != 0;
+}
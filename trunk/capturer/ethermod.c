@@ -20,6 +20,9 @@
 
 #include "wifistub.h"
 #include <signal.h>
+#ifdef CAPTURER_PACKET_MMAP
+#include "packetmmap.h"
+#endif
 
 #define APP_NAME		"sniffex"
 #define APP_DESC		"Sniffer example using libpcap"
@@ -50,9 +53,9 @@ pcap_t *inject_handle;
 /** packet capture handle */
 pcap_t *capture_handle;
 
-/** Pipes Descriptors */
-int income_pipe_fd;
-int inject_pipe_fd;
+/** Rings shared with the core */
+finsShmRing capture_ring;
+finsShmRing inject_ring;
 /**
  * Globally defined counters
  *
@@ -82,6 +85,7 @@ void termination_handler(int sig) {
 
 int main() {
 
+	fins_log_init();
 	(void) signal(SIGINT, termination_handler);
 	print_app_banner();
 
@@ -99,17 +103,12 @@ int main() {
 		}
 	}
 
-	if (mkfifo(INCOME_PIPE, 0777) != 0) {
-		PRINT_DEBUG("Failed to mkfifo(INCOME_PIPE, 0777)");
-		exit(1);
-	}
-
-	if (mkfifo(INJECT_PIPE, 0777) != 0) {
-		PRINT_DEBUG("Failed to mkfifo(INJECT_PIPE, 0777)");
-		exit(1);
-	}
 	//^^^^^END^^^^^ !!!!!	
 
+	/** created before forking so both processes share the mappings, the core attaches to them by path */
+	capture_ring = create_shm_ring(FINS_CAPTURE_RING, SHM_RING_SLOTS);
+	inject_ring = create_shm_ring(FINS_INJECT_RING, SHM_RING_SLOTS);
+
 	fflush(stdout);
 	pid_t pID;
 	char device[20];
@@ -133,7 +132,11 @@ int main() {
 		PRINT_DEBUG("child started to capture \n");
 		//sleep(2);
 
+#ifdef CAPTURER_PACKET_MMAP
+		packet_capture_init(device);
+#else
 		capture_init(device);
+#endif
 
 	}
 
@@ -157,7 +160,11 @@ int main() {
 		 * process a lead
 		 */
 		PRINT_DEBUG("parent started to Inject \n");
+#ifdef CAPTURER_PACKET_MMAP
+		packet_inject_init(device);
+#else
 		inject_init(device);
+#endif
 		//char device2[] = "eth0";
 		//capture_init(device2);
 
@@ -0,0 +1,404 @@
+/*
+ * packetmmap.c
+ *
+ *  Created on: Oct 18, 2026
+ *
+ * @brief AF_PACKET TPACKET_V3 capture/inject backend, see packetmmap.h
+ */
+
+#include "wifistub.h"
+#include "packetmmap.h"
+#include <poll.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <net/if.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+
+/** Globally defined counters, see ethermod.c */
+extern int inject_count;
+extern int capture_count;
+
+/** capture threads take turns writing whole blocks into the capture ring, which has a single producer */
+static pthread_mutex_t packet_capture_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void packet_bind(int fd, char *device, uint16_t protocol) {
+	struct sockaddr_ll addr;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sll_family = AF_PACKET;
+	addr.sll_protocol = protocol;
+	addr.sll_ifindex = if_nametoindex(device);
+	if (addr.sll_ifindex == 0) {
+		PRINT_ERROR("no such device: device='%s'", device);
+		exit(-1);
+	}
+
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr))) {
+		PRINT_ERROR("bind failed: device='%s', errno=%d", device, errno);
+		exit(-1);
+	}
+}
+
+static int packet_socket(int version) {
+	int fd;
+
+	fd = socket(AF_PACKET, SOCK_RAW, 0); //nothing is received until bound with a protocol
+	if (fd == -1) {
+		PRINT_ERROR("socket failed, needs CAP_NET_RAW: errno=%d", errno);
+		exit(-1);
+	}
+	if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version))) {
+		PRINT_ERROR("TPACKET_V3 not supported: errno=%d", errno);
+		exit(-1);
+	}
+
+	return fd;
+}
+
+/** the pcap filter of capture_init() as classic BPF, so unwanted frames never reach the ring */
+static void packet_filter(int fd, const uint8_t *mac) {
+	uint32_t hi = mac[0] << 8 | mac[1];
+	uint32_t lo = (uint32_t) mac[2] << 24 | mac[3] << 16 | mac[4] << 8 | mac[5];
+	struct sock_filter code[] = {
+	/*0*/BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 0), //ether dst
+			/*1*/BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, hi, 0, 2),
+			/*2*/BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 2),
+			/*3*/BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, lo, 8, 0),
+			/*4*/BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 0), //ether broadcast
+			/*5*/BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0xffffffff, 0, 7),
+			/*6*/BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 4),
+			/*7*/BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0xffff, 0, 5),
+			/*8*/BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 6), //not ether src
+			/*9*/BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, hi, 0, 2),
+			/*10*/BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 8),
+			/*11*/BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, lo, 1, 0),
+			/*12*/BPF_STMT(BPF_RET | BPF_K, SNAP_LEN),
+			/*13*/BPF_STMT(BPF_RET | BPF_K, 0), };
+	struct sock_fprog prog;
+
+	prog.len = sizeof(code) / sizeof(code[0]);
+	prog.filter = code;
+	if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog))) {
+		PRINT_ERROR("SO_ATTACH_FILTER failed: errno=%d", errno);
+		exit(-1);
+	}
+}
+
+/**@brief opens a capture socket with a TPACKET_V3 RX ring, in promiscuous mode like pcap_open_live()
+ * @param rx the ring to set up
+ * @param device the interface
+ * @param fanout_id the PACKET_FANOUT group to join, or -1 to receive everything on this socket
+ * @param mac the address frames are filtered on, see PACKET_MMAP_MAC, or NULL for no filter
+ * @return 1
+ * */
+int packet_rx_open(struct packet_rx *rx, char *device, int fanout_id, const uint8_t *mac) {
+	struct tpacket_req3 req;
+	struct packet_mreq mreq;
+	int fanout;
+
+	memset(rx, 0, sizeof(struct packet_rx));
+	rx->fd = packet_socket(TPACKET_V3);
+	rx->block_size = PACKET_MMAP_RX_BLOCK_SIZE;
+	rx->block_num = PACKET_MMAP_RX_BLOCK_NUM;
+
+	if (mac != NULL) {
+		packet_filter(rx->fd, mac);
+	}
+
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = rx->block_size;
+	req.tp_block_nr = rx->block_num;
+	req.tp_frame_size = PACKET_MMAP_RX_FRAME_SIZE;
+	req.tp_frame_nr = rx->block_size / PACKET_MMAP_RX_FRAME_SIZE * rx->block_num;
+	req.tp_retire_blk_tov = PACKET_MMAP_RX_TIMEOUT;
+	if (setsockopt(rx->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req))) {
+		PRINT_ERROR("PACKET_RX_RING failed: errno=%d", errno);
+		exit(-1);
+	}
+
+	rx->map_len = (size_t) rx->block_size * rx->block_num;
+	rx->map = (uint8_t *) mmap(NULL, rx->map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, rx->fd, 0);
+	if (rx->map == MAP_FAILED) {
+		rx->map = (uint8_t *) mmap(NULL, rx->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, rx->fd, 0); //over RLIMIT_MEMLOCK
+		if (rx->map == MAP_FAILED) {
+			PRINT_ERROR("mmap failed: errno=%d", errno);
+			exit(-1);
+		}
+	}
+
+	packet_bind(rx->fd, device, htons(ETH_P_ALL));
+
+	memset(&mreq, 0, sizeof(mreq));
+	mreq.mr_ifindex = if_nametoindex(device);
+	mreq.mr_type = PACKET_MR_PROMISC;
+	if (setsockopt(rx->fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq))) {
+		PRINT_DEBUG("promiscuous mode not set: device='%s', errno=%d", device, errno);
+	}
+
+	if (fanout_id >= 0) {
+		fanout = (fanout_id & 0xffff) | (PACKET_FANOUT_HASH << 16); //a flow stays on one thread, so stays in order
+		if (setsockopt(rx->fd, SOL_PACKET, PACKET_FANOUT, &fanout, sizeof(fanout))) {
+			PRINT_ERROR("PACKET_FANOUT failed: fanout_id=%d, errno=%d", fanout_id, errno);
+			exit(-1);
+		}
+	}
+
+	PRINT_DEBUG("Exited: device='%s', fd=%d, fanout_id=%d", device, rx->fd, fanout_id);
+	return 1;
+}
+
+/** the kernel ring holds far more than the capture ring, so when the core falls behind the capture
+ * thread waits for it rather than dropping, and the frames queue up in the blocks still to be read */
+static int packet_rx_space(void) {
+	uint64_t start = 0;
+	struct timespec ts;
+	uint64_t now;
+
+	while (space_shm_ring(capture_ring) == 0) {
+		flush_shm_ring(capture_ring);
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		now = (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+		if (start == 0) {
+			start = now;
+		} else if (now - start > PACKET_MMAP_RX_TIMEOUT) {
+			return 0; //the core is gone or stuck
+		}
+		sched_yield();
+	}
+
+	return 1;
+}
+
+/**@brief moves the next block the kernel filled into the capture ring and gives the block back
+ * @param rx the ring
+ * @param timeout_ms longest wait for a block, -1 for none
+ * @return the number of frames written, 0 if no block came
+ * */
+int packet_rx_block(struct packet_rx *rx, int timeout_ms) {
+	struct tpacket_block_desc *bd = (struct tpacket_block_desc *) (rx->map + (size_t) rx->cur * rx->block_size);
+	struct tpacket3_hdr *ppd;
+	struct sockaddr_ll *sll;
+	struct pollfd pfd;
+	uint32_t num;
+	uint32_t i;
+	int count = 0;
+
+	if (!(__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+		pfd.fd = rx->fd;
+		pfd.events = POLLIN | POLLERR;
+		pfd.revents = 0;
+		poll(&pfd, 1, timeout_ms);
+
+		if (!(__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER)) {
+			return 0;
+		}
+	}
+
+	num = bd->hdr.bh1.num_pkts;
+	ppd = (struct tpacket3_hdr *) ((uint8_t *) bd + bd->hdr.bh1.offset_to_first_pkt);
+
+	pthread_mutex_lock(&packet_capture_lock);
+	for (i = 0; i < num; i++) {
+		sll = (struct sockaddr_ll *) ((uint8_t *) ppd + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+
+		if (sll->sll_pkttype == PACKET_OUTGOING) {
+			//our own injected frames, pcap dropped them with the filter on ether src
+		} else if (ppd->tp_snaplen != ppd->tp_len) {
+			PRINT_DEBUG("Snaplen value is not enough to capture the whole packet as it is on wire: len=%u", ppd->tp_len);
+		} else if (!packet_rx_space()) {
+			__atomic_fetch_add(&capture_ring->hdr->dropped, 1, __ATOMIC_RELAXED);
+			PRINT_DEBUG("capture ring full, dropped %u", capture_ring->hdr->dropped);
+		} else if (write_shm_ring(capture_ring, (uint8_t *) ppd + ppd->tp_mac, ppd->tp_snaplen)) {
+			count++;
+		}
+
+		ppd = (struct tpacket3_hdr *) ((uint8_t *) ppd + ppd->tp_next_offset);
+	}
+	flush_shm_ring(capture_ring);
+	capture_count += count;
+	pthread_mutex_unlock(&packet_capture_lock);
+
+	__atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+	rx->cur = (rx->cur + 1) % rx->block_num;
+
+	return count;
+}
+
+void packet_rx_close(struct packet_rx *rx) {
+	munmap(rx->map, rx->map_len);
+	close(rx->fd);
+}
+
+/**@brief opens an inject socket with a TPACKET_V3 TX ring, bypassing the qdisc like pcap_inject() can not
+ * @param tx the ring to set up
+ * @param device the interface
+ * @return 1
+ * */
+int packet_tx_open(struct packet_tx *tx, char *device) {
+	struct tpacket_req3 req;
+	int one = 1;
+
+	memset(tx, 0, sizeof(struct packet_tx));
+	tx->fd = packet_socket(TPACKET_V3);
+	tx->frame_size = PACKET_MMAP_TX_FRAME_SIZE;
+	tx->frame_num = PACKET_MMAP_TX_FRAME_NUM;
+
+	//malformed frames are marked available again instead of stalling the ring
+	if (setsockopt(tx->fd, SOL_PACKET, PACKET_LOSS, &one, sizeof(one))) {
+		PRINT_DEBUG("PACKET_LOSS not set: errno=%d", errno);
+	}
+	if (setsockopt(tx->fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one))) {
+		PRINT_DEBUG("PACKET_QDISC_BYPASS not set: errno=%d", errno);
+	}
+
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = tx->frame_size;
+	req.tp_block_nr = tx->frame_num;
+	req.tp_frame_size = tx->frame_size;
+	req.tp_frame_nr = tx->frame_num;
+	if (setsockopt(tx->fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req))) {
+		PRINT_ERROR("PACKET_TX_RING failed: errno=%d", errno);
+		exit(-1);
+	}
+
+	tx->map_len = (size_t) tx->frame_size * tx->frame_num;
+	tx->map = (uint8_t *) mmap(NULL, tx->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, tx->fd, 0);
+	if (tx->map == MAP_FAILED) {
+		PRINT_ERROR("mmap failed: errno=%d", errno);
+		exit(-1);
+	}
+
+	packet_bind(tx->fd, device, 0); //protocol 0, so the socket never queues received frames
+
+	PRINT_DEBUG("Exited: device='%s', fd=%d", device, tx->fd);
+	return 1;
+}
+
+/**@brief queues a frame in the TX ring, it goes out at the next packet_tx_flush()
+ * @param tx the ring
+ * @param frame the ethernet frame
+ * @param len its length
+ * @return 1 on success, 0 if the frame does not fit a TX frame
+ * */
+int packet_tx_write(struct packet_tx *tx, const uint8_t *frame, uint32_t len) {
+	struct tpacket3_hdr *hdr = (struct tpacket3_hdr *) (tx->map + (size_t) tx->cur * tx->frame_size);
+	struct pollfd pfd;
+
+	if (len > tx->frame_size - TPACKET_ALIGN(sizeof(struct tpacket3_hdr))) {
+		PRINT_ERROR("frame too big: len=%u", len);
+		return 0;
+	}
+
+	while (__atomic_load_n(&hdr->tp_status, __ATOMIC_ACQUIRE) != TP_STATUS_AVAILABLE) {
+		//ring full, kick the kernel and wait for it to send up to this frame
+		packet_tx_flush(tx);
+		pfd.fd = tx->fd;
+		pfd.events = POLLOUT;
+		pfd.revents = 0;
+		poll(&pfd, 1, 10);
+	}
+
+	memcpy((uint8_t *) hdr + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)), frame, len);
+	hdr->tp_len = len;
+	hdr->tp_snaplen = len;
+	hdr->tp_next_offset = 0;
+	__atomic_store_n(&hdr->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+
+	tx->cur = (tx->cur + 1) % tx->frame_num;
+	if (++tx->pending >= PACKET_MMAP_TX_BATCH) {
+		packet_tx_flush(tx);
+	}
+
+	return 1;
+}
+
+/**@brief hands every queued frame to the kernel with a single send()
+ * @param tx the ring
+ * */
+void packet_tx_flush(struct packet_tx *tx) {
+	if (tx->pending == 0) {
+		return;
+	}
+
+	if (send(tx->fd, NULL, 0, MSG_DONTWAIT) == -1 && errno != EAGAIN && errno != ENOBUFS) {
+		PRINT_DEBUG("Failed to inject the packets: pending=%u, errno=%d", tx->pending, errno);
+	}
+	tx->pending = 0; //anything not taken is still marked, and goes with the next send()
+}
+
+void packet_tx_close(struct packet_tx *tx) {
+	packet_tx_flush(tx);
+	munmap(tx->map, tx->map_len);
+	close(tx->fd);
+}
+
+void *packet_capture_thread(void *local) {
+	struct packet_rx *rx = (struct packet_rx *) local;
+
+	while (1) {
+		packet_rx_block(rx, -1);
+	}
+
+	return NULL;
+}
+
+/**@brief the capture_init() of this backend: CAPTURER_FANOUT threads, each with its own RX ring in one
+ * fanout group, all feeding the capture ring. Never returns
+ * @param device the interface
+ * */
+void packet_capture_init(char *device) {
+	uint8_t mac[] = PACKET_MMAP_MAC;
+	struct packet_rx rx[PACKET_MMAP_FANOUT_MAX];
+	pthread_t thread;
+	int fanout = CAPTURER_FANOUT;
+	int i;
+
+	if (fanout < 1 || fanout > PACKET_MMAP_FANOUT_MAX) {
+		PRINT_ERROR("CAPTURER_FANOUT out of range: fanout=%d, max=%d", fanout, PACKET_MMAP_FANOUT_MAX);
+		exit(-1);
+	}
+
+	printf("Device: %s\n", device);
+	printf("Capture threads: %d\n", fanout);
+
+	for (i = 0; i < fanout; i++) {
+		packet_rx_open(&rx[i], device, fanout > 1 ? getpid() : -1, mac);
+	}
+	for (i = 1; i < fanout; i++) {
+		if (pthread_create(&thread, NULL, packet_capture_thread, (void *) &rx[i])) {
+			PRINT_ERROR("pthread_create failed");
+			exit(-1);
+		}
+	}
+
+	packet_capture_thread((void *) &rx[0]);
+} // end of packet_capture_init
+
+/**@brief the inject_init() of this backend, frames go from the inject ring into the TX ring and are
+ * sent in batches, or as soon as the core stops sending. Never returns
+ * @param device the interface
+ * */
+void packet_inject_init(char *device) {
+	struct packet_tx tx;
+	uint32_t framelen;
+	uint8_t *frame;
+
+	packet_tx_open(&tx, device);
+
+	while (1) {
+		frame = read_shm_ring(inject_ring, &framelen);
+		if (frame == NULL) {
+			packet_tx_flush(&tx);
+			wait_shm_ring(inject_ring, -1);
+			continue;
+		}
+
+		PRINT_DEBUG("A frame of length %d will be injected-----", framelen);
+		if (packet_tx_write(&tx, frame, framelen)) {
+			inject_count++;
+		}
+		pop_shm_ring(inject_ring);
+	}
+} // end of packet_inject_init
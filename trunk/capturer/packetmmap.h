@@ -0,0 +1,69 @@
+/*
+ * packetmmap.h
+ *
+ *  Created on: Oct 18, 2026
+ *
+ * @brief capturer backend on AF_PACKET rings instead of libpcap. Frames are received in TPACKET_V3
+ * blocks mapped from the kernel, so a whole block is moved into the capture ring and flushed at once,
+ * and injected frames are queued in a mapped TX ring and handed to the kernel with one send() per batch.
+ * Built in place of the pcap backend when settings.finsmk has CAPTURER_BACKEND = packet_mmap.
+ */
+
+#ifndef PACKETMMAP_H_
+#define PACKETMMAP_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* RX ring: frames are packed into blocks, a block goes to user space when full or after PACKET_MMAP_RX_TIMEOUT ms */
+#define PACKET_MMAP_RX_BLOCK_SIZE (1 << 18)
+#define PACKET_MMAP_RX_BLOCK_NUM 64
+#define PACKET_MMAP_RX_FRAME_SIZE 2048
+#define PACKET_MMAP_RX_TIMEOUT 10
+
+/* TX ring: fixed size frames, big enough for SNAP_LEN */
+#define PACKET_MMAP_TX_FRAME_SIZE 8192
+#define PACKET_MMAP_TX_FRAME_NUM 512
+#define PACKET_MMAP_TX_BATCH 32 //frames queued before the kernel is kicked
+
+/* capture threads sharing the interface through PACKET_FANOUT, set by CAPTURER_FANOUT in settings.finsmk */
+#ifndef CAPTURER_FANOUT
+#define CAPTURER_FANOUT 1
+#endif
+#define PACKET_MMAP_FANOUT_MAX 16
+
+/** the capture filter capture_init() gives pcap: "(ether dst 080027445566) or (ether broadcast and (not ether src 080027445566))" */
+#define PACKET_MMAP_MAC {0x08, 0x00, 0x27, 0x44, 0x55, 0x66}
+
+struct packet_rx {
+	int fd;
+	uint8_t *map;
+	size_t map_len;
+	uint32_t block_num;
+	uint32_t block_size;
+	uint32_t cur; //next block to be handed over by the kernel
+};
+
+struct packet_tx {
+	int fd;
+	uint8_t *map;
+	size_t map_len;
+	uint32_t frame_num;
+	uint32_t frame_size;
+	uint32_t cur; //next frame to fill
+	uint32_t pending; //frames filled since the last send()
+};
+
+int packet_rx_open(struct packet_rx *rx, char *device, int fanout_id, const uint8_t *mac);
+int packet_rx_block(struct packet_rx *rx, int timeout_ms);
+void packet_rx_close(struct packet_rx *rx);
+
+int packet_tx_open(struct packet_tx *tx, char *device);
+int packet_tx_write(struct packet_tx *tx, const uint8_t *frame, uint32_t len);
+void packet_tx_flush(struct packet_tx *tx);
+void packet_tx_close(struct packet_tx *tx);
+
+void packet_capture_init(char *device);
+void packet_inject_init(char *device);
+
+#endif /* PACKETMMAP_H_ */
@@ -0,0 +1,162 @@
+/**@file test_packetmmap.c
+ *@brief runs the packet_mmap backend over a real interface with the core replaced by a reader of the
+ * capture ring: frames are injected through the TX ring and must come back through the RX rings intact
+ * and in order. Needs CAP_NET_RAW. Run as ./test_packetmmap [device] [threads] > /dev/null, on lo by
+ * default, or inject on one end of a veth pair and capture on the other with [device] = tx,rx.
+ * Results go to stderr.
+ */
+#include "wifistub.h"
+#include "packetmmap.h"
+#include <time.h>
+#include <sched.h>
+#include <net/if.h>
+
+#define TEST_RING FINS_SHM_ROOT "/fins_test_capture"
+#define TEST_FRAMES 1000000
+#define TEST_ETHERTYPE 0x88b5 //local experimental
+#define TEST_IDLE_S 1
+
+finsShmRing capture_ring;
+finsShmRing inject_ring;
+int inject_count = 0;
+int capture_count = 0;
+
+struct packet_rx test_rx[PACKET_MMAP_FANOUT_MAX];
+volatile int test_stop = 0;
+
+uint32_t test_received = 0; //our frames
+uint32_t test_next = 0; //sequence number expected next
+uint32_t test_bad = 0;
+
+uint64_t test_now_ns(clockid_t clock) {
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+uint32_t test_len(uint32_t i) {
+	return 60 + i % 1455;
+}
+
+/** plays one of the capturer's capture threads */
+void *test_capture(void *local) {
+	struct packet_rx *rx = (struct packet_rx *) local;
+
+	while (!test_stop) {
+		packet_rx_block(rx, 100);
+	}
+
+	pthread_exit(NULL);
+}
+
+/** plays the core's capturer_to_interface(), checking our frames and skipping anything else on the wire */
+void *test_core(void *local) {
+	finsShmRing ring = open_shm_ring(TEST_RING);
+	uint8_t *frame;
+	uint32_t len;
+	uint32_t seq;
+
+	while (!test_stop) {
+		frame = read_shm_ring(ring, &len);
+		if (frame == NULL) {
+			wait_shm_ring(ring, 100);
+			continue;
+		}
+
+		if (len >= 18 && frame[12] == TEST_ETHERTYPE >> 8 && frame[13] == (TEST_ETHERTYPE & 0xff)) {
+			memcpy(&seq, frame + 14, sizeof(seq));
+			if (seq < test_next || len != test_len(seq) || frame[len - 1] != (uint8_t) seq) {
+				test_bad++;
+			}
+			test_next = seq + 1;
+			test_received++;
+		}
+		pop_shm_ring(ring);
+	}
+
+	close_shm_ring(ring);
+	pthread_exit(NULL);
+}
+
+int main(int argc, char *argv[]) {
+	char tx_device[IFNAMSIZ] = "lo";
+	char rx_device[IFNAMSIZ] = "lo";
+	uint8_t frame[SNAP_LEN];
+	struct packet_tx tx;
+	pthread_t thread[PACKET_MMAP_FANOUT_MAX];
+	pthread_t core;
+	int threads = argc > 2 ? atoi(argv[2]) : 1;
+	uint64_t wall;
+	uint64_t cpu;
+	uint32_t len;
+	uint32_t i;
+	char *comma;
+
+	if (argc > 1) {
+		strncpy(tx_device, argv[1], IFNAMSIZ - 1);
+		strncpy(rx_device, argv[1], IFNAMSIZ - 1);
+		comma = strchr(argv[1], ',');
+		if (comma != NULL) {
+			tx_device[comma - argv[1]] = '\0';
+			strncpy(rx_device, comma + 1, IFNAMSIZ - 1);
+		}
+	}
+	if (threads < 1 || threads > PACKET_MMAP_FANOUT_MAX) {
+		PRINT_ERROR("threads out of range: threads=%d", threads);
+		exit(-1);
+	}
+
+	unlink(TEST_RING);
+	capture_ring = create_shm_ring(TEST_RING, SHM_RING_SLOTS);
+	pthread_create(&core, NULL, test_core, NULL);
+
+	for (i = 0; i < threads; i++) {
+		packet_rx_open(&test_rx[i], rx_device, threads > 1 ? getpid() : -1, NULL);
+	}
+	for (i = 0; i < threads; i++) {
+		pthread_create(&thread[i], NULL, test_capture, (void *) &test_rx[i]);
+	}
+	packet_tx_open(&tx, tx_device);
+
+	//transfer: our frames, broadcast so any interface delivers them
+	memset(frame, 0xff, 6);
+	memset(frame + 6, 0x02, 6);
+	frame[12] = TEST_ETHERTYPE >> 8;
+	frame[13] = TEST_ETHERTYPE & 0xff;
+
+	wall = test_now_ns(CLOCK_MONOTONIC);
+	for (i = 0; i < TEST_FRAMES; i++) {
+		len = test_len(i);
+		memcpy(frame + 14, &i, sizeof(i));
+		frame[len - 1] = (uint8_t) i;
+		packet_tx_write(&tx, frame, len);
+	}
+	packet_tx_flush(&tx);
+	wall = test_now_ns(CLOCK_MONOTONIC) - wall;
+	fprintf(stderr, "inject: frames=%u, %.2f Mframes/s\n", TEST_FRAMES, 1000.0 * TEST_FRAMES / wall);
+
+	//let the last blocks retire
+	usleep(100000 + 2000 * PACKET_MMAP_RX_TIMEOUT);
+	fprintf(stderr, "capture: threads=%d, frames=%u, lost=%u, bad=%u, ring dropped=%u\n", threads, capture_count, TEST_FRAMES - test_received,
+			test_bad, capture_ring->hdr->dropped);
+
+	//idle: capture threads and the reader should all be asleep
+	wall = test_now_ns(CLOCK_MONOTONIC);
+	cpu = test_now_ns(CLOCK_PROCESS_CPUTIME_ID);
+	sleep(TEST_IDLE_S);
+	cpu = test_now_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+	wall = test_now_ns(CLOCK_MONOTONIC) - wall;
+	fprintf(stderr, "idle: %.3f%% of one core\n", 100.0 * cpu / wall);
+
+	test_stop = 1;
+	for (i = 0; i < threads; i++) {
+		pthread_join(thread[i], NULL);
+		packet_rx_close(&test_rx[i]);
+	}
+	pthread_join(core, NULL);
+	packet_tx_close(&tx);
+	close_shm_ring(capture_ring);
+	unlink(TEST_RING);
+
+	return test_bad != 0 || test_received == 0;
+}
@@ -121,7 +121,6 @@ void print_frame(const u_char *payload, int len) {
 	static int count = 1; /* packet counter */
 	//u_char * packet; /* Packet Pointer */
 	//struct data_to_pass data;
-	u_int numBytes;
 	u_int dataLength;
 	PRINT_DEBUG("Packet number %d: has been captured \n", count);
 
@@ -133,28 +132,22 @@ void print_frame(const u_char *payload, int len) {
 	//data.frame = (u_char *) malloc(header->caplen);
 	//memcpy(data.frame,packetReceived,data.frameLength);
 
-	/** Write the length of the received frame to the pipe, then write the frame contents
-	 * This part is an atomic critical section. Need to be handled carefully
+	/** Copy the frame into the capture ring, the core sees it when capture_init() flushes
+	 * the ring after each pcap_dispatch() batch
 	 */
 	dataLength = header->caplen;
 
-	print_frame(packetReceived, dataLength);
-	fflush(stdout);
-
-	numBytes = write(income_pipe_fd, &dataLength, sizeof(u_int));
-	if (numBytes <= 0) {
-		PRINT_DEBUG("numBytes written %d\n", numBytes);
-		//return (0);
-		return;
+	if (FINS_LOG_ON(FINS_LOG_DEBUG)) {
+		print_frame(packetReceived, dataLength);
+		fflush(stdout);
 	}
 
-	numBytes = write(income_pipe_fd, packetReceived, dataLength);
-	if (numBytes <= 0) {
-		PRINT_DEBUG("numBytes written %d\n", numBytes);
+	if (!write_shm_ring(capture_ring, packetReceived, dataLength)) {
+		PRINT_DEBUG("capture ring full, dropped %u\n", capture_ring->hdr->dropped);
 		//return (0);
 		return;
 	}
-	PRINT_DEBUG("A frame of length %d has been captured \n", numBytes);
+	PRINT_DEBUG("A frame of length %d has been captured \n", dataLength);
 
 	capture_count++;
 	//return (1);
@@ -191,14 +184,6 @@ void capture_init(char *interface) {
 	 }
 	 */
 
-	/* has to run without return check to work as blocking call */
-	/** It blocks until the other communication side opens the pipe */
-	income_pipe_fd = open(INCOME_PIPE, O_WRONLY);
-	if (income_pipe_fd == -1) {
-		PRINT_DEBUG("Income Pipe failure \n");
-		exit(EXIT_FAILURE);
-	}
-
 	//TODO recv MAC/ip address from Core?
 
 	/* Build the filter expression based on the mac address of the passed
@@ -263,8 +248,14 @@ void capture_init(char *interface) {
 #endif
 	//CHANGE END !!!!!	
 
-	/* now we can set our callback function */
-	pcap_loop(capture_handle, num_packets, got_packet, (u_char *) NULL);
+	/* now we can set our callback function, each batch pcap hands over is published to the core at once */
+	while (num_packets == 0 || capture_count < num_packets) {
+		if (pcap_dispatch(capture_handle, -1, got_packet, (u_char *) NULL) < 0) {
+			PRINT_DEBUG("pcap_dispatch failed: %s", pcap_geterr(capture_handle));
+			break;
+		}
+		flush_shm_ring(capture_ring);
+	}
 	/* cleanup */
 	pcap_freecode(&fp);
 	free(filter_exp);
@@ -286,26 +277,15 @@ void inject_init(char *interface) {
 	//unsigned char dev_macAddress[17];
 	strcpy((char *)device, interface);
 
-	int framelen;
-	//char *frame;
+	uint32_t framelen;
+	uint8_t *frame;
 	int numBytes;
 	unsigned char *dev;
 	dev = (unsigned char *) device;
 	char errbuf[PCAP_ERRBUF_SIZE]; /* error buffer */
-	char frame[SNAP_LEN];
 
 	//getDevice_MACAddress(dev_macAddress,dev);
 
-	/** has to run without return check to work as blocking call
-	 * It blocks until the other communication side opens the pipe
-	 * */
-	//	mkfifo(INJECT_PIPE, 0777);
-	inject_pipe_fd = open(INJECT_PIPE, O_RDONLY);
-	if (inject_pipe_fd == -1) {
-		PRINT_DEBUG("Inject Pipe failure \n");
-		exit(EXIT_FAILURE);
-	}
-
 	/** Setup the Injection Interface */
 	if ((inject_handle = pcap_open_live((char *)dev, BUFSIZ, 1, -1, errbuf)) == NULL) {
 		PRINT_DEBUG( "\nError: %s\n", errbuf);
@@ -314,23 +294,18 @@ void inject_init(char *interface) {
 
 	/** --------------------------------------------------------------------------*/
 	while (1) {
-		numBytes = read(inject_pipe_fd, &framelen, sizeof(int));
-		if (numBytes <= 0) {
-			PRINT_DEBUG("numBytes written %d\n", numBytes);
-			break;
-		}
-
-		//frame = (char *) malloc (framelen);
-		numBytes = read(inject_pipe_fd, frame, framelen);
-
-		if (numBytes <= 0) {
-			PRINT_DEBUG("numBytes written %d\n", numBytes);
-			break;
+		/** frames are injected straight from the ring, sleeping while the core sends nothing */
+		frame = read_shm_ring(inject_ring, &framelen);
+		if (frame == NULL) {
+			wait_shm_ring(inject_ring, -1);
+			continue;
 		}
 
 		PRINT_DEBUG("A frame of length %d will be injected-----", framelen);
 
-		print_frame((u_char *)frame, framelen);
+		if (FINS_LOG_ON(FINS_LOG_DEBUG)) {
+			print_frame((u_char *) frame, framelen);
+		}
 		/**
 		 * Inject the Ethernet Frame into the Device
 		 */
@@ -342,6 +317,7 @@ void inject_init(char *interface) {
 			PRINT_DEBUG("\n Message #%d has been injected whose size is %d  ", inject_count, numBytes);
 			inject_count++;
 		}
+		pop_shm_ring(inject_ring);
 	} // end of while loop
 
 } // inject_init()
@@ -357,10 +333,10 @@ void wifi_terminate() {
 
 /** -------------------------------------------------------------*/
 
-void close_pipes() {
-	unlink(INCOME_PIPE);
-	unlink(INJECT_PIPE);
-	close(income_pipe_fd);
-	close(inject_pipe_fd);
+void close_rings() {
+	unlink(FINS_CAPTURE_RING);
+	unlink(FINS_INJECT_RING);
+	close_shm_ring(capture_ring);
+	close_shm_ring(inject_ring);
 
 }
@@ -28,6 +28,7 @@
 #include <pthread.h>
 #include "getMAC_Address.h"
 #include "finsdebug.h"
+#include "shmRing.h"
 
 /* default snap length (maximum bytes per packet to capture) */
 //#define SNAP_LEN 1518
@@ -39,16 +40,16 @@ extern pcap_t *inject_handle;
 /* packet capture handle */
 extern pcap_t *capture_handle;
 
-/** The structure of the data to be written to the INCOME_PIPE */
+/** The structure of the data to be written to the capture ring */
 struct data_to_pass {
 	u_int frameLength;
 	unsigned char *frame;
 };
 
-/** The Buffering pipes between the Incoming Handlers and FINS Space */
-extern int income_pipe_fd;
+/** The Buffering rings between the Incoming Handlers and FINS Space */
+extern finsShmRing capture_ring;
 
-extern int inject_pipe_fd;
+extern finsShmRing inject_ring;
 
 // ADDED mrd015 !!!!!
 #ifdef BUILD_FOR_ANDROID
@@ -57,15 +58,13 @@ extern int inject_pipe_fd;
 	#define FINS_TMP_ROOT "/tmp/fins"
 #endif
 
-#define INCOME_PIPE FINS_TMP_ROOT "/fins_capture"
-#define INJECT_PIPE FINS_TMP_ROOT "/fins_inject"
 
 /** Functions prototypes fully defined in wifistub.c */
 
 void capture_init(char *device);
 void inject_init(char *device);
 void wifi_terminate();
-void close_pipes();
+void close_rings();
 void /*int*/ got_packet(u_char *args, const struct pcap_pkthdr *header,
 		const u_char *packetReceived);
 int wifi_inject(char *frameToSend, int frameLength);
@@ -0,0 +1,319 @@
+/**
+ * @file finschecksum.c
+ *
+ * @date Oct 18, 2026
+ * @brief the shared Internet checksum, see finschecksum.h
+ *
+ * A one's complement sum does not care about the order the 16 bit words are added in or how they
+ * are grouped, so the kernels add whole 64 bit words (or 32 bit lanes widened to 64 bits) and the
+ * carries are folded back in at the end. Loading the words natively keeps the sum in the byte order
+ * of the buffer, which is why nothing here swaps bytes.
+ */
+
+#include <string.h>
+#include <arpa/inet.h>
+#include "finsdebug.h"
+#include "finschecksum.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FINS_CSUM_X86
+#include <immintrin.h>
+#endif
+
+struct csum_kernel {
+	uint64_t (*sum)(const uint8_t *pt, uint32_t len);
+	uint64_t (*copy)(uint8_t *dst, const uint8_t *src, uint32_t len);
+};
+
+static inline uint64_t csum_add64(uint64_t sum, uint64_t w) {
+	sum += w;
+	return sum + (sum < w);
+}
+
+static inline uint32_t csum_fold64(uint64_t sum) {
+	sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+	sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+	return (uint32_t) sum;
+}
+
+/** the last len < 8 bytes, an odd byte is padded with a 0 after it like RFC 1071 says */
+static inline uint64_t csum_tail(const uint8_t *pt, uint32_t len, uint64_t sum) {
+	uint32_t w32;
+	uint16_t w16;
+
+	if (len & 4) {
+		memcpy(&w32, pt, 4);
+		sum = csum_add64(sum, w32);
+		pt += 4;
+	}
+	if (len & 2) {
+		memcpy(&w16, pt, 2);
+		sum = csum_add64(sum, w16);
+		pt += 2;
+	}
+	if (len & 1) {
+		w16 = 0;
+		memcpy(&w16, pt, 1);
+		sum = csum_add64(sum, w16);
+	}
+	return sum;
+}
+
+static uint64_t csum_word(const uint8_t *pt, uint32_t len) {
+	uint64_t sum = 0;
+	uint64_t w[4];
+
+	while (len >= 32) {
+		memcpy(w, pt, 32);
+		sum = csum_add64(sum, w[0]);
+		sum = csum_add64(sum, w[1]);
+		sum = csum_add64(sum, w[2]);
+		sum = csum_add64(sum, w[3]);
+		pt += 32;
+		len -= 32;
+	}
+	while (len >= 8) {
+		memcpy(w, pt, 8);
+		sum = csum_add64(sum, w[0]);
+		pt += 8;
+		len -= 8;
+	}
+	return csum_tail(pt, len, sum);
+}
+
+static uint64_t csum_word_copy(uint8_t *dst, const uint8_t *src, uint32_t len) {
+	uint64_t sum = 0;
+	uint64_t w[4];
+
+	while (len >= 32) {
+		memcpy(w, src, 32);
+		memcpy(dst, w, 32);
+		sum = csum_add64(sum, w[0]);
+		sum = csum_add64(sum, w[1]);
+		sum = csum_add64(sum, w[2]);
+		sum = csum_add64(sum, w[3]);
+		src += 32;
+		dst += 32;
+		len -= 32;
+	}
+	while (len >= 8) {
+		memcpy(w, src, 8);
+		memcpy(dst, w, 8);
+		sum = csum_add64(sum, w[0]);
+		src += 8;
+		dst += 8;
+		len -= 8;
+	}
+	memcpy(dst, src, len);
+	return csum_tail(src, len, sum);
+}
+
+#ifdef FINS_CSUM_X86
+/*
+ * The vector kernels widen each 32 bit lane to 64 bits and add, so the lanes cannot overflow before
+ * 2^32 adds and no carries have to be tracked inside the loop.
+ */
+__attribute__ ((target("sse2")))
+static inline __m128i csum_sse2_add(__m128i acc, __m128i v) {
+	__m128i zero = _mm_setzero_si128();
+
+	acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(v, zero));
+	return _mm_add_epi64(acc, _mm_unpackhi_epi32(v, zero));
+}
+
+__attribute__ ((target("sse2")))
+static inline uint64_t csum_sse2_reduce(__m128i acc) {
+	uint64_t lane[2];
+
+	_mm_storeu_si128((__m128i *) lane, acc);
+	return csum_add64(lane[0], lane[1]);
+}
+
+__attribute__ ((target("sse2")))
+static uint64_t csum_sse2(const uint8_t *pt, uint32_t len) {
+	__m128i acc0 = _mm_setzero_si128();
+	__m128i acc1 = _mm_setzero_si128();
+
+	while (len >= 64) {
+		acc0 = csum_sse2_add(acc0, _mm_loadu_si128((const __m128i *) pt));
+		acc1 = csum_sse2_add(acc1, _mm_loadu_si128((const __m128i *) (pt + 16)));
+		acc0 = csum_sse2_add(acc0, _mm_loadu_si128((const __m128i *) (pt + 32)));
+		acc1 = csum_sse2_add(acc1, _mm_loadu_si128((const __m128i *) (pt + 48)));
+		pt += 64;
+		len -= 64;
+	}
+	while (len >= 16) {
+		acc0 = csum_sse2_add(acc0, _mm_loadu_si128((const __m128i *) pt));
+		pt += 16;
+		len -= 16;
+	}
+	return csum_add64(csum_sse2_reduce(_mm_add_epi64(acc0, acc1)), csum_word(pt, len));
+}
+
+__attribute__ ((target("sse2")))
+static uint64_t csum_sse2_copy(uint8_t *dst, const uint8_t *src, uint32_t len) {
+	__m128i acc0 = _mm_setzero_si128();
+	__m128i acc1 = _mm_setzero_si128();
+	__m128i v0, v1;
+
+	while (len >= 32) {
+		v0 = _mm_loadu_si128((const __m128i *) src);
+		v1 = _mm_loadu_si128((const __m128i *) (src + 16));
+		_mm_storeu_si128((__m128i *) dst, v0);
+		_mm_storeu_si128((__m128i *) (dst + 16), v1);
+		acc0 = csum_sse2_add(acc0, v0);
+		acc1 = csum_sse2_add(acc1, v1);
+		src += 32;
+		dst += 32;
+		len -= 32;
+	}
+	return csum_add64(csum_sse2_reduce(_mm_add_epi64(acc0, acc1)), csum_word_copy(dst, src, len));
+}
+
+__attribute__ ((target("avx2")))
+static inline __m256i csum_avx2_add(__m256i acc, __m256i v) {
+	__m256i zero = _mm256_setzero_si256();
+
+	acc = _mm256_add_epi64(acc, _mm256_unpacklo_epi32(v, zero));
+	return _mm256_add_epi64(acc, _mm256_unpackhi_epi32(v, zero));
+}
+
+__attribute__ ((target("avx2")))
+static inline uint64_t csum_avx2_reduce(__m256i acc) {
+	uint64_t lane[4];
+
+	_mm256_storeu_si256((__m256i *) lane, acc);
+	return csum_add64(csum_add64(lane[0], lane[1]), csum_add64(lane[2], lane[3]));
+}
+
+__attribute__ ((target("avx2")))
+static uint64_t csum_avx2(const uint8_t *pt, uint32_t len) {
+	__m256i acc0 = _mm256_setzero_si256();
+	__m256i acc1 = _mm256_setzero_si256();
+
+	while (len >= 128) {
+		acc0 = csum_avx2_add(acc0, _mm256_loadu_si256((const __m256i *) pt));
+		acc1 = csum_avx2_add(acc1, _mm256_loadu_si256((const __m256i *) (pt + 32)));
+		acc0 = csum_avx2_add(acc0, _mm256_loadu_si256((const __m256i *) (pt + 64)));
+		acc1 = csum_avx2_add(acc1, _mm256_loadu_si256((const __m256i *) (pt + 96)));
+		pt += 128;
+		len -= 128;
+	}
+	while (len >= 32) {
+		acc0 = csum_avx2_add(acc0, _mm256_loadu_si256((const __m256i *) pt));
+		pt += 32;
+		len -= 32;
+	}
+	return csum_add64(csum_avx2_reduce(_mm256_add_epi64(acc0, acc1)), csum_word(pt, len));
+}
+
+__attribute__ ((target("avx2")))
+static uint64_t csum_avx2_copy(uint8_t *dst, const uint8_t *src, uint32_t len) {
+	__m256i acc0 = _mm256_setzero_si256();
+	__m256i acc1 = _mm256_setzero_si256();
+	__m256i v0, v1;
+
+	while (len >= 64) {
+		v0 = _mm256_loadu_si256((const __m256i *) src);
+		v1 = _mm256_loadu_si256((const __m256i *) (src + 32));
+		_mm256_storeu_si256((__m256i *) dst, v0);
+		_mm256_storeu_si256((__m256i *) (dst + 32), v1);
+		acc0 = csum_avx2_add(acc0, v0);
+		acc1 = csum_avx2_add(acc1, v1);
+		src += 64;
+		dst += 64;
+		len -= 64;
+	}
+	return csum_add64(csum_avx2_reduce(_mm256_add_epi64(acc0, acc1)), csum_word_copy(dst, src, len));
+}
+#endif
+
+static const struct csum_kernel csum_kernels[FINS_CSUM_KERNELS] = {
+		{ csum_word, csum_word_copy },
+#ifdef FINS_CSUM_X86
+		{ csum_sse2, csum_sse2_copy },
+		{ csum_avx2, csum_avx2_copy },
+#else
+		{ NULL, NULL },
+		{ NULL, NULL },
+#endif
+		};
+
+/** the kernel in use, set on first use, every thread that races there picks the same one */
+static const struct csum_kernel *csum_kernel;
+
+static int csum_supported(int kernel) {
+	switch (kernel) {
+	case FINS_CSUM_WORD:
+		return 1;
+#ifdef FINS_CSUM_X86
+	case FINS_CSUM_SSE2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("sse2");
+	case FINS_CSUM_AVX2:
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+#endif
+	default:
+		return 0;
+	}
+}
+
+static const struct csum_kernel *csum_select(void) {
+	int kernel;
+
+	for (kernel = FINS_CSUM_KERNELS - 1; kernel > FINS_CSUM_WORD; kernel--) {
+		if (csum_supported(kernel)) {
+			break;
+		}
+	}
+	PRINT_DEBUG("kernel=%d", kernel);
+	csum_kernel = &csum_kernels[kernel];
+	return csum_kernel;
+}
+
+int fins_csum_use(int kernel) {
+	if (kernel < 0 || kernel >= FINS_CSUM_KERNELS || !csum_supported(kernel)) {
+		return 0;
+	}
+	csum_kernel = &csum_kernels[kernel];
+	return 1;
+}
+
+uint32_t fins_csum_partial(const void *buf, uint32_t len, uint32_t sum) {
+	const struct csum_kernel *kernel = csum_kernel ? csum_kernel : csum_select();
+
+	return csum_fold64(csum_add64(sum, kernel->sum((const uint8_t *) buf, len)));
+}
+
+uint32_t fins_csum_copy(void *dst, const void *src, uint32_t len, uint32_t sum) {
+	const struct csum_kernel *kernel = csum_kernel ? csum_kernel : csum_select();
+
+	return csum_fold64(csum_add64(sum, kernel->copy((uint8_t *) dst, (const uint8_t *) src, len)));
+}
+
+uint32_t fins_csum_pseudo(uint32_t src_ip_netw, uint32_t dst_ip_netw, uint8_t protocol, uint16_t len, uint32_t sum) {
+	uint64_t total = (uint64_t) sum + src_ip_netw + dst_ip_netw + htons(protocol) + htons(len);
+
+	return csum_fold64(total);
+}
+
+uint16_t fins_csum_fold(uint32_t sum) {
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	sum = (sum & 0xFFFF) + (sum >> 16);
+	return (uint16_t) ~sum;
+}
+
+uint16_t fins_csum_update16(uint16_t check, uint16_t old, uint16_t new) {
+	uint32_t sum = (uint16_t) ~check + (uint16_t) ~old + new;
+
+	return fins_csum_fold(sum);
+}
+
+uint16_t fins_csum_update32(uint16_t check, uint32_t old, uint32_t new) {
+	uint32_t sum = (uint16_t) ~check;
+
+	sum += (uint16_t) ~(old >> 16) + (uint16_t) ~(old & 0xFFFF);
+	sum += (new >> 16) + (new & 0xFFFF);
+	return fins_csum_fold(sum);
+}
@@ -0,0 +1,43 @@
+/**
+ * @file finschecksum.h
+ *
+ * @date Oct 18, 2026
+ * @brief the Internet checksum (RFC 1071) shared by IPv4, UDP, TCP and ICMP. Sums are kept in the
+ * byte order of the buffer, so a checksum from fins_csum_fold() is stored into a header as it is and
+ * a buffer that checks out folds to 0 on any host. The sum is done by the widest kernel the cpu has
+ * (AVX2, SSE2 or 64 bit words), picked on first use.
+ *
+ * A partial sum can be carried across several buffers, in any order, as long as each one starts at an
+ * even offset into the packet.
+ */
+
+#ifndef FINSCHECKSUM_H_
+#define FINSCHECKSUM_H_
+
+#include <stdint.h>
+
+#define FINS_CSUM_WORD 0
+#define FINS_CSUM_SSE2 1
+#define FINS_CSUM_AVX2 2
+#define FINS_CSUM_KERNELS 3
+
+/** adds len bytes at buf to the partial sum */
+uint32_t fins_csum_partial(const void *buf, uint32_t len, uint32_t sum);
+
+/** copies len bytes from src to dst and adds them to the partial sum, in one pass */
+uint32_t fins_csum_copy(void *dst, const void *src, uint32_t len, uint32_t sum);
+
+/** adds the IPv4 pseudo header, addresses in network order, len in host order */
+uint32_t fins_csum_pseudo(uint32_t src_ip_netw, uint32_t dst_ip_netw, uint8_t protocol, uint16_t len, uint32_t sum);
+
+/** folds a partial sum to 16 bits and complements it, the result is in network order */
+uint16_t fins_csum_fold(uint32_t sum);
+
+/** checksum after a 16/32 bit field changes from old to new (RFC 1624 eqn. 3), all in network order */
+uint16_t fins_csum_update16(uint16_t check, uint16_t old, uint16_t new);
+uint16_t fins_csum_update32(uint16_t check, uint32_t old, uint32_t new);
+
+/** picks the kernel to use, returns 0 if this cpu does not have it */
+int fins_csum_use(int kernel);
+
+#endif /* FINSCHECKSUM_H_ */
@@ -0,0 +1,296 @@
+/*
+ * finsdebug.c
+ *
+ * @date Oct 18, 2026
+ * @brief log levels and the debug message ring, see finsdebug.h
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "finsdebug.h"
+
+#define FINS_LOG_SLOTS 4096 //must be a power of 2
+#define FINS_LOG_LINE 256 //longer messages are cut
+
+/** every module logs everything until fins_log_init() says otherwise, as before the levels existed */
+uint8_t fins_log_levels[FINS_LOG_MODULES] = { [0 ... FINS_LOG_MODULES - 1] = FINS_LOG_DEBUG };
+
+static const char *fins_log_names[FINS_LOG_MODULES] = { "other", "capturer", "switch", "daemon", "interface", "ipv4", "arp", "udp", "tcp", "icmp", "rtm" };
+static const char *fins_log_level_names[] = { "none", "error", "debug" };
+
+/** one formatted message, seq tells whose turn the slot is like in a bounded MPMC queue */
+struct fins_log_slot {
+	uint32_t seq;
+	uint32_t len;
+	char text[FINS_LOG_LINE];
+};
+
+static struct fins_log_slot fins_log_ring[FINS_LOG_SLOTS];
+static uint32_t fins_log_head; //next slot a thread claims
+static uint32_t fins_log_tail; //next slot written out, only touched under fins_log_lock
+static uint32_t fins_log_dropped;
+static uint32_t fins_log_waiting; //writer is about to sleep on fins_log_wake
+static uint32_t fins_log_wake;
+static int fins_log_sync;
+
+static uint32_t fins_log_running; //writer thread started in this process
+
+static pthread_mutex_t fins_log_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t fins_log_start_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define FINS_LOG_LINGER_MS 10 //the writer batches for this long once messages come in
+
+static void fins_log_futex(uint32_t *addr, int op, uint32_t val, int timeout_ms) {
+	struct timespec ts;
+
+	ts.tv_sec = timeout_ms / 1000;
+	ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+	syscall(SYS_futex, addr, op, val, timeout_ms >= 0 ? &ts : NULL, NULL, 0);
+}
+
+/** writes out everything published so far, call with fins_log_lock held */
+static int fins_log_drain(void) {
+	struct fins_log_slot *slot;
+	uint32_t dropped;
+	int count = 0;
+
+	while (1) {
+		slot = &fins_log_ring[fins_log_tail & (FINS_LOG_SLOTS - 1)];
+		if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != fins_log_tail + 1) {
+			break;
+		}
+		fwrite(slot->text, 1, slot->len, stdout);
+		__atomic_store_n(&slot->seq, fins_log_tail + FINS_LOG_SLOTS, __ATOMIC_RELEASE);
+		fins_log_tail++;
+		count++;
+	}
+
+	dropped = __atomic_exchange_n(&fins_log_dropped, 0, __ATOMIC_RELAXED);
+	if (dropped) {
+		printf("DEBUG: log ring full, dropped %u messages\n", dropped);
+	}
+	if (count || dropped) {
+		fflush(stdout);
+	}
+
+	return count;
+}
+
+static void *fins_log_writer(void *local) {
+	uint32_t wake;
+	int count;
+
+	while (1) {
+		wake = __atomic_load_n(&fins_log_wake, __ATOMIC_ACQUIRE);
+
+		pthread_mutex_lock(&fins_log_lock);
+		count = fins_log_drain();
+		pthread_mutex_unlock(&fins_log_lock);
+		if (count) {
+			//more are likely on the way, collect them without a wake per message
+			fins_log_futex(&fins_log_wake, FUTEX_WAIT, wake, FINS_LOG_LINGER_MS);
+			continue;
+		}
+
+		__atomic_store_n(&fins_log_waiting, 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST); //pairs with the fence in fins_log_debug
+		if (__atomic_load_n(&fins_log_ring[fins_log_tail & (FINS_LOG_SLOTS - 1)].seq, __ATOMIC_ACQUIRE) != fins_log_tail + 1) {
+			fins_log_futex(&fins_log_wake, FUTEX_WAIT, wake, -1);
+		}
+		__atomic_store_n(&fins_log_waiting, 0, __ATOMIC_RELAXED);
+	}
+
+	return NULL;
+}
+
+static void fins_log_prepare(void) {
+	pthread_mutex_lock(&fins_log_lock);
+	fins_log_drain(); //or the child would write them out again
+}
+
+static void fins_log_parent(void) {
+	pthread_mutex_unlock(&fins_log_lock);
+}
+
+/** the writer did not come along, the child starts its own on its first message */
+static void fins_log_child(void) {
+	pthread_mutex_init(&fins_log_lock, NULL);
+	__atomic_store_n(&fins_log_running, 0, __ATOMIC_RELEASE);
+}
+
+static void fins_log_start(void) {
+	static int ready = 0;
+	pthread_attr_t attr;
+	pthread_t thread;
+	uint32_t i;
+
+	pthread_mutex_lock(&fins_log_start_lock);
+	if (__atomic_load_n(&fins_log_running, __ATOMIC_ACQUIRE)) {
+		pthread_mutex_unlock(&fins_log_start_lock);
+		return;
+	}
+
+	if (!ready) {
+		for (i = 0; i < FINS_LOG_SLOTS; i++) {
+			fins_log_ring[i].seq = i;
+		}
+		atexit(fins_log_flush); //the usual PRINT_ERROR + exit(-1) should not lose what came before it
+		pthread_atfork(fins_log_prepare, fins_log_parent, fins_log_child);
+		ready = 1;
+	}
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_create(&thread, &attr, fins_log_writer, NULL)) {
+		fins_log_sync = 1; //still log, just not in the background
+	}
+	pthread_attr_destroy(&attr);
+
+	__atomic_store_n(&fins_log_running, 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&fins_log_start_lock);
+}
+
+/**@brief sets log levels from a string like "error,tcp=debug,sync"
+ * @param config comma separated [module=]level, level one of none/error/debug, a bare level applies to
+ * every module. "sync" writes debug messages at once instead of through the ring, "async" goes back
+ * @return 1 on success, 0 if part of config was not understood
+ * */
+int fins_log_set(const char *config) {
+	char buf[200];
+	char *token;
+	char *save;
+	char *level;
+	int module;
+	int value;
+	int ret = 1;
+
+	strncpy(buf, config, sizeof(buf) - 1);
+	buf[sizeof(buf) - 1] = '\0';
+
+	for (token = strtok_r(buf, ",", &save); token != NULL; token = strtok_r(NULL, ",", &save)) {
+		if (strcmp(token, "sync") == 0 || strcmp(token, "async") == 0) {
+			fins_log_sync = token[0] == 's';
+			continue;
+		}
+
+		level = strchr(token, '=');
+		if (level != NULL) {
+			*level++ = '\0';
+			for (module = 0; module < FINS_LOG_MODULES && strcmp(token, fins_log_names[module]); module++)
+				;
+		} else {
+			level = token;
+			module = -1;
+		}
+
+		for (value = FINS_LOG_NONE; value <= FINS_LOG_DEBUG && strcmp(level, fins_log_level_names[value]); value++)
+			;
+		if (module == FINS_LOG_MODULES || value > FINS_LOG_DEBUG) {
+			fprintf(stderr, "ERROR(%s, %s, %d):unknown log setting: '%s'\n", __FILE__, __FUNCTION__, __LINE__, token);
+			ret = 0;
+			continue;
+		}
+
+		if (module == -1) {
+			memset(fins_log_levels, value, sizeof(fins_log_levels));
+		} else {
+			fins_log_levels[module] = value;
+		}
+	}
+
+	return ret;
+}
+
+/**@brief reads the log levels from the FINS_LOG environment variable, see fins_log_set(). Called first
+ * thing in main(), unset leaves every module at debug
+ * */
+void fins_log_init(void) {
+	char *config = getenv("FINS_LOG");
+
+	if (config != NULL) {
+		fins_log_set(config);
+	}
+}
+
+/**@brief formats a message into the ring for the writer thread, dropping it if the ring is full */
+void fins_log_debug(const char *format, ...) {
+	struct fins_log_slot *slot;
+	uint32_t pos;
+	int32_t diff;
+	va_list args;
+	int len;
+
+	if (!fins_log_sync && !__atomic_load_n(&fins_log_running, __ATOMIC_ACQUIRE)) {
+		fins_log_start();
+	}
+
+	va_start(args, format);
+	if (fins_log_sync) {
+		vprintf(format, args);
+		fflush(stdout);
+		va_end(args);
+		return;
+	}
+
+	pos = __atomic_load_n(&fins_log_head, __ATOMIC_RELAXED);
+	while (1) {
+		slot = &fins_log_ring[pos & (FINS_LOG_SLOTS - 1)];
+		diff = (int32_t) (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+		if (diff == 0) {
+			if (__atomic_compare_exchange_n(&fins_log_head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				break;
+			}
+		} else if (diff < 0) {
+			__atomic_fetch_add(&fins_log_dropped, 1, __ATOMIC_RELAXED);
+			va_end(args);
+			return;
+		} else {
+			pos = __atomic_load_n(&fins_log_head, __ATOMIC_RELAXED);
+		}
+	}
+
+	len = vsnprintf(slot->text, FINS_LOG_LINE, format, args);
+	va_end(args);
+	if (len < 0) {
+		len = 0;
+	} else if (len >= FINS_LOG_LINE) {
+		len = FINS_LOG_LINE - 1;
+		slot->text[len - 1] = '\n';
+	}
+	slot->len = len;
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST); //pairs with the fence in fins_log_writer
+	//wake the writer if it sleeps for good, or cut its lingering short when the ring is half full
+	if (((pos + 1) & (FINS_LOG_SLOTS / 2 - 1)) == 0
+			|| (__atomic_load_n(&fins_log_waiting, __ATOMIC_RELAXED) && __atomic_exchange_n(&fins_log_waiting, 0, __ATOMIC_RELAXED))) {
+		__atomic_fetch_add(&fins_log_wake, 1, __ATOMIC_RELEASE);
+		fins_log_futex(&fins_log_wake, FUTEX_WAKE, 1, -1);
+	}
+}
+
+/**@brief writes an error at once, after the debug messages still in the ring so the order is kept */
+void fins_log_error(const char *format, ...) {
+	va_list args;
+
+	pthread_mutex_lock(&fins_log_lock);
+	fins_log_drain();
+	va_start(args, format);
+	vprintf(format, args);
+	va_end(args);
+	fflush(stdout);
+	pthread_mutex_unlock(&fins_log_lock);
+}
+
+/**@brief writes out the messages still in the ring, run at exit */
+void fins_log_flush(void) {
+	pthread_mutex_lock(&fins_log_lock);
+	fins_log_drain();
+	pthread_mutex_unlock(&fins_log_lock);
+}
@@ -1,25 +1,71 @@
 /*
  * finsdebug.h
  *
- *
+ * PRINT_DEBUG/PRINT_ERROR check a per-module level before anything is formatted, so a filtered
+ * message costs a load and a compare. Debug messages are formatted into a ring and written out by a
+ * background thread, errors are written at once. Building with -DFINS_NO_DEBUG (FINS_DEBUG = 0 in
+ * settings.finsmk) removes PRINT_DEBUG altogether. Levels are set at runtime with FINS_LOG, see
+ * fins_log_init().
  */
 
 #ifndef FINSDEBUG_H_
 #define FINSDEBUG_H_
 
+#include <stdio.h>
+#include <stdint.h>
+
+#ifndef FINS_NO_DEBUG
 #define DEBUG
+#endif
 #define ERROR
 
+#define FINS_LOG_NONE 0
+#define FINS_LOG_ERROR 1
+#define FINS_LOG_DEBUG 2
+
+/** who a message is from, each core module's Makefile sets FINS_LOG_MODULE */
+#define FINS_LOG_OTHER 0
+#define FINS_LOG_CAPTURER 1
+#define FINS_LOG_SWITCH 2
+#define FINS_LOG_DAEMON 3
+#define FINS_LOG_INTERFACE 4
+#define FINS_LOG_IPV4 5
+#define FINS_LOG_ARP 6
+#define FINS_LOG_UDP 7
+#define FINS_LOG_TCP 8
+#define FINS_LOG_ICMP 9
+#define FINS_LOG_RTM 10
+#define FINS_LOG_MODULES 11
+
+#ifndef FINS_LOG_MODULE
+#define FINS_LOG_MODULE FINS_LOG_OTHER
+#endif
+
 #ifdef DEBUG
-#include <stdio.h>
-#define PRINT_DEBUG(format, args...) printf("DEBUG(%s, %s, %d):"format"\n",__FILE__, __FUNCTION__, __LINE__, ##args);fflush(stdout);
+#define FINS_LOG_MAX FINS_LOG_DEBUG
+#else
+#define FINS_LOG_MAX FINS_LOG_ERROR
+#endif
+
+extern uint8_t fins_log_levels[FINS_LOG_MODULES];
+
+/** true if this module logs at level, use it to skip building a dump nobody will see */
+#define FINS_LOG_ON(level) ((level) <= FINS_LOG_MAX && fins_log_levels[FINS_LOG_MODULE] >= (level))
+
+void fins_log_init(void);
+int fins_log_set(const char *config);
+void fins_log_debug(const char *format, ...) __attribute__ ((format (printf, 1, 2)));
+void fins_log_error(const char *format, ...) __attribute__ ((format (printf, 1, 2)));
+void fins_log_flush(void);
+
+#ifdef DEBUG
+#define PRINT_DEBUG(format, args...) if (FINS_LOG_ON(FINS_LOG_DEBUG)) {fins_log_debug("DEBUG(%s, %s, %d):"format"\n",__FILE__, __FUNCTION__, __LINE__, ##args);}
 #else
 #define PRINT_DEBUG(format, args...)
 #endif
 
 #ifdef ERROR
-#include <stdio.h>
-#define PRINT_ERROR(format, args...) printf("ERROR(%s, %s, %d):"format"\n",__FILE__, __FUNCTION__, __LINE__, ##args);fflush(stdout);
+#define PRINT_ERROR(format, args...) if (FINS_LOG_ON(FINS_LOG_ERROR)) {fins_log_error("ERROR(%s, %s, %d):"format"\n",__FILE__, __FUNCTION__, __LINE__, ##args);}
 #else
 #define PRINT_ERROR(format, args...)
 #endif
@@ -8,11 +8,113 @@
 #include "finstypes.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <semaphore.h>
+#include <pthread.h>
 
 uint32_t control_serial_num = 0;
 sem_t control_serial_sem;
 
+/** pooled frames are told apart from malloc()ed ones by their address */
+static struct finsFrameSlot frame_pool[FINS_FRAME_POOL];
+static struct finsFrameSlot *frame_free[FINS_FRAME_POOL];
+static int frame_free_num = 0;
+static int frame_used = 0;
+static pthread_mutex_t frame_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** per buffer state, head is the lowest offset any holder has pushed down to */
+struct pdu_info {
+	int refs;
+	uint32_t head;
+	uint8_t *tail; //bytes in another pdu that follow this one, see attachFinsPdu()
+	uint32_t tail_len;
+};
+
+struct pdu_class {
+	uint32_t size;
+	uint32_t num;
+	uint8_t *arena;
+	struct pdu_info *info;
+	uint32_t *free;
+	uint32_t free_num;
+	uint32_t used;
+	pthread_mutex_t mutex;
+};
+
+#define PDU_CLASS(size, num) \
+	static uint8_t pdu_arena_##size[(size) * (num)] __attribute__ ((aligned (64))); \
+	static struct pdu_info pdu_info_##size[num]; \
+	static uint32_t pdu_free_##size[num];
+
+PDU_CLASS(512, 2048)
+PDU_CLASS(2048, 4096)
+PDU_CLASS(16384, 256)
+
+static struct pdu_class pdu_classes[FINS_PDU_CLASSES] = {
+	{ 512, 2048, pdu_arena_512, pdu_info_512, pdu_free_512, 0, 0, PTHREAD_MUTEX_INITIALIZER },
+	{ 2048, 4096, pdu_arena_2048, pdu_info_2048, pdu_free_2048, 0, 0, PTHREAD_MUTEX_INITIALIZER },
+	{ 16384, 256, pdu_arena_16384, pdu_info_16384, pdu_free_16384, 0, 0, PTHREAD_MUTEX_INITIALIZER } };
+
+static struct finsFrameSlot *frame_lookup(struct finsFrame *ff) {
+	if ((void *) ff >= (void *) frame_pool && (void *) ff < (void *) (frame_pool + FINS_FRAME_POOL)) {
+		return (struct finsFrameSlot *) ff;
+	} else {
+		return NULL;
+	}
+}
+
+static struct finsFrameSlot *frame_alloc(void) {
+	struct finsFrameSlot *slot = NULL;
+
+	pthread_mutex_lock(&frame_mutex);
+	if (frame_free_num) {
+		slot = frame_free[--frame_free_num];
+	} else if (frame_used < FINS_FRAME_POOL) {
+		slot = &frame_pool[frame_used++];
+	}
+	pthread_mutex_unlock(&frame_mutex);
+
+	return slot;
+}
+
+static void frame_release(struct finsFrameSlot *slot) {
+	pthread_mutex_lock(&frame_mutex);
+	frame_free[frame_free_num++] = slot;
+	pthread_mutex_unlock(&frame_mutex);
+}
+
+/** finds the class and buffer index of a pooled pdu, which may point anywhere inside its buffer */
+static struct pdu_class *pdu_lookup(uint8_t *pdu, uint32_t *index) {
+	struct pdu_class *class;
+	int i;
+
+	for (i = 0; i < FINS_PDU_CLASSES; i++) {
+		class = &pdu_classes[i];
+		if (pdu >= class->arena && pdu < class->arena + class->size * class->num) {
+			*index = (pdu - class->arena) / class->size;
+			return class;
+		}
+	}
+
+	return NULL;
+}
+
+/** adds a reference to a pdu, malloc()ed pdus can't be shared so they are copied */
+static uint8_t *pdu_hold(uint8_t *pdu, uint32_t len) {
+	uint32_t index;
+	struct pdu_class *class = pdu_lookup(pdu, &index);
+	uint8_t *pdu_copy;
+
+	if (class) {
+		__sync_fetch_and_add(&class->info[index].refs, 1);
+		return pdu;
+	}
+
+	pdu_copy = allocFinsPdu(len);
+	memcpy(pdu_copy, pdu, len);
+	return pdu_copy;
+}
+
 uint32_t gen_control_serial_num(void) {
 	uint32_t num;
 
@@ -55,6 +157,226 @@ struct finsFrame * buildFinsFrame(void) { //TODO replace with createFinsFrame()
 	return ff;
 }
 
+/**@brief takes a frame from the pool, falling back to malloc() when it is empty
+ * @return the frame, with empty metadata and no destination list
+ * */
+struct finsFrame *allocFinsFrame(void) {
+	struct finsFrameSlot *slot = frame_alloc();
+	struct finsFrame *ff;
+
+	if (slot) {
+		slot->refs = 1;
+		ff = &slot->ff;
+		ff->metaData = &slot->meta;
+	} else {
+		ff = (struct finsFrame *) malloc(sizeof(struct finsFrame));
+		if (ff == NULL) {
+			PRINT_ERROR("ff alloc failed");
+			exit(-1);
+		}
+		ff->metaData = (metadata *) malloc(sizeof(metadata));
+		if (ff->metaData == NULL) {
+			PRINT_ERROR("metadata alloc failed");
+			exit(-1);
+		}
+	}
+	metadata_create(ff->metaData);
+	ff->destinationID.next = NULL;
+
+	return ff;
+}
+
+/**@brief allocates a pdu with FINS_PDU_HEADROOM bytes in front of it and the rest of its size class behind it
+ * @param len the length of the pdu
+ * @return the pdu, which must be freed with freeFinsPdu()
+ * */
+uint8_t *allocFinsPdu(uint32_t len) {
+	struct pdu_class *class;
+	uint8_t *pdu = NULL;
+	uint32_t index;
+	int i;
+
+	for (i = 0; i < FINS_PDU_CLASSES; i++) {
+		class = &pdu_classes[i];
+		if (FINS_PDU_HEADROOM + len > class->size) {
+			continue;
+		}
+
+		pthread_mutex_lock(&class->mutex);
+		if (class->free_num) {
+			index = class->free[--class->free_num];
+			pdu = class->arena + index * class->size;
+		} else if (class->used < class->num) {
+			index = class->used++;
+			pdu = class->arena + index * class->size;
+		}
+		pthread_mutex_unlock(&class->mutex);
+
+		if (pdu) {
+			class->info[index].refs = 1;
+			class->info[index].head = FINS_PDU_HEADROOM;
+			class->info[index].tail = NULL;
+			class->info[index].tail_len = 0;
+			return pdu + FINS_PDU_HEADROOM;
+		}
+	}
+
+	pdu = (uint8_t *) malloc(len ? len : 1);
+	if (pdu == NULL) {
+		PRINT_ERROR("pdu alloc failed: len=%u", len);
+		exit(-1);
+	}
+	return pdu;
+}
+
+/**@brief drops a reference to a pdu, works for pdus from allocFinsPdu() and malloc()
+ * @param pdu the pdu, or any pointer into it
+ * */
+void freeFinsPdu(uint8_t *pdu) {
+	struct pdu_class *class;
+	uint32_t index;
+
+	if (pdu == NULL) {
+		return;
+	}
+
+	class = pdu_lookup(pdu, &index);
+	if (class == NULL) {
+		free(pdu);
+		return;
+	}
+
+	if (__sync_sub_and_fetch(&class->info[index].refs, 1) == 0) {
+		uint8_t *tail = class->info[index].tail;
+
+		pthread_mutex_lock(&class->mutex);
+		class->free[class->free_num++] = index;
+		pthread_mutex_unlock(&class->mutex);
+
+		freeFinsPdu(tail);
+	}
+}
+
+/**@brief attaches len bytes at data behind the pdu of a data frame without copying them, the frame
+ * goes out as its pdu followed by them. Only the interface and copies of the frame see those bytes,
+ * pduLength doesn't count them and modules reading the pdu see it as it was.
+ * @param ff the frame, its pdu must be pooled and held only by it
+ * @param data the bytes, inside a pooled pdu, which gets a reference
+ * @param len number of bytes
+ * @return 1 if attached, 0 if not possible, in which case the caller copies the bytes in
+ * */
+int attachFinsPdu(struct finsFrame *ff, uint8_t *data, uint32_t len) {
+	struct pdu_class *class;
+	struct pdu_class *data_class;
+	struct pdu_info *info;
+	uint32_t index;
+	uint32_t data_index;
+
+	class = pdu_lookup(ff->dataFrame.pdu, &index);
+	data_class = pdu_lookup(data, &data_index);
+	if (class == NULL || data_class == NULL || len == 0) {
+		return 0;
+	}
+	info = &class->info[index];
+	if (info->tail || __sync_fetch_and_add(&info->refs, 0) != 1 || data + len > data_class->arena + (data_index + 1) * data_class->size) {
+		return 0;
+	}
+
+	__sync_fetch_and_add(&data_class->info[data_index].refs, 1);
+	info->tail = data;
+	info->tail_len = len;
+	return 1;
+}
+
+/**@brief the bytes attached behind a pdu with attachFinsPdu()
+ * @param pdu the pdu
+ * @param len set to the number of bytes, 0 if there are none
+ * @return the bytes, NULL if there are none
+ * */
+uint8_t *tailFinsPdu(uint8_t *pdu, uint32_t *len) {
+	struct pdu_class *class;
+	uint32_t index;
+
+	class = pdu_lookup(pdu, &index);
+	if (class == NULL || class->info[index].tail == NULL) {
+		*len = 0;
+		return NULL;
+	}
+
+	*len = class->info[index].tail_len;
+	return class->info[index].tail;
+}
+
+/**@brief grows the pdu of a data frame at the front, for adding a header. Done in place when the
+ * headroom is free, otherwise the pdu is moved to a new buffer
+ * @param ff the frame
+ * @param len bytes to add
+ * @return the new start of the pdu
+ * */
+uint8_t *pushFinsPdu(struct finsFrame *ff, uint32_t len) {
+	uint8_t *pdu = ff->dataFrame.pdu;
+	struct pdu_class *class;
+	struct pdu_info *info;
+	uint32_t offset;
+	uint32_t index;
+
+	class = pdu_lookup(pdu, &index);
+	if (class) {
+		info = &class->info[index];
+		offset = (pdu - class->arena) - index * class->size;
+
+		//other holders only ever look at bytes from head up, so pushing below it is safe
+		if (offset >= len && (__sync_fetch_and_add(&info->refs, 0) == 1 || __sync_bool_compare_and_swap(&info->head, offset, offset - len))) {
+			if (info->head > offset - len) {
+				info->head = offset - len;
+			}
+			ff->dataFrame.pdu = pdu - len;
+			ff->dataFrame.pduLength += len;
+			return ff->dataFrame.pdu;
+		}
+	}
+
+	PRINT_DEBUG("copying: ff=%p, pdu=%p, len=%u", ff, pdu, len);
+	uint32_t tail_len;
+	uint8_t *tail = tailFinsPdu(pdu, &tail_len); //the copy takes in attached bytes
+
+	ff->dataFrame.pdu = allocFinsPdu(ff->dataFrame.pduLength + tail_len + len);
+	if (ff->dataFrame.pduLength) {
+		memcpy(ff->dataFrame.pdu + len, pdu, ff->dataFrame.pduLength);
+	}
+	if (tail_len) {
+		memcpy(ff->dataFrame.pdu + len + ff->dataFrame.pduLength, tail, tail_len);
+	}
+	ff->dataFrame.pduLength += tail_len + len;
+	freeFinsPdu(pdu);
+
+	return ff->dataFrame.pdu;
+}
+
+/**@brief shrinks the pdu of a data frame at the front, for stripping a header
+ * @param ff the frame
+ * @param len bytes to remove, at most pduLength
+ * @return the new start of the pdu
+ * */
+uint8_t *pullFinsPdu(struct finsFrame *ff, uint32_t len) {
+	uint32_t index;
+
+	if (len > ff->dataFrame.pduLength) {
+		PRINT_ERROR("pull past end: ff=%p, len=%u, pduLength=%u", ff, len, ff->dataFrame.pduLength);
+		len = ff->dataFrame.pduLength;
+	}
+
+	ff->dataFrame.pduLength -= len;
+	if (pdu_lookup(ff->dataFrame.pdu, &index)) {
+		ff->dataFrame.pdu += len;
+	} else {
+		//malloc()ed pdus must keep their start for free()
+		memmove(ff->dataFrame.pdu, ff->dataFrame.pdu + len, ff->dataFrame.pduLength);
+	}
+
+	return ff->dataFrame.pdu;
+}
+
 /**@brief prints the contents of a fins frame whether data or control type
  * @param fins_in the pointer to the fins frame
  * */
@@ -135,41 +457,30 @@ void copy_fins_to_fins(struct finsFrame *dst, struct finsFrame *src) {
 
 }
 
-struct finsFrame *cloneFinsFrame(struct finsFrame *ff) {
-	PRINT_DEBUG("Entered: ff=%p, meta=%p", ff, ff->metaData);
+/** copies a frame into a new pooled one, the pdu is either shared or copied */
+static struct finsFrame *frame_copy(struct finsFrame *ff, int share) {
+	PRINT_DEBUG("Entered: ff=%p, meta=%p, share=%d", ff, ff->metaData, share);
 
-	metadata *params_clone = (metadata *) malloc(sizeof(metadata));
-	if (params_clone == NULL) {
-		PRINT_ERROR("metadata creation failed");
-		exit(-1);
-	}
-	metadata_create(params_clone);
+	struct finsFrame *ff_clone = allocFinsFrame();
 
-	metadata *params = ff->metaData;
-	if (params) {
-		if (metadata_copy(params, params_clone) == META_FALSE) {
+	if (ff->metaData) {
+		if (metadata_copy(ff->metaData, ff_clone->metaData) == META_FALSE) {
 			PRINT_ERROR("todo error");
 		}
 	} else {
 		PRINT_ERROR("todo error");
 	}
 
-	struct finsFrame *ff_clone = (struct finsFrame *) malloc(sizeof(struct finsFrame));
-	if (ff_clone == NULL) {
-		PRINT_ERROR("ff_clone alloc failed");
-		exit(-1);
-	}
-
 	ff_clone->dataOrCtrl = ff->dataOrCtrl;
 	ff_clone->destinationID.id = ff->destinationID.id;
 	ff_clone->destinationID.next = ff->destinationID.next; //TODO this is a list copy all of them?
-	ff_clone->metaData = params_clone;
 
 	if (ff_clone->dataOrCtrl == CONTROL) {
 		ff_clone->ctrlFrame.senderID = ff->ctrlFrame.senderID;
-		ff_clone->ctrlFrame.serial_num = gen_control_serial_num(); //ff->ctrlFrame.serial_num; //TODO should this occur?
+		ff_clone->ctrlFrame.serial_num = ff->ctrlFrame.serial_num;
 		ff_clone->ctrlFrame.opcode = ff->ctrlFrame.opcode;
 		ff_clone->ctrlFrame.param_id = ff->ctrlFrame.param_id; //TODO error msg code
+		ff_clone->ctrlFrame.ret_val = ff->ctrlFrame.ret_val;
 
 		ff_clone->ctrlFrame.data_len = ff->ctrlFrame.data_len; //Add in the header size for this, too
 		if (ff_clone->ctrlFrame.data_len) {
@@ -191,13 +502,19 @@ struct finsFrame *cloneFinsFrame(struct finsFrame *ff) {
 
 		ff_clone->dataFrame.pduLength = ff->dataFrame.pduLength; //Add in the header size for this, too
 		if (ff_clone->dataFrame.pduLength) {
-			ff_clone->dataFrame.pdu = (uint8_t *) malloc(ff_clone->dataFrame.pduLength);
-			if (ff_clone->dataFrame.pdu == NULL) {
-				PRINT_ERROR("failed to create pdu: ff=%p", ff_clone);
-				exit(-1);
+			if (share) {
+				ff_clone->dataFrame.pdu = pdu_hold(ff->dataFrame.pdu, ff->dataFrame.pduLength);
+			} else {
+				uint32_t tail_len;
+				uint8_t *tail = tailFinsPdu(ff->dataFrame.pdu, &tail_len);
+
+				ff_clone->dataFrame.pdu = allocFinsPdu(ff->dataFrame.pduLength + tail_len);
+				memcpy(ff_clone->dataFrame.pdu, ff->dataFrame.pdu, ff->dataFrame.pduLength);
+				if (tail_len) {
+					memcpy(ff_clone->dataFrame.pdu + ff->dataFrame.pduLength, tail, tail_len);
+					ff_clone->dataFrame.pduLength += tail_len;
+				}
 			}
-
-			memcpy(ff_clone->dataFrame.pdu, ff->dataFrame.pdu, ff_clone->dataFrame.pduLength);
 		} else {
 			PRINT_DEBUG("here");
 			ff_clone->dataFrame.pdu = NULL;
@@ -211,34 +528,113 @@ struct finsFrame *cloneFinsFrame(struct finsFrame *ff) {
 	return ff_clone;
 }
 
+/**@brief clones a frame, the clone shares the pdu of the original (read only, see pushFinsPdu()).
+ * Control frames get a new serial_num and a copy of their data
+ * @param ff the frame to clone
+ * @return the clone
+ * */
+struct finsFrame *cloneFinsFrame(struct finsFrame *ff) {
+	struct finsFrame *ff_clone = frame_copy(ff, 1);
+
+	if (ff_clone->dataOrCtrl == CONTROL) {
+		ff_clone->ctrlFrame.serial_num = gen_control_serial_num(); //TODO should this occur?
+	}
+	return ff_clone;
+}
+
+/**@brief makes an exact deep copy of a frame, unlike cloneFinsFrame() control frames keep their serial_num
+ * @param ff the frame to copy
+ * @return the copy
+ * */
+struct finsFrame *copyFinsFrame(struct finsFrame *ff) {
+	return frame_copy(ff, 0);
+}
+
+/**@brief hands a frame to several modules without copying
+ * @param ff the frame, which must not be used by the caller afterwards
+ * @param refs the number of holders, each of which must free it
+ * @return the shared frame, or NULL if the pool is empty, in which case ff is untouched
+ * */
+struct finsFrame *shareFinsFrame(struct finsFrame *ff, int refs) {
+	struct finsFrameSlot *slot = frame_lookup(ff);
+
+	if (slot) {
+		__sync_fetch_and_add(&slot->refs, refs - 1);
+		return ff;
+	}
+
+	slot = frame_alloc();
+	if (slot == NULL) {
+		PRINT_DEBUG("frame pool empty: ff=%p", ff);
+		return NULL;
+	}
+
+	slot->ff = *ff;
+	slot->refs = refs;
+	PRINT_DEBUG("Exited: ff=%p, shared=%p, refs=%d", ff, &slot->ff, refs);
+	free(ff);
+
+	return &slot->ff;
+}
+
+/**@brief gives the caller a frame it may modify. Frames with a single holder are returned as they are,
+ * other holders get a copy and drop their reference
+ * @param ff the frame as read from the switch
+ * @return the frame to use instead of ff
+ * */
+struct finsFrame *writableFinsFrame(struct finsFrame *ff) {
+	struct finsFrameSlot *slot = frame_lookup(ff);
+	struct finsFrame *ff_own;
+
+	if (slot == NULL || __sync_fetch_and_add(&slot->refs, 0) == 1) {
+		return ff;
+	}
+
+	ff_own = copyFinsFrame(ff);
+	freeFinsFrame(ff);
+
+	PRINT_DEBUG("Exited: shared=%p, ff=%p", ff, ff_own);
+	return ff_own;
+}
+
+/**@brief drops a reference to a frame, the last one frees the metadata and pdu/data
+ * @param ff the frame
+ * @return 1 if there was a frame, 0 otherwise
+ * */
 int freeFinsFrame(struct finsFrame *ff) {
 	if (ff == NULL) {
 		return (0);
 	}
 
 	PRINT_DEBUG("Entered: ff=%p, meta=%p", ff, ff->metaData);
+	struct finsFrameSlot *slot = frame_lookup(ff);
+	if (slot && __sync_sub_and_fetch(&slot->refs, 1)) {
+		return (1);
+	}
+
+	if (ff->metaData != NULL && (slot == NULL || ff->metaData != &slot->meta)) {
+		metadata_destroy(ff->metaData);
+	}
 	if (ff->dataOrCtrl == CONTROL) {
-		if (ff->metaData != NULL) {
-			metadata_destroy(ff->metaData);
-		}
 		if (ff->ctrlFrame.data) {
 			PRINT_DEBUG("Freeing data=%p", ff->ctrlFrame.data);
-			free(ff->ctrlFrame.data);
+			freeFinsPdu(ff->ctrlFrame.data); //may be a pdu handed over with an error
 		}
 	} else if (ff->dataOrCtrl == DATA) {
-		if (ff->metaData != NULL) {
-			metadata_destroy(ff->metaData);
-		}
 		if (ff->dataFrame.pdu) {
 			PRINT_DEBUG("Freeing pdu=%p", ff->dataFrame.pdu);
-			free(ff->dataFrame.pdu);
+			freeFinsPdu(ff->dataFrame.pdu);
 		}
 	} else {
 		//dataOrCtrl uninitialized
 		PRINT_ERROR("todo error");
 	}
 
-	free(ff);
+	if (slot) {
+		frame_release(slot);
+	} else {
+		free(ff);
+	}
 	return (1);
 }
 
@@ -105,16 +105,56 @@ struct finsFrame {
 
 };
 
+/** frames come from a fixed pool of slots, each with its own metadata, and are reference counted.
+ * The switch hands a frame bound for several modules to all of them; freeFinsFrame() drops one
+ * reference and frees the contents with the last one. A module that modifies frames must call
+ * writableFinsFrame() first, modules that only read them (taps, monitors) don't pay anything.
+ * Whether a frame is pooled is decided from its address, so frames built with malloc() still work. */
+struct finsFrameSlot {
+	struct finsFrame ff; //must be first
+	metadata meta; //ff.metaData unless a module replaced it
+	int refs;
+};
+
+#define FINS_FRAME_POOL 4096
+
+/** pdus allocated with allocFinsPdu() live in size classed buffers with FINS_PDU_HEADROOM free
+ * bytes in front, so layers add headers with pushFinsPdu() and strip them with pullFinsPdu()
+ * instead of copying. Buffers are reference counted, cloneFinsFrame() shares them. A pdu can carry a
+ * reference to bytes in another one behind it, see attachFinsPdu(), so IPv4 fragments don't copy. */
+#define FINS_PDU_HEADROOM 128 //ethernet + ipv4 + tcp headers with options
+#define FINS_PDU_CLASSES 3
+
 uint32_t gen_control_serial_num(void);
 
 struct finsFrame * buildFinsFrame(void);
 
+struct finsFrame *allocFinsFrame(void);
+
+uint8_t *allocFinsPdu(uint32_t len);
+
+void freeFinsPdu(uint8_t *pdu);
+
+uint8_t *pushFinsPdu(struct finsFrame *ff, uint32_t len);
+
+uint8_t *pullFinsPdu(struct finsFrame *ff, uint32_t len);
+
+int attachFinsPdu(struct finsFrame *ff, uint8_t *data, uint32_t len);
+
+uint8_t *tailFinsPdu(uint8_t *pdu, uint32_t *len);
+
 void print_finsFrame(struct finsFrame *fins_in);
 
 void copy_fins_to_fins(struct finsFrame *dst, struct finsFrame *src);
 
 struct finsFrame *cloneFinsFrame(struct finsFrame *ff);
 
+struct finsFrame *copyFinsFrame(struct finsFrame *ff);
+
+struct finsFrame *shareFinsFrame(struct finsFrame *ff, int refs);
+
+struct finsFrame *writableFinsFrame(struct finsFrame *ff);
+
 int freeFinsFrame(struct finsFrame *f);
 
 /* needed function defs */
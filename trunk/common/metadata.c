@@ -5,11 +5,14 @@
  *  @version 1 Basic functionality has been tested
  *  @version 2 "September 20,2010" Clearing the code and adding extra
  *  documentation per each function
+ *  @version 3 elements are kept in a small array inside the metadata with interned integer keys instead
+ *  of a libconfig tree, so reads and writes do no allocation and copies are a memcpy
  *  @author Abdallah Abdallah
  */
 
 #include "metadata.h"
 #include <stdint.h>
+#include <pthread.h>
 
 /** @example <USEmetadata>
  * int main(int argc, char **argv)
@@ -29,13 +32,13 @@
  //cfgptr = metadata_create2();
 
 
- ethernet = metadata_add(cfgptr,"ethernet",META_TYPE_INT32);
- network = metadata_add(cfgptr, "network", META_TYPE_STRING);
+ ethernet = metadata_addElement(cfgptr,"ethernet",META_TYPE_INT32);
+ network = metadata_addElement(cfgptr, "network", META_TYPE_STRING);
 
- metadata_write(cfgptr,"ethernet",&l,META_TYPE_INT32);
- metadata_set_element(network,lolo);
+ metadata_writeToElement(cfgptr,"ethernet",&l,META_TYPE_INT32);
+ metadata_setElement(network,lolo);
 
- metadata_write(cfgptr,"transport",lolo, META_TYPE_STRING);
+ metadata_writeToElement(cfgptr,"transport",lolo, META_TYPE_STRING);
 
  metadata_print(cfgptr);
 
@@ -45,10 +48,131 @@
 
  */
 
+/** interned element names. Slots of the hash hold key + 1 and are only ever filled, so lookups
+ * of names already seen take no lock */
+#define META_KEY_HASH (4 * META_MAX_KEYS)
+static const char *meta_key_names[META_MAX_KEYS];
+static int meta_key_num = 0;
+static uint16_t meta_key_hash[META_KEY_HASH];
+static pthread_mutex_t meta_key_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/** interned string values, these are rare so every lookup locks */
+#define META_STRING_HASH 64
+struct meta_string {
+	struct meta_string *next;
+	char value[1];
+};
+static struct meta_string *meta_strings[META_STRING_HASH];
+static pthread_mutex_t meta_string_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint32_t meta_hash(const char *name) {
+	uint32_t hash = 2166136261u;
+
+	while (*name) {
+		hash = (hash ^ (uint8_t) *name++) * 16777619u;
+	}
+	return hash;
+}
+
+static int meta_key_find(const char *name, int insert) {
+	uint32_t hash = meta_hash(name) & (META_KEY_HASH - 1);
+	uint32_t i = hash;
+	uint16_t slot;
+	int key;
+
+	while ((slot = __atomic_load_n(&meta_key_hash[i], __ATOMIC_ACQUIRE))) {
+		if (strcmp(meta_key_names[slot - 1], name) == 0) {
+			return slot - 1;
+		}
+		i = (i + 1) & (META_KEY_HASH - 1);
+	}
+
+	if (!insert) {
+		return -1;
+	}
+
+	pthread_mutex_lock(&meta_key_mutex);
+	for (i = hash; (slot = meta_key_hash[i]); i = (i + 1) & (META_KEY_HASH - 1)) {
+		if (strcmp(meta_key_names[slot - 1], name) == 0) { //added while waiting for the lock
+			pthread_mutex_unlock(&meta_key_mutex);
+			return slot - 1;
+		}
+	}
+
+	if (meta_key_num == META_MAX_KEYS) {
+		pthread_mutex_unlock(&meta_key_mutex);
+		PRINT_ERROR("too many metadata names: name='%s'", name);
+		return -1;
+	}
+
+	key = meta_key_num++;
+	meta_key_names[key] = strdup(name);
+	if (meta_key_names[key] == NULL) {
+		PRINT_ERROR("alloc error");
+		exit(-1);
+	}
+	__atomic_store_n(&meta_key_hash[i], key + 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&meta_key_mutex);
+
+	return key;
+}
+
+static const char *meta_string_intern(const char *value) {
+	uint32_t hash = meta_hash(value) & (META_STRING_HASH - 1);
+	struct meta_string *string;
+
+	pthread_mutex_lock(&meta_string_mutex);
+	for (string = meta_strings[hash]; string; string = string->next) {
+		if (strcmp(string->value, value) == 0) {
+			pthread_mutex_unlock(&meta_string_mutex);
+			return string->value;
+		}
+	}
+
+	string = (struct meta_string *) malloc(sizeof(struct meta_string) + strlen(value));
+	if (string == NULL) {
+		PRINT_ERROR("alloc error");
+		exit(-1);
+	}
+	strcpy(string->value, value);
+	string->next = meta_strings[hash];
+	meta_strings[hash] = string;
+	pthread_mutex_unlock(&meta_string_mutex);
+
+	return string->value;
+}
+
+static metadata_element *meta_element_find(metadata *cfgptr, int key) {
+	metadata_element *element = cfgptr->elements;
+	metadata_element *end = element + cfgptr->num;
+
+	for (; element < end; element++) {
+		if (element->key == key) {
+			return element;
+		}
+	}
+	return NULL;
+}
+
+static metadata_element *meta_element_add(metadata *cfgptr, int key) {
+	metadata_element *element;
+
+	if (cfgptr->num == META_MAX_ELEMENTS) {
+		PRINT_ERROR("metadata full: meta=%p, name='%s'", cfgptr, metadata_key_name(key));
+		return NULL;
+	}
+
+	element = &cfgptr->elements[cfgptr->num++];
+	element->key = key;
+	element->type = META_TYPE_NONE;
+	element->value.int64 = 0;
+	return element;
+}
+
 void metadata_create(metadata *mptr) {
 
 	PRINT_DEBUG("Entered: meta=%p", mptr);
-	config_init(mptr);
+	mptr->num = 0;
 
 }
 
@@ -56,81 +180,92 @@ void metadata_destroy(metadata *metadata) {
 	PRINT_DEBUG("Entered: meta=%p", metadata);
 
 	if (metadata) {
-		config_destroy(metadata);
 		free(metadata);
 	}
 }
 
+/** @function returns the interned key of an element name, adding it if it is new. Modules
+ * can look their names up once and use the *Key functions afterwards
+ * returns -1 if META_MAX_KEYS names are already in use
+ */
+int metadata_key(const char *name) {
+	return meta_key_find(name, 1);
+}
+
+const char *metadata_key_name(int key) {
+	if (key >= 0 && key < META_MAX_KEYS && meta_key_names[key]) {
+		return meta_key_names[key];
+	} else {
+		return "?";
+	}
+}
+
 /** @function read the value of a metaData element
  * returns the reading status FALSE/ TRUE
  */
+int metadata_readFromKey(metadata *cfgptr, int key, void *value) {
 
-int metadata_readFromElement(metadata *cfgptr, const char *target, void *value) {
-
-	metadata_element *root, *handle;
+	metadata_element *handle;
 	int status;
 
-	root = config_root_setting(cfgptr);
-	handle = config_setting_get_member(root, target);
+	handle = key < 0 ? NULL : meta_element_find(cfgptr, key);
 	if (handle == NULL) {
-		//PRINT_DEBUG("%s is not found in the metadata", target);
 		status = META_FALSE;
-		PRINT_DEBUG("meta=%p, '%s', %d", cfgptr, target, status);
-
 	} else {
-		switch (config_setting_type(handle)) {
+		switch (handle->type) {
 		case META_TYPE_INT32:
-			status = config_setting_lookup_int(root, target, (int *) value);
+			*(int32_t *) value = handle->value.int32;
+			status = META_TRUE;
 			break;
 		case META_TYPE_INT64:
-			status = config_setting_lookup_int64(root, target, (int64_t *) value);
+			*(int64_t *) value = handle->value.int64;
+			status = META_TRUE;
 			break;
 		case META_TYPE_STRING:
-			status = config_setting_lookup_string(root, target, (const char **) value); //unsure of credibility, check strings?
+			*(const char **) value = handle->value.string;
+			status = META_TRUE;
 			break;
 		default:
 			PRINT_ERROR(" Asking for wrong type ");
 			status = META_FALSE;
 			break;
-
 		}
-		PRINT_DEBUG("meta=%p, '%s', %d", cfgptr, target, status);
 	}
 
+	PRINT_DEBUG("meta=%p, '%s', %d", cfgptr, metadata_key_name(key), status);
 	return (status);
+}
 
+int metadata_readFromElement(metadata *cfgptr, const char *target, void *value) {
+	return metadata_readFromKey(cfgptr, meta_key_find(target, 0), value);
 }
 
 /** @function set a value of metadata element that might exist or not exist
  * if it does not exist, it creates the element and set its value
- * if it already exists , it sets its value only
+ * if it already exists , it sets its value and type
  */
-int metadata_writeToElement(metadata *cfgptr, char *target, void *value, int type) {
+int metadata_writeToKey(metadata *cfgptr, int key, void *value, int type) {
 
+	metadata_element *handle;
 	int status;
-	metadata_element *root, *handle;
-	root = config_root_setting(cfgptr);
+
+	if (key < 0) {
+		return META_FALSE;
+	}
 
 	switch (type) {
 	case META_TYPE_INT32:
-		handle = config_setting_get_member(root, target);
-		if (handle == NULL)
-			handle = config_setting_add(root, target, CONFIG_TYPE_INT);
-		status = config_setting_set_int(handle, *(int *) value);
-		break;
-
 	case META_TYPE_INT64:
-		handle = config_setting_get_member(root, target);
-		if (handle == NULL)
-			handle = config_setting_add(root, target, CONFIG_TYPE_INT64);
-		status = config_setting_set_int64(handle, *(int64_t *) value);
-		break;
-
 	case META_TYPE_STRING:
-		handle = config_setting_get_member(root, target);
+		handle = meta_element_find(cfgptr, key);
 		if (handle == NULL)
-			handle = config_setting_add(root, target, CONFIG_TYPE_STRING);
-		status = config_setting_set_string(handle, (char *) value);
+			handle = meta_element_add(cfgptr, key);
+		if (handle == NULL) {
+			status = META_FALSE;
+			break;
+		}
+		handle->type = type;
+		status = metadata_setElement(handle, value);
 		break;
 	default:
 		PRINT_ERROR(" wrong type to be written");
@@ -139,10 +274,14 @@ int metadata_writeToElement(metadata *cfgptr, char *target, void *value, int typ
 		break;
 	}
 
-	PRINT_DEBUG("meta=%p, '%s', %d", cfgptr, target, status);
+	PRINT_DEBUG("meta=%p, '%s', %d", cfgptr, metadata_key_name(key), status);
 	return (status);
 }
 
+int metadata_writeToElement(metadata *cfgptr, char *target, void *value, int type) {
+	return metadata_writeToKey(cfgptr, meta_key_find(target, 1), value, type);
+}
+
 /** @function set the value of a MetaData element which is already
  * exist. If it is not found it returns an Error False Status
  */
@@ -150,15 +289,18 @@ int metadata_writeToElement(metadata *cfgptr, char *target, void *value, int typ
 int metadata_setElement(metadata_element *element, void *value) {
 
 	int status;
-	switch (config_setting_type(element)) {
+	switch (element->type) {
 	case META_TYPE_INT32:
-		status = config_setting_set_int(element, *((int *) value));
+		element->value.int32 = *(int32_t *) value;
+		status = META_TRUE;
 		break;
 	case META_TYPE_INT64:
-		status = config_setting_set_int64(element, *((int64_t *) value));
+		element->value.int64 = *(int64_t *) value;
+		status = META_TRUE;
 		break;
 	case META_TYPE_STRING:
-		status = config_setting_set_string(element, (char *) value);
+		element->value.string = meta_string_intern((char *) value);
+		status = META_TRUE;
 		break;
 	default:
 		PRINT_ERROR(" wrong type to be written");
@@ -172,14 +314,26 @@ int metadata_setElement(metadata_element *element, void *value) {
 
 /** @function add a new metadata element to a pre-existing metadata
  * structure but doesn't set any value for that element
- * it returns a pointer to that new added element
+ * it returns a pointer to that new added element, or to the element if it is already there
  */
 
 metadata_element *metadata_addElement(metadata *cfgptr, char *elementName, int type) {
-	metadata_element *root;
-	root = config_root_setting(cfgptr);
-	return (config_setting_add(root, elementName, type));
+	metadata_element *handle;
+	int key = meta_key_find(elementName, 1);
 
+	if (key < 0) {
+		return NULL;
+	}
+
+	handle = meta_element_find(cfgptr, key);
+	if (handle == NULL) {
+		handle = meta_element_add(cfgptr, key);
+		if (handle == NULL) {
+			return NULL;
+		}
+	}
+	handle->type = type;
+	return handle;
 }
 
 /** @function Print out the values of all the elements found in
@@ -190,40 +344,23 @@ metadata_element *metadata_addElement(metadata *cfgptr, char *elementName, int t
 
 int metadata_print(metadata *cfgptr) {
 
-	metadata_element *root, *handle;
-	int howManySettings;
-	int i = 0;
-	int type;
-	int value;
-	int64_t val64;
-	char *stringValue;
-	char *name;
-
-	root = config_root_setting(cfgptr);
-	howManySettings = config_setting_length(root);
-
-	for (i = 0; i < howManySettings; i++) {
-
-		handle = config_setting_get_elem(root, i);
-		name = config_setting_name(handle);
-
-		type = config_setting_type(handle);
-		//PRINT_DEBUG("%s \\", name);
-		switch (type) {
-		case CONFIG_TYPE_INT:
-			value = config_setting_get_int(handle);
-			//PRINT_DEBUG("%d", value);
-			PRINT_DEBUG("meta=%p, '%s'=%d", cfgptr, name, value);
+	metadata_element *handle;
+	const char *name;
+	int i;
+
+	for (i = 0; i < cfgptr->num; i++) {
+		handle = &cfgptr->elements[i];
+		name = metadata_key_name(handle->key);
+
+		switch (handle->type) {
+		case META_TYPE_INT32:
+			PRINT_DEBUG("meta=%p, '%s'=%d", cfgptr, name, handle->value.int32);
 			break;
-		case CONFIG_TYPE_INT64:
-			val64 = config_setting_get_int64(handle);
-			//PRINT_DEBUG("%lld", val64);
-			PRINT_DEBUG("meta=%p, '%s'=%lld", cfgptr, name, val64);
+		case META_TYPE_INT64:
+			PRINT_DEBUG("meta=%p, '%s'=%lld", cfgptr, name, (long long) handle->value.int64);
 			break;
-		case CONFIG_TYPE_STRING:
-			stringValue = (char *) config_setting_get_string(handle);
-			//PRINT_DEBUG("%s", stringValue);
-			PRINT_DEBUG("meta=%p, '%s'='%s'", cfgptr, name, stringValue);
+		case META_TYPE_STRING:
+			PRINT_DEBUG("meta=%p, '%s'='%s'", cfgptr, name, handle->value.string);
 			break;
 		default:
 			PRINT_ERROR(" wrong type found");
@@ -234,66 +371,36 @@ int metadata_print(metadata *cfgptr) {
 	return (i);
 }
 
+/** @function copies every element of cfgptr into cfgptr_copy, replacing elements of the same name.
+ * Copying into empty metadata, the common case, is a single memcpy
+ */
 int metadata_copy(metadata *cfgptr, metadata *cfgptr_copy) {
 	PRINT_DEBUG("Entered: meta=%p, meta_copy=%p", cfgptr, cfgptr_copy);
 
-	metadata_element *root = config_root_setting(cfgptr);
-	metadata_element *root_copy = config_root_setting(cfgptr_copy);
-
-	int num_settings = config_setting_length(root);
-	int status;
-	int total = 0;
-
 	metadata_element *handle;
 	metadata_element *handle_copy;
-	char *target;
-
-	int type;
-	int value_int32;
-	int64_t value_int64;
-	char *value_string;
-
+	int total = 0;
 	int i;
-	for (i = 0; i < num_settings; i++) {
-		handle = config_setting_get_elem(root, i);
-		target = config_setting_name(handle);
-
-		type = config_setting_type(handle);
-		switch (type) {
-		case CONFIG_TYPE_INT:
-			value_int32 = config_setting_get_int(handle);
-
-			handle_copy = config_setting_get_member(root_copy, target);
-			if (handle_copy == NULL)
-				handle_copy = config_setting_add(root_copy, target, CONFIG_TYPE_INT);
-			status = config_setting_set_int(handle_copy, value_int32);
-			break;
-		case CONFIG_TYPE_INT64:
-			value_int64 = config_setting_get_int64(handle);
 
-			handle_copy = config_setting_get_member(root_copy, target);
-			if (handle_copy == NULL)
-				handle_copy = config_setting_add(root_copy, target, CONFIG_TYPE_INT64);
-			status = config_setting_set_int64(handle_copy, value_int64);
-			break;
-		case CONFIG_TYPE_STRING:
-			value_string = (char *) config_setting_get_string(handle);
+	if (cfgptr_copy->num == 0) {
+		memcpy(cfgptr_copy->elements, cfgptr->elements, cfgptr->num * sizeof(metadata_element));
+		cfgptr_copy->num = cfgptr->num;
+		return META_TRUE;
+	}
 
-			handle_copy = config_setting_get_member(root_copy, target);
-			if (handle_copy == NULL)
-				handle_copy = config_setting_add(root_copy, target, CONFIG_TYPE_STRING);
-			status = config_setting_set_string(handle_copy, value_string);
-			break;
-		default:
-			PRINT_ERROR(" wrong type found, type=%d", type);
-			status = META_FALSE;
-			break;
+	for (i = 0; i < cfgptr->num; i++) {
+		handle = &cfgptr->elements[i];
+
+		handle_copy = meta_element_find(cfgptr_copy, handle->key);
+		if (handle_copy == NULL)
+			handle_copy = meta_element_add(cfgptr_copy, handle->key);
+		if (handle_copy) {
+			*handle_copy = *handle;
+			total++;
 		}
-		PRINT_DEBUG("meta=%p, '%s', %d", cfgptr_copy, target, status);
-		total += (status == CONFIG_TRUE);
 	}
 
-	return total == num_settings;
+	return total == cfgptr->num;
 }
 
 metadata *metadata_clone(metadata *cfgptr) {
@@ -310,77 +417,3 @@ metadata *metadata_clone(metadata *cfgptr) {
 
 	return cfgptr_clone;
 }
-
-/*---------------------------------------------------------------
- * Functions code that might be reused later
- * */
-
-/*
- void *metadata_read(metadata *cfgptr,char *target)
- {
-
- config_setting_t *root, *ethernet, *network, *transport,*socket,*handle;
- int howManySettings;
- int i=0;
- char *toBeParsed;
- int type;
- int value;
- char *stringValue;
- char *name;
-
- root=config_root_setting(cfgptr);
- howManySettings= config_setting_length(root);
-
- for (i=0; i< howManySettings; i++)
- {
-
- handle = config_setting_get_elem(root,i);
- name = config_setting_name(handle);
- if (strcmp(name,target)==0)
- {
- stringValue = config_setting_get_string(handle);
- PRINT_DEBUG("%s",stringValue);
-
- }
- type= config_setting_type(handle);
- PRINT_DEBUG("%s \\",name);
- switch (type)
- {
- case CONFIG_TYPE_INT:
- value = config_setting_get_int(handle);
- PRINT_DEBUG("%d",value);
- return(&value);
- case CONFIG_TYPE_STRING:
- stringValue = config_setting_get_string(handle);
- PRINT_DEBUG("%s",stringValue);
- return (stringValue);
- case CONFIG_TYPE_GROUP:
- PRINT_DEBUG("%s",handle->value);
- printf("Meta Data Type is group !! ");
- //exit();
- break;
-
- case CONFIG_TYPE_NONE:
- stringValue = config_setting_get_string(handle);
- PRINT_DEBUG("%s",stringValue);
- printf("Meta Data Type is NONE !! ");
- //exit();
- break;
-
- default:
- PRINT_DEBUG(" Default");
- printf("No Matching for Meta Data Type!! ");
- //exit();
- break;
- }
-
-
- }
-
-
-
-
- }
-
- */
-
@@ -3,6 +3,8 @@
  *
  * @date Aug 2, 2010
  * @version 1
+ * @version 2 the libconfig tree is replaced by a fixed size array of typed elements with interned
+ * integer keys, values are stored inline so copying metadata is a single memcpy
  * @author Abdallah Abdallah
  */
 
@@ -12,28 +14,49 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <libconfig.h>
+#include <stdint.h>
 #include "finsdebug.h"
 
-/* over riding the original types of the Config library */
+#define META_TYPE_NONE		0
+#define META_TYPE_INT32 	1
+#define META_TYPE_INT64 	2
+#define META_TYPE_STRING 	3
+#define META_TRUE 			1
+#define META_FALSE 			0
 
-#define META_TYPE_INT32 	CONFIG_TYPE_INT
-#define META_TYPE_INT64 	CONFIG_TYPE_INT64
-#define META_TYPE_STRING 	CONFIG_TYPE_STRING
-#define META_TRUE 			CONFIG_TRUE
-#define META_FALSE 			CONFIG_FALSE
+/** max elements in one metadata, frames use around 10 */
+#define META_MAX_ELEMENTS 	24
+/** max distinct element names for the whole process */
+#define META_MAX_KEYS 		256
+#define META_KEY_NONE 		0xFFFF
 
-typedef config_t metadata;
-typedef config_setting_t metadata_element;
+typedef struct {
+	uint16_t key; //interned name, see metadata_key()
+	uint8_t type;
+	union {
+		int32_t int32;
+		int64_t int64;
+		const char *string; //interned, never freed
+	} value;
+} metadata_element;
+
+typedef struct {
+	uint32_t num;
+	metadata_element elements[META_MAX_ELEMENTS];
+} metadata;
 
-void addSettings(metadata *cfgptr);
 void metadata_create(metadata *mptr);
 
 void metadata_destroy(metadata *metadata);
 
+int metadata_key(const char *name);
+const char *metadata_key_name(int key);
+
 int metadata_readFromElement(metadata *cfgptr, const char *target, void *value);
+int metadata_readFromKey(metadata *cfgptr, int key, void *value);
 
 int metadata_writeToElement(metadata *cfgptr, char *target, void *value, int type);
+int metadata_writeToKey(metadata *cfgptr, int key, void *value, int type);
 int metadata_setElement(metadata_element *element, void *value);
 metadata_element *metadata_addElement(metadata *cfgptr, char *elementName, int type);
 int metadata_print(metadata *cfgptr);
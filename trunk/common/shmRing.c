@@ -0,0 +1,275 @@
+/**
+ * @file shmRing.c
+ *
+ * @date Oct 18, 2026
+ * @brief the capturer <-> core frame rings, see shmRing.h
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "finsdebug.h"
+#include "shmRing.h"
+
+/** the consumer publishes freed slots after this many, or as soon as it runs dry */
+#define SHM_RING_BATCH 32
+
+static int shm_futex(uint32_t *addr, int op, uint32_t val, int timeout_ms) {
+	struct timespec ts;
+
+	if (timeout_ms >= 0) {
+		ts.tv_sec = timeout_ms / 1000;
+		ts.tv_nsec = (timeout_ms % 1000) * 1000000;
+	}
+	return syscall(SYS_futex, addr, op, val, timeout_ms >= 0 ? &ts : NULL, NULL, 0);
+}
+
+static finsShmRing shm_map(const char *path, int fd, size_t size) {
+	finsShmRing ring = (finsShmRing) malloc(sizeof(struct ShmRingRecord));
+	if (ring == NULL) {
+		PRINT_ERROR("alloc error");
+		exit(-1);
+	}
+	memset(ring, 0, sizeof(struct ShmRingRecord));
+
+	ring->hdr = (struct ShmRingHeader *) mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (ring->hdr == MAP_FAILED) {
+		PRINT_ERROR("mmap failed: path='%s'", path);
+		exit(-1);
+	}
+	ring->slot = (struct ShmRingSlot *) ((uint8_t *) ring->hdr + sizeof(struct ShmRingHeader));
+	ring->size = size;
+	strncpy(ring->path, path, sizeof(ring->path) - 1);
+
+	return ring;
+}
+
+/** picks up the shared indices, for a process attaching to a ring that may already be in use */
+static void shm_sync(finsShmRing ring) {
+	ring->mask = ring->hdr->slots - 1;
+	ring->head = ring->head_cache = __atomic_load_n(&ring->hdr->head, __ATOMIC_ACQUIRE);
+	ring->tail = ring->tail_cache = __atomic_load_n(&ring->hdr->tail, __ATOMIC_ACQUIRE);
+}
+
+/**@brief creates (or resets) the ring file and maps it, done by the capturer before the core attaches
+ * @param path the ring file, see FINS_CAPTURE_RING/FINS_INJECT_RING
+ * @param slots number of frames held, a power of 2
+ * @return the ring
+ * */
+finsShmRing create_shm_ring(const char *path, uint32_t slots) {
+	size_t size = sizeof(struct ShmRingHeader) + slots * sizeof(struct ShmRingSlot);
+	finsShmRing ring;
+	int fd;
+
+	if (slots & (slots - 1)) {
+		PRINT_ERROR("slots not a power of 2: slots=%u", slots);
+		exit(-1);
+	}
+
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (fd == -1) {
+		PRINT_ERROR("open failed: path='%s'", path);
+		exit(-1);
+	}
+	if (ftruncate(fd, size)) {
+		PRINT_ERROR("ftruncate failed: path='%s', size=%u", path, (uint32_t) size);
+		exit(-1);
+	}
+
+	ring = shm_map(path, fd, size);
+	close(fd);
+
+	ring->hdr->slots = slots;
+	ring->hdr->slot_size = sizeof(struct ShmRingSlot);
+	shm_sync(ring);
+	__atomic_store_n(&ring->hdr->magic, SHM_RING_MAGIC, __ATOMIC_RELEASE);
+
+	PRINT_DEBUG("Exited: path='%s', slots=%u, size=%u", path, slots, (uint32_t) size);
+	return ring;
+}
+
+/**@brief maps a ring created by the other process, blocking until it exists like opening a fifo did
+ * @param path the ring file
+ * @return the ring
+ * */
+finsShmRing open_shm_ring(const char *path) {
+	struct ShmRingHeader hdr;
+	finsShmRing ring;
+	int fd;
+
+	while (1) {
+		fd = open(path, O_RDWR);
+		if (fd != -1) {
+			if (read(fd, &hdr, sizeof(hdr)) == sizeof(hdr) && __atomic_load_n(&hdr.magic, __ATOMIC_ACQUIRE) == SHM_RING_MAGIC) {
+				break;
+			}
+			close(fd);
+		}
+		PRINT_DEBUG("waiting for ring: path='%s'", path);
+		usleep(100000);
+	}
+
+	if (hdr.slot_size != sizeof(struct ShmRingSlot)) {
+		PRINT_ERROR("slot size mismatch, rebuild capturer and core: path='%s', slot_size=%u", path, hdr.slot_size);
+		exit(-1);
+	}
+
+	ring = shm_map(path, fd, sizeof(struct ShmRingHeader) + hdr.slots * sizeof(struct ShmRingSlot));
+	close(fd);
+	shm_sync(ring);
+
+	PRINT_DEBUG("Exited: path='%s', slots=%u, head=%u, tail=%u", path, hdr.slots, ring->head, ring->tail);
+	return ring;
+}
+
+void close_shm_ring(finsShmRing ring) {
+	if (ring != NULL) {
+		munmap(ring->hdr, ring->size);
+		free(ring);
+	}
+}
+
+/**@brief copies a frame into the next slot, it is seen by the consumer after flush_shm_ring()
+ * @param ring the ring, only the producer may write
+ * @param frame the frame
+ * @param len its length, at most SHM_RING_FRAME_MAX
+ * @return 1 on success, 0 if the frame is too big or the ring is full, in which case it is counted as dropped
+ * */
+int write_shm_ring(finsShmRing ring, const uint8_t *frame, uint32_t len) {
+	return write_shm_ring_split(ring, frame, len, NULL, 0);
+}
+
+/**@brief like write_shm_ring() for a frame in two pieces, gathered into the slot
+ * @param rest the second piece, may be NULL if rest_len is 0
+ * @param rest_len its length, len + rest_len at most SHM_RING_FRAME_MAX
+ * */
+int write_shm_ring_split(finsShmRing ring, const uint8_t *frame, uint32_t len, const uint8_t *rest, uint32_t rest_len) {
+	struct ShmRingSlot *slot;
+
+	if (len + rest_len > SHM_RING_FRAME_MAX) {
+		PRINT_ERROR("frame too big: len=%u, max=%u", len + rest_len, SHM_RING_FRAME_MAX);
+		__atomic_fetch_add(&ring->hdr->dropped, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+
+	if (ring->head - ring->tail_cache > ring->mask) {
+		ring->tail_cache = __atomic_load_n(&ring->hdr->tail, __ATOMIC_ACQUIRE);
+		if (ring->head - ring->tail_cache > ring->mask) {
+			__atomic_fetch_add(&ring->hdr->dropped, 1, __ATOMIC_RELAXED);
+			return 0;
+		}
+	}
+
+	slot = &ring->slot[ring->head & ring->mask];
+	slot->len = len + rest_len;
+	memcpy(slot->data, frame, len);
+	if (rest_len) {
+		memcpy(slot->data + len, rest, rest_len);
+	}
+	ring->head++;
+
+	return 1;
+}
+
+/**@brief publishes the frames written since the last flush and wakes the consumer if it sleeps
+ * @param ring the ring, only the producer may flush
+ * */
+void flush_shm_ring(finsShmRing ring) {
+	struct ShmRingHeader *hdr = ring->hdr;
+
+	if (ring->head == hdr->head) {
+		return;
+	}
+
+	__atomic_store_n(&hdr->head, ring->head, __ATOMIC_RELEASE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST); //pairs with the fence in wait_shm_ring
+	if (__atomic_load_n(&hdr->waiting, __ATOMIC_RELAXED)) {
+		__atomic_fetch_add(&hdr->wake, 1, __ATOMIC_RELEASE);
+		shm_futex(&hdr->wake, FUTEX_WAKE, 1, -1);
+	}
+}
+
+/**@brief tells how many frames can be written before the ring is full, for a producer that would
+ * rather wait for the consumer than drop
+ * @param ring the ring, only the producer may ask
+ * @return the free slots
+ * */
+uint32_t space_shm_ring(finsShmRing ring) {
+	ring->tail_cache = __atomic_load_n(&ring->hdr->tail, __ATOMIC_ACQUIRE);
+	return ring->mask + 1 - (ring->head - ring->tail_cache);
+}
+
+/** hands freed slots back to the producer */
+static void shm_release(finsShmRing ring) {
+	if (ring->unpublished) {
+		__atomic_store_n(&ring->hdr->tail, ring->tail, __ATOMIC_RELEASE);
+		ring->unpublished = 0;
+	}
+}
+
+/**@brief gives the next frame, in place. It stays valid until pop_shm_ring()
+ * @param ring the ring, only the consumer may read
+ * @param len set to the frame length
+ * @return the frame, or NULL if the ring is empty
+ * */
+uint8_t *read_shm_ring(finsShmRing ring, uint32_t *len) {
+	struct ShmRingSlot *slot;
+
+	if (ring->tail == ring->head_cache) {
+		shm_release(ring);
+		ring->head_cache = __atomic_load_n(&ring->hdr->head, __ATOMIC_ACQUIRE);
+		if (ring->tail == ring->head_cache) {
+			return NULL;
+		}
+	}
+
+	slot = &ring->slot[ring->tail & ring->mask];
+	*len = slot->len;
+	return slot->data;
+}
+
+/**@brief frees the slot of the frame returned by read_shm_ring()
+ * @param ring the ring
+ * */
+void pop_shm_ring(finsShmRing ring) {
+	ring->tail++;
+	if (++ring->unpublished >= SHM_RING_BATCH) {
+		shm_release(ring);
+	}
+}
+
+/**@brief sleeps until the producer flushes, without a syscall if it already has
+ * @param ring the ring, only the consumer may wait
+ * @param timeout_ms longest sleep, -1 for none
+ * @return 1 if the ring has frames
+ * */
+int wait_shm_ring(finsShmRing ring, int timeout_ms) {
+	struct ShmRingHeader *hdr = ring->hdr;
+	uint32_t wake = __atomic_load_n(&hdr->wake, __ATOMIC_ACQUIRE);
+
+	shm_release(ring);
+
+	__atomic_store_n(&hdr->waiting, 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST); //pairs with the fence in flush_shm_ring
+	if (ring->tail == __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE)) {
+		shm_futex(&hdr->wake, FUTEX_WAIT, wake, timeout_ms);
+	}
+	__atomic_store_n(&hdr->waiting, 0, __ATOMIC_RELAXED);
+
+	ring->head_cache = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+	return ring->tail != ring->head_cache;
+}
+
+/**@brief wakes a consumer sleeping in wait_shm_ring(), for shutting it down
+ * @param ring the ring
+ * */
+void wake_shm_ring(finsShmRing ring) {
+	__atomic_fetch_add(&ring->hdr->wake, 1, __ATOMIC_RELEASE);
+	shm_futex(&ring->hdr->wake, FUTEX_WAKE, 1, -1);
+}
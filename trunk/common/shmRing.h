@@ -0,0 +1,77 @@
+/**
+ * @file shmRing.h
+ *
+ * @date Oct 18, 2026
+ * @brief single producer/single consumer ring of frames in a memory mapped file, shared by the
+ * capturer and the core. Frames are written straight into fixed size slots and the indices are
+ * published in batches, so the only syscall left is a futex wake when the reader is asleep.
+ */
+
+#ifndef SHMRING_H_
+#define SHMRING_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef BUILD_FOR_ANDROID
+#define FINS_SHM_ROOT "/data/data/fins"
+#else
+#define FINS_SHM_ROOT "/dev/shm"
+#endif
+
+#define FINS_CAPTURE_RING FINS_SHM_ROOT "/fins_capture"
+#define FINS_INJECT_RING FINS_SHM_ROOT "/fins_inject"
+
+#define SHM_RING_SLOTS 1024 //must be a power of 2
+#define SHM_RING_FRAME_MAX 4096 //largest frame, the capturer's SNAP_LEN
+#define SHM_RING_CACHE_LINE 64
+#define SHM_RING_MAGIC 0x46494e53
+
+/** the part that lives in the file, followed by the slots */
+struct ShmRingHeader {
+	uint32_t magic; //written last by the creator
+	uint32_t slots;
+	uint32_t slot_size;
+	uint32_t head __attribute__ ((aligned (SHM_RING_CACHE_LINE))); //next slot the producer publishes
+	uint32_t dropped; //frames the producer could not fit
+	uint32_t tail __attribute__ ((aligned (SHM_RING_CACHE_LINE))); //next slot the consumer frees
+	uint32_t waiting; //consumer is about to sleep on wake
+	uint32_t wake; //futex word, bumped by the producer when waiting is set
+};
+
+struct ShmRingSlot {
+	uint32_t len;
+	uint8_t data[SHM_RING_FRAME_MAX] __attribute__ ((aligned (SHM_RING_CACHE_LINE)));
+};
+
+/** a process' handle on a ring, head/tail here run ahead of the shared ones until published */
+struct ShmRingRecord {
+	struct ShmRingHeader *hdr;
+	struct ShmRingSlot *slot;
+	size_t size;
+	uint32_t mask;
+	uint32_t head;
+	uint32_t tail_cache;
+	uint32_t tail;
+	uint32_t head_cache;
+	uint32_t unpublished;
+	char path[100];
+};
+
+typedef struct ShmRingRecord *finsShmRing;
+
+finsShmRing create_shm_ring(const char *path, uint32_t slots);
+finsShmRing open_shm_ring(const char *path);
+void close_shm_ring(finsShmRing ring);
+
+int write_shm_ring(finsShmRing ring, const uint8_t *frame, uint32_t len);
+int write_shm_ring_split(finsShmRing ring, const uint8_t *frame, uint32_t len, const uint8_t *rest, uint32_t rest_len);
+void flush_shm_ring(finsShmRing ring);
+uint32_t space_shm_ring(finsShmRing ring);
+
+uint8_t *read_shm_ring(finsShmRing ring, uint32_t *len);
+void pop_shm_ring(finsShmRing ring);
+int wait_shm_ring(finsShmRing ring, int timeout_ms);
+void wake_shm_ring(finsShmRing ring);
+
+#endif /* SHMRING_H_ */
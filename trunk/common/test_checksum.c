@@ -0,0 +1,221 @@
+/**@file test_checksum.c
+ *@brief checks every checksum kernel this cpu has against a byte at a time sum, for all lengths and
+ * alignments, with chained and copied buffers and incremental updates, then times them against the
+ * loops IPv4 (native 16 bit words) and UDP/TCP/ICMP (bytes, big endian) used before.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include "finschecksum.h"
+
+#define TEST_BUF 10000
+#define TEST_BYTES (200 * 1000 * 1000) //bytes summed per timing
+
+static const char *test_kernels[FINS_CSUM_KERNELS] = { "word", "sse2", "avx2" };
+static const uint32_t test_sizes[] = { 20, 64, 576, 1500, 9000 };
+
+uint8_t test_src[TEST_BUF + 64];
+uint8_t test_dst[TEST_BUF + 64];
+volatile uint32_t test_sink;
+
+uint64_t test_now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/** what UDP_checksum()/icmp_checksum() did, returns host order */
+uint16_t test_old_bytes(uint8_t *pt, uint32_t len) {
+	uint32_t sum = 0;
+	uint32_t i;
+
+	for (i = 1; i < len; i += 2, pt += 2) {
+		sum += (*pt << 8) + *(pt + 1);
+	}
+	if (len & 0x1) {
+		sum += *pt << 8;
+	}
+	while ((sum >> 16)) {
+		sum = (sum & 0xFFFF) + (sum >> 16);
+	}
+	return (uint16_t) ~sum;
+}
+
+/** what IP4_checksum() did, returns network order */
+uint16_t test_old_native(void *ptr, int length) {
+	int sum = 0;
+	uint16_t *w = (uint16_t *) ptr;
+	int nleft = length;
+
+	while (nleft > 1) {
+		sum += *w++;
+		nleft -= 2;
+	}
+	sum = (sum >> 16) + (sum & 0xFFFF);
+	sum += (sum >> 16);
+	return (uint16_t) ~sum;
+}
+
+int test_kernel(int kernel) {
+	uint32_t len, off, split, sum;
+	uint16_t want, check, old, new;
+	uint32_t old32, new32;
+	int bad = 0;
+	int i;
+
+	for (len = 0; len <= 2100; len++) {
+		for (off = 0; off < 8; off++) {
+			want = test_old_bytes(test_src + off, len);
+			if (ntohs(fins_csum_fold(fins_csum_partial(test_src + off, len, 0))) != want) {
+				bad++;
+			}
+
+			memset(test_dst, 0, len + 16);
+			sum = fins_csum_copy(test_dst + off + 1, test_src + off, len, 0);
+			if (ntohs(fins_csum_fold(sum)) != want || memcmp(test_dst + off + 1, test_src + off, len) != 0 || test_dst[off + 1 + len] != 0) {
+				bad++;
+			}
+
+			split = (len / 3) & ~1;
+			sum = fins_csum_partial(test_src + off, split, 0);
+			sum = fins_csum_partial(test_src + off + split, len - split, sum);
+			if (ntohs(fins_csum_fold(sum)) != want) {
+				bad++;
+			}
+		}
+	}
+
+	//a checksummed buffer folds to 0, and stays checked out after incremental updates
+	for (i = 0; i < 10000; i++) {
+		len = 20 + 2 * (rand() % 40);
+		test_src[10] = test_src[11] = 0;
+		check = fins_csum_fold(fins_csum_partial(test_src, len, 0));
+		memcpy(test_src + 10, &check, 2);
+		if (fins_csum_fold(fins_csum_partial(test_src, len, 0)) != 0) {
+			bad++;
+		}
+
+		memcpy(&old, test_src + 8, 2);
+		new = (uint16_t) rand();
+		memcpy(test_src + 8, &new, 2);
+		check = fins_csum_update16(check, old, new);
+		memcpy(test_src + 10, &check, 2);
+		if (fins_csum_fold(fins_csum_partial(test_src, len, 0)) != 0) {
+			bad++;
+		}
+
+		memcpy(&old32, test_src + 12, 4);
+		new32 = (uint32_t) rand() * 2654435761u;
+		memcpy(test_src + 12, &new32, 4);
+		test_src[10] = test_src[11] = 0;
+		want = fins_csum_fold(fins_csum_partial(test_src, len, 0));
+		if (fins_csum_update32(check, old32, new32) != want) {
+			bad++;
+		}
+	}
+
+	//pseudo header against the struct the protocols used to build
+	for (i = 0; i < 1000; i++) {
+		uint8_t hdr[12];
+		uint32_t src = (uint32_t) rand() * 2654435761u;
+		uint32_t dst = (uint32_t) rand() * 2246822519u;
+		uint8_t proto = (uint8_t) rand();
+		uint16_t plen = (uint16_t) rand();
+
+		memcpy(hdr, &src, 4);
+		memcpy(hdr + 4, &dst, 4);
+		hdr[8] = 0;
+		hdr[9] = proto;
+		hdr[10] = plen >> 8;
+		hdr[11] = plen & 0xFF;
+		if (fins_csum_fold(fins_csum_pseudo(src, dst, proto, plen, 0)) != fins_csum_fold(fins_csum_partial(hdr, 12, 0))) {
+			bad++;
+		}
+	}
+	return bad;
+}
+
+double test_time_old(int native, uint32_t size) {
+	uint32_t rounds = TEST_BYTES / size;
+	uint64_t start = test_now_ns();
+	uint32_t i;
+
+	for (i = 0; i < rounds; i++) {
+		test_sink += native ? test_old_native(test_src, size) : test_old_bytes(test_src, size);
+	}
+	return (double) (test_now_ns() - start) / rounds;
+}
+
+double test_time_new(int copy, uint32_t size) {
+	uint32_t rounds = TEST_BYTES / size;
+	uint64_t start = test_now_ns();
+	uint32_t i;
+
+	for (i = 0; i < rounds; i++) {
+		if (copy) {
+			test_sink += fins_csum_fold(fins_csum_copy(test_dst, test_src, size, 0));
+		} else {
+			test_sink += fins_csum_fold(fins_csum_partial(test_src, size, 0));
+		}
+	}
+	return (double) (test_now_ns() - start) / rounds;
+}
+
+double test_time_memcpy(uint32_t size) {
+	uint32_t rounds = TEST_BYTES / size;
+	uint64_t start = test_now_ns();
+	uint32_t i;
+
+	for (i = 0; i < rounds; i++) {
+		memcpy(test_dst, test_src, size);
+		test_sink += test_old_bytes(test_dst, size);
+	}
+	return (double) (test_now_ns() - start) / rounds;
+}
+
+int main(int argc, char *argv[]) {
+	uint32_t s;
+	int bad = 0;
+	int kernel;
+	int i;
+
+	srand(1);
+	for (i = 0; i < TEST_BUF + 64; i++) {
+		test_src[i] = (uint8_t) rand();
+	}
+
+	for (kernel = 0; kernel < FINS_CSUM_KERNELS; kernel++) {
+		if (!fins_csum_use(kernel)) {
+			printf("%s: not supported\n", test_kernels[kernel]);
+			continue;
+		}
+		i = test_kernel(kernel);
+		printf("%s: %s\n", test_kernels[kernel], i ? "FAILED" : "ok");
+		bad += i;
+	}
+
+	printf("\nns per checksum   old bytes  old native");
+	for (kernel = 0; kernel < FINS_CSUM_KERNELS; kernel++) {
+		printf("  %10s", test_kernels[kernel]);
+	}
+	printf("  memcpy+old   copy+sum\n");
+	for (s = 0; s < sizeof(test_sizes) / sizeof(test_sizes[0]); s++) {
+		printf("%5u bytes      %10.1f  %10.1f", test_sizes[s], test_time_old(0, test_sizes[s]), test_time_old(1, test_sizes[s]));
+		for (kernel = 0; kernel < FINS_CSUM_KERNELS; kernel++) {
+			if (fins_csum_use(kernel)) {
+				printf("  %10.1f", test_time_new(0, test_sizes[s]));
+			} else {
+				printf("  %10s", "-");
+			}
+		}
+		printf("  %10.1f", test_time_memcpy(test_sizes[s]));
+		for (kernel = FINS_CSUM_KERNELS - 1; !fins_csum_use(kernel); kernel--)
+			;
+		printf(" %10.1f\n", test_time_new(1, test_sizes[s]));
+	}
+
+	return bad != 0;
+}
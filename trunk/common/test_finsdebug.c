@@ -0,0 +1,118 @@
+/**@file test_finsdebug.c
+ *@brief measures what a PRINT_DEBUG costs the calling thread when filtered out, when written through
+ * the ring and when written at once like before, and checks that messages from several threads all
+ * come out, in order per thread. stdout goes to a scratch file, results go to stderr.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include "finsdebug.h"
+
+#define TEST_FILE "/tmp/fins_test_log"
+#define TEST_MESSAGES 200000
+#define TEST_THREADS 4
+#define TEST_GAP 8 //messages per thread between short pauses, so the writer keeps up
+
+uint64_t test_now_ns(clockid_t clock) {
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/** a typical hot path message, like conn_list_find()'s */
+double test_cost(int count) {
+	uint64_t start = test_now_ns(CLOCK_THREAD_CPUTIME_ID);
+	int i;
+
+	for (i = 0; i < count; i++) {
+		PRINT_DEBUG("Entered: host=%u/%u, rem=%u/%u", 0xc0a80114, 5000 + i, 0xc0a80101, 80);
+	}
+	return (double) (test_now_ns(CLOCK_THREAD_CPUTIME_ID) - start) / count;
+}
+
+void *test_thread(void *local) {
+	int id = *(int *) local;
+	int i;
+
+	for (i = 0; i < TEST_MESSAGES; i++) {
+		PRINT_DEBUG("t=%d i=%d", id, i);
+		if (i % TEST_GAP == 0) {
+			usleep(1);
+		}
+	}
+
+	pthread_exit(NULL);
+}
+
+int main(int argc, char *argv[]) {
+	pthread_t thread[TEST_THREADS];
+	int id[TEST_THREADS];
+	int next[TEST_THREADS];
+	char line[300];
+	FILE *log;
+	char *msg;
+	uint32_t dropped = 0;
+	uint32_t got = 0;
+	int bad = 0;
+	uint32_t n;
+	int t;
+	int i;
+
+	if (freopen(TEST_FILE, "w", stdout) == NULL) {
+		fprintf(stderr, "could not open %s\n", TEST_FILE);
+		exit(-1);
+	}
+
+	fins_log_set("none");
+	fprintf(stderr, "filtered: %.1f ns per message\n", test_cost(10000000));
+	fins_log_set("debug");
+	fprintf(stderr, "ring: %.1f ns per message\n", test_cost(3000));
+	fins_log_flush();
+	fins_log_set("debug,sync");
+	fprintf(stderr, "sync: %.1f ns per message\n", test_cost(3000));
+	fflush(stdout);
+
+	//several threads through the ring, every message must come out once and in order
+	if (freopen(TEST_FILE, "w", stdout) == NULL) {
+		fprintf(stderr, "could not reopen %s\n", TEST_FILE);
+		exit(-1);
+	}
+	fins_log_set("async");
+	if (fork() == 0) { //in a child, which has to start its own writer
+		for (t = 0; t < TEST_THREADS; t++) {
+			id[t] = t;
+			pthread_create(&thread[t], NULL, test_thread, &id[t]);
+		}
+		for (t = 0; t < TEST_THREADS; t++) {
+			pthread_join(thread[t], NULL);
+		}
+		exit(0); //fins_log_flush() writes out the rest
+	}
+	wait(NULL);
+
+	log = fopen(TEST_FILE, "r");
+	memset(next, 0, sizeof(next));
+	while (fgets(line, sizeof(line), log) != NULL) {
+		if (sscanf(line, "DEBUG: log ring full, dropped %u messages", &n) == 1) {
+			dropped += n;
+			continue;
+		}
+		msg = strstr(line, "):t=");
+		if (msg == NULL || sscanf(msg, "):t=%d i=%d", &t, &i) != 2 || t < 0 || t >= TEST_THREADS || i < next[t]) {
+			bad++;
+			continue;
+		}
+		next[t] = i + 1;
+		got++;
+	}
+	fclose(log);
+	unlink(TEST_FILE);
+
+	fprintf(stderr, "threads: sent=%u, written=%u, dropped=%u, bad=%d\n", TEST_THREADS * TEST_MESSAGES, got, dropped, bad);
+	return bad != 0 || got + dropped != TEST_THREADS * TEST_MESSAGES;
+}
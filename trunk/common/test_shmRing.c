@@ -0,0 +1,124 @@
+/**@file test_shmRing.c
+ *@brief runs a ring between two local processes the way the capturer and the core use it, no NIC
+ * needed: checks every frame arrives intact and in order, measures the frame rate, and that the
+ * reader sleeps while the ring is idle. Results go to stderr, so run as ./test_shmRing > /dev/null
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/wait.h>
+#include "finsdebug.h"
+#include "shmRing.h"
+
+#define TEST_RING FINS_SHM_ROOT "/fins_test_ring"
+#define TEST_FRAMES 2000000
+#define TEST_FLUSH 32
+#define TEST_IDLE_S 1
+
+uint64_t test_now_ns(clockid_t clock) {
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+uint32_t test_len(uint32_t i) {
+	return 60 + i % 1455;
+}
+
+/** plays the capturer: frames of every ethernet size, flushed in batches like pcap_dispatch() */
+void test_producer(void) {
+	uint8_t frame[SHM_RING_FRAME_MAX];
+	finsShmRing ring;
+	uint32_t len;
+	uint32_t i;
+
+	usleep(200000); //the reader has to wait in open_shm_ring() first
+	ring = create_shm_ring(TEST_RING, SHM_RING_SLOTS);
+
+	for (i = 0; i < TEST_FRAMES; i++) {
+		len = test_len(i);
+		memcpy(frame, &i, sizeof(i));
+		frame[len - 1] = (uint8_t) i;
+
+		while (!write_shm_ring(ring, frame, len)) {
+			flush_shm_ring(ring);
+			sched_yield();
+		}
+		if (i % TEST_FLUSH == TEST_FLUSH - 1) {
+			flush_shm_ring(ring);
+		}
+	}
+	flush_shm_ring(ring);
+
+	//idle, then one last frame to end the test
+	sleep(TEST_IDLE_S);
+	write_shm_ring(ring, frame, sizeof(i));
+	flush_shm_ring(ring);
+
+	close_shm_ring(ring);
+	exit(0);
+}
+
+int main(int argc, char *argv[]) {
+	finsShmRing ring;
+	uint8_t *frame;
+	uint32_t len;
+	uint32_t i = 0;
+	uint32_t seq;
+	int bad = 0;
+	uint64_t wall;
+	uint64_t cpu;
+	pid_t pid;
+
+	unlink(TEST_RING);
+
+	pid = fork();
+	if (pid == 0) {
+		test_producer();
+	} else if (pid < 0) {
+		PRINT_ERROR("fork failed");
+		exit(-1);
+	}
+
+	//plays the core's capturer_to_interface()
+	ring = open_shm_ring(TEST_RING);
+
+	wall = test_now_ns(CLOCK_MONOTONIC);
+	while (i < TEST_FRAMES) {
+		frame = read_shm_ring(ring, &len);
+		if (frame == NULL) {
+			wait_shm_ring(ring, -1);
+			continue;
+		}
+
+		memcpy(&seq, frame, sizeof(seq));
+		if (seq != i || len != test_len(i) || frame[len - 1] != (uint8_t) i) {
+			bad++;
+		}
+		pop_shm_ring(ring);
+		i++;
+	}
+	wall = test_now_ns(CLOCK_MONOTONIC) - wall;
+	fprintf(stderr, "transfer: frames=%u, bad=%d, %.2f Mframes/s, %.2f Gbit/s\n", i, bad, 1000.0 * i / wall, 8.0 * (60 + 1454 / 2.0) * i / wall);
+
+	//idle: the reader should be asleep in the futex
+	wall = test_now_ns(CLOCK_MONOTONIC);
+	cpu = test_now_ns(CLOCK_PROCESS_CPUTIME_ID);
+	while ((frame = read_shm_ring(ring, &len)) == NULL) {
+		wait_shm_ring(ring, -1);
+	}
+	pop_shm_ring(ring);
+	cpu = test_now_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+	wall = test_now_ns(CLOCK_MONOTONIC) - wall;
+	fprintf(stderr, "idle: %.3f%% of one core while waiting %.1fs\n", 100.0 * cpu / wall, wall / 1e9);
+
+	waitpid(pid, NULL, 0);
+	close_shm_ring(ring);
+	unlink(TEST_RING);
+
+	return bad != 0;
+}
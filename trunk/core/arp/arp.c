@@ -11,26 +11,33 @@
 #include <arpa/inet.h>
 #include <string.h>
 #include <pthread.h>
+#include <libconfig.h>
 #include "arp.h"
 
 int arp_running;
 pthread_t switch_to_arp_thread;
 
-sem_t ARP_to_Switch_Qsem;
-finsQueue ARP_to_Switch_Queue;
+finsRing ARP_to_Switch_Queue;
 
-sem_t Switch_to_ARP_Qsem;
-finsQueue Switch_to_ARP_Queue;
+finsRing Switch_to_ARP_Queue;
+struct finsEvent Switch_to_ARP_Event;
+
+extern struct finsEvent Switch_Event;
 
 struct arp_interface *interface_list;
 uint32_t interface_num;
 
-struct arp_cache *cache_list; //The list of current cache we have
-uint32_t cache_num;
+struct arp_cache_table cache_table; //The neighbors we know or are seeking
 
 uint8_t arp_interrupt_flag;
 int arp_thread_count = 0;
 
+//one timer for the whole cache, ticking while any entry waits on the wheel
+pthread_t arp_to_thread_id;
+int arp_to_fd = -1;
+uint8_t arp_to_running;
+uint8_t arp_to_flag;
+
 /**
  * An address like a:b:c:d:e:f is converted into an 64-byte unsigned integer
  * @brief this function takes a user provided MAC address as a set of octets and produces a uint64 address
@@ -326,6 +333,7 @@ void *arp_to_thread(void *local) {
 	uint8_t *running = to_data->running;
 	uint8_t *flag = to_data->flag;
 	uint8_t *interrupt = to_data->interrupt;
+	struct finsEvent *event = to_data->event;
 	free(to_data);
 
 	int ret;
@@ -347,6 +355,7 @@ void *arp_to_thread(void *local) {
 		PRINT_DEBUG("Throwing TO flag: id=%d, fd=%d", id, fd);
 		*interrupt = 1;
 		*flag = 1;
+		post_event(event);
 	}
 
 	PRINT_DEBUG("Exited: id=%d, fd=%d", id, fd);
@@ -383,181 +392,312 @@ void arp_start_timer(int fd, double millis) {
 	}
 }
 
-struct arp_cache *cache_create(uint32_t ip_addr) {
-	PRINT_DEBUG("Entered: ip=%u", ip_addr);
+/**@brief the time in timer wheel ticks, ARP_TICK ms each */
+uint32_t arp_now(void) {
+	struct timespec ts;
 
-	struct arp_cache *cache = (struct arp_cache *) malloc(sizeof(struct arp_cache));
-	if (cache == NULL) {
-		PRINT_ERROR("Unable to create cache: ip=%u", ip_addr);
-		exit(-1);
-	}
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t) (ts.tv_sec * (1000 / ARP_TICK) + ts.tv_nsec / (ARP_TICK * 1000000));
+}
 
-	cache->next = NULL;
-	cache->running_flag = 1;
+static uint32_t cache_hash(uint32_t ip_addr) {
+	uint32_t h = ip_addr * 0x9e3779b1;
 
-	cache->mac_addr = ARP_MAC_NULL;
-	cache->ip_addr = ip_addr;
+	return h ^ (h >> 16);
+}
 
-	cache->request_list = request_list_create(ARP_REQUEST_LIST_MAX);
-	cache->request_num = 0;
+/** changes to the fields arp_cache_lookup() reads go between these, readers retry if seq moved */
+static void cache_write_begin(struct arp_cache *cache) {
+	__atomic_store_n(&cache->seq, cache->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
 
-	cache->seeking = 0;
-	memset(&cache->updated_stamp, 0, sizeof(struct timeval));
+static void cache_write_end(struct arp_cache *cache) {
+	__atomic_store_n(&cache->seq, cache->seq + 1, __ATOMIC_RELEASE);
+}
 
-	cache->to_flag = 0;
-	cache->to_fd = timerfd_create(CLOCK_REALTIME, 0);
-	if (cache->to_fd == -1) {
-		PRINT_ERROR("ERROR: unable to create to_fd.");
-		exit(-1);
-	}
-	cache->retries = 0;
+static void cache_publish(struct arp_cache *cache, uint8_t state, uint32_t ip_addr, uint64_t mac_addr, uint32_t updated) {
+	cache_write_begin(cache);
+	__atomic_store_n(&cache->state, state, __ATOMIC_RELAXED);
+	__atomic_store_n(&cache->ip_addr, ip_addr, __ATOMIC_RELAXED);
+	__atomic_store_n(&cache->mac_addr, mac_addr, __ATOMIC_RELAXED);
+	__atomic_store_n(&cache->updated, updated, __ATOMIC_RELAXED);
+	cache_write_end(cache);
+}
 
-	//start timer thread
-	struct arp_to_thread_data *to_data = (struct arp_to_thread_data *) malloc(sizeof(struct arp_to_thread_data));
-	if (to_data == NULL) {
-		PRINT_ERROR("arp_to_thread_data alloc fail");
-		exit(-1);
+/**@brief allocates the table, with room for max entries at half load
+ * @param max the number of entries to hold at most
+ */
+void cache_table_init(uint32_t max) {
+	uint32_t slots = ARP_CACHE_WAYS;
+	uint32_t i;
+
+	PRINT_DEBUG("Entered: max=%u", max);
+
+	while (slots < 2 * max) {
+		slots <<= 1;
 	}
 
-	int id = arp_thread_count++;
-	to_data->id = id;
-	to_data->fd = cache->to_fd;
-	to_data->running = &cache->running_flag;
-	to_data->flag = &cache->to_flag;
-	to_data->interrupt = &arp_interrupt_flag;
-	if (pthread_create(&cache->to_thread, NULL, arp_to_thread, (void *) to_data)) {
-		PRINT_ERROR("ERROR: unable to create arp_to_thread thread.");
+	cache_table.slots = (struct arp_cache *) malloc(slots * sizeof(struct arp_cache));
+	if (cache_table.slots == NULL) {
+		PRINT_ERROR("Unable to create cache table: max=%u, slots=%u", max, slots);
 		exit(-1);
 	}
+	memset(cache_table.slots, 0, slots * sizeof(struct arp_cache));
+	for (i = 0; i < slots; i++) {
+		cache_table.slots[i].wheel_next = -1;
+		cache_table.slots[i].wheel_prev = -1;
+	}
 
-	PRINT_DEBUG("Exited: ip=%u, cache=%p, id=%d, to_fd=%d", ip_addr, cache, id, cache->to_fd);
-	return cache;
+	cache_table.mask = slots - 1;
+	cache_table.max = max;
+	cache_table.num = 0;
+	for (i = 0; i < ARP_WHEEL; i++) {
+		cache_table.wheel[i] = -1;
+	}
+	cache_table.tick = arp_now();
+	cache_table.timers = 0;
 }
 
-void cache_shutdown(struct arp_cache *cache) {
-	PRINT_DEBUG("Entered: cache=%p", cache);
+void cache_table_free(void) {
+	uint32_t i;
+
+	PRINT_DEBUG("Entered");
+
+	if (cache_table.slots == NULL) {
+		return;
+	}
+	for (i = 0; i <= cache_table.mask; i++) {
+		if (cache_table.slots[i].request_list) {
+			request_list_free(cache_table.slots[i].request_list);
+		}
+	}
+	free(cache_table.slots);
+	cache_table.slots = NULL;
+	cache_table.num = 0;
+}
 
-	cache->running_flag = 0;
+/**@brief finds the entry for an address, seeking or valid. ARP thread only, see arp_cache_lookup() */
+struct arp_cache *cache_find(uint32_t ip_addr) {
+	PRINT_DEBUG("Entered: ip=%u", ip_addr);
 
-	//stop threads
-	arp_start_timer(cache->to_fd, ARP_TO_MIN);
+	uint32_t home = cache_hash(ip_addr);
+	struct arp_cache *cache;
+	uint32_t way;
 
-	//sem_post(&conn->write_wait_sem);
-	//sem_post(&conn->write_sem);
-	//clear all threads using this conn_stub
+	for (way = 0; way < ARP_CACHE_WAYS; way++) {
+		cache = &cache_table.slots[(home + way) & cache_table.mask];
+		if (cache->state == ARP_CACHE_FREE) {
+			break;
+		}
+		if (cache->state >= ARP_CACHE_SEEKING && cache->ip_addr == ip_addr) {
+			PRINT_DEBUG("Exited: ip=%u, cache=%p", ip_addr, cache);
+			return cache;
+		}
+	}
 
-	/*#*/PRINT_DEBUG("");
-	//post to read/write/connect/etc threads
-	pthread_join(cache->to_thread, NULL);
-	/*#*/PRINT_DEBUG("");
+	PRINT_DEBUG("Exited: ip=%u, cache=%p", ip_addr, NULL);
+	return NULL;
 }
 
-void cache_free(struct arp_cache *cache) {
-	PRINT_DEBUG("Entered: cache=%p", cache);
+static void cache_wheel_remove(struct arp_cache *cache) {
+	struct arp_cache *slots = cache_table.slots;
 
-	if (cache->request_list) {
-		request_list_free(cache->request_list);
+	if (cache->wheel_prev >= 0) {
+		slots[cache->wheel_prev].wheel_next = cache->wheel_next;
+	} else if (cache_table.wheel[cache->timer & (ARP_WHEEL - 1)] == cache - slots) {
+		cache_table.wheel[cache->timer & (ARP_WHEEL - 1)] = cache->wheel_next;
+	} else {
+		return; //not on the wheel
+	}
+	if (cache->wheel_next >= 0) {
+		slots[cache->wheel_next].wheel_prev = cache->wheel_prev;
 	}
+	cache->wheel_next = -1;
+	cache->wheel_prev = -1;
 
-	free(cache);
+	if (--cache_table.timers == 0 && arp_to_fd != -1) {
+		arp_stop_timer(arp_to_fd);
+	}
 }
-int cache_list_insert(struct arp_cache *cache) {
-	PRINT_DEBUG("Entered: cache=%p", cache);
 
-	if (cache_list == NULL) {
-		cache_list = cache;
-	} else {
-		struct arp_cache *temp = cache_list;
+/**@brief (re)starts the timer of an entry
+ * @param timer the tick it goes off, less than ARP_WHEEL ticks away
+ */
+void cache_set_timer(struct arp_cache *cache, uint32_t timer) {
+	int index = cache - cache_table.slots;
+	int *head = &cache_table.wheel[timer & (ARP_WHEEL - 1)];
 
-		while (temp->next != NULL) {
-			temp = temp->next;
-		}
+	cache_wheel_remove(cache);
 
-		temp->next = cache;
-		cache->next = NULL;
+	cache->timer = timer;
+	cache->wheel_prev = -1;
+	cache->wheel_next = *head;
+	if (*head >= 0) {
+		cache_table.slots[*head].wheel_prev = index;
+	}
+	*head = index;
+
+	if (cache_table.timers++ == 0 && arp_to_fd != -1) {
+		struct itimerspec its;
+		its.it_value.tv_sec = 0;
+		its.it_value.tv_nsec = ARP_TICK * 1000000;
+		its.it_interval = its.it_value;
+		if (timerfd_settime(arp_to_fd, 0, &its, NULL) == -1) {
+			PRINT_ERROR("Error setting timer.");
+			exit(-1);
+		}
 	}
-
-	cache_num++;
-	return 1;
 }
 
-struct arp_cache *cache_list_find(uint32_t ip_addr) {
+/**@brief adds an entry for an address that isn't in the table. If the table is full, or the slots
+ * the address may go in are, the least recently used valid entry among those slots is dropped
+ * @return the entry, NULL if there was no room (only seeking entries around)
+ */
+struct arp_cache *cache_insert(uint32_t ip_addr, uint32_t now) {
 	PRINT_DEBUG("Entered: ip=%u", ip_addr);
 
-	struct arp_cache *cache = cache_list;
-	while (cache != NULL && cache->ip_addr != ip_addr) {
-		cache = cache->next;
+	uint32_t home = cache_hash(ip_addr);
+	struct arp_cache *cache;
+	struct arp_cache *room = NULL;
+	struct arp_cache *lru = NULL;
+	uint32_t way;
+
+	for (way = 0; way < ARP_CACHE_WAYS; way++) {
+		cache = &cache_table.slots[(home + way) & cache_table.mask];
+		if (cache->state <= ARP_CACHE_DEAD) {
+			if (room == NULL) {
+				room = cache;
+			}
+			if (cache->state == ARP_CACHE_FREE && cache_table.num < cache_table.max) {
+				break; //nothing needs replacing
+			}
+		} else if (cache->state == ARP_CACHE_VALID
+				&& (lru == NULL || (int32_t) (__atomic_load_n(&cache->used, __ATOMIC_RELAXED) - __atomic_load_n(&lru->used, __ATOMIC_RELAXED)) < 0)) {
+			lru = cache;
+		}
+	}
+
+	if (room == NULL || cache_table.num >= cache_table.max) {
+		if (lru == NULL) {
+			PRINT_DEBUG("Exited: ip=%u, cache=%p", ip_addr, NULL);
+			return NULL;
+		}
+		PRINT_DEBUG("evicting: cache=%p, ip=%u, used=%u", lru, lru->ip_addr, lru->used);
+		cache_remove(lru);
+		room = lru;
 	}
 
+	cache = room;
+	cache->retries = 0;
+	__atomic_store_n(&cache->used, now, __ATOMIC_RELAXED);
+	if (cache->request_list == NULL) {
+		cache->request_list = request_list_create(ARP_REQUEST_LIST_MAX);
+	}
+	cache_publish(cache, ARP_CACHE_SEEKING, ip_addr, ARP_MAC_NULL, now);
+	cache_table.num++;
+
 	PRINT_DEBUG("Exited: ip=%u, cache=%p", ip_addr, cache);
 	return cache;
 }
 
-void cache_list_remove(struct arp_cache *cache) {
+/**@brief drops an entry, frames waiting on it must have been answered */
+void cache_remove(struct arp_cache *cache) {
 	PRINT_DEBUG("Entered: cache=%p", cache);
 
-	if (cache_list == NULL) {
-		return;
-	}
+	cache_wheel_remove(cache);
+	cache_publish(cache, ARP_CACHE_DEAD, ARP_IP_NULL, ARP_MAC_NULL, 0);
+	cache_table.num--;
+}
 
-	if (cache_list == cache) {
-		cache_list = cache_list->next;
-		cache_num--;
-		return;
-	}
+/**@brief starts seeking the address of an entry again, the request has been sent */
+void cache_seek(struct arp_cache *cache, uint32_t now) {
+	cache->retries = 0;
+	cache_publish(cache, ARP_CACHE_SEEKING, cache->ip_addr, cache->mac_addr, now);
+	cache_set_timer(cache, now + ARP_RETRANS_TO_DEFAULT / ARP_TICK);
+}
 
-	struct arp_cache *temp = cache_list;
-	while (temp->next != NULL) {
-		if (temp->next == cache) {
-			temp->next = cache->next;
-			cache_num--;
-			return;
-		}
-		temp = temp->next;
-	}
+/**@brief records the address a reply gave, the entry stays valid for ARP_CACHE_TO_DEFAULT */
+void cache_confirm(struct arp_cache *cache, uint64_t mac_addr, uint32_t now) {
+	cache_publish(cache, ARP_CACHE_VALID, cache->ip_addr, mac_addr, now);
+	cache_set_timer(cache, now + ARP_CACHE_TO_DEFAULT / ARP_TICK);
 }
 
-struct arp_cache *cache_list_remove_first_non_seeking(void) {
-	PRINT_DEBUG("Entered");
+/**@brief runs the timers that went off up to now */
+void cache_wheel_turn(uint32_t now) {
+	struct arp_cache *cache;
+	uint32_t steps = now - cache_table.tick;
+	uint32_t tick;
+	int index;
+	int next;
 
-	if (cache_list == NULL) {
-		return NULL;
+	if (steps > ARP_WHEEL) {
+		steps = ARP_WHEEL;
 	}
-
-	struct arp_cache *cache = cache_list;
-	if (cache->seeking) {
-		struct arp_cache *next;
-
-		while (cache->next != NULL) {
-			if (cache->next->seeking) {
-				cache = cache->next;
-			} else {
-				next = cache->next;
-				cache->next = next->next;
-
-				cache_num--;
-				PRINT_DEBUG("Exited: cache=%p", next);
-				return next;
+	for (tick = now - steps + 1; steps > 0; steps--, tick++) {
+		for (index = cache_table.wheel[tick & (ARP_WHEEL - 1)]; index >= 0; index = next) {
+			cache = &cache_table.slots[index];
+			next = cache->wheel_next;
+			if ((int32_t) (cache->timer - now) <= 0) {
+				cache_wheel_remove(cache);
+				arp_handle_to(cache, now);
 			}
 		}
-
-		PRINT_DEBUG("Exited: cache=%p", NULL);
-		return NULL; //TODO change to head?
-	} else {
-		cache_list = cache->next;
 	}
-
-	cache_num--;
-	PRINT_DEBUG("Exited: cache=%p", cache);
-	return cache;
+	cache_table.tick = now;
 }
 
-int cache_list_is_empty(void) {
-	return cache_num == 0;
-}
+/**@brief finds the addresses for a frame going from src_ip to dst_ip without going through the ARP thread.
+ * Safe from any thread, a miss or an address being changed just means asking the ARP module
+ * @return 1 if both are known and up to date, 0 otherwise
+ */
+int arp_cache_lookup(uint32_t dst_ip, uint32_t src_ip, uint64_t *dst_mac, uint64_t *src_mac) {
+	struct arp_interface *interface;
+	struct arp_cache *slots = cache_table.slots;
+	struct arp_cache *cache;
+	uint32_t home = cache_hash(dst_ip);
+	uint32_t way;
+	uint32_t seq;
+	uint32_t ip_addr;
+	uint32_t updated;
+	uint64_t mac_addr;
+	uint8_t state;
+	uint32_t now;
+
+	//interfaces are registered before the module runs
+	for (interface = interface_list; interface != NULL && interface->ip_addr != src_ip; interface = interface->next)
+		;
+	if (interface == NULL || slots == NULL) {
+		return 0;
+	}
+	*src_mac = interface->mac_addr;
+
+	for (way = 0; way < ARP_CACHE_WAYS; way++) {
+		cache = &slots[(home + way) & cache_table.mask];
+		do {
+			seq = __atomic_load_n(&cache->seq, __ATOMIC_ACQUIRE);
+			state = __atomic_load_n(&cache->state, __ATOMIC_RELAXED);
+			ip_addr = __atomic_load_n(&cache->ip_addr, __ATOMIC_RELAXED);
+			mac_addr = __atomic_load_n(&cache->mac_addr, __ATOMIC_RELAXED);
+			updated = __atomic_load_n(&cache->updated, __ATOMIC_RELAXED);
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		} while ((seq & 1) || seq != __atomic_load_n(&cache->seq, __ATOMIC_RELAXED));
+
+		if (state == ARP_CACHE_FREE) {
+			return 0;
+		}
+		if (ip_addr == dst_ip && state == ARP_CACHE_VALID) {
+			now = arp_now();
+			if (now - updated >= ARP_CACHE_TO_DEFAULT / ARP_TICK) {
+				return 0;
+			}
+			__atomic_store_n(&cache->used, now, __ATOMIC_RELAXED);
+			*dst_mac = mac_addr;
+			return 1;
+		}
+	}
 
-int cache_list_has_space(void) {
-	return cache_num < ARP_CACHE_LIST_MAX;
+	return 0;
 }
 
 /**
@@ -645,27 +785,25 @@ void print_cache(void) { //TODO fix/update?
 	//print_IP_addrs(ptr_elementInList->ip_addr);
 	//print_MAC_addrs(ptr_elementInList->mac_addr);
 	//ptr_elementInList = ptr_elementInList->next; //move the pointer to the stored node
-	print_neighbors(cache_list);
+	print_neighbors();
 	PRINT_DEBUG("");
 }
 
 /**
  * @brief this function prints the list of addresses of a host's neighbors
  * (useful in testing/mimicing network response)
- * @param ptr_neighbors points to the first element of the list of 'neighbors'
  */
-void print_neighbors(struct arp_cache *ptr_list_neighbors) {
+void print_neighbors(void) {
+	uint32_t i;
 
-	struct arp_cache *ptr_elementInList;
-
-	ptr_elementInList = ptr_list_neighbors;
 	PRINT_DEBUG("List of addresses of neighbors:");
 
-	while (ptr_elementInList != NULL) {
-		print_IP_addrs(ptr_elementInList->ip_addr);
-		print_MAC_addrs(ptr_elementInList->mac_addr);
-		PRINT_DEBUG("");
-		ptr_elementInList = ptr_elementInList->next;
+	for (i = 0; cache_table.slots != NULL && i <= cache_table.mask; i++) {
+		if (cache_table.slots[i].state >= ARP_CACHE_SEEKING) {
+			print_IP_addrs(cache_table.slots[i].ip_addr);
+			print_MAC_addrs(cache_table.slots[i].mac_addr);
+			PRINT_DEBUG("");
+		}
 	}
 }
 
@@ -765,19 +903,28 @@ struct arp_message *fdf_to_arp(struct finsFrame *ff) {
 }
 
 void arp_get_ff(void) {
+	struct finsFrame *ffs[RING_BURST];
 	struct finsFrame *ff;
+	int n;
+	int i;
 
 	do {
-		sem_wait(&Switch_to_ARP_Qsem);
-		ff = read_queue(Switch_to_ARP_Queue);
-		sem_post(&Switch_to_ARP_Qsem);
-	} while (arp_running && ff == NULL && !arp_interrupt_flag); //TODO change logic here, combine with switch_to_arp?
+		n = read_ring_burst(ffs, RING_BURST, Switch_to_ARP_Queue);
+		if (arp_running && n == 0 && !arp_interrupt_flag) {
+			wait_event(&Switch_to_ARP_Event);
+		}
+	} while (arp_running && n == 0 && !arp_interrupt_flag); //TODO change logic here, combine with switch_to_arp?
 
 	if (!arp_running) {
+		while (n > 0) {
+			freeFinsFrame(ffs[--n]);
+		}
 		return;
 	}
 
-	if (ff) {
+	for (i = 0; i < n; i++) {
+		ff = writableFinsFrame(ffs[i]); //frames delivered to several modules are shared
+
 		if (ff->dataOrCtrl == CONTROL) {
 			arp_fcf(ff);
 			PRINT_DEBUG("");
@@ -792,12 +939,12 @@ void arp_get_ff(void) {
 		} else {
 			PRINT_ERROR("todo error");
 		}
-	} else if (arp_interrupt_flag) {
+	}
+
+	if (arp_interrupt_flag) {
 		arp_interrupt_flag = 0;
 
 		arp_interrupt();
-	} else {
-		PRINT_ERROR("todo error");
 	}
 }
 
@@ -892,35 +1039,19 @@ void arp_exec(struct finsFrame *ff) {
 }
 
 void arp_interrupt(void) {
-	struct arp_cache *cache = cache_list;
-	struct arp_cache *next;
-
-	while (cache) {
-		next = cache->next;
-		if (cache->to_flag) {
-			cache->to_flag = 0;
-
-			arp_handle_to(cache);
-		}
-		cache = next;
-	}
+	cache_wheel_turn(arp_now());
 }
 
 /**@brief to be completed. A fins frame is written to the 'wire'*/
 int arp_to_switch(struct finsFrame *ff) {
 	PRINT_DEBUG("Entered: ff=%p, meta=%p", ff, ff->metaData);
-	if (sem_wait(&ARP_to_Switch_Qsem)) {
-		PRINT_ERROR("ARP_to_Switch_Qsem wait prob");
-		exit(-1);
-	}
-	if (write_queue(ff, ARP_to_Switch_Queue)) {
+	if (write_ring(ff, ARP_to_Switch_Queue)) {
 		/*#*/PRINT_DEBUG("");
-		sem_post(&ARP_to_Switch_Qsem);
+		post_event(&Switch_Event);
 		return 1;
 	}
 
 	PRINT_DEBUG("");
-	sem_post(&ARP_to_Switch_Qsem);
 
 	return 0;
 }
@@ -945,8 +1076,23 @@ void arp_init(void) {
 	interface_list = NULL;
 	interface_num = 0;
 
-	cache_list = NULL;
-	cache_num = 0;
+	config_t cfg;
+	config_setting_t *setting;
+	int cache_size = ARP_CACHE_SIZE_DEFAULT;
+
+	config_init(&cfg);
+	if (config_read_file(&cfg, ARP_CONFIG_FILE)) {
+		setting = config_lookup(&cfg, "arp.cache_size");
+		if (setting != NULL && config_setting_get_int(setting) > 0) {
+			cache_size = config_setting_get_int(setting);
+		}
+	} else {
+		PRINT_DEBUG("no arp config, using defaults: file='%s', error='%s'", ARP_CONFIG_FILE, config_error_text(&cfg));
+	}
+	config_destroy(&cfg);
+
+	PRINT_DEBUG("cache_size=%d", cache_size);
+	cache_table_init(cache_size);
 
 	//#############
 	//uint64_t MACADDRESS = 0x080027445566; //eth0, bridged
@@ -961,6 +1107,30 @@ void arp_init(void) {
 void arp_run(pthread_attr_t *fins_pthread_attr) {
 	PRINT_DEBUG("Entered");
 
+	arp_to_fd = timerfd_create(CLOCK_MONOTONIC, 0);
+	if (arp_to_fd == -1) {
+		PRINT_ERROR("ERROR: unable to create to_fd.");
+		exit(-1);
+	}
+
+	struct arp_to_thread_data *to_data = (struct arp_to_thread_data *) malloc(sizeof(struct arp_to_thread_data));
+	if (to_data == NULL) {
+		PRINT_ERROR("to_data alloc fail");
+		exit(-1);
+	}
+	to_data->id = arp_thread_count++;
+	to_data->fd = arp_to_fd;
+	to_data->running = &arp_to_running;
+	to_data->flag = &arp_to_flag;
+	to_data->interrupt = &arp_interrupt_flag;
+	to_data->event = &Switch_to_ARP_Event;
+	arp_to_running = 1;
+	arp_to_flag = 0;
+	if (pthread_create(&arp_to_thread_id, fins_pthread_attr, arp_to_thread, (void *) to_data)) {
+		PRINT_ERROR("ERROR: unable to create arp_to_thread.");
+		exit(-1);
+	}
+
 	pthread_create(&switch_to_arp_thread, fins_pthread_attr, switch_to_arp, fins_pthread_attr);
 }
 
@@ -984,11 +1154,20 @@ int arp_register_interface(uint64_t MAC_address, uint32_t IP_address) {
 void arp_shutdown(void) {
 	PRINT_DEBUG("Entered");
 	arp_running = 0;
+	post_event(&Switch_to_ARP_Event);
 
 	//TODO fill this out
 
 	PRINT_DEBUG("Joining switch_to_arp_thread");
 	pthread_join(switch_to_arp_thread, NULL);
+
+	//the timer may be stopped, so wake its thread up
+	arp_to_running = 0;
+	arp_start_timer(arp_to_fd, 1);
+	PRINT_DEBUG("Joining arp_to_thread");
+	pthread_join(arp_to_thread_id, NULL);
+	close(arp_to_fd);
+	arp_to_fd = -1;
 }
 
 void arp_release(void) {
@@ -1003,15 +1182,8 @@ void arp_release(void) {
 		interface_free(interface);
 	}
 
-	struct arp_cache *cache;
-	while (!cache_list_is_empty()) {
-		cache = cache_list;
-		cache_list_remove(cache);
-
-		cache_shutdown(cache);
-		cache_free(cache);
-	}
+	cache_table_free();
 
-	term_queue(ARP_to_Switch_Queue);
-	term_queue(Switch_to_ARP_Queue);
+	term_ring(ARP_to_Switch_Queue);
+	term_ring(Switch_to_ARP_Queue);
 }
@@ -38,6 +38,12 @@
 //#define ARP_IP_BROADCAST 0xFFFFFFFF
 #define ARP_IP_NULL 0
 
+#define ARP_CONFIG_FILE "fins.cfg" //"arp.cache_size" sets the number of cache entries
+#define ARP_CACHE_SIZE_DEFAULT 512
+#define ARP_CACHE_WAYS 16 //slots searched from an address' home slot, eviction picks the LRU one of them
+#define ARP_TICK 100 //ms per timer wheel slot
+#define ARP_WHEEL 256 //slots, a power of 2 and more than ARP_CACHE_TO_DEFAULT / ARP_TICK
+
 /**struct arp_hdr is used for use external to the ARP module. The zeroth element of both
  * the IP and MAC arrays (e.g. sender_MAC_addrs[0] or target_IP_addrs[0] etc.) is the
  * most significant byte while the last element is the least significant.*/
@@ -129,50 +135,70 @@ struct arp_to_thread_data {
 	uint8_t *running;
 	uint8_t *flag;
 	uint8_t *interrupt;
+	struct finsEvent *event;
 };
 
 void arp_stop_timer(int fd);
 void arp_start_timer(int fd, double millis);
 
-/**This struct is used to store information about neighboring nodes of the host interface*/
+#define ARP_CACHE_FREE 0 //never used, ends a search
+#define ARP_CACHE_DEAD 1 //removed, skipped by searches and reused by inserts
+#define ARP_CACHE_SEEKING 2
+#define ARP_CACHE_VALID 3
+
+/**This struct is used to store information about neighboring nodes of the host interface. Entries
+ * live in an open addressing table and never move, so the timer wheel links them by index. Only
+ * the ARP thread changes them, other threads read them through arp_cache_lookup()*/
 struct arp_cache {
-	struct arp_cache *next;
-	uint8_t running_flag;
+	uint32_t seq; //odd while the entry is being changed
+	uint8_t state;
+	uint8_t retries;
 
 	uint64_t mac_addr;
 	uint32_t ip_addr;
 
-	struct arp_request_list *request_list;
-	uint32_t request_num;
-	uint8_t seeking;
-	struct timeval updated_stamp;
+	uint32_t updated; //tick the address was confirmed, or seeking started
+	uint32_t used; //tick of the last lookup, for LRU eviction
+	uint32_t timer; //tick the entry times out, retransmits while seeking and expires when valid
+	int wheel_next;
+	int wheel_prev;
+
+	struct arp_request_list *request_list; //while seeking
+};
+
+/** the table, its size is fixed when the module starts */
+struct arp_cache_table {
+	struct arp_cache *slots;
+	uint32_t mask;
+	uint32_t max; //entries held at most
+	uint32_t num;
 
-	pthread_t to_thread;
-	int to_fd;
-	uint8_t to_flag;
-	int retries;
+	int wheel[ARP_WHEEL]; //first entry timing out in each tick, -1 if none
+	uint32_t tick; //last tick the wheel was turned to
+	uint32_t timers; //entries in the wheel
 };
 
-#define ARP_THREADS_MAX 50
 #define ARP_RETRANS_TO_DEFAULT 1000
 #define ARP_CACHE_TO_DEFAULT 15000
 #define ARP_RETRIES 2
 #define ARP_TO_MIN 0.00001
 
-struct arp_cache *cache_create(uint32_t ip_addr);
-void cache_shutdown(struct arp_cache *cache);
-void cache_free(struct arp_cache *cache);
+uint32_t arp_now(void);
+
+void cache_table_init(uint32_t max);
+void cache_table_free(void);
+struct arp_cache *cache_find(uint32_t ip_addr);
+struct arp_cache *cache_insert(uint32_t ip_addr, uint32_t now);
+void cache_remove(struct arp_cache *cache);
+void cache_seek(struct arp_cache *cache, uint32_t now);
+void cache_confirm(struct arp_cache *cache, uint64_t mac_addr, uint32_t now);
+void cache_set_timer(struct arp_cache *cache, uint32_t timer);
+void cache_wheel_turn(uint32_t now);
 
-#define ARP_CACHE_LIST_MAX 50
-int cache_list_insert(struct arp_cache *cache);
-struct arp_cache *cache_list_find(uint32_t ip_addr);
-void cache_list_remove(struct arp_cache *cache);
-struct arp_cache *cache_list_remove_first_non_seeking(void);
-int cache_list_is_empty(void);
-int cache_list_has_space(void);
+int arp_cache_lookup(uint32_t dst_ip, uint32_t src_ip, uint64_t *dst_mac, uint64_t *src_mac);
 
 void print_msgARP(struct arp_message *);
-void print_neighbors(struct arp_cache *ptr_to_cache);
+void print_neighbors(void);
 void print_IP_addrs(uint32_t ip_addrs);
 void print_MAC_addrs(uint64_t mac_addrs);
 void print_arp_hdr(struct arp_hdr *pckt);
@@ -201,7 +227,7 @@ void arp_in_fdf(struct finsFrame *ff);
 void arp_out_fdf(struct finsFrame *ff);
 
 void arp_interrupt(void);
-void arp_handle_to(struct arp_cache *cache);
+void arp_handle_to(struct arp_cache *cache, uint32_t now);
 
 #endif
 
@@ -38,7 +38,6 @@ double arp_time_diff(struct timeval *time1, struct timeval *time2) { //time2 - t
 void arp_exec_get_addr(struct finsFrame *ff, uint32_t dst_ip, uint32_t src_ip) {
 	struct arp_interface *interface;
 	struct arp_cache *cache;
-	struct arp_cache *temp_cache;
 	uint64_t dst_mac;
 	uint64_t src_mac;
 
@@ -67,9 +66,12 @@ void arp_exec_get_addr(struct finsFrame *ff, uint32_t dst_ip, uint32_t src_ip) {
 
 			arp_to_switch(ff);
 		} else {
-			cache = cache_list_find(dst_ip);
+			uint32_t now = arp_now();
+
+			cache = cache_find(dst_ip);
 			if (cache) {
-				if (cache->seeking) {
+				__atomic_store_n(&cache->used, now, __ATOMIC_RELAXED); //also touched by arp_cache_lookup()
+				if (cache->state == ARP_CACHE_SEEKING) {
 					PRINT_DEBUG("cache seeking: cache=%p", cache);
 					struct arp_request *request = request_create(ff, src_mac, src_ip);
 					if (request_list_has_space(cache->request_list)) {
@@ -89,10 +91,7 @@ void arp_exec_get_addr(struct finsFrame *ff, uint32_t dst_ip, uint32_t src_ip) {
 					dst_mac = cache->mac_addr;
 					PRINT_DEBUG("dst: cache=%p, ip=%u, mac=%llx", cache, dst_ip, dst_mac);
 
-					struct timeval current;
-					gettimeofday(&current, 0);
-
-					if (arp_time_diff(&cache->updated_stamp, &current) <= ARP_CACHE_TO_DEFAULT) {
+					if (now - cache->updated < ARP_CACHE_TO_DEFAULT / ARP_TICK) {
 						PRINT_DEBUG("up to date cache: cache=%p", cache);
 
 						metadata_writeToElement(params, "dst_mac", &dst_mac, META_TYPE_INT64);
@@ -111,26 +110,10 @@ void arp_exec_get_addr(struct finsFrame *ff, uint32_t dst_ip, uint32_t src_ip) {
 
 						struct finsFrame *ff_req = arp_to_fdf(&msg);
 						if (arp_to_switch(ff_req)) {
-							cache->seeking = 1;
-							cache->retries = 0;
-
-							gettimeofday(&cache->updated_stamp, 0); //TODO use this value as start of seeking
-							arp_start_timer(cache->to_fd, ARP_RETRANS_TO_DEFAULT);
+							cache_seek(cache, now);
 
 							struct arp_request *request = request_create(ff, src_mac, src_ip);
-							if (request_list_has_space(cache->request_list)) {
-								request_list_append(cache->request_list, request);
-							} else {
-								PRINT_ERROR("Error: request_list full");
-								request_free(request);
-
-								ff->destinationID.id = IP_ID; //ff->ctrlFrame.senderID
-								ff->ctrlFrame.senderID = ARP_ID;
-								ff->ctrlFrame.opcode = CTRL_EXEC_REPLY;
-								ff->ctrlFrame.ret_val = 0;
-
-								arp_to_switch(ff);
-							}
+							request_list_append(cache->request_list, request);
 						} else {
 							PRINT_ERROR("switch send failed");
 							freeFinsFrame(ff_req);
@@ -147,6 +130,19 @@ void arp_exec_get_addr(struct finsFrame *ff, uint32_t dst_ip, uint32_t src_ip) {
 			} else {
 				PRINT_DEBUG("dst: start seeking");
 
+				cache = cache_insert(dst_ip, now);
+				if (cache == NULL) {
+					PRINT_ERROR("Cache full");
+
+					ff->destinationID.id = IP_ID; //ff->ctrlFrame.senderID
+					ff->ctrlFrame.senderID = ARP_ID;
+					ff->ctrlFrame.opcode = CTRL_EXEC_REPLY;
+					ff->ctrlFrame.ret_val = 0;
+
+					arp_to_switch(ff);
+					return;
+				}
+
 				dst_mac = ARP_MAC_BROADCAST;
 
 				struct arp_message msg;
@@ -154,58 +150,14 @@ void arp_exec_get_addr(struct finsFrame *ff, uint32_t dst_ip, uint32_t src_ip) {
 
 				struct finsFrame *ff_req = arp_to_fdf(&msg);
 				if (arp_to_switch(ff_req)) {
-					cache = cache_create(dst_ip);
-					if (!cache_list_has_space()) {
-						PRINT_DEBUG("Making space in cache_list");
-
-						temp_cache = cache_list_remove_first_non_seeking();
-						if (temp_cache) {
-							struct arp_request *temp_request;
-							struct finsFrame *temp_ff;
-
-							while (!request_list_is_empty(temp_cache->request_list)) {
-								temp_request = request_list_remove_front(temp_cache->request_list);
-								temp_ff = temp_request->ff;
-
-								temp_ff->destinationID.id = IP_ID; //ff->ctrlFrame.senderID
-								temp_ff->ctrlFrame.senderID = ARP_ID;
-								temp_ff->ctrlFrame.opcode = CTRL_EXEC_REPLY;
-								temp_ff->ctrlFrame.ret_val = 0;
-
-								arp_to_switch(temp_ff);
-
-								request_free(temp_request);
-							}
-
-							cache_shutdown(temp_cache);
-							cache_free(temp_cache);
-						} else {
-							PRINT_ERROR("Cache full");
-
-							ff->destinationID.id = IP_ID; //ff->ctrlFrame.senderID
-							ff->ctrlFrame.senderID = ARP_ID;
-							ff->ctrlFrame.opcode = CTRL_EXEC_REPLY;
-							ff->ctrlFrame.ret_val = 0;
-
-							arp_to_switch(ff);
-
-							cache_shutdown(cache);
-							cache_free(cache);
-							return;
-						}
-					}
-					cache_list_insert(cache);
-					cache->seeking = 1;
-					cache->retries = 0;
-
-					gettimeofday(&cache->updated_stamp, 0);
-					arp_start_timer(cache->to_fd, ARP_RETRANS_TO_DEFAULT);
+					cache_seek(cache, now);
 
 					struct arp_request *request = request_create(ff, src_mac, src_ip);
 					request_list_append(cache->request_list, request);
 				} else {
 					PRINT_DEBUG("switch send failed");
 					freeFinsFrame(ff_req);
+					cache_remove(cache);
 
 					ff->destinationID.id = IP_ID; //ff->ctrlFrame.senderID
 					ff->ctrlFrame.senderID = ARP_ID;
@@ -262,16 +214,11 @@ void arp_in_fdf(struct finsFrame *ff) {
 				} else {
 					PRINT_DEBUG("Reply");
 
-					struct arp_cache *cache = cache_list_find(src_ip);
+					struct arp_cache *cache = cache_find(src_ip);
 					if (cache) {
-						if (cache->seeking) {
+						if (cache->state == ARP_CACHE_SEEKING) {
 							PRINT_DEBUG("Updating host: node=%p, mac=0x%llx, ip=%u", cache, src_mac, src_ip);
-							arp_stop_timer(cache->to_fd);
-							cache->to_flag = 0;
-							gettimeofday(&cache->updated_stamp, 0); //use this as time cache confirmed
-
-							cache->seeking = 0;
-							cache->mac_addr = src_mac;
+							cache_confirm(cache, src_mac, arp_now()); //time cache confirmed
 
 							struct arp_request *request;
 							struct finsFrame *ff_resp;
@@ -320,10 +267,10 @@ void arp_out_fdf(struct finsFrame *ff) {
 
 }
 
-void arp_handle_to(struct arp_cache *cache) {
-	PRINT_DEBUG("Entered: cache=%p", cache);
+void arp_handle_to(struct arp_cache *cache, uint32_t now) {
+	PRINT_DEBUG("Entered: cache=%p, now=%u", cache, now);
 
-	if (cache->seeking) {
+	if (cache->state == ARP_CACHE_SEEKING) {
 		if (cache->retries < ARP_RETRIES) {
 			uint64_t dst_mac = ARP_MAC_BROADCAST;
 			uint32_t dst_ip = cache->ip_addr;
@@ -342,18 +289,16 @@ void arp_handle_to(struct arp_cache *cache) {
 				gen_requestARP(&msg, src_mac, src_ip, dst_mac, dst_ip);
 
 				struct finsFrame *ff_req = arp_to_fdf(&msg);
-				if (arp_to_switch(ff_req)) {
-					cache->retries++;
-
-					//gettimeofday(&cache->updated_stamp, 0);
-					arp_start_timer(cache->to_fd, ARP_RETRANS_TO_DEFAULT);
-				} else {
+				if (!arp_to_switch(ff_req)) {
 					PRINT_ERROR("todo error");
 					freeFinsFrame(ff_req);
 
 					//TODO send error FCF
 				}
 			}
+			//a failed send counts as a try, so the entry can't wait forever
+			cache->retries++;
+			cache_set_timer(cache, now + ARP_RETRANS_TO_DEFAULT / ARP_TICK);
 		} else {
 			PRINT_DEBUG("Unreachable address, sending error FCF");
 
@@ -374,10 +319,11 @@ void arp_handle_to(struct arp_cache *cache) {
 				request_free(request);
 			}
 
-			cache_list_remove(cache);
-			cache_shutdown(cache);
-			cache_free(cache);
+			cache_remove(cache);
 		}
+	} else if (cache->state == ARP_CACHE_VALID) {
+		PRINT_DEBUG("Expired: cache=%p, ip=%u", cache, cache->ip_addr);
+		cache_remove(cache);
 	} else {
 		PRINT_DEBUG("Dropping TO: cache=%p", cache);
 	}
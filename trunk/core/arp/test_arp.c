@@ -18,11 +18,9 @@
 #include "test_arp.h" //this header file already contains #include "arp.h"
 #define DEBUG
 
-sem_t ARP_to_Switch_Qsem;
-finsQueue ARP_to_Switch_Queue;
+finsRing ARP_to_Switch_Queue;
 
-sem_t Switch_to_ARP_Qsem;
-finsQueue Switch_to_ARP_Queue;
+finsRing Switch_to_ARP_Queue;
 
 struct arp_cache *ptr_neighbor_list;
 int num_hosts; /*<the number of neighbors to be generated*/
@@ -269,18 +267,12 @@ void fins_from_stub(struct finsFrame *fins_frame) {
 void test_to_arp(struct finsFrame *fins_frame) {
 	PRINT_DEBUG("Entered: ff=%p meta=%p", fins_frame, fins_frame->metaData);
 
-	if (sem_wait(&Switch_to_ARP_Qsem)) {
-		PRINT_ERROR("Switch_to_ARP_Qsem wait prob");
-		exit(-1);
-	}
-	if (write_queue(fins_frame, Switch_to_ARP_Queue)) {
+	if (write_ring(fins_frame, Switch_to_ARP_Queue)) {
 		/*#*/PRINT_DEBUG("");
-		sem_post(&Switch_to_ARP_Qsem);
 		return;
 	}
 
 	PRINT_DEBUG("");
-	sem_post(&Switch_to_ARP_Qsem);
 }
 
 void *ARP() {
@@ -341,10 +333,8 @@ int main(int argc, char *argv[]) {
 	host_MAC_addrs = MACADDRESS;
 	host_IP_addrs = IPADDRESS;
 
-	ARP_to_Switch_Queue = init_queue("arp2switch", MAX_Queue_size);
-	Switch_to_ARP_Queue = init_queue("switch2arp", MAX_Queue_size);
-	sem_init(&ARP_to_Switch_Qsem, 0, 1);
-	sem_init(&Switch_to_ARP_Qsem, 0, 1);
+	ARP_to_Switch_Queue = init_ring("arp2switch", MAX_Queue_size);
+	Switch_to_ARP_Queue = init_ring("switch2arp", MAX_Queue_size);
 
 	gen_neighbor_list(argv[1]);
 
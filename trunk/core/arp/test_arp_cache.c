@@ -0,0 +1,311 @@
+/**@file test_arp_cache.c
+ *@brief checks the ARP cache table: inserts and finds, least recently used replacement, retransmits
+ * and expiry off the timer wheel, then races arp_cache_lookup() readers against a writer churning the
+ * table and checks no reader ever sees an address paired with another entry's MAC. Results go to
+ * stderr, so run as ./test_arp_cache > /dev/null to drop the debug output.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <queueModule.h>
+#include "arp.h"
+
+#define TEST_SRC_IP 0x0a000001
+#define TEST_SRC_MAC 0x080027445566ull
+#define TEST_POOL 4096 //addresses the writer churns through
+#define TEST_READERS 2
+#define TEST_RACE_NS 1000000000ull
+
+struct finsEvent Switch_Event;
+
+extern finsRing ARP_to_Switch_Queue;
+extern struct arp_cache_table cache_table;
+
+volatile int test_racing;
+
+uint64_t test_now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+uint32_t test_ip(uint32_t i) {
+	return 0x0a010000 + i * 7;
+}
+
+uint64_t test_mac(uint32_t ip) {
+	return ((uint64_t) ip * 0x9e3779b97f4a7c15ull) & 0xFFFFFFFFFFFFull;
+}
+
+/** frames the module sent to the switch, counted by ret_val for replies to IPv4 */
+int test_drain(int *failed) {
+	struct finsFrame *ff;
+	int n = 0;
+
+	while ((ff = read_ring(ARP_to_Switch_Queue)) != NULL) {
+		if (ff->dataOrCtrl == CONTROL && ff->ctrlFrame.ret_val == 0) {
+			(*failed)++;
+		}
+		freeFinsFrame(ff);
+		n++;
+	}
+	return n;
+}
+
+int test_table(void) {
+	uint64_t dst_mac, src_mac;
+	struct arp_cache *cache;
+	uint32_t now;
+	uint32_t i;
+	int missing = 0;
+	int gone = 0;
+	int bad = 0;
+
+	cache_table_init(ARP_CACHE_SIZE_DEFAULT);
+	now = cache_table.tick;
+	for (i = 0; i < ARP_CACHE_SIZE_DEFAULT; i++) {
+		cache = cache_insert(test_ip(i), now);
+		if (cache == NULL || cache_find(test_ip(i)) != cache || cache->state != ARP_CACHE_SEEKING) {
+			bad++;
+			continue;
+		}
+		if (arp_cache_lookup(test_ip(i), TEST_SRC_IP, &dst_mac, &src_mac)) {
+			bad++; //nothing to send to while seeking
+		}
+		cache_confirm(cache, test_mac(test_ip(i)), arp_now());
+	}
+	if (cache_table.num > cache_table.max) {
+		bad++;
+	}
+
+	//a full window drops its least recently used entry, so a few of the early ones may be gone
+	for (i = 0; i < ARP_CACHE_SIZE_DEFAULT; i++) {
+		if (!arp_cache_lookup(test_ip(i), TEST_SRC_IP, &dst_mac, &src_mac)) {
+			missing++;
+		} else if (dst_mac != test_mac(test_ip(i)) || src_mac != TEST_SRC_MAC) {
+			bad++;
+		}
+	}
+	if (missing > ARP_CACHE_SIZE_DEFAULT / 50) {
+		bad++;
+	}
+	if (arp_cache_lookup(test_ip(ARP_CACHE_SIZE_DEFAULT), TEST_SRC_IP, &dst_mac, &src_mac)
+			|| arp_cache_lookup(test_ip(0), TEST_SRC_IP + 1, &dst_mac, &src_mac)) {
+		bad++; //unknown neighbor or interface
+	}
+
+	for (i = 0; i < ARP_CACHE_SIZE_DEFAULT; i += 2) {
+		if ((cache = cache_find(test_ip(i))) != NULL) {
+			cache_remove(cache);
+		}
+	}
+	for (i = 0; i < ARP_CACHE_SIZE_DEFAULT; i++) {
+		cache = cache_find(test_ip(i));
+		if ((i & 1) == 0 && cache != NULL) {
+			bad++;
+		} else if ((i & 1) && cache == NULL) {
+			gone++;
+		}
+	}
+	if (gone > missing) {
+		bad++;
+	}
+	fprintf(stderr, "table: %u entries in %u slots, %d replaced while filling\n", cache_table.num, cache_table.mask + 1, missing);
+
+	cache_table_free();
+	return bad;
+}
+
+int test_lru(void) {
+	struct arp_cache *cache;
+	uint32_t now;
+	uint32_t i;
+	int bad = 0;
+
+	//8 entries fill ARP_CACHE_WAYS slots, so every address can go anywhere and the choice is global
+	cache_table_init(ARP_CACHE_WAYS / 2);
+	now = cache_table.tick;
+	for (i = 0; i < ARP_CACHE_WAYS / 2; i++) {
+		cache = cache_insert(test_ip(i), now);
+		cache_confirm(cache, test_mac(test_ip(i)), now);
+		cache->used = now + 100 - i; //the last one in is the least recently used
+	}
+	cache_find(test_ip(ARP_CACHE_WAYS / 2 - 1))->used = now + 200;
+
+	cache = cache_insert(test_ip(100), now + 300);
+	if (cache == NULL || cache_find(test_ip(ARP_CACHE_WAYS / 2 - 2)) != NULL || cache_find(test_ip(ARP_CACHE_WAYS / 2 - 1)) == NULL
+			|| cache_table.num != ARP_CACHE_WAYS / 2) {
+		bad++;
+	}
+
+	//entries being sought are never replaced
+	for (i = 200; cache_insert(test_ip(i), now + 300) != NULL; i++)
+		;
+	if (i != 200 + ARP_CACHE_WAYS / 2 - 1) {
+		bad++;
+	}
+
+	cache_table_free();
+	return bad;
+}
+
+int test_wheel(void) {
+	struct arp_cache *cache;
+	struct finsFrame *ff;
+	uint32_t now;
+	int failed = 0;
+	int bad = 0;
+	int i;
+
+	cache_table_init(ARP_CACHE_SIZE_DEFAULT);
+	now = cache_table.tick;
+
+	//seeking: ARP_RETRIES retransmits ARP_RETRANS_TO_DEFAULT apart, then the waiting frames fail
+	cache = cache_insert(test_ip(1), now);
+	cache_seek(cache, now);
+	for (i = 0; i < 3; i++) {
+		ff = allocFinsFrame();
+		ff->dataOrCtrl = CONTROL;
+		request_list_append(cache->request_list, request_create(ff, TEST_SRC_MAC, TEST_SRC_IP));
+	}
+	for (i = 1; i <= ARP_RETRIES; i++) {
+		now += ARP_RETRANS_TO_DEFAULT / ARP_TICK - 1;
+		cache_wheel_turn(now);
+		if (test_drain(&failed) != 0) {
+			bad++;
+		}
+		cache_wheel_turn(++now);
+		if (test_drain(&failed) != 1 || cache->retries != i) {
+			bad++;
+		}
+	}
+	now += ARP_RETRANS_TO_DEFAULT / ARP_TICK;
+	cache_wheel_turn(now);
+	if (test_drain(&failed) != 3 || failed != 3 || cache_find(test_ip(1)) != NULL || cache_table.timers != 0) {
+		bad++;
+	}
+
+	//valid: expires ARP_CACHE_TO_DEFAULT after being confirmed, even when the wheel skips ahead
+	for (i = 0; i < 100; i++) {
+		cache = cache_insert(test_ip(i), now);
+		cache_confirm(cache, test_mac(test_ip(i)), now + i);
+	}
+	cache_wheel_turn(now + ARP_CACHE_TO_DEFAULT / ARP_TICK + 49);
+	if (cache_table.num != 50 || cache_find(test_ip(49)) != NULL || cache_find(test_ip(50)) == NULL) {
+		bad++;
+	}
+	cache_wheel_turn(now + 10 * ARP_WHEEL);
+	if (cache_table.num != 0 || cache_table.timers != 0 || test_drain(&failed) != 0) {
+		bad++;
+	}
+
+	cache_table_free();
+	return bad;
+}
+
+void *test_reader(void *local) {
+	uint64_t *result = (uint64_t *) local;
+	uint64_t dst_mac, src_mac;
+	uint32_t ip;
+	uint32_t i = 0;
+
+	while (test_racing) {
+		ip = test_ip(i++ % TEST_POOL);
+		if (arp_cache_lookup(ip, TEST_SRC_IP, &dst_mac, &src_mac)) {
+			result[0]++;
+			if (dst_mac != test_mac(ip)) {
+				result[1]++;
+			}
+		}
+		result[2]++;
+	}
+	return NULL;
+}
+
+int test_race(void) {
+	pthread_t readers[TEST_READERS];
+	uint64_t results[TEST_READERS][3];
+	struct arp_cache *cache;
+	uint64_t start;
+	uint64_t writes = 0;
+	uint32_t ip;
+	int bad = 0;
+	int i;
+
+	cache_table_init(TEST_POOL / 4);
+	memset(results, 0, sizeof(results));
+	test_racing = 1;
+	for (i = 0; i < TEST_READERS; i++) {
+		pthread_create(&readers[i], NULL, test_reader, results[i]);
+	}
+
+	start = test_now_ns();
+	while (test_now_ns() - start < TEST_RACE_NS) {
+		ip = test_ip(rand() % TEST_POOL);
+		if ((cache = cache_find(ip)) != NULL) {
+			cache_remove(cache);
+		} else if ((cache = cache_insert(ip, arp_now())) != NULL) {
+			cache_confirm(cache, test_mac(ip), arp_now());
+		}
+		writes++;
+	}
+
+	test_racing = 0;
+	for (i = 0; i < TEST_READERS; i++) {
+		pthread_join(readers[i], NULL);
+		fprintf(stderr, "race: reader %d, %llu lookups, %llu hits, %llu torn\n", i, (unsigned long long) results[i][2],
+				(unsigned long long) results[i][0], (unsigned long long) results[i][1]);
+		if (results[i][1] != 0 || results[i][0] == 0) {
+			bad++;
+		}
+	}
+	fprintf(stderr, "race: %llu writes\n", (unsigned long long) writes);
+
+	cache_table_free();
+	return bad;
+}
+
+double test_time_lookup(void) {
+	uint64_t dst_mac, src_mac;
+	uint64_t start;
+	uint32_t i;
+	int hits = 0;
+
+	cache_table_init(ARP_CACHE_SIZE_DEFAULT);
+	for (i = 0; i < ARP_CACHE_SIZE_DEFAULT; i++) {
+		cache_confirm(cache_insert(test_ip(i), arp_now()), test_mac(test_ip(i)), arp_now());
+	}
+	start = test_now_ns();
+	for (i = 0; i < 10000000; i++) {
+		hits += arp_cache_lookup(test_ip(i % ARP_CACHE_SIZE_DEFAULT), TEST_SRC_IP, &dst_mac, &src_mac);
+	}
+	cache_table_free();
+	return hits ? (double) (test_now_ns() - start) / i : 0;
+}
+
+int main(int argc, char *argv[]) {
+	int bad = 0;
+	int i;
+
+	ARP_to_Switch_Queue = init_ring("arp_to_switch", 64);
+	init_event(&Switch_Event);
+	arp_register_interface(TEST_SRC_MAC, TEST_SRC_IP);
+	srand(1);
+
+	bad += i = test_table();
+	fprintf(stderr, "table: %s\n", i ? "FAILED" : "ok");
+	bad += i = test_lru();
+	fprintf(stderr, "lru: %s\n", i ? "FAILED" : "ok");
+	bad += i = test_wheel();
+	fprintf(stderr, "wheel: %s\n", i ? "FAILED" : "ok");
+	bad += i = test_race();
+	fprintf(stderr, "race: %s\n", i ? "FAILED" : "ok");
+
+	fprintf(stderr, "\nns per arp_cache_lookup() hit: %.1f\n", test_time_lookup());
+
+	term_ring(ARP_to_Switch_Queue);
+	return bad != 0;
+}
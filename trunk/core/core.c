@@ -24,6 +24,7 @@
 #include <icmp.h>
 #include <rtm.h>
 #include <signal.h>
+#include <libconfig.h>
 
 /**
  * TODO free and close/DESTORY all the semaphores before exit !!!
@@ -110,6 +111,8 @@ void uint32_decrease_test(uint32_t *data, uint32_t value) {
 }
 
 int main() {
+	fins_log_init(); //levels from FINS_LOG, e.g. FINS_LOG=error,tcp=debug
+
 	//###################################################################### //TODO get this from config file eventually
 	//host interface
 	my_host_mac_addr = 0x080027445566ull;
@@ -211,8 +214,9 @@ int main() {
 	 //#############################
 	 */
 
-	while (1)
-		;
+	while (1) {
+		pause(); //termination_handler exits
+	}
 
 	return (1);
 }
@@ -11,18 +11,33 @@
 
 #include "daemon.h"
 
+#include <libconfig.h>
+
 int daemon_running;
 pthread_t wedge_to_daemon_thread;
 pthread_t switch_to_daemon_thread;
 
-sem_t Daemon_to_Switch_Qsem;
-finsQueue Daemon_to_Switch_Queue;
+sem_t Daemon_to_Switch_Qsem; //serializes the wedge & switch threads writing to the ring, the switch never takes it
+finsRing Daemon_to_Switch_Queue;
+
+finsRing Switch_to_Daemon_Queue;
+struct finsEvent Switch_to_Daemon_Event;
 
-sem_t Switch_to_Daemon_Qsem;
-finsQueue Switch_to_Daemon_Queue;
+extern struct finsEvent Switch_Event;
 
 sem_t daemon_sockets_sem;
-struct daemon_socket daemon_sockets[MAX_SOCKETS];
+struct daemon_socket *daemon_sockets;
+int daemon_sockets_max;
+
+struct daemon_sockets_table {
+	int *host_hash; //first socket with the (host_ip, host_port) hash, chained through host_next
+	int *conn_hash; //first socket with the (host_ip, host_port, dst_ip, dst_port) hash, chained through conn_next
+	uint16_t *port_refs; //sockets holding each local port, NULL for raw sockets
+	uint64_t *port_map; //bit set for each port with refs, the ephemeral port search runs over this
+	uint32_t port_next;
+};
+struct daemon_sockets_table daemon_tables[DAEMON_TABLES];
+uint32_t daemon_hash_mask;
 
 sem_t daemon_calls_sem; //TODO remove?
 struct daemon_call daemon_calls[MAX_CALLS];
@@ -33,18 +48,31 @@ sem_t daemon_thread_sem;
 
 uint8_t daemon_interrupt_flag;
 
+int nl_sockfd;
+struct nl_link *daemon_link;
+
+int daemon_rings_fd = -1;
+uint8_t *daemon_rings; //the wedge's ring slots mapped in, NULL when it has none
+struct fins_ring daemon_rings_rx[FINS_RING_SLOTS]; //recvmsg data, the daemon writes these
+sem_t daemon_rings_sem;
+
 int init_fins_nl(void) {
+	struct sockaddr_nl local_sockaddress; // sockaddr_nl for this process (source)
+	struct sockaddr_nl kernel_sockaddress; // sockaddr_nl for the kernel (destination)
 	int sockfd;
+	int size;
 	int ret;
 
-	sem_init(&nl_sem, 0, 1);
-
 	// Get a netlink socket descriptor
 	sockfd = socket(AF_NETLINK, SOCK_RAW, NETLINK_FINS);
 	if (sockfd == -1) {
 		return -1;
 	}
 
+	//room for a few batches of calls queued up while the last one is handled
+	size = DAEMON_NL_RCVBUF;
+	setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
 	// Populate local_sockaddress
 	memset(&local_sockaddress, 0, sizeof(local_sockaddress));
 	local_sockaddress.nl_family = AF_NETLINK;
@@ -55,6 +83,7 @@ int init_fins_nl(void) {
 	// Bind the local netlink socket
 	ret = bind(sockfd, (struct sockaddr*) &local_sockaddress, sizeof(local_sockaddress));
 	if (ret == -1) {
+		close(sockfd);
 		return -1;
 	}
 
@@ -65,62 +94,104 @@ int init_fins_nl(void) {
 	kernel_sockaddress.nl_pid = 0; // to kernel
 	kernel_sockaddress.nl_groups = 0; // unicast
 
+	daemon_link = nl_link_create(sockfd, &kernel_sockaddress);
 	return sockfd;
 }
 
 /*
- * Sends len bytes from buf on the sockfd.  Returns 0 if successful.  Returns -1 if an error occurred, errno set appropriately.
+ * Sends len bytes from buf to the wedge.  Returns 0 if successful.  Returns -1 if an error occurred, errno set appropriately.
+ * While the link is corked the message is packed with the others and goes out when it is uncorked.
  */
-int send_wedge(int sockfd, uint8_t *buf, size_t len, int flags) {
-	PRINT_DEBUG("Entered: sockfd=%d, buf=%p, len=%d, flags=0x%x", sockfd, buf, len, flags);
+int send_wedge(uint8_t *buf, size_t len, int flags) {
+	PRINT_DEBUG("Entered: buf=%p, len=%d, flags=0x%x", buf, len, flags);
 
-	int ret; // Holds system call return values for error checking
+	return nl_link_send(daemon_link, buf, len, flags);
+}
 
-	// Begin send message section
-	// Build a message to send to the kernel
-	int nlmsg_len = NLMSG_LENGTH(len);
-	struct nlmsghdr *nlh = (struct nlmsghdr *) malloc(nlmsg_len);
-	if (nlh == NULL) {
-		PRINT_ERROR("nlh malloc error, len=%d, nlmsg_len=%d", len, nlmsg_len);
-		return -1;
+/*
+ * Maps the wedge's payload rings, if it has them. Without them every payload goes in the netlink messages.
+ */
+void daemon_rings_init(void) {
+	int i;
+
+	sem_init(&daemon_rings_sem, 0, 1);
+	daemon_rings = NULL;
+
+	daemon_rings_fd = open(FINS_RING_DEV, O_RDWR);
+	if (daemon_rings_fd == -1) {
+		PRINT_DEBUG("no payload rings: %s, errno=%d", FINS_RING_DEV, errno);
+		return;
 	}
-	memset(nlh, 0, nlmsg_len);
-
-	nlh->nlmsg_len = nlmsg_len;
-	// following can be used by application to track message, opaque to netlink core
-	nlh->nlmsg_type = 0; // arbitrary value
-	nlh->nlmsg_seq = 0; // sequence number
-	nlh->nlmsg_pid = getpid(); // pthread_self() << 16 | getpid();	// use the second one for multiple threads
-	nlh->nlmsg_flags = flags;
-
-	// Insert payload (memcpy)
-	memcpy(NLMSG_DATA(nlh), buf, len);
-
-	// finish message packing
-	struct iovec iov;
-	memset(&iov, 0, sizeof(struct iovec));
-	iov.iov_base = (void *) nlh;
-	iov.iov_len = nlh->nlmsg_len;
-
-	struct msghdr msg;
-	memset(&msg, 0, sizeof(struct msghdr));
-	msg.msg_name = (void *) &kernel_sockaddress;
-	msg.msg_namelen = sizeof(kernel_sockaddress);
-	msg.msg_iov = &iov;
-	msg.msg_iovlen = 1;
-
-	// Send the message
-	PRINT_DEBUG("Sending message to kernel");
-	sem_wait(&nl_sem);
-	ret = sendmsg(sockfd, &msg, 0);
-	sem_post(&nl_sem);
-	free(nlh);
 
-	if (ret == -1) {
+	daemon_rings = (uint8_t *) mmap(NULL, FINS_RING_SLOTS * sizeof(struct fins_ring_slot), PROT_READ | PROT_WRITE, MAP_SHARED, daemon_rings_fd, 0);
+	if (daemon_rings == MAP_FAILED) {
+		PRINT_ERROR("mmap of %s failed, errno=%d", FINS_RING_DEV, errno);
+		close(daemon_rings_fd);
+		daemon_rings_fd = -1;
+		daemon_rings = NULL;
+		return;
+	}
+
+	for (i = 0; i < FINS_RING_SLOTS; i++) {
+		ring_init(&daemon_rings_rx[i], ((struct fins_ring_slot *) daemon_rings)[i].rx);
+	}
+}
+
+void daemon_rings_free(void) {
+	if (daemon_rings != NULL) {
+		munmap(daemon_rings, FINS_RING_SLOTS * sizeof(struct fins_ring_slot));
+		daemon_rings = NULL;
+	}
+	if (daemon_rings_fd != -1) {
+		close(daemon_rings_fd);
+		daemon_rings_fd = -1;
+	}
+	sem_destroy(&daemon_rings_sem);
+}
+
+/*
+ * Puts the data of a recvmsg reply in the socket's ring. Returns where it went, or -1 if it goes in the message.
+ */
+int daemon_ring_put(int sock_index, uint8_t *data, uint32_t data_len) {
+	struct fins_ring *ring;
+	int slot = daemon_sockets[sock_index].ring;
+	int where;
+
+	if (daemon_rings == NULL || slot < 0 || slot >= FINS_RING_SLOTS || data_len < FINS_RING_MIN) {
 		return -1;
-	} else {
-		return 0;
 	}
+
+	sem_wait(&daemon_rings_sem);
+	ring = &daemon_rings_rx[slot];
+	if (ring->owner != daemon_sockets[sock_index].sock_id) {
+		//the wedge handed the slot on, whatever the last socket left in it is gone
+		ring_init(ring, ring->data);
+		ring->owner = daemon_sockets[sock_index].sock_id;
+	}
+	where = ring_put(ring, data, data_len);
+	sem_post(&daemon_rings_sem);
+
+	PRINT_DEBUG("sock_index=%d, slot=%d, data_len=%u, where=%d", sock_index, slot, data_len, where);
+	return where;
+}
+
+/*
+ * Gives back a chunk a reply that never reached the wedge was pointing at.
+ */
+void daemon_ring_drop(int sock_index, int where) {
+	if (where != -1) {
+		ring_done(daemon_rings_rx[daemon_sockets[sock_index].ring].data, where);
+	}
+}
+
+/*
+ * The sendmsg data the wedge put in ring slot at where. Hand it back with ring_done() once copied.
+ */
+uint8_t *daemon_ring_take(int ring, int where, uint32_t data_len) {
+	if (daemon_rings == NULL || ring < 0 || ring >= FINS_RING_SLOTS) {
+		return NULL;
+	}
+	return ring_get(((struct fins_ring_slot *) daemon_rings)[ring].tx, where, data_len);
 }
 
 void *daemon_to_thread(void *local) {
@@ -130,6 +201,7 @@ void *daemon_to_thread(void *local) {
 	uint8_t *running = to_data->running;
 	uint8_t *flag = to_data->flag;
 	uint8_t *interrupt = to_data->interrupt;
+	struct finsEvent *event = to_data->event;
 	free(to_data);
 
 	int ret;
@@ -151,6 +223,7 @@ void *daemon_to_thread(void *local) {
 		PRINT_DEBUG("Throwing TO flag: id=%d, fd=%d", id, fd);
 		*interrupt = 1;
 		*flag = 1;
+		post_event(event);
 	}
 
 	PRINT_DEBUG("Exited: id=%d, fd=%d", id, fd);
@@ -534,6 +607,173 @@ void call_list_free(struct daemon_call_list *call_list) {
 	free(call_list);
 }
 
+/** the lookup tables, one per transport, hashed on the local address and on the whole connection */
+static uint32_t daemon_hash_host(uint32_t host_ip, uint16_t host_port) {
+	uint32_t h = host_ip * 0x9e3779b1 + (uint32_t) host_port * 0x85ebca6b;
+
+	return (h ^ (h >> 16)) & daemon_hash_mask;
+}
+
+static uint32_t daemon_hash_conn(uint32_t host_ip, uint16_t host_port, uint32_t rem_ip, uint16_t rem_port) {
+	uint32_t h = host_ip * 0x9e3779b1 + (uint32_t) host_port * 0x85ebca6b + rem_ip * 0xc2b2ae35 + (uint32_t) rem_port * 0x27d4eb2f;
+
+	return (h ^ (h >> 16)) & daemon_hash_mask;
+}
+
+static int daemon_table_type(int type) {
+	switch (type) {
+	case SOCK_RAW:
+		return DAEMON_TABLE_ICMP;
+	case SOCK_DGRAM:
+		return DAEMON_TABLE_UDP;
+	case SOCK_STREAM:
+		return DAEMON_TABLE_TCP;
+	default:
+		return -1;
+	}
+}
+
+static int daemon_table_protocol(int protocol) {
+	switch (protocol) {
+	case IPPROTO_ICMP:
+		return DAEMON_TABLE_ICMP;
+	case IPPROTO_UDP:
+		return DAEMON_TABLE_UDP;
+	case IPPROTO_TCP:
+		return DAEMON_TABLE_TCP;
+	default:
+		return -1;
+	}
+}
+
+/** raw sockets don't own ports, ICMP is matched on the address alone */
+static uint16_t daemon_key_port(int table, uint16_t host_port) {
+	return table == DAEMON_TABLE_ICMP ? 0 : host_port;
+}
+
+static void daemon_sockets_link(int sock_index) {
+	struct daemon_socket *sock = &daemon_sockets[sock_index];
+	struct daemon_sockets_table *table = &daemon_tables[sock->table];
+	int *head;
+
+	head = &table->host_hash[daemon_hash_host(sock->host_ip, daemon_key_port(sock->table, sock->host_port))];
+	sock->host_prev = -1;
+	sock->host_next = *head;
+	if (*head != -1) {
+		daemon_sockets[*head].host_prev = sock_index;
+	}
+	*head = sock_index;
+
+	head = &table->conn_hash[daemon_hash_conn(sock->host_ip, sock->host_port, sock->dst_ip, sock->dst_port)];
+	sock->conn_prev = -1;
+	sock->conn_next = *head;
+	if (*head != -1) {
+		daemon_sockets[*head].conn_prev = sock_index;
+	}
+	*head = sock_index;
+
+	if (table->port_refs != NULL && sock->host_port != 0 && table->port_refs[sock->host_port]++ == 0) {
+		table->port_map[sock->host_port >> 6] |= 1ull << (sock->host_port & 63);
+	}
+}
+
+static void daemon_sockets_unlink(int sock_index) {
+	struct daemon_socket *sock = &daemon_sockets[sock_index];
+	struct daemon_sockets_table *table = &daemon_tables[sock->table];
+
+	if (sock->host_prev != -1) {
+		daemon_sockets[sock->host_prev].host_next = sock->host_next;
+	} else {
+		table->host_hash[daemon_hash_host(sock->host_ip, daemon_key_port(sock->table, sock->host_port))] = sock->host_next;
+	}
+	if (sock->host_next != -1) {
+		daemon_sockets[sock->host_next].host_prev = sock->host_prev;
+	}
+
+	if (sock->conn_prev != -1) {
+		daemon_sockets[sock->conn_prev].conn_next = sock->conn_next;
+	} else {
+		table->conn_hash[daemon_hash_conn(sock->host_ip, sock->host_port, sock->dst_ip, sock->dst_port)] = sock->conn_next;
+	}
+	if (sock->conn_next != -1) {
+		daemon_sockets[sock->conn_next].conn_prev = sock->conn_prev;
+	}
+
+	if (table->port_refs != NULL && sock->host_port != 0 && --table->port_refs[sock->host_port] == 0) {
+		table->port_map[sock->host_port >> 6] &= ~(1ull << (sock->host_port & 63));
+	}
+}
+
+static int daemon_sockets_host_find(int table, uint32_t host_ip, uint16_t key_port) {
+	int i = daemon_tables[table].host_hash[daemon_hash_host(host_ip, key_port)];
+
+	while (i != -1 && (daemon_sockets[i].host_ip != host_ip || daemon_key_port(table, daemon_sockets[i].host_port) != key_port)) {
+		i = daemon_sockets[i].host_next;
+	}
+	return i;
+}
+
+void daemon_sockets_init(int max) {
+	uint32_t buckets = 16;
+	int i;
+
+	daemon_sockets_max = max;
+	daemon_sockets = (struct daemon_socket *) malloc(max * sizeof(struct daemon_socket));
+	if (daemon_sockets == NULL) {
+		PRINT_ERROR("daemon_sockets alloc fail");
+		exit(-1);
+	}
+	for (i = 0; i < max; i++) {
+		daemon_sockets[i].sock_id = -1;
+		daemon_sockets[i].state = SS_FREE;
+		daemon_sockets[i].table = -1;
+	}
+
+	while (buckets < (uint32_t) max) {
+		buckets <<= 1;
+	}
+	daemon_hash_mask = buckets - 1;
+	srand((unsigned) time(NULL)); //ephemeral ports start somewhere new each run
+
+	for (i = 0; i < DAEMON_TABLES; i++) {
+		daemon_tables[i].host_hash = (int *) malloc(buckets * sizeof(int));
+		daemon_tables[i].conn_hash = (int *) malloc(buckets * sizeof(int));
+		if (daemon_tables[i].host_hash == NULL || daemon_tables[i].conn_hash == NULL) {
+			PRINT_ERROR("daemon_tables alloc fail");
+			exit(-1);
+		}
+		memset(daemon_tables[i].host_hash, -1, buckets * sizeof(int));
+		memset(daemon_tables[i].conn_hash, -1, buckets * sizeof(int));
+
+		if (i == DAEMON_TABLE_ICMP) {
+			daemon_tables[i].port_refs = NULL;
+			daemon_tables[i].port_map = NULL;
+		} else {
+			daemon_tables[i].port_refs = (uint16_t *) calloc(DAEMON_PORTS, sizeof(uint16_t));
+			daemon_tables[i].port_map = (uint64_t *) calloc(DAEMON_PORTS / 64, sizeof(uint64_t));
+			if (daemon_tables[i].port_refs == NULL || daemon_tables[i].port_map == NULL) {
+				PRINT_ERROR("daemon_tables alloc fail");
+				exit(-1);
+			}
+		}
+		daemon_tables[i].port_next = MIN_port + (uint32_t) rand() % (MAX_port - MIN_port + 1);
+	}
+}
+
+void daemon_sockets_free(void) {
+	int i;
+
+	for (i = 0; i < DAEMON_TABLES; i++) {
+		free(daemon_tables[i].host_hash);
+		free(daemon_tables[i].conn_hash);
+		free(daemon_tables[i].port_refs);
+		free(daemon_tables[i].port_map);
+	}
+	free(daemon_sockets);
+	daemon_sockets = NULL;
+	daemon_sockets_max = 0;
+}
+
 /**
  * @brief insert new daemon socket in the first empty location
  * in the daemon sockets array
@@ -542,6 +782,10 @@ void call_list_free(struct daemon_call_list *call_list) {
  */
 int daemon_sockets_insert(uint64_t sock_id, int sock_index, int type, int protocol) {
 	PRINT_DEBUG("Entered: sock_id=%llu, sock_index=%d, type=%d, protocol=%d", sock_id, sock_index, type, protocol);
+	if (sock_index < 0 || sock_index >= daemon_sockets_max) {
+		PRINT_ERROR("index out of range: index=%d, max=%d", sock_index, daemon_sockets_max);
+		return 0;
+	}
 	if (daemon_sockets[sock_index].sock_id == -1) {
 		daemon_sockets[sock_index].sock_id = sock_id;
 		daemon_sockets[sock_index].state = SS_UNCONNECTED;
@@ -585,10 +829,21 @@ int daemon_sockets_insert(uint64_t sock_id, int sock_index, int type, int protoc
 		daemon_sockets[sock_index].sockopts.FIP_TTL = 64;
 		daemon_sockets[sock_index].sockopts.FIP_TOS = 64;
 		daemon_sockets[sock_index].sockopts.FSO_REUSEADDR = 0;
+		daemon_sockets[sock_index].sockopts.FTCP_CONGESTION[0] = '\0';
 
 		//daemon_sockets[sock_index].sockopts.FSO_RCVTIMEO = IPTOS_LOWDELAY;
 		//daemon_sockets[sock_index].sockopts.FSO_SNDTIMEO = IPTOS_LOWDELAY;
 
+		daemon_sockets[sock_index].ring = -1;
+
+		daemon_sockets[sock_index].ready = 0;
+		daemon_sockets[sock_index].ready_tcp = 0;
+
+		daemon_sockets[sock_index].table = daemon_table_type(type);
+		if (daemon_sockets[sock_index].table != -1) {
+			daemon_sockets_link(sock_index);
+		}
+
 		return 1;
 	} else {
 		PRINT_DEBUG("index in use: index=%d", sock_index);
@@ -605,7 +860,7 @@ int daemon_sockets_find(uint64_t sock_id) {
 	PRINT_DEBUG("Entered: sock_id=%llu", sock_id);
 
 	int i = 0;
-	for (i = 0; i < MAX_SOCKETS; i++) {
+	for (i = 0; i < daemon_sockets_max; i++) {
 		if (daemon_sockets[i].sock_id == sock_id) {
 			PRINT_DEBUG("Exited: sock_id=%llu, sock_index=%d", sock_id, i);
 			return i;
@@ -616,66 +871,44 @@ int daemon_sockets_find(uint64_t sock_id) {
 	return (-1);
 }
 
+/**
+ * @brief find the socket an incoming datagram is for, one bound to dst_ip before one bound to any address.
+ * ICMP is matched on the address alone
+ * @return the location index on success , -1 on failure
+ */
 int daemon_sockets_match(uint16_t dst_port, uint32_t dst_ip, int protocol) {
 	PRINT_DEBUG("Entered: %u/%u: %d, ", dst_ip, dst_port, protocol);
 
-	int i;
-	for (i = 0; i < MAX_SOCKETS; i++) {
-		if (daemon_sockets[i].sock_id != -1) {
-			if (protocol == IPPROTO_ICMP) {
-				if ((daemon_sockets[i].protocol == protocol) && (daemon_sockets[i].host_ip == dst_ip)) {
-					PRINT_DEBUG("ICMP");
-					return (i);
-				}
-			} else {
-				if (daemon_sockets[i].host_ip == INADDR_ANY) {
-					if (daemon_sockets[i].host_port == dst_port) {
-						PRINT_DEBUG("hostport == dstport");
-						return (i);
-					}
-				} else if ((daemon_sockets[i].host_port == dst_port) && (daemon_sockets[i].host_ip == dst_ip)/** && (daemonSockets[i].protocol == protocol)*/) {
-					PRINT_DEBUG("host_IP == dstip");
-					return (i);
-				} else {
-					PRINT_DEBUG("default");
-				}
-			}
-
-			if (0) {
-				if (daemon_sockets[i].host_ip == INADDR_ANY && (protocol != IPPROTO_ICMP)) {
-					if ((daemon_sockets[i].host_port == dst_port))
-						return (i);
-				} else if ((daemon_sockets[i].host_port == dst_port) && (daemon_sockets[i].host_ip == dst_ip) && ((protocol != IPPROTO_ICMP))
-				/** && (daemonSockets[i].protocol == protocol)*/) {
-					return (i);
-				}
-
-				/** Matching for ICMP incoming datagrams
-				 * In this case the IP passes is actually the source IP of that incoming message (Or called the host)
-				 */
-				else if ((daemon_sockets[i].protocol == protocol) && (protocol == IPPROTO_ICMP) && (daemon_sockets[i].dst_ip == dst_ip)) {
-					return (i);
-
-				} else {
-				}
-			}
-		}
-	} // end of for loop
+	int table = daemon_table_protocol(protocol);
+	if (table == -1) {
+		return (-1);
+	}
 
-	return (-1);
+	int i = daemon_sockets_host_find(table, dst_ip, daemon_key_port(table, dst_port));
+	if (i == -1 && table != DAEMON_TABLE_ICMP) {
+		i = daemon_sockets_host_find(table, INADDR_ANY, dst_port);
+	}
 
+	PRINT_DEBUG("Exited: %u/%u: %d, sock_index=%d", dst_ip, dst_port, protocol, i);
+	return (i);
 }
 
 int daemon_sockets_match_connection(uint32_t host_ip, uint16_t host_port, uint32_t rem_ip, uint16_t rem_port, int protocol) {
 	PRINT_DEBUG("Entered: %u/%u to %u/%u", host_ip, host_port, rem_ip, rem_port);
 
-	int i;
-	for (i = 0; i < MAX_SOCKETS; i++) {
-		if (daemon_sockets[i].sock_id != -1 && daemon_sockets[i].host_ip == host_ip && daemon_sockets[i].host_port == host_port
-				&& daemon_sockets[i].dst_ip == rem_ip && daemon_sockets[i].dst_port == rem_port && daemon_sockets[i].protocol == protocol) {
+	int table = daemon_table_protocol(protocol);
+	if (table == -1) {
+		return (-1);
+	}
+
+	int i = daemon_tables[table].conn_hash[daemon_hash_conn(host_ip, host_port, rem_ip, rem_port)];
+	while (i != -1) {
+		if (daemon_sockets[i].host_ip == host_ip && daemon_sockets[i].host_port == host_port && daemon_sockets[i].dst_ip == rem_ip
+				&& daemon_sockets[i].dst_port == rem_port) {
 			PRINT_DEBUG("Exited: host=%u/%u, rem=%u/%u, sock_index=%d", host_ip, host_port, rem_ip, rem_port, i);
 			return (i);
 		}
+		i = daemon_sockets[i].conn_next;
 	}
 
 	//TODO add check for INADDR_ANY & INPORT_ANY
@@ -684,28 +917,105 @@ int daemon_sockets_match_connection(uint32_t host_ip, uint16_t host_port, uint32
 }
 
 /**
- * @brief check if this host port is free or not
+ * @brief check if this host port is free or not for the protocol. Port 0 is always free, it is
+ * given an ephemeral port when the socket is first used, and raw sockets can share an address
 
  * @param
- * @return value of 1 on success (found free) , -1 on failure (found previously-allocated)
+ * @return value of 1 on success (found free) , 0 on failure (found previously-allocated)
  */
-int daemon_sockets_check_ports(uint16_t host_port, uint32_t host_ip) {
-	PRINT_DEBUG("Entered: host_ip=%u, host_port=%u", host_ip, host_port);
+int daemon_sockets_check_ports(uint16_t host_port, uint32_t host_ip, int protocol) {
+	PRINT_DEBUG("Entered: host_ip=%u, host_port=%u, protocol=%d", host_ip, host_port, protocol);
 
-	int i = 0;
+	int table = daemon_table_protocol(protocol);
+	if (table == -1 || table == DAEMON_TABLE_ICMP || host_port == 0) {
+		return (1);
+	}
 
-	for (i = 0; i < MAX_SOCKETS; i++) {
-		if (daemon_sockets[i].host_ip == INADDR_ANY) {
-			if (daemon_sockets[i].host_port == host_port) {
-				return (0);
-			}
-		} else {
-			if ((daemon_sockets[i].host_port == host_port) && (daemon_sockets[i].host_ip == host_ip)) {
-				return (0);
-			}
+	if (host_ip == INADDR_ANY) {
+		return daemon_tables[table].port_refs[host_port] == 0;
+	}
+	return daemon_sockets_host_find(table, host_ip, host_port) == -1 && daemon_sockets_host_find(table, INADDR_ANY, host_port) == -1;
+}
+
+/**
+ * @brief pick a free port between MIN_port and MAX_port, searching on from the last one given out.
+ * The caller claims it with daemon_sockets_set_host() before posting daemon_sockets_sem
+ * @return the port, 0 if they are all in use
+ */
+uint16_t daemon_sockets_ephemeral(int protocol) {
+	struct daemon_sockets_table *table;
+	uint64_t free_bits;
+	uint32_t port;
+	uint32_t left = MAX_port - MIN_port + 1;
+	uint32_t n;
+
+	int i = daemon_table_protocol(protocol);
+	if (i == -1 || i == DAEMON_TABLE_ICMP) {
+		return 0;
+	}
+	table = &daemon_tables[i];
+
+	port = table->port_next;
+	while (left > 0) {
+		n = 64 - (port & 63);
+		if (n > MAX_port + 1 - port) {
+			n = MAX_port + 1 - port;
+		}
+		if (n > left) {
+			n = left;
+		}
+
+		free_bits = ~table->port_map[port >> 6] >> (port & 63);
+		if (n < 64) {
+			free_bits &= (1ull << n) - 1;
+		}
+		if (free_bits) {
+			port += __builtin_ctzll(free_bits);
+			table->port_next = port == MAX_port ? MIN_port : port + 1;
+			PRINT_DEBUG("Exited: protocol=%d, port=%u", protocol, port);
+			return (uint16_t) port;
+		}
+
+		left -= n;
+		port += n;
+		if (port > MAX_port) {
+			port = MIN_port;
 		}
 	}
-	return (1);
+
+	PRINT_ERROR("no ephemeral ports left: protocol=%d", protocol);
+	return 0;
+}
+
+/**
+ * @brief changes the local address of a socket, the lookup tables follow it. Called with daemon_sockets_sem held,
+ * as are the other daemon_sockets_* functions
+ */
+void daemon_sockets_set_host(int sock_index, uint32_t host_ip, uint16_t host_port) {
+	struct daemon_socket *sock = &daemon_sockets[sock_index];
+
+	if (sock->table != -1) {
+		daemon_sockets_unlink(sock_index);
+	}
+	sock->host_ip = host_ip;
+	sock->host_port = host_port;
+	if (sock->table != -1) {
+		daemon_sockets_link(sock_index);
+	}
+}
+
+/** @brief changes the remote address of a socket, like daemon_sockets_set_host() */
+void daemon_sockets_set_dst(int sock_index, uint32_t dst_ip, uint16_t dst_port) {
+	struct daemon_socket *sock = &daemon_sockets[sock_index];
+
+	if (sock->table != -1) {
+		daemon_sockets_unlink(sock_index);
+	}
+	sock->dst_ip = dst_ip;
+	sock->dst_port = dst_port;
+	if (sock->table != -1) {
+		daemon_sockets_link(sock_index);
+	}
 }
 
 /**
@@ -716,8 +1026,13 @@ int daemon_sockets_check_ports(uint16_t host_port, uint32_t host_ip) {
  */
 int daemon_sockets_remove(int sock_index) {
 	PRINT_DEBUG("Entered: sock_id=%llu, sock_index=%d", daemon_sockets[sock_index].sock_id, sock_index);
+	if (daemon_sockets[sock_index].table != -1) {
+		daemon_sockets_unlink(sock_index);
+		daemon_sockets[sock_index].table = -1;
+	}
 	daemon_sockets[sock_index].sock_id = -1;
 	daemon_sockets[sock_index].state = SS_FREE;
+	daemon_sockets[sock_index].ring = -1;
 
 	//TODO stop all threads related to
 
@@ -767,7 +1082,7 @@ int check_daemon_dstports(uint16_t dstport, uint32_t dstip) {
 
 	int i = 0;
 
-	for (i = 0; i < MAX_SOCKETS; i++) {
+	for (i = 0; i < daemon_sockets_max; i++) {
 		if ((daemon_sockets[i].dst_port == dstport) && (daemon_sockets[i].dst_ip == dstip))
 			return (-1);
 
@@ -776,20 +1091,6 @@ int check_daemon_dstports(uint16_t dstport, uint32_t dstip) {
 
 }
 
-/**
- * @brief generate a random integer between min and max
- * @param minimum value of the range, maximum value of the range
- * @return the random integer value
- *
- */
-
-int randoming(int min, int max) {
-
-	srand((unsigned) time(NULL));
-	return (min + (int) (max - min + 1) * (rand() / (RAND_MAX + 1.0)));
-
-}
-
 int nack_send(uint32_t call_id, int call_index, uint32_t call_type, uint32_t msg) { //TODO remove extra params
 	int ret;
 
@@ -809,7 +1110,7 @@ int nack_send(uint32_t call_id, int call_index, uint32_t call_type, uint32_t msg
 	hdr->ret = NACK;
 	hdr->msg = msg;
 
-	ret = send_wedge(nl_sockfd, buf, buf_len, 0);
+	ret = send_wedge(buf, buf_len, 0);
 	free(buf);
 
 	return ret == 1; //TODO change to ret_val ?
@@ -834,7 +1135,7 @@ int ack_send(uint32_t call_id, int call_index, uint32_t call_type, uint32_t msg)
 	hdr->ret = ACK;
 	hdr->msg = msg;
 
-	ret = send_wedge(nl_sockfd, buf, buf_len, 0);
+	ret = send_wedge(buf, buf_len, 0);
 	free(buf);
 
 	return ret == 1; //TODO change to ret_val ?
@@ -843,12 +1144,13 @@ int ack_send(uint32_t call_id, int call_index, uint32_t call_type, uint32_t msg)
 int daemon_to_switch(struct finsFrame *ff) {
 	PRINT_DEBUG("Entered: ff=%p, meta=%p", ff, ff->metaData);
 	if (sem_wait(&Daemon_to_Switch_Qsem)) {
-		PRINT_ERROR("TCP_to_Switch_Qsem wait prob");
+		PRINT_ERROR("Daemon_to_Switch_Qsem wait prob");
 		exit(-1);
 	}
-	if (write_queue(ff, Daemon_to_Switch_Queue)) {
+	if (write_ring(ff, Daemon_to_Switch_Queue)) {
 		PRINT_DEBUG("");
 		sem_post(&Daemon_to_Switch_Qsem);
+		post_event(&Switch_Event);
 		return 1;
 	} else {
 		PRINT_DEBUG("");
@@ -1843,7 +2145,7 @@ void ioctl_out(struct nl_wedge_to_daemon *hdr, uint8_t *buf, ssize_t buf_len) {
 
 	PRINT_DEBUG("msg_len=%d, msg='%s'", msg_len, msg);
 	if (msg_len) {
-		if (send_wedge(nl_sockfd, msg, msg_len, 0)) {
+		if (send_wedge(msg, msg_len, 0)) {
 			PRINT_ERROR("Exiting, fail send_wedge: sock_id=%llu", hdr->sock_id);
 			nack_send(hdr->call_id, hdr->call_index, hdr->call_type, 0);
 		}
@@ -1893,6 +2195,9 @@ void sendmsg_out(struct nl_wedge_to_daemon *hdr, uint8_t *buf, ssize_t len) {
 	void *msg_control = NULL;
 	uint32_t data_len;
 	uint8_t *data = NULL;
+	int ring;
+	int where;
+	uint8_t *ring_pt;
 	uint8_t *pt;
 
 	PRINT_DEBUG("Entered: hdr=%p, len=%d", hdr, len);
@@ -1948,6 +2253,12 @@ void sendmsg_out(struct nl_wedge_to_daemon *hdr, uint8_t *buf, ssize_t len) {
 	data_len = *(uint32_t *) pt;
 	pt += sizeof(uint32_t);
 
+	ring = *(int *) pt;
+	pt += sizeof(int);
+
+	where = *(int *) pt;
+	pt += sizeof(int);
+
 	if (data_len) {
 		data = (uint8_t *) malloc(data_len);
 		if (data == NULL) {
@@ -1956,8 +2267,23 @@ void sendmsg_out(struct nl_wedge_to_daemon *hdr, uint8_t *buf, ssize_t len) {
 			exit(-1);
 		}
 
-		memcpy(data, pt, data_len);
-		pt += data_len;
+		if (where == -1) {
+			memcpy(data, pt, data_len);
+			pt += data_len;
+		} else {
+			//the data is in the socket's ring, copy it straight into the PDU and give the chunk back
+			ring_pt = daemon_ring_take(ring, where, data_len);
+			if (ring_pt == NULL) {
+				PRINT_ERROR("bad ring chunk: ring=%d, where=%d, data_len=%u", ring, where, data_len);
+				nack_send(hdr->call_id, hdr->call_index, hdr->call_type, EINVAL);
+				if (msg_controllen)
+					free(msg_control);
+				free(data);
+				return;
+			}
+			memcpy(data, ring_pt, data_len);
+			ring_done(((struct fins_ring_slot *) daemon_rings)[ring].tx, where);
+		}
 	}
 
 	if (pt - buf != len) {
@@ -1993,6 +2319,7 @@ void sendmsg_out(struct nl_wedge_to_daemon *hdr, uint8_t *buf, ssize_t len) {
 	int protocol = daemon_sockets[hdr->sock_index].protocol;
 
 	daemon_sockets[hdr->sock_index].sockopts.FSO_TIMESTAMP |= timestamp;
+	daemon_sockets[hdr->sock_index].ring = ring;
 
 	PRINT_DEBUG("sock_id=%llu, sock_index=%d, type=%d, proto=%d", hdr->sock_id, hdr->sock_index, type, protocol);
 	PRINT_DEBUG("post$$$$$$$$$$$$$$$");
@@ -2035,6 +2362,7 @@ void recvmsg_out(struct nl_wedge_to_daemon *hdr, uint8_t *buf, ssize_t len) {
 	int data_len;
 	uint32_t msg_controllen;
 	int flags;
+	int ring;
 	uint8_t * pt;
 
 	PRINT_DEBUG("Entered: hdr=%p, len=%d", hdr, len);
@@ -2054,6 +2382,9 @@ void recvmsg_out(struct nl_wedge_to_daemon *hdr, uint8_t *buf, ssize_t len) {
 	flags = *(int *) pt;
 	pt += sizeof(int);
 
+	ring = *(int *) pt;
+	pt += sizeof(int);
+
 	/*
 	 msg_flags = *(uint32_t *) pt; //TODO remove, set when returning
 	 pt += sizeof(uint32_t);
@@ -2108,6 +2439,7 @@ void recvmsg_out(struct nl_wedge_to_daemon *hdr, uint8_t *buf, ssize_t len) {
 	int protocol = daemon_sockets[hdr->sock_index].protocol;
 
 	daemon_sockets[hdr->sock_index].sockopts.FSO_TIMESTAMP |= timestamp;
+	daemon_sockets[hdr->sock_index].ring = ring;
 
 	PRINT_DEBUG("sock_id=%llu, sock_index=%d, type=%d, proto=%d", hdr->sock_id, hdr->sock_index, type, protocol);
 	PRINT_DEBUG("post$$$$$$$$$$$$$$$");
@@ -2332,6 +2664,54 @@ void release_out(struct nl_wedge_to_daemon *hdr, uint8_t *buf, ssize_t len) {
 	}
 }
 
+/*
+ * Works out what poll would report for the socket and, if that changed, pushes it to the wedge so it can
+ * answer poll without asking. For UDP and ICMP everything is known here and the wedge can trust the mask;
+ * for TCP only the data waiting here and the last POLLOUT from TCP are, so it is just a hint.
+ * Edges go out as they happen, the link packs them with the replies of the same batch.
+ * Called with daemon_sockets_sem held.
+ */
+void daemon_ready_update(int sock_index) {
+	struct daemon_socket *sock = &daemon_sockets[sock_index];
+	uint8_t msg[sizeof(struct nl_daemon_to_wedge) + sizeof(int)];
+	struct nl_daemon_to_wedge *hdr_ret;
+	uint32_t mask = 0;
+	int exact;
+
+	if (sock->data_buf > 0) {
+		mask |= POLLIN | POLLRDNORM;
+	}
+
+	if (sock->type == SOCK_STREAM) {
+		mask |= sock->ready_tcp;
+		exact = 0;
+	} else {
+		mask |= POLLOUT | POLLWRNORM | POLLWRBAND;
+		if (sock->sockopts.FIP_RECVERR && sock->error_buf > 0) {
+			mask |= POLLERR;
+		}
+		exact = 1;
+	}
+
+	if (mask == sock->ready) {
+		return;
+	}
+	PRINT_DEBUG("sock_id=%llu, sock_index=%d, ready=0x%x, mask=0x%x, exact=%d", sock->sock_id, sock_index, sock->ready, mask, exact);
+	sock->ready = mask;
+
+	hdr_ret = (struct nl_daemon_to_wedge *) msg;
+	hdr_ret->call_type = ready_event_call;
+	hdr_ret->sock_id = sock->sock_id;
+	hdr_ret->sock_index = sock_index;
+	hdr_ret->ret = ACK;
+	hdr_ret->msg = mask;
+	*(int *) (msg + sizeof(struct nl_daemon_to_wedge)) = exact;
+
+	if (send_wedge(msg, sizeof(msg), 0)) {
+		PRINT_ERROR("send_wedge error: sock_index=%d", sock_index);
+	}
+}
+
 void poll_out(struct nl_wedge_to_daemon *hdr, uint8_t *buf, ssize_t len) {
 	uint8_t * pt;
 	int events;
@@ -2774,6 +3154,12 @@ void daemon_out_ff(struct nl_wedge_to_daemon *hdr, uint8_t *msg_pt, ssize_t msg_
 		return;
 	}
 
+	if (hdr->sock_index < 0 || hdr->sock_index >= daemon_sockets_max) {
+		PRINT_ERROR("sock_index out of range: sock_index=%d, max=%d", hdr->sock_index, daemon_sockets_max);
+		nack_send(hdr->call_id, hdr->call_index, hdr->call_type, 0);
+		return;
+	}
+
 	switch (hdr->call_type) {
 	case socket_call:
 		socket_out(hdr, msg_pt, msg_len);
@@ -2890,180 +3276,34 @@ void test_func_daemon(struct nl_wedge_to_daemon *hdr, uint8_t *msg_pt, ssize_t m
 	}
 }
 
-void *wedge_to_daemon(void *local) {
-	PRINT_DEBUG("Entered");
-
-	int ret;
+void wedge_to_daemon_call(void *arg, uint8_t *msg, ssize_t msg_len) {
+	struct nl_wedge_to_daemon *hdr;
 
-	// Begin receive message section
-	// Allocate a buffer to hold contents of recvfrom call
-	void *recv_buf;
-	recv_buf = malloc(RECV_BUFFER_SIZE + 16); //16 = NLMSGHDR size
-	if (recv_buf == NULL) {
-		PRINT_ERROR("buffer allocation failed");
-		exit(-1);
+	if (msg_len < (ssize_t) sizeof(struct nl_wedge_to_daemon)) {
+		PRINT_ERROR("call too short: msg_len=%d", (int) msg_len);
+		return;
 	}
 
-	struct sockaddr sockaddr_sender; // Needed for recvfrom
-	socklen_t sockaddr_senderlen = sizeof(sockaddr_sender); // Needed for recvfrom
-	memset(&sockaddr_sender, 0, sockaddr_senderlen);
-
-	struct nlmsghdr *nlh;
-	void *nl_buf; // Pointer to your actual data payload
-	ssize_t nl_len, part_len; // Size of your actual data payload
-	uint8_t *part_pt;
-
-	uint8_t *msg_buf = NULL;
-	ssize_t msg_len = -1;
-	uint8_t *msg_pt = NULL;
+	hdr = (struct nl_wedge_to_daemon *) msg;
+	daemon_out_ff(hdr, msg + sizeof(struct nl_wedge_to_daemon), msg_len - sizeof(struct nl_wedge_to_daemon));
+}
 
-	struct nl_wedge_to_daemon *hdr;
-	int okFlag, doneFlag = 0;
-	ssize_t test_msg_len;
+void *wedge_to_daemon(void *local) {
+	PRINT_DEBUG("Entered");
 
-	int pos;
+	int ret;
 
 	PRINT_DEBUG("Waiting for message from kernel");
 
-	int counter = 0;
 	while (daemon_running) {
-		PRINT_DEBUG("NL counter = %d", counter++);
-
-		daemon_setNonblocking(nl_sockfd);
-		do {
-			ret = recvfrom(nl_sockfd, recv_buf, RECV_BUFFER_SIZE + 16, 0, &sockaddr_sender, &sockaddr_senderlen); //TODO change to nonblocking in loop
-		} while (daemon_running && ret <= 0);
-
-		if (!daemon_running) {
-			break;
-		}
-
-		daemon_setBlocking(nl_sockfd);
-
+		//the replies to a batch of calls go back to the wedge together once it is handled
+		ret = nl_link_recv(daemon_link, 100, wedge_to_daemon_call, NULL);
 		if (ret == -1) {
-			perror("recvfrom() caused an error");
+			perror("nl_link_recv() caused an error");
 			exit(-1);
 		}
-		//PRINT_DEBUG("%d", sockaddr_sender);
-
-		nlh = (struct nlmsghdr *) recv_buf;
-
-		if ((okFlag = NLMSG_OK(nlh, ret))) {
-			switch (nlh->nlmsg_type) {
-			case NLMSG_NOOP:
-				PRINT_DEBUG("nlh->nlmsg_type=NLMSG_NOOP");
-				break;
-			case NLMSG_ERROR:
-				PRINT_ERROR("nlh->nlmsg_type=NLMSG_ERROR");
-			case NLMSG_OVERRUN:
-				PRINT_ERROR("nlh->nlmsg_type=NLMSG_OVERRUN");
-				okFlag = 0;
-				break;
-			case NLMSG_DONE:
-				PRINT_DEBUG("nlh->nlmsg_type=NLMSG_DONE");
-				doneFlag = 1;
-			default:
-				PRINT_DEBUG("nlh->nlmsg_type=default");
-				nl_buf = NLMSG_DATA(nlh);
-				nl_len = NLMSG_PAYLOAD(nlh, 0);
-
-				PRINT_DEBUG("nl_len=%d", nl_len);
-
-				part_pt = nl_buf;
-				test_msg_len = *(ssize_t *) part_pt;
-				part_pt += sizeof(ssize_t);
-
-				//PRINT_DEBUG("test_msg_len=%d, msg_len=%d", test_msg_len, msg_len);
-
-				if (msg_len == -1) {
-					msg_len = test_msg_len;
-				} else if (test_msg_len != msg_len) {
-					okFlag = 0;
-					PRINT_ERROR("test_msg_len != msg_len");
-					//could just malloc msg_buff again
-					break;//might comment out or make so start new
-				}
-
-				part_len = *(ssize_t *) part_pt;
-				part_pt += sizeof(ssize_t);
-				if (part_len > RECV_BUFFER_SIZE) {
-					PRINT_DEBUG("part_len (%d) > RECV_BUFFER_SIZE (%d)", part_len, RECV_BUFFER_SIZE);
-				}
-
-				//PRINT_DEBUG("part_len=%d", part_len);
-
-				pos = *(int *) part_pt;
-				part_pt += sizeof(int);
-				if (pos > msg_len || pos != msg_pt - msg_buf) {
-					if (pos > msg_len) {
-						PRINT_ERROR("pos > msg_len");
-					} else {
-						PRINT_ERROR("pos != msg_pt - msg_buf");
-					}
-				}
-
-				//PRINT_DEBUG("pos=%d", pos);
-
-				PRINT_DEBUG("msg_len=%d, part_len=%d, pos=%d, seq=%d", msg_len, part_len, pos, nlh->nlmsg_seq);
-
-				if (nlh->nlmsg_seq == 0) {
-					if (msg_buf != NULL) {
-						PRINT_ERROR("error: msg_buf != NULL at new sequence, freeing");
-						free(msg_buf);
-					}
-					msg_buf = (uint8_t *) malloc(msg_len);
-					if (msg_buf == NULL) {
-						PRINT_ERROR("msg buffer allocation failed");
-						exit(-1);
-					}
-					msg_pt = msg_buf;
-				}
-
-				if (msg_pt != NULL) {
-					msg_pt = msg_buf + pos; //atm redundant, is for if out of sync msgs
-					memcpy(msg_pt, part_pt, part_len);
-					msg_pt += part_len;
-				} else {
-					PRINT_ERROR("error: msg_pt is NULL");
-				}
-
-				if ((nlh->nlmsg_flags & NLM_F_MULTI) == 0) {
-					//doneFlag = 1; //not multi-part msg //removed multi
-				}
-				break;
-			}
-		}
-
-		if (okFlag != 1) {
-			doneFlag = 0;
-			PRINT_DEBUG("okFlag != 1");
-			//send kernel a resend request
-			//with pos of part being passed can store msg_buf, then recopy new part when received
-		}
-
-		if (doneFlag) {
-			if (msg_len < sizeof(struct nl_wedge_to_daemon)) {
-				//TODOD error
-				PRINT_ERROR("todo error");
-			}
-
-			hdr = (struct nl_wedge_to_daemon *) msg_buf;
-			msg_pt = msg_buf + sizeof(struct nl_wedge_to_daemon);
-			msg_len -= sizeof(struct nl_wedge_to_daemon);
-
-			daemon_out_ff(hdr, msg_pt, msg_len); //TODO uncomment
-
-			free(msg_buf);
-			doneFlag = 0;
-			msg_buf = NULL;
-			msg_pt = NULL;
-			msg_len = -1;
-		}
 	}
 
-	free(recv_buf);
-	close(nl_sockfd);
-
 	PRINT_DEBUG("Exited");
 	pthread_exit(NULL);
 }
@@ -3128,19 +3368,29 @@ void daemon_interrupt(void) {
 }
 
 void daemon_get_ff(void) {
+	struct finsFrame *ffs[RING_BURST];
 	struct finsFrame *ff;
+	int n;
+	int i;
 
 	do {
-		sem_wait(&Switch_to_Daemon_Qsem);
-		ff = read_queue(Switch_to_Daemon_Queue);
-		sem_post(&Switch_to_Daemon_Qsem);
-	} while (daemon_running && ff == NULL && !daemon_interrupt_flag); //TODO change logic here, combine with switch_to_arp?
+		n = read_ring_burst(ffs, RING_BURST, Switch_to_Daemon_Queue);
+		if (daemon_running && n == 0 && !daemon_interrupt_flag) {
+			wait_event(&Switch_to_Daemon_Event);
+		}
+	} while (daemon_running && n == 0 && !daemon_interrupt_flag); //TODO change logic here, combine with switch_to_arp?
 
 	if (!daemon_running) {
+		while (n > 0) {
+			freeFinsFrame(ffs[--n]);
+		}
 		return;
 	}
 
-	if (ff) {
+	nl_link_cork(daemon_link); //replies the burst produces go to the wedge in one send
+	for (i = 0; i < n; i++) {
+		ff = writableFinsFrame(ffs[i]); //frames delivered to several modules are shared
+
 		if (ff->dataOrCtrl == CONTROL) {
 			daemon_fcf(ff);
 			PRINT_DEBUG("");
@@ -3155,13 +3405,14 @@ void daemon_get_ff(void) {
 		} else {
 			PRINT_ERROR("todo error");
 		}
-	} else if (daemon_interrupt_flag) {
+	}
+
+	if (daemon_interrupt_flag) {
 		daemon_interrupt_flag = 0;
 
 		daemon_interrupt();
-	} else {
-		PRINT_ERROR("todo error");
 	}
+	nl_link_uncork(daemon_link);
 }
 
 void daemon_fcf(struct finsFrame *ff) {
@@ -3644,12 +3895,30 @@ void daemon_init(void) {
 	sem_init(&daemon_thread_sem, 0, 1);
 	daemon_thread_count = 0;
 
+	config_t cfg;
+	config_setting_t *setting;
+	int sockets_max = DAEMON_SOCKETS_DEFAULT;
+
+	config_init(&cfg);
+	if (config_read_file(&cfg, DAEMON_CONFIG_FILE)) {
+		setting = config_lookup(&cfg, "daemon.sockets_max");
+		if (setting != NULL && config_setting_get_int(setting) > 0) {
+			sockets_max = config_setting_get_int(setting);
+		}
+	} else {
+		PRINT_DEBUG("no daemon config, using defaults: file='%s', error='%s'", DAEMON_CONFIG_FILE, config_error_text(&cfg));
+	}
+	config_destroy(&cfg);
+
+	if (sockets_max > MAX_SOCKETS) {
+		PRINT_ERROR("sockets_max=%d is more than the wedge has, using %d", sockets_max, MAX_SOCKETS);
+		sockets_max = MAX_SOCKETS;
+	}
+	PRINT_DEBUG("sockets_max=%d", sockets_max);
+
 	int i;
 	sem_init(&daemon_sockets_sem, 0, 1);
-	for (i = 0; i < MAX_SOCKETS; i++) {
-		daemon_sockets[i].sock_id = -1;
-		daemon_sockets[i].state = SS_FREE;
-	}
+	daemon_sockets_init(sockets_max);
 
 	sem_init(&daemon_calls_sem, 0, 1);
 	for (i = 0; i < MAX_CALLS; i++) {
@@ -3676,6 +3945,7 @@ void daemon_init(void) {
 		to_data->running = &daemon_calls[i].to_running;
 		to_data->flag = &daemon_calls[i].to_flag;
 		to_data->interrupt = &daemon_interrupt_flag;
+		to_data->event = &Switch_to_Daemon_Event;
 		if (pthread_create(&daemon_calls[i].to_thread, NULL, daemon_to_thread, (void *) to_data)) {
 			PRINT_ERROR("ERROR: unable to create arp_to_thread thread.");
 			exit(-1);
@@ -3684,6 +3954,9 @@ void daemon_init(void) {
 
 	expired_call_list = call_list_create(MAX_CALLS);
 
+//map the payload rings before the wedge hears from the daemon, it only hands out slots once they are mapped
+	daemon_rings_init();
+
 //init the netlink socket connection to daemon
 	nl_sockfd = init_fins_nl();
 	if (nl_sockfd == -1) {
@@ -3694,7 +3967,7 @@ void daemon_init(void) {
 //prime the kernel to establish daemon's PID
 	int daemoncode = daemon_start_call;
 	int ret;
-	ret = send_wedge(nl_sockfd, (uint8_t *) &daemoncode, sizeof(int), 0);
+	ret = send_wedge((uint8_t *) &daemoncode, sizeof(int), 0);
 	if (ret != 0) {
 		perror("sendfins() caused an error");
 		exit(-1);
@@ -3712,10 +3985,11 @@ void daemon_run(pthread_attr_t *fins_pthread_attr) {
 void daemon_shutdown(void) {
 	PRINT_DEBUG("Entered");
 	daemon_running = 0;
+	post_event(&Switch_to_Daemon_Event);
 
 //prime the kernel to establish daemon's PID
 	int daemoncode = daemon_stop_call;
-	int ret = send_wedge(nl_sockfd, (uint8_t *) &daemoncode, sizeof(int), 0);
+	int ret = send_wedge((uint8_t *) &daemoncode, sizeof(int), 0);
 	if (ret) {
 		PRINT_DEBUG("send_wedge failure");
 		//perror("sendfins() caused an error");
@@ -3738,7 +4012,7 @@ void daemon_release(void) {
 	//struct daemon_call *call;
 
 	int i = 0;
-	for (i = 0; i < MAX_SOCKETS; i++) {
+	for (i = 0; i < daemon_sockets_max; i++) {
 		if (daemon_sockets[i].sock_id != -1) {
 			daemon_sockets_remove(i); //TODO replace inner with this?
 			/*
@@ -3768,6 +4042,12 @@ void daemon_release(void) {
 		daemon_calls_shutdown(i);
 	}
 
-	term_queue(Daemon_to_Switch_Queue);
-	term_queue(Switch_to_Daemon_Queue);
+	daemon_sockets_free();
+
+	nl_link_free(daemon_link);
+	close(nl_sockfd);
+	daemon_rings_free();
+
+	term_ring(Daemon_to_Switch_Queue);
+	term_ring(Switch_to_Daemon_Queue);
 }
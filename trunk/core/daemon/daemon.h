@@ -35,6 +35,7 @@
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <sys/time.h>
 #include <sys/timerfd.h>
 #include <unistd.h>
@@ -45,10 +46,15 @@
 #include <finsdebug.h>
 /** Additional header for meta-data manipulation */
 #include <metadata.h>
+
+#include "nlHandling.h"
+#include "ringHandling.h"
 //#include "arp.c"
 
 /** FINS Sockets database related defined constants */
-#define MAX_SOCKETS 100
+#define MAX_SOCKETS 4096 //most sock_index values the wedge hands out, the same in fins_stack_wedge.h
+#define DAEMON_SOCKETS_DEFAULT 1024
+#define DAEMON_CONFIG_FILE "fins.cfg" //"daemon.sockets_max" sets how many sockets are kept, up to MAX_SOCKETS
 #define MAX_CALLS 100
 #define MaxChildrenNumSharingSocket 100
 #define MAX_parallel_threads 10
@@ -58,6 +64,13 @@
 #define NACK 	6666
 #define MIN_port 32768
 #define MAX_port 61000
+#define DAEMON_PORTS 65536
+
+/** each transport has its own lookup tables and ports */
+#define DAEMON_TABLE_ICMP 0
+#define DAEMON_TABLE_UDP 1
+#define DAEMON_TABLE_TCP 2
+#define DAEMON_TABLES 3
 #define DEFAULT_BACKLOG 5
 #define DAEMON_BLOCK_DEFAULT 500
 #define CONTROL_LEN_MAX 10240
@@ -88,6 +101,7 @@
 #define daemon_start_call 19
 #define daemon_stop_call 20
 #define poll_event_call 21
+#define ready_event_call 22
 
 /** Additional calls
  * To hande special cases
@@ -95,14 +109,13 @@
  * in order to make sure that we cover as many applications as possible
  * This range of these functions will start from 30
  */
-#define MAX_CALL_TYPES 22
+#define MAX_CALL_TYPES 23
 
 //fins netlink stuff
 #define NETLINK_FINS	20		// Pick an appropriate protocol or define a new one in include/linux/netlink.h
-struct sockaddr_nl local_sockaddress; // sockaddr_nl for this process (source)
-struct sockaddr_nl kernel_sockaddress; // sockaddr_nl for the kernel (destination)
-int nl_sockfd; //temp for now
-sem_t nl_sem;
+#define DAEMON_NL_RCVBUF (4 * NL_BATCH * NL_PART_SIZE)
+extern int nl_sockfd;
+extern struct nl_link *daemon_link;
 
 enum sock_flags {
 	SOCK_DEAD = 0, SOCK_DONE, SOCK_URGINLINE, SOCK_KEEPOPEN, SOCK_LINGER, SOCK_DESTROY, SOCK_BROADCAST, SOCK_TIMESTAMP, SOCK_ZAPPED, SOCK_USE_WRITE_QUEUE, /* whether to call sk->sk_write_space in sock_wfree */
@@ -155,6 +168,8 @@ enum sol_sockOptions {
 
 };
 
+#define DAEMON_CONG_NAME_MAX 16 //TCP_CA_NAME_MAX
+
 struct socket_options { //TODO change to common opts, then union of structs for ICMP/UDP/TCP
 
 	//SOL_SOCKET stuff
@@ -205,6 +220,7 @@ struct socket_options { //TODO change to common opts, then union of structs for
 
 	//SOL_TCP stuff;
 	int FTCP_NODELAY;
+	char FTCP_CONGESTION[DAEMON_CONG_NAME_MAX]; //"" for TCP's default
 };
 
 struct tcp_Parameters {
@@ -228,38 +244,12 @@ struct daemon_to_thread_data {
 	uint8_t *running;
 	uint8_t *flag;
 	uint8_t *interrupt;
+	struct finsEvent *event;
 };
 
 void daemon_stop_timer(int fd);
 void daemon_start_timer(int fd, double millis);
 
-struct nl_wedge_to_daemon {
-	uint64_t sock_id;
-	int sock_index;
-
-	uint32_t call_type;
-	int call_pid;
-
-	uint32_t call_id;
-	int call_index;
-};
-
-struct nl_daemon_to_wedge {
-	uint32_t call_type;
-
-	union {
-		uint32_t call_id;
-		uint64_t sock_id; //TODO currently unused, remove if never needed
-	};
-	union {
-		int call_index;
-		int sock_index; //TODO currently unused, remove if never needed
-	};
-
-	uint32_t ret;
-	uint32_t msg;
-};
-
 struct daemon_call {
 	struct daemon_call *next;
 	uint8_t alloc;
@@ -357,18 +347,33 @@ struct daemon_socket {
 	uint32_t error_call;
 
 	struct socket_options sockopts;
+
+	int ring; //payload ring slot the wedge gave the socket, -1 for none
+
+	uint32_t ready; //poll mask last pushed to the wedge, see daemon_ready_update()
+	uint32_t ready_tcp; //POLLOUT bits TCP last reported, until the next sendmsg
+
+	//links in the lookup tables, only changed by the daemon_sockets_* functions
+	int table; //DAEMON_TABLE_*, -1 when not in one
+	int host_prev;
+	int host_next;
+	int conn_prev;
+	int conn_next;
 };
 
+void daemon_sockets_init(int max);
+void daemon_sockets_free(void);
 int daemon_sockets_insert(uint64_t sock_id, int sock_index, int sock_type, int protocol);
 int daemon_sockets_find(uint64_t sock_id);
 int daemon_sockets_match(uint16_t dstport, uint32_t dstip, int protocol);
 int daemon_sockets_match_connection(uint32_t host_ip, uint16_t host_port, uint32_t rem_ip, uint16_t rem_port, int protocol);
 //int check_daemonSocket(uint64_t sock_id);
-int daemon_sockets_check_ports(uint16_t hostport, uint32_t hostip);
+int daemon_sockets_check_ports(uint16_t hostport, uint32_t hostip, int protocol);
+uint16_t daemon_sockets_ephemeral(int protocol);
+void daemon_sockets_set_host(int sock_index, uint32_t host_ip, uint16_t host_port);
+void daemon_sockets_set_dst(int sock_index, uint32_t dst_ip, uint16_t dst_port);
 int daemon_sockets_remove(int sock_index);
 
-int randoming(int min, int max);
-
 //ADDED mrd015 !!!!! (this crap really needs to be gathered into one header.)
 #ifdef BUILD_FOR_ANDROID
 #define FINS_TMP_ROOT "/data/data/fins"
@@ -380,9 +385,13 @@ int randoming(int min, int max);
 #define RTM_PIPE_IN FINS_TMP_ROOT "/rtm_in"
 #define RTM_PIPE_OUT FINS_TMP_ROOT "/rtm_out"
 
-#define RECV_BUFFER_SIZE	8192//4096//1024// Pick an appropriate value here
 int init_fins_nl(void);
-int send_wedge(int sockfd, uint8_t *buf, size_t len, int flags);
+int send_wedge(uint8_t *buf, size_t len, int flags);
+void daemon_rings_init(void);
+void daemon_rings_free(void);
+int daemon_ring_put(int sock_index, uint8_t *data, uint32_t data_len);
+void daemon_ring_drop(int sock_index, int where);
+uint8_t *daemon_ring_take(int ring, int where, uint32_t data_len);
 int nack_send(uint32_t call_id, int call_index, uint32_t call_type, uint32_t msg);
 int ack_send(uint32_t call_id, int call_index, uint32_t call_type, uint32_t msg);
 
@@ -403,6 +412,7 @@ void getsockopt_out(struct nl_wedge_to_daemon *hdr, uint8_t *buf, ssize_t len);
 void setsockopt_out(struct nl_wedge_to_daemon *hdr, uint8_t *buf, ssize_t len);
 void release_out(struct nl_wedge_to_daemon *hdr, uint8_t *buf, ssize_t len);
 void poll_out(struct nl_wedge_to_daemon *hdr, uint8_t *buf, ssize_t len);
+void daemon_ready_update(int sock_index);
 void mmap_out(struct nl_wedge_to_daemon *hdr, uint8_t *buf, ssize_t len);
 void socketpair_out(struct nl_wedge_to_daemon *hdr, uint8_t *buf, ssize_t len);
 void shutdown_out(struct nl_wedge_to_daemon *hdr, uint8_t *buf, ssize_t len);
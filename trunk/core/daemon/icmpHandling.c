@@ -9,7 +9,7 @@
 #include <finstypes.h>
 
 extern sem_t daemon_sockets_sem;
-extern struct daemon_socket daemon_sockets[MAX_SOCKETS];
+extern struct daemon_socket *daemon_sockets;
 
 extern sem_t daemon_calls_sem; //TODO remove?
 extern struct daemon_call daemon_calls[MAX_CALLS];
@@ -63,6 +63,9 @@ void socket_out_icmp(struct nl_wedge_to_daemon *hdr, int domain, int type, int p
 	}
 	ret = daemon_sockets_insert(hdr->sock_id, hdr->sock_index, type, protocol); //TODO add &icmp_ops
 	PRINT_DEBUG("sock_index=%d, ret=%d", hdr->sock_index, ret);
+	if (ret) {
+		daemon_ready_update(hdr->sock_index);
+	}
 	PRINT_DEBUG("post$$$$$$$$$$$$$$$");
 	sem_post(&daemon_sockets_sem);
 
@@ -119,7 +122,7 @@ void bind_out_icmp(struct nl_wedge_to_daemon *hdr, struct sockaddr_in *addr) {
 	/** check if the same port and address have been both used earlier or not
 	 * it returns (-1) in case they already exist, so that we should not reuse them
 	 * */
-	if (!daemon_sockets_check_ports(host_port, host_ip) && !daemon_sockets[hdr->sock_index].sockopts.FSO_REUSEADDR) {
+	if (!daemon_sockets_check_ports(host_port, host_ip, IPPROTO_ICMP) && !daemon_sockets[hdr->sock_index].sockopts.FSO_REUSEADDR) {
 		PRINT_ERROR("this port is not free");
 		PRINT_DEBUG("post$$$$$$$$$$$$$$$");
 		sem_post(&daemon_sockets_sem);
@@ -132,12 +135,10 @@ void bind_out_icmp(struct nl_wedge_to_daemon *hdr, struct sockaddr_in *addr) {
 	/**
 	 * Binding
 	 */
-	daemon_sockets[hdr->sock_index].host_port = host_port;
-
 	if (host_ip == any_ip_addr) { //TODO change this when have multiple interfaces
-		daemon_sockets[hdr->sock_index].host_ip = my_host_ip_addr;
+		daemon_sockets_set_host(hdr->sock_index, my_host_ip_addr, host_port);
 	} else {
-		daemon_sockets[hdr->sock_index].host_ip = host_ip;
+		daemon_sockets_set_host(hdr->sock_index, host_ip, host_port);
 	}
 
 	PRINT_DEBUG("bind: index:%d, host:%u/%u, dst:%u/%u",
@@ -254,8 +255,7 @@ void connect_out_icmp(struct nl_wedge_to_daemon *hdr, struct sockaddr_in *addr,
 	 * any modifications to the contents of the daemonSockets database
 	 */
 	daemon_sockets[hdr->sock_index].state = SS_CONNECTING;
-	daemon_sockets[hdr->sock_index].dst_ip = dst_ip;
-	daemon_sockets[hdr->sock_index].dst_port = dst_port;
+	daemon_sockets_set_dst(hdr->sock_index, dst_ip, dst_port);
 
 	PRINT_DEBUG("curr: sock_id=%llu, sock_index=%d, state=%u, host=%u/%u, dst=%u/%u",
 			daemon_sockets[hdr->sock_index].sock_id, hdr->sock_index, daemon_sockets[hdr->sock_index].state, daemon_sockets[hdr->sock_index].host_ip, daemon_sockets[hdr->sock_index].host_port, daemon_sockets[hdr->sock_index].dst_ip, daemon_sockets[hdr->sock_index].dst_port);
@@ -416,7 +416,7 @@ void getname_out_icmp(struct nl_wedge_to_daemon *hdr, int peer) {
 	}
 
 	PRINT_DEBUG("msg_len=%d, msg='%s'", msg_len, msg);
-	if (send_wedge(nl_sockfd, msg, msg_len, 0)) {
+	if (send_wedge(msg, msg_len, 0)) {
 		PRINT_ERROR("Exited: fail send_wedge: hdr=%p", hdr);
 		nack_send(hdr->call_id, hdr->call_index, hdr->call_type, 0);
 	} else {
@@ -536,7 +536,7 @@ void ioctl_out_icmp(struct nl_wedge_to_daemon *hdr, uint32_t cmd, uint8_t *buf,
 
 	PRINT_DEBUG("msg_len=%d, msg='%s'", msg_len, msg);
 	if (msg_len) {
-		if (send_wedge(nl_sockfd, msg, msg_len, 0)) {
+		if (send_wedge(msg, msg_len, 0)) {
 			PRINT_ERROR("Exited: fail send_wedge: hdr=%p", hdr);
 			nack_send(hdr->call_id, hdr->call_index, hdr->call_type, 0);
 		}
@@ -629,7 +629,7 @@ void sendmsg_out_icmp(struct nl_wedge_to_daemon *hdr, uint8_t *data, uint32_t da
 	 * the current IP using the IPv4 modules unless a binding has occured earlier
 	 */
 	if (daemon_sockets[hdr->sock_index].host_ip == any_ip_addr) { //TODO change this when have multiple interfaces
-		daemon_sockets[hdr->sock_index].host_ip = my_host_ip_addr;
+		daemon_sockets_set_host(hdr->sock_index, my_host_ip_addr, daemon_sockets[hdr->sock_index].host_port);
 	}
 	host_ip = daemon_sockets[hdr->sock_index].host_ip;
 
@@ -643,16 +643,6 @@ void sendmsg_out_icmp(struct nl_wedge_to_daemon *hdr, uint8_t *data, uint32_t da
 	 */
 
 	host_port = daemon_sockets[hdr->sock_index].host_port;
-	/*
-	 if (host_port == 0) {
-	 while (1) {
-	 host_port = randoming(MIN_port, MAX_port);
-	 if (daemon_sockets_check_ports(host_port, host_ip)) {
-	 break;
-	 }
-	 }
-	 daemon_sockets[hdr->sock_index].host_port = host_port;
-	 }*/
 
 	/*//TODO uncomment? find out if connect rem addr sent through sendmsg
 	 if (daemonSockets[hdr->sock_index].state > SS_UNCONNECTED) {
@@ -752,6 +742,7 @@ void recvmsg_out_icmp(struct nl_wedge_to_daemon *hdr, int data_len, uint32_t msg
 				}
 
 				daemon_sockets[hdr->sock_index].error_buf--;
+				daemon_ready_update(hdr->sock_index);
 
 				metadata *params = ff->metaData;
 
@@ -908,7 +899,8 @@ void recvmsg_out_icmp(struct nl_wedge_to_daemon *hdr, int data_len, uint32_t msg
 
 				int addr_len = sizeof(struct sockaddr_in);
 
-				int msg_len = sizeof(struct nl_daemon_to_wedge) + 3 * sizeof(int) + addr_len + ff->ctrlFrame.data_len + control_len;
+				int where = daemon_ring_put(hdr->sock_index, ff->ctrlFrame.data, ff->ctrlFrame.data_len);
+				int msg_len = sizeof(struct nl_daemon_to_wedge) + 4 * sizeof(int) + addr_len + (where == -1 ? ff->ctrlFrame.data_len : 0) + control_len;
 				uint8_t *msg = (uint8_t *) malloc(msg_len);
 				if (msg == NULL) {
 					PRINT_ERROR("ERROR: buf alloc fail");
@@ -932,8 +924,13 @@ void recvmsg_out_icmp(struct nl_wedge_to_daemon *hdr, int data_len, uint32_t msg
 				*(int *) pt = ff->ctrlFrame.data_len;
 				pt += sizeof(int);
 
-				memcpy(pt, ff->ctrlFrame.data, ff->ctrlFrame.data_len);
-				pt += ff->ctrlFrame.data_len;
+				*(int *) pt = where;
+				pt += sizeof(int);
+
+				if (where == -1) {
+					memcpy(pt, ff->ctrlFrame.data, ff->ctrlFrame.data_len);
+					pt += ff->ctrlFrame.data_len;
+				}
 
 				*(int *) pt = control_len;
 				pt += sizeof(int);
@@ -953,9 +950,10 @@ void recvmsg_out_icmp(struct nl_wedge_to_daemon *hdr, int data_len, uint32_t msg
 				}
 
 				PRINT_DEBUG("msg_len=%d, msg='%s'", msg_len, msg);
-				if (send_wedge(nl_sockfd, msg, msg_len, 0)) {
+				if (send_wedge(msg, msg_len, 0)) {
 					PRINT_ERROR("Exited: fail send_wedge: hdr=%p", hdr);
 					nack_send(hdr->call_id, hdr->call_index, hdr->call_type, 0);
+					daemon_ring_drop(hdr->sock_index, where);
 				} else {
 					//PRINT_DEBUG("Exiting, normal: id=%d, index=%d, uniqueSockID=%llu", id, index, uniqueSockID);
 				}
@@ -995,6 +993,7 @@ void recvmsg_out_icmp(struct nl_wedge_to_daemon *hdr, int data_len, uint32_t msg
 			}
 
 			daemon_sockets[hdr->sock_index].data_buf -= ff->dataFrame.pduLength;
+			daemon_ready_update(hdr->sock_index);
 			PRINT_DEBUG("after: sock_index=%d, data_buf=%d", hdr->sock_index, daemon_sockets[hdr->sock_index].data_buf);
 
 			metadata *params = ff->metaData;
@@ -1111,7 +1110,8 @@ void recvmsg_out_icmp(struct nl_wedge_to_daemon *hdr, int data_len, uint32_t msg
 
 			int addr_len = sizeof(struct sockaddr_in);
 
-			int msg_len = sizeof(struct nl_daemon_to_wedge) + 3 * sizeof(int) + addr_len + ff->dataFrame.pduLength + control_len;
+			int where = daemon_ring_put(hdr->sock_index, ff->dataFrame.pdu, ff->dataFrame.pduLength);
+			int msg_len = sizeof(struct nl_daemon_to_wedge) + 4 * sizeof(int) + addr_len + (where == -1 ? ff->dataFrame.pduLength : 0) + control_len;
 			uint8_t *msg = (uint8_t *) malloc(msg_len);
 			if (msg == NULL) {
 				PRINT_ERROR("ERROR: buf alloc fail");
@@ -1135,8 +1135,13 @@ void recvmsg_out_icmp(struct nl_wedge_to_daemon *hdr, int data_len, uint32_t msg
 			*(int *) pt = ff->dataFrame.pduLength;
 			pt += sizeof(int);
 
-			memcpy(pt, ff->dataFrame.pdu, ff->dataFrame.pduLength);
-			pt += ff->dataFrame.pduLength;
+			*(int *) pt = where;
+			pt += sizeof(int);
+
+			if (where == -1) {
+				memcpy(pt, ff->dataFrame.pdu, ff->dataFrame.pduLength);
+				pt += ff->dataFrame.pduLength;
+			}
 
 			*(int *) pt = control_len;
 			pt += sizeof(int);
@@ -1156,9 +1161,10 @@ void recvmsg_out_icmp(struct nl_wedge_to_daemon *hdr, int data_len, uint32_t msg
 			}
 
 			PRINT_DEBUG("msg_len=%d, msg='%s'", msg_len, msg);
-			if (send_wedge(nl_sockfd, msg, msg_len, 0)) {
+			if (send_wedge(msg, msg_len, 0)) {
 				PRINT_ERROR("Exited: fail send_wedge: hdr=%p", hdr);
 				nack_send(hdr->call_id, hdr->call_index, hdr->call_type, 0);
+				daemon_ring_drop(hdr->sock_index, where);
 			} else {
 				//PRINT_DEBUG("Exiting, normal: id=%d, index=%d, uniqueSockID=%llu", id, index, uniqueSockID);
 			}
@@ -1777,7 +1783,7 @@ void getsockopt_out_icmp(struct nl_wedge_to_daemon *hdr, int level, int optname,
 	}
 
 	PRINT_DEBUG("msg_len=%d, msg='%s'", msg_len, msg);
-	if (send_wedge(nl_sockfd, msg, msg_len, 0)) {
+	if (send_wedge(msg, msg_len, 0)) {
 		PRINT_ERROR("Exited: fail send_wedge: hdr=%p", hdr);
 		nack_send(hdr->call_id, hdr->call_index, hdr->call_type, 0);
 	} else {
@@ -1834,7 +1840,7 @@ void poll_in_icmp(struct daemon_call_list *call_list, struct daemon_call *call,
 		}
 
 		PRINT_DEBUG("msg_len=%d, msg='%s'", msg_len, msg);
-		if (send_wedge(nl_sockfd, msg, msg_len, 0)) {
+		if (send_wedge(msg, msg_len, 0)) {
 			PRINT_ERROR("Exited: send_wedge error: call=%p", call);
 		} else {
 
@@ -1994,7 +2000,8 @@ void recvmsg_in_icmp(struct daemon_call_list *call_list, struct daemon_call *cal
 
 	int addr_len = sizeof(struct sockaddr_in);
 
-	int msg_len = sizeof(struct nl_daemon_to_wedge) + 3 * sizeof(int) + addr_len + data_len + control_len;
+	int where = daemon_ring_put(call->sock_index, data, data_len);
+	int msg_len = sizeof(struct nl_daemon_to_wedge) + 4 * sizeof(int) + addr_len + (where == -1 ? data_len : 0) + control_len;
 	uint8_t *msg = (uint8_t *) malloc(msg_len);
 	if (msg == NULL) {
 		PRINT_ERROR("ERROR: buf alloc fail");
@@ -2018,8 +2025,13 @@ void recvmsg_in_icmp(struct daemon_call_list *call_list, struct daemon_call *cal
 	*(int *) pt = data_len;
 	pt += sizeof(int);
 
-	memcpy(pt, data, data_len);
-	pt += data_len;
+	*(int *) pt = where;
+	pt += sizeof(int);
+
+	if (where == -1) {
+		memcpy(pt, data, data_len);
+		pt += data_len;
+	}
 
 	*(int *) pt = control_len;
 	pt += sizeof(int);
@@ -2039,9 +2051,10 @@ void recvmsg_in_icmp(struct daemon_call_list *call_list, struct daemon_call *cal
 	}
 
 	PRINT_DEBUG("msg_len=%d, msg='%s'", msg_len, msg);
-	if (send_wedge(nl_sockfd, msg, msg_len, 0)) {
+	if (send_wedge(msg, msg_len, 0)) {
 		PRINT_ERROR("Exited: send_wedge error: call_list=%p, call=%p", call_list, call);
 		nack_send(call->call_id, call->call_index, call->call_type, 0);
+		daemon_ring_drop(call->sock_index, where);
 	} else {
 		PRINT_DEBUG("Exited: Normal: call_list=%p, call=%p", call_list, call);
 	}
@@ -2076,7 +2089,7 @@ void daemon_icmp_in_fdf(struct finsFrame *ff, uint32_t src_ip, uint32_t dst_ip)
 	struct finsFrame *ff_clone;
 
 	int i;
-	for (i = 0; i < MAX_SOCKETS; i++) {
+	for (i = daemon_sockets_match(0, dst_ip, IPPROTO_ICMP); i != -1; i = daemon_sockets[i].host_next) {
 		if (daemon_sockets[i].sock_id != -1 && daemon_sockets[i].protocol == IPPROTO_ICMP && daemon_sockets[i].host_ip == dst_ip) {
 			PRINT_DEBUG( "Matched: sock_id=%llu, sock_index=%d, host=%u/%u, dst=%u/%u, prot=%u",
 					daemon_sockets[i].sock_id, i, daemon_sockets[i].host_ip, daemon_sockets[i].host_port, daemon_sockets[i].dst_ip, daemon_sockets[i].dst_port, daemon_sockets[i].protocol);
@@ -2108,6 +2121,7 @@ void daemon_icmp_in_fdf(struct finsFrame *ff, uint32_t src_ip, uint32_t dst_ip)
 				ff_clone = cloneFinsFrame(ff);
 				if (write_queue(ff_clone, daemon_sockets[i].data_queue)) {
 					daemon_sockets[i].data_buf += ff_clone->dataFrame.pduLength;
+					daemon_ready_update(i);
 					PRINT_DEBUG("stored, sock_index=%d, ff=%p, meta=%p, data_buf=%d", i, ff_clone, ff_clone->metaData, daemon_sockets[i].data_buf);
 				} else {
 					PRINT_ERROR("Write queue error: ff=%p", ff_clone);
@@ -2142,7 +2156,7 @@ void daemon_icmp_in_error(struct finsFrame *ff, uint32_t src_ip, uint32_t dst_ip
 	struct finsFrame *ff_clone;
 
 	int i;
-	for (i = 0; i < MAX_SOCKETS; i++) {
+	for (i = daemon_sockets_match(0, src_ip, IPPROTO_ICMP); i != -1; i = daemon_sockets[i].host_next) {
 		if (daemon_sockets[i].sock_id != -1 && daemon_sockets[i].protocol == IPPROTO_ICMP && daemon_sockets[i].host_ip == src_ip) {
 			PRINT_DEBUG( "Matched: sock_id=%llu, sock_index=%d, host=%u/%u, dst=%u/%u, prot=%u",
 					daemon_sockets[i].sock_id, i, daemon_sockets[i].host_ip, daemon_sockets[i].host_port, daemon_sockets[i].dst_ip, daemon_sockets[i].dst_port, daemon_sockets[i].protocol);
@@ -2173,6 +2187,7 @@ void daemon_icmp_in_error(struct finsFrame *ff, uint32_t src_ip, uint32_t dst_ip
 					ff_clone = cloneFinsFrame(ff); //NOTE this FCF clone has a different serial_num!!!
 					if (write_queue(ff_clone, daemon_sockets[i].error_queue)) {
 						daemon_sockets[i].error_buf++; //TODO change to byte size?
+						daemon_ready_update(i);
 						PRINT_DEBUG("stored, sock_index=%d, ff=%p, meta=%p, error_buf=%d", i, ff_clone, ff_clone->metaData, daemon_sockets[i].error_buf);
 					} else {
 						PRINT_ERROR("Write queue error: ff=%p", ff_clone);
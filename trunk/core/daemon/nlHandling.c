@@ -0,0 +1,385 @@
+/*
+ * nlHandling.c
+ *
+ *  Created on: Oct 18, 2026
+ *      @brief batched netlink transport between the daemon and the wedge, see nlHandling.h
+ */
+
+#define _GNU_SOURCE //recvmmsg()/sendmmsg()
+#include "nlHandling.h"
+
+#include <errno.h>
+#include <semaphore.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <finsdebug.h>
+
+/** the wedge puts one part in each datagram, starting them 4 bytes into the buffer lines the call up on 8 */
+#define NL_RECV_OFFSET 4
+#define NL_RECV_SIZE (NL_PART_SIZE + NLMSG_HDRLEN)
+
+struct nl_link {
+	int fd;
+	struct sockaddr_nl peer;
+	socklen_t peer_len; //0 on a connected socket
+
+	uint8_t *recv_bufs;
+	struct mmsghdr recv_msgs[NL_BATCH];
+	struct iovec recv_iov[NL_BATCH];
+	uint8_t *call_buf; //aligned copy of a call that came in one part
+	uint8_t *msg_buf; //call being put back together
+	ssize_t msg_len;
+	ssize_t msg_got;
+
+	sem_t send_sem;
+	int corked;
+	uint8_t *send_bufs;
+	struct mmsghdr send_msgs[NL_BATCH];
+	struct iovec send_iov[NL_BATCH];
+	int send_num; //datagrams started, the last one can take more
+
+	struct nl_link_stats stats;
+};
+
+#ifdef BUILD_FOR_ANDROID
+//bionic has no recvmmsg()/sendmmsg(), do them a datagram at a time
+static int nl_recvmmsg(int fd, struct mmsghdr *msgs, unsigned int num, int flags) {
+	unsigned int i;
+	ssize_t ret;
+
+	for (i = 0; i < num; i++) {
+		ret = recvmsg(fd, &msgs[i].msg_hdr, i ? flags | MSG_DONTWAIT : flags);
+		if (ret < 0) {
+			return i ? (int) i : -1;
+		}
+		msgs[i].msg_len = ret;
+	}
+	return i;
+}
+
+static int nl_sendmmsg(int fd, struct mmsghdr *msgs, unsigned int num, int flags) {
+	unsigned int i;
+	ssize_t ret;
+
+	for (i = 0; i < num; i++) {
+		ret = sendmsg(fd, &msgs[i].msg_hdr, flags);
+		if (ret < 0) {
+			return i ? (int) i : -1;
+		}
+		msgs[i].msg_len = ret;
+	}
+	return i;
+}
+#else
+#define nl_recvmmsg(fd, msgs, num, flags) recvmmsg(fd, msgs, num, flags, NULL)
+#define nl_sendmmsg(fd, msgs, num, flags) sendmmsg(fd, msgs, num, flags)
+#endif
+
+struct nl_link *nl_link_create(int fd, struct sockaddr_nl *peer) {
+	struct nl_link *link;
+	int i;
+
+	link = (struct nl_link *) calloc(1, sizeof(struct nl_link));
+	if (link == NULL) {
+		PRINT_ERROR("nl_link alloc fail");
+		exit(-1);
+	}
+	link->fd = fd;
+	if (peer != NULL) {
+		link->peer = *peer;
+		link->peer_len = sizeof(struct sockaddr_nl);
+	}
+
+	link->recv_bufs = (uint8_t *) malloc(NL_BATCH * (NL_RECV_SIZE + 8));
+	link->call_buf = (uint8_t *) malloc(NL_PART_SIZE);
+	link->send_bufs = (uint8_t *) malloc(NL_BATCH * NL_SEND_SIZE);
+	if (link->recv_bufs == NULL || link->call_buf == NULL || link->send_bufs == NULL) {
+		PRINT_ERROR("nl_link alloc fail");
+		exit(-1);
+	}
+
+	for (i = 0; i < NL_BATCH; i++) {
+		link->recv_iov[i].iov_base = link->recv_bufs + i * (NL_RECV_SIZE + 8) + NL_RECV_OFFSET;
+		link->recv_iov[i].iov_len = NL_RECV_SIZE;
+		link->recv_msgs[i].msg_hdr.msg_iov = &link->recv_iov[i];
+		link->recv_msgs[i].msg_hdr.msg_iovlen = 1;
+
+		link->send_iov[i].iov_base = link->send_bufs + i * NL_SEND_SIZE;
+		link->send_msgs[i].msg_hdr.msg_iov = &link->send_iov[i];
+		link->send_msgs[i].msg_hdr.msg_iovlen = 1;
+		if (link->peer_len) {
+			link->send_msgs[i].msg_hdr.msg_name = (void *) &link->peer;
+			link->send_msgs[i].msg_hdr.msg_namelen = link->peer_len;
+		}
+	}
+
+	link->msg_len = -1;
+	sem_init(&link->send_sem, 0, 1);
+	return link;
+}
+
+void nl_link_free(struct nl_link *link) {
+	free(link->recv_bufs);
+	free(link->call_buf);
+	free(link->send_bufs);
+	if (link->msg_buf != NULL) {
+		free(link->msg_buf);
+	}
+	sem_destroy(&link->send_sem);
+	free(link);
+}
+
+void nl_link_stats(struct nl_link *link, struct nl_link_stats *stats) {
+	sem_wait(&link->send_sem);
+	*stats = link->stats;
+	sem_post(&link->send_sem);
+}
+
+static void nl_link_drop(struct nl_link *link) {
+	if (link->msg_buf != NULL) {
+		free(link->msg_buf);
+		link->msg_buf = NULL;
+	}
+	link->msg_len = -1;
+}
+
+/** puts one part where it goes in the call, returns the call once its last part is in */
+static uint8_t *nl_link_part(struct nl_link *link, struct nlmsghdr *nlh, ssize_t *len) {
+	uint8_t *pt = (uint8_t *) NLMSG_DATA(nlh);
+	ssize_t nl_len = NLMSG_PAYLOAD(nlh, 0);
+	ssize_t msg_len;
+	ssize_t part_len;
+	int pos;
+
+	switch (nlh->nlmsg_type) {
+	case NLMSG_NOOP:
+		return NULL;
+	case NLMSG_ERROR:
+	case NLMSG_OVERRUN:
+		PRINT_ERROR("nlmsg_type=%u, dropping call", nlh->nlmsg_type);
+		nl_link_drop(link);
+		return NULL;
+	default:
+		break;
+	}
+
+	if (nl_len < (ssize_t) NL_PART_HDR_SIZE) {
+		PRINT_ERROR("part too short: nl_len=%d", (int) nl_len);
+		return NULL;
+	}
+	//the header sits 4 off the call's alignment
+	memcpy(&msg_len, pt, sizeof(ssize_t));
+	memcpy(&part_len, pt + sizeof(ssize_t), sizeof(ssize_t));
+	memcpy(&pos, pt + 2 * sizeof(ssize_t), sizeof(int));
+	pt += NL_PART_HDR_SIZE;
+
+	if (part_len < 0 || part_len > nl_len - (ssize_t) NL_PART_HDR_SIZE || pos < 0 || pos + part_len > msg_len) {
+		PRINT_ERROR("bad part: msg_len=%d, part_len=%d, pos=%d, nl_len=%d", (int) msg_len, (int) part_len, pos, (int) nl_len);
+		nl_link_drop(link);
+		return NULL;
+	}
+
+	if (nlh->nlmsg_seq == 0 && nlh->nlmsg_type == NLMSG_DONE && part_len == msg_len) {
+		//all in one part, the usual case, no reassembly. The wedge only serializes calls that need several
+		//parts, so one of these can come between the parts of another call
+		*len = msg_len;
+		if (((uintptr_t) pt & 7) == 0) {
+			return pt;
+		}
+		memcpy(link->call_buf, pt, msg_len);
+		return link->call_buf;
+	}
+
+	if (nlh->nlmsg_seq == 0) {
+		if (link->msg_len != -1) {
+			PRINT_ERROR("new call before the last one was done, dropping it");
+			nl_link_drop(link);
+		}
+
+		link->msg_buf = (uint8_t *) malloc(msg_len);
+		if (link->msg_buf == NULL) {
+			PRINT_ERROR("msg buffer allocation failed");
+			exit(-1);
+		}
+		link->msg_len = msg_len;
+		link->msg_got = 0;
+	}
+
+	if (link->msg_len != msg_len) {
+		PRINT_ERROR("part of another call: msg_len=%d, part msg_len=%d", (int) link->msg_len, (int) msg_len);
+		nl_link_drop(link);
+		return NULL;
+	}
+
+	memcpy(link->msg_buf + pos, pt, part_len);
+	link->msg_got += part_len;
+
+	if (nlh->nlmsg_type != NLMSG_DONE) {
+		return NULL;
+	}
+	if (link->msg_got != link->msg_len) {
+		PRINT_ERROR("parts missing: msg_len=%d, got=%d", (int) link->msg_len, (int) link->msg_got);
+		nl_link_drop(link);
+		return NULL;
+	}
+	*len = link->msg_len;
+	return link->msg_buf;
+}
+
+int nl_link_recv(struct nl_link *link, int timeout, void (*call)(void *arg, uint8_t *msg, ssize_t len), void *arg) {
+	struct pollfd fds;
+	struct nlmsghdr *nlh;
+	uint8_t *msg;
+	ssize_t msg_len;
+	int remaining;
+	int calls = 0;
+	int n;
+	int i;
+
+	fds.fd = link->fd;
+	fds.events = POLLIN;
+	fds.revents = 0;
+	n = poll(&fds, 1, timeout);
+	if (n <= 0) {
+		return (n == 0 || errno == EINTR) ? 0 : -1;
+	}
+
+	n = nl_recvmmsg(link->fd, link->recv_msgs, NL_BATCH, MSG_DONTWAIT);
+	if (n < 0) {
+		return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+	}
+	link->stats.recv_batches++;
+	link->stats.recv_dgrams += n;
+
+	nl_link_cork(link);
+	for (i = 0; i < n; i++) {
+		nlh = (struct nlmsghdr *) link->recv_iov[i].iov_base;
+		remaining = (int) link->recv_msgs[i].msg_len;
+		if (link->recv_msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+			PRINT_ERROR("datagram truncated: len=%d", remaining);
+		}
+
+		for (; NLMSG_OK(nlh, remaining); nlh = NLMSG_NEXT(nlh, remaining)) {
+			msg = nl_link_part(link, nlh, &msg_len);
+			if (msg != NULL) {
+				call(arg, msg, msg_len);
+				calls++;
+				if (msg == link->msg_buf) {
+					nl_link_drop(link);
+				}
+			}
+		}
+	}
+	link->stats.recv_calls += calls;
+
+	if (nl_link_uncork(link)) {
+		return -1;
+	}
+	return calls;
+}
+
+/** called with send_sem held */
+static int nl_link_flush(struct nl_link *link) {
+	int sent = 0;
+	int ret;
+
+	while (sent < link->send_num) {
+		ret = nl_sendmmsg(link->fd, link->send_msgs + sent, link->send_num - sent, 0);
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			PRINT_ERROR("sendmmsg error: errno=%d", errno);
+			link->send_num = 0;
+			return -1;
+		}
+		sent += ret;
+	}
+	link->stats.send_dgrams += sent;
+	link->send_num = 0;
+	return 0;
+}
+
+int nl_link_send(struct nl_link *link, uint8_t *buf, size_t len, int flags) {
+	struct nlmsghdr *nlh;
+	struct nlmsghdr hdr;
+	struct iovec iov[2];
+	struct msghdr msg;
+	size_t space = NLMSG_SPACE(len);
+	int ret = 0;
+
+	sem_wait(&link->send_sem);
+	link->stats.send_msgs++;
+
+	if (space > NL_SEND_SIZE) {
+		//too big to pack, goes on its own straight from buf
+		ret = nl_link_flush(link);
+
+		memset(&hdr, 0, sizeof(struct nlmsghdr));
+		hdr.nlmsg_len = NLMSG_LENGTH(len);
+		hdr.nlmsg_pid = getpid();
+		hdr.nlmsg_flags = flags;
+		iov[0].iov_base = (void *) &hdr;
+		iov[0].iov_len = NLMSG_HDRLEN;
+		iov[1].iov_base = (void *) buf;
+		iov[1].iov_len = len;
+
+		memset(&msg, 0, sizeof(struct msghdr));
+		if (link->peer_len) {
+			msg.msg_name = (void *) &link->peer;
+			msg.msg_namelen = link->peer_len;
+		}
+		msg.msg_iov = iov;
+		msg.msg_iovlen = 2;
+
+		if (sendmsg(link->fd, &msg, 0) == -1) {
+			PRINT_ERROR("sendmsg error: errno=%d", errno);
+			ret = -1;
+		} else {
+			link->stats.send_dgrams++;
+		}
+		sem_post(&link->send_sem);
+		return ret;
+	}
+
+	if (link->send_num == 0 || link->send_iov[link->send_num - 1].iov_len + space > NL_SEND_SIZE) {
+		if (link->send_num == NL_BATCH) {
+			ret = nl_link_flush(link);
+		}
+		link->send_iov[link->send_num++].iov_len = 0;
+	}
+
+	nlh = (struct nlmsghdr *) ((uint8_t *) link->send_iov[link->send_num - 1].iov_base + link->send_iov[link->send_num - 1].iov_len);
+	nlh->nlmsg_len = NLMSG_LENGTH(len);
+	nlh->nlmsg_type = 0;
+	nlh->nlmsg_seq = 0;
+	nlh->nlmsg_pid = getpid();
+	nlh->nlmsg_flags = flags;
+	memcpy(NLMSG_DATA(nlh), buf, len);
+	link->send_iov[link->send_num - 1].iov_len += space;
+
+	if (link->corked == 0) {
+		ret = nl_link_flush(link);
+	}
+	sem_post(&link->send_sem);
+	return ret;
+}
+
+void nl_link_cork(struct nl_link *link) {
+	sem_wait(&link->send_sem);
+	link->corked++;
+	sem_post(&link->send_sem);
+}
+
+int nl_link_uncork(struct nl_link *link) {
+	int ret = 0;
+
+	sem_wait(&link->send_sem);
+	if (--link->corked == 0 && link->send_num > 0) {
+		ret = nl_link_flush(link);
+	}
+	sem_post(&link->send_sem);
+	return ret;
+}
@@ -0,0 +1,77 @@
+/*
+ * nlHandling.h
+ *
+ *  Created on: Oct 18, 2026
+ *      @brief the netlink link between the daemon and the wedge. Calls come in with recvmmsg(), a batch
+ *      of datagrams at a time, and a call the wedge split into parts is put back together. Replies are
+ *      packed several to a datagram while the link is corked and go out with one sendmmsg() when it is
+ *      uncorked. Nothing here knows about sockets or calls, so it runs as well over a socketpair.
+ */
+
+#ifndef NLHANDLING_H_
+#define NLHANDLING_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+
+struct nl_wedge_to_daemon {
+	uint64_t sock_id;
+	int sock_index;
+
+	uint32_t call_type;
+	int call_pid;
+
+	uint32_t call_id;
+	int call_index;
+};
+
+struct nl_daemon_to_wedge {
+	uint32_t call_type;
+
+	union {
+		uint32_t call_id;
+		uint64_t sock_id; //TODO currently unused, remove if never needed
+	};
+	union {
+		int call_index;
+		int sock_index; //TODO currently unused, remove if never needed
+	};
+
+	uint32_t ret;
+	uint32_t msg;
+};
+
+/** each part from the wedge starts with the call length, the part length and where the part goes */
+#define NL_PART_HDR_SIZE (2 * sizeof(ssize_t) + sizeof(int))
+#define NL_PART_SIZE 16384 //largest part the wedge sends, header included, RECV_BUFFER_SIZE in the wedge
+#define NL_SEND_SIZE 16384 //replies are packed into datagrams up to this, bigger ones go alone
+#define NL_BATCH 32 //datagrams per recvmmsg()/sendmmsg()
+
+struct nl_link;
+
+struct nl_link_stats {
+	uint64_t recv_batches;
+	uint64_t recv_dgrams;
+	uint64_t recv_calls;
+	uint64_t send_dgrams;
+	uint64_t send_msgs;
+};
+
+/** wraps fd, which stays the caller's to close. Replies go to peer or, if it is NULL, to whatever fd is connected to */
+struct nl_link *nl_link_create(int fd, struct sockaddr_nl *peer);
+void nl_link_free(struct nl_link *link);
+void nl_link_stats(struct nl_link *link, struct nl_link_stats *stats);
+
+/** waits up to timeout ms for a batch and calls call() for each complete call in it, with the link
+ * corked. msg is only good until call() returns. Returns the calls handed over, -1 on error */
+int nl_link_recv(struct nl_link *link, int timeout, void (*call)(void *arg, uint8_t *msg, ssize_t len), void *arg);
+
+/** sends len bytes as one netlink message, queued while the link is corked. Returns 0, -1 on error */
+int nl_link_send(struct nl_link *link, uint8_t *buf, size_t len, int flags);
+
+void nl_link_cork(struct nl_link *link);
+int nl_link_uncork(struct nl_link *link);
+
+#endif /* NLHANDLING_H_ */
@@ -0,0 +1,88 @@
+/*
+ * ringHandling.c
+ *
+ *  Created on: Oct 18, 2026
+ *      @brief the payload rings shared with the wedge, see ringHandling.h
+ */
+
+#include "ringHandling.h"
+
+#include <string.h>
+
+#define RING_ALIGN(len) (((len) + 7) & ~7u)
+
+void ring_init(struct fins_ring *ring, uint8_t *data) {
+	ring->data = data;
+	ring->head = 0;
+	ring->tail = 0;
+	ring->owner = 0;
+}
+
+/** takes back every chunk at the tail the consumer is done with */
+static void ring_reclaim(struct fins_ring *ring) {
+	struct fins_ring_chunk *chunk;
+	uint32_t state;
+
+	while (ring->tail != ring->head) {
+		chunk = (struct fins_ring_chunk *) (ring->data + (ring->tail & (FINS_RING_SIZE - 1)));
+		state = __atomic_load_n(&chunk->state, __ATOMIC_ACQUIRE);
+		if (state != FINS_CHUNK_DONE && state != FINS_CHUNK_SKIP) {
+			break;
+		}
+		ring->tail += chunk->space;
+	}
+}
+
+int ring_put(struct fins_ring *ring, uint8_t *buf, uint32_t len) {
+	struct fins_ring_chunk *chunk;
+	uint32_t need = sizeof(struct fins_ring_chunk) + RING_ALIGN(len);
+	uint32_t pos;
+	uint32_t pad;
+
+	if (need > FINS_RING_SIZE / 2) {
+		return -1;
+	}
+
+	ring_reclaim(ring);
+	pos = ring->head & (FINS_RING_SIZE - 1);
+	if (pos + need > FINS_RING_SIZE) {
+		//payloads are never split, pad out the end and start over at 0
+		pad = FINS_RING_SIZE - pos;
+		if (ring->head - ring->tail + pad + need > FINS_RING_SIZE) {
+			return -1;
+		}
+		chunk = (struct fins_ring_chunk *) (ring->data + pos);
+		chunk->space = pad;
+		chunk->state = FINS_CHUNK_SKIP;
+		ring->head += pad;
+		pos = 0;
+	} else if (ring->head - ring->tail + need > FINS_RING_SIZE) {
+		return -1;
+	}
+
+	chunk = (struct fins_ring_chunk *) (ring->data + pos);
+	chunk->space = need;
+	memcpy(ring->data + pos + sizeof(struct fins_ring_chunk), buf, len);
+	__atomic_store_n(&chunk->state, FINS_CHUNK_BUSY, __ATOMIC_RELEASE);
+	ring->head += need;
+	return (int) pos;
+}
+
+uint8_t *ring_get(uint8_t *data, int where, uint32_t len) {
+	struct fins_ring_chunk *chunk;
+
+	if (where < 0 || (where & 7) || (uint32_t) where + sizeof(struct fins_ring_chunk) + len > FINS_RING_SIZE) {
+		return NULL;
+	}
+	chunk = (struct fins_ring_chunk *) (data + where);
+	if (__atomic_load_n(&chunk->state, __ATOMIC_ACQUIRE) != FINS_CHUNK_BUSY || chunk->space < sizeof(struct fins_ring_chunk) + len) {
+		return NULL;
+	}
+	return data + where + sizeof(struct fins_ring_chunk);
+}
+
+void ring_done(uint8_t *data, int where) {
+	struct fins_ring_chunk *chunk = (struct fins_ring_chunk *) (data + where);
+
+	__atomic_store_n(&chunk->state, FINS_CHUNK_DONE, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,54 @@
+/*
+ * ringHandling.h
+ *
+ *  Created on: Oct 18, 2026
+ *      @brief the payload rings shared with the wedge. The wedge exports FINS_RING_SLOTS slots through
+ *      FINS_RING_DEV, each with a ring of sendmsg data going to the daemon and one of recvmsg data coming
+ *      back. A socket moving bulk data gets a slot, and its calls then carry (where, len) in place of the
+ *      payload, so the bytes skip the skb and the netlink buffers. The layout must match fins_stack_wedge.h.
+ */
+
+#ifndef RINGHANDLING_H_
+#define RINGHANDLING_H_
+
+#include <stdint.h>
+
+#define FINS_RING_DEV "/dev/fins_ring"
+#define FINS_RING_SLOTS 64
+#define FINS_RING_SIZE (256 * 1024) //per direction, a power of 2
+#define FINS_RING_MIN 512 //payloads smaller than this stay in the netlink message
+
+/** every payload in a ring starts with one of these, on an 8 byte boundary */
+struct fins_ring_chunk {
+	uint32_t space; //bytes to the next chunk, this header included
+	uint32_t state;
+};
+
+#define FINS_CHUNK_BUSY 1 //written by the producer, not read yet
+#define FINS_CHUNK_DONE 2 //the consumer is done with it
+#define FINS_CHUNK_SKIP 3 //padding to the end of the ring
+
+struct fins_ring_slot {
+	uint8_t tx[FINS_RING_SIZE]; //wedge to daemon
+	uint8_t rx[FINS_RING_SIZE]; //daemon to wedge
+};
+
+/** producer side of one ring, kept by whichever end writes it. Only the producer moves head and tail,
+ * the consumer just marks chunks done, so nothing it writes can throw the producer off */
+struct fins_ring {
+	uint8_t *data;
+	uint32_t head; //free running, where the next chunk goes
+	uint32_t tail; //free running, oldest chunk not given back yet
+	uint64_t owner; //sock_id the ring was last written for
+};
+
+void ring_init(struct fins_ring *ring, uint8_t *data);
+
+/** copies len bytes into the ring, returns where the chunk starts or -1 when there isn't room */
+int ring_put(struct fins_ring *ring, uint8_t *buf, uint32_t len);
+
+/** the consumer's side: the payload of the chunk at where, NULL if where and len don't make sense */
+uint8_t *ring_get(uint8_t *data, int where, uint32_t len);
+void ring_done(uint8_t *data, int where);
+
+#endif /* RINGHANDLING_H_ */
@@ -12,7 +12,7 @@
 #define	IP4_PT_TCP		6		/* protocol type for TCP packets	*/
 
 extern sem_t daemon_sockets_sem;
-extern struct daemon_socket daemon_sockets[MAX_SOCKETS];
+extern struct daemon_socket *daemon_sockets;
 
 extern sem_t daemon_calls_sem; //TODO remove?
 extern struct daemon_call daemon_calls[MAX_CALLS];
@@ -140,7 +140,7 @@ void bind_out_tcp(struct nl_wedge_to_daemon *hdr, struct sockaddr_in *addr) {
 	/** check if the same port and address have been both used earlier or not
 	 * it returns (-1) in case they already exist, so that we should not reuse them
 	 * */
-	if (!daemon_sockets_check_ports(host_port, host_ip) && !daemon_sockets[hdr->sock_index].sockopts.FSO_REUSEADDR) { //TODO change, need to check if in TIME_WAIT state
+	if (!daemon_sockets_check_ports(host_port, host_ip, IPPROTO_TCP) && !daemon_sockets[hdr->sock_index].sockopts.FSO_REUSEADDR) { //TODO change, need to check if in TIME_WAIT state
 		PRINT_ERROR("this port is not free");
 		PRINT_DEBUG("post$$$$$$$$$$$$$$$");
 		sem_post(&daemon_sockets_sem);
@@ -155,12 +155,10 @@ void bind_out_tcp(struct nl_wedge_to_daemon *hdr, struct sockaddr_in *addr) {
 	 */
 
 	if (host_ip == any_ip_addr) {
-		daemon_sockets[hdr->sock_index].host_ip = my_host_ip_addr;
+		daemon_sockets_set_host(hdr->sock_index, my_host_ip_addr, host_port);
 	} else {
-		daemon_sockets[hdr->sock_index].host_ip = host_ip;
+		daemon_sockets_set_host(hdr->sock_index, host_ip, host_port);
 	}
-
-	daemon_sockets[hdr->sock_index].host_port = host_port;
 	PRINT_DEBUG("bind address: host=%u:%u (%u)", daemon_sockets[hdr->sock_index].host_ip, host_port, htonl(daemon_sockets[hdr->sock_index].host_ip));
 	PRINT_DEBUG("post$$$$$$$$$$$$$$$");
 	sem_post(&daemon_sockets_sem);
@@ -182,6 +180,7 @@ void bind_out_tcp(struct nl_wedge_to_daemon *hdr, struct sockaddr_in *addr) {
 void listen_out_tcp(struct nl_wedge_to_daemon *hdr, int backlog) {
 	uint32_t host_ip;
 	uint32_t host_port;
+	char congestion[DAEMON_CONG_NAME_MAX];
 
 	PRINT_DEBUG("Entered: hdr=%p, backlog=%d", hdr, backlog);
 
@@ -207,6 +206,7 @@ void listen_out_tcp(struct nl_wedge_to_daemon *hdr, int backlog) {
 
 	host_ip = daemon_sockets[hdr->sock_index].host_ip;
 	host_port = daemon_sockets[hdr->sock_index].host_port;
+	strcpy(congestion, daemon_sockets[hdr->sock_index].sockopts.FTCP_CONGESTION);
 	PRINT_DEBUG("");
 	PRINT_DEBUG("post$$$$$$$$$$$$$$$");
 	sem_post(&daemon_sockets_sem);
@@ -231,6 +231,9 @@ void listen_out_tcp(struct nl_wedge_to_daemon *hdr, int backlog) {
 	metadata_writeToElement(params, "state", &state, META_TYPE_INT32);
 	metadata_writeToElement(params, "host_ip", &host_ip, META_TYPE_INT32);
 	metadata_writeToElement(params, "host_port", &host_port, META_TYPE_INT32);
+	if (congestion[0] != '\0') {
+		metadata_writeToElement(params, "congestion", congestion, META_TYPE_STRING);
+	}
 
 	if (daemon_fcf_to_tcp(params, gen_control_serial_num(), CTRL_EXEC, EXEC_TCP_LISTEN)) {
 		ack_send(hdr->call_id, hdr->call_index, hdr->call_type, 0);
@@ -370,8 +373,7 @@ void connect_out_tcp(struct nl_wedge_to_daemon *hdr, struct sockaddr_in *addr, i
 	//if statements make sure socket is in SS_UNCONNECTED
 	daemon_sockets[hdr->sock_index].state = SS_CONNECTING;
 	daemon_sockets[hdr->sock_index].listening = 0;
-	daemon_sockets[hdr->sock_index].dst_ip = rem_ip;
-	daemon_sockets[hdr->sock_index].dst_port = rem_port;
+	daemon_sockets_set_dst(hdr->sock_index, rem_ip, rem_port);
 	uint32_t state = daemon_sockets[hdr->sock_index].state;
 
 	/**
@@ -379,7 +381,7 @@ void connect_out_tcp(struct nl_wedge_to_daemon *hdr, struct sockaddr_in *addr, i
 	 * the current IP using the IPv4 modules unless a binding has occured earlier
 	 */
 	if (daemon_sockets[hdr->sock_index].host_ip == any_ip_addr) { //TODO change this when have multiple interfaces
-		daemon_sockets[hdr->sock_index].host_ip = my_host_ip_addr;
+		daemon_sockets_set_host(hdr->sock_index, my_host_ip_addr, daemon_sockets[hdr->sock_index].host_port);
 	}
 	host_ip = daemon_sockets[hdr->sock_index].host_ip;
 
@@ -393,15 +395,17 @@ void connect_out_tcp(struct nl_wedge_to_daemon *hdr, struct sockaddr_in *addr, i
 	 */
 	host_port = daemon_sockets[hdr->sock_index].host_port;
 	if (host_port == 0) {
-		PRINT_DEBUG("");
-		while (1) {
-			host_port = (uint16_t) randoming(MIN_port, MAX_port);
-			if (daemon_sockets_check_ports(host_port, host_ip)) {
-				break;
-			}
+		host_port = daemon_sockets_ephemeral(IPPROTO_TCP);
+		if (host_port == 0) {
+			daemon_sockets[hdr->sock_index].state = SS_UNCONNECTED;
+			PRINT_DEBUG("post$$$$$$$$$$$$$$$");
+			sem_post(&daemon_sockets_sem);
+
+			nack_send(hdr->call_id, hdr->call_index, hdr->call_type, EADDRNOTAVAIL);
+			free(addr);
+			return;
 		}
-		PRINT_DEBUG("");
-		daemon_sockets[hdr->sock_index].host_port = host_port;
+		daemon_sockets_set_host(hdr->sock_index, host_ip, host_port);
 	}
 
 	/** Reverse again because it was reversed by the application itself
@@ -429,6 +433,9 @@ void connect_out_tcp(struct nl_wedge_to_daemon *hdr, struct sockaddr_in *addr, i
 	metadata_writeToElement(params, "host_port", &host_port, META_TYPE_INT32);
 	metadata_writeToElement(params, "rem_ip", &rem_ip, META_TYPE_INT32);
 	metadata_writeToElement(params, "rem_port", &rem_port, META_TYPE_INT32);
+	if (daemon_sockets[hdr->sock_index].sockopts.FTCP_CONGESTION[0] != '\0') {
+		metadata_writeToElement(params, "congestion", daemon_sockets[hdr->sock_index].sockopts.FTCP_CONGESTION, META_TYPE_STRING);
+	}
 
 	uint32_t serial_num = gen_control_serial_num();
 	if (daemon_fcf_to_tcp(params, serial_num, CTRL_EXEC, EXEC_TCP_CONNECT)) {
@@ -711,7 +718,7 @@ void getname_out_tcp(struct nl_wedge_to_daemon *hdr, int peer) {
 	}
 
 	PRINT_DEBUG("msg_len=%d, msg='%s'", msg_len, msg);
-	if (send_wedge(nl_sockfd, msg, msg_len, 0)) {
+	if (send_wedge(msg, msg_len, 0)) {
 		PRINT_ERROR("Exited: fail send_wedge: hdr=%p", hdr);
 		nack_send(hdr->call_id, hdr->call_index, hdr->call_type, 0);
 	} else {
@@ -832,7 +839,7 @@ void ioctl_out_tcp(struct nl_wedge_to_daemon *hdr, uint32_t cmd, uint8_t *buf, s
 
 	PRINT_DEBUG("msg_len=%d, msg='%s'", msg_len, msg);
 	if (msg_len) {
-		if (send_wedge(nl_sockfd, msg, msg_len, 0)) {
+		if (send_wedge(msg, msg_len, 0)) {
 			PRINT_ERROR("Exited: fail send_wedge: hdr=%p", hdr);
 			nack_send(hdr->call_id, hdr->call_index, hdr->call_type, 0);
 		} else {
@@ -931,6 +938,10 @@ void sendmsg_out_tcp(struct nl_wedge_to_daemon *hdr, uint8_t *data, uint32_t dat
 	dst_port = daemon_sockets[hdr->sock_index].dst_port;
 	dst_ip = daemon_sockets[hdr->sock_index].dst_ip;
 
+	//this may fill the window, until TCP says otherwise the wedge can't count on POLLOUT
+	daemon_sockets[hdr->sock_index].ready_tcp = 0;
+	daemon_ready_update(hdr->sock_index);
+
 	/**
 	 * Default current host port is supposed to be randomly selected from the range found in
 	 * /proc/sys/net/ipv4/ip_local_port_range
@@ -1071,6 +1082,7 @@ void recvmsg_out_tcp(struct nl_wedge_to_daemon *hdr, int data_len, uint32_t msg_
 			}
 
 			daemon_sockets[hdr->sock_index].data_buf -= ff->dataFrame.pduLength;
+			daemon_ready_update(hdr->sock_index);
 			PRINT_DEBUG("after: sock_index=%d, data_buf=%d", hdr->sock_index, daemon_sockets[hdr->sock_index].data_buf);
 
 			uint32_t state = daemon_sockets[hdr->sock_index].state;
@@ -1190,7 +1202,8 @@ void recvmsg_out_tcp(struct nl_wedge_to_daemon *hdr, int data_len, uint32_t msg_
 
 			int addr_len = sizeof(struct sockaddr_in);
 
-			int msg_len = sizeof(struct nl_daemon_to_wedge) + 3 * sizeof(int) + addr_len + ff->dataFrame.pduLength + control_len;
+			int where = daemon_ring_put(hdr->sock_index, ff->dataFrame.pdu, ff->dataFrame.pduLength);
+			int msg_len = sizeof(struct nl_daemon_to_wedge) + 4 * sizeof(int) + addr_len + (where == -1 ? ff->dataFrame.pduLength : 0) + control_len;
 			uint8_t *msg = (uint8_t *) malloc(msg_len);
 			if (msg == NULL) {
 				PRINT_ERROR("ERROR: buf alloc fail");
@@ -1214,8 +1227,13 @@ void recvmsg_out_tcp(struct nl_wedge_to_daemon *hdr, int data_len, uint32_t msg_
 			*(int *) pt = ff->dataFrame.pduLength;
 			pt += sizeof(int);
 
-			memcpy(pt, ff->dataFrame.pdu, ff->dataFrame.pduLength);
-			pt += ff->dataFrame.pduLength;
+			*(int *) pt = where;
+			pt += sizeof(int);
+
+			if (where == -1) {
+				memcpy(pt, ff->dataFrame.pdu, ff->dataFrame.pduLength);
+				pt += ff->dataFrame.pduLength;
+			}
 
 			*(int *) pt = control_len;
 			pt += sizeof(int);
@@ -1233,9 +1251,10 @@ void recvmsg_out_tcp(struct nl_wedge_to_daemon *hdr, int data_len, uint32_t msg_
 			}
 
 			PRINT_DEBUG("msg_len=%d, msg='%s'", msg_len, msg);
-			if (send_wedge(nl_sockfd, msg, msg_len, 0)) {
+			if (send_wedge(msg, msg_len, 0)) {
 				PRINT_ERROR("Exited: fail send_wedge: hdr=%p", hdr);
 				nack_send(hdr->call_id, hdr->call_index, hdr->call_type, 0);
+				daemon_ring_drop(hdr->sock_index, where);
 			} else {
 //TODO send size back to TCP handlers
 //if (state > SS_UNCONNECTED) { //shouldn't be able to get data if not connected
@@ -1963,7 +1982,7 @@ void getsockopt_out_tcp(struct nl_wedge_to_daemon *hdr, int level, int optname,
 		}
 
 		PRINT_DEBUG("msg_len=%d, msg='%s'", msg_len, msg);
-		if (send_wedge(nl_sockfd, msg, msg_len, 0)) {
+		if (send_wedge(msg, msg_len, 0)) {
 			PRINT_ERROR("Exited: fail send_wedge: hdr=%p", hdr);
 			nack_send(hdr->call_id, hdr->call_index, hdr->call_type, 0);
 		} else {
@@ -1998,6 +2017,19 @@ void getsockopt_out_tcp(struct nl_wedge_to_daemon *hdr, int level, int optname,
 	}
 }
 
+/** 1 if TCP has a congestion control by that name, the daemon doesn't link tcp_cong.c so it keeps its own list */
+static int tcp_cong_known(char *name) {
+	char *names[] = TCP_CONG_NAMES;
+	int i;
+
+	for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+		if (strcmp(names[i], name) == 0) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
 void setsockopt_out_tcp(struct nl_wedge_to_daemon *hdr, int level, int optname, int optlen, uint8_t *optval) {
 	uint32_t state;
 	uint32_t host_ip;
@@ -2040,8 +2072,9 @@ void setsockopt_out_tcp(struct nl_wedge_to_daemon *hdr, int level, int optname,
 	metadata_create(params);
 
 	int send_dst = -1;
-	//int len = 0;
+	int len = 0;
 	//uint8_t *val = NULL;
+	char congestion[DAEMON_CONG_NAME_MAX];
 
 	uint32_t param_id = optname;
 
@@ -2065,6 +2098,32 @@ void setsockopt_out_tcp(struct nl_wedge_to_daemon *hdr, int level, int optname,
 		switch (optname) {
 		case TCP_NODELAY:
 			break;
+		case TCP_CONGESTION:
+			if (optlen > 0) {
+				len = optlen < DAEMON_CONG_NAME_MAX ? optlen : DAEMON_CONG_NAME_MAX - 1;
+				memcpy(congestion, optval, len);
+				congestion[len] = '\0';
+
+				if (!tcp_cong_known(congestion)) {
+					PRINT_ERROR("unknown congestion control: congestion='%s'", congestion);
+					PRINT_DEBUG("post$$$$$$$$$$$$$$$");
+					sem_post(&daemon_sockets_sem);
+
+					metadata_destroy(params);
+					nack_send(hdr->call_id, hdr->call_index, hdr->call_type, ENOENT);
+					return;
+				}
+				strcpy(daemon_sockets[hdr->sock_index].sockopts.FTCP_CONGESTION, congestion);
+
+				if (state > SS_UNCONNECTED || daemon_sockets[hdr->sock_index].listening) {
+					param_id = SET_PARAM_TCP_CONGESTION;
+					metadata_writeToElement(params, "congestion", daemon_sockets[hdr->sock_index].sockopts.FTCP_CONGESTION, META_TYPE_STRING);
+					send_dst = 1;
+				} else {
+					send_dst = 0; //goes with connect/listen
+				}
+			}
+			break;
 		default:
 			break;
 		}
@@ -2186,6 +2245,7 @@ void setsockopt_out_tcp(struct nl_wedge_to_daemon *hdr, int level, int optname,
 		if (daemon_fcf_to_tcp(params, serial_num, CTRL_SET_PARAM, param_id)) {
 			if (daemon_calls_insert(hdr->call_id, hdr->call_index, hdr->call_pid, hdr->call_type, hdr->sock_id, hdr->sock_index)) {
 				daemon_calls[hdr->call_index].serial_num = serial_num;
+				daemon_calls[hdr->call_index].data = param_id; //checked against the reply
 
 				PRINT_DEBUG("");
 				PRINT_DEBUG("post$$$$$$$$$$$$$$$");
@@ -2333,10 +2393,8 @@ void accept_in_tcp(struct finsFrame *ff, uint32_t call_id, int call_index, uint3
 	if (ff->ctrlFrame.ret_val) {
 		if (daemon_sockets_insert(sock_id_new, sock_index_new, daemon_sockets[sock_index].type, daemon_sockets[sock_index].protocol)) {
 			daemon_sockets[sock_index_new].state = SS_CONNECTED;
-			daemon_sockets[sock_index_new].host_ip = daemon_sockets[sock_index].host_ip;
-			daemon_sockets[sock_index_new].host_port = daemon_sockets[sock_index].host_port;
-			daemon_sockets[sock_index_new].dst_ip = rem_ip;
-			daemon_sockets[sock_index_new].dst_port = (uint16_t) rem_port;
+			daemon_sockets_set_host(sock_index_new, daemon_sockets[sock_index].host_ip, daemon_sockets[sock_index].host_port);
+			daemon_sockets_set_dst(sock_index_new, rem_ip, (uint16_t) rem_port);
 
 			PRINT_DEBUG("Accept socket created: sock_id=%llu, sock_index=%d, state=%u, host=%u/%u, dst=%u/%u",
 					daemon_sockets[sock_index_new].sock_id, sock_index_new, daemon_sockets[sock_index_new].state, daemon_sockets[sock_index_new].host_ip, daemon_sockets[sock_index_new].host_port, daemon_sockets[sock_index_new].dst_ip, daemon_sockets[sock_index_new].dst_port);
@@ -2478,7 +2536,7 @@ void getsockopt_in_tcp(struct finsFrame *ff, uint32_t call_id, int call_index, u
 		}
 
 		PRINT_DEBUG("msg_len=%d, msg='%s'", msg_len, msg);
-		if (send_wedge(nl_sockfd, msg, msg_len, 0)) {
+		if (send_wedge(msg, msg_len, 0)) {
 			PRINT_ERROR("Exited: fail send_wedge: ff=%p", ff);
 			nack_send(call_id, call_index, call_type, 0);
 		} else {
@@ -2576,6 +2634,20 @@ void poll_in_tcp_fcf(struct finsFrame *ff, uint32_t call_id, int call_index, int
 		nack_send(call_id, call_index, call_type, 0);
 	} else {
 		if (ret_msg) {
+			if (ret_msg & (POLLOUT | POLLWRNORM | POLLWRBAND)) {
+				PRINT_DEBUG("wait$$$$$$$$$$$$$$$");
+				if (sem_wait(&daemon_sockets_sem)) {
+					PRINT_ERROR("daemon_sockets_sem wait prob");
+					exit(-1);
+				}
+				if (daemon_sockets[sock_index].sock_id == sock_id) {
+					daemon_sockets[sock_index].ready_tcp = ret_msg & (POLLOUT | POLLWRNORM | POLLWRBAND);
+					daemon_ready_update(sock_index);
+				}
+				PRINT_DEBUG("post$$$$$$$$$$$$$$$");
+				sem_post(&daemon_sockets_sem);
+			}
+
 			ack_send(call_id, call_index, call_type, ret_msg);
 		} else {
 			if (flags) { //flags == initial
@@ -2671,7 +2743,7 @@ void poll_in_tcp_fdf(struct daemon_call_list *call_list, struct daemon_call *cal
 		}
 
 		PRINT_DEBUG("msg_len=%d, msg='%s'", msg_len, msg);
-		if (send_wedge(nl_sockfd, msg, msg_len, 0)) {
+		if (send_wedge(msg, msg_len, 0)) {
 			PRINT_ERROR("Exited: send_wedge error: call=%p", call);
 		} else {
 
@@ -2775,7 +2847,8 @@ void recvmsg_in_tcp_fdf(struct daemon_call_list *call_list, struct daemon_call *
 
 	int addr_len = sizeof(struct sockaddr_in);
 
-	int msg_len = sizeof(struct nl_daemon_to_wedge) + 3 * sizeof(int) + addr_len + data_len + control_len;
+	int where = daemon_ring_put(call->sock_index, data, data_len);
+	int msg_len = sizeof(struct nl_daemon_to_wedge) + 4 * sizeof(int) + addr_len + (where == -1 ? data_len : 0) + control_len;
 	uint8_t *msg = (uint8_t *) malloc(msg_len);
 	if (msg == NULL) {
 		PRINT_ERROR("ERROR: buf alloc fail");
@@ -2799,8 +2872,13 @@ void recvmsg_in_tcp_fdf(struct daemon_call_list *call_list, struct daemon_call *
 	*(int *) pt = data_len;
 	pt += sizeof(int);
 
-	memcpy(pt, data, data_len);
-	pt += data_len;
+	*(int *) pt = where;
+	pt += sizeof(int);
+
+	if (where == -1) {
+		memcpy(pt, data, data_len);
+		pt += data_len;
+	}
 
 	*(int *) pt = control_len;
 	pt += sizeof(int);
@@ -2820,9 +2898,10 @@ void recvmsg_in_tcp_fdf(struct daemon_call_list *call_list, struct daemon_call *
 	}
 
 	PRINT_DEBUG("msg_len=%d, msg='%s'", msg_len, msg);
-	if (send_wedge(nl_sockfd, msg, msg_len, 0)) {
+	if (send_wedge(msg, msg_len, 0)) {
 		PRINT_ERROR("Exited: send_wedge error: call_list=%p, call=%p", call_list, call);
 		nack_send(call->call_id, call->call_index, call->call_type, 0);
+		daemon_ring_drop(call->sock_index, where);
 	} else {
 		//PRINT_DEBUG("before: sock_index=%d, data_buf=%d", hdr->sock_index, daemon_sockets[hdr->sock_index].data_buf);
 		//daemon_sockets[call->sock_index].data_buf -= data_len;
@@ -2938,6 +3017,7 @@ void daemon_tcp_in_fdf(struct finsFrame *ff, uint32_t src_ip, uint32_t dst_ip) {
 
 		if (write_queue(ff, daemon_sockets[sock_index].data_queue)) {
 			daemon_sockets[sock_index].data_buf += ff->dataFrame.pduLength;
+			daemon_ready_update(sock_index);
 
 			int data_buf = daemon_sockets[sock_index].data_buf;
 			PRINT_DEBUG("post$$$$$$$$$$$$$$$");
@@ -3055,6 +3135,9 @@ void daemon_tcp_in_poll(struct finsFrame *ff, uint32_t ret_msg) {
 		PRINT_DEBUG( "Matched: sock_id=%llu, sock_index=%d, host=%u/%u, dst=%u/%u, prot=%u",
 				daemon_sockets[sock_index].sock_id, sock_index, daemon_sockets[sock_index].host_ip, daemon_sockets[sock_index].host_port, daemon_sockets[sock_index].dst_ip, daemon_sockets[sock_index].dst_port, daemon_sockets[sock_index].protocol);
 
+		daemon_sockets[sock_index].ready_tcp = ret_msg & (POLLOUT | POLLWRNORM | POLLWRBAND);
+		daemon_ready_update(sock_index);
+
 		struct daemon_call_list *call_list = daemon_sockets[sock_index].call_list;
 
 		struct daemon_call *call = call_list->front;
@@ -3236,8 +3319,7 @@ void connect_expired_tcp(struct finsFrame *ff, struct daemon_call *call, uint8_t
 		daemon_sockets[call->sock_index].error_call = call->call_type;
 		daemon_sockets[call->sock_index].error_msg = ret_msg;
 
-		daemon_sockets[call->sock_index].host_ip = 0; //TODO don't clear? so that will detect error
-		daemon_sockets[call->sock_index].host_port = 0;
+		daemon_sockets_set_host(call->sock_index, 0, 0); //TODO don't clear? so that will detect error
 
 		PRINT_DEBUG("curr: sock_id=%llu, sock_index=%d, state=%u, host=%u/%u, dst=%u/%u",
 				daemon_sockets[call->sock_index].sock_id, call->sock_index, daemon_sockets[call->sock_index].state, daemon_sockets[call->sock_index].host_ip, daemon_sockets[call->sock_index].host_port, daemon_sockets[call->sock_index].dst_ip, daemon_sockets[call->sock_index].dst_port);
@@ -3313,10 +3395,8 @@ void accept_expired_tcp(struct finsFrame *ff, struct daemon_call *call, uint8_t
 	if (ff->ctrlFrame.ret_val) {
 		if (daemon_sockets_insert(call->sock_id_new, call->sock_index_new, daemon_sockets[call->sock_index].type, daemon_sockets[call->sock_index].protocol)) {
 			daemon_sockets[call->sock_index_new].state = SS_CONNECTED;
-			daemon_sockets[call->sock_index_new].host_ip = daemon_sockets[call->sock_index].host_ip;
-			daemon_sockets[call->sock_index_new].host_port = daemon_sockets[call->sock_index].host_port;
-			daemon_sockets[call->sock_index_new].dst_ip = rem_ip;
-			daemon_sockets[call->sock_index_new].dst_port = (uint16_t) rem_port;
+			daemon_sockets_set_host(call->sock_index_new, daemon_sockets[call->sock_index].host_ip, daemon_sockets[call->sock_index].host_port);
+			daemon_sockets_set_dst(call->sock_index_new, rem_ip, (uint16_t) rem_port);
 
 			PRINT_DEBUG("Accept socket created: sock_id=%llu, sock_index=%d, state=%u, host=%u/%u, dst=%u/%u",
 					daemon_sockets[call->sock_index_new].sock_id, call->sock_index_new, daemon_sockets[call->sock_index_new].state, daemon_sockets[call->sock_index_new].host_ip, daemon_sockets[call->sock_index_new].host_port, daemon_sockets[call->sock_index_new].dst_ip, daemon_sockets[call->sock_index_new].dst_port);
@@ -62,6 +62,9 @@ void accept_expired_tcp(struct finsFrame *ff, struct daemon_call *call, uint8_t
 
 #define SET_PARAM_TCP_HOST_WINDOW 0
 #define SET_PARAM_TCP_SOCK_OPT 1
+#define SET_PARAM_TCP_CONGESTION 2
+
+#define TCP_CONG_NAMES {"reno", "cubic", "bbr"} //as registered in tcp_cong.c, checked before TCP_CONGESTION is stored
 
 #define READ_PARAM_TCP_HOST_WINDOW 0
 #define READ_PARAM_TCP_SOCK_OPT 1
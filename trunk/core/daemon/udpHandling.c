@@ -9,7 +9,7 @@
 #include <finstypes.h>
 
 extern sem_t daemon_sockets_sem;
-extern struct daemon_socket daemon_sockets[MAX_SOCKETS];
+extern struct daemon_socket *daemon_sockets;
 
 extern sem_t daemon_calls_sem; //TODO remove?
 extern struct daemon_call daemon_calls[MAX_CALLS];
@@ -63,6 +63,9 @@ void socket_out_udp(struct nl_wedge_to_daemon *hdr, int domain, int type, int pr
 	}
 	ret = daemon_sockets_insert(hdr->sock_id, hdr->sock_index, type, protocol); //TODO add &udp_ops
 	PRINT_DEBUG("sock_index=%d, ret=%d", hdr->sock_index, ret);
+	if (ret) {
+		daemon_ready_update(hdr->sock_index);
+	}
 	PRINT_DEBUG("post$$$$$$$$$$$$$$$");
 	sem_post(&daemon_sockets_sem);
 
@@ -119,7 +122,7 @@ void bind_out_udp(struct nl_wedge_to_daemon *hdr, struct sockaddr_in *addr) {
 	/** check if the same port and address have been both used earlier or not
 	 * it returns (-1) in case they already exist, so that we should not reuse them
 	 * */
-	if (!daemon_sockets_check_ports(host_port, host_ip) && !daemon_sockets[hdr->sock_index].sockopts.FSO_REUSEADDR) {
+	if (!daemon_sockets_check_ports(host_port, host_ip, IPPROTO_UDP) && !daemon_sockets[hdr->sock_index].sockopts.FSO_REUSEADDR) {
 		PRINT_ERROR("this port is not free");
 		PRINT_DEBUG("post$$$$$$$$$$$$$$$");
 		sem_post(&daemon_sockets_sem);
@@ -132,12 +135,10 @@ void bind_out_udp(struct nl_wedge_to_daemon *hdr, struct sockaddr_in *addr) {
 	/**
 	 * Binding
 	 */
-	daemon_sockets[hdr->sock_index].host_port = host_port;
-
 	if (host_ip == any_ip_addr) { //TODO change this when have multiple interfaces
-		daemon_sockets[hdr->sock_index].host_ip = my_host_ip_addr;
+		daemon_sockets_set_host(hdr->sock_index, my_host_ip_addr, host_port);
 	} else {
-		daemon_sockets[hdr->sock_index].host_ip = host_ip;
+		daemon_sockets_set_host(hdr->sock_index, host_ip, host_port);
 	}
 
 	PRINT_DEBUG("bind: index:%d, host:%u/%u, dst:%u/%u",
@@ -252,8 +253,7 @@ void connect_out_udp(struct nl_wedge_to_daemon *hdr, struct sockaddr_in *addr, i
 	 * any modifications to the contents of the daemonSockets database
 	 */
 	daemon_sockets[hdr->sock_index].state = SS_CONNECTING;
-	daemon_sockets[hdr->sock_index].dst_ip = dst_ip;
-	daemon_sockets[hdr->sock_index].dst_port = dst_port;
+	daemon_sockets_set_dst(hdr->sock_index, dst_ip, dst_port);
 
 	PRINT_DEBUG("curr: sock_id=%llu, sock_index=%d, state=%u, host=%u/%u, dst=%u/%u",
 			daemon_sockets[hdr->sock_index].sock_id, hdr->sock_index, daemon_sockets[hdr->sock_index].state, daemon_sockets[hdr->sock_index].host_ip, daemon_sockets[hdr->sock_index].host_port, daemon_sockets[hdr->sock_index].dst_ip, daemon_sockets[hdr->sock_index].dst_port);
@@ -332,7 +332,7 @@ void getname_out_udp(struct nl_wedge_to_daemon *hdr, int peer) {
 		host_port = daemon_sockets[hdr->sock_index].host_port;
 
 		if (daemon_sockets[hdr->sock_index].host_ip == any_ip_addr) { //TODO change this when have multiple interfaces
-			daemon_sockets[hdr->sock_index].host_ip = my_host_ip_addr;
+			daemon_sockets_set_host(hdr->sock_index, my_host_ip_addr, daemon_sockets[hdr->sock_index].host_port);
 		}
 		host_ip = daemon_sockets[hdr->sock_index].host_ip;
 
@@ -346,13 +346,8 @@ void getname_out_udp(struct nl_wedge_to_daemon *hdr, int peer) {
 		 */
 		host_port = daemon_sockets[hdr->sock_index].host_port;
 		if ((uint16_t) host_port == 0) {
-			while (1) {
-				host_port = (uint16_t) randoming(MIN_port, MAX_port);
-				if (daemon_sockets_check_ports((uint16_t) host_port, host_ip)) {
-					break;
-				}
-			}
-			daemon_sockets[hdr->sock_index].host_port = (uint16_t) host_port;
+			host_port = daemon_sockets_ephemeral(IPPROTO_UDP);
+			daemon_sockets_set_host(hdr->sock_index, host_ip, (uint16_t) host_port);
 		}
 	} else if (peer == 1) { //getpeername
 		state = daemon_sockets[hdr->sock_index].state;
@@ -438,7 +433,7 @@ void getname_out_udp(struct nl_wedge_to_daemon *hdr, int peer) {
 	}
 
 	PRINT_DEBUG("msg_len=%d, msg='%s'", msg_len, msg);
-	if (send_wedge(nl_sockfd, msg, msg_len, 0)) {
+	if (send_wedge(msg, msg_len, 0)) {
 		PRINT_ERROR("Exited: fail send_wedge: hdr=%p", hdr);
 		nack_send(hdr->call_id, hdr->call_index, hdr->call_type, 0);
 	} else {
@@ -558,7 +553,7 @@ void ioctl_out_udp(struct nl_wedge_to_daemon *hdr, uint32_t cmd, uint8_t *buf, s
 
 	PRINT_DEBUG("msg_len=%d, msg='%s'", msg_len, msg);
 	if (msg_len) {
-		if (send_wedge(nl_sockfd, msg, msg_len, 0)) {
+		if (send_wedge(msg, msg_len, 0)) {
 			PRINT_ERROR("Exited: fail send_wedge: hdr=%p", hdr);
 			nack_send(hdr->call_id, hdr->call_index, hdr->call_type, 0);
 		}
@@ -651,7 +646,7 @@ void sendmsg_out_udp(struct nl_wedge_to_daemon *hdr, uint8_t *data, uint32_t dat
 	 * the current IP using the IPv4 modules unless a binding has occured earlier
 	 */
 	if (daemon_sockets[hdr->sock_index].host_ip == any_ip_addr) { //TODO change this when have multiple interfaces
-		daemon_sockets[hdr->sock_index].host_ip = my_host_ip_addr;
+		daemon_sockets_set_host(hdr->sock_index, my_host_ip_addr, daemon_sockets[hdr->sock_index].host_port);
 	}
 	host_ip = daemon_sockets[hdr->sock_index].host_ip;
 
@@ -665,13 +660,19 @@ void sendmsg_out_udp(struct nl_wedge_to_daemon *hdr, uint8_t *data, uint32_t dat
 	 */
 	host_port = daemon_sockets[hdr->sock_index].host_port;
 	if ((uint16_t) host_port == 0) {
-		while (1) {
-			host_port = (uint16_t) randoming(MIN_port, MAX_port);
-			if (daemon_sockets_check_ports((uint16_t) host_port, host_ip)) {
-				break;
-			}
+		host_port = daemon_sockets_ephemeral(IPPROTO_UDP);
+		if (host_port == 0) {
+			PRINT_DEBUG("post$$$$$$$$$$$$$$$");
+			sem_post(&daemon_sockets_sem);
+
+			nack_send(hdr->call_id, hdr->call_index, hdr->call_type, EADDRINUSE);
+
+			free(data);
+			if (addr)
+				free(addr);
+			return;
 		}
-		daemon_sockets[hdr->sock_index].host_port = (uint16_t) host_port;
+		daemon_sockets_set_host(hdr->sock_index, host_ip, (uint16_t) host_port);
 	}
 
 	/*//TODO uncomment? find out if connect rem addr sent through sendmsg
@@ -774,6 +775,7 @@ void recvmsg_out_udp(struct nl_wedge_to_daemon *hdr, int data_len, uint32_t msg_
 				}
 
 				daemon_sockets[hdr->sock_index].error_buf--;
+				daemon_ready_update(hdr->sock_index);
 
 				metadata *params = ff->metaData;
 
@@ -935,7 +937,8 @@ void recvmsg_out_udp(struct nl_wedge_to_daemon *hdr, int data_len, uint32_t msg_
 
 				int addr_len = sizeof(struct sockaddr_in);
 
-				int msg_len = sizeof(struct nl_daemon_to_wedge) + 3 * sizeof(int) + addr_len + ff->ctrlFrame.data_len + control_len;
+				int where = daemon_ring_put(hdr->sock_index, ff->ctrlFrame.data, ff->ctrlFrame.data_len);
+				int msg_len = sizeof(struct nl_daemon_to_wedge) + 4 * sizeof(int) + addr_len + (where == -1 ? ff->ctrlFrame.data_len : 0) + control_len;
 				uint8_t *msg = (uint8_t *) malloc(msg_len);
 				if (msg == NULL) {
 					PRINT_ERROR("ERROR: buf alloc fail");
@@ -959,8 +962,13 @@ void recvmsg_out_udp(struct nl_wedge_to_daemon *hdr, int data_len, uint32_t msg_
 				*(int *) pt = ff->ctrlFrame.data_len;
 				pt += sizeof(int);
 
-				memcpy(pt, ff->ctrlFrame.data, ff->ctrlFrame.data_len);
-				pt += ff->ctrlFrame.data_len;
+				*(int *) pt = where;
+				pt += sizeof(int);
+
+				if (where == -1) {
+					memcpy(pt, ff->ctrlFrame.data, ff->ctrlFrame.data_len);
+					pt += ff->ctrlFrame.data_len;
+				}
 
 				*(int *) pt = control_len;
 				pt += sizeof(int);
@@ -980,9 +988,10 @@ void recvmsg_out_udp(struct nl_wedge_to_daemon *hdr, int data_len, uint32_t msg_
 				}
 
 				PRINT_DEBUG("msg_len=%d, msg='%s'", msg_len, msg);
-				if (send_wedge(nl_sockfd, msg, msg_len, 0)) {
+				if (send_wedge(msg, msg_len, 0)) {
 					PRINT_ERROR("Exited: fail send_wedge: hdr=%p", hdr);
 					nack_send(hdr->call_id, hdr->call_index, hdr->call_type, 0);
+					daemon_ring_drop(hdr->sock_index, where);
 				} else {
 					//PRINT_DEBUG("Exiting, normal: id=%d, index=%d, uniqueSockID=%llu", id, index, uniqueSockID);
 				}
@@ -1022,6 +1031,7 @@ void recvmsg_out_udp(struct nl_wedge_to_daemon *hdr, int data_len, uint32_t msg_
 			}
 
 			daemon_sockets[hdr->sock_index].data_buf -= ff->dataFrame.pduLength;
+			daemon_ready_update(hdr->sock_index);
 			PRINT_DEBUG("after: sock_index=%d, data_buf=%d", hdr->sock_index, daemon_sockets[hdr->sock_index].data_buf);
 
 			metadata *params = ff->metaData;
@@ -1143,7 +1153,8 @@ void recvmsg_out_udp(struct nl_wedge_to_daemon *hdr, int data_len, uint32_t msg_
 
 			int addr_len = sizeof(struct sockaddr_in);
 
-			int msg_len = sizeof(struct nl_daemon_to_wedge) + 3 * sizeof(int) + addr_len + ff->dataFrame.pduLength + control_len;
+			int where = daemon_ring_put(hdr->sock_index, ff->dataFrame.pdu, ff->dataFrame.pduLength);
+			int msg_len = sizeof(struct nl_daemon_to_wedge) + 4 * sizeof(int) + addr_len + (where == -1 ? ff->dataFrame.pduLength : 0) + control_len;
 			uint8_t *msg = (uint8_t *) malloc(msg_len);
 			if (msg == NULL) {
 				PRINT_ERROR("ERROR: buf alloc fail");
@@ -1167,8 +1178,13 @@ void recvmsg_out_udp(struct nl_wedge_to_daemon *hdr, int data_len, uint32_t msg_
 			*(int *) pt = ff->dataFrame.pduLength;
 			pt += sizeof(int);
 
-			memcpy(pt, ff->dataFrame.pdu, ff->dataFrame.pduLength);
-			pt += ff->dataFrame.pduLength;
+			*(int *) pt = where;
+			pt += sizeof(int);
+
+			if (where == -1) {
+				memcpy(pt, ff->dataFrame.pdu, ff->dataFrame.pduLength);
+				pt += ff->dataFrame.pduLength;
+			}
 
 			*(int *) pt = control_len;
 			pt += sizeof(int);
@@ -1188,9 +1204,10 @@ void recvmsg_out_udp(struct nl_wedge_to_daemon *hdr, int data_len, uint32_t msg_
 			}
 
 			PRINT_DEBUG("msg_len=%d, msg='%s'", msg_len, msg);
-			if (send_wedge(nl_sockfd, msg, msg_len, 0)) {
+			if (send_wedge(msg, msg_len, 0)) {
 				PRINT_ERROR("Exited: fail send_wedge: hdr=%p", hdr);
 				nack_send(hdr->call_id, hdr->call_index, hdr->call_type, 0);
+				daemon_ring_drop(hdr->sock_index, where);
 			} else {
 				//PRINT_DEBUG("Exiting, normal: id=%d, index=%d, uniqueSockID=%llu", id, index, uniqueSockID);
 			}
@@ -1811,7 +1828,7 @@ void getsockopt_out_udp(struct nl_wedge_to_daemon *hdr, int level, int optname,
 	}
 
 	PRINT_DEBUG("msg_len=%d, msg='%s'", msg_len, msg);
-	if (send_wedge(nl_sockfd, msg, msg_len, 0)) {
+	if (send_wedge(msg, msg_len, 0)) {
 		PRINT_ERROR("Exited: fail send_wedge: hdr=%p", hdr);
 		nack_send(hdr->call_id, hdr->call_index, hdr->call_type, 0);
 	} else {
@@ -1871,7 +1888,7 @@ void poll_in_udp(struct daemon_call_list *call_list, struct daemon_call *call, u
 		}
 
 		PRINT_DEBUG("msg_len=%d, msg='%s'", msg_len, msg);
-		if (send_wedge(nl_sockfd, msg, msg_len, 0)) {
+		if (send_wedge(msg, msg_len, 0)) {
 			PRINT_ERROR("Exited: send_wedge error: call=%p", call);
 		} else {
 
@@ -2039,7 +2056,8 @@ void recvmsg_in_udp(struct daemon_call_list *call_list, struct daemon_call *call
 
 	int addr_len = sizeof(struct sockaddr_in);
 
-	int msg_len = sizeof(struct nl_daemon_to_wedge) + 3 * sizeof(int) + addr_len + data_len + control_len;
+	int where = daemon_ring_put(call->sock_index, data, data_len);
+	int msg_len = sizeof(struct nl_daemon_to_wedge) + 4 * sizeof(int) + addr_len + (where == -1 ? data_len : 0) + control_len;
 	uint8_t *msg = (uint8_t *) malloc(msg_len);
 	if (msg == NULL) {
 		PRINT_ERROR("ERROR: buf alloc fail");
@@ -2063,8 +2081,13 @@ void recvmsg_in_udp(struct daemon_call_list *call_list, struct daemon_call *call
 	*(int *) pt = data_len;
 	pt += sizeof(int);
 
-	memcpy(pt, data, data_len);
-	pt += data_len;
+	*(int *) pt = where;
+	pt += sizeof(int);
+
+	if (where == -1) {
+		memcpy(pt, data, data_len);
+		pt += data_len;
+	}
 
 	*(int *) pt = control_len;
 	pt += sizeof(int);
@@ -2084,9 +2107,10 @@ void recvmsg_in_udp(struct daemon_call_list *call_list, struct daemon_call *call
 	}
 
 	PRINT_DEBUG("msg_len=%d, msg='%s'", msg_len, msg);
-	if (send_wedge(nl_sockfd, msg, msg_len, 0)) {
+	if (send_wedge(msg, msg_len, 0)) {
 		PRINT_ERROR("Exited: send_wedge error: call_list=%p, call=%p", call_list, call);
 		nack_send(call->call_id, call->call_index, call->call_type, 0);
+		daemon_ring_drop(call->sock_index, where);
 	} else {
 		PRINT_DEBUG("Exited: Normal: call_list=%p, call=%p", call_list, call);
 	}
@@ -2164,6 +2188,7 @@ void daemon_udp_in_fdf(struct finsFrame *ff, uint32_t src_ip, uint32_t dst_ip) {
 
 		if (write_queue(ff, daemon_sockets[sock_index].data_queue)) {
 			daemon_sockets[sock_index].data_buf += ff->dataFrame.pduLength;
+			daemon_ready_update(sock_index);
 
 			int data_buf = daemon_sockets[sock_index].data_buf;
 			PRINT_DEBUG("post$$$$$$$$$$$$$$$");
@@ -2238,6 +2263,7 @@ void daemon_udp_in_error(struct finsFrame *ff, uint32_t src_ip, uint32_t dst_ip)
 
 			if (write_queue(ff, daemon_sockets[sock_index].error_queue)) {
 				daemon_sockets[sock_index].error_buf++;
+				daemon_ready_update(sock_index);
 
 				int error_buf = daemon_sockets[sock_index].error_buf;
 				PRINT_DEBUG("post$$$$$$$$$$$$$$$");
@@ -43,14 +43,12 @@ Queue CreateQueue(const char* name, int MaxElements) {
 		exit(-1);
 	}
 
-	Q->Array = malloc(sizeof(ElementType) * MaxElements);
+	Q->Array = calloc(MaxElements, sizeof(ElementType)); //zeroed to avoid freeFinsFrame: use of f->dataOrControl, pages only get used as the queue fills
 	if (Q->Array == NULL) {
 		FatalError( "Out of space!!!");
 		exit(-1);
 	}
 
-	memset(Q->Array, 0, sizeof(ElementType) * MaxElements); //avoid freeFinsFrame: use of f->dataOrControl
-
 	Q->Capacity = MaxElements;
 	strcpy(Q->name, name);
 	MakeEmpty(Q);
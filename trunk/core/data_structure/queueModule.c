@@ -10,6 +10,9 @@
  */
 
 #include <queueModule.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 
 /**@brief initializes a queue buffer between the switch and the module
  * @return pointer to the queue whose default name is Q
@@ -191,3 +194,235 @@ int checkEmpty(finsQueue Q) {
 	return (IsEmpty(Q));
 }
 
+/**@brief initializes a ring between the switch and a module
+ * @param name used in debug output, default R
+ * @param size minimum number of frames held, rounded up to a power of 2
+ * @return pointer to the ring
+ * */
+finsRing init_ring(const char *name, int size) {
+	finsRing r;
+	uint32_t cap = 1;
+
+	while (cap < (uint32_t) size) {
+		cap <<= 1;
+	}
+
+	if (posix_memalign((void **) &r, RING_CACHE_LINE, sizeof(struct RingRecord))) {
+		PRINT_ERROR("alloc error");
+		exit(-1);
+	}
+	memset(r, 0, sizeof(struct RingRecord));
+
+	r->array = (struct finsFrame **) malloc(cap * sizeof(struct finsFrame *));
+	if (r->array == NULL) {
+		PRINT_ERROR("alloc error");
+		exit(-1);
+	}
+
+	r->mask = cap - 1;
+	strncpy(r->name, name ? name : "R", sizeof(r->name) - 1);
+
+	return r;
+}
+
+/**@brief frees any frames left in the ring and the ring itself. Both ends must be stopped
+ * @param r points to the ring
+ * */
+int term_ring(finsRing r) {
+	PRINT_DEBUG("Entered: r=%p", r);
+
+	struct finsFrame *ff;
+
+	if (r != NULL) {
+		while ((ff = read_ring(r))) {
+			freeFinsFrame(ff);
+		}
+
+		free(r->array);
+		free(r);
+	}
+	return 1;
+}
+
+int checkEmptyRing(finsRing r) {
+	return __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+}
+
+/**@brief inserts up to n frames into ring r, in order. Must only be called by the ring's producer
+ * @param ffs the frames being written
+ * @param n the number of frames in ffs
+ * @param r points to the ring being accessed
+ * @return the number of frames written, less than n if the ring filled up
+ * */
+int write_ring_burst(struct finsFrame **ffs, int n, finsRing r) {
+	uint32_t head = r->head;
+	uint32_t space = r->mask + 1 - (head - r->tail_cache);
+	int i;
+
+	if (space < (uint32_t) n) {
+		r->tail_cache = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+		space = r->mask + 1 - (head - r->tail_cache);
+		if (space < (uint32_t) n) {
+			n = space;
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		r->array[(head + i) & r->mask] = ffs[i];
+	}
+	__atomic_store_n(&r->head, head + n, __ATOMIC_RELEASE);
+
+	return n;
+}
+
+/**@brief inserts a finsFrame into ring r. Must only be called by the ring's producer
+ * @return 1 on success, 0 if the ring is full
+ * */
+int write_ring(struct finsFrame *ff, finsRing r) {
+	return write_ring_burst(&ff, 1, r);
+}
+
+/**@brief removes up to n frames from ring r, in order. Must only be called by the ring's consumer
+ * @param ffs receives the frames read
+ * @param n the room in ffs
+ * @param r points to the ring being accessed
+ * @return the number of frames read, 0 if the ring is empty
+ * */
+int read_ring_burst(struct finsFrame **ffs, int n, finsRing r) {
+	uint32_t tail = r->tail;
+	uint32_t avail = r->head_cache - tail;
+	int i;
+
+	if (avail < (uint32_t) n) {
+		r->head_cache = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+		avail = r->head_cache - tail;
+		if (avail < (uint32_t) n) {
+			n = avail;
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		ffs[i] = r->array[(tail + i) & r->mask];
+	}
+	__atomic_store_n(&r->tail, tail + n, __ATOMIC_RELEASE);
+
+	return n;
+}
+
+/**@brief removes a finsFrame from ring r. Must only be called by the ring's consumer
+ * @return the frame, or NULL if the ring is empty
+ * */
+struct finsFrame *read_ring(finsRing r) {
+	struct finsFrame *ff;
+
+	if (read_ring_burst(&ff, 1, r)) {
+		return ff;
+	} else {
+		return NULL;
+	}
+}
+
+/**@brief takes up to n frames off ring r, blocking on ev while it is empty. Must only be called by the ring's consumer
+ * @param ffs receives the frames read
+ * @param n the room in ffs
+ * @param r points to the ring being accessed
+ * @param ev the notifier the ring's producer posts
+ * @param running the module's running flag
+ * @return the number of frames read, 0 once the module is stopped (anything read then is freed)
+ * */
+int read_ring_wait(struct finsFrame **ffs, int n, finsRing r, struct finsEvent *ev, int *running) {
+	int got;
+
+	do {
+		got = read_ring_burst(ffs, n, r);
+		if (*running && got == 0) {
+			wait_event(ev);
+		}
+	} while (*running && got == 0);
+
+	if (!*running) {
+		while (got > 0) {
+			freeFinsFrame(ffs[--got]);
+		}
+	}
+	return got;
+}
+
+/**@brief sets up a batch for ring *r, whose consumer waits on ev. The ring is read when flushing,
+ * so the batch can be set up before the switch creates it
+ * */
+void init_batch(struct finsBatch *b, finsRing *r, struct finsEvent *ev) {
+	b->ring = r;
+	b->event = ev;
+	b->len = 0;
+}
+
+/**@brief adds a frame to a batch, flushing it first if it is full. Must only be called by the ring's producer
+ * @return 1, a frame that doesn't fit in the ring at flush_batch() is dropped then
+ * */
+int write_batch(struct finsFrame *ff, struct finsBatch *b) {
+	if (b->len == RING_BURST) {
+		flush_batch(b);
+	}
+	b->ffs[b->len++] = ff;
+	return 1;
+}
+
+/**@brief writes the frames of a batch to its ring, and wakes the consumer once. Frames the ring has no room for are freed
+ * @return the number of frames written
+ * */
+int flush_batch(struct finsBatch *b) {
+	int written;
+	int i;
+
+	if (b->len == 0) {
+		return 0;
+	}
+
+	written = write_ring_burst(b->ffs, b->len, *b->ring);
+	if (written) {
+		post_event(b->event);
+	}
+	for (i = written; i < b->len; i++) {
+		PRINT_ERROR("ring full, dropping: ring='%s', ff=%p", (*b->ring)->name, b->ffs[i]);
+		freeFinsFrame(b->ffs[i]);
+	}
+	b->len = 0;
+
+	return written;
+}
+
+/**@brief initializes a wake-up notifier with nothing pending
+ * @param ev points to the notifier
+ * */
+void init_event(struct finsEvent *ev) {
+	sem_init(&ev->sem, 0, 0);
+	ev->pending = 0;
+}
+
+/**@brief wakes the thread blocked in wait_event(), or makes its next wait_event() return immediately
+ * @param ev points to the notifier
+ * */
+void post_event(struct finsEvent *ev) {
+	if (__sync_bool_compare_and_swap(&ev->pending, 0, 1)) {
+		sem_post(&ev->sem);
+	}
+}
+
+/**@brief blocks until post_event() is called. The pending flag is cleared before returning, so the caller
+ * must drain its queues after waking: anything written after that point posts a new wake-up
+ * @param ev points to the notifier
+ * */
+void wait_event(struct finsEvent *ev) {
+	while (sem_wait(&ev->sem)) {
+		if (errno != EINTR) {
+			PRINT_ERROR("sem_wait prob: ev=%p, errno=%d", ev, errno);
+			exit(-1);
+		}
+	}
+	__sync_bool_compare_and_swap(&ev->pending, 1, 0);
+}
+
+void term_event(struct finsEvent *ev) {
+	sem_destroy(&ev->sem);
+}
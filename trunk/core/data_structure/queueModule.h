@@ -26,6 +26,45 @@
 
 typedef Queue finsQueue;
 
+#define RING_CACHE_LINE 64
+
+/** lock-free single-producer/single-consumer ring used for the links between the switch and
+ * the modules. head is only written by the producer and tail only by the consumer, each on its
+ * own cache line; the cached copy of the other side's index is only refreshed when the ring
+ * looks full/empty, so a burst touches the shared lines once. Indexes are free running. */
+struct RingRecord {
+	uint32_t head __attribute__ ((aligned(RING_CACHE_LINE)));
+	uint32_t tail_cache;
+
+	uint32_t tail __attribute__ ((aligned(RING_CACHE_LINE)));
+	uint32_t head_cache;
+
+	uint32_t mask __attribute__ ((aligned(RING_CACHE_LINE)));
+	char name[50];
+	struct finsFrame **array;
+};
+
+typedef struct RingRecord *finsRing;
+
+/** wake-up notifier for the thread consuming one or more queues. Any number of
+ * post_event() calls between two wait_event() calls collapse into a single wake-up,
+ * so producers can post after every write without flooding the consumer. */
+struct finsEvent {
+	sem_t sem;
+	volatile int pending;
+};
+
+#define RING_BURST 32 //frames a module takes off its ring per pass
+
+/** the frames a module sends while handling a burst. They go to the ring together when the burst
+ * is done, with one write_ring_burst() and one post_event(), instead of one of each per frame */
+struct finsBatch {
+	finsRing *ring;
+	struct finsEvent *event;
+	int len;
+	struct finsFrame *ffs[RING_BURST];
+};
+
 finsQueue init_queue(const char* name, int size);
 int checkEmpty(finsQueue Q);
 int TerminateFinsQueue(finsQueue Q);
@@ -38,4 +77,25 @@ int write_queue_front(struct finsFrame *ff, finsQueue q);
 
 struct finsFrame * read_queue(finsQueue q);
 
+finsRing init_ring(const char *name, int size);
+int term_ring(finsRing r);
+int checkEmptyRing(finsRing r);
+
+int write_ring(struct finsFrame *ff, finsRing r);
+int write_ring_burst(struct finsFrame **ffs, int n, finsRing r);
+
+struct finsFrame *read_ring(finsRing r);
+int read_ring_burst(struct finsFrame **ffs, int n, finsRing r);
+
+int read_ring_wait(struct finsFrame **ffs, int n, finsRing r, struct finsEvent *ev, int *running);
+
+void init_batch(struct finsBatch *b, finsRing *r, struct finsEvent *ev);
+int write_batch(struct finsFrame *ff, struct finsBatch *b);
+int flush_batch(struct finsBatch *b);
+
+void init_event(struct finsEvent *ev);
+void post_event(struct finsEvent *ev);
+void wait_event(struct finsEvent *ev);
+void term_event(struct finsEvent *ev);
+
 #endif /* QUEUEMODULE_H_ */
@@ -14,11 +14,12 @@
 int icmp_running;
 pthread_t switch_to_icmp_thread;
 
-sem_t ICMP_to_Switch_Qsem;
-finsQueue ICMP_to_Switch_Queue;
+finsRing ICMP_to_Switch_Queue;
 
-sem_t Switch_to_ICMP_Qsem;
-finsQueue Switch_to_ICMP_Queue;
+finsRing Switch_to_ICMP_Queue;
+struct finsEvent Switch_to_ICMP_Event;
+
+extern struct finsEvent Switch_Event;
 
 struct icmp_sent_list *icmp_sent_packet_list;
 
@@ -757,72 +758,49 @@ void icmp_out_fdf(struct finsFrame *ff) {
 }
 
 void icmp_get_ff(void) {
+	struct finsFrame *ffs[RING_BURST];
 	struct finsFrame *ff;
-
-	do {
-		sem_wait(&Switch_to_ICMP_Qsem);
-		ff = read_queue(Switch_to_ICMP_Queue);
-		sem_post(&Switch_to_ICMP_Qsem);
-	} while (icmp_running && ff == NULL);
-
-	if (!icmp_running) {
-		return;
-	}
-
-	if (ff->dataOrCtrl == CONTROL) { // send to the control frame handler
-		icmp_fcf(ff);
-	} else if (ff->dataOrCtrl == DATA) {
-		if (ff->dataFrame.directionFlag == UP) { //Incoming ICMP packet (coming in from teh internets)
-			icmp_in_fdf(ff);
-		} else if (ff->dataFrame.directionFlag == DOWN) { //Outgoing ICMP packet (going out from us to teh internets)
-			icmp_out_fdf(ff);
+	int n;
+	int i;
+
+	n = read_ring_wait(ffs, RING_BURST, Switch_to_ICMP_Queue, &Switch_to_ICMP_Event, &icmp_running);
+	for (i = 0; i < n; i++) {
+		ff = writableFinsFrame(ffs[i]); //frames delivered to several modules are shared
+
+		if (ff->dataOrCtrl == CONTROL) { // send to the control frame handler
+			icmp_fcf(ff);
+		} else if (ff->dataOrCtrl == DATA) {
+			if (ff->dataFrame.directionFlag == UP) { //Incoming ICMP packet (coming in from teh internets)
+				icmp_in_fdf(ff);
+			} else if (ff->dataFrame.directionFlag == DOWN) { //Outgoing ICMP packet (going out from us to teh internets)
+				icmp_out_fdf(ff);
+			}
+		} else {
+			PRINT_ERROR("todo error");
 		}
-	} else {
-		PRINT_ERROR("todo error");
 	}
 }
 
 int icmp_to_switch(struct finsFrame *ff) {
 	PRINT_DEBUG("Entered: ff=%p, meta=%p", ff, ff->metaData);
-	if (sem_wait(&ICMP_to_Switch_Qsem)) {
-		PRINT_ERROR("ICMP_to_Switch_Qsem wait prob");
-		exit(-1);
-	}
-	if (write_queue(ff, ICMP_to_Switch_Queue)) {
+	if (write_ring(ff, ICMP_to_Switch_Queue)) {
 		/*#*/PRINT_DEBUG("");
-		sem_post(&ICMP_to_Switch_Qsem);
+		post_event(&Switch_Event);
 		return 1;
 	}
 
 	PRINT_DEBUG("");
-	sem_post(&ICMP_to_Switch_Qsem);
 
 	return 0;
 }
 
 uint16_t icmp_checksum(uint8_t *pt, uint32_t len) {
 	PRINT_DEBUG("Entered: pt=%p, len=%u", pt, len);
-	uint32_t sum = 0;
-	uint32_t i;
 
-	for (i = 1; i < len; i += 2, pt += 2) {
-		//PRINT_DEBUG("%u=%2x (%u), %u=%2x (%u)", i-1, *(pt), *(pt), i, *(pt+1), *(pt+1));
-		sum += (*pt << 8) + *(pt + 1);
-	}
-	if (len & 0x1) {
-		//PRINT_DEBUG("%u=%2x (%u), uneven", len-1, *(pt), *(pt));
-		sum += *pt << 8;
-	}
+	uint16_t sum = ntohs(fins_csum_fold(fins_csum_partial(pt, len, 0)));
 
-	while ((sum >> 16)) {
-		sum = (sum & 0xFFFF) + (sum >> 16);
-	}
-	sum = ~sum;
-
-	//hdr->checksum = htons((uint16_t) sum);
-
-	PRINT_DEBUG("checksum=0x%x", (uint16_t) sum);
-	return (uint16_t) sum;
+	PRINT_DEBUG("checksum=0x%x", sum);
+	return sum;
 }
 
 void icmp_ping_reply(struct finsFrame* ff, struct icmp_packet *icmp_pkt, uint32_t data_len) {
@@ -842,9 +820,9 @@ void icmp_ping_reply(struct finsFrame* ff, struct icmp_packet *icmp_pkt, uint32_
 	icmp_pkt_reply->param_1 = icmp_pkt->param_1; //id
 	icmp_pkt_reply->param_2 = icmp_pkt->param_2; //seq num
 
-	memcpy(icmp_pkt_reply->data, icmp_pkt->data, data_len);
-
-	icmp_pkt_reply->checksum = htons(icmp_checksum(pdu_reply, pdu_len_reply));
+	//the data is summed as it is copied, then the header is added
+	uint32_t sum = fins_csum_copy(icmp_pkt_reply->data, icmp_pkt->data, data_len, 0);
+	icmp_pkt_reply->checksum = fins_csum_fold(fins_csum_partial(pdu_reply, ICMP_HEADER_SIZE, sum));
 	PRINT_DEBUG("checksum=0x%x", icmp_pkt_reply->checksum);
 
 	uint32_t src_ip;
@@ -965,6 +943,7 @@ void icmp_run(pthread_attr_t *fins_pthread_attr) {
 void icmp_shutdown(void) {
 	PRINT_DEBUG("Entered");
 	icmp_running = 0;
+	post_event(&Switch_to_ICMP_Event);
 
 	//TODO expand this
 
@@ -979,6 +958,6 @@ void icmp_release(void) {
 
 	//TODO free all module related mem
 
-	term_queue(ICMP_to_Switch_Queue);
-	term_queue(Switch_to_ICMP_Queue);
+	term_ring(ICMP_to_Switch_Queue);
+	term_ring(Switch_to_ICMP_Queue);
 }
@@ -13,6 +13,7 @@
 #include <finstypes.h>
 #include <metadata.h>
 #include <finsdebug.h>
+#include <finschecksum.h>
 #include <queueModule.h>
 #include "icmp_types.h"
 
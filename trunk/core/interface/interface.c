@@ -15,6 +15,7 @@
 //#include <queueModule.h>
 #include <sys/time.h>
 #include <finsdebug.h>
+#include <finschecksum.h>
 
 #include "interface.h"
 
@@ -22,14 +23,17 @@ int interface_running;
 pthread_t switch_to_interface_thread;
 pthread_t capturer_to_interface_thread;
 
-sem_t Interface_to_Switch_Qsem;
-finsQueue Interface_to_Switch_Queue;
+finsRing Interface_to_Switch_Queue;
 
-sem_t Switch_to_Interface_Qsem;
-finsQueue Switch_to_Interface_Queue;
+finsRing Switch_to_Interface_Queue;
+struct finsEvent Switch_to_Interface_Event;
 
-int capture_pipe_fd; /** capture file descriptor to read from capturer */
-int inject_pipe_fd; /** inject file descriptor to read from capturer */
+extern struct finsEvent Switch_Event;
+
+finsShmRing capture_ring; /** frames captured by the capturer */
+finsShmRing inject_ring; /** frames for the capturer to inject */
+
+static struct interface_gro gro; /** only the capturer thread touches it */
 
 /** special functions to print the data within a frame for testing*/
 void print_hex_ascii_line(const u_char *payload, int len, int offset) {
@@ -121,48 +125,173 @@ void print_frame(const u_char *payload, int len) {
 } // end of print_frame
 /** ---------------------------------------------------------*/
 
-int interface_setNonblocking(int fd) { //TODO move to common file?
-	int flags;
+/**@brief returns 0 unless ff is an IPv4 TCP seg with data that GRO can merge: no IP options or fragments, just
+ * ACK & maybe PSH set */
+static int interface_gro_check(struct finsFrame *ff, uint32_t *hlen, uint32_t *data_len) {
+	struct sniff_ip4 *ip = (struct sniff_ip4 *) ff->dataFrame.pdu;
+	struct sniff_tcp *tcp = (struct sniff_tcp *) (ip + 1);
+	uint32_t ip_len;
 
-	/* If they have O_NONBLOCK, use the Posix way to do it */
-#if defined(O_NONBLOCK)
-	/* Fixme: O_NONBLOCK is defined but broken on SunOS 4.1.x and AIX 3.2.5. */
-	if (-1 == (flags = fcntl(fd, F_GETFL, 0))) {
-		flags = 0;
+	if (ff->dataFrame.pduLength < sizeof(struct sniff_ip4) + sizeof(struct sniff_tcp) || ip->ip_verlen != 0x45 || ip->ip_proto != SNIFF_IP4_PROTO_TCP
+			|| (ntohs(ip->ip_fragoff) & ~SNIFF_IP4_DF) || (tcp->th_off >> 4) < 5 || (tcp->th_flags & ~SNIFF_TH_PSH) != SNIFF_TH_ACK) {
+		return 0;
 	}
-	return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
-#else
-	/* Otherwise, use the old way of doing it */
-	flags = 1;
-	return ioctl(fd, FIOBIO, &flags);
-#endif
+
+	ip_len = ntohs(ip->ip_len);
+	*hlen = sizeof(struct sniff_ip4) + (tcp->th_off >> 4) * 4;
+	if (ip_len > ff->dataFrame.pduLength || ip_len <= *hlen) {
+		return 0;
+	}
+	*data_len = ip_len - *hlen;
+	return 1;
+}
+
+/**@brief 1 if the TCP seg at ip, whose data sums to sum, has a good checksum */
+static int interface_gro_valid(uint8_t *ip, uint32_t hlen, uint32_t data_len, uint32_t sum) {
+	struct sniff_ip4 *hdr = (struct sniff_ip4 *) ip;
+
+	sum = fins_csum_pseudo(hdr->ip_src, hdr->ip_dst, SNIFF_IP4_PROTO_TCP, (uint16_t) (hlen - sizeof(struct sniff_ip4) + data_len), sum);
+	return fins_csum_fold(fins_csum_partial(ip + sizeof(struct sniff_ip4), hlen - sizeof(struct sniff_ip4), sum)) == 0;
 }
 
-int interface_setBlocking(int fd) {
-	int flags;
+/**@brief 1 if ff is the next seg of the held one's flow, with the same headers but for its seq & PSH */
+static int interface_gro_match(struct finsFrame *ff, uint32_t hlen, uint32_t data_len) {
+	struct sniff_ip4 *ip = (struct sniff_ip4 *) ff->dataFrame.pdu;
+	struct sniff_ip4 *held_ip = (struct sniff_ip4 *) gro.ff->dataFrame.pdu;
+	struct sniff_tcp *tcp = (struct sniff_tcp *) (ip + 1);
+	struct sniff_tcp *held_tcp = (struct sniff_tcp *) (held_ip + 1);
+
+	//an odd seg_len would put the next seg's data at an odd offset, which the partial sums can't chain over
+	return hlen == gro.hlen && ip->ip_src == held_ip->ip_src && ip->ip_dst == held_ip->ip_dst && ip->ip_dif == held_ip->ip_dif
+			&& ip->ip_ttl == held_ip->ip_ttl && tcp->th_sport == held_tcp->th_sport && tcp->th_dport == held_tcp->th_dport
+			&& tcp->th_ack == held_tcp->th_ack && tcp->th_win == held_tcp->th_win && ntohl(tcp->th_seq) == gro.seq_next
+			&& memcmp(tcp + 1, held_tcp + 1, hlen - sizeof(struct sniff_ip4) - sizeof(struct sniff_tcp)) == 0 && data_len <= gro.seg_len
+			&& (gro.seg_len & 1) == 0 && gro.len + data_len <= INTERFACE_GRO_MAX;
+}
 
-	/* If they have O_NONBLOCK, use the Posix way to do it */
-#if defined(O_NONBLOCK)
-	/* Fixme: O_NONBLOCK is defined but broken on SunOS 4.1.x and AIX 3.2.5. */
-	if (-1 == (flags = fcntl(fd, F_GETFL, 0))) {
-		flags = 0;
+/**@brief copies ff's data onto the end of the held seg, 0 if a checksum is bad & nothing was added */
+static int interface_gro_add(struct finsFrame *ff, uint32_t hlen, uint32_t data_len) {
+	struct sniff_tcp *tcp = (struct sniff_tcp *) (ff->dataFrame.pdu + sizeof(struct sniff_ip4));
+	uint8_t *pdu;
+	uint32_t sum;
+
+	if (gro.segs == 1) {
+		//the first seg moves to a pdu with room for the rest, its data is checked as it goes
+		pdu = allocFinsPdu(INTERFACE_GRO_MAX);
+		memcpy(pdu, gro.ff->dataFrame.pdu, gro.hlen);
+		sum = fins_csum_copy(pdu + gro.hlen, gro.ff->dataFrame.pdu + gro.hlen, gro.seg_len, 0);
+		if (!interface_gro_valid(pdu, gro.hlen, gro.seg_len, sum)) {
+			freeFinsPdu(pdu);
+			return 0;
+		}
+		freeFinsPdu(gro.ff->dataFrame.pdu);
+		gro.ff->dataFrame.pdu = pdu;
+		gro.sum = sum;
 	}
-	return fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
-#else
-	/* Otherwise, use the old way of doing it */
-	flags = 0; //TODO verify is right?
-	return ioctl(fd, FIOBIO, &flags);
-#endif
+
+	//copied in past the end, only kept if the seg checks out
+	sum = fins_csum_copy(gro.ff->dataFrame.pdu + gro.len, ff->dataFrame.pdu + hlen, data_len, 0);
+	if (!interface_gro_valid(ff->dataFrame.pdu, hlen, data_len, sum)) {
+		return 0;
+	}
+	gro.sum += sum;
+	if (gro.sum < sum) {
+		gro.sum++; //end around carry
+	}
+
+	gro.len += data_len;
+	gro.seq_next += data_len;
+	gro.segs++;
+	if (tcp->th_flags & SNIFF_TH_PSH) {
+		((struct sniff_tcp *) (gro.ff->dataFrame.pdu + sizeof(struct sniff_ip4)))->th_flags |= SNIFF_TH_PSH;
+	}
+	return 1;
+}
+
+/**@brief sends the held seg on to the switch, with its headers redone if segs were merged into it
+ * @return 1 if a frame went to the switch
+ * */
+static int interface_gro_flush(void) {
+	struct finsFrame *ff = gro.ff;
+	struct sniff_ip4 *ip;
+	struct sniff_tcp *tcp;
+	uint32_t sum;
+
+	if (ff == NULL) {
+		return 0;
+	}
+	gro.ff = NULL;
+
+	if (gro.segs > 1) {
+		ip = (struct sniff_ip4 *) ff->dataFrame.pdu;
+		ip->ip_len = htons(gro.len);
+		ip->ip_cksum = 0;
+		ip->ip_cksum = fins_csum_fold(fins_csum_partial(ip, sizeof(struct sniff_ip4), 0));
+
+		tcp = (struct sniff_tcp *) (ip + 1);
+		tcp->th_sum = 0;
+		sum = fins_csum_pseudo(ip->ip_src, ip->ip_dst, SNIFF_IP4_PROTO_TCP, (uint16_t) (gro.len - sizeof(struct sniff_ip4)), gro.sum);
+		tcp->th_sum = fins_csum_fold(fins_csum_partial(tcp, gro.hlen - sizeof(struct sniff_ip4), sum));
+
+		ff->dataFrame.pduLength = gro.len;
+		PRINT_DEBUG("merged: ff=%p, segs=%u, len=%u", ff, gro.segs, gro.len);
+	}
+
+	if (write_ring(ff, Interface_to_Switch_Queue)) {
+		return 1;
+	}
+	PRINT_ERROR("send to switch error, ff=%p", ff);
+	freeFinsFrame(ff);
+	return 0;
+}
+
+/**@brief GRO, merges in order TCP segs of a flow captured back to back into one, so IPv4 & TCP handle them
+ * once. The seg is held back until one that doesn't continue it comes, or one with PSH or less data, or the
+ * burst ends.
+ * @param burst counts the frames sent to the switch
+ * @return 1 if ff was taken, else it should go on as is, after interface_gro_flush()
+ * */
+static int interface_gro(struct finsFrame *ff, int *burst) {
+	struct sniff_tcp *tcp = (struct sniff_tcp *) (ff->dataFrame.pdu + sizeof(struct sniff_ip4));
+	uint32_t hlen;
+	uint32_t data_len;
+
+	if (!interface_gro_check(ff, &hlen, &data_len)) {
+		return 0;
+	}
+
+	if (gro.ff && interface_gro_match(ff, hlen, data_len) && interface_gro_add(ff, hlen, data_len)) {
+		freeFinsFrame(ff);
+		tcp = (struct sniff_tcp *) (gro.ff->dataFrame.pdu + sizeof(struct sniff_ip4));
+		if ((tcp->th_flags & SNIFF_TH_PSH) || data_len < gro.seg_len || gro.len + gro.seg_len > INTERFACE_GRO_MAX) {
+			*burst += interface_gro_flush();
+		}
+		return 1;
+	}
+
+	*burst += interface_gro_flush();
+	if (tcp->th_flags & SNIFF_TH_PSH) {
+		return 0;
+	}
+
+	gro.ff = ff;
+	gro.hlen = hlen;
+	gro.len = hlen + data_len;
+	gro.seg_len = data_len;
+	gro.seq_next = ntohl(tcp->th_seq) + data_len;
+	gro.segs = 1;
+	gro.sum = 0;
+	return 1;
 }
 
 void *capturer_to_interface(void *local) {
 	PRINT_DEBUG("Entered");
 
 	uint8_t *frame;
-	int frame_len;
+	uint8_t *frame_ring;
+	uint32_t frame_len;
 	struct sniff_ethernet *hdr;
-	int numBytes;
-	//int capture_pipe_fd;
+	int burst = 0;
 	struct finsFrame *ff = NULL;
 
 	metadata *params;
@@ -173,44 +302,31 @@ void *capturer_to_interface(void *local) {
 	uint32_t ether_type;
 
 	while (interface_running) {
-		interface_setNonblocking(capture_pipe_fd);
-		do {
-			numBytes = read(capture_pipe_fd, &frame_len, sizeof(int)); //TODO change to nonblocking in loop
-		} while (interface_running && numBytes <= 0);
-
-		if (!interface_running) {
-			break;
-		}
-
-		interface_setBlocking(capture_pipe_fd);
-
-		if (numBytes <= 0) {
-			PRINT_ERROR("numBytes written %d", numBytes);
-			break;
-		}
-		frame = (uint8_t *) malloc(frame_len);
-		if (frame == NULL) {
-			PRINT_ERROR("allocation fail");
-			exit(-1);
+		frame_ring = read_shm_ring(capture_ring, &frame_len);
+		if (frame_ring == NULL || burst >= INTERFACE_CAPTURE_BURST) {
+			//the switch is woken once per burst, a seg GRO holds back doesn't wait past it
+			burst += interface_gro_flush();
+			if (burst) {
+				post_event(&Switch_Event);
+				burst = 0;
+			}
+			if (frame_ring == NULL) {
+				wait_shm_ring(capture_ring, -1);
+				continue;
+			}
 		}
 
-		numBytes = read(capture_pipe_fd, frame, frame_len);
-		if (numBytes <= 0) {
-			PRINT_ERROR("numBytes written %d", numBytes);
-			free(frame);
-			break;
-		}
+		//the pdu is the only copy, the ethernet header is pulled off below
+		frame = allocFinsPdu(frame_len);
+		memcpy(frame, frame_ring, frame_len);
+		pop_shm_ring(capture_ring);
 
-		if (numBytes != frame_len) {
-			PRINT_ERROR("bytes read not equal to datalen,  numBytes=%d", numBytes);
-			free(frame);
+		if (frame_len < SIZE_ETHERNET) {
+			PRINT_ERROR("frame too small: frame_len=%u", frame_len);
+			freeFinsPdu(frame);
 			continue;
 		}
 
-		if (numBytes < sizeof(struct sniff_ethernet)) {
-			PRINT_ERROR("todo error");
-		}
-
 		PRINT_DEBUG("A frame of length %d has been written-----", frame_len);
 
 		//print_frame(data,datalen);
@@ -231,12 +347,7 @@ void *capturer_to_interface(void *local) {
 		PRINT_DEBUG("recv frame: dst=0x%12.12llx, src=0x%12.12llx, type=0x%x, stamp=%u.%u",
 				dst_mac, src_mac, ether_type, (uint32_t)current.tv_sec, (uint32_t)current.tv_usec);
 
-		ff = (struct finsFrame *) malloc(sizeof(struct finsFrame));
-		if (ff == NULL) {
-			PRINT_ERROR("ff creation failed, dropping frame");
-			exit(-1);
-		}
-
+		ff = allocFinsFrame();
 		PRINT_DEBUG("ff=%p", ff);
 
 		/** TODO
@@ -244,16 +355,10 @@ void *capturer_to_interface(void *local) {
 		 * 2. pre-process the frame in order to extract the metadata
 		 * 3. build a finsFrame and insert it into EtherStub_to_Switch_Queue
 		 */
-		params = (metadata *) malloc(sizeof(metadata));
-		if (params == NULL) {
-			PRINT_ERROR("metadata creation failed");
-			exit(-1);
-		}
-		metadata_create(params);
+		params = ff->metaData;
 		metadata_writeToElement(params, "recv_stamp", &current, META_TYPE_INT64);
 
 		ff->dataOrCtrl = DATA;
-		ff->metaData = params;
 
 		if (ether_type == ETH_TYPE_IP4) { //0x0800 == 2048, IPv4
 			PRINT_DEBUG("IPv4: proto=0x%x (%u)", ether_type, ether_type);
@@ -268,36 +373,37 @@ void *capturer_to_interface(void *local) {
 			//drop, don't handle & don't catch sys calls
 			ff->dataFrame.pdu = NULL;
 			freeFinsFrame(ff);
-			free(frame);
+			freeFinsPdu(frame);
 			continue;
 		} else {
 			PRINT_ERROR("default: proto=0x%x (%u)", ether_type, ether_type);
 			//drop
 			ff->dataFrame.pdu = NULL;
 			freeFinsFrame(ff);
-			free(frame);
+			freeFinsPdu(frame);
 			continue;
 		}
 
 		ff->dataFrame.directionFlag = UP;
-		ff->dataFrame.pduLength = frame_len - SIZE_ETHERNET;
-		ff->dataFrame.pdu = (uint8_t *) malloc(ff->dataFrame.pduLength);
-		if (ff->dataFrame.pdu == NULL) {
-			PRINT_ERROR("todo error");
-			exit(-1);
-		}
-		memcpy(ff->dataFrame.pdu, frame + SIZE_ETHERNET, ff->dataFrame.pduLength);
+		ff->dataFrame.pduLength = frame_len;
+		ff->dataFrame.pdu = frame;
+		pullFinsPdu(ff, SIZE_ETHERNET);
 
 		metadata_writeToElement(params, "recv_dst_mac", &dst_mac, META_TYPE_INT64);
 		metadata_writeToElement(params, "recv_src_mac", &src_mac, META_TYPE_INT64);
 		metadata_writeToElement(params, "recv_ether_type", &ether_type, META_TYPE_INT32);
 
-		if (!interface_to_switch(ff)) {
+		if (ether_type == ETH_TYPE_IP4 && interface_gro(ff, &burst)) {
+			continue;
+		}
+		burst += interface_gro_flush(); //stays ahead of what came after it
+
+		if (write_ring(ff, Interface_to_Switch_Queue)) {
+			burst++;
+		} else {
 			PRINT_ERROR("send to switch error, ff=%p", ff)
 			freeFinsFrame(ff);
 		}
-
-		free(frame);
 	} // end of while loop
 
 	PRINT_DEBUG("Exited");
@@ -316,48 +422,129 @@ void *switch_to_interface(void *local) {
 	pthread_exit(NULL);
 } // end of Inject Function
 
+/**@brief handles a burst of frames from the switch, runs of outgoing frames are injected together */
 void interface_get_ff(void) {
+	struct finsFrame *ffs[RING_BURST];
 	struct finsFrame *ff;
+	int n;
+	int i, j;
 
-	do {
-		sem_wait(&Switch_to_Interface_Qsem);
-		ff = read_queue(Switch_to_Interface_Queue);
-		sem_post(&Switch_to_Interface_Qsem);
-	} while (interface_running && ff == NULL);
-
-	if (!interface_running) {
-		return;
+	n = read_ring_wait(ffs, RING_BURST, Switch_to_Interface_Queue, &Switch_to_Interface_Event, &interface_running);
+	for (i = 0; i < n; i++) {
+		ffs[i] = writableFinsFrame(ffs[i]); //frames delivered to several modules are shared
 	}
 
-	PRINT_DEBUG(" At least one frame has been read from the Switch to Etherstub ff=%p", ff);
+	for (i = 0; i < n; i = j) {
+		ff = ffs[i];
+		j = i + 1;
 
-	if (ff->dataOrCtrl == CONTROL) {
-		interface_fcf(ff);
-		PRINT_DEBUG("");
-	} else if (ff->dataOrCtrl == DATA) {
-		//ff->dataFrame is an IPv4 packet
-		if (ff->dataFrame.directionFlag == UP) {
-			//interface_in_fdf(ff); //TODO remove?
-			PRINT_ERROR("todo error");
-		} else { //directionFlag==DOWN
-			interface_out_fdf(ff);
+		PRINT_DEBUG(" At least one frame has been read from the Switch to Etherstub ff=%p", ff);
+
+		if (ff->dataOrCtrl == CONTROL) {
+			interface_fcf(ff);
 			PRINT_DEBUG("");
+		} else if (ff->dataOrCtrl == DATA) {
+			//ff->dataFrame is an IPv4 packet
+			if (ff->dataFrame.directionFlag == UP) {
+				//interface_in_fdf(ff); //TODO remove?
+				PRINT_ERROR("todo error");
+			} else { //directionFlag==DOWN
+				while (j < n && ffs[j]->dataOrCtrl == DATA && ffs[j]->dataFrame.directionFlag != UP) {
+					j++;
+				}
+				interface_out_fdf_burst(&ffs[i], j - i);
+				PRINT_DEBUG("");
+			}
+		} else {
+			PRINT_ERROR("todo error");
 		}
-	} else {
-		PRINT_ERROR("todo error");
 	}
 }
 
-void interface_out_fdf(struct finsFrame *ff) {
+/**@brief writes a TCP super-segment to the inject ring as segs of gso_size data each. The headers are copied
+ * per seg with their lengths, IP id, seq num & checksums redone, and FIN/PSH left for the last seg only.
+ * @return the number of segs written
+ * */
+static int interface_gso(uint8_t *frame, uint32_t framelen, uint32_t gso_size) {
+	uint8_t hdr[GSO_HDR_MAX];
+	struct sniff_ip4 *ip = (struct sniff_ip4 *) (frame + SIZE_ETHERNET);
+	struct sniff_ip4 *seg_ip = (struct sniff_ip4 *) (hdr + SIZE_ETHERNET);
+	struct sniff_tcp *tcp;
+	struct sniff_tcp *seg_tcp;
+	uint32_t ip_hlen;
+	uint32_t tcp_hlen;
+	uint32_t hlen;
+	uint32_t pos;
+	uint32_t len;
+	uint32_t seq;
+	uint16_t id;
+	uint32_t sum;
+	int written = 0;
+
+	ip_hlen = (ip->ip_verlen & 0x0f) * 4;
+	tcp = (struct sniff_tcp *) ((uint8_t *) ip + ip_hlen);
+	tcp_hlen = (tcp->th_off >> 4) * 4;
+	hlen = SIZE_ETHERNET + ip_hlen + tcp_hlen;
+	if (ip->ip_proto != SNIFF_IP4_PROTO_TCP || hlen > GSO_HDR_MAX || hlen > framelen || gso_size == 0) {
+		PRINT_ERROR("not a TCP super-segment, dropping: framelen=%u, proto=%u, hlen=%u, gso_size=%u", framelen, ip->ip_proto, hlen, gso_size);
+		return 0;
+	}
+
+	seg_tcp = (struct sniff_tcp *) (hdr + SIZE_ETHERNET + ip_hlen);
+	seq = ntohl(tcp->th_seq);
+	id = ntohs(ip->ip_id);
+
+	for (pos = hlen; pos < framelen; pos += len) {
+		len = framelen - pos < gso_size ? framelen - pos : gso_size;
+
+		memcpy(hdr, frame, hlen);
+		seg_ip->ip_len = htons(ip_hlen + tcp_hlen + len);
+		seg_ip->ip_id = htons(id++);
+		seg_ip->ip_cksum = 0;
+		seg_ip->ip_cksum = fins_csum_fold(fins_csum_partial(seg_ip, ip_hlen, 0));
+
+		seg_tcp->th_seq = htonl(seq);
+		seq += len;
+		if (pos + len < framelen) {
+			seg_tcp->th_flags &= ~(SNIFF_TH_FIN | SNIFF_TH_PSH);
+		}
+		if (pos != hlen) {
+			seg_tcp->th_flags &= ~SNIFF_TH_CWR;
+		}
+
+		//the TCP header is a multiple of 4, so the data's sum chains on
+		seg_tcp->th_sum = 0;
+		sum = fins_csum_pseudo(ip->ip_src, ip->ip_dst, SNIFF_IP4_PROTO_TCP, (uint16_t) (tcp_hlen + len), 0);
+		sum = fins_csum_partial(seg_tcp, tcp_hlen, sum);
+		sum = fins_csum_partial(frame + pos, len, sum);
+		seg_tcp->th_sum = fins_csum_fold(sum);
+
+		if (write_shm_ring_split(inject_ring, hdr, hlen, frame + pos, len)) {
+			written++;
+		} else {
+			PRINT_ERROR("inject ring full, dropping: seq=%u, len=%u", seq - len, len);
+		}
+	}
+
+	PRINT_DEBUG("cut: framelen=%u, gso_size=%u, segs=%d", framelen, gso_size, written);
+	return written;
+}
+
+/**@brief puts the ethernet header on a frame and writes it to the inject ring, without waking the capturer
+ * @return 1 if the frame was written
+ */
+static int interface_inject(struct finsFrame *ff) {
 
 	uint64_t dst_mac;
 	uint64_t src_mac;
 	uint32_t ether_type;
 
-	char *frame;
 	struct sniff_ethernet *hdr;
 	int framelen;
-	int numBytes;
+	uint8_t *tail;
+	uint32_t tail_len;
+	uint32_t gso_size;
+	int written;
 
 	metadata *params = ff->metaData;
 
@@ -370,22 +557,15 @@ void interface_out_fdf(struct finsFrame *ff) {
 		//TODO error
 		PRINT_ERROR("todo error");
 		//TODO create error fcf?
-		return;
+		return 0;
 	}
 
 	PRINT_DEBUG("send frame: dst=0x%12.12llx, src=0x%12.12llx, type=0x%x", dst_mac, src_mac, ether_type);
 
-	framelen = ff->dataFrame.pduLength + SIZE_ETHERNET;
+	hdr = (struct sniff_ethernet *) pushFinsPdu(ff, SIZE_ETHERNET); //the ethernet header goes in the headroom
+	framelen = ff->dataFrame.pduLength;
 	PRINT_DEBUG("framelen=%d", framelen);
 
-	frame = (char *) malloc(framelen);
-	if (frame == NULL) {
-		PRINT_ERROR("frame creation failed");
-		exit(-1);
-	}
-
-	hdr = (struct sniff_ethernet *) frame;
-
 	hdr->ether_dhost[0] = (dst_mac >> 40) & 0xff;
 	hdr->ether_dhost[1] = (dst_mac >> 32) & 0xff;
 	hdr->ether_dhost[2] = (dst_mac >> 24) & 0xff;
@@ -408,33 +588,44 @@ void interface_out_fdf(struct finsFrame *ff) {
 		PRINT_ERROR("todo error");
 		//TODO create error fcf?
 		freeFinsFrame(ff);
-		free(frame);
-		return;
+		return 0;
 	}
 
-	//memcpy(frame + SIZE_ETHERNET, ff->dataFrame.pdu, ff->dataFrame.pduLength);
-	memcpy(hdr->data, ff->dataFrame.pdu, ff->dataFrame.pduLength);
 	//	print_finsFrame(ff);
 	PRINT_DEBUG("daemon inject to ethernet stub ");
 
-	numBytes = write(inject_pipe_fd, &framelen, sizeof(int));
-	if (numBytes <= 0) {
-		PRINT_ERROR("numBytes written %d", numBytes);
-		freeFinsFrame(ff);
-		free(frame);
-		return;
+	tail = tailFinsPdu(ff->dataFrame.pdu, &tail_len); //an IPv4 fragment's data, still in the datagram's pdu
+	if (metadata_readFromElement(params, "send_gso_size", &gso_size) == META_TRUE && ether_type == ETH_TYPE_IP4 && tail_len == 0) {
+		written = interface_gso((uint8_t *) hdr, framelen, gso_size);
+	} else {
+		written = write_shm_ring_split(inject_ring, (uint8_t *) hdr, framelen, tail, tail_len);
+		if (!written) {
+			PRINT_ERROR("inject ring full, dropping: ff=%p, framelen=%d", ff, framelen);
+		}
 	}
 
-	numBytes = write(inject_pipe_fd, frame, framelen);
-	if (numBytes <= 0) {
-		PRINT_ERROR("numBytes written %d", numBytes);
-		freeFinsFrame(ff);
-		free(frame);
-		return;
+	freeFinsFrame(ff);
+	return written;
+}
+
+void interface_out_fdf(struct finsFrame *ff) {
+	if (interface_inject(ff)) {
+		flush_shm_ring(inject_ring);
 	}
+}
 
-	freeFinsFrame(ff);
-	free(frame);
+/**@brief interface_out_fdf() for a run of frames, the capturer is woken once for all of them */
+void interface_out_fdf_burst(struct finsFrame **ffs, int num) {
+	int written = 0;
+	int i;
+
+	PRINT_DEBUG("Entered: ff=%p, num=%d", ffs[0], num);
+	for (i = 0; i < num; i++) {
+		written += interface_inject(ffs[i]);
+	}
+	if (written) {
+		flush_shm_ring(inject_ring);
+	}
 }
 
 void interface_in_fdf(struct finsFrame *ff) {
@@ -454,18 +645,13 @@ void interface_exec(struct finsFrame *ff) {
 
 int interface_to_switch(struct finsFrame *ff) {
 	PRINT_DEBUG("Entered: ff=%p, meta=%p", ff, ff->metaData);
-	if (sem_wait(&Interface_to_Switch_Qsem)) {
-		PRINT_ERROR("Interface_to_Switch_Qsem wait prob");
-		exit(-1);
-	}
-	if (write_queue(ff, Interface_to_Switch_Queue)) {
+	if (write_ring(ff, Interface_to_Switch_Queue)) {
 		/*#*/PRINT_DEBUG("");
-		sem_post(&Interface_to_Switch_Qsem);
+		post_event(&Switch_Event);
 		return 1;
 	}
 
 	PRINT_DEBUG("");
-	sem_post(&Interface_to_Switch_Qsem);
 
 	return 0;
 }
@@ -474,17 +660,9 @@ void interface_init(void) {
 	PRINT_DEBUG("Entered");
 	interface_running = 1;
 
-	inject_pipe_fd = open(INJECT_PIPE, O_WRONLY);
-	if (inject_pipe_fd == -1) {
-		PRINT_ERROR("opening inject_pipe did not work");
-		exit(-1);
-	}
-
-	capture_pipe_fd = open(CAPTURE_PIPE, O_RDONLY); //responsible for socket/ioctl call
-	if (capture_pipe_fd == -1) {
-		PRINT_ERROR("opening capture_pipe did not work");
-		exit(-1); //exit(EXIT_FAILURE);
-	}
+	//the capturer creates the rings, this waits for it like opening the fifos did
+	inject_ring = open_shm_ring(FINS_INJECT_RING);
+	capture_ring = open_shm_ring(FINS_CAPTURE_RING);
 
 	PRINT_DEBUG("");
 }
@@ -499,6 +677,8 @@ void interface_run(pthread_attr_t *fins_pthread_attr) {
 void interface_shutdown(void) {
 	PRINT_DEBUG("Entered");
 	interface_running = 0;
+	post_event(&Switch_to_Interface_Event);
+	wake_shm_ring(capture_ring);
 
 	//TODO expand this
 
@@ -512,6 +692,9 @@ void interface_release(void) {
 	PRINT_DEBUG("Entered");
 	//TODO free all module related mem
 
-	term_queue(Interface_to_Switch_Queue);
-	term_queue(Switch_to_Interface_Queue);
+	term_ring(Interface_to_Switch_Queue);
+	term_ring(Switch_to_Interface_Queue);
+
+	close_shm_ring(capture_ring);
+	close_shm_ring(inject_ring);
 }
@@ -4,21 +4,21 @@
 #include <finstypes.h>
 #include <metadata.h>
 #include <queueModule.h>
+#include <shmRing.h>
 #include <sys/types.h>
 #include <stdint.h>
 
 /** Ethernet Stub Variables  */
 #ifdef BUILD_FOR_ANDROID
 #define FINS_TMP_ROOT "/data/data/fins"
-#define CAPTURE_PIPE FINS_TMP_ROOT "/fins_capture"
-#define INJECT_PIPE FINS_TMP_ROOT "/fins_inject"
 #else
 #define FINS_TMP_ROOT "/tmp/fins"
-#define CAPTURE_PIPE FINS_TMP_ROOT "/fins_capture"
-#define INJECT_PIPE FINS_TMP_ROOT "/fins_inject"
 #define SEMAPHORE_ROOT "/dev/shm"
 #endif
 
+/** frames read from the capture ring before handing freed slots back */
+#define INTERFACE_CAPTURE_BURST 32
+
 /* ethernet headers are always exactly 14 bytes [1] */
 #define SIZE_ETHERNET 14
 
@@ -37,6 +37,55 @@ struct sniff_ethernet {
 	uint8_t data[1];
 };
 
+/* IPv4 & TCP headers, just what GSO rewrites in each seg it cuts from a super-segment */
+struct sniff_ip4 {
+	uint8_t ip_verlen; /* version << 4 | header length in words */
+	uint8_t ip_dif;
+	uint16_t ip_len;
+	uint16_t ip_id;
+	uint16_t ip_fragoff;
+	uint8_t ip_ttl;
+	uint8_t ip_proto;
+	uint16_t ip_cksum;
+	uint32_t ip_src;
+	uint32_t ip_dst;
+};
+
+struct sniff_tcp {
+	uint16_t th_sport;
+	uint16_t th_dport;
+	uint32_t th_seq;
+	uint32_t th_ack;
+	uint8_t th_off; /* header length in words << 4 */
+	uint8_t th_flags;
+	uint16_t th_win;
+	uint16_t th_sum;
+	uint16_t th_urp;
+};
+
+#define SNIFF_TH_FIN 0x01
+#define SNIFF_TH_PSH 0x08
+#define SNIFF_TH_CWR 0x80
+
+#define SNIFF_TH_ACK 0x10
+
+#define SNIFF_IP4_PROTO_TCP 6
+#define SNIFF_IP4_DF 0x4000
+#define GSO_HDR_MAX (SIZE_ETHERNET + 60 + 60) /* ethernet, IPv4 & TCP with all their options */
+
+/* GRO, a captured TCP seg held back while the next ones captured continue it, see interface_gro() */
+struct interface_gro {
+	struct finsFrame *ff; /* NULL if none, its pdu starts at the IPv4 header */
+	uint32_t hlen; /* IPv4 + TCP headers */
+	uint32_t len; /* IPv4 len so far */
+	uint32_t seg_len; /* data in the first seg, all merged segs but the last have as much */
+	uint32_t seq_next;
+	uint32_t segs;
+	uint32_t sum; /* partial sum of the data, once a seg has been added */
+};
+
+#define INTERFACE_GRO_MAX 65535 /* IPv4 len of a merged seg */
+
 void interface_init(void);
 void interface_run(pthread_attr_t *fins_pthread_attr);
 void interface_shutdown(void);
@@ -48,6 +97,7 @@ int interface_to_switch(struct finsFrame *ff); //Send a finsFrame to the switch'
 //int interface_fdf_to_daemon(u_char *dataLocal, int len, uint32_t host_ip, uint16_t host_port, uint32_t rem_ip, uint16_t rem_port);
 
 void interface_out_fdf(struct finsFrame *ff);
+void interface_out_fdf_burst(struct finsFrame **ffs, int num);
 void interface_in_fdf(struct finsFrame *ff);
 void interface_fcf(struct finsFrame *ff);
 void interface_exec(struct finsFrame *ff);
@@ -0,0 +1,327 @@
+/**@file test_interface.c
+ *@brief checks GRO in the capture path: runs capturer_to_interface() on a capture ring filled with crafted
+ * TCP segs and checks what it hands the switch, frame by frame: which segs were merged, the merged frame's
+ * len, ip_len, IPv4 & TCP checksums, seq, flags & data. Covers the flush on a short seg, on PSH, at 64 KB
+ * and at the end of a burst, segs of another flow or a non-TCP frame in between, an odd seg len and a seg
+ * with a bad checksum. Then runs a bulk flow GRO merges next to two interleaved ones it can't, counting the
+ * frames the switch gets & the time the capture path takes per seg, which is what GRO costs before IPv4 &
+ * TCP handle a merged frame once. Results go to stderr, so run as ./test_interface > /dev/null to drop the
+ * debug output.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <finschecksum.h>
+#include "interface.h"
+
+#define TEST_RING FINS_SHM_ROOT "/fins_test_capture"
+#define TEST_SRC_IP 0x0a000002
+#define TEST_DST_IP 0x0a000001
+#define TEST_MSS 1448
+#define TEST_OPT_BYTES 12 //timestamps, as Linux sends them
+#define TEST_HLEN (SIZE_ETHERNET + 20 + 20 + TEST_OPT_BYTES)
+#define TEST_FRAMES_MAX 64
+#define TEST_WAIT_NS 1000000000ull
+#define TEST_BULK_SEGS 200000
+#define TEST_BULK_INFLIGHT 512
+
+extern int interface_running;
+extern finsRing Interface_to_Switch_Queue;
+extern finsShmRing capture_ring;
+struct finsEvent Switch_Event;
+
+void *capturer_to_interface(void *local);
+
+/** what a frame handed to the switch should be */
+struct test_want {
+	uint16_t port;
+	uint32_t seq;
+	uint32_t len; //TCP data
+	uint8_t flags;
+	uint8_t sum_ok;
+};
+
+uint64_t test_now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+uint8_t test_byte(uint32_t seq) {
+	return (uint8_t) (seq * 7 + (seq >> 8));
+}
+
+/** writes one TCP seg with good checksums to the capture ring, unless bad is set */
+void test_seg(uint16_t port, uint32_t seq, uint32_t len, uint8_t flags, int bad) {
+	uint8_t frame[SHM_RING_FRAME_MAX];
+	struct sniff_ethernet *eth = (struct sniff_ethernet *) frame;
+	struct sniff_ip4 *ip = (struct sniff_ip4 *) (frame + SIZE_ETHERNET);
+	struct sniff_tcp *tcp = (struct sniff_tcp *) (ip + 1);
+	uint32_t tcp_len = 20 + TEST_OPT_BYTES + len;
+	uint32_t i;
+
+	memset(frame, 0, TEST_HLEN);
+	eth->ether_type = htons(ETH_TYPE_IP4);
+
+	ip->ip_verlen = 0x45;
+	ip->ip_len = htons(20 + tcp_len);
+	ip->ip_fragoff = htons(SNIFF_IP4_DF);
+	ip->ip_ttl = 64;
+	ip->ip_proto = SNIFF_IP4_PROTO_TCP;
+	ip->ip_src = htonl(TEST_SRC_IP);
+	ip->ip_dst = htonl(TEST_DST_IP);
+	ip->ip_cksum = fins_csum_fold(fins_csum_partial(ip, 20, 0));
+
+	tcp->th_sport = htons(port);
+	tcp->th_dport = htons(80);
+	tcp->th_seq = htonl(seq);
+	tcp->th_ack = htonl(5000);
+	tcp->th_off = ((20 + TEST_OPT_BYTES) / 4) << 4;
+	tcp->th_flags = flags;
+	tcp->th_win = htons(1024);
+	memset(tcp + 1, 1, 2); //NOP NOP
+	((uint8_t *) (tcp + 1))[2] = 8; //TS, same in every seg of a burst
+	((uint8_t *) (tcp + 1))[3] = 10;
+	for (i = 0; i < len; i++) {
+		frame[TEST_HLEN + i] = test_byte(seq + i);
+	}
+	tcp->th_sum = fins_csum_fold(fins_csum_partial(tcp, tcp_len, fins_csum_pseudo(ip->ip_src, ip->ip_dst, SNIFF_IP4_PROTO_TCP, tcp_len, 0)));
+	if (bad) {
+		frame[TEST_HLEN] ^= 0xff;
+	}
+
+	if (!write_shm_ring(capture_ring, frame, TEST_HLEN + len)) {
+		fprintf(stderr, "capture ring full\n");
+		exit(1);
+	}
+}
+
+/** writes an ARP request to the capture ring */
+void test_arp(void) {
+	uint8_t frame[60];
+
+	memset(frame, 0, sizeof(frame));
+	((struct sniff_ethernet *) frame)->ether_type = htons(ETH_TYPE_ARP);
+	write_shm_ring(capture_ring, frame, sizeof(frame));
+}
+
+/** checks one frame handed to the switch against want, returns the number of problems */
+int test_check(struct finsFrame *ff, struct test_want *want) {
+	struct sniff_ip4 *ip = (struct sniff_ip4 *) ff->dataFrame.pdu;
+	struct sniff_tcp *tcp = (struct sniff_tcp *) (ip + 1);
+	uint32_t tcp_len;
+	uint32_t len;
+	uint32_t seq;
+	uint32_t i;
+	int sum_ok;
+	int bad = 0;
+
+	if (want->port == 0) {
+		return ff->destinationID.id != ARP_ID;
+	}
+	if (ff->destinationID.id != IPV4_ID || ff->dataFrame.pduLength < 40) {
+		return 1;
+	}
+
+	tcp_len = ntohs(ip->ip_len) - 20;
+	len = tcp_len - (tcp->th_off >> 4) * 4;
+	seq = ntohl(tcp->th_seq);
+	sum_ok = fins_csum_fold(fins_csum_partial(tcp, tcp_len, fins_csum_pseudo(ip->ip_src, ip->ip_dst, SNIFF_IP4_PROTO_TCP, tcp_len, 0))) == 0;
+
+	bad += ff->dataFrame.pduLength != ntohs(ip->ip_len);
+	bad += fins_csum_fold(fins_csum_partial(ip, 20, 0)) != 0;
+	bad += ntohs(tcp->th_sport) != want->port || seq != want->seq || len != want->len || tcp->th_flags != want->flags || sum_ok != want->sum_ok;
+	if (sum_ok) {
+		for (i = 0; i < len; i++) {
+			if (ff->dataFrame.pdu[ntohs(ip->ip_len) - len + i] != test_byte(seq + i)) {
+				bad++;
+				break;
+			}
+		}
+	}
+	if (bad) {
+		fprintf(stderr, "  got port=%u, seq=%u, len=%u, pduLength=%u, ip_len=%u, flags=0x%x, tcp sum ok=%d\n", ntohs(tcp->th_sport), seq, len,
+				ff->dataFrame.pduLength, ntohs(ip->ip_len), tcp->th_flags, sum_ok);
+		fprintf(stderr, "  want port=%u, seq=%u, len=%u, flags=0x%x, tcp sum ok=%u\n", want->port, want->seq, want->len, want->flags, want->sum_ok);
+	}
+	return bad;
+}
+
+/** publishes what was written to the capture ring as one burst & checks the frames the switch gets */
+int test_burst(char *name, struct test_want *want, int num) {
+	struct finsFrame *ff;
+	uint64_t start;
+	int got = 0;
+	int bad = 0;
+
+	flush_shm_ring(capture_ring);
+
+	start = test_now_ns();
+	while (test_now_ns() - start < TEST_WAIT_NS) {
+		ff = read_ring(Interface_to_Switch_Queue);
+		if (ff == NULL) {
+			if (got == num) {
+				usleep(10000); //anything extra would have come by now
+				if ((ff = read_ring(Interface_to_Switch_Queue)) == NULL) {
+					break;
+				}
+			} else {
+				usleep(100);
+				continue;
+			}
+		}
+		if (got < num) {
+			bad += test_check(ff, &want[got]);
+		}
+		got++;
+		freeFinsFrame(ff);
+	}
+
+	bad += got != num;
+	fprintf(stderr, "%s: %d frames, %s\n", name, got, bad ? "FAILED" : "ok");
+	return bad != 0;
+}
+
+int test_gro(void) {
+	struct test_want want[TEST_FRAMES_MAX];
+	uint32_t seq;
+	int bad = 0;
+	int i;
+
+	//a short seg ends a merge, the segs after it start the next one, flushed when the burst ends
+	for (i = 0; i < 10; i++) {
+		test_seg(1, 1000 + i * TEST_MSS, TEST_MSS, SNIFF_TH_ACK, 0);
+	}
+	seq = 1000 + 10 * TEST_MSS;
+	test_seg(1, seq, 500, SNIFF_TH_ACK, 0);
+	test_seg(1, seq + 500, TEST_MSS, SNIFF_TH_ACK, 0);
+	test_seg(1, seq + 500 + TEST_MSS, TEST_MSS, SNIFF_TH_ACK, 0);
+	want[0] = (struct test_want) { 1, 1000, 10 * TEST_MSS + 500, SNIFF_TH_ACK, 1 };
+	want[1] = (struct test_want) { 1, seq + 500, 2 * TEST_MSS, SNIFF_TH_ACK, 1 };
+	bad += test_burst("short seg", want, 2);
+
+	//PSH ends a merge & is kept on it, a PSH seg with nothing held goes on alone
+	for (i = 0; i < 3; i++) {
+		test_seg(2, 1000 + i * TEST_MSS, TEST_MSS, SNIFF_TH_ACK | (i == 2 ? SNIFF_TH_PSH : 0), 0);
+	}
+	test_seg(2, 1000 + 3 * TEST_MSS, 100, SNIFF_TH_ACK | SNIFF_TH_PSH, 0);
+	want[0] = (struct test_want) { 2, 1000, 3 * TEST_MSS, SNIFF_TH_ACK | SNIFF_TH_PSH, 1 };
+	want[1] = (struct test_want) { 2, 1000 + 3 * TEST_MSS, 100, SNIFF_TH_ACK | SNIFF_TH_PSH, 1 };
+	bad += test_burst("PSH", want, 2);
+
+	//a merged seg stops short of the 16 bit ip_len
+	for (i = 0; i < 50; i++) {
+		test_seg(3, 1000 + i * TEST_MSS, TEST_MSS, SNIFF_TH_ACK, 0);
+	}
+	i = (INTERFACE_GRO_MAX - (TEST_HLEN - SIZE_ETHERNET)) / TEST_MSS;
+	want[0] = (struct test_want) { 3, 1000, i * TEST_MSS, SNIFF_TH_ACK, 1 };
+	want[1] = (struct test_want) { 3, 1000 + i * TEST_MSS, (50 - i) * TEST_MSS, SNIFF_TH_ACK, 1 };
+	bad += test_burst("64 KB", want, 2);
+
+	//another flow in between flushes, as does a non-TCP frame, & order is kept
+	test_seg(4, 1000, TEST_MSS, SNIFF_TH_ACK, 0);
+	test_seg(4, 1000 + TEST_MSS, TEST_MSS, SNIFF_TH_ACK, 0);
+	test_seg(5, 1000, TEST_MSS, SNIFF_TH_ACK, 0);
+	test_seg(4, 1000 + 2 * TEST_MSS, TEST_MSS, SNIFF_TH_ACK, 0);
+	test_arp();
+	test_seg(4, 1000 + 3 * TEST_MSS, TEST_MSS, SNIFF_TH_ACK, 0);
+	want[0] = (struct test_want) { 4, 1000, 2 * TEST_MSS, SNIFF_TH_ACK, 1 };
+	want[1] = (struct test_want) { 5, 1000, TEST_MSS, SNIFF_TH_ACK, 1 };
+	want[2] = (struct test_want) { 4, 1000 + 2 * TEST_MSS, TEST_MSS, SNIFF_TH_ACK, 1 };
+	want[3] = (struct test_want) { 0 };
+	want[4] = (struct test_want) { 4, 1000 + 3 * TEST_MSS, TEST_MSS, SNIFF_TH_ACK, 1 };
+	bad += test_burst("other flow", want, 5);
+
+	//an odd seg len would put the next seg's data at an odd offset, so nothing is merged onto it
+	test_seg(6, 1000, TEST_MSS - 1, SNIFF_TH_ACK, 0);
+	test_seg(6, 1000 + TEST_MSS - 1, TEST_MSS - 1, SNIFF_TH_ACK, 0);
+	want[0] = (struct test_want) { 6, 1000, TEST_MSS - 1, SNIFF_TH_ACK, 1 };
+	want[1] = (struct test_want) { 6, 1000 + TEST_MSS - 1, TEST_MSS - 1, SNIFF_TH_ACK, 1 };
+	bad += test_burst("odd len", want, 2);
+
+	//a bad seg isn't merged onto a good one or a good one onto it, TCP gets it as it came & drops it
+	for (i = 0; i < 5; i++) {
+		test_seg(7, 1000 + i * TEST_MSS, TEST_MSS, SNIFF_TH_ACK, i == 2);
+	}
+	want[0] = (struct test_want) { 7, 1000, 2 * TEST_MSS, SNIFF_TH_ACK, 1 };
+	want[1] = (struct test_want) { 7, 1000 + 2 * TEST_MSS, TEST_MSS, SNIFF_TH_ACK, 0 };
+	want[2] = (struct test_want) { 7, 1000 + 3 * TEST_MSS, 2 * TEST_MSS, SNIFF_TH_ACK, 1 };
+	bad += test_burst("bad checksum", want, 3);
+
+	return bad;
+}
+
+/** frames the switch gets for TEST_BULK_SEGS segs, written a ring's worth at a time, & ns per seg */
+uint32_t test_bulk(int interleave, double *ns) {
+	struct finsFrame *ff;
+	uint64_t start;
+	uint32_t written = 0;
+	uint32_t frames = 0;
+	uint32_t data = 0;
+	uint32_t seq[2] = { 1000, 1000 };
+	struct sniff_ip4 *ip;
+	int flow;
+
+	start = test_now_ns();
+	while (data < TEST_BULK_SEGS * TEST_MSS) {
+		//no more in flight than the switch queue holds, even if none are merged
+		while (written < TEST_BULK_SEGS && written - data / TEST_MSS < TEST_BULK_INFLIGHT && space_shm_ring(capture_ring) > 0) {
+			flow = interleave ? written & 1 : 0;
+			test_seg(10 + flow, seq[flow], TEST_MSS, SNIFF_TH_ACK, 0);
+			seq[flow] += TEST_MSS;
+			written++;
+			if (written % 32 == 0) {
+				flush_shm_ring(capture_ring);
+			}
+		}
+		flush_shm_ring(capture_ring);
+
+		while ((ff = read_ring(Interface_to_Switch_Queue)) != NULL) {
+			ip = (struct sniff_ip4 *) ff->dataFrame.pdu;
+			data += ntohs(ip->ip_len) - (TEST_HLEN - SIZE_ETHERNET);
+			frames++;
+			freeFinsFrame(ff);
+		}
+	}
+	*ns = (double) (test_now_ns() - start) / TEST_BULK_SEGS;
+
+	return frames;
+}
+
+int main(int argc, char *argv[]) {
+	pthread_t thread;
+	uint32_t merged, alone;
+	double merged_ns, alone_ns;
+	int bad = 0;
+
+	Interface_to_Switch_Queue = init_ring("interface_to_switch", 1024);
+	init_event(&Switch_Event);
+	capture_ring = create_shm_ring(TEST_RING, SHM_RING_SLOTS);
+
+	interface_running = 1;
+	pthread_create(&thread, NULL, capturer_to_interface, NULL);
+
+	bad += test_gro();
+
+	merged = test_bulk(0, &merged_ns);
+	alone = test_bulk(1, &alone_ns);
+	fprintf(stderr, "\n%u segs of %u bytes\n", TEST_BULK_SEGS, TEST_MSS);
+	fprintf(stderr, "one flow:         %u frames to the switch, %.0f ns/seg captured\n", merged, merged_ns);
+	fprintf(stderr, "two interleaved:  %u frames to the switch, %.0f ns/seg captured\n", alone, alone_ns);
+	if (merged >= alone) {
+		bad++;
+	}
+
+	interface_running = 0;
+	wake_shm_ring(capture_ring);
+	pthread_join(thread, NULL);
+	close_shm_ring(capture_ring);
+	unlink(TEST_RING);
+
+	return bad != 0;
+}
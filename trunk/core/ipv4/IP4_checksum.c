@@ -5,20 +5,7 @@
 
 #include "ipv4.h"
 
+/** returns the checksum in network order, 0 if a header with its checksum in checks out */
 uint16_t IP4_checksum(struct ip4_packet* ptr, int length) {
-
-	int sum = 0;
-	u_short ret = 0;
-	uint16_t *w = (uint16_t*) ptr;
-	int nleft = length;
-
-	while (nleft > 1) {
-		sum += *w++;
-		nleft -= 2;
-	}
-
-	sum = (sum >> 16) + (sum & 0xFFFF);
-	sum += (sum >> 16);
-	ret = ~sum;
-	return (ret);
+	return fins_csum_fold(fins_csum_partial(ptr, length, 0));
 }
@@ -14,6 +14,15 @@ int IP4_forward(struct finsFrame *ff, struct ip4_packet* ppacket, IP4addr dest,
 
 	struct ip4_next_hop_info next_hop = IP4_next_hop(dest);
 	if (next_hop.interface >= 0) {
+		//one hop less, patch the header checksum for the ttl/proto word instead of redoing it
+		uint16_t old_word;
+		uint16_t new_word;
+
+		memcpy(&old_word, &ppacket->ip_ttl, 2);
+		ppacket->ip_ttl--;
+		memcpy(&new_word, &ppacket->ip_ttl, 2);
+		ppacket->ip_cksum = fins_csum_update16(ppacket->ip_cksum, old_word, new_word);
+
 		//IP4_send_fdf_out(ff, ppacket, next_hop, length); //TODO uncommenct/fix
 		return 1;
 	}
@@ -1,48 +1,54 @@
 #include "ipv4.h"
 
-struct ip4_fragment IP4_fragment_data(void *data, uint16_t length,
-		uint16_t offset, uint16_t fragment_size) {
-	struct ip4_fragment fragment;
-	if ((offset + fragment_size) >= length) {
-		fragment.first = offset;
-		fragment.last = length;
-		fragment.data_length = length - offset;
-		fragment.more_fragments = 0;
-		fragment.data = data + offset;
-		PRINT_DEBUG("");
-		return (fragment);
-	}
+/** fills in the per fragment fields of header and writes it out at dst */
+static void IP4_fragment_header(struct ip4_packet *header, uint8_t *dst, uint32_t offset, uint32_t len, int more) {
+	header->ip_len = htons(IP4_MIN_HLEN + len);
+	header->ip_fragoff = htons((more ? IP4_MF << 13 : 0) | offset >> 3);
+	header->ip_cksum = 0;
+	header->ip_cksum = IP4_checksum(header, IP4_MIN_HLEN);
+	memcpy(dst, header, IP4_MIN_HLEN);
+}
 
-	/* Take care of a special case when the fragment is less than 8 bytes larger that then
-	 * the fragment size
-	 */
-	if ((offset + fragment_size + 8) > length) {
-		fragment.first = offset;
-		fragment.last = length - (length - offset) % 8;
-		fragment.data_length = fragment.last - fragment.first;
+/**@brief splits a datagram bigger than IP4_PCK_LEN into fragments without copying its data. The first
+ * fragment is ff cut short, with its header pushed in front. The others get a pdu holding just their
+ * header, with their data attached from ff's pdu (see attachFinsPdu()), or copied in if it isn't pooled.
+ * @param ff the frame with length bytes of data, becomes the first fragment
+ * @param header the datagram's header, ip_len, ip_fragoff and ip_cksum are set per fragment
+ * @param length the data length
+ * @param ffs receives the fragments in order, room for IP4_FRAG_MAX
+ * @return the number of fragments
+ */
+int IP4_fragment_data(struct finsFrame *ff, struct ip4_packet *header, uint16_t length, struct finsFrame **ffs) {
+	uint8_t *data = ff->dataFrame.pdu;
+	struct finsFrame *frag;
+	uint32_t offset;
+	uint32_t len;
+	int num = 1;
 
-#ifdef DEBUG
-		if (fragment.data_length % 8 != 0)
-		{
-			PRINT_DEBUG("Problem with fragment data length. Not a multiple of 8");
-		}
-#endif
+	//the first fragment last, pushing its header may move the data if the pdu isn't pooled
+	for (offset = IP4_FRAG_LEN; offset < length; offset += len, num++) {
+		len = length - offset > IP4_FRAG_LEN ? IP4_FRAG_LEN : length - offset;
 
-		fragment.more_fragments = 1;
-		return (fragment);
+		frag = allocFinsFrame();
+		frag->dataOrCtrl = DATA;
+		frag->dataFrame.directionFlag = DOWN;
+		frag->dataFrame.pduLength = IP4_MIN_HLEN;
+		frag->dataFrame.pdu = allocFinsPdu(IP4_MIN_HLEN);
+		if (!attachFinsPdu(frag, data + offset, len)) {
+			PRINT_DEBUG("copying: ff=%p, offset=%u, len=%u", ff, offset, len);
+			freeFinsPdu(frag->dataFrame.pdu);
+			frag->dataFrame.pduLength = IP4_MIN_HLEN + len;
+			frag->dataFrame.pdu = allocFinsPdu(frag->dataFrame.pduLength);
+			memcpy(frag->dataFrame.pdu + IP4_MIN_HLEN, data + offset, len);
+		}
+		IP4_fragment_header(header, frag->dataFrame.pdu, offset, len, offset + len < length);
+		ffs[num] = frag;
 	}
 
-	fragment.first = offset;
-	fragment.last = offset + fragment_size;
-	fragment.data_length = fragment_size;
-#ifdef DEBUG
-	if (fragment.data_length % 8 != 0)
-	{
-		PRINT_DEBUG("Problem with fragment data length. Not a multiple of 8");
-	}
-#endif
-	fragment.more_fragments = 1;
-	PRINT_DEBUG("");
+	ff->dataFrame.pduLength = IP4_FRAG_LEN;
+	IP4_fragment_header(header, pushFinsPdu(ff, IP4_MIN_HLEN), 0, IP4_FRAG_LEN, 1);
+	ffs[0] = ff;
 
-	return (fragment);
+	PRINT_DEBUG("Exited: ff=%p, length=%u, num=%d", ff, length, num);
+	return num;
 }
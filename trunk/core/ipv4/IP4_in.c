@@ -133,8 +133,7 @@ void IP4_in(struct finsFrame *ff, struct ip4_packet* ppacket, int len) {
 		return;
 	} else {
 		PRINT_DEBUG("Packet ID %d is fragmented", header.id);
-		struct ip4_packet* ppacket_reassembled = IP4_reass(&header, ppacket);
-		//free ppacket
+		struct ip4_packet* ppacket_reassembled = IP4_reass(ff, &header, ppacket); //takes ff unless it completes the packet
 		if (ppacket_reassembled != NULL) {
 			stats.delivered++;
 			stats.reassembled++;
@@ -144,3 +143,16 @@ void IP4_in(struct finsFrame *ff, struct ip4_packet* ppacket, int len) {
 	}
 
 }
+
+/**@brief IP4_in() for a run of packets from the interface, the next header is fetched while one is handled */
+void IP4_in_burst(struct finsFrame **ffs, int num) {
+	int i;
+
+	PRINT_DEBUG("Entered: ff=%p, num=%d", ffs[0], num);
+	for (i = 0; i < num; i++) {
+		if (i + 1 < num) {
+			__builtin_prefetch(ffs[i + 1]->dataFrame.pdu);
+		}
+		IP4_in(ffs[i], (struct ip4_packet*) ffs[i]->dataFrame.pdu, ffs[i]->dataFrame.pduLength);
+	}
+}
@@ -15,6 +15,7 @@ void IP4_init(void) {
 	PRINT_DEBUG("after constr pckt buff");
 	routing_table = IP4_sort_routing_table(IP4_get_routing_table());
 	PRINT_DEBUG("after ip4 sort route table");
+	IP4_route_update(routing_table);
 	memset(&stats, 0, sizeof(struct ip4_stats));
 	PRINT_DEBUG("after memset");
 #ifdef DEBUG
@@ -6,30 +6,325 @@
  */
 #include "ipv4.h"
 
-extern struct ip4_routing_table* routing_table;
+/** the trie lookups use, replaced whole by IP4_route_update() */
+static struct ip4_route_trie *route_trie;
+/** the one before it, freed on the next update so a lookup still inside it can finish */
+static struct ip4_route_trie *route_retired;
+
+struct route_entry {
+	uint32_t prefix;
+	uint32_t len;
+	uint32_t order; //position in the table, the first of equal routes wins
+	uint32_t value;
+};
+
+/** the trie while it is built, chunks are plain 256 entry arrays until they are compressed */
+struct route_build {
+	uint32_t *root;
+	uint32_t *chunks;
+	uint32_t chunk_num;
+	uint32_t chunk_max;
+	uint32_t node_max;
+	uint32_t leaf_max;
+};
+
+static int route_cmp(const void *a, const void *b) {
+	const struct route_entry *ra = (const struct route_entry *) a;
+	const struct route_entry *rb = (const struct route_entry *) b;
+
+	if (ra->len != rb->len) {
+		return ra->len < rb->len ? -1 : 1;
+	}
+	return ra->order > rb->order ? -1 : (ra->order < rb->order); //later ones first, so earlier ones overwrite them
+}
+
+/** makes room for num entries of size in array, doubling it */
+static void *route_grow(void *array, uint32_t num, uint32_t *max, size_t size) {
+	if (num > *max) {
+		for (*max = *max ? *max : 64; *max < num; *max *= 2)
+			;
+		array = realloc(array, *max * size);
+		if (array == NULL) {
+			PRINT_ERROR("alloc fail: max=%u", *max);
+			exit(-1);
+		}
+	}
+	return array;
+}
+
+/** a new chunk with every entry set to value, the one it is pushed down from */
+static uint32_t route_chunk(struct route_build *build, uint32_t value) {
+	uint32_t i;
+
+	build->chunks = (uint32_t *) route_grow(build->chunks, build->chunk_num + 1, &build->chunk_max, IP4_TRIE_CHUNK * sizeof(uint32_t));
+
+	uint32_t *chunk = build->chunks + build->chunk_num * IP4_TRIE_CHUNK;
+	for (i = 0; i < IP4_TRIE_CHUNK; i++) {
+		chunk[i] = value;
+	}
+	return IP4_TRIE_PTR | build->chunk_num++;
+}
+
+/** sets a leaf, or every leaf under it if it already has a chunk below */
+static void route_set(struct route_build *build, uint32_t *slot, uint32_t value) {
+	uint32_t i;
+
+	if (*slot & IP4_TRIE_PTR) {
+		uint32_t *chunk = build->chunks + (*slot & ~IP4_TRIE_PTR) * IP4_TRIE_CHUNK;
+		for (i = 0; i < IP4_TRIE_CHUNK; i++) {
+			route_set(build, &chunk[i], value);
+		}
+	} else {
+		*slot = value;
+	}
+}
+
+static void route_insert(struct route_build *build, uint32_t prefix, uint32_t len, uint32_t value) {
+	uint32_t base;
+	uint32_t first;
+	uint32_t i;
+
+	if (len <= IP4_TRIE_ROOT_BITS) {
+		first = prefix >> 16;
+		for (i = 0; i < (1u << (16 - len)); i++) {
+			route_set(build, &build->root[first + i], value);
+		}
+		return;
+	}
+
+	//push the route already covering it down into a chunk, if there is no chunk yet
+	first = prefix >> 16;
+	if (!(build->root[first] & IP4_TRIE_PTR)) {
+		build->root[first] = route_chunk(build, build->root[first]);
+	}
+	base = (build->root[first] & ~IP4_TRIE_PTR) * IP4_TRIE_CHUNK;
+	if (len <= 24) {
+		first = (prefix >> 8) & 0xFF;
+		for (i = 0; i < (1u << (24 - len)); i++) {
+			route_set(build, &build->chunks[base + first + i], value);
+		}
+		return;
+	}
+
+	first = base + ((prefix >> 8) & 0xFF);
+	if (!(build->chunks[first] & IP4_TRIE_PTR)) {
+		uint32_t chunk = route_chunk(build, build->chunks[first]); //moves chunks
+		build->chunks[first] = chunk;
+	}
+	base = (build->chunks[first] & ~IP4_TRIE_PTR) * IP4_TRIE_CHUNK;
+	first = prefix & 0xFF;
+	for (i = 0; i < (1u << (32 - len)); i++) {
+		build->chunks[base + first + i] = value;
+	}
+}
+
+/** compresses a chunk into trie->nodes[index], its children go in one block so they can be ranked */
+static void route_compress(struct ip4_route_trie *trie, struct route_build *build, uint32_t chunk, uint32_t index) {
+	uint32_t *entry = build->chunks + chunk * IP4_TRIE_CHUNK;
+	struct ip4_trie_node node;
+	uint32_t children = 0;
+	uint32_t last = 0;
+	uint32_t child;
+	int w, b, i;
+
+	memset(&node, 0, sizeof(node));
+	for (w = 0; w < 4; w++) {
+		node.node[w] = trie->node_num + children;
+		node.leaf[w] = trie->leaf_num;
+		for (b = 0; b < 64; b++) {
+			i = 64 * w + b;
+			if (entry[i] & IP4_TRIE_PTR) {
+				node.vector[w] |= 1ull << b;
+				children++;
+			} else if (node.leafvec[w] == 0 || entry[i] != last) {
+				node.leafvec[w] |= 1ull << b;
+				trie->leaves = (uint32_t *) route_grow(trie->leaves, trie->leaf_num + 1, &build->leaf_max, sizeof(uint32_t));
+				trie->leaves[trie->leaf_num++] = entry[i];
+				last = entry[i];
+			}
+		}
+	}
+
+	child = trie->node_num;
+	trie->node_num += children;
+	trie->nodes = (struct ip4_trie_node *) route_grow(trie->nodes, trie->node_num, &build->node_max, sizeof(struct ip4_trie_node));
+	trie->nodes[index] = node;
+
+	for (i = 0; i < IP4_TRIE_CHUNK; i++) {
+		if (entry[i] & IP4_TRIE_PTR) {
+			route_compress(trie, build, entry[i] & ~IP4_TRIE_PTR, child++);
+		}
+	}
+}
+
+/**@brief compiles a routing table into a trie. Routes are inserted shortest first so longer ones
+ * overwrite them, a route with dst 0 is taken as the default route whatever its mask. */
+struct ip4_route_trie *IP4_route_build(struct ip4_routing_table *table) {
+	struct ip4_routing_table *entry;
+	struct route_entry *routes;
+	struct route_build build;
+	uint32_t node;
+	uint32_t num = 0;
+	uint32_t i;
+
+	struct ip4_route_trie *trie = (struct ip4_route_trie *) malloc(sizeof(struct ip4_route_trie));
+	if (trie == NULL) {
+		PRINT_ERROR("trie alloc fail");
+		exit(-1);
+	}
+	memset(trie, 0, sizeof(struct ip4_route_trie));
+
+	for (entry = table; entry != NULL; entry = entry->next_entry) {
+		num++;
+	}
+	if (num == 0) {
+		return trie;
+	}
+
+	routes = (struct route_entry *) malloc(num * sizeof(struct route_entry));
+	trie->hops = (struct ip4_next_hop_info *) malloc(num * sizeof(struct ip4_next_hop_info));
+	if (routes == NULL || trie->hops == NULL) {
+		PRINT_ERROR("routes alloc fail: num=%u", num);
+		exit(-1);
+	}
+
+	for (entry = table, i = 0; entry != NULL; entry = entry->next_entry, i++) {
+		routes[i].len = entry->dst == 0 ? 0 : (entry->mask > 32 ? 32 : entry->mask);
+		routes[i].prefix = routes[i].len ? (uint32_t) entry->dst & (0xFFFFFFFF << (32 - routes[i].len)) : 0;
+		routes[i].order = i;
+		routes[i].value = i + 1;
+
+		trie->hops[i].address = entry->gw;
+		trie->hops[i].interface = entry->interface;
+	}
+	trie->hop_num = num;
+
+	memset(&build, 0, sizeof(build));
+	build.root = trie->root;
+	qsort(routes, num, sizeof(struct route_entry), route_cmp);
+	for (i = 0; i < num; i++) {
+		route_insert(&build, routes[i].prefix, routes[i].len, routes[i].value);
+	}
+	free(routes);
+
+	for (i = 0; i < IP4_TRIE_ROOT; i++) {
+		if (trie->root[i] & IP4_TRIE_PTR) {
+			node = trie->node_num++;
+			trie->nodes = (struct ip4_trie_node *) route_grow(trie->nodes, trie->node_num, &build.node_max, sizeof(struct ip4_trie_node));
+			route_compress(trie, &build, trie->root[i] & ~IP4_TRIE_PTR, node);
+			trie->root[i] = IP4_TRIE_PTR | node;
+		}
+	}
+	free(build.chunks);
+
+	PRINT_DEBUG("routes=%u, chunks=%u, nodes=%u, leaves=%u", num, build.chunk_num, trie->node_num, trie->leaf_num);
+	return trie;
+}
+
+void IP4_route_free(struct ip4_route_trie *trie) {
+	if (trie) {
+		free(trie->nodes);
+		free(trie->leaves);
+		free(trie->hops);
+		free(trie);
+	}
+}
+
+/**@brief builds a trie from table and swaps it in, the table is not kept. Called from one thread. */
+void IP4_route_update(struct ip4_routing_table *table) {
+	struct ip4_route_trie *trie = IP4_route_build(table);
+
+	IP4_route_free(route_retired);
+	route_retired = __atomic_exchange_n(&route_trie, trie, __ATOMIC_ACQ_REL);
+}
+
+void IP4_route_release(void) {
+	IP4_route_free(route_retired);
+	IP4_route_free(route_trie);
+	route_retired = route_trie = NULL;
+}
+
+/** entry i of a node, a node index | IP4_TRIE_PTR or a leaf */
+static inline uint32_t route_node(struct ip4_route_trie *trie, struct ip4_trie_node *node, uint32_t i) {
+	uint32_t w = i >> 6;
+	uint64_t upto = ~0ull >> (63 - (i & 63)); //bits up to and including i
+
+	if (node->vector[w] & (1ull << (i & 63))) {
+		return IP4_TRIE_PTR | (node->node[w] + __builtin_popcountll(node->vector[w] & (upto >> 1)));
+	}
+	return trie->leaves[node->leaf[w] + __builtin_popcountll(node->leafvec[w] & upto) - 1];
+}
+
+static inline uint32_t route_lookup(struct ip4_route_trie *trie, uint32_t dst) {
+	uint32_t value = trie->root[dst >> 16];
+
+	if (value & IP4_TRIE_PTR) {
+		value = route_node(trie, &trie->nodes[value & ~IP4_TRIE_PTR], (dst >> 8) & 0xFF);
+		if (value & IP4_TRIE_PTR) {
+			value = route_node(trie, &trie->nodes[value & ~IP4_TRIE_PTR], dst & 0xFF);
+		}
+	}
+	return value;
+}
+
+static inline void route_hop(struct ip4_route_trie *trie, uint32_t value, IP4addr dst, struct ip4_next_hop_info *info) {
+	if (value == 0) {
+		info->interface = -1;
+	} else if (trie->hops[value - 1].address == 0) { // dst host in on our net, can be contacted directly
+		info->address = dst;
+		info->interface = trie->hops[value - 1].interface;
+	} else { // dst host is outside of our net, needs to be contacted via gw
+		*info = trie->hops[value - 1];
+	}
+}
 
 struct ip4_next_hop_info IP4_next_hop(IP4addr dst) {
+	struct ip4_route_trie *trie = __atomic_load_n(&route_trie, __ATOMIC_ACQUIRE);
 	struct ip4_next_hop_info info;
-	IP4addr mask;
-	struct ip4_routing_table* current_table_entry = routing_table;
-	while (current_table_entry != NULL) {
-		mask = (uint32_t)((0xffffffff << (IP4_ALEN * 8 - current_table_entry->mask)) & 0xffffffff);
-		if (((current_table_entry->dst & mask) == (dst & mask)) | (current_table_entry->dst == 0)) // if dst=0, this is the default route, always match
-				{
-			if (current_table_entry->gw == 0) // dst host in on our net, can be contacted directly
-					{
-				info.address = dst;
-				info.interface = current_table_entry->interface;
-				return info;
-			} else // dst host is outside of our net, needs to be contacted via gw
-			{
-				info.address = current_table_entry->gw;
-				info.interface = current_table_entry->interface;
-				return info;
+
+	if (trie == NULL) {
+		info.interface = -1;
+		return info;
+	}
+	route_hop(trie, route_lookup(trie, (uint32_t) dst), dst, &info);
+	return info;
+}
+
+/**@brief resolves count destinations against the same trie. They go through in groups, each level's
+ * loads for the whole group are started before any of them is used, so the cache misses overlap. */
+void IP4_next_hop_burst(IP4addr *dst, struct ip4_next_hop_info *info, int count) {
+	struct ip4_route_trie *trie = __atomic_load_n(&route_trie, __ATOMIC_ACQUIRE);
+	uint32_t value[IP4_HOP_GROUP];
+	int group;
+	int i;
+
+	if (trie == NULL) {
+		for (i = 0; i < count; i++) {
+			info[i].interface = -1;
+		}
+		return;
+	}
+
+	for (; count > 0; count -= group, dst += group, info += group) {
+		group = count < IP4_HOP_GROUP ? count : IP4_HOP_GROUP;
+
+		for (i = 0; i < group; i++) {
+			__builtin_prefetch(&trie->root[(uint32_t) dst[i] >> 16]);
+		}
+		for (i = 0; i < group; i++) {
+			value[i] = trie->root[(uint32_t) dst[i] >> 16];
+			if (value[i] & IP4_TRIE_PTR) {
+				__builtin_prefetch(&trie->nodes[value[i] & ~IP4_TRIE_PTR]);
 			}
 		}
-		current_table_entry = current_table_entry->next_entry;
+		for (i = 0; i < group; i++) {
+			if (value[i] & IP4_TRIE_PTR) {
+				value[i] = route_node(trie, &trie->nodes[value[i] & ~IP4_TRIE_PTR], ((uint32_t) dst[i] >> 8) & 0xFF);
+				if (value[i] & IP4_TRIE_PTR) {
+					value[i] = route_node(trie, &trie->nodes[value[i] & ~IP4_TRIE_PTR], (uint32_t) dst[i] & 0xFF);
+				}
+			}
+			route_hop(trie, value[i], dst[i], &info[i]);
+		}
 	}
-	info.interface = -1;
-	return info;
 }
@@ -10,20 +10,9 @@
 
 extern struct ip4_stats stats;
 
-//extern struct ip4_packet *construct_packet_buffer;
-void IP4_out(struct finsFrame *ff, uint16_t length, IP4addr source, uint8_t protocol) {
-	PRINT_DEBUG("Entered: ff=%p, meta=%p, len=%u, src=%lu, proto=%u", ff, ff->metaData, length, source, protocol);
-
-	//print_finsFrame(ff);
-	//char *data = (char *) ((ff->dataFrame).pdu);
-	PRINT_DEBUG("");
-
-	//uint8_t more_fragments = 1;
-	//uint16_t offset = 0;
-	IP4addr destination;
-
-	struct ip4_next_hop_info next_hop;
-	//struct ip4_fragment fragment;
+/** sends a packet whose route has been looked up */
+static void IP4_out_routed(struct finsFrame *ff, uint16_t length, IP4addr source, IP4addr destination, uint8_t protocol,
+		struct ip4_next_hop_info next_hop) {
 	struct ip4_packet_header construct_packet;
 	struct ip4_packet *construct_packet_buffer;
 
@@ -31,17 +20,6 @@ void IP4_out(struct finsFrame *ff, uint16_t length, IP4addr source, uint8_t prot
 	construct_packet_buffer = (struct ip4_packet *) &construct_packet;
 	PRINT_DEBUG("");
 
-	int ret = 0;
-	ret += metadata_readFromElement(ff->metaData, "send_dst_ip", &destination) == META_FALSE;
-
-	if (ret) {
-		PRINT_ERROR("todo error");
-
-		//TODO error
-	}
-
-	PRINT_DEBUG("");
-
 	IP4_const_header(construct_packet_buffer, source, destination, protocol);
 
 	uint32_t send_ttl;
@@ -54,56 +32,101 @@ void IP4_out(struct finsFrame *ff, uint16_t length, IP4addr source, uint8_t prot
 		//TODO implement
 	}
 
-	PRINT_DEBUG("");
-	/** TODO
-	 * finding out what is wrong with the fragmentation and reimplement it
-	 * correctly
-	 * Notice that the current implementation support mutlithreading
-	 * while the basic opf the implemented fragmentation is based on having one
-	 * global packet to hold the contents
-	 */
-	/**
-	 while (more_fragments)
-	 {
-	 fragment = IP4_fragment_data(data, length, offset, IP4_PCK_LEN
-	 - IP4_MIN_HLEN);
-	 memcpy(fragment.data, construct_packet_buffer->ip_data,
-	 fragment.data_length);
-	 construct_packet_buffer->ip_fragoff = htons(fragment.first >> 3);
-	 construct_packet_buffer->ip_len = htons(fragment.data_length
-	 + IP4_MIN_HLEN);
-	 more_fragments = fragment.more_fragments;
-	 next_hop = IP4_next_hop(destination);
-	 if (next_hop.interface>=0)
-	 {
-	 stats.outfragments++;
-	 PRINT_DEBUG("");
-	 print_finsFrame(ff);
-	 IP4_send_fdf_out(ff, construct_packet_buffer, next_hop, fragment.data_length);
-	 }
-	 else
-	 {
-	 PRINT_DEBUG("No route to the destination, packet discarded");
-	 }
-	 more_fragments = fragment.more_fragments;
-	 offset = fragment.last + 1;
-	 }
-
-	 */
-	construct_packet_buffer->ip_fragoff = htons(0);
-	construct_packet_buffer->ip_id = htons(0);
-	construct_packet_buffer->ip_len = htons(length + IP4_MIN_HLEN);
-	construct_packet_buffer->ip_cksum = 0;
-	construct_packet_buffer->ip_cksum = IP4_checksum(construct_packet_buffer, IP4_MIN_HLEN);
-
-	next_hop = IP4_next_hop(destination);
+	//a TCP super-segment goes down whole, the interface cuts it into packets that fit and fixes up each header
+	uint32_t gso_size = 0;
+	metadata_readFromElement(ff->metaData, "send_gso_size", &gso_size);
+
 	if (next_hop.interface >= 0) {
-		//stats.outfragments++;
-		PRINT_DEBUG("");
-		//print_finsFrame(ff);
-		IP4_send_fdf_out(ff, construct_packet_buffer, next_hop, length);
+		if (length + IP4_MIN_HLEN <= IP4_PCK_LEN || (gso_size && protocol == IP4_PT_TCP)) {
+			construct_packet_buffer->ip_fragoff = htons(0);
+			construct_packet_buffer->ip_id = htons(0);
+			construct_packet_buffer->ip_len = htons(length + IP4_MIN_HLEN);
+			construct_packet_buffer->ip_cksum = 0;
+			construct_packet_buffer->ip_cksum = IP4_checksum(construct_packet_buffer, IP4_MIN_HLEN);
+
+			ff->dataFrame.pduLength = length;
+			memcpy(pushFinsPdu(ff, IP4_MIN_HLEN), construct_packet_buffer, IP4_MIN_HLEN); //header goes in the headroom of the transport pdu
+			IP4_send_fdf_out(&ff, 1, next_hop);
+		} else {
+			struct finsFrame *ffs[IP4_FRAG_MAX];
+			int num = IP4_fragment_data(ff, construct_packet_buffer, length, ffs);
+
+			stats.fragmented++;
+			stats.outfragments += num;
+			IP4_send_fdf_out(ffs, num, next_hop);
+		}
 	} else {
 		PRINT_ERROR("No route to the destination, packet discarded");
 		freeFinsFrame(ff);
 	}
 }
+
+//extern struct ip4_packet *construct_packet_buffer;
+void IP4_out(struct finsFrame *ff, uint16_t length, IP4addr source, uint8_t protocol) {
+	PRINT_DEBUG("Entered: ff=%p, meta=%p, len=%u, src=%lu, proto=%u", ff, ff->metaData, length, source, protocol);
+
+	//print_finsFrame(ff);
+	//char *data = (char *) ((ff->dataFrame).pdu);
+	PRINT_DEBUG("");
+
+	IP4addr destination;
+
+	int ret = 0;
+	ret += metadata_readFromElement(ff->metaData, "send_dst_ip", &destination) == META_FALSE;
+
+	if (ret) {
+		PRINT_ERROR("todo error");
+
+		//TODO error
+	}
+
+	PRINT_DEBUG("");
+
+	IP4_out_routed(ff, length, source, destination, protocol, IP4_next_hop(destination));
+}
+
+/**@brief IP4_out() for a run of frames from the transport modules. The routes are looked up together
+ * with IP4_next_hop_burst(), the protocol of each frame comes from its "send_protocol"
+ */
+void IP4_out_burst(struct finsFrame **ffs, int num, IP4addr source) {
+	PRINT_DEBUG("Entered: ff=%p, num=%d, src=%lu", ffs[0], num, source);
+
+	IP4addr destination[RING_BURST];
+	struct ip4_next_hop_info next_hop[RING_BURST];
+	uint8_t protocol[RING_BURST];
+	uint32_t send_protocol;
+	int i, j;
+
+	for (; num > 0; num -= j, ffs += j) {
+		j = num < RING_BURST ? num : RING_BURST;
+
+		for (i = 0; i < j; i++) {
+			send_protocol = 0;
+			if (metadata_readFromElement(ffs[i]->metaData, "send_protocol", &send_protocol) == META_FALSE) {
+				PRINT_ERROR("metadata read error: ff=%p", ffs[i]);
+			}
+			protocol[i] = (uint8_t) send_protocol;
+
+			destination[i] = 0;
+			if (metadata_readFromElement(ffs[i]->metaData, "send_dst_ip", &destination[i]) == META_FALSE) {
+				PRINT_ERROR("todo error");
+			}
+		}
+
+		IP4_next_hop_burst(destination, next_hop, j);
+
+		for (i = 0; i < j; i++) {
+			switch (protocol[i]) {
+			case IP4_PT_ICMP:
+			case IP4_PT_TCP:
+			case IP4_PT_UDP:
+				IP4_out_routed(ffs[i], ffs[i]->dataFrame.pduLength, source, destination[i], protocol[i], next_hop[i]);
+				break;
+			default:
+				PRINT_ERROR("invalid protocol: protocol=%u", protocol[i]);
+				freeFinsFrame(ffs[i]);
+				break;
+			}
+		}
+	}
+}
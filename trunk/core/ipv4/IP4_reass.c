@@ -5,282 +5,339 @@
  *      Author: rado
  */
 
+#include <time.h>
 #include "ipv4.h"
 
-/* Variable pointing to the first element of a double
- * linked list holding partially received packets.
- * Must be global so the todo:TTL garbage collector
- * can clean it.
- */
-static struct ip4_reass_list *packet_list = NULL;
+extern struct ip4_stats stats;
 
-/*
- * Function that takes the header struct and the
- * raw IP data of a fragmented IP packet.
- * In case that this fragment is the last one missing to
- * reassemble an IP packet it returns a pointer to it.
- * In case it isn't it returns NULL
+/* Packets being reassembled are found through a hash on (id, src, dst, proto) and
+ * sit in a timing wheel slot for the second they expire, so a fragment costs a
+ * bucket walk and old packets are dropped a slot at a time. Fragments stay in the
+ * pdu they arrived in until the packet is complete, then are copied out once.
+ * Everything held is charged against a global and a per-source budget.
  */
-struct ip4_packet* IP4_reass(struct ip4_header *pheader,
-		struct ip4_packet *ppacket) {
-	struct ip4_reass_list *packet_entry;
+static struct ip4_reass_packet *reass_table[IP4_REASS_HASH];
+static struct ip4_reass_src *reass_srcs[IP4_REASS_SRC_HASH];
+static struct ip4_reass_packet *reass_wheel[IP4_REASS_WHEEL];
+static uint32_t reass_tick; //last second the wheel was turned to
+static uint32_t reass_mem;
+static uint32_t reass_frags;
 
-	if (packet_list == NULL) {
-		packet_entry = packet_list = IP4_new_packet_entry(pheader, NULL, NULL);
-	} else {
-		packet_entry = packet_list;
-		while (1) {
-			if ((packet_entry->header.id == pheader->id)
-					& (packet_entry->header.source == pheader->source)
-					& (packet_entry->header.protocol == pheader->protocol)
-					& (packet_entry->header.destination == pheader->destination)) {
-				break;
-			}
-			if (packet_entry->next_packet == NULL) {
-				struct ip4_reass_list* new_packet_entry = IP4_new_packet_entry(
-						pheader, packet_entry, NULL);
-				packet_entry->next_packet = new_packet_entry;
-				packet_entry = new_packet_entry;
-				break;
-			}
-			packet_entry = packet_entry->next_packet;
+static uint32_t reass_hash(IP4addr source, IP4addr destination, uint16_t id, uint8_t protocol) {
+	uint32_t h = (uint32_t) source * 0x9e3779b1;
+
+	h ^= (uint32_t) destination + ((uint32_t) id << 16 | protocol);
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	return h & (IP4_REASS_HASH - 1);
+}
+
+static uint32_t reass_now(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t) ts.tv_sec;
+}
+
+static struct ip4_reass_src *reass_src_get(IP4addr source) {
+	uint32_t i = ((uint32_t) source * 0x9e3779b1) >> 24 & (IP4_REASS_SRC_HASH - 1);
+	struct ip4_reass_src *src;
+
+	for (src = reass_srcs[i]; src != NULL; src = src->next) {
+		if (src->source == source) {
+			return src;
 		}
 	}
 
-	struct ip4_fragment* fragment = IP4_construct_fragment(pheader, ppacket);
-	PRINT_DEBUG("Packet pointer: %lu",(unsigned long)ppacket); PRINT_DEBUG("Fragment.first: %d",fragment->first); PRINT_DEBUG("Fragment.last: %d",fragment->last); PRINT_DEBUG("Fragment.more_fragments: %d", fragment->more_fragments); PRINT_DEBUG("Fragment.data: %lu", (unsigned long)fragment->data);
+	src = (struct ip4_reass_src *) malloc(sizeof(struct ip4_reass_src));
+	if (src == NULL) {
+		PRINT_ERROR("src alloc fail");
+		exit(-1);
+	}
+	src->source = source;
+	src->mem = 0;
+	src->next = reass_srcs[i];
+	reass_srcs[i] = src;
+	return src;
+}
 
-	IP4_add_fragment(packet_entry, fragment);
+static void reass_src_put(struct ip4_reass_src *src) {
+	uint32_t i = ((uint32_t) src->source * 0x9e3779b1) >> 24 & (IP4_REASS_SRC_HASH - 1);
+	struct ip4_reass_src **link;
 
-	return (NULL);
+	if (src->mem) {
+		return;
+	}
+	for (link = &reass_srcs[i]; *link != src; link = &(*link)->next)
+		;
+	*link = src->next;
+	free(src);
 }
 
-uint8_t IP4_add_fragment(struct ip4_reass_list *list,
-		struct ip4_fragment *fragment) {
-	int i;
-	uint8_t use_fragment = 0;
-	struct ip4_reass_hole *current_hole = NULL, *next_hole_abs_pointer,
-			*prev_hole_abs_pointer, *new_hole;
-
-	for (i = 0; 1; i++) {
-		/* Step 1
-		 * Select the next hole descriptor from the hole descriptor
-		 * list. If there are no more entries, go to step eight.
-		 */
-		if (current_hole == NULL) {
-			current_hole
-					= (struct ip4_reass_hole*) ((unsigned long) list->buffer
-							+ list->first_hole_rel_pointer);
-		} else if (current_hole->next_hole_rel_pointer != 0) {
-			current_hole = IP4_next_hole(current_hole);
-		} else {
-			break;
-		}
-		prev_hole_abs_pointer = IP4_previous_hole(current_hole);
-		next_hole_abs_pointer = IP4_next_hole(current_hole);
-
-		/* Step 2 & 3
-		 * 2. If fragment.first is greater than hole.last, go to step one.
-		 * 3. If fragment.last is less than hole.first, go to step one.
-		 */
-		if ((fragment->first > current_hole->last) || (fragment->last
-				< current_hole->first)) {
-			use_fragment = 0;
-			continue;
-		}
-		use_fragment = 1;
-
-		/* Step 4
-		 * Delete the current entry from the hole descriptor list.
-		 * -(Since  neither  step  two  nor step three was true, the
-		 * newly arrived fragment does interact with this  hole  in
-		 * some  way.    Therefore,  the current descriptor will no
-		 * longer be valid.  We will destroy it, and  in  the  next
-		 * two  steps  we  will  determine  whether  or  not  it is
-		 * necessary to create any new hole descriptors.)
-		 */
-		IP4_remove_hole(current_hole, list);
-
-		/* Step 5
-		 * If fragment.first is greater than hole.first, then  create  a
-		 * new  hole  descriptor "new_hole" with new_hole.first equal to
-		 * hole.first, and new_hole.last equal to  fragment.first  minus
-		 * one.
-		 */
-		if (fragment->first > current_hole->first) {
-			new_hole = current_hole;
-			if (IP4_previous_hole(current_hole) == NULL) {
-				new_hole->prev_hole_rel_pointer = 0;
-				list ->first_hole_rel_pointer = (unsigned long) new_hole
-						- (unsigned long) list->buffer;
-			} else {
-				new_hole->prev_hole_rel_pointer = (unsigned long) new_hole
-						- (unsigned long) IP4_previous_hole(current_hole);
-				IP4_previous_hole(current_hole)->next_hole_rel_pointer
-						= new_hole->prev_hole_rel_pointer;
-			}
+static void reass_charge(struct ip4_reass_packet *packet, int32_t mem) {
+	packet->mem += mem;
+	packet->src->mem += mem;
+	reass_mem += mem;
+}
 
-			if (IP4_next_hole(current_hole) == NULL) {
-				new_hole->next_hole_rel_pointer = 0;
-			} else {
-				new_hole->next_hole_rel_pointer
-						= (unsigned long) IP4_next_hole(current_hole)
-								- (unsigned long) new_hole;
-				IP4_next_hole(current_hole)->prev_hole_rel_pointer
-						= new_hole->next_hole_rel_pointer;
-			}
+static void reass_wheel_remove(struct ip4_reass_packet *packet) {
+	if (packet->wheel_prev) {
+		packet->wheel_prev->wheel_next = packet->wheel_next;
+	} else {
+		reass_wheel[packet->expires & (IP4_REASS_WHEEL - 1)] = packet->wheel_next;
+	}
+	if (packet->wheel_next) {
+		packet->wheel_next->wheel_prev = packet->wheel_prev;
+	}
+}
 
-			new_hole->first = current_hole->first;
-			new_hole->last = fragment->first - 1;
-			list->hole_count++;
-			current_hole = new_hole;
-		}
+/** unlinks a packet and frees it with whatever fragments it still holds */
+static void reass_free(struct ip4_reass_packet *packet) {
+	struct ip4_reass_packet **link;
+	struct ip4_reass_frag *frag;
 
-		/* Step 6
-		 * If fragment.last is less  than  hole.last  and  fragment.more_
-		 * fragments is true, then create a new hole descriptor
-		 * "new_hole", with new_hole.first equal to fragment.last plus
-		 * one and new_hole.last equal to hole.last.
-		 */
-		if ((fragment->last < current_hole->last) && (fragment->more_fragments
-				== 1)) {
-			new_hole = (struct ip4_reass_hole*) ((unsigned long) list->buffer
-					+ (unsigned long) fragment->last + 1);
-
-			if (IP4_previous_hole(current_hole) == NULL) {
-				list->first_hole_rel_pointer = (unsigned long) new_hole
-						- (unsigned long) IP4_previous_hole(current_hole);
-				new_hole->prev_hole_rel_pointer = 0;
-			} else {
-				new_hole->prev_hole_rel_pointer = (unsigned long) new_hole
-						- (unsigned long) IP4_previous_hole(current_hole);
-				IP4_previous_hole(current_hole)->next_hole_rel_pointer
-						= new_hole->prev_hole_rel_pointer;
-			}
+	for (link = &reass_table[reass_hash(packet->source, packet->destination, packet->id, packet->protocol)]; *link != packet; link =
+			&(*link)->next)
+		;
+	*link = packet->next;
+	reass_wheel_remove(packet);
 
-			if (IP4_next_hole(current_hole) == NULL) {
-				new_hole->next_hole_rel_pointer = 0;
-			} else {
-				new_hole->next_hole_rel_pointer
-						= (unsigned long) IP4_next_hole(current_hole)
-								- (unsigned long) new_hole;
-				IP4_next_hole(current_hole)->prev_hole_rel_pointer
-						= new_hole->next_hole_rel_pointer;
-			}
+	while (packet->frags) {
+		frag = packet->frags;
+		packet->frags = frag->next;
+		freeFinsPdu(frag->pdu);
+		free(frag);
+	}
+	reass_frags -= packet->frag_num;
+	reass_charge(packet, -(int32_t) packet->mem);
+	reass_src_put(packet->src);
+	free(packet);
+}
+
+/**@brief turns the wheel to now, dropping packets that have waited IP4_REASS_TTL. Called as fragments
+ * arrive, so an idle stack keeps its stale packets until the next one (they stay within the budget). */
+void IP4_reass_expire(uint32_t now) {
+	struct ip4_reass_packet *packet;
+	struct ip4_reass_packet *next;
+	uint32_t steps = now - reass_tick;
+	uint32_t slot;
 
-			new_hole->first = fragment->last + 1;
-			new_hole->last = current_hole->last;
-			list->hole_count++;
-			current_hole = new_hole;
+	if (steps > IP4_REASS_WHEEL) {
+		steps = IP4_REASS_WHEEL;
+	}
+	for (slot = now - steps + 1; steps > 0; steps--, slot++) {
+		for (packet = reass_wheel[slot & (IP4_REASS_WHEEL - 1)]; packet != NULL; packet = next) {
+			next = packet->wheel_next;
+			if ((int32_t) (packet->expires - now) <= 0) {
+				PRINT_DEBUG("timed out: id=%u, src=%lu, received=%u, total=%u", packet->id, packet->source, packet->received, packet->total);
+				stats.timedout++;
+				reass_free(packet); //TODO send ICMP time exceeded if the first fragment is in
+			}
 		}
+	}
+	reass_tick = now;
+}
+
+/** makes room for mem more bytes by dropping the packets closest to expiring */
+static int reass_make_room(uint32_t mem, struct ip4_reass_packet *keep) {
+	uint32_t slot;
+	struct ip4_reass_packet *packet;
+	struct ip4_reass_packet *next;
 
-		/* Step 7
-		 * Go to step one.
-		 */
+	for (slot = reass_tick + 1; slot != reass_tick + 1 + IP4_REASS_WHEEL; slot++) {
+		for (packet = reass_wheel[slot & (IP4_REASS_WHEEL - 1)]; packet != NULL; packet = next) {
+			if (reass_mem + mem <= IP4_REASS_MEM && reass_frags < IP4_REASS_FRAGS) {
+				return 1;
+			}
+			next = packet->wheel_next;
+			if (packet != keep) {
+				stats.fragdropped += packet->frag_num;
+				reass_free(packet);
+			}
+		}
 	}
+	return reass_mem + mem <= IP4_REASS_MEM && reass_frags < IP4_REASS_FRAGS;
+}
+
+static struct ip4_reass_packet *reass_find(struct ip4_header *header, uint32_t now) {
+	uint32_t i = reass_hash(header->source, header->destination, header->id, header->protocol);
+	struct ip4_reass_packet *packet;
 
-	if (use_fragment == 1) {
-		if (fragment->last < list->length) {
-			memcpy((void *) ((unsigned long) list->buffer
-					+ (unsigned long) fragment->first),
-					(void *) fragment->data, fragment->data_length);
-		} else {
-			/* todo: Packet reassembly buffer extension*/
-			PRINT_DEBUG("Packet buffer needs to be expanded to for packets larger than the defined initial buffer size.");
+	for (packet = reass_table[i]; packet != NULL; packet = packet->next) {
+		if (packet->id == header->id && packet->source == header->source && packet->destination == header->destination
+				&& packet->protocol == header->protocol) {
+			return packet;
 		}
 	}
 
-	/*
-	 * Step 8
-	 * If the hole descriptor list is now empty, the datagram is now
-	 * complete.  Pass it on to the higher level protocol  processor
-	 * for further handling.  Otherwise, return.
-	 */
-	if (list->hole_count == 0) {
-		return (1);
-	} else {
-		return (0);
+	packet = (struct ip4_reass_packet *) malloc(sizeof(struct ip4_reass_packet));
+	if (packet == NULL) {
+		PRINT_ERROR("packet alloc fail");
+		exit(-1);
 	}
-}
+	memset(packet, 0, sizeof(struct ip4_reass_packet));
+	packet->source = header->source;
+	packet->destination = header->destination;
+	packet->id = header->id;
+	packet->protocol = header->protocol;
+	packet->src = reass_src_get(header->source);
+	reass_charge(packet, sizeof(struct ip4_reass_packet));
 
-struct ip4_reass_list* IP4_new_packet_entry(struct ip4_header* pheader,
-		struct ip4_reass_list* previous, struct ip4_reass_list* next) {
-	struct ip4_reass_list* packet_list_entry = (struct ip4_reass_list*) malloc(
-			sizeof(struct ip4_reass_list*));
-	packet_list_entry->next_packet = next;
-	packet_list_entry->previous_packet = previous;
-	packet_list_entry = (struct ip4_reass_list*) malloc(
-			sizeof(struct ip4_reass_list));
-	packet_list_entry->header = *pheader;
-	packet_list_entry->length = IP4_BUFFLEN;
-	packet_list_entry->buffer = (void *) malloc(IP4_BUFFLEN);
-	packet_list_entry->ttl = IP4_REASS_TTL;
-	packet_list_entry->first_hole_rel_pointer = 0;
-	packet_list_entry->hole_count = 1;
-
-	((struct ip4_reass_hole*) packet_list_entry->buffer)->first = 0;
-	((struct ip4_reass_hole*) packet_list_entry->buffer)->last = IP4_MAXLEN;
-	((struct ip4_reass_hole*) packet_list_entry->buffer)->next_hole_rel_pointer
-			= 0;
-	((struct ip4_reass_hole*) packet_list_entry->buffer)->prev_hole_rel_pointer
-			= 0;
-	return (packet_list_entry);
-}
+	packet->next = reass_table[i];
+	reass_table[i] = packet;
 
-struct ip4_fragment* IP4_construct_fragment(struct ip4_header* pheader,
-		struct ip4_packet* ppacket) {
-	struct ip4_fragment* fragment = (struct ip4_fragment*) malloc(
-			sizeof(struct ip4_fragment));
-	fragment->first = (pheader->fragmentation_offset) * 8;
-	fragment->last = fragment->first + (pheader->packet_length
-			- pheader->header_length);
-	fragment->data_length = pheader->packet_length - pheader->header_length;
-	if (pheader->flags & IP4_MF)
-		fragment->more_fragments = 1;
-	else
-		fragment->more_fragments = 0;
-	fragment->data = (void*) ppacket + pheader->header_length;
-	return (fragment);
+	packet->expires = now + IP4_REASS_TTL;
+	i = packet->expires & (IP4_REASS_WHEEL - 1);
+	packet->wheel_next = reass_wheel[i];
+	if (reass_wheel[i]) {
+		reass_wheel[i]->wheel_prev = packet;
+	}
+	reass_wheel[i] = packet;
+	return packet;
 }
 
-struct ip4_reass_hole* IP4_previous_hole(struct ip4_reass_hole* current_hole) {
-	if (current_hole->prev_hole_rel_pointer == 0) {
-		return (NULL);
+/** where the data held so far ends */
+static uint32_t reass_end(struct ip4_reass_packet *packet) {
+	struct ip4_reass_frag *frag = packet->frags;
+
+	if (frag == NULL) {
+		return 0;
 	}
-	return ((struct ip4_reass_hole*) ((unsigned long) current_hole
-			+ current_hole->prev_hole_rel_pointer));
+	while (frag->next != NULL) {
+		frag = frag->next;
+	}
+	return frag->first + frag->len;
 }
 
-struct ip4_reass_hole* IP4_next_hole(struct ip4_reass_hole* current_hole) {
-	if (current_hole->next_hole_rel_pointer == 0) {
-		return (NULL);
+/** copies the fragments out into one pdu, the first fragment's header in front */
+static uint8_t *reass_build(struct ip4_reass_packet *packet) {
+	uint8_t *pdu = allocFinsPdu(packet->hlen + packet->total);
+	struct ip4_packet *ppacket = (struct ip4_packet *) pdu;
+	struct ip4_reass_frag *frag;
+
+	memcpy(pdu, packet->hdr, packet->hlen);
+	for (frag = packet->frags; frag != NULL; frag = frag->next) {
+		memcpy(pdu + packet->hlen + frag->first, frag->data, frag->len);
 	}
-	return ((struct ip4_reass_hole*) ((unsigned long) current_hole
-			+ current_hole->next_hole_rel_pointer));
+
+	ppacket->ip_len = htons(packet->hlen + packet->total);
+	ppacket->ip_fragoff &= htons(IP4_DF << 13);
+	ppacket->ip_cksum = 0;
+	ppacket->ip_cksum = IP4_checksum(ppacket, packet->hlen);
+	return pdu;
 }
 
-void IP4_remove_hole(struct ip4_reass_hole* current_hole,
-		struct ip4_reass_list *list) {
-	struct ip4_reass_hole* next_hole = IP4_next_hole(current_hole);
-	struct ip4_reass_hole* previous_hole = IP4_previous_hole(current_hole);
-	if (previous_hole == NULL && next_hole == NULL) {
-		list->first_hole_rel_pointer = 0;
-		list->hole_count = 0;
-		return;
+/*
+ * Takes a fragment and the frame it came in, the frame is consumed.
+ * In case that this fragment is the last one missing to
+ * reassemble an IP packet, the frame is given the whole packet as its
+ * pdu, header is updated and a pointer to the packet is returned.
+ * In case it isn't it returns NULL
+ */
+struct ip4_packet* IP4_reass(struct finsFrame *ff, struct ip4_header *header, struct ip4_packet *ppacket) {
+	struct ip4_reass_packet *packet;
+	struct ip4_reass_frag *frag;
+	struct ip4_reass_frag **link;
+	uint32_t now = reass_now();
+	uint32_t first = header->fragmentation_offset * 8;
+	uint32_t len = header->packet_length - header->header_length;
+	uint32_t mem = ff->dataFrame.pduLength + sizeof(struct ip4_reass_frag);
+
+	stats.fragments++;
+	IP4_reass_expire(now);
+
+	//fragments other than the last carry multiples of 8 bytes
+	if (len == 0 || first + len > IP4_MAXLEN - header->header_length || ((header->flags & IP4_MF) && (len & 7))) {
+		PRINT_DEBUG("bad fragment: id=%u, first=%u, len=%u", header->id, first, len);
+		stats.fragdropped++;
+		freeFinsFrame(ff);
+		return NULL;
 	}
-	if (next_hole == NULL) {
-		previous_hole->next_hole_rel_pointer = 0;
-		list->hole_count--;
-		return;
+
+	packet = reass_find(header, now);
+
+	//find where it goes, an overlap means a broken or hostile sender and drops the packet (like RFC 5722)
+	for (link = &packet->frags; *link != NULL && (*link)->first + (*link)->len <= first; link = &(*link)->next)
+		;
+	if (*link != NULL && (*link)->first < first + len) {
+		stats.fragdropped++;
+		if ((*link)->first == first && (*link)->len == len) { //a duplicate
+			freeFinsFrame(ff);
+			return NULL;
+		}
+		PRINT_DEBUG("overlap: id=%u, first=%u, len=%u", header->id, first, len);
+		stats.fragdropped += packet->frag_num;
+		reass_free(packet);
+		freeFinsFrame(ff);
+		return NULL;
 	}
-	if (previous_hole == NULL) {
-		next_hole->prev_hole_rel_pointer = 0;
-		list->first_hole_rel_pointer += current_hole->next_hole_rel_pointer;
-		list->hole_count--;
-		return;
+	//the last fragment can't come twice or end before another one, no fragment can go past it
+	if ((!(header->flags & IP4_MF) && (packet->total || reass_end(packet) > first + len)) || (packet->total && first + len > packet->total)) {
+		PRINT_DEBUG("bad end: id=%u, first=%u, len=%u, total=%u", header->id, first, len, packet->total);
+		stats.fragdropped += packet->frag_num + 1;
+		reass_free(packet);
+		freeFinsFrame(ff);
+		return NULL;
+	}
+
+	if (packet->src->mem + mem > IP4_REASS_SRC_MEM || !reass_make_room(mem, packet)) {
+		PRINT_DEBUG("over budget: src=%lu, src_mem=%u, mem=%u, frags=%u", header->source, packet->src->mem, reass_mem, reass_frags);
+		stats.fragdropped++;
+		if (packet->frags == NULL) {
+			reass_free(packet);
+		}
+		freeFinsFrame(ff);
+		return NULL;
+	}
+
+	frag = (struct ip4_reass_frag *) malloc(sizeof(struct ip4_reass_frag));
+	if (frag == NULL) {
+		PRINT_ERROR("frag alloc fail");
+		exit(-1);
+	}
+	frag->pdu = ff->dataFrame.pdu;
+	frag->data = (uint8_t *) ppacket + header->header_length;
+	frag->first = first;
+	frag->len = len;
+	frag->next = *link;
+	*link = frag;
+	ff->dataFrame.pdu = NULL;
+
+	packet->frag_num++;
+	packet->received += len;
+	reass_frags++;
+	reass_charge(packet, mem);
+	if (!(header->flags & IP4_MF)) {
+		packet->total = first + len;
+	}
+	if (first == 0) {
+		packet->hlen = header->header_length;
+		memcpy(packet->hdr, ppacket, header->header_length);
+	}
+
+	if (packet->total == 0 || packet->received != packet->total) {
+		freeFinsFrame(ff);
+		return NULL;
+	}
+
+	ff->dataFrame.pdu = reass_build(packet);
+	ff->dataFrame.pduLength = packet->hlen + packet->total;
+	header->header_length = packet->hlen;
+	header->packet_length = ff->dataFrame.pduLength;
+	header->flags &= IP4_DF;
+	header->fragmentation_offset = 0;
+	reass_free(packet);
+
+	return (struct ip4_packet *) ff->dataFrame.pdu;
+}
+
+void IP4_reass_release(void) {
+	uint32_t i;
+
+	for (i = 0; i < IP4_REASS_HASH; i++) {
+		while (reass_table[i]) {
+			reass_free(reass_table[i]);
+		}
 	}
-	previous_hole->next_hole_rel_pointer += current_hole->next_hole_rel_pointer;
-	next_hole->prev_hole_rel_pointer += current_hole->prev_hole_rel_pointer;
-	list->hole_count--;
-	return;
 }
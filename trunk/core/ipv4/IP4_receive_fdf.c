@@ -10,84 +10,60 @@
 
 extern IP4addr my_ip_addr;
 
-extern sem_t Switch_to_IPv4_Qsem;
-extern finsQueue Switch_to_IPv4_Queue;
+extern finsRing Switch_to_IPv4_Queue;
+extern struct finsEvent Switch_to_IPv4_Event;
+extern struct finsBatch ipv4_batch;
 
+/**@brief handles a burst of frames from the switch. Runs of data frames going the same way are handled
+ * together, and everything sent goes to the switch at the end
+ */
 void IP4_receive_fdf(void) {
-
-	struct finsFrame* pff = NULL;
-	uint32_t protocol;
-	do {
-		sem_wait(&Switch_to_IPv4_Qsem);
-		pff = read_queue(Switch_to_IPv4_Queue);
-		sem_post(&Switch_to_IPv4_Qsem);
-	} while (ipv4_running && pff == NULL);
-
-	if (!ipv4_running) {
-		return;
+	struct finsFrame *ffs[RING_BURST];
+	struct finsFrame *pff;
+	int n;
+	int i, j;
+
+	n = read_ring_wait(ffs, RING_BURST, Switch_to_IPv4_Queue, &Switch_to_IPv4_Event, &ipv4_running);
+	for (i = 0; i < n; i++) {
+		ffs[i] = writableFinsFrame(ffs[i]); //frames delivered to several modules are shared
 	}
 
-	if (pff->dataOrCtrl == CONTROL) {
-		PRINT_DEBUG("Received frame: D/C: %d, DestID=%d, ff=%p, meta=%p", pff->dataOrCtrl, pff->destinationID.id, pff, pff->metaData);
-		ipv4_fcf(pff);
-	} else if (pff->dataOrCtrl == DATA) {
-		PRINT_DEBUG("Received frame: D/C: %d, DestID=%d, ff=%p, meta=%p", pff->dataOrCtrl, pff->destinationID.id, pff, pff->metaData);
-		PRINT_DEBUG("PDU Length: %d", pff->dataFrame.pduLength);
-		PRINT_DEBUG("Data direction: %d", pff->dataFrame.directionFlag);
-		PRINT_DEBUG("pdu=%p", pff->dataFrame.pdu);
-
-		if (pff->dataFrame.directionFlag == UP) {
-			PRINT_DEBUG("IP4_in");
-
-			IP4_in(pff, (struct ip4_packet*) pff->dataFrame.pdu, pff->dataFrame.pduLength);
-
-		} else if (pff->dataFrame.directionFlag == DOWN) {
-			PRINT_DEBUG("IP4_out");
-
-			metadata *params = pff->metaData;
-			if (params == NULL) {
-				PRINT_ERROR("todo error");
-				freeFinsFrame(pff);
-				return;
+	for (i = 0; i < n; i = j) {
+		pff = ffs[i];
+		j = i + 1;
+
+		if (pff->dataOrCtrl == CONTROL) {
+			PRINT_DEBUG("Received frame: D/C: %d, DestID=%d, ff=%p, meta=%p", pff->dataOrCtrl, pff->destinationID.id, pff, pff->metaData);
+			ipv4_fcf(pff);
+		} else if (pff->dataOrCtrl == DATA) {
+			PRINT_DEBUG("Received frame: D/C: %d, DestID=%d, ff=%p, meta=%p", pff->dataOrCtrl, pff->destinationID.id, pff, pff->metaData);
+			PRINT_DEBUG("PDU Length: %d", pff->dataFrame.pduLength);
+			PRINT_DEBUG("Data direction: %d", pff->dataFrame.directionFlag);
+			PRINT_DEBUG("pdu=%p", pff->dataFrame.pdu);
+
+			while (j < n && ffs[j]->dataOrCtrl == DATA && ffs[j]->dataFrame.directionFlag == pff->dataFrame.directionFlag) {
+				j++;
 			}
 
-			int ret = 0;
-			ret += metadata_readFromElement(params, "send_protocol", &protocol) == META_FALSE;
-
-			if (ret) {
-				PRINT_ERROR("metadata read error: ret=%d", ret);
-			}
-
-			PRINT_DEBUG("%lu", my_ip_addr);
-			PRINT_DEBUG("Transport protocol going out passed to IPv4: protocol=%u", protocol);
-			switch (protocol) {
-			case IP4_PT_ICMP:
-				IP4_out(pff, pff->dataFrame.pduLength, my_ip_addr, IP4_PT_ICMP);
-				break;
-			case IP4_PT_TCP:
-				IP4_out(pff, pff->dataFrame.pduLength, my_ip_addr, IP4_PT_TCP);
-				break;
-			case IP4_PT_UDP:
-				IP4_out(pff, pff->dataFrame.pduLength, my_ip_addr, IP4_PT_UDP);
-				break;
-			default:
-				PRINT_ERROR("invalid protocol: protocol=%u", protocol);
-				/**
-				 * TODO investigate why the freeFinsFrame below create segmentation fault
-				 */
-				freeFinsFrame(pff);
-				break;
+			if (pff->dataFrame.directionFlag == UP) {
+				PRINT_DEBUG("IP4_in");
+				IP4_in_burst(&ffs[i], j - i);
+			} else if (pff->dataFrame.directionFlag == DOWN) {
+				PRINT_DEBUG("IP4_out: src=%lu", my_ip_addr);
+				IP4_out_burst(&ffs[i], j - i, my_ip_addr);
+			} else {
+				PRINT_ERROR("Error: Wrong value of fdf.directionFlag");
+				for (; i < j; i++) {
+					freeFinsFrame(ffs[i]);
+				}
 			}
-
 		} else {
-			PRINT_ERROR("Error: Wrong value of fdf.directionFlag");
+			PRINT_ERROR("Error: Wrong pff->dataOrCtrl value");
 			freeFinsFrame(pff);
 		}
-	} else {
-		PRINT_ERROR("Error: Wrong pff->dataOrCtrl value");
-		freeFinsFrame(pff);
 	}
 
+	flush_batch(&ipv4_batch);
 }
 
 void ipv4_fcf(struct finsFrame *ff) {
@@ -141,18 +117,20 @@ void ipv4_exec_reply_get_addr(struct finsFrame *ff, uint64_t src_mac, uint64_t d
 	if (store) {
 		store_list_remove(store);
 
-		metadata *params = store->ff->metaData;
-
 		uint32_t ether_type = IP4_ETH_TYPE;
-		metadata_writeToElement(params, "send_dst_mac", &dst_mac, META_TYPE_INT64);
-		metadata_writeToElement(params, "send_src_mac", &src_mac, META_TYPE_INT64);
-		metadata_writeToElement(params, "send_ether_type", &ether_type, META_TYPE_INT32);
+		int i;
+		for (i = 0; i < store->ff_num; i++) {
+			metadata *params = store->ffs[i]->metaData;
+			metadata_writeToElement(params, "send_dst_mac", &dst_mac, META_TYPE_INT64);
+			metadata_writeToElement(params, "send_src_mac", &src_mac, META_TYPE_INT64);
+			metadata_writeToElement(params, "send_ether_type", &ether_type, META_TYPE_INT32);
+		}
 
 		PRINT_DEBUG("recv frame: dst=0x%12.12llx, src=0x%12.12llx, type=0x%x", dst_mac, src_mac, ether_type);
 
 		//print_finsFrame(fins_frame);
-		ipv4_to_switch(store->ff);
-		store->ff = NULL;
+		ipv4_to_switch_burst(store->ffs, store->ff_num);
+		store->ff_num = 0;
 
 		store_free(store);
 
@@ -186,19 +164,22 @@ void ipv4_exec_reply(struct finsFrame *ff) {
 					//ipv4_exec_reply_get_addr(ff, src_mac, dst_mac);
 					struct ip4_store *store = store_list_find(ff->ctrlFrame.serial_num);
 					if (store) {
-						PRINT_DEBUG("store=%p, ff=%p, serial_num=%u", store, store->ff, store->serial_num);
+						PRINT_DEBUG("store=%p, ff=%p, ff_num=%d, serial_num=%u", store, store->ffs[0], store->ff_num, store->serial_num);
 						store_list_remove(store);
 
 						uint32_t ether_type = IP4_ETH_TYPE;
-						metadata_writeToElement(store->ff->metaData, "send_ether_type", &ether_type, META_TYPE_INT32);
-						metadata_writeToElement(store->ff->metaData, "send_dst_mac", &dst_mac, META_TYPE_INT64);
-						metadata_writeToElement(store->ff->metaData, "send_src_mac", &src_mac, META_TYPE_INT64);
+						int i;
+						for (i = 0; i < store->ff_num; i++) { //fragments all go to the same next hop
+							metadata_writeToElement(store->ffs[i]->metaData, "send_ether_type", &ether_type, META_TYPE_INT32);
+							metadata_writeToElement(store->ffs[i]->metaData, "send_dst_mac", &dst_mac, META_TYPE_INT64);
+							metadata_writeToElement(store->ffs[i]->metaData, "send_src_mac", &src_mac, META_TYPE_INT64);
+						}
 
 						PRINT_DEBUG("recv frame: dst=0x%12.12llx, src=0x%12.12llx, type=0x%x", dst_mac, src_mac, ether_type);
 
 						//print_finsFrame(fins_frame);
-						ipv4_to_switch(store->ff);
-						store->ff = NULL;
+						ipv4_to_switch_burst(store->ffs, store->ff_num);
+						store->ff_num = 0;
 
 						store_free(store);
 
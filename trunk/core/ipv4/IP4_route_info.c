@@ -29,43 +29,42 @@ void IP4_print_routing_table(struct ip4_routing_table * table_pointer) {
 	}
 }
 
+/** merges two lists sorted by mask, longest first, a keeps ties ahead of b */
+static struct ip4_routing_table *IP4_merge_routing_table(struct ip4_routing_table *a, struct ip4_routing_table *b) {
+	struct ip4_routing_table head;
+	struct ip4_routing_table *tail = &head;
+
+	while (a != NULL && b != NULL) {
+		if (a->mask >= b->mask) {
+			tail->next_entry = a;
+			a = a->next_entry;
+		} else {
+			tail->next_entry = b;
+			b = b->next_entry;
+		}
+		tail = tail->next_entry;
+	}
+	tail->next_entry = a != NULL ? a : b;
+	return head.next_entry;
+}
+
+/**@brief sorts the table by mask, longest first, keeping the order of equal masks (merge sort) */
 struct ip4_routing_table * IP4_sort_routing_table(struct ip4_routing_table * table_pointer) {
-	if (table_pointer == NULL) {
-		return NULL;
+	if (table_pointer == NULL || table_pointer->next_entry == NULL) {
+		return table_pointer;
 	}
-	struct ip4_routing_table *first = table_pointer;
-	struct ip4_routing_table *previous;
-	struct ip4_routing_table *current;
-	int swapped = 1;
-	while (swapped) {
-		swapped = 0;
-		previous = NULL;
-		current = table_pointer;
-		while ((current != NULL) && (current->next_entry != NULL)) {
-			//uncomment these after kernel stuff stable
-			//PRINT_DEBUG("masks (curr, next): %d %d",(int)current->mask, (int)current->next_entry->mask);
-			if (current->mask < current->next_entry->mask) {
-				//PRINT_DEBUG("mask < mask");
-				if (previous == NULL) {
-					//PRINT_DEBUG("prev  ==  null");
-					first = current->next_entry;
-					current->next_entry = current->next_entry->next_entry;
-					first->next_entry = current;
-				} else {
-					//PRINT_DEBUG("prev  !=  null");
-					previous->next_entry = current->next_entry;
-					current->next_entry = current->next_entry->next_entry;
-					previous->next_entry->next_entry = current;
-				}
-				swapped = 1;
-			}
-			previous = current;
-			current = current->next_entry;
-		}
+
+	//split in half, slow stops at the end of the first half
+	struct ip4_routing_table *slow = table_pointer;
+	struct ip4_routing_table *fast = table_pointer->next_entry;
+	while (fast != NULL && fast->next_entry != NULL) {
+		slow = slow->next_entry;
+		fast = fast->next_entry->next_entry;
 	}
-	PRINT_DEBUG("IP4_sort_routing_table end");
-	return (first);
+	struct ip4_routing_table *second = slow->next_entry;
+	slow->next_entry = NULL;
 
+	return IP4_merge_routing_table(IP4_sort_routing_table(table_pointer), IP4_sort_routing_table(second));
 }
 
 struct ip4_routing_table * parse_nlmsg(struct nlmsghdr* msg) {
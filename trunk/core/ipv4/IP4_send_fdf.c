@@ -7,9 +7,9 @@
 
 #include "ipv4.h"
 #include <queueModule.h>
+#include <arp.h>
 
-extern finsQueue IPv4_to_Switch_Queue;
-extern sem_t IPv4_to_Switch_Qsem;
+extern struct finsBatch ipv4_batch;
 
 extern IP4addr my_ip_addr;
 
@@ -69,19 +69,18 @@ void IP4_send_fdf_in(struct finsFrame *ff, struct ip4_header* pheader, struct ip
 		break;
 	case IP4_PT_TCP:
 	case IP4_PT_UDP:
-		ff->dataFrame.pduLength = pheader->packet_length - pheader->header_length;
-		uint8_t *pdu = ff->dataFrame.pdu;
-		uint8_t *data = (uint8_t *) malloc(ff->dataFrame.pduLength);
-		if (data == NULL) {
-			PRINT_ERROR("ip pdu alloc fail");
-			exit(-1);
+		if ((uint8_t *) ppacket == ff->dataFrame.pdu) {
+			pullFinsPdu(ff, pheader->header_length);
+			ff->dataFrame.pduLength = pheader->packet_length - pheader->header_length; //drops link layer padding
+		} else { //reassembled
+			uint8_t *pdu = ff->dataFrame.pdu;
+			ff->dataFrame.pduLength = pheader->packet_length - pheader->header_length;
+			ff->dataFrame.pdu = allocFinsPdu(ff->dataFrame.pduLength);
+			memcpy(ff->dataFrame.pdu, ppacket->ip_data, ff->dataFrame.pduLength);
+
+			PRINT_DEBUG("Freeing pdu=%p", pdu);
+			freeFinsPdu(pdu);
 		}
-
-		memcpy(data, ppacket->ip_data, ff->dataFrame.pduLength);
-		ff->dataFrame.pdu = data;
-
-		PRINT_DEBUG("Freeing pdu=%p", pdu);
-		free(pdu);
 		break;
 	default:
 		PRINT_ERROR("todo error");
@@ -91,35 +90,36 @@ void IP4_send_fdf_in(struct finsFrame *ff, struct ip4_header* pheader, struct ip
 	ipv4_to_switch(ff);
 }
 
-void IP4_send_fdf_out(struct finsFrame *ff, struct ip4_packet* ppacket, struct ip4_next_hop_info next_hop, uint16_t length) {
-	PRINT_DEBUG("Entered: ff=%p, meta=%p", ff, ff->metaData);
+void IP4_send_fdf_out(struct finsFrame **ffs, int num, struct ip4_next_hop_info next_hop) {
+	PRINT_DEBUG("Entered: ff=%p, meta=%p, num=%d", ffs[0], ffs[0]->metaData, num);
 
 	PRINT_DEBUG("address=%u, interface=%u", (uint32_t)next_hop.address, next_hop.interface);
 
-	//ff->dataOrCtrl = DATA;
-	ff->destinationID.id = INTERFACE_ID;
-	ff->destinationID.next = NULL;
-	//ff->metaData = ff->metaData;
-
-	//ff->dataFrame.directionFlag = DOWN;
-	ff->dataFrame.pduLength = length + IP4_MIN_HLEN;
-
-	uint8_t *pdu = ff->dataFrame.pdu;
-	ff->dataFrame.pdu = (uint8_t *) malloc(length + IP4_MIN_HLEN);
-	if (ff->dataFrame.pdu == NULL) {
-		PRINT_ERROR("ipv4 pdu alloc fail");
-		exit(-1);
+	int i;
+	for (i = 0; i < num; i++) {
+		ffs[i]->destinationID.id = INTERFACE_ID;
+		ffs[i]->destinationID.next = NULL;
 	}
-	memcpy(ff->dataFrame.pdu, ppacket, IP4_MIN_HLEN);
-	memcpy(ff->dataFrame.pdu + IP4_MIN_HLEN, pdu, length);
 
-	if (store_list_has_space()) {
-		metadata *params = (metadata *) malloc(sizeof(metadata));
-		if (params == NULL) {
-			PRINT_ERROR("metadata creation failed");
-			exit(-1);
+	//known neighbors are read straight from the ARP cache, only misses wait on an EXEC_ARP_GET_ADDR round trip
+	uint64_t dst_mac;
+	uint64_t src_mac;
+	if (arp_cache_lookup(next_hop.address, next_hop.interface, &dst_mac, &src_mac)) {
+		uint32_t ether_type = IP4_ETH_TYPE;
+		for (i = 0; i < num; i++) {
+			metadata_writeToElement(ffs[i]->metaData, "send_ether_type", &ether_type, META_TYPE_INT32);
+			metadata_writeToElement(ffs[i]->metaData, "send_dst_mac", &dst_mac, META_TYPE_INT64);
+			metadata_writeToElement(ffs[i]->metaData, "send_src_mac", &src_mac, META_TYPE_INT64);
 		}
-		metadata_create(params);
+
+		PRINT_DEBUG("cached: dst=0x%12.12llx, src=0x%12.12llx, type=0x%x", dst_mac, src_mac, ether_type);
+		ipv4_to_switch_burst(ffs, num);
+		return;
+	}
+
+	if (store_list_has_space()) {
+		struct finsFrame *ff_arp = allocFinsFrame();
+		metadata *params = ff_arp->metaData;
 
 		//uint32_t src_ip = my_ip_addr; //TODO get these from next hop info
 		//uint32_t dst_ip = ntohl(ppacket->ip_dst);
@@ -129,16 +129,8 @@ void IP4_send_fdf_out(struct finsFrame *ff, struct ip4_packet* ppacket, struct i
 		metadata_writeToElement(params, "src_ip", &src_ip, META_TYPE_INT32);
 		metadata_writeToElement(params, "dst_ip", &dst_ip, META_TYPE_INT32);
 
-		struct finsFrame *ff_arp = (struct finsFrame *) malloc(sizeof(struct finsFrame));
-		if (ff_arp == NULL) {
-			PRINT_ERROR("ff_arp alloc error");
-			exit(-1);
-		}
-
 		ff_arp->dataOrCtrl = CONTROL;
 		ff_arp->destinationID.id = ARP_ID;
-		ff_arp->destinationID.next = NULL;
-		ff_arp->metaData = params;
 
 		uint32_t serial_num = gen_control_serial_num();
 
@@ -152,30 +144,34 @@ void IP4_send_fdf_out(struct finsFrame *ff, struct ip4_packet* ppacket, struct i
 
 		ipv4_to_switch(ff_arp);
 
-		//TODO store IP fdf
-		struct ip4_store *store = store_create(serial_num, ff, pdu);
+		//one lookup for the packet or all of its fragments, they are sent together on the reply
+		struct ip4_store *store = store_create(serial_num, ffs, num, NULL);
 		store_list_insert(store);
 	} else {
-		PRINT_ERROR("todo error");
+		PRINT_ERROR("store list full, dropping: ff=%p, num=%d", ffs[0], num);
 		//TODO expand store space? remove first stored packet, send error message, & store new packet?
-		//free(pdu);
+		for (i = 0; i < num; i++) {
+			freeFinsFrame(ffs[i]);
+		}
 	}
 }
 
+/**@brief queues a frame for the switch, it is sent with the rest of the burst being handled */
 int ipv4_to_switch(struct finsFrame *ff) {
 	PRINT_DEBUG("Entered: ff=%p, meta=%p", ff, ff->metaData);
-	if (sem_wait(&IPv4_to_Switch_Qsem)) {
-		PRINT_ERROR("Interface_to_Switch_Qsem wait prob");
-		exit(-1);
-	}
-	if (write_queue(ff, IPv4_to_Switch_Queue)) {
-		/*#*/PRINT_DEBUG("");
-		sem_post(&IPv4_to_Switch_Qsem);
-		return 1;
-	}
+	return write_batch(ff, &ipv4_batch);
+}
 
-	PRINT_DEBUG("");
-	sem_post(&IPv4_to_Switch_Qsem);
+/**@brief queues frames for the switch, they are sent with the rest of the burst being handled
+ * @return the number of frames queued
+ * */
+int ipv4_to_switch_burst(struct finsFrame **ffs, int num) {
+	PRINT_DEBUG("Entered: ff=%p, num=%d", ffs[0], num);
+	int i;
+
+	for (i = 0; i < num; i++) {
+		write_batch(ffs[i], &ipv4_batch);
+	}
 
-	return 0;
+	return num;
 }
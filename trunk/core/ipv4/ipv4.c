@@ -8,11 +8,13 @@
 #include "ipv4.h"
 #include <queueModule.h>
 
-sem_t IPv4_to_Switch_Qsem;
-finsQueue IPv4_to_Switch_Queue;
+finsRing IPv4_to_Switch_Queue;
+struct finsBatch ipv4_batch; //what a burst sends, see IP4_receive_fdf()
 
-sem_t Switch_to_IPv4_Qsem;
-finsQueue Switch_to_IPv4_Queue;
+finsRing Switch_to_IPv4_Queue;
+struct finsEvent Switch_to_IPv4_Event;
+
+extern struct finsEvent Switch_Event;
 
 IP4addr my_ip_addr;
 IP4addr my_mask;
@@ -44,10 +46,10 @@ void *switch_to_ipv4(void *local) {
 	pthread_exit(NULL);
 }
 
-struct ip4_store *store_create(uint32_t serial_num, struct finsFrame *ff, uint8_t *pdu) {
-	PRINT_DEBUG("Entered: serial_num=%u, ff=%p, pdu=%p", serial_num, ff, pdu);
+struct ip4_store *store_create(uint32_t serial_num, struct finsFrame **ffs, int ff_num, uint8_t *pdu) {
+	PRINT_DEBUG("Entered: serial_num=%u, ff=%p, ff_num=%d, pdu=%p", serial_num, ffs[0], ff_num, pdu);
 
-	struct ip4_store *store = (struct ip4_store *) malloc(sizeof(struct ip4_store));
+	struct ip4_store *store = (struct ip4_store *) malloc(sizeof(struct ip4_store) + ff_num * sizeof(struct finsFrame *));
 	if (store == NULL) {
 		PRINT_ERROR("store alloc fail");
 		exit(-1);
@@ -55,10 +57,11 @@ struct ip4_store *store_create(uint32_t serial_num, struct finsFrame *ff, uint8_
 
 	store->next = NULL;
 	store->serial_num = serial_num;
-	store->ff = ff;
 	store->pdu = pdu;
+	store->ff_num = ff_num;
+	memcpy(store->ffs, ffs, ff_num * sizeof(struct finsFrame *));
 
-	PRINT_DEBUG("Exited: serial_num=%u, ff=%p, pdu=%p, store=%p", serial_num, ff, pdu, store);
+	PRINT_DEBUG("Exited: serial_num=%u, ff=%p, ff_num=%d, pdu=%p, store=%p", serial_num, ffs[0], ff_num, pdu, store);
 	return store;
 }
 
@@ -67,11 +70,13 @@ void store_free(struct ip4_store *store) {
 
 	if (store->pdu) {
 		PRINT_DEBUG("Freeing pdu=%p", store->pdu);
-		free(store->pdu);
+		freeFinsPdu(store->pdu);
 	}
 
-	if (store->ff)
-		freeFinsFrame(store->ff);
+	int i;
+	for (i = 0; i < store->ff_num; i++) {
+		freeFinsFrame(store->ffs[i]);
+	}
 
 	free(store);
 }
@@ -146,6 +151,7 @@ int store_list_has_space(void) {
 void ipv4_init(void) {
 	PRINT_DEBUG("Entered");
 	ipv4_running = 1;
+	init_batch(&ipv4_batch, &IPv4_to_Switch_Queue, &Switch_Event);
 
 	store_list = NULL;
 	store_num = 0;
@@ -186,6 +192,7 @@ void ipv4_run(pthread_attr_t *fins_pthread_attr) {
 void ipv4_shutdown(void) {
 	PRINT_DEBUG("Entered");
 	ipv4_running = 0;
+	post_event(&Switch_to_IPv4_Event);
 
 	//TODO expand this
 
@@ -205,6 +212,9 @@ void ipv4_release(void) {
 		store_free(store);
 	}
 
+	IP4_route_release();
+	IP4_reass_release();
+
 	struct ip4_routing_table *table;
 	while (routing_table) {
 		table = routing_table;
@@ -213,6 +223,6 @@ void ipv4_release(void) {
 		free(table);
 	}
 
-	term_queue(IPv4_to_Switch_Queue); //TODO uncomment
-	term_queue(Switch_to_IPv4_Queue);
+	term_ring(IPv4_to_Switch_Queue); //TODO uncomment
+	term_ring(Switch_to_IPv4_Queue);
 }
@@ -19,6 +19,7 @@
 #include <pthread.h>
 #include <finstypes.h>
 #include <finsdebug.h>
+#include <finschecksum.h>
 #include <queueModule.h>
 
 /* Internet Protocol (IP)  Constants and Datagram Format		*/
@@ -103,29 +104,38 @@ struct ip4_stats {
 
 };
 
-struct ip4_reass_list {
-	struct ip4_reass_list *next_packet, *previous_packet;
-	uint8_t ttl;
-	struct ip4_header header;
-	int first_hole_rel_pointer;
-	void *buffer;
-	uint16_t length;
-	uint16_t hole_count;
+/** a fragment waiting for the rest of its packet, kept in the buffer it arrived in */
+struct ip4_reass_frag {
+	struct ip4_reass_frag *next; //by offset
+	uint8_t *pdu; //the frame's pdu, freed when the packet is done
+	uint8_t *data;
+	uint16_t first; //offset of data in the packet
+	uint16_t len;
 };
 
-struct ip4_reass_hole {
-	uint16_t first;
-	uint16_t last;
-	uint16_t next_hole_rel_pointer;
-	uint16_t prev_hole_rel_pointer;
+/** bytes held for one source address, so one sender can't take the whole budget */
+struct ip4_reass_src {
+	struct ip4_reass_src *next; //in its hash bucket
+	IP4addr source;
+	uint32_t mem;
 };
 
-struct ip4_fragment {
-	uint16_t first;
-	uint16_t last;
-	uint16_t data_length;
-	uint8_t more_fragments;
-	void *data;
+struct ip4_reass_packet {
+	struct ip4_reass_packet *next; //in its hash bucket
+	struct ip4_reass_packet *wheel_next, *wheel_prev; //in its timing wheel slot
+	IP4addr source;
+	IP4addr destination;
+	uint16_t id;
+	uint8_t protocol;
+	uint8_t hlen; //of the first fragment, 0 until it arrives
+	uint8_t hdr[60]; //the first fragment's header, options included
+	uint32_t total; //data length, known once the last fragment arrives
+	uint32_t received; //data bytes held, fragments never overlap
+	uint32_t expires; //second the packet is given up on
+	uint32_t mem;
+	uint32_t frag_num;
+	struct ip4_reass_src *src;
+	struct ip4_reass_frag *frags;
 };
 
 struct ip4_route_request {
@@ -151,6 +161,34 @@ struct ip4_next_hop_info {
 	uint32_t interface;
 };
 
+#define IP4_TRIE_ROOT_BITS	16
+#define IP4_TRIE_ROOT		(1 << IP4_TRIE_ROOT_BITS)	/* entries for the first 16 bits			*/
+#define IP4_TRIE_CHUNK		256		/* entries for each following 8 bits				*/
+#define IP4_TRIE_PTR		0x80000000	/* entry is a node index, else a hop index + 1, 0 for no route	*/
+#define IP4_HOP_GROUP		16		/* lookups IP4_next_hop_burst() keeps in flight				*/
+
+/** 256 entries for 8 bits of address, compressed like Poptrie: bitmaps say which entries are nodes
+ * below and where a run of equal leaves starts, an entry's node/leaf is found by counting set bits */
+struct ip4_trie_node {
+	uint64_t vector[4]; //entry is a node below
+	uint64_t leafvec[4]; //entry starts a run of equal leaves
+	uint32_t node[4]; //first node below, for each 64 entries
+	uint32_t leaf[4]; //first leaf, for each 64 entries
+};
+
+/** the routes compiled into a 16-8-8 multibit trie, prefixes are pushed down to the leaves so a
+ * lookup is the root and at most 2 nodes however many routes there are. Built whole and swapped in
+ * on update. */
+struct ip4_route_trie {
+	uint32_t root[IP4_TRIE_ROOT];
+	struct ip4_trie_node *nodes;
+	uint32_t node_num;
+	uint32_t *leaves; //hop index + 1, 0 for no route
+	uint32_t leaf_num;
+	struct ip4_next_hop_info *hops; //address is the gateway, 0 for on link
+	uint32_t hop_num;
+};
+
 //struct ip_
 /* Basic IPv4 definitions */
 #define	IP4_ALEN		4		/* IP address length in bytes (octets)					*/
@@ -158,9 +196,16 @@ struct ip4_next_hop_info {
 #define	IP4_MIN_HLEN	20		/* minimum IP header length (in bytes)					*/
 #define	IP4_INIT_TTL	255		/* Initial time-to-live value							*/
 #define	IP4_MAXLEN		65535	/* Maximum IP datagram length (bytes)					*/
-#define IP4_BUFFLEN		9000	/* Initial reassembly buffer size (bytes)				*/
 #define IP4_REASS_TTL	60		/* Time (sec) to wait for fragments of packet to arrive	*/
+#define IP4_REASS_WHEEL	64		/* timing wheel slots of 1 sec, a power of 2 > IP4_REASS_TTL	*/
+#define IP4_REASS_HASH	1024	/* packet hash buckets, a power of 2					*/
+#define IP4_REASS_SRC_HASH	256	/* source hash buckets, a power of 2					*/
+#define IP4_REASS_MEM	(4 * 1024 * 1024)	/* bytes held for reassembly, all sources		*/
+#define IP4_REASS_SRC_MEM	(IP4_REASS_MEM / 4)	/* bytes held for one source			*/
+#define IP4_REASS_FRAGS	1024	/* pdus held at once, leaves the pool to other traffic	*/
 #define IP4_PCK_LEN		1500	/* Length of IP packets to be constructed				*/
+#define IP4_FRAG_LEN	((IP4_PCK_LEN - IP4_MIN_HLEN) & ~7)	/* data per fragment, a multiple of 8	*/
+#define IP4_FRAG_MAX	((IP4_MAXLEN + IP4_FRAG_LEN - 1) / IP4_FRAG_LEN)	/* fragments of the largest datagram */
 /* IPv4 masks*/
 #define	IP4_MF			0x1		/* more fragments bit			*/
 #define	IP4_DF			0x2		/* don't fragment bit			*/
@@ -222,11 +267,12 @@ struct ip4_next_hop_info {
 struct ip4_store {
 	struct ip4_store *next;
 	uint32_t serial_num;
-	struct finsFrame *ff;
 	uint8_t *pdu;
+	int ff_num;
+	struct finsFrame *ffs[]; //the packet, or all of its fragments, sent together
 };
 
-struct ip4_store *store_create(uint32_t serial_num, struct finsFrame *ff, uint8_t *pdu);
+struct ip4_store *store_create(uint32_t serial_num, struct finsFrame **ffs, int ff_num, uint8_t *pdu);
 void store_free(struct ip4_store *store);
 
 #define IP4_STORE_LIST_MAX 2048
@@ -249,29 +295,32 @@ void set_interface(uint32_t IP_address, uint32_t mask);
 void set_loopback(uint32_t IP_address, uint32_t mask);
 
 void IP4_in(struct finsFrame *ff, struct ip4_packet* ppacket, int len);
+void IP4_in_burst(struct finsFrame **ffs, int num);
 uint16_t IP4_checksum(struct ip4_packet* ptr, int length);
 int IP4_dest_check(IP4addr destination);
 //void IP4_reass(void);
 void IP4_send_fdf_in(struct finsFrame *ff, struct ip4_header*, struct ip4_packet*);
-void IP4_send_fdf_out(struct finsFrame *ff, struct ip4_packet* ppacket, struct ip4_next_hop_info next_hop, uint16_t length);
-
-uint8_t IP4_add_fragment(struct ip4_reass_list*, struct ip4_fragment*);
-struct ip4_packet* IP4_reass(struct ip4_header *header, struct ip4_packet *packet);
-struct ip4_reass_list* IP4_new_packet_entry(struct ip4_header* pheader, struct ip4_reass_list* previous, struct ip4_reass_list* next);
-struct ip4_fragment* IP4_construct_fragment(struct ip4_header* pheader, struct ip4_packet* ppacket);
-struct ip4_reass_hole* IP4_previous_hole(struct ip4_reass_hole* current_hole);
-struct ip4_reass_hole* IP4_next_hole(struct ip4_reass_hole* current_hole);
-void IP4_remove_hole(struct ip4_reass_hole* current_hole, struct ip4_reass_list *list);
+void IP4_send_fdf_out(struct finsFrame **ffs, int num, struct ip4_next_hop_info next_hop);
+
+struct ip4_packet* IP4_reass(struct finsFrame *ff, struct ip4_header *header, struct ip4_packet *packet);
+void IP4_reass_expire(uint32_t now);
+void IP4_reass_release(void);
 void IP4_const_header(struct ip4_packet *packet, IP4addr source, IP4addr destination, uint8_t protocol);
-struct ip4_fragment IP4_fragment_data(void *data, uint16_t length, uint16_t offest, uint16_t fragment_size);
+int IP4_fragment_data(struct finsFrame *ff, struct ip4_packet *header, uint16_t length, struct finsFrame **ffs);
 
 void IP4_out(struct finsFrame *ff, uint16_t length, IP4addr source, uint8_t protocol);
+void IP4_out_burst(struct finsFrame **ffs, int num, IP4addr source);
 
 struct ip4_routing_table * IP4_get_routing_table();
 struct ip4_routing_table * IP4_sort_routing_table(struct ip4_routing_table * table_pointer);
 void IP4_print_routing_table(struct ip4_routing_table * table_pointer);
 void IP4_init(void);
 struct ip4_next_hop_info IP4_next_hop(IP4addr dst);
+void IP4_next_hop_burst(IP4addr *dst, struct ip4_next_hop_info *info, int count);
+struct ip4_route_trie *IP4_route_build(struct ip4_routing_table *table);
+void IP4_route_free(struct ip4_route_trie *trie);
+void IP4_route_update(struct ip4_routing_table *table);
+void IP4_route_release(void);
 int IP4_forward(struct finsFrame *ff, struct ip4_packet* ppacket, IP4addr dest, uint16_t length);
 void IP4_receive_fdf(void);
 
@@ -283,5 +332,6 @@ void ipv4_error(struct finsFrame *ff);
 
 int InputQueue_Read_local(struct finsFrame *pff);
 int ipv4_to_switch(struct finsFrame *fins_frame);
+int ipv4_to_switch_burst(struct finsFrame **ffs, int num);
 void IP4_exit(void);
 #endif /* IPV4_H_ */
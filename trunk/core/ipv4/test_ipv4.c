@@ -0,0 +1,454 @@
+/**@file test_ipv4.c
+ *@brief checks the next hop trie against a walk of the sorted routing table, then times lookups
+ * from 10 to 100k routes, one at a time and in bursts, next to the list walk IP4_next_hop() used
+ * to do. Then feeds IP4_reass() fragments in order, out of order, duplicated, overlapping, timed out
+ * and from a flooding source, and times it with many packets in flight. Last, fragments datagrams with
+ * IP4_fragment_data() and reassembles them. Results go to stderr, so run as ./test_ipv4 > /dev/null to
+ * drop the debug output.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "ipv4.h"
+
+#define TEST_LOOKUPS 2000000
+#define TEST_WALK_BUDGET 200000000 //route entries the list walk may visit per size
+#define TEST_BURST 32
+#define TEST_FRAG 1480 //data per fragment, an Ethernet MTU
+#define TEST_INFLIGHT 256 //packets being reassembled at once in the timing
+#define TEST_ROUNDS 200
+
+uint32_t my_host_ip_addr;
+uint32_t my_host_mask;
+uint32_t loopback_ip_addr;
+uint32_t any_ip_addr;
+struct ip4_stats stats;
+
+static const uint32_t test_sizes[] = { 10, 100, 1000, 10000, 100000 };
+
+IP4addr test_dst[TEST_LOOKUPS];
+struct ip4_next_hop_info test_info[TEST_LOOKUPS];
+volatile uint32_t test_sink;
+
+uint64_t test_now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+uint32_t test_rand(void) {
+	return ((uint32_t) rand() << 16) ^ (uint32_t) rand();
+}
+
+/** what IP4_next_hop() did, first match in the sorted list */
+struct ip4_next_hop_info test_walk(struct ip4_routing_table *table, IP4addr dst) {
+	struct ip4_next_hop_info info;
+	IP4addr mask;
+
+	for (; table != NULL; table = table->next_entry) {
+		mask = table->mask ? (0xffffffff << (IP4_ALEN * 8 - table->mask)) & 0xffffffff : 0;
+		if (((table->dst & mask) == (dst & mask)) | (table->dst == 0)) {
+			info.address = table->gw == 0 ? dst : table->gw;
+			info.interface = table->interface;
+			return info;
+		}
+	}
+	info.interface = -1;
+	return info;
+}
+
+/** a table shaped like a BGP feed, mostly /24s, plus a default route */
+struct ip4_routing_table *test_table(uint32_t num) {
+	struct ip4_routing_table *table = NULL;
+	struct ip4_routing_table *entry;
+	uint32_t i;
+	int r;
+
+	for (i = 0; i < num; i++) {
+		entry = (struct ip4_routing_table *) malloc(sizeof(struct ip4_routing_table));
+		r = rand() % 100;
+		if (i == num / 2) {
+			entry->mask = 0;
+			entry->dst = 0;
+		} else {
+			entry->mask = r < 60 ? 24 : (r < 75 ? 16 + rand() % 8 : (r < 90 ? 25 + rand() % 8 : 8 + rand() % 8));
+			entry->dst = test_rand() & (0xffffffff << (32 - entry->mask));
+		}
+		entry->gw = i % 3 ? test_rand() : 0;
+		entry->metric = 0;
+		entry->interface = i;
+		entry->next_entry = table;
+		table = entry;
+	}
+	return IP4_sort_routing_table(table);
+}
+
+/** destinations inside the routes, with some random ones that mostly hit the default route */
+void test_fill(struct ip4_routing_table *table, uint32_t num) {
+	struct ip4_routing_table **entries = (struct ip4_routing_table **) malloc(num * sizeof(struct ip4_routing_table *));
+	uint32_t i;
+
+	for (i = 0; table != NULL; table = table->next_entry) {
+		entries[i++] = table;
+	}
+	for (i = 0; i < TEST_LOOKUPS; i++) {
+		if (i % 4 == 0) {
+			test_dst[i] = test_rand();
+		} else {
+			table = entries[test_rand() % num];
+			test_dst[i] = table->dst | (test_rand() & ~(table->mask ? 0xffffffff << (32 - table->mask) : 0));
+		}
+	}
+	free(entries);
+}
+
+void test_free(struct ip4_routing_table *table) {
+	struct ip4_routing_table *next;
+
+	for (; table != NULL; table = next) {
+		next = table->next_entry;
+		free(table);
+	}
+}
+
+uint8_t test_byte(uint16_t id, uint32_t off) {
+	return (uint8_t) (off * 7 + id);
+}
+
+/** hands IP4_reass() a fragment from src, the header is read from the pdu */
+struct ip4_packet *test_reass_frame(struct finsFrame *ff, IP4addr src) {
+	struct ip4_packet *ppacket = (struct ip4_packet *) ff->dataFrame.pdu;
+	struct ip4_header header;
+
+	memset(&header, 0, sizeof(header));
+	header.source = src;
+	header.destination = 0x0a000001;
+	header.header_length = IP4_HLEN(ppacket);
+	header.packet_length = ntohs(ppacket->ip_len);
+	header.id = ntohs(ppacket->ip_id);
+	header.flags = (uint8_t)(IP4_FLG(ntohs(ppacket->ip_fragoff));
+	header.fragmentation_offset = ntohs(ppacket->ip_fragoff) & IP4_FRAGOFF;
+	header.protocol = ppacket->ip_proto;
+	return IP4_reass(ff, &header, ppacket);
+}
+
+/** hands IP4_reass() the fragment of packet id from src holding data bytes first to first + len */
+struct ip4_packet *test_frag(IP4addr src, uint16_t id, uint32_t first, uint32_t len, int more, struct finsFrame **pff) {
+	struct finsFrame *ff = allocFinsFrame();
+	struct ip4_packet *ppacket;
+	uint32_t i;
+
+	ff->dataOrCtrl = DATA;
+	ff->dataFrame.directionFlag = UP;
+	ff->dataFrame.pduLength = IP4_MIN_HLEN + len;
+	ff->dataFrame.pdu = allocFinsPdu(ff->dataFrame.pduLength);
+	ppacket = (struct ip4_packet *) ff->dataFrame.pdu;
+	memset(ppacket, 0, IP4_MIN_HLEN);
+	ppacket->ip_verlen = 0x45;
+	ppacket->ip_len = htons(IP4_MIN_HLEN + len);
+	ppacket->ip_id = htons(id);
+	ppacket->ip_fragoff = htons((more ? IP4_MF << 13 : 0) | first / 8);
+	ppacket->ip_ttl = 64;
+	ppacket->ip_proto = IP4_PT_UDP;
+	for (i = 0; i < len; i++) {
+		ff->dataFrame.pdu[IP4_MIN_HLEN + i] = test_byte(id, first + i);
+	}
+
+	*pff = ff;
+	return test_reass_frame(ff, src);
+}
+
+/** 0 if ppacket is the whole of packet id, then frees its frame */
+int test_whole(struct finsFrame *ff, struct ip4_packet *ppacket, uint16_t id, uint32_t total) {
+	int bad = 0;
+	uint32_t i;
+
+	if (ppacket == NULL || (uint8_t *) ppacket != ff->dataFrame.pdu || ff->dataFrame.pduLength != IP4_MIN_HLEN + total) {
+		return 1;
+	}
+	if (ntohs(ppacket->ip_len) != IP4_MIN_HLEN + total || (ntohs(ppacket->ip_fragoff) & (IP4_MF << 13 | IP4_FRAGOFF))
+			|| fins_csum_fold(fins_csum_partial(ppacket, IP4_MIN_HLEN, 0)) != 0) {
+		bad++;
+	}
+	for (i = 0; i < total; i++) {
+		if (ff->dataFrame.pdu[IP4_MIN_HLEN + i] != test_byte(id, i)) {
+			bad++;
+			break;
+		}
+	}
+	freeFinsFrame(ff);
+	return bad;
+}
+
+uint32_t test_sec(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t) ts.tv_sec;
+}
+
+int test_reass(void) {
+	struct finsFrame *ff;
+	struct ip4_packet *ppacket;
+	uint16_t drops;
+	uint64_t start;
+	uint32_t i, j, r;
+	int bad = 0;
+
+	//in order, backwards, with a duplicate
+	bad += test_frag(1, 1, 0, TEST_FRAG, 1, &ff) != NULL;
+	bad += test_frag(1, 1, TEST_FRAG, TEST_FRAG, 1, &ff) != NULL;
+	ppacket = test_frag(1, 1, 2 * TEST_FRAG, 100, 0, &ff);
+	bad += test_whole(ff, ppacket, 1, 2 * TEST_FRAG + 100);
+
+	bad += test_frag(1, 2, 2 * TEST_FRAG, 100, 0, &ff) != NULL;
+	bad += test_frag(1, 2, TEST_FRAG, TEST_FRAG, 1, &ff) != NULL;
+	bad += test_frag(1, 2, TEST_FRAG, TEST_FRAG, 1, &ff) != NULL;
+	ppacket = test_frag(1, 2, 0, TEST_FRAG, 1, &ff);
+	bad += test_whole(ff, ppacket, 2, 2 * TEST_FRAG + 100);
+
+	//an overlap drops the packet, so it never completes
+	drops = stats.fragdropped;
+	bad += test_frag(1, 3, 0, TEST_FRAG, 1, &ff) != NULL;
+	bad += test_frag(1, 3, TEST_FRAG - 8, 16, 1, &ff) != NULL;
+	bad += test_frag(1, 3, TEST_FRAG, 100, 0, &ff) != NULL;
+	bad += stats.fragdropped == drops;
+
+	//a last fragment ending before data already held
+	bad += test_frag(1, 4, TEST_FRAG, TEST_FRAG, 1, &ff) != NULL;
+	bad += test_frag(1, 4, 0, 8, 0, &ff) != NULL;
+	bad += test_frag(1, 4, 0, TEST_FRAG, 1, &ff) != NULL;
+	IP4_reass_release();
+
+	//timed out
+	drops = stats.timedout;
+	bad += test_frag(1, 5, 0, TEST_FRAG, 1, &ff) != NULL;
+	IP4_reass_expire(test_sec() + IP4_REASS_TTL);
+	bad += stats.timedout != drops + 1;
+	bad += test_frag(1, 5, TEST_FRAG, 100, 0, &ff) != NULL;
+	IP4_reass_release();
+
+	//a source sending only first fragments fills its share, another one still gets through
+	drops = stats.fragdropped;
+	for (i = 0; i < 2 * IP4_REASS_FRAGS; i++) {
+		bad += test_frag(2, (uint16_t) i, 0, TEST_FRAG, 1, &ff) != NULL;
+	}
+	bad += stats.fragdropped == drops;
+	bad += test_frag(3, 1, TEST_FRAG, 100, 0, &ff) != NULL;
+	ppacket = test_frag(3, 1, 0, TEST_FRAG, 1, &ff);
+	bad += test_whole(ff, ppacket, 1, TEST_FRAG + 100);
+	IP4_reass_release();
+
+	//packets of 3 fragments interleaved, the last fragment first
+	start = test_now_ns();
+	for (r = 0; r < TEST_ROUNDS; r++) {
+		for (j = 0; j < 3; j++) {
+			for (i = 0; i < TEST_INFLIGHT; i++) {
+				ppacket = test_frag(4 + i % 16, (uint16_t) (r * TEST_INFLIGHT + i), (2 - j) * TEST_FRAG, j ? TEST_FRAG : 100, j != 0, &ff);
+				if (j == 2) {
+					if (ppacket == NULL) {
+						bad++;
+					} else {
+						freeFinsFrame(ff);
+					}
+				}
+			}
+		}
+	}
+	fprintf(stderr, "reassembly: %.1f ns per fragment, %u packets in flight\n", (double) (test_now_ns() - start) / (TEST_ROUNDS * TEST_INFLIGHT * 3),
+			TEST_INFLIGHT);
+	IP4_reass_release();
+	return bad;
+}
+
+/** a datagram of length bytes on its way down to IPv4 */
+struct finsFrame *test_datagram(uint16_t id, uint32_t length) {
+	struct finsFrame *ff = allocFinsFrame();
+	uint32_t i;
+
+	ff->dataOrCtrl = DATA;
+	ff->dataFrame.directionFlag = DOWN;
+	ff->dataFrame.pduLength = length;
+	ff->dataFrame.pdu = allocFinsPdu(length);
+	for (i = 0; i < length; i++) {
+		ff->dataFrame.pdu[i] = test_byte(id, i);
+	}
+	return ff;
+}
+
+/** what fragmenting cost with a pdu per fragment, header and data copied in */
+int test_copy_fragments(struct finsFrame *ff, struct ip4_packet *header, uint16_t length, struct finsFrame **ffs) {
+	uint32_t offset;
+	uint32_t len;
+	int num;
+
+	for (offset = 0, num = 0; offset < length; offset += len, num++) {
+		len = length - offset > IP4_FRAG_LEN ? IP4_FRAG_LEN : length - offset;
+		ffs[num] = allocFinsFrame();
+		ffs[num]->dataOrCtrl = DATA;
+		ffs[num]->dataFrame.pduLength = IP4_MIN_HLEN + len;
+		ffs[num]->dataFrame.pdu = allocFinsPdu(IP4_MIN_HLEN + len);
+		header->ip_len = htons(IP4_MIN_HLEN + len);
+		header->ip_fragoff = htons((offset + len < length ? IP4_MF << 13 : 0) | offset >> 3);
+		header->ip_cksum = 0;
+		header->ip_cksum = IP4_checksum(header, IP4_MIN_HLEN);
+		memcpy(ffs[num]->dataFrame.pdu, header, IP4_MIN_HLEN);
+		memcpy(ffs[num]->dataFrame.pdu + IP4_MIN_HLEN, ff->dataFrame.pdu + offset, len);
+	}
+	freeFinsFrame(ff);
+	return num;
+}
+
+/** fragments datagrams with IP4_fragment_data(), flattens the fragments the way the interface sends them
+ * and puts them back together with IP4_reass(), last fragment first. Then times fragmenting. */
+int test_fragment(void) {
+	struct ip4_packet_header hdr;
+	struct ip4_packet *header = (struct ip4_packet *) &hdr;
+	struct finsFrame *ffs[IP4_FRAG_MAX];
+	struct finsFrame *ff;
+	struct finsFrame *flat;
+	struct ip4_packet *ppacket;
+	uint64_t start, spent;
+	double zero, copy;
+	uint32_t length, tail_len, i;
+	uint16_t id;
+	int num, k;
+	int bad = 0;
+
+	for (length = IP4_FRAG_LEN + 1; length <= 20000; length += 331) {
+		IP4_const_header(header, 0x0a000002, 0x0a000001, IP4_PT_UDP);
+		id = ntohs(header->ip_id);
+		num = IP4_fragment_data(test_datagram(id, length), header, length, ffs);
+		bad += num != (int) ((length + IP4_FRAG_LEN - 1) / IP4_FRAG_LEN);
+
+		ppacket = NULL;
+		for (k = num - 1; k >= 0; k--) {
+			//zero copy while the datagram fits a pool class
+			if (k && tailFinsPdu(ffs[k]->dataFrame.pdu, &tail_len) == NULL && length + FINS_PDU_HEADROOM <= 16384) {
+				bad++;
+			}
+			flat = copyFinsFrame(ffs[k]);
+			freeFinsFrame(ffs[k]);
+			if (fins_csum_fold(fins_csum_partial(flat->dataFrame.pdu, IP4_MIN_HLEN, 0)) != 0) {
+				bad++;
+			}
+			ppacket = test_reass_frame(flat, 5);
+			if (k && ppacket != NULL) {
+				bad++;
+			}
+		}
+		bad += test_whole(flat, ppacket, id, length);
+	}
+
+	IP4_const_header(header, 0x0a000002, 0x0a000001, IP4_PT_UDP);
+	spent = 0;
+	for (i = 0; i < TEST_ROUNDS * 10; i++) {
+		ff = test_datagram(0, 16000);
+		start = test_now_ns();
+		num = IP4_fragment_data(ff, header, 16000, ffs);
+		spent += test_now_ns() - start;
+		for (k = 0; k < num; k++) {
+			freeFinsFrame(ffs[k]);
+		}
+	}
+	zero = (double) spent / (TEST_ROUNDS * 10);
+	spent = 0;
+	for (i = 0; i < TEST_ROUNDS * 10; i++) {
+		ff = test_datagram(0, 16000);
+		start = test_now_ns();
+		num = test_copy_fragments(ff, header, 16000, ffs);
+		spent += test_now_ns() - start;
+		for (k = 0; k < num; k++) {
+			freeFinsFrame(ffs[k]);
+		}
+	}
+	copy = (double) spent / (TEST_ROUNDS * 10);
+	fprintf(stderr, "fragmenting 16000 bytes: %.1f ns, %.1f ns copying each fragment\n", zero, copy);
+
+	IP4_reass_release();
+	return bad;
+}
+
+int main(int argc, char *argv[]) {
+	struct ip4_routing_table *table;
+	struct ip4_routing_table *entry;
+	struct ip4_next_hop_info want;
+	struct ip4_next_hop_info got;
+	uint64_t start;
+	struct ip4_route_trie *trie;
+	double build, mb, single, burst, walk;
+	uint32_t walks;
+	uint32_t s, i;
+	int bad = 0;
+
+	srand(1);
+	fprintf(stderr, "routes   build ms  trie MB   trie ns  burst ns   walk ns\n");
+	for (s = 0; s < sizeof(test_sizes) / sizeof(test_sizes[0]); s++) {
+		table = test_table(test_sizes[s]);
+		for (entry = table; entry->next_entry != NULL; entry = entry->next_entry) {
+			if (entry->mask < entry->next_entry->mask) {
+				bad++;
+			}
+		}
+		test_fill(table, test_sizes[s]);
+
+		start = test_now_ns();
+		trie = IP4_route_build(table);
+		build = (double) (test_now_ns() - start) / 1000000;
+		mb = (double) (sizeof(struct ip4_route_trie) + trie->node_num * sizeof(struct ip4_trie_node) + trie->leaf_num * sizeof(uint32_t) + trie->hop_num * sizeof(struct ip4_next_hop_info)) / 1000000;
+		IP4_route_free(trie);
+		IP4_route_update(table);
+
+		walks = TEST_WALK_BUDGET / test_sizes[s];
+		if (walks > TEST_LOOKUPS) {
+			walks = TEST_LOOKUPS;
+		}
+		for (i = 0; i < walks; i += 7) {
+			want = test_walk(table, test_dst[i]);
+			got = IP4_next_hop(test_dst[i]);
+			if (want.interface != got.interface || (want.interface != (uint32_t) -1 && want.address != got.address)) {
+				bad++;
+			}
+		}
+
+		start = test_now_ns();
+		for (i = 0; i < TEST_LOOKUPS; i++) {
+			test_info[i] = IP4_next_hop(test_dst[i]);
+		}
+		single = (double) (test_now_ns() - start) / TEST_LOOKUPS;
+
+		start = test_now_ns();
+		for (i = 0; i < TEST_LOOKUPS; i += TEST_BURST) {
+			IP4_next_hop_burst(test_dst + i, test_info + i, TEST_BURST);
+		}
+		burst = (double) (test_now_ns() - start) / TEST_LOOKUPS;
+		test_sink += test_info[TEST_LOOKUPS - 1].interface;
+		for (i = 0; i < TEST_LOOKUPS; i += 13) {
+			got = IP4_next_hop(test_dst[i]);
+			if (got.interface != test_info[i].interface || (got.interface != (uint32_t) -1 && got.address != test_info[i].address)) {
+				bad++;
+			}
+		}
+
+		start = test_now_ns();
+		for (i = 0; i < walks; i++) {
+			test_sink += test_walk(table, test_dst[i]).interface;
+		}
+		walk = (double) (test_now_ns() - start) / walks;
+
+		fprintf(stderr, "%6u %10.2f %8.1f %9.1f %9.1f %9.1f\n", test_sizes[s], build, mb, single, burst, walk);
+		test_free(table);
+	}
+	IP4_route_release();
+	fprintf(stderr, "mismatches=%d\n", bad);
+
+	i = test_reass();
+	fprintf(stderr, "reassembly errors=%u\n", i);
+	bad += i;
+
+	i = test_fragment();
+	fprintf(stderr, "fragmentation errors=%u\n", i);
+	bad += i;
+	return bad != 0;
+}
@@ -14,13 +14,14 @@
 #include <queueModule.h>
 #include "rtm.h"
 
-//declares external semaphores to manage/protect the RTM_to_Switch Queue multithreading
-sem_t RTM_to_Switch_Qsem;
-finsQueue RTM_to_Switch_Queue;
+//ring from the RTM to the switch, RTM is its only producer
+finsRing RTM_to_Switch_Queue;
 
-//declares external semaphores to manage/protect the RTM_to_Switch Queue due to multithreading
-sem_t Switch_to_RTM_Qsem;
-finsQueue Switch_to_RTM_Queue;
+//ring from the switch to the RTM
+finsRing Switch_to_RTM_Queue;
+struct finsEvent Switch_to_RTM_Event;
+
+extern struct finsEvent Switch_Event;
 
 //declares file descriptors for the two pipes
 int rtm_in_fd;
@@ -42,9 +43,10 @@ void rtm_get_ff() {
 	
 	struct finsFrame *ff;
 	do {
-		sem_wait(&Switch_to_RTM_Qsem);
-		ff = read_queue(Switch_to_RTM_Queue);
-		sem_post(&Switch_to_RTM_Qsem);
+		ff = read_ring(Switch_to_RTM_Queue);
+		if (ff == NULL) {
+			wait_event(&Switch_to_RTM_Event);
+		}
 	} while (ff == NULL);
 
 	if (ff->dataOrCtrl == CONTROL) { //CONTROL FF
@@ -153,9 +155,8 @@ void rtm_init(pthread_attr_t *fins_pthread_attr) {
 		fins_frame->ctrlFrame.serial_num = temp_serial_cntr;
 
 		//SEND TO QUEUE
-		sem_wait(&RTM_to_Switch_Qsem);
-		write_queue(fins_frame, RTM_to_Switch_Queue);
-		sem_post(&RTM_to_Switch_Qsem);
+		write_ring(fins_frame, RTM_to_Switch_Queue);
+		post_event(&Switch_Event);
 		PRINT_DEBUG("sent data ");
 
 		//READ FROM QUEUE
@@ -10,218 +10,306 @@
 #include <metadata.h>
 #include <queueModule.h>
 #include <arpa/inet.h>
+#include <libconfig.h>
 
 int switch_running;
 pthread_t switch_thread;
 
-#define MAX_modules 16
-extern finsQueue Daemon_to_Switch_Queue;
-extern finsQueue Switch_to_Daemon_Queue;
+extern finsRing Daemon_to_Switch_Queue;
+extern finsRing Switch_to_Daemon_Queue;
 
-extern finsQueue Switch_to_Interface_Queue;
-extern finsQueue Interface_to_Switch_Queue;
+extern finsRing Switch_to_Interface_Queue;
+extern finsRing Interface_to_Switch_Queue;
 
-extern finsQueue Switch_to_ARP_Queue;
-extern finsQueue ARP_to_Switch_Queue;
+extern finsRing Switch_to_ARP_Queue;
+extern finsRing ARP_to_Switch_Queue;
 
-extern finsQueue Switch_to_IPv4_Queue;
-extern finsQueue IPv4_to_Switch_Queue;
+extern finsRing Switch_to_IPv4_Queue;
+extern finsRing IPv4_to_Switch_Queue;
 
-extern finsQueue RTM_to_Switch_Queue;
-extern finsQueue Switch_to_RTM_Queue;
+extern finsRing RTM_to_Switch_Queue;
+extern finsRing Switch_to_RTM_Queue;
 
-extern finsQueue Switch_to_UDP_Queue;
-extern finsQueue UDP_to_Switch_Queue;
+extern finsRing Switch_to_UDP_Queue;
+extern finsRing UDP_to_Switch_Queue;
 
-extern finsQueue Switch_to_TCP_Queue;
-extern finsQueue TCP_to_Switch_Queue;
+extern finsRing Switch_to_TCP_Queue;
+extern finsRing TCP_to_Switch_Queue;
 
-extern finsQueue Switch_to_ICMP_Queue;
-extern finsQueue ICMP_to_Switch_Queue;
+extern finsRing Switch_to_ICMP_Queue;
+extern finsRing ICMP_to_Switch_Queue;
 
+/** TCP and the daemon write to the switch from several threads, so their producers are
+ * serialized on these. The switch never takes them */
 extern sem_t Daemon_to_Switch_Qsem;
-extern sem_t Switch_to_Daemon_Qsem;
+extern sem_t TCP_to_Switch_Qsem;
 
-extern sem_t Switch_to_Interface_Qsem;
-extern sem_t Interface_to_Switch_Qsem;
+extern struct finsEvent Switch_to_Daemon_Event;
+extern struct finsEvent Switch_to_Interface_Event;
+extern struct finsEvent Switch_to_ARP_Event;
+extern struct finsEvent Switch_to_IPv4_Event;
+extern struct finsEvent Switch_to_UDP_Event;
+extern struct finsEvent Switch_to_TCP_Event;
+extern struct finsEvent Switch_to_ICMP_Event;
+extern struct finsEvent Switch_to_RTM_Event;
 
-extern sem_t Switch_to_ARP_Qsem;
-extern sem_t ARP_to_Switch_Qsem;
+/** posted by every module after writing to its *_to_Switch queue */
+struct finsEvent Switch_Event;
 
-extern sem_t Switch_to_IPv4_Qsem;
-extern sem_t IPv4_to_Switch_Qsem;
+/** rings indexed by module ID, from the module to the switch and from the switch to the module */
+finsRing switch_in[MAX_ID];
+finsRing switch_out[MAX_ID];
+struct finsEvent *switch_out_event[MAX_ID];
 
-extern sem_t Switch_to_UDP_Qsem;
-extern sem_t UDP_to_Switch_Qsem;
+/** compiled forwarding table: switch_table[src][dst] has a bit set for every module ID that receives
+ * a frame sent by module src to module dst. See switch_table_init() */
+uint32_t switch_table[MAX_ID][MAX_ID];
 
-extern sem_t Switch_to_TCP_Qsem;
-extern sem_t TCP_to_Switch_Qsem;
+void Queues_init(void) { //TODO split & move to each module, when registration is done
+	init_event(&Switch_Event);
 
-extern sem_t ICMP_to_Switch_Qsem;
-extern sem_t Switch_to_ICMP_Qsem;
+	Daemon_to_Switch_Queue = init_ring("daemon_to_switch", MAX_Queue_size);
+	Switch_to_Daemon_Queue = init_ring("switch_to_daemon", MAX_Queue_size);
+	switch_in[DAEMON_ID] = Daemon_to_Switch_Queue;
+	switch_out[DAEMON_ID] = Switch_to_Daemon_Queue;
+	sem_init(&Daemon_to_Switch_Qsem, 0, 1);
+	init_event(&Switch_to_Daemon_Event);
+	switch_out_event[DAEMON_ID] = &Switch_to_Daemon_Event;
+
+	Interface_to_Switch_Queue = init_ring("etherstub_to_switch", MAX_Queue_size);
+	Switch_to_Interface_Queue = init_ring("switch_to_etherstub", MAX_Queue_size);
+	switch_in[INTERFACE_ID] = Interface_to_Switch_Queue;
+	switch_out[INTERFACE_ID] = Switch_to_Interface_Queue;
+	init_event(&Switch_to_Interface_Event);
+	switch_out_event[INTERFACE_ID] = &Switch_to_Interface_Event;
+
+	ARP_to_Switch_Queue = init_ring("arp_to_switch", MAX_Queue_size);
+	Switch_to_ARP_Queue = init_ring("switch_to_arp", MAX_Queue_size);
+	switch_in[ARP_ID] = ARP_to_Switch_Queue;
+	switch_out[ARP_ID] = Switch_to_ARP_Queue;
+	init_event(&Switch_to_ARP_Event);
+	switch_out_event[ARP_ID] = &Switch_to_ARP_Event;
+
+	IPv4_to_Switch_Queue = init_ring("ipv4_to_switch", MAX_Queue_size);
+	Switch_to_IPv4_Queue = init_ring("switch_to_ipv4", MAX_Queue_size);
+	switch_in[IPV4_ID] = IPv4_to_Switch_Queue;
+	switch_out[IPV4_ID] = Switch_to_IPv4_Queue;
+	init_event(&Switch_to_IPv4_Event);
+	switch_out_event[IPV4_ID] = &Switch_to_IPv4_Event;
+
+	UDP_to_Switch_Queue = init_ring("udp_to_switch", MAX_Queue_size);
+	Switch_to_UDP_Queue = init_ring("switch_to_udp", MAX_Queue_size);
+	switch_in[UDP_ID] = UDP_to_Switch_Queue;
+	switch_out[UDP_ID] = Switch_to_UDP_Queue;
+	init_event(&Switch_to_UDP_Event);
+	switch_out_event[UDP_ID] = &Switch_to_UDP_Event;
+
+	TCP_to_Switch_Queue = init_ring("tcp_to_switch", MAX_Queue_size);
+	Switch_to_TCP_Queue = init_ring("switch_to_tcp", MAX_Queue_size);
+	switch_in[TCP_ID] = TCP_to_Switch_Queue;
+	switch_out[TCP_ID] = Switch_to_TCP_Queue;
+	sem_init(&TCP_to_Switch_Qsem, 0, 1);
+	init_event(&Switch_to_TCP_Event);
+	switch_out_event[TCP_ID] = &Switch_to_TCP_Event;
+
+	ICMP_to_Switch_Queue = init_ring("icmp_to_switch", MAX_Queue_size);
+	Switch_to_ICMP_Queue = init_ring("switch_to_icmp", MAX_Queue_size);
+	switch_in[ICMP_ID] = ICMP_to_Switch_Queue;
+	switch_out[ICMP_ID] = Switch_to_ICMP_Queue;
+	init_event(&Switch_to_ICMP_Event);
+	switch_out_event[ICMP_ID] = &Switch_to_ICMP_Event;
+
+	RTM_to_Switch_Queue = init_ring("rtm_to_switch", MAX_Queue_size);
+	Switch_to_RTM_Queue = init_ring("switch_to_rtm", MAX_Queue_size);
+	switch_in[RTM_ID] = RTM_to_Switch_Queue;
+	switch_out[RTM_ID] = Switch_to_RTM_Queue;
+	init_event(&Switch_to_RTM_Event);
+	switch_out_event[RTM_ID] = &Switch_to_RTM_Event;
+}
 
-extern sem_t RTM_to_Switch_Qsem;
-extern sem_t Switch_to_RTM_Qsem;
+/**@brief builds the forwarding table: every frame goes to the module it is addressed to, plus any taps
+ * listed in the "switch" group of the config file, e.g.
+ * switch = { taps = ( { src = 0; dst = 3; to = 8; } ); };
+ * delivers every frame addressed to IPv4 (3) to the RTM (8) as well. src = 0 matches any sender.
+ * @param file the config file, the defaults are kept if it can't be read
+ * */
+void switch_table_init(const char *file) {
+	config_t cfg;
+	config_setting_t *taps;
+	config_setting_t *tap;
+	int src;
+	int dst;
+	int to;
+	int i;
 
-finsQueue modules_IO_queues[MAX_modules];
-sem_t *IO_queues_sem[MAX_modules];
+	memset(switch_table, 0, sizeof(switch_table));
+	for (src = 0; src < MAX_ID; src++) {
+		for (dst = 1; dst < MAX_ID; dst++) {
+			if (switch_out[dst]) {
+				switch_table[src][dst] = 1 << dst;
+			}
+		}
+	}
+
+	config_init(&cfg);
+	if (!config_read_file(&cfg, file)) {
+		PRINT_DEBUG("no switch config, using defaults: file='%s', error='%s'", file, config_error_text(&cfg));
+		config_destroy(&cfg);
+		return;
+	}
+
+	taps = config_lookup(&cfg, "switch.taps");
+	if (taps) {
+		for (i = 0; i < config_setting_length(taps); i++) {
+			tap = config_setting_get_elem(taps, i);
+			if (config_setting_get_member(tap, "src") == NULL || config_setting_get_member(tap, "dst") == NULL
+					|| config_setting_get_member(tap, "to") == NULL) {
+				PRINT_ERROR("switch tap %d missing src/dst/to", i);
+				continue;
+			}
+			src = config_setting_get_int(config_setting_get_member(tap, "src"));
+			dst = config_setting_get_int(config_setting_get_member(tap, "dst"));
+			to = config_setting_get_int(config_setting_get_member(tap, "to"));
 
-void Queues_init(void) { //TODO split & move to each module, when registration is done
-	Daemon_to_Switch_Queue = init_queue("daemon_to_switch", MAX_Queue_size);
-	Switch_to_Daemon_Queue = init_queue("switch_to_daemon", MAX_Queue_size);
-	modules_IO_queues[0] = Daemon_to_Switch_Queue;
-	modules_IO_queues[1] = Switch_to_Daemon_Queue;
-	sem_init(&Daemon_to_Switch_Qsem, 0, 1);
-	sem_init(&Switch_to_Daemon_Qsem, 0, 1);
-	IO_queues_sem[0] = &Daemon_to_Switch_Qsem;
-	IO_queues_sem[1] = &Switch_to_Daemon_Qsem;
-
-	Interface_to_Switch_Queue = init_queue("etherstub_to_switch", MAX_Queue_size);
-	Switch_to_Interface_Queue = init_queue("switch_to_etherstub", MAX_Queue_size);
-	modules_IO_queues[10] = Interface_to_Switch_Queue;
-	modules_IO_queues[11] = Switch_to_Interface_Queue;
-	sem_init(&Interface_to_Switch_Qsem, 0, 1);
-	sem_init(&Switch_to_Interface_Qsem, 0, 1);
-	IO_queues_sem[10] = &Interface_to_Switch_Qsem;
-	IO_queues_sem[11] = &Switch_to_Interface_Qsem;
-
-	ARP_to_Switch_Queue = init_queue("arp_to_switch", MAX_Queue_size);
-	Switch_to_ARP_Queue = init_queue("switch_to_arp", MAX_Queue_size);
-	modules_IO_queues[8] = ARP_to_Switch_Queue;
-	modules_IO_queues[9] = Switch_to_ARP_Queue;
-	sem_init(&ARP_to_Switch_Qsem, 0, 1);
-	sem_init(&Switch_to_ARP_Qsem, 0, 1);
-	IO_queues_sem[8] = &ARP_to_Switch_Qsem;
-	IO_queues_sem[9] = &Switch_to_ARP_Qsem;
-
-	IPv4_to_Switch_Queue = init_queue("ipv4_to_switch", MAX_Queue_size);
-	Switch_to_IPv4_Queue = init_queue("switch_to_ipv4", MAX_Queue_size);
-	modules_IO_queues[6] = IPv4_to_Switch_Queue;
-	modules_IO_queues[7] = Switch_to_IPv4_Queue;
-	sem_init(&IPv4_to_Switch_Qsem, 0, 1);
-	sem_init(&Switch_to_IPv4_Qsem, 0, 1);
-	IO_queues_sem[6] = &IPv4_to_Switch_Qsem;
-	IO_queues_sem[7] = &Switch_to_IPv4_Qsem;
-
-	UDP_to_Switch_Queue = init_queue("udp_to_switch", MAX_Queue_size);
-	Switch_to_UDP_Queue = init_queue("switch_to_udp", MAX_Queue_size);
-	modules_IO_queues[2] = UDP_to_Switch_Queue;
-	modules_IO_queues[3] = Switch_to_UDP_Queue;
-	sem_init(&UDP_to_Switch_Qsem, 0, 1);
-	sem_init(&Switch_to_UDP_Qsem, 0, 1);
-	IO_queues_sem[2] = &UDP_to_Switch_Qsem;
-	IO_queues_sem[3] = &Switch_to_UDP_Qsem;
-
-	TCP_to_Switch_Queue = init_queue("tcp_to_switch", MAX_Queue_size);
-	Switch_to_TCP_Queue = init_queue("switch_to_tcp", MAX_Queue_size);
-	modules_IO_queues[4] = TCP_to_Switch_Queue;
-	modules_IO_queues[5] = Switch_to_TCP_Queue;
-	sem_init(&TCP_to_Switch_Qsem, 0, 1);
-	sem_init(&Switch_to_TCP_Qsem, 0, 1);
-	IO_queues_sem[4] = &TCP_to_Switch_Qsem;
-	IO_queues_sem[5] = &Switch_to_TCP_Qsem;
-
-	ICMP_to_Switch_Queue = init_queue("icmp_to_switch", MAX_Queue_size);
-	Switch_to_ICMP_Queue = init_queue("switch_to_icmp", MAX_Queue_size);
-	modules_IO_queues[12] = ICMP_to_Switch_Queue;
-	modules_IO_queues[13] = Switch_to_ICMP_Queue;
-	sem_init(&ICMP_to_Switch_Qsem, 0, 1);
-	sem_init(&Switch_to_ICMP_Qsem, 0, 1);
-	IO_queues_sem[12] = &ICMP_to_Switch_Qsem;
-	IO_queues_sem[13] = &Switch_to_ICMP_Qsem;
-
-	RTM_to_Switch_Queue = init_queue("rtm_to_switch", MAX_Queue_size);
-	Switch_to_RTM_Queue = init_queue("switch_to_rtm", MAX_Queue_size);
-	modules_IO_queues[14] = RTM_to_Switch_Queue;
-	modules_IO_queues[15] = Switch_to_RTM_Queue;
-	sem_init(&RTM_to_Switch_Qsem, 0, 1);
-	sem_init(&Switch_to_RTM_Qsem, 0, 1);
-	IO_queues_sem[14] = &RTM_to_Switch_Qsem;
-	IO_queues_sem[15] = &Switch_to_RTM_Qsem;
+			if (src < 0 || src >= MAX_ID || dst <= 0 || dst >= MAX_ID || to <= 0 || to >= MAX_ID || switch_out[to] == NULL) {
+				PRINT_ERROR("switch tap %d out of range: src=%d, dst=%d, to=%d", i, src, dst, to);
+				continue;
+			}
+
+			PRINT_DEBUG("tap: src=%d, dst=%d, to=%d", src, dst, to);
+			if (src == SWITCH_ID) {
+				for (src = 0; src < MAX_ID; src++) {
+					switch_table[src][dst] |= 1 << to;
+				}
+			} else {
+				switch_table[src][dst] |= 1 << to;
+			}
+		}
+	}
+
+	config_destroy(&cfg);
+}
+
+/**@brief looks up the modules a frame sent by module src is delivered to. Extra destinations in
+ * destinationID.next are consumed, the switch frees their nodes
+ * @return the set of module IDs, one bit each, 0 if the frame is to be dropped
+ * */
+static uint32_t switch_route(struct finsFrame *ff, int src, int counter) {
+	struct destinationList *dest;
+	struct destinationList *next;
+	uint32_t mask = 0;
+
+	if (ff->destinationID.id < MAX_ID) {
+		mask = switch_table[src][ff->destinationID.id];
+	}
+
+	for (dest = ff->destinationID.next; dest; dest = next) {
+		if (dest->id < MAX_ID) {
+			mask |= switch_table[src][dest->id];
+		}
+		next = dest->next;
+		free(dest);
+	}
+	ff->destinationID.next = NULL;
+
+	PRINT_DEBUG("Counter=%d, from='%s', dst=%u, to_mask=0x%x, ff=%p, meta=%p", counter, switch_in[src]->name, ff->destinationID.id, mask, ff, ff->metaData);
+	return mask;
 }
 
 void *switch_loop(void *local) {
 	PRINT_DEBUG("Entered");
 
-	int i;
+	int src;
+	int to;
+	int j;
+	int n;
+	int found;
+	int written;
+	int copy;
+	uint32_t mask;
+	uint32_t to_mask;
 	struct finsFrame *ff;
+	struct finsFrame *shared;
+	struct finsFrame *burst[SWITCH_BURST];
+	struct finsFrame *out[MAX_ID][SWITCH_BURST];
+	int out_len[MAX_ID];
 
 	int counter = 0;
 
 	while (switch_running) {
-		/** the receiving Queues are only the even numbers
-		 * 0,2,4,6,8,10,12,14. This is why we increase the counter by 2
-		 */
-		for (i = 0; i < MAX_modules; i = i + 2) {
-			sem_wait(IO_queues_sem[i]);
-			ff = read_queue(modules_IO_queues[i]);
-			sem_post(IO_queues_sem[i]);
-
-			if (ff != NULL) {
-				counter++;
-				//PRINT_DEBUG("Counter %d", counter);
-
-				switch (ff->destinationID.id) {
-				case ARP_ID:
-					PRINT_DEBUG("Counter=%d, from='%s' to ARP Queue +1, ff=%p, meta=%p", counter, modules_IO_queues[i]->name, ff, ff->metaData);
-					sem_wait(&Switch_to_ARP_Qsem);
-					write_queue(ff, Switch_to_ARP_Queue);
-					sem_post(&Switch_to_ARP_Qsem);
-					break;
-				case RTM_ID:
-					PRINT_DEBUG("Counter=%d, from='%s' to RTM Queue +1, ff=%p, meta=%p", counter, modules_IO_queues[i]->name, ff, ff->metaData);
-					sem_wait(&Switch_to_RTM_Qsem);
-					write_queue(ff, Switch_to_RTM_Queue);
-					sem_post(&Switch_to_RTM_Qsem);
-					break;
-				case DAEMON_ID:
-					PRINT_DEBUG("Counter=%d, from='%s' to Daemon Queue +1, ff=%p, meta=%p", counter, modules_IO_queues[i]->name, ff, ff->metaData);
-					sem_wait(&Switch_to_Daemon_Qsem);
-					write_queue(ff, Switch_to_Daemon_Queue);
-					sem_post(&Switch_to_Daemon_Qsem);
-					break;
-				case UDP_ID:
-					PRINT_DEBUG("Counter=%d, from='%s' to UDP Queue +1, ff=%p, meta=%p", counter, modules_IO_queues[i]->name, ff, ff->metaData);
-					sem_wait(&Switch_to_UDP_Qsem);
-					write_queue(ff, Switch_to_UDP_Queue);
-					sem_post(&Switch_to_UDP_Qsem);
-					break;
-				case TCP_ID:
-					PRINT_DEBUG("Counter=%d, from='%s' to TCP Queue +1, ff=%p, meta=%p", counter, modules_IO_queues[i]->name, ff, ff->metaData);
-					sem_wait(&Switch_to_TCP_Qsem);
-					write_queue(ff, Switch_to_TCP_Queue);
-					sem_post(&Switch_to_TCP_Qsem);
-					break;
-				case IPV4_ID:
-					PRINT_DEBUG("Counter=%d, from='%s' to IPv4 Queue +1, ff=%p, meta=%p", counter, modules_IO_queues[i]->name, ff, ff->metaData);
-					sem_wait(&Switch_to_IPv4_Qsem);
-					write_queue(ff, Switch_to_IPv4_Queue);
-					sem_post(&Switch_to_IPv4_Qsem);
-					break;
-				case INTERFACE_ID:
-					PRINT_DEBUG("Counter=%d, from='%s' to Interface Queue +1, ff=%p, meta=%p", counter, modules_IO_queues[i]->name, ff, ff->metaData);
-					sem_wait(&Switch_to_Interface_Qsem);
-					write_queue(ff, Switch_to_Interface_Queue);
-					sem_post(&Switch_to_Interface_Qsem);
-					break;
-				case ICMP_ID:
-					PRINT_DEBUG("Counter=%d, from='%s' to ICMP Queue +1, ff=%p, meta=%p", counter, modules_IO_queues[i]->name, ff, ff->metaData);
-					sem_wait(&Switch_to_ICMP_Qsem);
-					write_queue(ff, Switch_to_ICMP_Queue);
-					sem_post(&Switch_to_ICMP_Qsem);
-					break;
-				default:
-					PRINT_DEBUG("Counter=%d, from='%s' to Unknown Dest, ff=%p, meta=%p", counter, modules_IO_queues[i]->name, ff, ff->metaData);
-					freeFinsFrame(ff);
-					break;
-				} // end of Switch statement
-			} // end of if (ff != NULL )
-			else { //PRINT_DEBUG("No frame read from Queue # %d", i);
+		wait_event(&Switch_Event);
 
+		/** drain every ready ring before sleeping again, up to SWITCH_BURST frames at a time. Frames
+		 * are binned by destination so each destination ring is published once per burst
+		 */
+		do {
+			found = 0;
+			to_mask = 0;
+
+			for (src = 1; src < MAX_ID; src++) {
+				if (switch_in[src] == NULL) {
+					continue;
+				}
+
+				n = read_ring_burst(burst, SWITCH_BURST, switch_in[src]);
+				if (n == 0) {
+					continue;
+				}
+				found += n;
+
+				memset(out_len, 0, sizeof(out_len));
+				for (j = 0; j < n; j++) {
+					counter++;
+					ff = burst[j];
+					mask = switch_route(ff, src, counter);
+
+					if (mask == 0) {
+						PRINT_DEBUG("Counter=%d, from='%s' to Unknown Dest, ff=%p, meta=%p", counter, switch_in[src]->name, ff, ff->metaData);
+						freeFinsFrame(ff);
+						continue;
+					}
+
+					copy = 0;
+					if (mask & (mask - 1)) {
+						shared = shareFinsFrame(ff, __builtin_popcount(mask));
+						if (shared) {
+							ff = shared;
+						} else {
+							copy = 1; //pool empty, every destination but the first gets its own copy
+						}
+					}
+
+					while (mask) {
+						to = __builtin_ctz(mask);
+						mask &= mask - 1;
+						out[to][out_len[to]++] = ff;
+						if (copy && mask) {
+							ff = copyFinsFrame(ff);
+						}
+					}
+				}
+
+				for (to = 1; to < MAX_ID; to++) {
+					if (out_len[to] == 0) {
+						continue;
+					}
+
+					written = write_ring_burst(out[to], out_len[to], switch_out[to]);
+					for (j = written; j < out_len[to]; j++) {
+						PRINT_ERROR("Full queue: name='%s', ff=%p", switch_out[to]->name, out[to][j]);
+						freeFinsFrame(out[to][j]);
+					}
+					to_mask |= 1 << to;
+				}
 			}
 
-		} //end of for For loop (Round Robin reading from Modules)
-
+			//wake each destination once per pass rather than once per frame
+			for (to = 1; to < MAX_ID; to++) {
+				if (to_mask & (1 << to)) {
+					post_event(switch_out_event[to]);
+				}
+			}
+		} while (found && switch_running);
 	} // end of while loop
 
 	PRINT_DEBUG("Exited");
@@ -233,7 +321,7 @@ void switch_init(void) {
 	switch_running = 1;
 
 	Queues_init(); //TODO split & move to each module
-	//TODO not much, init queues here?
+	switch_table_init(SWITCH_CONFIG_FILE);
 }
 
 void switch_run(pthread_attr_t *fins_pthread_attr) {
@@ -245,6 +333,7 @@ void switch_run(pthread_attr_t *fins_pthread_attr) {
 void switch_shutdown(void) {
 	PRINT_DEBUG("Entered");
 	switch_running = 0;
+	post_event(&Switch_Event);
 
 	//TODO expand this
 
@@ -256,6 +345,6 @@ void switch_release(void) {
 	PRINT_DEBUG("Entered");
 	//TODO free all module related mem
 
-	term_queue(RTM_to_Switch_Queue); //TODO move to RTM module when that's updated
-	term_queue(Switch_to_RTM_Queue);
+	term_ring(RTM_to_Switch_Queue); //TODO move to RTM module when that's updated
+	term_ring(Switch_to_RTM_Queue);
 }
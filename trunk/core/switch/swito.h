@@ -12,7 +12,14 @@
 
 #define MAX_Queue_size 100000
 
+/** max frames the switch pulls from one queue at a time */
+#define SWITCH_BURST 32
+
+/** read by switch_init() for the forwarding table, relative to where the core is started */
+#define SWITCH_CONFIG_FILE "fins.cfg"
+
 void Queues_init(void);
+void switch_table_init(const char *file);
 
 void switch_init(void);
 void switch_run(pthread_attr_t *fins_pthread_attr);
@@ -0,0 +1,286 @@
+/**@file test_switch.c
+ *@brief benchmarks the switch on its own: CPU used while idle and the latency of forwarding
+ * a frame from one module queue to another. Results go to stderr, so run as ./test_switch > /dev/null
+ * to drop the debug output.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <finstypes.h>
+#include <finsdebug.h>
+#include <queueModule.h>
+#include "swito.h"
+
+#define TEST_FRAMES 100000
+#define TEST_GAP_US 20
+#define TEST_BULK_FRAMES 2000000
+#define TEST_WINDOW 1024
+
+finsRing Daemon_to_Switch_Queue;
+finsRing Switch_to_Daemon_Queue;
+finsRing Switch_to_Interface_Queue;
+finsRing Interface_to_Switch_Queue;
+finsRing Switch_to_ARP_Queue;
+finsRing ARP_to_Switch_Queue;
+finsRing Switch_to_IPv4_Queue;
+finsRing IPv4_to_Switch_Queue;
+finsRing RTM_to_Switch_Queue;
+finsRing Switch_to_RTM_Queue;
+finsRing Switch_to_UDP_Queue;
+finsRing UDP_to_Switch_Queue;
+finsRing Switch_to_TCP_Queue;
+finsRing TCP_to_Switch_Queue;
+finsRing Switch_to_ICMP_Queue;
+finsRing ICMP_to_Switch_Queue;
+
+sem_t Daemon_to_Switch_Qsem;
+sem_t TCP_to_Switch_Qsem;
+
+struct finsEvent Switch_to_Daemon_Event;
+struct finsEvent Switch_to_Interface_Event;
+struct finsEvent Switch_to_ARP_Event;
+struct finsEvent Switch_to_IPv4_Event;
+struct finsEvent Switch_to_UDP_Event;
+struct finsEvent Switch_to_TCP_Event;
+struct finsEvent Switch_to_ICMP_Event;
+struct finsEvent Switch_to_RTM_Event;
+
+extern struct finsEvent Switch_Event;
+
+extern sem_t control_serial_sem;
+
+uint64_t latency[TEST_FRAMES];
+
+uint64_t test_now_ns(clockid_t clock) {
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/** plays the UDP module: stamps each frame with its send time and hands it to the switch for IPv4 */
+void *test_producer(void *local) {
+	struct finsFrame *ff;
+	int i;
+
+	for (i = 0; i < TEST_FRAMES; i++) {
+		ff = (struct finsFrame *) malloc(sizeof(struct finsFrame));
+		if (ff == NULL) {
+			PRINT_ERROR("ff alloc fail");
+			exit(-1);
+		}
+		ff->dataOrCtrl = DATA;
+		ff->destinationID.id = IPV4_ID;
+		ff->destinationID.next = NULL;
+		ff->metaData = NULL;
+		ff->dataFrame.directionFlag = DOWN;
+		ff->dataFrame.pduLength = sizeof(uint64_t);
+		ff->dataFrame.pdu = (uint8_t *) malloc(sizeof(uint64_t));
+		if (ff->dataFrame.pdu == NULL) {
+			PRINT_ERROR("pdu alloc fail");
+			exit(-1);
+		}
+		*(uint64_t *) ff->dataFrame.pdu = test_now_ns(CLOCK_MONOTONIC);
+
+		if (!write_ring(ff, UDP_to_Switch_Queue)) {
+			PRINT_ERROR("ring full");
+			exit(-1);
+		}
+		post_event(&Switch_Event);
+
+		usleep(TEST_GAP_US);
+	}
+
+	pthread_exit(NULL);
+}
+
+/** plays the IPv4 module: sleeps on its event like ipv4 does and records each frame's latency */
+void *test_consumer(void *local) {
+	struct finsFrame *ff;
+	int count = 0;
+
+	while (count < TEST_FRAMES) {
+		ff = read_ring(Switch_to_IPv4_Queue);
+
+		if (ff == NULL) {
+			wait_event(&Switch_to_IPv4_Event);
+			continue;
+		}
+
+		latency[count++] = test_now_ns(CLOCK_MONOTONIC) - *(uint64_t *) ff->dataFrame.pdu;
+		freeFinsFrame(ff);
+	}
+
+	pthread_exit(NULL);
+}
+
+struct finsFrame *test_frame(void) {
+	struct finsFrame *ff = (struct finsFrame *) malloc(sizeof(struct finsFrame));
+	if (ff == NULL) {
+		PRINT_ERROR("ff alloc fail");
+		exit(-1);
+	}
+	ff->dataOrCtrl = DATA;
+	ff->destinationID.id = IPV4_ID;
+	ff->destinationID.next = NULL;
+	ff->metaData = NULL;
+	ff->dataFrame.directionFlag = DOWN;
+	ff->dataFrame.pduLength = 0;
+	ff->dataFrame.pdu = NULL;
+	return ff;
+}
+
+/** plays the UDP module at full rate, handing frames over in bursts. TEST_WINDOW frames are
+ * recycled through test_bulk_consumer so malloc is not what gets measured */
+void *test_bulk_producer(void *local) {
+	struct finsFrame *pool[TEST_WINDOW];
+	int avail = TEST_WINDOW;
+	int sent = 0;
+	int n;
+	int got;
+
+	for (n = 0; n < TEST_WINDOW; n++) {
+		pool[n] = test_frame();
+	}
+
+	while (sent < TEST_BULK_FRAMES) {
+		n = avail < SWITCH_BURST ? avail : SWITCH_BURST;
+		if (n > TEST_BULK_FRAMES - sent) {
+			n = TEST_BULK_FRAMES - sent;
+		}
+		if (n) {
+			for (got = avail - n; got < avail; got++) {
+				pool[got]->destinationID.id = IPV4_ID;
+			}
+			n = write_ring_burst(&pool[avail - n], n, UDP_to_Switch_Queue);
+			avail -= n;
+			sent += n;
+			post_event(&Switch_Event);
+		}
+
+		got = read_ring_burst(&pool[avail], TEST_WINDOW - avail, Switch_to_UDP_Queue);
+		avail += got;
+		if (n == 0 && got == 0) {
+			sched_yield();
+		}
+	}
+
+	while (avail < TEST_WINDOW) {
+		avail += read_ring_burst(&pool[avail], TEST_WINDOW - avail, Switch_to_UDP_Queue);
+	}
+	for (n = 0; n < TEST_WINDOW; n++) {
+		freeFinsFrame(pool[n]);
+	}
+
+	pthread_exit(NULL);
+}
+
+/** plays the IPv4 module the way its thread runs, a burst at a time, bouncing every frame back to the
+ * producer through the switch to UDP ring */
+void *test_bulk_consumer(void *local) {
+	struct finsFrame *burst[RING_BURST];
+	struct finsBatch batch;
+	int running = 1;
+	int count = 0;
+	int n;
+	int i;
+
+	init_batch(&batch, &IPv4_to_Switch_Queue, &Switch_Event);
+	while (count < TEST_BULK_FRAMES) {
+		n = read_ring_wait(burst, RING_BURST, Switch_to_IPv4_Queue, &Switch_to_IPv4_Event, &running);
+
+		count += n;
+		for (i = 0; i < n; i++) {
+			burst[i]->destinationID.id = UDP_ID;
+			write_batch(burst[i], &batch);
+		}
+		flush_batch(&batch);
+	}
+
+	pthread_exit(NULL);
+}
+
+int test_compare(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *) a;
+	uint64_t y = *(const uint64_t *) b;
+	return (x > y) - (x < y);
+}
+
+int main(int argc, char *argv[]) {
+	pthread_t producer;
+	pthread_t consumer;
+	struct finsFrame *ff;
+	struct finsFrame *ff_tap;
+	uint64_t wall;
+	uint64_t cpu;
+
+	sem_init(&control_serial_sem, 0, 1);
+
+	switch_init();
+	switch_run(NULL);
+
+	//idle: nothing is written, so the switch should not be scheduled at all
+	wall = test_now_ns(CLOCK_MONOTONIC);
+	cpu = test_now_ns(CLOCK_PROCESS_CPUTIME_ID);
+	sleep(2);
+	cpu = test_now_ns(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+	wall = test_now_ns(CLOCK_MONOTONIC) - wall;
+	fprintf(stderr, "idle: cpu=%.3f%% of one core\n", 100.0 * cpu / wall);
+
+	//forwarding latency UDP -> switch -> IPv4
+	pthread_create(&consumer, NULL, test_consumer, NULL);
+	pthread_create(&producer, NULL, test_producer, NULL);
+	pthread_join(producer, NULL);
+	pthread_join(consumer, NULL);
+
+	qsort(latency, TEST_FRAMES, sizeof(uint64_t), test_compare);
+	fprintf(stderr, "latency: frames=%d, p50=%.1fus, p99=%.1fus, max=%.1fus\n", TEST_FRAMES, latency[TEST_FRAMES / 2] / 1000.0,
+			latency[TEST_FRAMES * 99 / 100] / 1000.0, latency[TEST_FRAMES - 1] / 1000.0);
+
+	//throughput UDP -> switch -> IPv4 -> switch -> UDP, in bursts
+	wall = test_now_ns(CLOCK_MONOTONIC);
+	pthread_create(&consumer, NULL, test_bulk_consumer, NULL);
+	pthread_create(&producer, NULL, test_bulk_producer, NULL);
+	pthread_join(producer, NULL);
+	pthread_join(consumer, NULL);
+	wall = test_now_ns(CLOCK_MONOTONIC) - wall;
+	fprintf(stderr, "throughput: frames=%d, %.2f Mframes/s through the switch\n", TEST_BULK_FRAMES, 2.0 * TEST_BULK_FRAMES * 1000.0 / wall);
+
+	//multicast: a frame addressed to IPv4 and UDP reaches both as the same frame
+	ff = test_frame();
+	ff->metaData = (metadata *) malloc(sizeof(metadata));
+	if (ff->metaData == NULL) {
+		PRINT_ERROR("metadata alloc fail");
+		exit(-1);
+	}
+	metadata_create(ff->metaData);
+	ff->destinationID.next = (struct destinationList *) malloc(sizeof(struct destinationList));
+	if (ff->destinationID.next == NULL) {
+		PRINT_ERROR("dest alloc fail");
+		exit(-1);
+	}
+	ff->destinationID.next->id = UDP_ID;
+	ff->destinationID.next->next = NULL;
+
+	write_ring(ff, ICMP_to_Switch_Queue);
+	post_event(&Switch_Event);
+
+	while (checkEmptyRing(Switch_to_IPv4_Queue) || checkEmptyRing(Switch_to_UDP_Queue)) {
+		usleep(100);
+	}
+	ff = read_ring(Switch_to_IPv4_Queue);
+	ff_tap = read_ring(Switch_to_UDP_Queue);
+	fprintf(stderr, "multicast: %s\n", ff == ff_tap ? "shared" : "copied");
+
+	ff = writableFinsFrame(ff); //still held by the tap, so this one is copied
+	fprintf(stderr, "multicast: writable %s\n", ff != ff_tap ? "copied" : "not copied");
+	freeFinsFrame(ff);
+	freeFinsFrame(ff_tap);
+
+	switch_shutdown();
+	return 0;
+}
@@ -7,24 +7,31 @@
 //#include <arpa/inet.h>
 #include "tcp.h"
 
+#include <libconfig.h>
+
 int tcp_running;
 pthread_t switch_to_tcp_thread;
 
-sem_t TCP_to_Switch_Qsem;
-finsQueue TCP_to_Switch_Queue;
+sem_t TCP_to_Switch_Qsem; //serializes the connection threads writing to the ring, the switch never takes it
+finsRing TCP_to_Switch_Queue;
+
+finsRing Switch_to_TCP_Queue;
+struct finsEvent Switch_to_TCP_Event;
 
-sem_t Switch_to_TCP_Qsem;
-finsQueue Switch_to_TCP_Queue;
+extern struct finsEvent Switch_Event;
 
-struct tcp_connection_stub *conn_stub_list; //The list of current connections we have
+struct tcp_connection_stub *conn_stub_table[TCP_CONN_STUB_HASH_SIZE]; //The listening stubs we have
 uint32_t conn_stub_num;
 
-struct tcp_connection *conn_list; //The list of current connections we have
-uint32_t conn_num;
+struct tcp_connection *conn_table[TCP_CONN_HASH_SIZE]; //The connections we have
+uint32_t conn_num; //atomic, inserts/removes only hold their bucket's sem
 
 uint32_t tcp_thread_id_num = 0;
 sem_t tcp_thread_id_sem;
 
+struct tcp_cong_ops *tcp_cong_default; //set from fins.cfg in tcp_init()
+uint8_t tcp_gso;
+
 void uint32_increase(uint32_t *data, uint32_t value) {
 	if (*data > value) {
 		//*data += value;
@@ -54,6 +61,8 @@ struct tcp_node *node_create(uint8_t *data, uint32_t len, uint32_t seq_num, uint
 	node->len = len;
 	node->seq_num = seq_num;
 	node->seq_end = seq_end;
+	node->sacked = 0;
+	node->retrans = 0;
 	node->next = NULL;
 
 	PRINT_DEBUG("Exited: data=%p, len=%d, seq_num=%u, seq_end=%u, node=%p", data, len, seq_num, seq_end, node);
@@ -439,6 +448,8 @@ struct tcp_connection_stub *conn_stub_create(uint32_t host_ip, uint16_t host_por
 
 	conn_stub->running_flag = 1;
 
+	conn_stub->cong_ops = tcp_cong_default;
+
 	PRINT_DEBUG("Exited: host=%u/%u, backlog=%u, conn_stub=%p", host_ip, host_port, backlog, conn_stub);
 	return conn_stub;
 }
@@ -539,22 +550,17 @@ void conn_stub_free(struct tcp_connection_stub *conn_stub) {
 	free(conn_stub);
 }
 
-int conn_stub_list_insert(struct tcp_connection_stub *conn_stub) { //TODO change from append to insertion to ordered LL, return -1 if already inserted
-	PRINT_DEBUG("Entered: conn_stub=%p", conn_stub);
+static uint32_t conn_stub_hash(uint16_t host_port) {
+	return host_port & (TCP_CONN_STUB_HASH_SIZE - 1);
+}
 
-	struct tcp_connection_stub *temp = NULL;
+int conn_stub_list_insert(struct tcp_connection_stub *conn_stub) {
+	PRINT_DEBUG("Entered: conn_stub=%p", conn_stub);
 
-	if (conn_stub_list == NULL) {
-		conn_stub_list = conn_stub;
-	} else {
-		temp = conn_stub_list;
-		while (temp->next != NULL) {
-			temp = temp->next;
-		}
+	struct tcp_connection_stub **bucket = &conn_stub_table[conn_stub_hash(conn_stub->host_port)];
 
-		temp->next = conn_stub;
-		conn_stub->next = NULL;
-	}
+	conn_stub->next = *bucket;
+	*bucket = conn_stub;
 
 	conn_stub_num++;
 	return 1;
@@ -563,8 +569,8 @@ int conn_stub_list_insert(struct tcp_connection_stub *conn_stub) { //TODO change
 struct tcp_connection_stub *conn_stub_list_find(uint32_t host_ip, uint16_t host_port) {
 	PRINT_DEBUG("Entered: host=%u/%u", host_ip, host_port);
 
-	struct tcp_connection_stub *temp = conn_stub_list;
-	while (temp != NULL) { //TODO change to return NULL once conn_list is ordered LL
+	struct tcp_connection_stub *temp = conn_stub_table[conn_stub_hash(host_port)];
+	while (temp != NULL) {
 		if (temp->host_ip == host_ip && temp->host_port == host_port) {
 			PRINT_DEBUG("Exited: host=%u/%u, conn_stub=%p", host_ip, host_port, temp);
 			return temp;
@@ -579,24 +585,15 @@ struct tcp_connection_stub *conn_stub_list_find(uint32_t host_ip, uint16_t host_
 void conn_stub_list_remove(struct tcp_connection_stub *conn_stub) {
 	PRINT_DEBUG("Entered: conn_stub=%p", conn_stub);
 
-	struct tcp_connection_stub *temp = conn_stub_list;
-	if (temp == NULL) {
-		return;
-	}
-
-	if (temp == conn_stub) {
-		conn_stub_list = conn_stub_list->next;
-		conn_stub_num--;
-		return;
-	}
-
-	while (temp->next != NULL) {
-		if (temp->next == conn_stub) {
-			temp->next = conn_stub->next;
+	struct tcp_connection_stub **temp = &conn_stub_table[conn_stub_hash(conn_stub->host_port)];
+	while (*temp != NULL) {
+		if (*temp == conn_stub) {
+			*temp = conn_stub->next;
+			conn_stub->next = NULL;
 			conn_stub_num--;
-			break;
+			return;
 		}
-		temp = temp->next;
+		temp = &(*temp)->next;
 	}
 }
 
@@ -605,45 +602,7 @@ int conn_stub_list_is_empty(void) {
 }
 
 int conn_stub_list_has_space(uint32_t len) {
-	return conn_stub_num + len <= TCP_CONN_MAX;
-}
-
-void *tcp_to_thread(void *local) {
-	struct tcp_to_thread_data *to_data = (struct tcp_to_thread_data *) local;
-	int id = to_data->id;
-	int fd = to_data->fd;
-	uint8_t *running = to_data->running;
-	uint8_t *flag = to_data->flag;
-	uint8_t *waiting = to_data->waiting;
-	sem_t *sem = to_data->sem;
-	free(to_data);
-
-	int ret;
-	uint64_t exp;
-
-	PRINT_DEBUG("Entered: id=%u, fd=%d", id, fd);
-	while (*running) {
-		/*#*/PRINT_DEBUG("");
-		ret = read(fd, &exp, sizeof(uint64_t)); //blocking read
-		if (!(*running)) {
-			break;
-		}
-		if (ret != sizeof(uint64_t)) {
-			//read error
-			PRINT_ERROR("Read error: id=%u, fd=%d", id, fd);
-			continue;
-		}
-
-		PRINT_DEBUG("throwing flag: id=%u, fd=%d", id, fd);
-		*flag = 1;
-		if (*waiting) {
-			PRINT_DEBUG("posting to wait_sem");
-			sem_post(sem);
-		}
-	}
-
-	PRINT_DEBUG("Exited: id=%u, fd=%d", id, fd);
-	pthread_exit(NULL);
+	return conn_stub_num + len <= TCP_CONN_STUB_MAX;
 }
 
 void handle_interrupt(struct tcp_connection *conn) {
@@ -674,8 +633,7 @@ void handle_interrupt(struct tcp_connection *conn) {
 
 				if (request->to_running) {
 					request->to_running = 0; //TODO encapsulate this to request_free()
-					tcp_start_timer(request->to_fd, TCP_TO_MIN); //smallest is 0.000001
-					pthread_join(request->to_thread, NULL);
+					tcp_timer_close(request->to_timer);
 				}
 				free(request->data);
 				free(request);
@@ -690,13 +648,11 @@ void handle_interrupt(struct tcp_connection *conn) {
 void handle_requests(struct tcp_connection *conn) {
 	PRINT_DEBUG("Entered: conn=%p", conn);
 
-	struct tcp_node *node;
 	struct tcp_node *temp_node;
 	struct tcp_request *request;
 	int avail;
-	uint8_t *buf;
 
-	int space = conn->write_queue->max - conn->write_queue->len;
+	int space = conn_send_space(conn);
 	while (space && !queue_is_empty(conn->request_queue)) {
 		temp_node = conn->request_queue->front;
 		request = (struct tcp_request *) temp_node->data;
@@ -704,33 +660,15 @@ void handle_requests(struct tcp_connection *conn) {
 		avail = request->len - conn->request_index;
 		PRINT_DEBUG("space=%d, index=%d, len=%u, avail=%d", space, conn->request_index, request->len, avail);
 		if (space < avail) {
-			buf = (uint8_t *) malloc(space);
-			if (buf == NULL) {
-				PRINT_ERROR("Error, unable to create node");
-				exit(-1);
-			}
-
-			memcpy(buf, request->data + conn->request_index, space);
+			conn_send_write(conn, request->data + conn->request_index, space);
 			conn->request_index += space;
 
-			node = node_create(buf, space, conn->request_index - space, conn->request_index - 1);
-			queue_append(conn->write_queue, node);
-
 			space = 0;
 			break;
 		} else {
-			buf = (uint8_t *) malloc(avail);
-			if (buf == NULL) {
-				PRINT_ERROR("Error, unable to create node");
-				exit(-1);
-			}
-
-			memcpy(buf, request->data + conn->request_index, avail);
+			conn_send_write(conn, request->data + conn->request_index, avail);
 			conn->request_index = 0;
 
-			node = node_create(buf, avail, request->len - avail, request->len - 1);
-			queue_append(conn->write_queue, node);
-
 			space -= avail;
 
 			queue_remove_front(conn->request_queue); // == to temp_node
@@ -739,8 +677,7 @@ void handle_requests(struct tcp_connection *conn) {
 
 			if (request->to_running) {
 				request->to_running = 0; //TODO encapsulate this to request_free()
-				tcp_start_timer(request->to_fd, TCP_TO_MIN); //smallest is 0.000001
-				pthread_join(request->to_thread, NULL);
+				tcp_timer_close(request->to_timer);
 			}
 			free(request->data);
 			free(request);
@@ -837,7 +774,7 @@ void main_syn_sent(struct tcp_connection *conn) {
 		if (conn->timeout > TCP_GBN_TO_MAX) {
 			conn->timeout = TCP_GBN_TO_MAX;
 		}
-		tcp_start_timer(conn->to_gbn_fd, conn->timeout);
+		tcp_start_timer(conn->to_gbn_timer->fd, conn->timeout);
 
 	} else {
 		conn->main_wait_flag = 1;
@@ -886,7 +823,7 @@ void main_syn_recv(struct tcp_connection *conn) {
 			if (conn->timeout > TCP_GBN_TO_MAX) {
 				conn->timeout = TCP_GBN_TO_MAX;
 			}
-			tcp_start_timer(conn->to_gbn_fd, conn->timeout);
+			tcp_start_timer(conn->to_gbn_timer->fd, conn->timeout);
 
 		} else {
 			conn_shutdown(conn);
@@ -912,6 +849,7 @@ void main_established(struct tcp_connection *conn) {
 	double recv_space;
 	double cong_space;
 	uint32_t data_len;
+	uint32_t max_len;
 	struct tcp_node *temp_node;
 
 	if (conn->request_interrupt) {
@@ -934,45 +872,27 @@ void main_established(struct tcp_connection *conn) {
 			conn->rtt_flag = 0;
 
 			//cong control
-			switch (conn->cong_state) {
-			case RENO_SLOWSTART:
-				conn->cong_state = RENO_AVOIDANCE;
-				conn->threshhold = conn->cong_window / 2.0;
-				if (conn->threshhold < (double) conn->MSS) {
-					conn->threshhold = (double) conn->MSS;
-				}
-				conn->cong_window = conn->threshhold + 3.0 * conn->MSS;
-				break;
-			case RENO_AVOIDANCE:
-			case RENO_RECOVERY:
-				conn->cong_state = RENO_SLOWSTART;
-				conn->threshhold = (double) conn->send_max_win; //TODO fix?
-				conn->cong_window = (double) conn->MSS;
-				break;
-			}
+			cong_rto(conn);
 
 			//resend first seg
 			conn->gbn_node = conn->send_queue->front;
+			conn_send_node(conn, conn->gbn_node, FLAG_ACK);
 
-			seg = (struct tcp_segment *) conn->gbn_node->data;
-			seg_update(seg, conn, FLAG_ACK);
-			seg_send(seg);
-
-			uint32_decrease(&conn->send_win, seg->data_len);
+			uint32_decrease(&conn->send_win, conn->gbn_node->len);
 			//conn->timeout *= 2; //TODO uncomment, should have?
-			tcp_start_timer(conn->to_gbn_fd, conn->timeout);
+			tcp_start_timer(conn->to_gbn_timer->fd, conn->timeout);
 			conn->main_wait_flag = 0;
 		}
+	} else if (conn->sack_enabled && conn->cong_state == RENO_RECOVERY && sack_retransmit(conn)) {
+		//resent the next lost seg, see sack_retransmit()
 	} else if (conn->fast_flag) {
 		conn->fast_flag = 0;
 		//fast retransmit
 
 		if (!queue_is_empty(conn->send_queue)) {
-			seg = (struct tcp_segment *) conn->send_queue->front->data;
-			seg_update(seg, conn, FLAG_ACK);
-			seg_send(seg);
+			conn_send_node(conn, conn->send_queue->front, FLAG_ACK);
 
-			uint32_decrease(&conn->send_win, seg->data_len);
+			uint32_decrease(&conn->send_win, conn->send_queue->front->len);
 		}
 	} else if (conn->gbn_flag) {
 		//normal GBN
@@ -991,13 +911,14 @@ void main_established(struct tcp_connection *conn) {
 				} else {
 					conn->gbn_node = conn->gbn_node->next;
 				}
+				while (conn->gbn_node && conn->gbn_node->sacked) { //rem already has it
+					conn->gbn_node = conn->gbn_node->next;
+				}
 
 				if (conn->gbn_node) {
-					seg = (struct tcp_segment *) conn->gbn_node->data;
-					seg_update(seg, conn, FLAG_ACK);
-					seg_send(seg);
+					conn_send_node(conn, conn->gbn_node, FLAG_ACK);
 
-					uint32_decrease(&conn->send_win, seg->data_len);
+					uint32_decrease(&conn->send_win, conn->gbn_node->len);
 				} else {
 					conn->gbn_flag = 0;
 				}
@@ -1011,23 +932,33 @@ void main_established(struct tcp_connection *conn) {
 		//normal
 		PRINT_DEBUG("Normal");
 
-		if (queue_is_empty(conn->request_queue) && queue_is_empty(conn->write_queue)) {
+		if (queue_is_empty(conn->request_queue) && conn->send_next == conn->send_end) {
 			conn->main_wait_flag = 1;
 			PRINT_DEBUG("Normal: flagging waitFlag");
 		} else {
-			write_space = conn->write_queue->len - conn->write_index;
+			write_space = conn->send_end - conn->send_next;
 			flight_size = conn->send_seq_end - conn->send_seq_num;
 			recv_space = (double) conn->send_win - (double) flight_size;
-			cong_space = conn->cong_window - (double) flight_size;
+			if (conn->sack_enabled && conn->cong_state == RENO_RECOVERY) {
+				cong_space = conn->cong_window - (double) sack_pipe(conn); //SACKed & lost segs have left the network
+			} else {
+				cong_space = conn->cong_window - (double) flight_size;
+			}
 
 			//if (conn->send_win && flight_size < (uint32_t) conn->send_max_win && cong_space >= (double) conn->MSS) {
 			//if (conn->send_win_ack + conn->send_win > conn->send_seq_end && flight_size < (uint32_t) conn->send_max_win && cong_space >= (double) conn->MSS) {
 			PRINT_DEBUG("write_space=%u, recv_space=%f, cong_space=%f", write_space, recv_space, cong_space);
-			if (write_space > 0 && recv_space > 1 && cong_space > 1) { //TODO make sure is right!
+			if (write_space > 0 && recv_space > 1 && cong_space > 1 && cong_pace(conn)) { //TODO make sure is right!
 				PRINT_DEBUG("sending packet");
 
-				if (write_space > (uint32_t) conn->MSS) {
-					data_len = (uint32_t) conn->MSS;
+				//new data goes in one super-seg, it's the retransmits that are MSS at a time
+				max_len = (uint32_t) conn->MSS;
+				if (tcp_gso) {
+					max_len = cong_burst(conn, TCP_GSO_MAX - TCP_GSO_MAX % (uint32_t) conn->MSS);
+				}
+
+				if (write_space > max_len) {
+					data_len = max_len;
 				} else {
 					data_len = write_space;
 				}
@@ -1037,23 +968,23 @@ void main_established(struct tcp_connection *conn) {
 				if ((double) data_len > cong_space) { //TODO unneeded if (cong_space >= MSS) kept, keep if change to (cong_space > 0)
 					data_len = (uint32_t) cong_space; //TODO check if converts fine
 				}
+				if (data_len > (uint32_t) conn->MSS && data_len < write_space) {
+					data_len -= data_len % (uint32_t) conn->MSS; //no runt seg in the middle of a super-seg
+				}
 
-				seg = seg_create(conn->host_ip, conn->host_port, conn->rem_ip, conn->rem_port, conn->send_seq_end, conn->send_seq_end);
-				conn->write_index = seg_add_data(seg, conn->write_queue, conn->write_index, data_len);
+				temp_node = conn_send_queue(conn, data_len);
 
 				conn->total += data_len;
 				PRINT_DEBUG("len=%u, total=%u", data_len, conn->total);
 
-				handle_requests(conn);
-
-				seg_update(seg, conn, FLAG_ACK);
-				seg_send(seg);
-
-				temp_node = node_create((uint8_t *) seg, data_len, seg->seq_num, seg->seq_num + data_len - 1);
-				queue_append(conn->send_queue, temp_node);
+				conn_send_run(conn, temp_node, data_len, FLAG_ACK);
 
+				conn->send_next += data_len;
 				conn->send_seq_end += (uint32_t) data_len;
+
+				handle_requests(conn);
 				uint32_decrease(&conn->send_win, data_len);
+				cong_sent(conn, data_len);
 
 				if (conn->rtt_flag == 0) {
 					gettimeofday(&conn->rtt_stamp, 0);
@@ -1064,13 +995,13 @@ void main_established(struct tcp_connection *conn) {
 
 				if (conn->first_flag) {
 					conn->first_flag = 0;
-					tcp_start_timer(conn->to_gbn_fd, conn->timeout);
+					tcp_start_timer(conn->to_gbn_timer->fd, conn->timeout);
 					conn->to_gbn_flag = 0;
 				}
 
 				if (conn->poll_events & (POLLOUT | POLLWRNORM | POLLWRBAND)) { //TODO remove?
 					if (queue_is_empty(conn->request_queue)) {
-						int space = conn->write_queue->max - conn->write_queue->len;
+						int space = conn_send_space(conn);
 						PRINT_DEBUG("conn=%p, space=%d", conn, space);
 						if (space > 0) {
 							conn_send_exec(conn, EXEC_TCP_POLL_POST, 1, POLLOUT | POLLWRNORM | POLLWRBAND);
@@ -1111,6 +1042,7 @@ void main_fin_wait_1(struct tcp_connection *conn) {
 	double recv_space;
 	double cong_space;
 	uint32_t data_len;
+	uint32_t max_len;
 	struct tcp_node *temp_node;
 
 	if (conn->request_interrupt) {
@@ -1146,44 +1078,27 @@ void main_fin_wait_1(struct tcp_connection *conn) {
 			conn->rtt_flag = 0;
 
 			//cong control
-			switch (conn->cong_state) {
-			case RENO_SLOWSTART:
-				conn->cong_state = RENO_AVOIDANCE;
-				conn->threshhold = conn->cong_window / 2.0;
-				if (conn->threshhold < (double) conn->MSS) {
-					conn->threshhold = (double) conn->MSS;
-				}
-				conn->cong_window = conn->threshhold + 3.0 * conn->MSS;
-				break;
-			case RENO_AVOIDANCE:
-			case RENO_RECOVERY:
-				conn->cong_state = RENO_SLOWSTART;
-				conn->threshhold = (double) conn->send_max_win; //TODO fix?
-				conn->cong_window = (double) conn->MSS;
-				break;
-			}
+			cong_rto(conn);
 
 			//resend first seg
 			conn->gbn_node = conn->send_queue->front;
-			seg = (struct tcp_segment *) conn->gbn_node->data;
-			seg_update(seg, conn, FLAG_ACK);
-			seg_send(seg);
+			conn_send_node(conn, conn->gbn_node, FLAG_ACK);
 
-			uint32_decrease(&conn->send_win, seg->data_len);
+			uint32_decrease(&conn->send_win, conn->gbn_node->len);
 			//conn->timeout *= 2; //TODO uncomment, should have?
-			tcp_start_timer(conn->to_gbn_fd, conn->timeout);
+			tcp_start_timer(conn->to_gbn_timer->fd, conn->timeout);
 			conn->main_wait_flag = 0;
 		}
+	} else if (conn->sack_enabled && conn->cong_state == RENO_RECOVERY && sack_retransmit(conn)) {
+		//resent the next lost seg, see sack_retransmit()
 	} else if (conn->fast_flag) {
 		conn->fast_flag = 0;
 		//fast retransmit
 
 		if (!queue_is_empty(conn->send_queue)) {
-			seg = (struct tcp_segment *) conn->send_queue->front->data;
-			seg_update(seg, conn, FLAG_ACK);
-			seg_send(seg);
+			conn_send_node(conn, conn->send_queue->front, FLAG_ACK);
 
-			uint32_decrease(&conn->send_win, seg->data_len);
+			uint32_decrease(&conn->send_win, conn->send_queue->front->len);
 		}
 	} else if (conn->gbn_flag) {
 		//normal GBN
@@ -1202,13 +1117,14 @@ void main_fin_wait_1(struct tcp_connection *conn) {
 				} else {
 					conn->gbn_node = conn->gbn_node->next;
 				}
+				while (conn->gbn_node && conn->gbn_node->sacked) { //rem already has it
+					conn->gbn_node = conn->gbn_node->next;
+				}
 
 				if (conn->gbn_node) {
-					seg = (struct tcp_segment *) conn->gbn_node->data;
-					seg_update(seg, conn, FLAG_ACK);
-					seg_send(seg);
+					conn_send_node(conn, conn->gbn_node, FLAG_ACK);
 
-					uint32_decrease(&conn->send_win, seg->data_len);
+					uint32_decrease(&conn->send_win, conn->gbn_node->len);
 				} else {
 					conn->gbn_flag = 0;
 				}
@@ -1222,7 +1138,7 @@ void main_fin_wait_1(struct tcp_connection *conn) {
 		//normal
 		PRINT_DEBUG("Normal");
 
-		if (queue_is_empty(conn->request_queue) && queue_is_empty(conn->write_queue)) {
+		if (queue_is_empty(conn->request_queue) && conn->send_next == conn->send_end) {
 			if (conn->fin_sent) {
 				conn->main_wait_flag = 1;
 				PRINT_DEBUG("Normal: flagging waitFlag");
@@ -1240,19 +1156,29 @@ void main_fin_wait_1(struct tcp_connection *conn) {
 				seg_free(seg);
 			}
 		} else {
-			write_space = conn->write_queue->len - conn->write_index;
+			write_space = conn->send_end - conn->send_next;
 			flight_size = conn->send_seq_end - conn->send_seq_num;
 			recv_space = (double) conn->send_win - (double) flight_size;
-			cong_space = conn->cong_window - (double) flight_size;
+			if (conn->sack_enabled && conn->cong_state == RENO_RECOVERY) {
+				cong_space = conn->cong_window - (double) sack_pipe(conn); //SACKed & lost segs have left the network
+			} else {
+				cong_space = conn->cong_window - (double) flight_size;
+			}
 
 			//if (conn->send_win && flight_size < (uint32_t) conn->send_max_win && cong_space >= (double) conn->MSS) {
 			//if (conn->send_win_ack + conn->send_win > conn->send_seq_end && flight_size < (uint32_t) conn->send_max_win && cong_space >= (double) conn->MSS) {
 			PRINT_DEBUG("write_space=%u, recv_space=%f, cong_space=%f", write_space, recv_space, cong_space);
-			if (write_space > 0 && recv_space > 1 && cong_space > 1) { //TODO make sure is right!
+			if (write_space > 0 && recv_space > 1 && cong_space > 1 && cong_pace(conn)) { //TODO make sure is right!
 				PRINT_DEBUG("sending packet");
 
-				if (write_space > (uint32_t) conn->MSS) {
-					data_len = (uint32_t) conn->MSS;
+				//new data goes in one super-seg, it's the retransmits that are MSS at a time
+				max_len = (uint32_t) conn->MSS;
+				if (tcp_gso) {
+					max_len = cong_burst(conn, TCP_GSO_MAX - TCP_GSO_MAX % (uint32_t) conn->MSS);
+				}
+
+				if (write_space > max_len) {
+					data_len = max_len;
 				} else {
 					data_len = write_space;
 				}
@@ -1262,33 +1188,33 @@ void main_fin_wait_1(struct tcp_connection *conn) {
 				if ((double) data_len > cong_space) { //TODO unneeded if (cong_space >= MSS) kept, keep if change to (cong_space > 0)
 					data_len = (uint32_t) cong_space; //TODO check if converts fine
 				}
+				if (data_len > (uint32_t) conn->MSS && data_len < write_space) {
+					data_len -= data_len % (uint32_t) conn->MSS; //no runt seg in the middle of a super-seg
+				}
 
-				seg = seg_create(conn->host_ip, conn->host_port, conn->rem_ip, conn->rem_port, conn->send_seq_end, conn->send_seq_end);
-				conn->write_index = seg_add_data(seg, conn->write_queue, conn->write_index, data_len);
+				temp_node = conn_send_queue(conn, data_len);
 
 				conn->total += data_len;
 				PRINT_DEBUG("len=%u, total=%u", data_len, conn->total);
 
+				conn->send_next += data_len;
 				handle_requests(conn);
 
-				if (queue_is_empty(conn->request_queue) && queue_is_empty(conn->write_queue)) {
+				if (queue_is_empty(conn->request_queue) && conn->send_next == conn->send_end) {
 					conn->fin_sent = 1;
 					conn->fin_sep = 0;
-					conn->fssn = seg->seq_num;
-					conn->fsse = seg->seq_end;
+					conn->fssn = temp_node->seq_num;
+					conn->fsse = temp_node->seq_num + data_len;
 					PRINT_DEBUG("setting: fin_sent=%u, fin_sep=%u, fssn=%u, fsse=%u", conn->fin_sent, conn->fin_sep, conn->fssn, conn->fsse);
 
-					seg_update(seg, conn, FLAG_ACK | FLAG_FIN);
+					conn_send_run(conn, temp_node, data_len, FLAG_ACK | FLAG_FIN);
 				} else {
-					seg_update(seg, conn, FLAG_ACK);
+					conn_send_run(conn, temp_node, data_len, FLAG_ACK);
 				}
-				seg_send(seg);
-
-				temp_node = node_create((uint8_t *) seg, data_len, seg->seq_num, seg->seq_num + data_len - 1);
-				queue_append(conn->send_queue, temp_node);
 
 				conn->send_seq_end += (uint32_t) data_len;
 				uint32_decrease(&conn->send_win, data_len);
+				cong_sent(conn, data_len);
 
 				if (conn->rtt_flag == 0) {
 					gettimeofday(&conn->rtt_stamp, 0);
@@ -1299,13 +1225,13 @@ void main_fin_wait_1(struct tcp_connection *conn) {
 
 				if (conn->first_flag) {
 					conn->first_flag = 0;
-					tcp_start_timer(conn->to_gbn_fd, conn->timeout);
+					tcp_start_timer(conn->to_gbn_timer->fd, conn->timeout);
 					conn->to_gbn_flag = 0;
 				}
 
 				if (conn->poll_events & (POLLOUT | POLLWRNORM | POLLWRBAND)) { //TODO remove?
 					if (queue_is_empty(conn->request_queue)) {
-						int space = conn->write_queue->max - conn->write_queue->len;
+						int space = conn_send_space(conn);
 						PRINT_DEBUG("conn=%p, space=%d", conn, space);
 						if (space > 0) {
 							conn_send_exec(conn, EXEC_TCP_POLL_POST, 1, POLLOUT | POLLWRNORM | POLLWRBAND);
@@ -1389,7 +1315,7 @@ void main_time_wait(struct tcp_connection *conn) {
 
 		if (conn->delayed_flag) {
 			//send remaining ACK
-			tcp_stop_timer(conn->to_delayed_fd);
+			tcp_stop_timer(conn->to_delayed_timer->fd);
 			conn->delayed_flag = 0;
 			conn->to_delayed_flag = 0;
 
@@ -1443,17 +1369,22 @@ void main_last_ack(struct tcp_connection *conn) {
 	PRINT_DEBUG("Exited: conn=%p", conn);
 }
 
-void *main_thread(void *local) {
-	struct tcp_connection *conn = (struct tcp_connection *) local;
+/**@brief runs the main_*() step of the conn's state until it has to wait, as its main thread once did.
+ * Called by the conn's worker with conn->sem held, which it releases, or frees the conn once it has stopped
+ * */
+void conn_main(struct tcp_connection *conn) {
+	int steps;
 
 	PRINT_DEBUG("Entered: conn=%p", conn);
 
-	/*#*/PRINT_DEBUG("sem_wait: conn=%p", conn);
-	if (sem_wait(&conn->sem)) {
-		PRINT_ERROR("conn->sem wait prob");
-		exit(-1);
-	}
-	while (conn->running_flag) {
+	conn->main_wait_flag = 0;
+	for (steps = 0; conn->running_flag; steps++) {
+		if (steps == TCP_WORKER_BUDGET) {
+			//let the worker's other conns have a turn, then carry on
+			conn_wake(conn);
+			break;
+		}
+
 		PRINT_DEBUG( "host: seqs=(%u, %u) (%u, %u), win=(%u/%u), rem: seqs=(%u, %u) (%u, %u), win=(%u/%u)",
 				conn->send_seq_num-conn->issn, conn->send_seq_end-conn->issn, conn->send_seq_num, conn->send_seq_end, conn->recv_win, conn->recv_max_win, conn->recv_seq_num-conn->irsn, conn->recv_seq_end-conn->irsn, conn->recv_seq_num, conn->recv_seq_end, conn->send_win, conn->send_max_win);
 
@@ -1497,50 +1428,21 @@ void *main_thread(void *local) {
 		}
 
 		if (conn->main_wait_flag && !conn->request_interrupt && !conn->to_gbn_flag && !conn->to_delayed_flag
-		/*&& !(!queue_is_empty(conn->request_queue) && queue_has_space(conn->write_queue, 1))*/) {
-			/*#*/PRINT_DEBUG("sem_post: conn=%p", conn);
-			sem_post(&conn->sem);
-
-			PRINT_DEBUG("");
-			if (sem_wait(&conn->main_wait_sem)) {
-				PRINT_ERROR("conn->main_wait_sem wait prob");
-				exit(-1);
-			}
-
-			/*#*/PRINT_DEBUG("sem_wait: conn=%p", conn);
-			if (sem_wait(&conn->sem)) {
-				PRINT_ERROR("conn->sem wait prob");
-				exit(-1);
-			}
-			conn->main_wait_flag = 0;
-			//sem_init(&conn->main_wait_sem, 0, 0);
-		} else {
-			/*#*/PRINT_DEBUG("sem_post: conn=%p", conn);
-			sem_post(&conn->sem);
-
-			/*#*/PRINT_DEBUG("sem_wait: conn=%p", conn);
-			if (sem_wait(&conn->sem)) {
-				PRINT_ERROR("conn->sem wait prob");
-				exit(-1);
-			}
+		/*&& !(!queue_is_empty(conn->request_queue) && conn_send_space(conn))*/) {
+			break;
 		}
 	}
 
-	/*#*/PRINT_DEBUG("");
-	if (sem_wait(&conn_list_sem)) {
-		PRINT_ERROR("conn_list_sem wait prob");
-		exit(-1);
+	if (conn->running_flag || !conn_stop(conn)) {
+		/*#*/PRINT_DEBUG("sem_post: conn=%p", conn);
+		sem_post(&conn->sem);
+		return;
 	}
-	conn_list_remove(conn);
-	/*#*/PRINT_DEBUG("");
-	sem_post(&conn_list_sem);
 
 	//close & free connection
-	conn_stop(conn);
 	conn_free(conn);
 
 	PRINT_DEBUG("Exited: conn=%p", conn);
-	pthread_exit(NULL);
 }
 
 void tcp_stop_timer(int fd) {
@@ -1585,6 +1487,7 @@ struct tcp_connection *conn_create(uint32_t host_ip, uint16_t host_port, uint32_
 	conn->total = 0;
 
 	conn->next = NULL;
+	conn->list_sem = conn_list_sem(host_ip, host_port, rem_ip, rem_port);
 	sem_init(&conn->sem, 0, 1);
 	conn->running_flag = 1;
 	conn->threads = 1;
@@ -1599,17 +1502,16 @@ struct tcp_connection *conn_create(uint32_t host_ip, uint16_t host_port, uint32_
 	conn->rem_port = rem_port;
 
 	conn->request_queue = queue_create(TCP_REQUEST_LIST_MAX);
-	conn->write_queue = queue_create(TCP_MAX_QUEUE_DEFAULT);
 	conn->send_queue = queue_create(TCP_MAX_QUEUE_DEFAULT);
 	conn->recv_queue = queue_create(TCP_MAX_QUEUE_DEFAULT);
 	//conn->read_queue = queue_create(TCP_MAX_QUEUE_DEFAULT); //commented, since buffer in Daemon
 
-	conn->main_wait_flag = 0;
-	sem_init(&conn->main_wait_sem, 0, 0);
+	conn->worker = tcp_worker_get(conn_hash(host_port, rem_ip, rem_port));
+	conn->wake_queued = 0;
+	conn->main_wait_flag = 1; //nothing to do until a call, segment or timer comes in
 
 	conn->request_interrupt = 0;
 	conn->request_index = 0;
-	conn->write_index = 0;
 	conn->poll_events = 0;
 
 	conn->first_flag = 1;
@@ -1619,20 +1521,12 @@ struct tcp_connection *conn_create(uint32_t host_ip, uint16_t host_port, uint32_
 	conn->to_gbn_flag = 0;
 	conn->gbn_flag = 0;
 	conn->gbn_node = NULL;
-	conn->to_gbn_fd = timerfd_create(CLOCK_REALTIME, 0);
-	if (conn->to_gbn_fd == -1) {
-		PRINT_ERROR("ERROR: unable to create to_fd.");
-		exit(-1);
-	}
+	conn->to_gbn_timer = tcp_timer_open(conn, &conn->to_gbn_flag, NULL);
 
 	conn->delayed_flag = 0;
 	conn->delayed_ack_flags = 0;
 	conn->to_delayed_flag = 0;
-	conn->to_delayed_fd = timerfd_create(CLOCK_REALTIME, 0);
-	if (conn->to_delayed_fd == -1) {
-		PRINT_ERROR("ERROR: unable to create delayed_fd.");
-		exit(-1);
-	}
+	conn->to_delayed_timer = tcp_timer_open(conn, &conn->to_delayed_flag, NULL);
 
 	conn->fin_sent = 0;
 	conn->fin_sep = 0;
@@ -1658,6 +1552,12 @@ struct tcp_connection *conn_create(uint32_t host_ip, uint16_t host_port, uint32_
 	conn->cong_state = RENO_SLOWSTART;
 	conn->cong_window = conn->MSS;
 	conn->threshhold = 0;
+	conn->cong_ops = tcp_cong_default;
+	memset(conn->cong_priv, 0, sizeof(conn->cong_priv));
+
+	conn->to_pace_flag = 0;
+	conn->to_pace_timer = tcp_timer_open(conn, &conn->to_pace_flag, NULL);
+	timerclear(&conn->pace_next);
 
 	conn->rtt_flag = 0;
 	conn->rtt_first = 1;
@@ -1665,6 +1565,7 @@ struct tcp_connection *conn_create(uint32_t host_ip, uint16_t host_port, uint32_
 	memset(&conn->rtt_stamp, 0, sizeof(struct timeval));
 	conn->rtt_est = 0;
 	conn->rtt_dev = 0;
+	conn->rtt_last = 0;
 	conn->timeout = TCP_GBN_TO_DEFAULT;
 
 	conn->active_open = 0;
@@ -1674,71 +1575,29 @@ struct tcp_connection *conn_create(uint32_t host_ip, uint16_t host_port, uint32_
 	conn->tsopt_enabled = 0;
 	conn->ts_rem = 0;
 
-	conn->sack_attempt = 0; //1;
+	conn->sack_attempt = 1;
 	conn->sack_enabled = 0;
 	conn->sack_len = 0;
+	conn->sack_recent = 0;
+	conn->sack_recover = 0;
 
 	conn->wsopt_attempt = 0; //1;
 	conn->wsopt_enabled = 0;
 	conn->ws_send = TCP_OPT_WS_DEFAULT;
 	conn->ws_recv = TCP_OPT_WS_DEFAULT;
 
-	//################################################################## alternate implementation, uses 1
 	conn->send_buf = NULL;
-	conn->send_len = 0;
+	conn->send_len = TCP_SEND_BUF_DEFAULT;
 	conn->send_start = 0;
 	conn->send_next = 0;
 	conn->send_end = 0;
-	conn->send_pkt = (struct tcp_packet *) malloc(sizeof(struct tcp_packet));
-	if (conn->send_pkt == NULL) {
-		PRINT_ERROR("problem");
-		exit(-1);
-	}
-	conn->send_pkt->ip_hdr.src_ip = conn->host_ip;
-	conn->send_pkt->ip_hdr.dst_ip = conn->rem_ip;
-	conn->send_pkt->ip_hdr.zeros = 0;
-	conn->send_pkt->ip_hdr.protocol = IPPROTO_TCP;
-	conn->send_pkt->tcp_hdr.src_port = conn->host_port;
-	conn->send_pkt->tcp_hdr.dst_port = conn->rem_port;
-	//##################################################################
-
-	//start timers
-	struct tcp_to_thread_data *gbn_data = (struct tcp_to_thread_data *) malloc(sizeof(struct tcp_to_thread_data));
-	gbn_data->id = tcp_gen_thread_id();
-	gbn_data->fd = conn->to_gbn_fd;
-	gbn_data->running = &conn->running_flag;
-	gbn_data->flag = &conn->to_gbn_flag;
-	gbn_data->waiting = &conn->main_wait_flag;
-	gbn_data->sem = &conn->main_wait_sem;
-	PRINT_DEBUG("to_gbn_fd: conn=%p, id=%u, to_gbn_fd=%d", conn, gbn_data->id, conn->to_gbn_fd);
-	if (pthread_create(&conn->to_gbn_thread, NULL, tcp_to_thread, (void *) gbn_data)) {
-		PRINT_ERROR("ERROR: unable to create recv_thread thread.");
-		exit(-1);
-	}
-
-	struct tcp_to_thread_data *delayed_data = (struct tcp_to_thread_data *) malloc(sizeof(struct tcp_to_thread_data));
-	delayed_data->id = tcp_gen_thread_id();
-	delayed_data->fd = conn->to_delayed_fd;
-	delayed_data->running = &conn->running_flag;
-	delayed_data->flag = &conn->to_delayed_flag;
-	delayed_data->waiting = &conn->main_wait_flag;
-	delayed_data->sem = &conn->main_wait_sem;
-	PRINT_DEBUG("to_delayed_fd: conn=%p, id=%u, to_gbn_fd=%d", conn, delayed_data->id, conn->to_delayed_fd);
-	if (pthread_create(&conn->to_delayed_thread, NULL, tcp_to_thread, (void *) delayed_data)) {
-		PRINT_ERROR("ERROR: unable to create recv_thread thread.");
-		exit(-1);
-	}
+	conn->send_seg = seg_create(conn->host_ip, conn->host_port, conn->rem_ip, conn->rem_port, 0, 0);
+	conn->send_seg->ring_len = conn->send_len;
 
 	//TODO add keepalive timer - implement through gbn timer
 	//TODO add silly window timer
 	//TODO add nagel timer
 
-	//start main thread
-	if (pthread_create(&conn->main_thread, NULL, main_thread, (void *) conn)) {
-		PRINT_ERROR("ERROR: unable to create main_thread thread.");
-		exit(-1);
-	}
-
 	PRINT_DEBUG("Exited: host=%u/%u, rem=%u/%u, conn=%p", host_ip, host_port, rem_ip, rem_port, conn);
 	return conn;
 }
@@ -1890,147 +1749,247 @@ int conn_reply_fcf(struct tcp_connection *conn, uint32_t ret_val, uint32_t ret_m
 }
 
 int conn_is_finished(struct tcp_connection *conn) {
-	return queue_is_empty(conn->request_queue) && queue_is_empty(conn->write_queue) && conn->send_seq_num == conn->send_seq_end;
+	return queue_is_empty(conn->request_queue) && conn->send_next == conn->send_end && conn->send_seq_num == conn->send_seq_end;
+}
+
+uint32_t conn_send_space(struct tcp_connection *conn) {
+	return conn->send_len - (conn->send_end - conn->send_start);
+}
+
+void conn_send_write(struct tcp_connection *conn, uint8_t *data, uint32_t len) {
+	PRINT_DEBUG("Entered: conn=%p, data=%p, len=%u", conn, data, len);
+
+	uint32_t pos;
+	uint32_t first;
+
+	if (conn->send_buf == NULL) {
+		conn->send_buf = (uint8_t *) malloc(conn->send_len);
+		if (conn->send_buf == NULL) {
+			PRINT_ERROR("Unable to create send_buf: conn=%p, len=%u", conn, conn->send_len);
+			exit(-1);
+		}
+		conn->send_seg->ring = conn->send_buf;
+	}
+
+	pos = conn->send_end & (conn->send_len - 1);
+	first = conn->send_len - pos;
+	if (len <= first) {
+		memcpy(conn->send_buf + pos, data, len);
+	} else {
+		memcpy(conn->send_buf + pos, data, first);
+		memcpy(conn->send_buf, data + first, len - first);
+	}
+	conn->send_end += len;
+}
+
+void conn_send_node(struct tcp_connection *conn, struct tcp_node *node, uint16_t flags) {
+	conn_send_run(conn, node, node->len, flags);
+}
+
+void conn_send_run(struct tcp_connection *conn, struct tcp_node *node, uint32_t len, uint16_t flags) {
+	struct tcp_segment *seg = conn->send_seg;
+
+	//the nodes are back to back in send_buf, so one view covers them
+	seg->seq_num = node->seq_num;
+	seg->seq_end = node->seq_num + len;
+	seg->data_len = len;
+	seg->ring_pos = node->pos;
+	seg->gso_size = len > node->len ? node->len : 0;
+
+	seg_update(seg, conn, flags);
+	seg_send(seg);
+}
+
+struct tcp_node *conn_send_queue(struct tcp_connection *conn, uint32_t len) {
+	struct tcp_node *first = NULL;
+	struct tcp_node *node;
+	uint32_t seq_num = conn->send_seq_end;
+	uint32_t pos = conn->send_next;
+	uint32_t node_len;
+
+	//one node per MSS, so SACK & resends still go seg by seg
+	while (len > 0) {
+		node_len = len > (uint32_t) conn->MSS ? (uint32_t) conn->MSS : len;
+
+		node = node_create(NULL, node_len, seq_num, seq_num + node_len - 1);
+		node->pos = pos;
+		queue_append(conn->send_queue, node);
+		if (first == NULL) {
+			first = node;
+		}
+
+		seq_num += node_len;
+		pos += node_len;
+		len -= node_len;
+	}
+
+	return first;
 }
 
 void conn_shutdown(struct tcp_connection *conn) {
 	PRINT_DEBUG("Entered: conn=%p", conn);
 
 	conn->running_flag = 0;
-	sem_post(&conn->main_wait_sem);
+	conn_wake(conn);
 }
 
-void conn_stop(struct tcp_connection *conn) {
+/**@brief takes a conn that is no longer running out of conn_table & stops its timers, must hold conn->sem
+ * @return 1 if the conn can be freed, 0 if exec threads or queued work still hold it. Its worker runs it
+ * again once they let go
+ * */
+int conn_stop(struct tcp_connection *conn) {
 	PRINT_DEBUG("Entered: conn=%p", conn);
 
+	int busy;
+
 	conn->running_flag = 0;
 
-	//stop threads
-	tcp_start_timer(conn->to_gbn_fd, TCP_TO_MIN);
-	tcp_start_timer(conn->to_delayed_fd, TCP_TO_MIN);
-	//TODO stop keepalive timer
-	//TODO stop silly window timer
-	//TODO stop nagel timer
-	//sem_post(&conn->main_wait_sem);
-	//sem_post(&conn->write_wait_sem);
-	//sem_post(&conn->write_sem);
-	//clear all threads using this conn_stub
+	/*#*/PRINT_DEBUG("");
+	if (sem_wait(conn->list_sem)) {
+		PRINT_ERROR("conn_list_sem wait prob");
+		exit(-1);
+	}
+	conn_list_remove(conn);
+	busy = conn->threads > 1;
+	/*#*/PRINT_DEBUG("conn=%p, threads=%d", conn, conn->threads);
+	sem_post(conn->list_sem);
 
-	while (1) {
-		/*#*/PRINT_DEBUG("");
-		if (sem_wait(&conn_list_sem)) {
-			PRINT_ERROR("conn_list_sem wait prob");
-			exit(-1);
-		}
-		if (conn->threads <= 1) {
-			/*#*/PRINT_DEBUG("");
-			sem_post(&conn_list_sem);
-			break;
-		} else {
-			/*#*/PRINT_DEBUG("conn=%p, threads=%d", conn, conn->threads);
-			sem_post(&conn_list_sem);
-		}
+	if (busy) {
+		//queued segments run the conn when done, exec threads don't so look again shortly
+		tcp_start_timer(conn->to_gbn_timer->fd, TCP_STOP_RETRY);
+		return 0;
+	}
 
-		/*#*/PRINT_DEBUG("sem_post: conn=%p", conn);
-		sem_post(&conn->sem);
-		/*#*/PRINT_DEBUG("sem_wait: conn=%p", conn);
-		if (sem_wait(&conn->sem)) {
-			PRINT_ERROR("conn->sem wait prob");
-			exit(-1);
-		}
+	if (sem_wait(&conn->worker->sem)) {
+		PRINT_ERROR("worker->sem wait prob");
+		exit(-1);
+	}
+	busy = conn->wake_queued;
+	sem_post(&conn->worker->sem);
+	if (busy) {
+		return 0;
 	}
 
-	/*#*/PRINT_DEBUG("");
-	//post to read/write/connect/etc threads
-	pthread_join(conn->to_gbn_thread, NULL);
-	pthread_join(conn->to_delayed_thread, NULL);
-	/*#*/PRINT_DEBUG("");
-	pthread_join(conn->main_thread, NULL);
+	struct tcp_node *node;
+	struct tcp_request *request;
+	for (node = conn->request_queue->front; node; node = node->next) {
+		request = (struct tcp_request *) node->data;
+		if (request->to_running) {
+			request->to_running = 0;
+			tcp_timer_close(request->to_timer);
+		}
+	}
+	tcp_timer_close(conn->to_gbn_timer);
+	tcp_timer_close(conn->to_delayed_timer);
+	tcp_timer_close(conn->to_pace_timer);
+	//TODO stop keepalive timer
+	//TODO stop silly window timer
+	//TODO stop nagel timer
+	return 1;
 }
 
 void conn_free(struct tcp_connection *conn) {
 	PRINT_DEBUG("conn=%p", conn);
 
-	if (conn->write_queue)
-		queue_free(conn->write_queue);
 	if (conn->send_queue)
 		queue_free(conn->send_queue);
 	if (conn->recv_queue)
 		queue_free(conn->recv_queue);
+	if (conn->send_buf)
+		free(conn->send_buf);
+	if (conn->send_seg)
+		seg_free(conn->send_seg);
 	//if (conn->read_queue)
 	//	queue_free(conn->read_queue);
-	free(conn);
+	tcp_worker_free(conn); //events of this round may still point at it
 }
 
-int conn_list_insert(struct tcp_connection *conn) { //TODO change from append to insertion to ordered LL, return -1 if already inserted
-	PRINT_DEBUG("Entered: conn=%p", conn);
+/** gives the conn_table bucket of a 4-tuple, which also picks its lock and its worker. host_ip is left out:
+ * it is this machine's one address (or loopback for local conns, see conn_list_find()), so it would not
+ * spread conns anyway */
+uint32_t conn_hash(uint16_t host_port, uint32_t rem_ip, uint16_t rem_port) {
+	uint32_t hash = rem_ip * 0x9e3779b1; //spread rem_ip first, xor alone lets its low bits cancel the ports
 
-	struct tcp_connection *temp = NULL;
+	hash ^= (uint32_t) host_port << 16 | rem_port;
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6b;
+	hash ^= hash >> 13;
+	hash *= 0xc2b2ae35;
+	hash ^= hash >> 16;
+	return hash & (TCP_CONN_HASH_SIZE - 1);
+}
 
-	if (conn_list == NULL) {
-		conn_list = conn;
-	} else {
-		temp = conn_list;
-		while (temp->next != NULL) {
-			temp = temp->next;
-		}
+/**@brief gives the sem guarding the conn_table bucket of a 4-tuple, hold it around conn_list_find(),
+ * conn_list_insert(), conn_list_remove() and changes to the threads of conns in that bucket
+ * */
+sem_t *conn_list_sem(uint32_t host_ip, uint16_t host_port, uint32_t rem_ip, uint16_t rem_port) {
+	return &conn_list_sems[conn_hash(host_port, rem_ip, rem_port) & (TCP_CONN_LOCKS - 1)];
+}
 
-		temp->next = conn;
-		conn->next = NULL;
+//must hold conn->list_sem, fails if TCP_CONN_MAX conns are already in
+int conn_list_insert(struct tcp_connection *conn) {
+	PRINT_DEBUG("Entered: conn=%p", conn);
+
+	struct tcp_connection **bucket = &conn_table[conn_hash(conn->host_port, conn->rem_ip, conn->rem_port)];
+
+	if (__atomic_add_fetch(&conn_num, 1, __ATOMIC_RELAXED) > TCP_CONN_MAX) {
+		__atomic_sub_fetch(&conn_num, 1, __ATOMIC_RELAXED);
+		return 0;
 	}
 
-	conn_num++;
+	conn->next = *bucket;
+	*bucket = conn;
 	return 1;
 }
 
 //find a TCP connection with given host addr/port and remote addr/port
 //NOTE: this means for incoming IP FF call with (dst_ip, src_ip, dst_p, src_p)
+//a conn whose host_ip differs is only returned if no exact match exists, as conns to loopback are
+//made from my_host_ip_addr but answered to 127.0.0.1
 struct tcp_connection *conn_list_find(uint32_t host_ip, uint16_t host_port, uint32_t rem_ip, uint16_t rem_port) {
 	PRINT_DEBUG("Entered: host=%u/%u, rem=%u/%u", host_ip, host_port, rem_ip, rem_port);
 
-	struct tcp_connection *temp = conn_list;
-	while (temp != NULL) { //TODO change to return NULL once conn_list is ordered LL
-		if (temp->rem_port == rem_port && /*temp->rem_ip == rem_ip && temp->host_ip == host_ip &&*/temp->host_port == host_port) {
-			PRINT_DEBUG("Exited: host=%u/%u, rem=%u/%u, conn=%p", host_ip, host_port, rem_ip, rem_port, temp);
-			return temp;
+	struct tcp_connection *temp = conn_table[conn_hash(host_port, rem_ip, rem_port)];
+	struct tcp_connection *other_host = NULL;
+	while (temp != NULL) {
+		if (temp->rem_port == rem_port && temp->rem_ip == rem_ip && temp->host_port == host_port) {
+			if (temp->host_ip == host_ip) {
+				PRINT_DEBUG("Exited: host=%u/%u, rem=%u/%u, conn=%p", host_ip, host_port, rem_ip, rem_port, temp);
+				return temp;
+			}
+			if (other_host == NULL) {
+				other_host = temp;
+			}
 		}
 		temp = temp->next;
 	}
 
-	PRINT_DEBUG("Exited: host=%u/%u, rem=%u/%u, conn=%p", host_ip, host_port, rem_ip, rem_port, NULL);
-	return NULL;
+	PRINT_DEBUG("Exited: host=%u/%u, rem=%u/%u, conn=%p", host_ip, host_port, rem_ip, rem_port, other_host);
+	return other_host;
 }
 
+//must hold conn->list_sem
 void conn_list_remove(struct tcp_connection *conn) {
 	PRINT_DEBUG("Entered: conn=%p", conn);
 
-	struct tcp_connection *temp = conn_list;
-	if (temp == NULL) {
-		return;
-	}
-
-	if (temp == conn) {
-		conn_list = conn_list->next;
-		conn_num--;
-		return;
-	}
-
-	while (temp->next != NULL) {
-		if (temp->next == conn) {
-			temp->next = conn->next;
-			conn_num--;
-			break;
+	struct tcp_connection **temp = &conn_table[conn_hash(conn->host_port, conn->rem_ip, conn->rem_port)];
+	while (*temp != NULL) {
+		if (*temp == conn) {
+			*temp = conn->next;
+			conn->next = NULL;
+			__atomic_sub_fetch(&conn_num, 1, __ATOMIC_RELAXED);
+			return;
 		}
-		temp = temp->next;
+		temp = &(*temp)->next;
 	}
 }
 
 int conn_list_is_empty(void) {
-	return conn_num == 0;
+	return __atomic_load_n(&conn_num, __ATOMIC_RELAXED) == 0;
 }
 
 int conn_list_has_space(void) {
-	return conn_num < TCP_CONN_MAX;
+	return __atomic_load_n(&conn_num, __ATOMIC_RELAXED) < TCP_CONN_MAX;
 }
 
 //Seed the above random number generator
@@ -2054,6 +2013,29 @@ uint32_t tcp_gen_thread_id(void) {
 	return num;
 }
 
+/** copies the data a seg views in its ring to dst, summing it on the way. When the view wraps after an odd
+ * number of bytes the rest starts at an odd offset, so it is summed on its own & byte swapped (RFC 1071) */
+static uint32_t seg_ring_copy(struct tcp_segment *seg, uint8_t *dst, uint32_t sum) {
+	uint32_t pos = seg->ring_pos & (seg->ring_len - 1);
+	uint32_t first = seg->ring_len - pos;
+	uint32_t rest;
+
+	if ((uint32_t) seg->data_len <= first) {
+		return fins_csum_copy(dst, seg->ring + pos, seg->data_len, sum);
+	}
+
+	sum = fins_csum_copy(dst, seg->ring + pos, first, sum);
+	if (first & 1) {
+		rest = fins_csum_copy(dst + first, seg->ring, seg->data_len - first, 0);
+		rest = (rest & 0xffff) + (rest >> 16);
+		rest = (rest & 0xffff) + (rest >> 16);
+		rest = ((rest & 0xff) << 8) | (rest >> 8);
+		sum += rest;
+		return sum + (sum < rest);
+	}
+	return fins_csum_copy(dst + first, seg->ring, seg->data_len - first, sum);
+}
+
 struct finsFrame *tcp_to_fdf(struct tcp_segment *seg) {
 	PRINT_DEBUG("Entered: seg=%p", seg);
 
@@ -2076,6 +2058,9 @@ struct finsFrame *tcp_to_fdf(struct tcp_segment *seg) {
 	metadata_writeToElement(params, "send_src_port", &src_port, META_TYPE_INT32); //Write the source port in
 	uint32_t dst_port = seg->dst_port;
 	metadata_writeToElement(params, "send_dst_port", &dst_port, META_TYPE_INT32); //And the destination port
+	if (seg->gso_size && (uint32_t) seg->data_len > seg->gso_size) {
+		metadata_writeToElement(params, "send_gso_size", &seg->gso_size, META_TYPE_INT32); //IPv4 leaves it whole, the interface cuts it up
+	}
 
 	struct finsFrame *ff = (struct finsFrame*) malloc(sizeof(struct finsFrame));
 	if (ff == NULL) {
@@ -2111,51 +2096,22 @@ struct finsFrame *tcp_to_fdf(struct tcp_segment *seg) {
 	hdr->checksum = 0;
 	hdr->urg_pointer = htons(seg->urg_pointer);
 
+	//options and data are summed as they are copied in, opt_len is always a multiple of 4
+	uint32_t sum = fins_csum_pseudo(htonl(seg->src_ip), htonl(seg->dst_ip), IPPROTO_TCP, (uint16_t) ff->dataFrame.pduLength, 0);
+	sum = fins_csum_partial(hdr, MIN_TCP_HEADER_BYTES, sum);
 	if (seg->opt_len > 0) {
-		memcpy(hdr->options, seg->options, seg->opt_len);
-
-		if (seg->data_len > 0) {
-			memcpy(hdr->options + seg->opt_len, seg->data, seg->data_len);
-		}
-	} else if (seg->data_len > 0) {
-		memcpy(hdr->options, seg->data, seg->data_len);
-	}
-
-	uint32_t sum = 0;
-	uint8_t *pt;
-	uint32_t i;
-
-	struct ipv4_header ip_hdr;
-	ip_hdr.src_ip = htonl(seg->src_ip);
-	ip_hdr.dst_ip = htonl(seg->dst_ip);
-	ip_hdr.zeros = 0;
-	ip_hdr.protocol = IPPROTO_TCP;
-	ip_hdr.tcp_len = htons((uint16_t) ff->dataFrame.pduLength);
-
-	pt = (uint8_t *) &ip_hdr;
-	for (i = 0; i < IP_HEADER_BYTES; i += 2, pt += 2) {
-		//PRINT_DEBUG("%u=%2x (%u), %u=%2x (%u)", i, *(pt+1), *(pt+1), i+1, *(pt+2), *(pt+2));
-		sum += (*pt << 8) + *(pt + 1);
-	}
-
-	pt = (uint8_t *) ff->dataFrame.pdu;
-	for (i = 1; i < ff->dataFrame.pduLength; i += 2, pt += 2) {
-		//PRINT_DEBUG("%u=%2x (%u), %u=%2x (%u)", i, *(pt+1), *(pt+1), i+1, *(pt+2), *(pt+2));
-		sum += (*pt << 8) + *(pt + 1);
+		sum = fins_csum_copy(hdr->options, seg->options, seg->opt_len, sum);
 	}
-	if (ff->dataFrame.pduLength & 0x1) {
-		//PRINT_DEBUG("%u=%2x (%u), uneven", ff->dataFrame.pduLength-1, *(pt+1), *(pt+1));
-		sum += *pt << 8;
-	}
-
-	while ((sum >> 16)) {
-		sum = (sum & 0xFFFF) + (sum >> 16);
+	if (seg->data_len > 0) {
+		if (seg->ring) {
+			sum = seg_ring_copy(seg, hdr->options + seg->opt_len, sum);
+		} else {
+			sum = fins_csum_copy(hdr->options + seg->opt_len, seg->data, seg->data_len, sum);
+		}
 	}
-	sum = ~sum;
+	hdr->checksum = fins_csum_fold(sum);
 
-	PRINT_DEBUG("checksum=0x%x", (uint16_t) sum);
-
-	hdr->checksum = htons((uint16_t) sum);
+	PRINT_DEBUG("checksum=0x%x", ntohs(hdr->checksum));
 
 	PRINT_DEBUG("Exited: seg=%p, ff=%p, meta=%p", seg, ff, ff->metaData);
 	return ff;
@@ -2217,6 +2173,8 @@ struct tcp_segment *fdf_to_tcp(struct finsFrame *ff) {
 	}
 
 	//And fill in the data length and the data, also
+	seg->ring = NULL;
+	seg->gso_size = 0;
 	seg->data_len = ff->dataFrame.pduLength - TCP_HEADER_BYTES(seg->flags);
 	if (seg->data_len > 0) {
 		seg->data = (uint8_t *) malloc(seg->data_len);
@@ -2269,63 +2227,22 @@ struct tcp_segment *seg_create(uint32_t src_ip, uint16_t src_port, uint32_t dst_
 
 	seg->data_len = 0;
 	seg->data = NULL;
+	seg->ring = NULL;
+	seg->ring_len = 0;
+	seg->ring_pos = 0;
+	seg->gso_size = 0;
 
 	PRINT_DEBUG("Exited: src=%u/%u, dst=%u/%u, seq_num=%u, seq_end=%u, seg=%p", src_ip, src_port, dst_ip, dst_port, seq_num, seq_end, seg);
 	return seg;
 }
 
-uint32_t seg_add_data(struct tcp_segment *seg, struct tcp_queue *queue, uint32_t index, int data_len) {
-	PRINT_DEBUG("Entered: seg=%p, queue=%p, index=%u, data_len=%d", seg, queue, index, data_len);
-
-	if (data_len > queue->len) {
-		PRINT_ERROR("len=%u, data_len=%u", queue->len, data_len);
-	}
-
-	uint32_t avail;
-	struct tcp_node *temp_node;
-
-	seg->data_len = data_len;
-	seg->seq_end = seg->seq_num + seg->data_len;
-	seg->data = (uint8_t *) malloc(data_len);
-	if (seg->data == NULL) {
-		PRINT_ERROR("todo error");
-		exit(-1);
-	}
-	uint8_t *ptr = seg->data;
-
-	while (data_len && !queue_is_empty(queue)) {
-		avail = queue->front->len - index;
-		PRINT_DEBUG("data_len=%d, index=%u, len=%u, avail=%u", data_len, index, queue->front->len, avail);
-		if (data_len < avail) {
-			memcpy(ptr, queue->front->data + index, data_len);
-			ptr += data_len;
-			index += data_len;
-			data_len = 0;
-			break;
-		} else {
-			memcpy(ptr, queue->front->data + index, avail);
-			ptr += avail;
-			index = 0;
-			data_len -= avail;
-
-			temp_node = queue_remove_front(queue);
-			node_free(temp_node);
-		}
-	}
-
-	PRINT_DEBUG("Exited: seg=%p, queue=%p, index=%u, data_len=%d", seg, queue, index, data_len);
-	return index;
-}
-
 void seg_add_options(struct tcp_segment *seg, struct tcp_connection *conn) {
 	PRINT_DEBUG("Entered: conn=%p, seg=%p", conn, seg);
 
-	//uint32_t i;
-	//uint32_t len;
+	int i;
 	uint8_t *pt;
-	struct tcp_node *node;
-	uint32_t left;
-	uint32_t right;
+	uint32_t sack[2 * TCP_SACK_BLOCKS_MAX];
+	int blocks;
 
 	//add options //TODO implement options system
 	switch (conn->state) {
@@ -2464,58 +2381,20 @@ void seg_add_options(struct tcp_segment *seg, struct tcp_connection *conn) {
 			pt += sizeof(uint32_t);
 		}
 
-		if (conn->sack_enabled) {
-			seg->opt_len += 2;
-			*pt++ = TCP_OPT_NOP; //NOP
-			*pt++ = TCP_OPT_NOP; //NOP
-
-			seg->opt_len += 2;
-			*pt++ = TCP_OPT_SACK;
-			uint8_t *len_pt = pt++;
-			*len_pt = 2;
-
-			node = conn->recv_queue->front;
-			while (node) {
-				left = node->seq_num;
-				right = node->seq_end;
-
-				while (node->next) {
-					if (left <= right) {
-						if (node->next->seq_num <= right) {
-							right = node->next->seq_end;
-						} else {
-							break;
-						}
-					} else {
-						if (node->next->seq_num <= right) {
-							right = node->next->seq_end;
-						} else if (left < node->next->seq_num) {
-							right = node->next->seq_end;
-						} else {
-							//save
-							break;
-						}
-					}
-
-					node = node->next;
-				}
-
-				//save left & right
-				*(uint32_t *) pt = htonl(left);
-				pt += sizeof(uint32_t);
-				*(uint32_t *) pt = htonl(right);
-				pt += sizeof(uint32_t);
+		if (conn->sack_enabled && !queue_is_empty(conn->recv_queue)) {
+			blocks = sack_blocks(conn, sack, conn->tsopt_enabled ? TCP_SACK_BLOCKS_TS : TCP_SACK_BLOCKS_MAX);
+			if (blocks) {
+				seg->opt_len += 2;
+				*pt++ = TCP_OPT_NOP; //NOP
+				*pt++ = TCP_OPT_NOP; //NOP
 
-				*len_pt += 2 * sizeof(uint32_t);
-				seg->opt_len += 2 * sizeof(uint32_t);
-				if (seg->opt_len > 32) {
-					break;
+				seg->opt_len += TCP_OPT_SACK_BYTES(blocks);
+				*pt++ = TCP_OPT_SACK;
+				*pt++ = TCP_OPT_SACK_BYTES(blocks);
+				for (i = 0; i < 2 * blocks; i++) {
+					*(uint32_t *) pt = htonl(sack[i]);
+					pt += sizeof(uint32_t);
 				}
-				node = node->next;
-			}
-
-			if (*len_pt == 2) {
-				seg->opt_len -= 4;
 			}
 		}
 
@@ -2614,72 +2493,23 @@ void seg_update(struct tcp_segment *seg, struct tcp_connection *conn, uint16_t f
 	//seg->checksum = seg_checksum(seg);
 }
 
-uint16_t seg_checksum(struct tcp_segment *seg) { //TODO check if checksum works, check rollover
-	int i;
-	//TODO add TCP alternate checksum w/data in options (15)
-
-	uint32_t sum = 0;
-
-	struct tcp_packet2 pkt;
-	pkt.src_ip = htonl(seg->src_ip);
-	pkt.dst_ip = htonl(seg->dst_ip);
-	pkt.zeros = 0;
-	pkt.protocol = IPPROTO_TCP;
-	pkt.tcp_len = htons(TCP_HEADER_BYTES(seg->flags) + seg->data_len);
-	pkt.src_port = htons(seg->src_port);
-	pkt.dst_port = htons(seg->dst_port);
-	pkt.seq_num = htonl(seg->seq_num);
-	pkt.ack_num = htonl(seg->ack_num);
-	pkt.flags = htons(seg->flags);
-	pkt.win_size = htons(seg->win_size);
-	pkt.checksum = htons(seg->checksum);
-	pkt.urg_pointer = htons(seg->urg_pointer);
-
-	uint8_t *pt = (uint8_t *) &pkt;
-	for (i = 0; i < IP_HEADER_BYTES + MIN_TCP_HEADER_BYTES; i += 2, pt += 2) {
-		sum += (*pt << 8) + *(pt + 1);
-	}
-
-	/*
-	 //fake IP header
-	 sum += ((uint16_t)(seg->src_ip >> 16)) + ((uint16_t)(seg->src_ip & 0xFFFF)); //TODO fix
-	 sum += ((uint16_t)(seg->dst_ip >> 16)) + ((uint16_t)(seg->dst_ip & 0xFFFF));
-	 sum += (uint16_t) TCP_PROTOCOL;
-	 sum += (uint16_t)(IP_HEADER_BYTES + TCP_HEADER_BYTES(seg->flags) + seg->data_len);
-
-	 //fake TCP header
-	 sum += seg->src_port;
-	 sum += seg->dst_port;
-	 sum += ((uint16_t)(seg->seq_num >> 16)) + ((uint16_t)(seg->seq_num & 0xFFFF));
-	 sum += ((uint16_t)(seg->ack_num >> 16)) + ((uint16_t)(seg->ack_num & 0xFFFF));
-	 sum += seg->flags;
-	 sum += seg->win_size;
-	 //sum += seg->checksum; //dummy checksum=0
-	 sum += seg->urg_pointer;
-	 */
+uint16_t seg_checksum(struct tcp_segment *seg) { //TODO add TCP alternate checksum w/data in options (15)
+	struct tcpv4_header hdr;
+	hdr.src_port = htons(seg->src_port);
+	hdr.dst_port = htons(seg->dst_port);
+	hdr.seq_num = htonl(seg->seq_num);
+	hdr.ack_num = htonl(seg->ack_num);
+	hdr.flags = htons(seg->flags);
+	hdr.win_size = htons(seg->win_size);
+	hdr.checksum = htons(seg->checksum);
+	hdr.urg_pointer = htons(seg->urg_pointer);
 
-	//options, opt_len always has to be a factor of 2
-	pt = (uint8_t *) seg->options;
-	for (i = 0; i < seg->opt_len; i += 2, pt += 2) {
-		sum += (*pt << 8) + *(pt + 1);
-	}
+	uint32_t sum = fins_csum_pseudo(htonl(seg->src_ip), htonl(seg->dst_ip), IPPROTO_TCP, TCP_HEADER_BYTES(seg->flags) + seg->data_len, 0);
+	sum = fins_csum_partial(&hdr, MIN_TCP_HEADER_BYTES, sum);
+	sum = fins_csum_partial(seg->options, seg->opt_len, sum); //opt_len always has to be a factor of 2
+	sum = fins_csum_partial(seg->data, seg->data_len, sum);
 
-	//data
-	pt = (uint8_t *) seg->data;
-	for (i = 1; i < seg->data_len; i += 2, pt += 2) {
-		sum += (*pt << 8) + *(pt + 1);
-	}
-
-	if (seg->data_len & 0x1) {
-		sum += *pt << 8;
-	}
-
-	while (sum >> 16) {
-		sum = (sum & 0xFFFF) + (sum >> 16);
-	}
-
-	sum = ~sum;
-	return htons((uint16_t) sum);
+	return fins_csum_fold(sum);
 }
 
 int seg_send(struct tcp_segment *seg) {
@@ -2749,7 +2579,7 @@ void seg_free(struct tcp_segment *seg) {
 
 void seg_delayed_ack(struct tcp_segment *seg, struct tcp_connection *conn) {
 	if (conn->delayed_flag) {
-		tcp_stop_timer(conn->to_delayed_fd);
+		tcp_stop_timer(conn->to_delayed_timer->fd);
 		conn->delayed_flag = 0;
 		conn->to_delayed_flag = 0;
 
@@ -2924,13 +2754,46 @@ void tcp_init(void) {
 	tcp_thread_id_num = 0;
 	sem_init(&tcp_thread_id_sem, 0, 1);
 
-	conn_stub_list = NULL;
+	memset(conn_stub_table, 0, sizeof(conn_stub_table));
 	conn_stub_num = 0;
 	sem_init(&conn_stub_list_sem, 0, 1);
 
-	conn_list = NULL;
+	memset(conn_table, 0, sizeof(conn_table));
 	conn_num = 0;
-	sem_init(&conn_list_sem, 0, 1);
+	int i;
+	for (i = 0; i < TCP_CONN_LOCKS; i++) {
+		sem_init(&conn_list_sems[i], 0, 1);
+	}
+
+	config_t cfg;
+	config_setting_t *setting;
+	const char *congestion;
+
+	tcp_cong_default = NULL;
+	tcp_gso = 1;
+	config_init(&cfg);
+	if (config_read_file(&cfg, TCP_CONFIG_FILE)) {
+		setting = config_lookup(&cfg, "tcp.congestion");
+		if (setting != NULL && (congestion = config_setting_get_string(setting)) != NULL) {
+			tcp_cong_default = cong_find((char *) congestion);
+			if (tcp_cong_default == NULL) {
+				PRINT_ERROR("unknown congestion control, using '%s': congestion='%s'", TCP_CONG_DEFAULT, congestion);
+			}
+		}
+		setting = config_lookup(&cfg, "tcp.gso");
+		if (setting != NULL) {
+			tcp_gso = config_setting_get_bool(setting);
+		}
+	} else {
+		PRINT_DEBUG("no tcp config, using defaults: file='%s', error='%s'", TCP_CONFIG_FILE, config_error_text(&cfg));
+	}
+	config_destroy(&cfg);
+	if (tcp_cong_default == NULL) {
+		tcp_cong_default = cong_find(TCP_CONG_DEFAULT);
+	}
+	PRINT_DEBUG("congestion='%s', gso=%u", tcp_cong_default->name, tcp_gso);
+
+	tcp_workers_init();
 
 	tcp_srand();
 }
@@ -2938,94 +2801,103 @@ void tcp_init(void) {
 void tcp_run(pthread_attr_t *fins_pthread_attr) {
 	PRINT_DEBUG("Entered");
 
+	tcp_workers_run(fins_pthread_attr);
 	pthread_create(&switch_to_tcp_thread, fins_pthread_attr, switch_to_tcp, fins_pthread_attr);
 }
 
 void tcp_get_ff(void) {
-
+	struct finsFrame *ffs[RING_BURST];
 	struct finsFrame *ff;
+	int n;
+	int i;
 
 	PRINT_DEBUG("");
-	do {
-		sem_wait(&Switch_to_TCP_Qsem);
-		ff = read_queue(Switch_to_TCP_Queue);
-		sem_post(&Switch_to_TCP_Qsem);
-	} while (tcp_running && ff == NULL);
-	PRINT_DEBUG("");
+	n = read_ring_wait(ffs, RING_BURST, Switch_to_TCP_Queue, &Switch_to_TCP_Event, &tcp_running);
+	PRINT_DEBUG("n=%d", n);
 
-	if (!tcp_running) {
-		return;
-	}
+	for (i = 0; i < n; i++) {
+		ff = writableFinsFrame(ffs[i]); //frames delivered to several modules are shared
 
-	if (ff->dataOrCtrl == CONTROL) {
-		tcp_fcf(ff);
-		PRINT_DEBUG("");
-	} else if (ff->dataOrCtrl == DATA) {
-		if (ff->dataFrame.directionFlag == UP) {
-			tcp_in_fdf(ff);
-			PRINT_DEBUG("");
-		} else { //directionFlag==DOWN
-			tcp_out_fdf(ff);
+		if (ff->dataOrCtrl == CONTROL) {
+			tcp_fcf(ff);
 			PRINT_DEBUG("");
+		} else if (ff->dataOrCtrl == DATA) {
+			if (ff->dataFrame.directionFlag == UP) {
+				tcp_in_fdf(ff);
+				PRINT_DEBUG("");
+			} else { //directionFlag==DOWN
+				tcp_out_fdf(ff);
+				PRINT_DEBUG("");
+			}
+		} else {
+			PRINT_ERROR("todo error");
 		}
-	} else {
-		PRINT_ERROR("todo error");
 	}
 }
 
 void tcp_shutdown(void) {
 	PRINT_DEBUG("Entered");
 	tcp_running = 0;
+	post_event(&Switch_to_TCP_Event);
 
 	//TODO expand this
 	//shutdown every conn/conn_stub
 
-	/*#*/PRINT_DEBUG("");
-	if (sem_wait(&conn_list_sem)) {
-		PRINT_ERROR("conn_list_sem wait prob");
-		exit(-1);
-	}
-	struct tcp_connection *conn = conn_list;
+	struct tcp_connection *conn;
 	struct tcp_connection *old_conn;
-	while (conn) { //change to conn_list_is_empty()
-		old_conn = conn;
-		conn = conn->next;
+	int i;
+	for (i = 0; i < TCP_CONN_HASH_SIZE; i++) {
+		/*#*/PRINT_DEBUG("");
+		if (sem_wait(&conn_list_sems[i & (TCP_CONN_LOCKS - 1)])) {
+			PRINT_ERROR("conn_list_sem wait prob");
+			exit(-1);
+		}
+		conn = conn_table[i];
+		while (conn) { //change to conn_list_is_empty()
+			old_conn = conn;
+			conn = conn->next;
 
-		//TODO add conn->sem's
-		//conn_shutdown(old_conn);
+			//TODO add conn->sem's
+			//conn_shutdown(old_conn);
+		}
+		sem_post(&conn_list_sems[i & (TCP_CONN_LOCKS - 1)]);
 	}
-	/*#*/PRINT_DEBUG("");
-	sem_post(&conn_list_sem);
 
 	/*#*/PRINT_DEBUG("");
 	if (sem_wait(&conn_stub_list_sem)) {
 		PRINT_ERROR("conn_stub_list_sem wait prob");
 		exit(-1);
 	}
-	struct tcp_connection_stub *conn_stub = conn_stub_list;
+	struct tcp_connection_stub *conn_stub;
 	struct tcp_connection_stub *old_conn_stub;
-	while (conn_stub) { //change to conn_list_is_empty()
-		old_conn_stub = conn_stub;
-		conn_stub = conn_stub->next;
-
-		//TODO add conn_stub->sem's
-		//conn_stub_shutdown(old_conn_stub);
-		//conn_stub_free(old_conn_stub);
+	for (i = 0; i < TCP_CONN_STUB_HASH_SIZE; i++) {
+		conn_stub = conn_stub_table[i];
+		while (conn_stub) { //change to conn_list_is_empty()
+			old_conn_stub = conn_stub;
+			conn_stub = conn_stub->next;
+
+			//TODO add conn_stub->sem's
+			//conn_stub_shutdown(old_conn_stub);
+			//conn_stub_free(old_conn_stub);
+		}
 	}
 	/*#*/PRINT_DEBUG("");
 	sem_post(&conn_stub_list_sem);
 
 	PRINT_DEBUG("Joining switch_to_tcp_thread");
 	pthread_join(switch_to_tcp_thread, NULL);
+
+	tcp_workers_shutdown();
 }
 
 void tcp_release(void) {
 	PRINT_DEBUG("Entered");
 
 	//TODO free all module related mem
+	tcp_workers_release();
 
-	term_queue(TCP_to_Switch_Queue);
-	term_queue(Switch_to_TCP_Queue);
+	term_ring(TCP_to_Switch_Queue);
+	term_ring(Switch_to_TCP_Queue);
 }
 
 void tcp_fcf(struct finsFrame *ff) {
@@ -3310,9 +3182,10 @@ int tcp_to_switch(struct finsFrame *ff) {
 		PRINT_ERROR("TCP_to_Switch_Qsem wait prob");
 		exit(-1);
 	}
-	if (write_queue(ff, TCP_to_Switch_Queue)) {
+	if (write_ring(ff, TCP_to_Switch_Queue)) {
 		/*#*/PRINT_DEBUG("");
 		sem_post(&TCP_to_Switch_Qsem);
+		post_event(&Switch_Event);
 		return 1;
 	}
 
@@ -21,11 +21,14 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/time.h>
 #include <sys/timerfd.h>
 #include <time.h>
 #include <unistd.h>
 
+#include <finschecksum.h>
 #include <finsdebug.h>
 #include <finstypes.h>
 //Macros for the TCP header
@@ -48,6 +51,7 @@
 
 //flags defined for this implementation
 #define FLAG_ACK_PLUS	0x1000
+#define FLAG_ACK_NOW	0x2000	//ACK right away instead of delaying it
 
 //header & option sizes in words
 #define MAX_TCP_OPTIONS_WORDS		(10)
@@ -74,6 +78,22 @@
 //#define MAX_TCP_HEADER_LEN		MAX_OPTIONS_LEN + MIN_TCP_HEADER_LEN	//Maximum TCP header size, as defined by the maximum options size
 //typedef unsigned long IP4addr; /*  internet address			*/
 
+struct tcp_connection;
+struct tcp_segment;
+
+/** a timerfd watched by the epoll of a conn's worker, when it goes off the worker sets flag (& interrupt)
+ * and runs the conn. Closed timers are freed by the worker at the end of its round */
+struct tcp_timer {
+	int fd;
+	struct tcp_connection *conn;
+	uint8_t *flag;
+	uint8_t *interrupt;
+	struct tcp_timer *next; //in the worker's dead list once closed
+};
+
+struct tcp_timer *tcp_timer_open(struct tcp_connection *conn, uint8_t *flag, uint8_t *interrupt);
+void tcp_timer_close(struct tcp_timer *timer);
+
 void uint32_increase(uint32_t *data, uint32_t value);
 void uint32_decrease(uint32_t *data, uint32_t value);
 
@@ -84,8 +104,7 @@ struct tcp_request {
 	uint32_t serial_num;
 	//TO?
 
-	pthread_t to_thread; //TODO encapsulate into TO obj
-	int to_fd;
+	struct tcp_timer *to_timer;
 	uint8_t to_running;
 	uint8_t to_flag;
 };
@@ -97,6 +116,9 @@ struct tcp_node {
 	uint32_t len;
 	uint32_t seq_num;
 	uint32_t seq_end;
+	uint8_t sacked; //send_queue: rem has it, from its SACK blocks
+	uint8_t retrans; //send_queue: resent during this SACK recovery
+	uint32_t pos; //send_queue: where its data starts in send_buf
 };
 
 struct tcp_node *node_create(uint8_t *data, uint32_t len, uint32_t seq_num, uint32_t seq_end);
@@ -128,7 +150,7 @@ void queue_free(struct tcp_queue *queue);
 
 struct tcp_connection_stub {
 	//## protected by conn_stub_list_sem
-	struct tcp_connection_stub *next;
+	struct tcp_connection_stub *next; //next in its conn_stub_table bucket
 	uint32_t threads;
 	//##
 
@@ -147,6 +169,8 @@ struct tcp_connection_stub {
 
 	uint8_t running_flag;
 //uint32_t backlog; //TODO ?
+
+	struct tcp_cong_ops *cong_ops; //passed on to the conns it accepts
 };
 
 struct tcp_connection_stub *conn_stub_create(uint32_t host_ip, uint16_t host_port, uint32_t backlog);
@@ -156,6 +180,8 @@ void conn_stub_shutdown(struct tcp_connection_stub *conn_stub);
 void conn_stub_free(struct tcp_connection_stub *conn_stub);
 //int conn_stub_add(uint32_t src_ip, uint16_t src_port);
 
+/** listening stubs, hashed on host_port. Only listen/connect/SYNs look here, so one sem guards it */
+#define TCP_CONN_STUB_HASH_SIZE 256 //must be a power of 2
 sem_t conn_stub_list_sem;
 int conn_stub_list_insert(struct tcp_connection_stub *conn_stub);
 struct tcp_connection_stub *conn_stub_list_find(uint32_t host_ip, uint16_t host_port);
@@ -171,6 +197,22 @@ typedef enum {
 	RENO_SLOWSTART = 0, RENO_AVOIDANCE, RENO_RECOVERY
 } reno_state;
 
+/** a congestion control algorithm, see tcp_cong.c. cong_state stays the phase the conn is in, dup ACKs & the
+ * GBN TO still move it into recovery & back, the ops decide how cong_window & threshhold follow */
+struct tcp_cong_ops {
+	char *name; //as given to setsockopt(TCP_CONGESTION) & in the config
+	void (*init)(struct tcp_connection *conn); //cong_window & threshhold are set, clear cong_priv
+	void (*on_ack)(struct tcp_connection *conn, uint32_t acked); //send_seq_num moved up by acked bytes
+	void (*on_loss)(struct tcp_connection *conn); //fast retransmit, sets threshhold, cong_window follows it
+	void (*on_rto)(struct tcp_connection *conn); //GBN TO
+	double (*pacing_rate)(struct tcp_connection *conn); //bytes/sec, 0 or NULL for just ACK clocking
+};
+
+#define TCP_CONG_NAME_MAX 16 //TCP_CA_NAME_MAX
+#define TCP_CONG_PRIV 32 //doubles of state per conn for the ops
+#define TCP_CONG_DEFAULT "reno"
+#define TCP_CONFIG_FILE "fins.cfg" //"tcp.congestion" names the congestion control conns start with, "tcp.gso" turns GSO off
+
 struct ipv4_header {
 	uint32_t src_ip; //Source ip
 	uint32_t dst_ip; //Destination ip
@@ -191,38 +233,17 @@ struct tcpv4_header {
 	uint8_t options[MAX_TCP_OPTIONS_BYTES]; //Options for the TCP segment (If Data Offset > 5) //TODO iron out full options mechanism
 };
 
-struct tcp_packet {
-	struct ipv4_header ip_hdr;
-	struct tcpv4_header tcp_hdr;
-};
-
-struct tcp_packet2 {
-	uint32_t src_ip; //Source ip
-	uint32_t dst_ip; //Destination ip
-	uint8_t zeros; //Unused zeros
-	uint8_t protocol; //protocol
-	uint16_t tcp_len; //TCP length
-	uint16_t src_port; //Source port
-	uint16_t dst_port; //Destination port
-	uint32_t seq_num; //Sequence number
-	uint32_t ack_num; //Acknowledgment number
-	uint16_t flags; //Flags and data offset
-	uint16_t win_size; //Window size
-	uint16_t checksum; //TCP checksum
-	uint16_t urg_pointer; //Urgent pointer (If URG flag set)
-	uint8_t options[MAX_TCP_OPTIONS_BYTES]; //Options for the TCP segment (If Data Offset > 5) //TODO iron out full options mechanism
-};
-
 //Structure for TCP connections that we have open at the moment
 struct tcp_connection {
-	//## protected by conn_list_sem
-	struct tcp_connection *next; //Next item in the list of TCP connections //TODO remove when change conn_list to circular array of ptrs
+	//## protected by list_sem
+	struct tcp_connection *next; //next in its conn_table bucket
 	uint32_t threads; //Number of threads accessing this obj
 	uint32_t write_threads;
 	//##
 
 	uint32_t total;
 
+	sem_t *list_sem; //the conn_table bucket lock, see conn_list_sem()
 	sem_t sem; //for next, state, write_threads
 	uint8_t running_flag; //signifies if it is running, 0 when shutting down
 	tcp_state state;
@@ -232,19 +253,17 @@ struct tcp_connection {
 	uint32_t rem_ip; //IP address of remote machine
 	uint16_t rem_port; //Port on remote machine
 
-	struct tcp_queue *request_queue; //buffer for sendmsg requests to be added to write_queue - nonblocking requests may TO and be removed
-	struct tcp_queue *write_queue; //buffer for raw data to be transfered - guaranteed to be transfered
-	struct tcp_queue *send_queue; //buffer for sent tcp_seg that are unACKed
+	struct tcp_queue *request_queue; //buffer for sendmsg requests to be added to send_buf - nonblocking requests may TO and be removed
+	struct tcp_queue *send_queue; //sent segs that are unACKed, views of their data in send_buf
 	struct tcp_queue *recv_queue; //buffer for recv tcp_seg that are unACKed - ordered out of order packets
 	//struct tcp_queue *read_queue; //buffer for raw data that has been transfered //TODO push straight to daemon?
 
-	pthread_t main_thread;
-	uint8_t main_wait_flag;
-	sem_t main_wait_sem;
+	struct tcp_worker *worker; //runs this conn, see tcp_worker.c
+	uint8_t wake_queued; //protected by worker->sem
+	uint8_t main_wait_flag; //main is waiting, call conn_wake() to run it again
 
 	uint8_t request_interrupt;
 	int request_index;
-	uint32_t write_index;
 	uint32_t poll_events;
 
 	uint8_t first_flag;
@@ -256,14 +275,12 @@ struct tcp_connection {
 	uint8_t to_msl_flag; //MSL timeout occurred
 	//uint8_t msl_flag; //MSL performing GBN
 
-	pthread_t to_gbn_thread;
-	int to_gbn_fd; //GBN timeout occurred
+	struct tcp_timer *to_gbn_timer; //GBN timeout occurred
 	uint8_t to_gbn_flag; //1 GBN timeout occurred
 	uint8_t gbn_flag; //1 performing GBN
 	struct tcp_node *gbn_node;
 
-	pthread_t to_delayed_thread;
-	int to_delayed_fd; //delayed ACK TO occurred
+	struct tcp_timer *to_delayed_timer; //delayed ACK TO occurred
 	uint8_t to_delayed_flag; //1 delayed ack timeout occured
 	uint8_t delayed_flag; //0 no delayed ack, 1 delayed ack
 	uint16_t delayed_ack_flags;
@@ -295,6 +312,12 @@ struct tcp_connection {
 	reno_state cong_state;
 	double cong_window;
 	double threshhold;
+	struct tcp_cong_ops *cong_ops;
+	double cong_priv[TCP_CONG_PRIV]; //kept by cong_ops, see tcp_cong.c
+
+	struct tcp_timer *to_pace_timer; //pacing delay over
+	uint8_t to_pace_flag;
+	struct timeval pace_next; //earliest the next new seg may go, when cong_ops paces
 
 	uint8_t rtt_flag;
 	uint32_t rtt_first;
@@ -302,6 +325,7 @@ struct tcp_connection {
 	struct timeval rtt_stamp;
 	double rtt_est;
 	double rtt_dev;
+	double rtt_last; //latest sample, ms
 	double timeout;
 
 	uint8_t active_open;
@@ -316,37 +340,31 @@ struct tcp_connection {
 	uint8_t sack_attempt; //attempt selective ACK option
 	uint8_t sack_enabled; //selective ACK option enabled
 	uint8_t sack_len;
+	uint32_t sack_recent; //seq of the latest out of order seg, its block is reported first
+	uint32_t sack_recover; //send_seq_end when recovery started, it ends once that is ACKed
 
 	uint8_t wsopt_attempt; //attempt window scaling option
 	uint8_t wsopt_enabled; //window scaling option enabled
 	uint8_t ws_send; //window scaling applied on sending
 	uint8_t ws_recv; //window scaling applied on recving
 
-	//-------------------------------------------------------------alternate implementation for sending
-	uint8_t *send_buf; //send buf, circular buffer that keeps data to send
-	uint32_t send_len; //size of send buffer
-	uint32_t send_start; //index in send_buf that corresponds to send_seq_num (SSN)
-	uint32_t send_next; //index in send_buf that corresponds to send_seq_end (SSE)
-	uint32_t send_end; //index in send_buf that corresponds to (1+end of data), so is where write to next
-	struct tcp_packet *send_pkt; //the single tcpv4_packet used for sending
-
-//if start == end, then no data written, next-start = len of data unACKed,
-//for optimization malloc a single packet for sending since for info:
-//doesn't change: src ip, dst ip, protocol, src port, dst port
-//always latest: ack, win, options
-//per seg: ip_tcp_len, seq_num, flags, checksum, urg pointer, data
-//just reference data in send_buffer
-
-//call:
-//update_pkt_latest(conn, flag?): ack, win, opts, opt_len;
-//update_pkt_seg(seq, flags, data, data_len, urg pt): ip_tcp_len, checksum;
-//checksum(pkt, opt_len, data, data_len): checksum
+	//raw data to be transfered, guaranteed to be transfered. Positions run free & are taken mod send_len, so
+	//send_end - send_start is what is held, send_next - send_start is unACKed & send_end - send_next unsent
+	uint8_t *send_buf; //circular buffer, allocated on the first write
+	uint32_t send_len; //size of send_buf, a power of 2
+	uint32_t send_start; //pos in send_buf that corresponds to send_seq_num (SSN)
+	uint32_t send_next; //pos in send_buf that corresponds to send_seq_end (SSE)
+	uint32_t send_end; //pos in send_buf that corresponds to (1+end of data), so is where write to next
+	struct tcp_segment *send_seg; //the one seg data is sent & resent in, a view of send_buf
 };
 
 //TODO raise any of these?
 #define TCP_THREADS_MAX 50 //TODO set thread limits by call?
 #define TCP_MAX_QUEUE_DEFAULT 131072//65535
-#define TCP_CONN_MAX 512
+#define TCP_SEND_BUF_DEFAULT 131072 //must be a power of 2
+#define TCP_GSO_MAX (65535 - 20 - MAX_TCP_HEADER_BYTES) //data in a super-seg, its IPv4 len is 16 bits
+#define TCP_CONN_MAX 32768
+#define TCP_CONN_STUB_MAX 1024
 #define TCP_GBN_TO_MIN 1000
 #define TCP_GBN_TO_MAX 64000
 #define TCP_GBN_TO_DEFAULT 5000
@@ -381,8 +399,11 @@ struct tcp_connection {
 #define TCP_OPT_SACK 5
 #define TCP_OPT_SACK_BYTES(x) (8*x+2)
 #define TCP_OPT_SACK_MIN_BYTES TCP_OPT_SACK_BYTES(0)
-#define TCP_OPT_SACK_MAX_BYTES TCP_OPT_SACK_BYTES(3)
+#define TCP_OPT_SACK_MAX_BYTES TCP_OPT_SACK_BYTES(4)
 #define TCP_OPT_SACK_LEN(x) ((x-2)/8)
+#define TCP_SACK_BLOCKS_MAX 4 //fits with the NOPs, 3 when sent with time stamps
+#define TCP_SACK_BLOCKS_TS 3
+#define TCP_SACK_DUP_THRESH 3
 #define TCP_OPT_TS 8
 #define TCP_OPT_TS_BYTES 10
 
@@ -392,13 +413,26 @@ int conn_send_exec(struct tcp_connection *conn, uint32_t param_id, uint32_t ret_
 int conn_send_fcf(struct tcp_connection *conn, uint32_t serialNum, uint32_t param_id, uint32_t ret_val, uint32_t ret_msg);
 int conn_reply_fcf(struct tcp_connection *conn, uint32_t ret_val, uint32_t ret_msg);
 int conn_is_finished(struct tcp_connection *conn);
+uint32_t conn_send_space(struct tcp_connection *conn); //bytes free in send_buf
+void conn_send_write(struct tcp_connection *conn, uint8_t *data, uint32_t len); //len must fit in conn_send_space()
+void conn_send_node(struct tcp_connection *conn, struct tcp_node *node, uint16_t flags); //sends the data node views
+void conn_send_run(struct tcp_connection *conn, struct tcp_node *node, uint32_t len, uint16_t flags); //len bytes of nodes from node on, in one frame
+struct tcp_node *conn_send_queue(struct tcp_connection *conn, uint32_t len); //len new bytes from send_next as MSS nodes, returns the first
 void conn_shutdown(struct tcp_connection *conn);
-void conn_stop(struct tcp_connection *conn); //TODO remove, move above tcp_main_thread, makes private
+int conn_stop(struct tcp_connection *conn);
 void conn_free(struct tcp_connection *conn);
+void conn_main(struct tcp_connection *conn);
+void conn_recv(struct tcp_connection *conn, struct tcp_segment *seg);
 
 void handle_requests(struct tcp_connection *conn);
 
-sem_t conn_list_sem;
+/** established connections, hashed on the 4-tuple. Buckets share TCP_CONN_LOCKS sems, so segments for
+ * different connections are demuxed in parallel. A bucket's sem also guards threads of its conns */
+#define TCP_CONN_HASH_SIZE 16384 //must be a power of 2
+#define TCP_CONN_LOCKS 256 //must be a power of 2, at most TCP_CONN_HASH_SIZE
+sem_t conn_list_sems[TCP_CONN_LOCKS];
+uint32_t conn_hash(uint16_t host_port, uint32_t rem_ip, uint16_t rem_port);
+sem_t *conn_list_sem(uint32_t host_ip, uint16_t host_port, uint32_t rem_ip, uint16_t rem_port);
 int conn_list_insert(struct tcp_connection *conn);
 struct tcp_connection *conn_list_find(uint32_t host_ip, uint16_t host_port, uint32_t rem_ip, uint16_t rem_port);
 void conn_list_remove(struct tcp_connection *conn);
@@ -408,6 +442,43 @@ int conn_list_has_space(void);
 void tcp_start_timer(int fd, double millis);
 void tcp_stop_timer(int fd);
 
+/** TCP runs on a fixed pool of workers instead of threads per conn and per segment. A conn belongs to the
+ * worker its 4-tuple hashes to, which runs its main_*() steps, its recv_*() for each segment in arrival
+ * order and its timers, all from one epoll loop */
+#define TCP_WORKERS 4 //must be a power of 2
+#define TCP_WORKER_EVENTS 64 //epoll events taken per wait
+#define TCP_WORKER_BUDGET 64 //main_*() steps a conn runs before the worker's other conns get a turn
+#define TCP_STOP_RETRY 1 //ms before a stopped conn checks again if exec threads still hold it
+
+//a segment to process or, with seg NULL, a conn to run
+struct tcp_work {
+	struct tcp_work *next;
+	struct tcp_connection *conn;
+	struct tcp_segment *seg;
+};
+
+struct tcp_worker {
+	uint32_t id;
+	pthread_t thread;
+	uint8_t running;
+	int epoll_fd;
+	int event_fd; //written when work goes into an empty queue
+	sem_t sem; //for the queue, the dead lists & wake_queued of its conns
+	struct tcp_work *front;
+	struct tcp_work *end;
+	struct tcp_connection *dead_conns; //freed at the end of the round, chained by next
+	struct tcp_timer *dead_timers;
+};
+
+void tcp_workers_init(void);
+void tcp_workers_run(pthread_attr_t *fins_pthread_attr);
+void tcp_workers_shutdown(void);
+void tcp_workers_release(void);
+struct tcp_worker *tcp_worker_get(uint32_t hash);
+void tcp_worker_recv(struct tcp_connection *conn, struct tcp_segment *seg);
+void tcp_worker_free(struct tcp_connection *conn);
+void conn_wake(struct tcp_connection *conn);
+
 //Object for TCP segments all values are in host format
 struct tcp_segment {
 	uint16_t src_port; //Source port
@@ -423,6 +494,10 @@ struct tcp_segment {
 	int opt_len; //length of the options in bytes
 	uint8_t *data; //Actual TCP segment data
 	int data_len; //Length of the data. This, of course, is not in the original TCP header.
+	uint8_t *ring; //if set, the data is instead data_len bytes of this circular buffer from ring_pos
+	uint32_t ring_len; //a power of 2
+	uint32_t ring_pos;
+	uint32_t gso_size; //if set & data_len is more, the interface cuts the seg into segs of this much data
 
 	uint32_t src_ip; //Source addr
 	uint32_t dst_ip; //Destination addr
@@ -441,7 +516,6 @@ struct finsFrame *tcp_to_fdf(struct tcp_segment *tcp);
 struct tcp_segment *fdf_to_tcp(struct finsFrame *ff);
 
 struct tcp_segment *seg_create(uint32_t src_ip, uint16_t src_port, uint32_t dst_ip, uint16_t dst_port, uint32_t seq_num, uint32_t seq_end);
-uint32_t seg_add_data(struct tcp_segment *seg, struct tcp_queue *queue, uint32_t index, int data_len);
 uint16_t seg_checksum(struct tcp_segment *seg);
 int seg_send(struct tcp_segment *seg);
 void seg_free(struct tcp_segment *seg);
@@ -464,15 +538,6 @@ struct tcp_thread_data {
 	struct finsFrame *ff;
 };
 
-struct tcp_to_thread_data {
-	uint32_t id;
-	int fd;
-	uint8_t *running;
-	uint8_t *flag;
-	uint8_t *waiting;
-	sem_t *sem;
-};
-
 //General functions for dealing with the incoming and outgoing frames
 void tcp_init(void);
 void tcp_run(pthread_attr_t *fins_pthread_attr);
@@ -497,6 +562,7 @@ int tcp_reply_fcf(struct finsFrame *ff, uint32_t ret_val, uint32_t ret_msg);
 
 #define SET_PARAM_TCP_HOST_WINDOW 0
 #define SET_PARAM_TCP_SOCK_OPT 1
+#define SET_PARAM_TCP_CONGESTION 2
 
 #define READ_PARAM_TCP_HOST_WINDOW 0
 #define READ_PARAM_TCP_SOCK_OPT 1
@@ -528,6 +594,28 @@ void tcp_read_param(struct finsFrame *ff);
 
 int process_options(struct tcp_connection *conn, struct tcp_segment *seg);
 
+/** selective ACKs, see tcp_sack.c */
+int sack_blocks(struct tcp_connection *conn, uint32_t *blocks, int max); //blocks holds 2*max seqs, returns blocks written
+void sack_recv(struct tcp_connection *conn, struct tcp_segment *seg); //marks the send_queue nodes seg SACKs
+struct tcp_node *sack_scan(struct tcp_connection *conn, uint32_t *pipe); //first lost node not resent yet, pipe may be NULL
+void sack_recovery(struct tcp_connection *conn);
+int sack_retransmit(struct tcp_connection *conn); //1 if a lost node was resent
+uint32_t sack_pipe(struct tcp_connection *conn);
+
+/** congestion control, see tcp_cong.c */
+extern struct tcp_cong_ops *tcp_cong_default; //what new conns & stubs start with
+extern uint8_t tcp_gso; //new data goes out in super-segs of up to TCP_GSO_MAX, cut into MSS segs by the interface
+struct tcp_cong_ops *cong_find(char *name); //NULL if there's no such algorithm
+void cong_set(struct tcp_connection *conn, struct tcp_cong_ops *ops);
+void cong_init(struct tcp_connection *conn); //handshake done, start in slow start
+void cong_ack(struct tcp_connection *conn, uint32_t acked);
+void cong_loss(struct tcp_connection *conn);
+void cong_rto(struct tcp_connection *conn);
+int cong_pace(struct tcp_connection *conn); //1 if a new seg may go now, else the pace timer is set
+void cong_sent(struct tcp_connection *conn, uint32_t len);
+uint32_t cong_burst(struct tcp_connection *conn, uint32_t max); //bytes a super-seg may carry when pacing, at least MSS
+double tcp_time_diff(struct timeval *time1, struct timeval *time2); //ms from time1 to time2
+
 /*
  void tcp_read_param_host_window(struct finsFrame *ff);
  void tcp_read_param_sock_opt(struct finsFrame *ff);
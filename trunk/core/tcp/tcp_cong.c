@@ -0,0 +1,463 @@
+/*
+ * @file tcp_cong.c
+ * @date Oct 18, 2026
+ * @brief congestion control. Each algorithm is a tcp_cong_ops, handle_ACK & the GBN TO call into the one the
+ * conn has, and main holds new segs back while the ops pace. Reno is what TCP has always done, CUBIC follows
+ * RFC 9438, and BBR keeps a model of the path instead of reacting to loss: the max delivery rate of the last
+ * rounds times the min RTT is the BDP, cong_window is a gain of it & segs are paced at a gain of the rate.
+ */
+
+#include "tcp.h"
+
+#define SEQ_LT(a, b) ((int32_t) ((a) - (b)) < 0)
+
+//########## Reno
+
+static void reno_ack(struct tcp_connection *conn, uint32_t acked) {
+	switch (conn->cong_state) {
+	case RENO_SLOWSTART:
+		conn->cong_window += (double) conn->MSS;
+		if (conn->cong_window >= conn->threshhold) {
+			conn->cong_state = RENO_AVOIDANCE;
+		}
+		break;
+	case RENO_AVOIDANCE:
+		conn->cong_window += ((double) conn->MSS) * ((double) conn->MSS) / conn->cong_window;
+		break;
+	case RENO_RECOVERY:
+		break;
+	}
+}
+
+static void reno_loss(struct tcp_connection *conn) {
+	uint32_t flight_size = conn->send_seq_end - conn->send_seq_num;
+
+	//RFC 5681: max(FlightSize/2, 2*SMSS)
+	conn->threshhold = (double) flight_size / 2.0;
+	if (conn->threshhold < 2.0 * conn->MSS) {
+		conn->threshhold = 2.0 * conn->MSS;
+	}
+}
+
+static void reno_rto(struct tcp_connection *conn) {
+	switch (conn->cong_state) {
+	case RENO_SLOWSTART:
+		conn->cong_state = RENO_AVOIDANCE;
+		conn->threshhold = conn->cong_window / 2.0;
+		if (conn->threshhold < (double) conn->MSS) {
+			conn->threshhold = (double) conn->MSS;
+		}
+		conn->cong_window = conn->threshhold + 3.0 * conn->MSS;
+		break;
+	case RENO_AVOIDANCE:
+	case RENO_RECOVERY:
+		conn->cong_state = RENO_SLOWSTART;
+		conn->threshhold = (double) conn->send_max_win; //TODO fix?
+		conn->cong_window = (double) conn->MSS;
+		break;
+	}
+}
+
+//########## CUBIC
+
+#define CUBIC_C 0.4
+#define CUBIC_BETA 0.7
+
+struct cubic_priv {
+	double w_max; //bytes, cong_window when the last loss hit
+	double k; //secs the cubic takes to get back up to w_max
+	double origin; //bytes, where the cubic flattens out
+	double w_est; //bytes, what Reno would have by now
+	struct timeval epoch; //start of this stretch of avoidance
+	uint8_t epoch_on;
+};
+
+static void cubic_init(struct tcp_connection *conn) {
+	memset(conn->cong_priv, 0, sizeof(struct cubic_priv));
+}
+
+static void cubic_ack(struct tcp_connection *conn, uint32_t acked) {
+	struct cubic_priv *ca = (struct cubic_priv *) conn->cong_priv;
+	double mss = (double) conn->MSS;
+	struct timeval now;
+	double target;
+	double t;
+
+	if (conn->cong_state != RENO_AVOIDANCE) {
+		reno_ack(conn, acked);
+		return;
+	}
+
+	gettimeofday(&now, 0);
+	if (!ca->epoch_on) {
+		ca->epoch_on = 1;
+		ca->epoch = now;
+		if (conn->cong_window < ca->w_max) {
+			ca->k = cbrt((ca->w_max - conn->cong_window) / mss / CUBIC_C);
+			ca->origin = ca->w_max;
+		} else {
+			ca->k = 0;
+			ca->origin = conn->cong_window;
+		}
+		ca->w_est = conn->cong_window;
+	}
+
+	//W_cubic(t + RTT)
+	t = (tcp_time_diff(&ca->epoch, &now) + conn->rtt_est) / 1000.0;
+	target = ca->origin + CUBIC_C * (t - ca->k) * (t - ca->k) * (t - ca->k) * mss;
+	if (target > 1.5 * conn->cong_window) {
+		target = 1.5 * conn->cong_window;
+	}
+
+	//never slower than Reno
+	ca->w_est += 3.0 * (1.0 - CUBIC_BETA) / (1.0 + CUBIC_BETA) * mss * (double) acked / conn->cong_window;
+	if (target < ca->w_est) {
+		target = ca->w_est;
+	}
+
+	if (target > conn->cong_window) {
+		conn->cong_window += (target - conn->cong_window) / conn->cong_window * (double) acked;
+	} else {
+		conn->cong_window += 0.01 * mss * (double) acked / conn->cong_window;
+	}
+}
+
+static void cubic_loss(struct tcp_connection *conn) {
+	struct cubic_priv *ca = (struct cubic_priv *) conn->cong_priv;
+
+	if (conn->cong_window < ca->w_max) {
+		ca->w_max = conn->cong_window * (1.0 + CUBIC_BETA) / 2.0; //fast convergence, let newer flows in
+	} else {
+		ca->w_max = conn->cong_window;
+	}
+	ca->epoch_on = 0;
+
+	conn->threshhold = conn->cong_window * CUBIC_BETA;
+	if (conn->threshhold < 2.0 * conn->MSS) {
+		conn->threshhold = 2.0 * conn->MSS;
+	}
+}
+
+static void cubic_rto(struct tcp_connection *conn) {
+	cubic_loss(conn);
+
+	conn->cong_state = RENO_SLOWSTART;
+	conn->cong_window = (double) conn->MSS;
+}
+
+//########## BBR
+
+#define BBR_BW_ROUNDS 10 //rounds the max delivery rate is taken over
+#define BBR_RTT_WIN 10000 //ms a min RTT stays good for
+#define BBR_PROBE_RTT_TIME 200 //ms spent at BBR_MIN_CWND to see the min RTT again
+#define BBR_HIGH_GAIN 2.885 //2/ln(2), doubles the rate each round
+#define BBR_CWND_GAIN 2.0
+#define BBR_MIN_CWND 4 //segs
+#define BBR_CYCLE_LEN 8
+
+static double bbr_cycle_gains[BBR_CYCLE_LEN] = { 1.25, 0.75, 1, 1, 1, 1, 1, 1 };
+
+enum bbr_mode {
+	BBR_STARTUP = 0, BBR_DRAIN, BBR_PROBE_BW, BBR_PROBE_RTT
+};
+
+struct bbr_priv {
+	uint32_t mode;
+	uint32_t cycle; //index in bbr_cycle_gains
+	uint32_t full_cnt; //rounds in startup without the rate growing
+	uint32_t rounds;
+	uint32_t round_end; //this round ends once this seq is ACKed
+	double delivered; //bytes ACKed so far
+	double round_delivered; //delivered when this round started
+	double bw[BBR_BW_ROUNDS]; //bytes/sec delivered in each of the last rounds
+	double btl_bw; //max of bw, 0 until there's a sample
+	double full_bw;
+	double min_rtt; //ms, 0 until calcRTT has a sample
+	double prior_cwnd; //put back after probing the RTT
+	struct timeval round_stamp;
+	struct timeval rtt_stamp; //when min_rtt was seen
+	struct timeval cycle_stamp; //when the gain cycle moved last or PROBE_RTT started
+};
+
+static void bbr_init(struct tcp_connection *conn) {
+	struct bbr_priv *bbr = (struct bbr_priv *) conn->cong_priv;
+
+	memset(bbr, 0, sizeof(struct bbr_priv));
+	bbr->mode = BBR_STARTUP;
+	bbr->round_end = conn->send_seq_end;
+	gettimeofday(&bbr->round_stamp, 0);
+	bbr->rtt_stamp = bbr->round_stamp;
+	bbr->cycle_stamp = bbr->round_stamp;
+}
+
+static double bbr_bdp(struct tcp_connection *conn, double gain) {
+	struct bbr_priv *bbr = (struct bbr_priv *) conn->cong_priv;
+
+	return gain * bbr->btl_bw * bbr->min_rtt / 1000.0;
+}
+
+static void bbr_ack(struct tcp_connection *conn, uint32_t acked) {
+	struct bbr_priv *bbr = (struct bbr_priv *) conn->cong_priv;
+	double mss = (double) conn->MSS;
+	uint32_t flight_size = conn->send_seq_end - conn->send_seq_num;
+	uint8_t round_done = 0;
+	uint8_t expired = 0;
+	struct timeval now;
+	double elapsed;
+	double target;
+	int i;
+
+	gettimeofday(&now, 0);
+	bbr->delivered += (double) acked;
+
+	//min RTT, from the samples calcRTT takes
+	if (conn->rtt_last > 0) {
+		expired = bbr->min_rtt > 0 && tcp_time_diff(&bbr->rtt_stamp, &now) > BBR_RTT_WIN;
+		if (bbr->min_rtt == 0 || conn->rtt_last < bbr->min_rtt || expired) {
+			bbr->min_rtt = conn->rtt_last;
+			bbr->rtt_stamp = now;
+		}
+	}
+
+	//a round is over once what was sent when it started is ACKed, what it delivered gives a rate sample
+	if (!SEQ_LT(conn->send_seq_num, bbr->round_end)) {
+		if (bbr->min_rtt > 0) {
+			elapsed = tcp_time_diff(&bbr->round_stamp, &now);
+			if (elapsed < bbr->min_rtt) {
+				elapsed = bbr->min_rtt; //ACKs bunched up don't make the path any faster
+			}
+			bbr->bw[bbr->rounds % BBR_BW_ROUNDS] = (bbr->delivered - bbr->round_delivered) * 1000.0 / elapsed;
+			bbr->btl_bw = 0;
+			for (i = 0; i < BBR_BW_ROUNDS; i++) {
+				if (bbr->btl_bw < bbr->bw[i]) {
+					bbr->btl_bw = bbr->bw[i];
+				}
+			}
+		}
+
+		bbr->rounds++;
+		bbr->round_end = conn->send_seq_end;
+		if (bbr->round_end == conn->send_seq_num) {
+			bbr->round_end++; //nothing out, the round is the next seg sent
+		}
+		bbr->round_stamp = now;
+		bbr->round_delivered = bbr->delivered;
+		round_done = 1;
+	}
+
+	switch (bbr->mode) {
+	case BBR_STARTUP:
+		if (round_done && bbr->btl_bw > 0) {
+			if (bbr->btl_bw >= 1.25 * bbr->full_bw) {
+				bbr->full_bw = bbr->btl_bw;
+				bbr->full_cnt = 0;
+			} else if (++bbr->full_cnt >= 3) {
+				//the pipe is full, drain the queue startup left behind
+				bbr->mode = BBR_DRAIN;
+				if (conn->cong_state == RENO_SLOWSTART) {
+					conn->cong_state = RENO_AVOIDANCE;
+				}
+			}
+		}
+		break;
+	case BBR_DRAIN:
+		if ((double) flight_size <= bbr_bdp(conn, 1.0)) {
+			bbr->mode = BBR_PROBE_BW;
+			bbr->cycle = 0;
+			bbr->cycle_stamp = now;
+		}
+		break;
+	case BBR_PROBE_BW:
+		if (tcp_time_diff(&bbr->cycle_stamp, &now) > bbr->min_rtt) {
+			bbr->cycle = (bbr->cycle + 1) % BBR_CYCLE_LEN;
+			bbr->cycle_stamp = now;
+		}
+		break;
+	case BBR_PROBE_RTT:
+		if (tcp_time_diff(&bbr->cycle_stamp, &now) > BBR_PROBE_RTT_TIME && round_done) {
+			bbr->mode = BBR_PROBE_BW;
+			bbr->cycle = 0;
+			bbr->cycle_stamp = now;
+			bbr->rtt_stamp = now;
+			conn->cong_window = bbr->prior_cwnd;
+		}
+		break;
+	}
+
+	if (expired && bbr->mode != BBR_PROBE_RTT && bbr->mode != BBR_STARTUP) {
+		bbr->mode = BBR_PROBE_RTT;
+		bbr->prior_cwnd = conn->cong_window;
+		bbr->cycle_stamp = now;
+	}
+
+	//cong_window
+	if (bbr->mode == BBR_PROBE_RTT) {
+		conn->cong_window = BBR_MIN_CWND * mss;
+	} else if (bbr->mode == BBR_STARTUP || bbr->btl_bw == 0 || bbr->min_rtt == 0) {
+		conn->cong_window += (double) acked; //until the pipe is full the model lags what cwnd lets out
+	} else {
+		target = bbr_bdp(conn, BBR_CWND_GAIN);
+		if (conn->cong_window + (double) acked < target) {
+			conn->cong_window += (double) acked;
+		} else {
+			conn->cong_window = target;
+		}
+	}
+	if (conn->cong_window < BBR_MIN_CWND * mss) {
+		conn->cong_window = BBR_MIN_CWND * mss;
+	}
+}
+
+static void bbr_loss(struct tcp_connection *conn) {
+	//loss says little about the rate the path gives, so the window stays where the model has it
+	conn->threshhold = conn->cong_window;
+}
+
+static void bbr_rto(struct tcp_connection *conn) {
+	if (conn->cong_state == RENO_RECOVERY) {
+		conn->cong_state = RENO_AVOIDANCE;
+	}
+	conn->threshhold = conn->cong_window;
+	conn->cong_window = (double) conn->MSS; //grows back to the model as ACKs come in
+}
+
+static double bbr_pacing_rate(struct tcp_connection *conn) {
+	struct bbr_priv *bbr = (struct bbr_priv *) conn->cong_priv;
+
+	switch (bbr->mode) {
+	case BBR_STARTUP:
+		return BBR_HIGH_GAIN * bbr->btl_bw;
+	case BBR_DRAIN:
+		return bbr->btl_bw / BBR_HIGH_GAIN;
+	case BBR_PROBE_BW:
+		return bbr_cycle_gains[bbr->cycle] * bbr->btl_bw;
+	default:
+		return bbr->btl_bw;
+	}
+}
+
+//##########
+
+static struct tcp_cong_ops tcp_congs[] = {
+	{ "reno", NULL, reno_ack, reno_loss, reno_rto, NULL },
+	{ "cubic", cubic_init, cubic_ack, cubic_loss, cubic_rto, NULL },
+	{ "bbr", bbr_init, bbr_ack, bbr_loss, bbr_rto, bbr_pacing_rate } };
+#define TCP_CONGS (sizeof(tcp_congs) / sizeof(struct tcp_cong_ops))
+
+struct tcp_cong_ops *cong_find(char *name) {
+	int i;
+
+	for (i = 0; i < TCP_CONGS; i++) {
+		if (strncmp(name, tcp_congs[i].name, TCP_CONG_NAME_MAX) == 0) {
+			return &tcp_congs[i];
+		}
+	}
+	return NULL;
+}
+
+void cong_set(struct tcp_connection *conn, struct tcp_cong_ops *ops) {
+	PRINT_DEBUG("Entered: conn=%p, cong=%s", conn, ops->name);
+
+	conn->cong_ops = ops;
+	if (ops->init) {
+		ops->init(conn);
+	}
+	timerclear(&conn->pace_next);
+}
+
+void cong_init(struct tcp_connection *conn) {
+	conn->cong_state = RENO_SLOWSTART;
+	conn->cong_window = (double) conn->MSS;
+	conn->threshhold = conn->send_max_win / 2.0;
+
+	cong_set(conn, conn->cong_ops);
+}
+
+void cong_ack(struct tcp_connection *conn, uint32_t acked) {
+	conn->cong_ops->on_ack(conn, acked);
+
+	if (conn->cong_state == RENO_RECOVERY) {
+		if (conn->sack_enabled && SEQ_LT(conn->send_seq_num, conn->sack_recover)) {
+			return; //partial ACK, keep resending the holes
+		}
+		conn->cong_state = RENO_AVOIDANCE;
+		conn->cong_window = conn->threshhold;
+	}
+}
+
+void cong_loss(struct tcp_connection *conn) {
+	PRINT_DEBUG("Entered: conn=%p, cong=%s, cwnd=%f", conn, conn->cong_ops->name, conn->cong_window);
+
+	conn->cong_state = RENO_RECOVERY;
+	conn->cong_ops->on_loss(conn);
+}
+
+void cong_rto(struct tcp_connection *conn) {
+	PRINT_DEBUG("Entered: conn=%p, cong=%s, cwnd=%f", conn, conn->cong_ops->name, conn->cong_window);
+
+	conn->cong_ops->on_rto(conn);
+	timerclear(&conn->pace_next);
+}
+
+int cong_pace(struct tcp_connection *conn) {
+	struct timeval now;
+	double wait;
+
+	if (conn->cong_ops->pacing_rate == NULL || !timerisset(&conn->pace_next)) {
+		return 1;
+	}
+
+	gettimeofday(&now, 0);
+	wait = tcp_time_diff(&now, &conn->pace_next);
+	if (wait < 0.001) {
+		return 1;
+	}
+
+	conn->to_pace_flag = 0;
+	tcp_start_timer(conn->to_pace_timer->fd, wait);
+	return 0;
+}
+
+void cong_sent(struct tcp_connection *conn, uint32_t len) {
+	struct timeval now;
+	double rate;
+	long usecs;
+
+	if (conn->cong_ops->pacing_rate == NULL) {
+		return;
+	}
+	rate = conn->cong_ops->pacing_rate(conn);
+	if (rate <= 0) {
+		timerclear(&conn->pace_next);
+		return;
+	}
+
+	//idle time isn't saved up for a burst later
+	gettimeofday(&now, 0);
+	if (!timerisset(&conn->pace_next) || timercmp(&conn->pace_next, &now, <)) {
+		conn->pace_next = now;
+	}
+	usecs = conn->pace_next.tv_usec + (long) ((double) len * 1000000.0 / rate);
+	conn->pace_next.tv_sec += usecs / 1000000;
+	conn->pace_next.tv_usec = usecs % 1000000;
+}
+
+uint32_t cong_burst(struct tcp_connection *conn, uint32_t max) {
+	double rate;
+	uint32_t len;
+
+	if (conn->cong_ops->pacing_rate == NULL || (rate = conn->cong_ops->pacing_rate(conn)) <= 0) {
+		return max;
+	}
+
+	//a super-seg leaves as one burst, so keep it to about 1ms at the pacing rate
+	len = (uint32_t) (rate / 1000.0);
+	len -= len % (uint32_t) conn->MSS;
+	if (len < (uint32_t) conn->MSS) {
+		len = (uint32_t) conn->MSS;
+	}
+	if (len > max) {
+		len = max;
+	}
+	return len;
+}
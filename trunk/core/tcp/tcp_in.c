@@ -6,6 +6,8 @@
 
 #include "tcp.h"
 
+#define SEQ_LEQ(a, b) ((int32_t) ((a) - (b)) <= 0)
+
 double tcp_time_diff(struct timeval *time1, struct timeval *time2) { //time2 - time1
 	double decimal = 0, diff = 0;
 
@@ -51,6 +53,7 @@ void calcRTT(struct tcp_connection *conn) {
 		sampRTT += decimal;
 	}
 	sampRTT *= 1000.0;
+	conn->rtt_last = sampRTT;
 
 	if (conn->rtt_first) {
 		conn->rtt_first = 0;
@@ -92,13 +95,17 @@ void handle_RST(struct tcp_connection *conn, struct tcp_segment *seg) {
 void handle_ACK(struct tcp_connection *conn, struct tcp_segment *seg) {
 	struct tcp_node *node;
 	struct tcp_node *temp_node;
-	struct tcp_segment *temp_seg;
+	uint32_t acked;
 
 	PRINT_DEBUG("Entered: conn=%p, seg=%p, state=%d", conn, seg, conn->state);PRINT_DEBUG("ack=%u, send=(%u, %u), sent=%u, sep=%u, fssn=%u, fsse=%u",
 			seg->ack_num-conn->issn, conn->send_seq_num-conn->issn, conn->send_seq_end-conn->issn, conn->fin_sent, conn->fin_sep, conn->fssn, conn->fsse);
 
 	//check if valid ACK
 	if (in_window(seg->ack_num, seg->ack_num, conn->send_seq_num, conn->send_seq_end)) {
+		if (conn->sack_enabled && seg->opt_len) {
+			sack_recv(conn, seg);
+		}
+
 		if (seg->ack_num == conn->send_seq_num) {
 
 			if (conn->send_win_seq < seg->seq_num || (conn->send_win_seq == seg->seq_num && conn->send_win_ack <= seg->ack_num)) {
@@ -114,16 +121,16 @@ void handle_ACK(struct tcp_connection *conn, struct tcp_segment *seg) {
 			PRINT_DEBUG( "host: seqs=(%u, %u) (%u, %u), win=(%u/%u), rem: seqs=(%u, %u) (%u, %u), win=(%u/%u)",
 					conn->send_seq_num-conn->issn, conn->send_seq_end-conn->issn, conn->send_seq_num, conn->send_seq_end, conn->recv_win, conn->recv_max_win, conn->recv_seq_num-conn->irsn, conn->recv_seq_end-conn->irsn, conn->recv_seq_num, conn->recv_seq_end, conn->send_win, conn->send_max_win);
 
-			//TODO process ACK options
-
 			conn->duplicate++; //TODO fix, creating duplicate from ACK or FIN ACK.
-			//check for FR
-			if (conn->duplicate == 3) {
+			//check for FR, with SACK also once the rem has enough past the front for it to count as lost
+			if (conn->duplicate == 3
+					|| (conn->sack_enabled && conn->cong_state != RENO_RECOVERY && !queue_is_empty(conn->send_queue)
+							&& sack_scan(conn, NULL) == conn->send_queue->front)) {
 				conn->duplicate = 0;
 
 				//RTT
 				conn->rtt_flag = 0;
-				tcp_start_timer(conn->to_gbn_fd, conn->timeout);
+				tcp_start_timer(conn->to_gbn_timer->fd, conn->timeout);
 				conn->to_gbn_flag = 0;
 
 				//Cong
@@ -132,18 +139,20 @@ void handle_ACK(struct tcp_connection *conn, struct tcp_segment *seg) {
 				case RENO_AVOIDANCE:
 					if (conn->send_seq_num == conn->issn) {
 						//TODO do nothing don't FR
+					} else if (conn->sack_enabled) {
+						//no inflation, main resends what is lost as the pipe allows
+						sack_recovery(conn);
 					} else { //TODO should be only if there's no data & it doesn't update the adv window
-						conn->cong_state = RENO_RECOVERY;
 						conn->fast_flag = 1;
 
-						conn->threshhold = conn->cong_window / 2.0;
-						if (conn->threshhold < (double) conn->MSS) {
-							conn->threshhold = (double) conn->MSS;
-						}
+						cong_loss(conn);
 						conn->cong_window = conn->threshhold + 3.0 * conn->MSS;
 					}
 					break;
 				case RENO_RECOVERY:
+					if (conn->sack_enabled) {
+						break;
+					}
 					conn->fast_flag = 1; //TODO send FR every 3 repeated, check if should do only first then ff=0
 					//conn->cong_window += (double) conn->MSS; //in RFC but FR is sent right afterward in same code
 					break;
@@ -155,15 +164,15 @@ void handle_ACK(struct tcp_connection *conn, struct tcp_segment *seg) {
 			//remove all segs
 			while (!queue_is_empty(conn->send_queue)) {
 				temp_node = queue_remove_front(conn->send_queue);
-				temp_seg = (struct tcp_segment *) temp_node->data;
 
-				PRINT_DEBUG( "acked: seg=%p, seqs=(%u, %u) (%u, %u), len=%d, rem: seqs=(%u, %u) (%u, %u)",
-						temp_seg, temp_seg->seq_num-conn->issn, temp_seg->seq_end-conn->issn, temp_seg->seq_num, temp_seg->seq_end, temp_seg->data_len, conn->recv_seq_num-conn->irsn, conn->recv_seq_end-conn->irsn, conn->recv_seq_num, conn->recv_seq_end);
+				PRINT_DEBUG( "acked: node=%p, seqs=(%u, %u) (%u, %u), len=%u, rem: seqs=(%u, %u) (%u, %u)",
+						temp_node, temp_node->seq_num-conn->issn, temp_node->seq_end-conn->issn, temp_node->seq_num, temp_node->seq_end, temp_node->len, conn->recv_seq_num-conn->irsn, conn->recv_seq_end-conn->irsn, conn->recv_seq_num, conn->recv_seq_end);
 
-				seg_free(temp_seg);
+				conn->send_start += temp_node->len;
 				free(temp_node);
 			}
 
+			acked = seg->ack_num - conn->send_seq_num;
 			conn->send_seq_num = seg->ack_num;
 
 			if (conn->send_win_seq < seg->seq_num || (conn->send_win_seq == seg->seq_num && conn->send_win_ack <= seg->ack_num)) {
@@ -180,52 +189,35 @@ void handle_ACK(struct tcp_connection *conn, struct tcp_segment *seg) {
 			PRINT_DEBUG( "host: seqs=(%u, %u) (%u, %u), win=(%u/%u), rem: seqs=(%u, %u) (%u, %u), win=(%u/%u)",
 					conn->send_seq_num-conn->issn, conn->send_seq_end-conn->issn, conn->send_seq_num, conn->send_seq_end, conn->recv_win, conn->recv_max_win, conn->recv_seq_num-conn->irsn, conn->recv_seq_end-conn->irsn, conn->recv_seq_num, conn->recv_seq_end, conn->send_win, conn->send_max_win);
 
-			//TODO process ACK options
-
 			//flags
 			conn->fast_flag = 0;
 			conn->gbn_flag = 0;
 
-			//RTT
-			if (conn->rtt_flag && seg->ack_num == conn->rtt_seq_end) {
+			//RTT, any ACK covering the timed seg
+			if (conn->rtt_flag && SEQ_LEQ(conn->rtt_seq_end, seg->ack_num)) {
 				calcRTT(conn);
 			}
-			tcp_stop_timer(conn->to_gbn_fd);
+			tcp_stop_timer(conn->to_gbn_timer->fd);
+			conn->first_flag = 1; //next seg sent starts it again
 
 			//Cong
-			switch (conn->cong_state) {
-			case RENO_SLOWSTART:
-				conn->cong_window += (double) conn->MSS;
-				if (conn->cong_window >= conn->threshhold) {
-					conn->cong_state = RENO_AVOIDANCE;
-				}
-				break;
-			case RENO_AVOIDANCE:
-				conn->cong_window += ((double) conn->MSS) * ((double) conn->MSS) / conn->cong_window;
-				break;
-			case RENO_RECOVERY:
-				conn->cong_state = RENO_AVOIDANCE;
-				conn->cong_window = conn->threshhold;
-				break;
-			}
+			cong_ack(conn, acked);
 		} else {
 			node = queue_find(conn->send_queue, seg->ack_num);
 			if (node) {
 				//remove ACK segs
 				while (!queue_is_empty(conn->send_queue) && conn->send_queue->front != node) {
 					temp_node = queue_remove_front(conn->send_queue);
-					temp_seg = (struct tcp_segment *) temp_node->data;
 
-					PRINT_DEBUG( "acked: seg=%p, seqs=(%u, %u) (%u, %u), len=%d, rem: seqs=(%u, %u) (%u, %u)",
-							temp_seg, temp_seg->seq_num-conn->issn, temp_seg->seq_end-conn->issn, temp_seg->seq_num, temp_seg->seq_end, temp_seg->data_len, conn->recv_seq_num-conn->irsn, conn->recv_seq_end-conn->irsn, conn->recv_seq_num, conn->recv_seq_end);
+					PRINT_DEBUG( "acked: node=%p, seqs=(%u, %u) (%u, %u), len=%u, rem: seqs=(%u, %u) (%u, %u)",
+							temp_node, temp_node->seq_num-conn->issn, temp_node->seq_end-conn->issn, temp_node->seq_num, temp_node->seq_end, temp_node->len, conn->recv_seq_num-conn->irsn, conn->recv_seq_end-conn->irsn, conn->recv_seq_num, conn->recv_seq_end);
 
-					seg_free(temp_seg); //TODO fix major problem!
+					conn->send_start += temp_node->len;
 					free(temp_node);
 				}
 
-				//TODO process ACK options
-
 				//valid ACK
+				acked = seg->ack_num - conn->send_seq_num;
 				conn->send_seq_num = seg->ack_num;
 				if (conn->wsopt_enabled) {
 					conn->send_win = ((uint32_t) seg->win_size) << conn->ws_send;
@@ -243,30 +235,16 @@ void handle_ACK(struct tcp_connection *conn, struct tcp_segment *seg) {
 				}
 
 				//RTT
-				if (conn->rtt_flag && seg->ack_num == conn->rtt_seq_end) {
+				if (conn->rtt_flag && SEQ_LEQ(conn->rtt_seq_end, seg->ack_num)) {
 					calcRTT(conn);
 				}
 				if (!conn->gbn_flag) {
-					tcp_start_timer(conn->to_gbn_fd, conn->timeout);
+					tcp_start_timer(conn->to_gbn_timer->fd, conn->timeout);
 					conn->to_gbn_flag = 0;
 				}
 
 				//Cong
-				switch (conn->cong_state) {
-				case RENO_SLOWSTART:
-					conn->cong_window += conn->MSS;
-					if (conn->cong_window >= conn->threshhold) {
-						conn->cong_state = RENO_AVOIDANCE;
-					}
-					break;
-				case RENO_AVOIDANCE:
-					conn->cong_window += ((double) conn->MSS) * ((double) conn->MSS) / conn->cong_window;
-					break;
-				case RENO_RECOVERY:
-					conn->cong_state = RENO_AVOIDANCE;
-					conn->cong_window = conn->threshhold;
-					break;
-				}
+				cong_ack(conn, acked);
 			} else {
 				PRINT_ERROR(
 						"Invalid ACK, was not sent: conn=%p, host=%u/%u, rem=%u/%u, state=%u, seg=%p, seqs=(%u, %u) (%u, %u), recv=(%u, %u) (%u, %u), ack=%u (%u), send=(%u, %u) (%u, %u)",
@@ -275,15 +253,14 @@ void handle_ACK(struct tcp_connection *conn, struct tcp_segment *seg) {
 		}
 
 		if (conn->main_wait_flag) {
-			PRINT_DEBUG("posting to main_wait_sem");
-			sem_post(&conn->main_wait_sem);
+			PRINT_DEBUG("waking main");
+			conn_wake(conn);
 		}
 	} else if (conn->fin_sent && conn->fin_sep && seg->ack_num == conn->fsse) {
 		//remove all segs
 		while (!queue_is_empty(conn->send_queue)) {
 			temp_node = queue_remove_front(conn->send_queue);
-			temp_seg = (struct tcp_segment *) temp_node->data;
-			seg_free(temp_seg);
+			conn->send_start += temp_node->len;
 			free(temp_node);
 		}
 
@@ -358,7 +335,7 @@ int process_flags(struct tcp_connection *conn, struct tcp_segment *seg, uint16_t
 					PRINT_DEBUG("FIN_WAIT_1: FIN ACK, send ACK, TIME_WAIT: state=%d, conn=%p, seg=%p", conn->state, conn, seg);
 					conn->state = TS_TIME_WAIT;
 
-					tcp_start_timer(conn->to_gbn_fd, 2 * TCP_MSL_TO_DEFAULT);
+					tcp_start_timer(conn->to_gbn_timer->fd, 2 * TCP_MSL_TO_DEFAULT);
 					conn->to_gbn_flag = 0;
 				} else {
 					//if FIN ACK, send FIN ACK, CLOSING (w FIN_SENT)
@@ -426,7 +403,7 @@ int process_flags(struct tcp_connection *conn, struct tcp_segment *seg, uint16_t
 			PRINT_DEBUG("FIN_WAIT_2: FIN, send ACK, TIME_WAIT: state=%d, conn=%p, seg=%p", conn->state, conn, seg);
 			conn->state = TS_TIME_WAIT;
 
-			tcp_start_timer(conn->to_gbn_fd, 2 * TCP_MSL_TO_DEFAULT);
+			tcp_start_timer(conn->to_gbn_timer->fd, 2 * TCP_MSL_TO_DEFAULT);
 			conn->to_gbn_flag = 0;
 			*send_flags |= FLAG_ACK;
 			return 1;
@@ -449,7 +426,7 @@ int process_flags(struct tcp_connection *conn, struct tcp_segment *seg, uint16_t
 				PRINT_DEBUG("CLOSING: ACK, send -, TIME_WAIT: state=%d, conn=%p, seg=%p", conn->state, conn, seg);
 				conn->state = TS_TIME_WAIT;
 
-				tcp_start_timer(conn->to_gbn_fd, 2 * TCP_MSL_TO_DEFAULT);
+				tcp_start_timer(conn->to_gbn_timer->fd, 2 * TCP_MSL_TO_DEFAULT);
 				conn->to_gbn_flag = 0;
 				return 0;
 			} else {
@@ -477,7 +454,7 @@ int process_flags(struct tcp_connection *conn, struct tcp_segment *seg, uint16_t
 		} else {
 			return 0;
 		}
-		//startTimer(conn->to_gbn_fd, 2 /* *DEFAULT_MSL*/);
+		//startTimer(conn->to_gbn_timer->fd, 2 /* *DEFAULT_MSL*/);
 		//*send_flags |= FLAG_ACK;
 		return 1;
 	case TS_CLOSE_WAIT:
@@ -561,7 +538,7 @@ int process_flags_old(struct tcp_connection *conn, struct tcp_segment *seg, uint
 					PRINT_DEBUG("FIN_WAIT_1: FIN ACK, send ACK, TIME_WAIT: state=%d, conn=%p, seg=%p", conn->state, conn, seg);
 					conn->state = TS_TIME_WAIT;
 
-					tcp_start_timer(conn->to_gbn_fd, 2 * TCP_MSL_TO_DEFAULT);
+					tcp_start_timer(conn->to_gbn_timer->fd, 2 * TCP_MSL_TO_DEFAULT);
 					conn->to_gbn_flag = 0;
 					if (seg->data_len) {
 						*send_flags |= FLAG_ACK;
@@ -628,7 +605,7 @@ int process_flags_old(struct tcp_connection *conn, struct tcp_segment *seg, uint
 			PRINT_DEBUG("FIN_WAIT_2: FIN, send ACK, TIME_WAIT: state=%d, conn=%p, seg=%p", conn->state, conn, seg);
 			conn->state = TS_TIME_WAIT;
 
-			tcp_start_timer(conn->to_gbn_fd, 2 * TCP_MSL_TO_DEFAULT);
+			tcp_start_timer(conn->to_gbn_timer->fd, 2 * TCP_MSL_TO_DEFAULT);
 			conn->to_gbn_flag = 0;
 			if (seg->data_len) {
 				*send_flags |= FLAG_ACK;
@@ -653,7 +630,7 @@ int process_flags_old(struct tcp_connection *conn, struct tcp_segment *seg, uint
 				PRINT_DEBUG("CLOSING: ACK, send -, TIME_WAIT: state=%d, conn=%p, seg=%p", conn->state, conn, seg);
 				conn->state = TS_TIME_WAIT;
 
-				tcp_start_timer(conn->to_gbn_fd, 2 * TCP_MSL_TO_DEFAULT);
+				tcp_start_timer(conn->to_gbn_timer->fd, 2 * TCP_MSL_TO_DEFAULT);
 				conn->to_gbn_flag = 0;
 			} else {
 				//if ACK, send FIN, CLOSING w/fin_sent
@@ -689,7 +666,7 @@ int process_flags_old(struct tcp_connection *conn, struct tcp_segment *seg, uint
 		} else {
 			return 1;
 		}
-		//startTimer(conn->to_gbn_fd, 2 /* *DEFAULT_MSL*/);
+		//startTimer(conn->to_gbn_timer->fd, 2 /* *DEFAULT_MSL*/);
 		//*send_flags |= FLAG_ACK;
 		return 1;
 	case TS_CLOSE_WAIT:
@@ -815,8 +792,9 @@ int process_options(struct tcp_connection *conn, struct tcp_segment *seg) {
 		case TCP_OPT_SACK:
 			len = pt[i++];
 			if (TCP_OPT_SACK_MIN_BYTES <= len && len <= TCP_OPT_SACK_MAX_BYTES) {
-				//TODO
+				//blocks are taken by sack_recv() from handle_ACK()
 				PRINT_DEBUG("SACK: (%u/%u), len=%u", i-TCP_OPT_SACK_MIN_BYTES, seg->opt_len, len);
+				i += len - 2;
 			} else {
 				PRINT_ERROR("SACK: (%u/%u), len=%u PROB", i-2, seg->opt_len, len);
 			}
@@ -915,6 +893,12 @@ uint16_t handle_data(struct tcp_connection *conn, struct tcp_segment *seg) {
 	//data handling
 	if (seg->seq_num == conn->recv_seq_num) { //add check for overlapping?
 		//in order seq num
+		if (seg->data_len && !queue_is_empty(conn->recv_queue)) {
+			send_flags |= FLAG_ACK_NOW; //fills a hole, let the rem know right away
+		}
+		if (seg->data_len > conn->MSS) {
+			send_flags |= FLAG_ACK_NOW; //a super-seg, ACK every 2 full segs' worth (RFC 5681 4.2)
+		}
 
 		if (process_seg(conn, seg, &send_flags)) {
 			conn->recv_win = ((uint16_t) seg->data_len < conn->recv_win) ? conn->recv_win - (uint16_t) seg->data_len : 0;
@@ -994,10 +978,10 @@ uint16_t handle_data(struct tcp_connection *conn, struct tcp_segment *seg) {
 		}
 
 		/*#*/PRINT_DEBUG("");
-		sem_post(&conn->main_wait_sem); //signal recv main thread
+		conn_wake(conn); //signal main
 	} else {
 		if (seg->data_len) {
-			send_flags |= FLAG_ACK;
+			send_flags |= FLAG_ACK | FLAG_ACK_NOW; //dup ACK, with SACK blocks if enabled
 		} else if (seg->flags & FLAG_FIN) {
 			send_flags |= FLAG_ACK;
 		}
@@ -1005,11 +989,13 @@ uint16_t handle_data(struct tcp_connection *conn, struct tcp_segment *seg) {
 		//re-ordered segment
 		if (conn->recv_win) {
 			if (in_window(seg->seq_num, seg->seq_end, conn->recv_seq_num, conn->recv_seq_end)) {
-				node = node_create((uint8_t *) seg, seg->data_len, seg->seq_num, seg->seq_end);
+				//node seq_end is the last byte, as queue_insert() expects, else segs that touch are taken for dups
+				node = node_create((uint8_t *) seg, seg->data_len, seg->seq_num, seg->data_len ? seg->seq_end - 1 : seg->seq_end);
 				ret = queue_insert(conn->recv_queue, node, conn->recv_seq_num, conn->recv_seq_end);
 				PRINT_DEBUG("after");
 				if (ret) {
 					conn->recv_win = ((uint16_t) seg->data_len < conn->recv_win) ? conn->recv_win - (uint16_t) seg->data_len : 0;
+					conn->sack_recent = seg->seq_num;
 				} else {
 					PRINT_DEBUG("Dropping duplicate rem=(%u, %u), got=(%u, %u)", conn->recv_seq_num, conn->recv_seq_end, seg->seq_num, seg->seq_end);
 					seg_free(seg);
@@ -1068,8 +1054,8 @@ void handle_reply(struct tcp_connection *conn, uint16_t flags) {
 	}
 
 	if (flags & FLAG_ACK) {
-		if (conn->delayed_flag || (flags & FLAG_FIN)) {
-			tcp_stop_timer(conn->to_delayed_fd);
+		if (conn->delayed_flag || (flags & (FLAG_FIN | FLAG_ACK_NOW))) {
+			tcp_stop_timer(conn->to_delayed_timer->fd);
 			conn->delayed_flag = 0;
 			conn->to_delayed_flag = 0;
 
@@ -1079,8 +1065,8 @@ void handle_reply(struct tcp_connection *conn, uint16_t flags) {
 			seg_free(seg);
 		} else {
 			conn->delayed_flag = 1;
-			conn->delayed_ack_flags = flags;
-			tcp_start_timer(conn->to_delayed_fd, TCP_DELAYED_TO_DEFAULT);
+			conn->delayed_ack_flags = flags & (FLAG_CONTROL | FLAG_ECN);
+			tcp_start_timer(conn->to_delayed_timer->fd, TCP_DELAYED_TO_DEFAULT);
 			conn->to_delayed_flag = 0;
 		}
 	} else {
@@ -1240,13 +1226,11 @@ void recv_syn_sent(struct tcp_connection *conn, struct tcp_segment *seg) {
 				conn->gbn_flag = 0;
 
 				//RTT
-				tcp_stop_timer(conn->to_gbn_fd);
+				tcp_stop_timer(conn->to_gbn_timer->fd);
 				conn->timeout = TCP_GBN_TO_DEFAULT;
 
 				//Cong
-				conn->cong_state = RENO_SLOWSTART;
-				conn->cong_window = (double) conn->MSS;
-				conn->threshhold = conn->send_max_win / 2.0;
+				cong_init(conn);
 
 				//TODO piggy back data? release to established with delayed TO on
 				//send ACK
@@ -1306,7 +1290,7 @@ void recv_syn_sent(struct tcp_connection *conn, struct tcp_segment *seg) {
 			seg_send(temp_seg);
 			seg_free(temp_seg);
 
-			tcp_start_timer(conn->to_gbn_fd, TCP_MSL_TO_DEFAULT); //TODO figure out to's
+			tcp_start_timer(conn->to_gbn_timer->fd, TCP_MSL_TO_DEFAULT); //TODO figure out to's
 			conn->to_gbn_flag = 0;
 		}
 	} else {
@@ -1371,13 +1355,11 @@ void recv_syn_recv(struct tcp_connection *conn, struct tcp_segment *seg) {
 				conn->gbn_flag = 0;
 
 				//RTT
-				tcp_stop_timer(conn->to_gbn_fd);
+				tcp_stop_timer(conn->to_gbn_timer->fd);
 				conn->timeout = TCP_GBN_TO_DEFAULT;
 
 				//Cong
-				conn->cong_state = RENO_SLOWSTART;
-				conn->cong_window = (double) conn->MSS;
-				conn->threshhold = conn->send_max_win / 2.0;
+				cong_init(conn);
 
 				if (!(seg->flags & FLAG_ACK)) {
 					flags = handle_data(conn, seg);
@@ -1427,7 +1409,7 @@ void recv_syn_recv(struct tcp_connection *conn, struct tcp_segment *seg) {
 			seg_send(temp_seg);
 			seg_free(temp_seg);
 
-			tcp_start_timer(conn->to_gbn_fd, TCP_MSL_TO_DEFAULT);
+			tcp_start_timer(conn->to_gbn_timer->fd, TCP_MSL_TO_DEFAULT);
 			conn->to_gbn_flag = 0;
 		}
 	} else {
@@ -1458,13 +1440,11 @@ void recv_syn_recv(struct tcp_connection *conn, struct tcp_segment *seg) {
 				conn->gbn_flag = 0;
 
 				//RTT
-				tcp_stop_timer(conn->to_gbn_fd);
+				tcp_stop_timer(conn->to_gbn_timer->fd);
 				conn->timeout = TCP_GBN_TO_DEFAULT;
 
 				//Cong
-				conn->cong_state = RENO_SLOWSTART;
-				conn->cong_window = (double) conn->MSS;
-				conn->threshhold = conn->send_max_win / 2.0;
+				cong_init(conn);
 
 				if (!(seg->flags & FLAG_ACK)) {
 					flags = handle_data(conn, seg);
@@ -1691,7 +1671,7 @@ void recv_closing_old(struct tcp_connection *conn, struct tcp_segment *seg) {
 			PRINT_DEBUG( "host: seqs=(%u, %u) (%u, %u), win=(%u/%u), rem: seqs=(%u, %u) (%u, %u), win=(%u/%u)",
 					conn->send_seq_num-conn->issn, conn->send_seq_end-conn->issn, conn->send_seq_num, conn->send_seq_end, conn->recv_win, conn->recv_max_win, conn->recv_seq_num-conn->irsn, conn->recv_seq_end-conn->irsn, conn->recv_seq_num, conn->recv_seq_end, conn->send_win, conn->send_max_win);
 
-			tcp_start_timer(conn->to_gbn_fd, 2 * TCP_MSL_TO_DEFAULT);
+			tcp_start_timer(conn->to_gbn_timer->fd, 2 * TCP_MSL_TO_DEFAULT);
 			conn->to_gbn_flag = 0;
 		} else {
 			//TODO RST
@@ -1704,7 +1684,7 @@ void recv_closing_old(struct tcp_connection *conn, struct tcp_segment *seg) {
 			PRINT_DEBUG("ACK, send -, TIME_WAIT: state=%d, conn=%p, seg=%p", conn->state, conn, seg);
 			conn->state = TS_TIME_WAIT;
 
-			tcp_start_timer(conn->to_gbn_fd, 2 * TCP_MSL_TO_DEFAULT);
+			tcp_start_timer(conn->to_gbn_timer->fd, 2 * TCP_MSL_TO_DEFAULT);
 			conn->to_gbn_flag = 0;
 		}
 	}
@@ -1833,21 +1813,12 @@ void recv_last_ack_old(struct tcp_connection *conn, struct tcp_segment *seg) {
 	seg_free(seg);
 }
 
-void *recv_thread(void *local) {
-	struct tcp_thread_data *thread_data = (struct tcp_thread_data *) local;
-	int id = thread_data->id;
-	struct tcp_connection *conn = thread_data->conn;
-	struct tcp_segment *seg = thread_data->seg;
-
+/**@brief handles a segment in the conn's state, called by the conn's worker with conn->sem held */
+void conn_recv(struct tcp_connection *conn, struct tcp_segment *seg) {
 	uint16_t calc;
 
-	PRINT_DEBUG("Entered: id=%u", id);
+	PRINT_DEBUG("Entered: conn=%p, seg=%p", conn, seg);
 
-	/*#*/PRINT_DEBUG("sem_wait: conn=%p", conn);
-	if (sem_wait(&conn->sem)) {
-		PRINT_ERROR("conn->sem wait prob");
-		exit(-1);
-	}
 	if (conn->running_flag) {
 		calc = seg_checksum(seg); //TODO add alt checksum
 		PRINT_DEBUG("checksum=%u, calc=%u", seg->checksum, calc);
@@ -1906,22 +1877,7 @@ void *recv_thread(void *local) {
 		seg_free(seg);
 	}
 
-	/*#*/PRINT_DEBUG("");
-	if (sem_wait(&conn_list_sem)) {
-		PRINT_ERROR("conn_list_sem wait prob");
-		exit(-1);
-	}
-	conn->threads--;
-	PRINT_DEBUG("leaving thread: conn=%p, threads=%d", conn, conn->threads);
-	sem_post(&conn_list_sem);
-
-	/*#*/PRINT_DEBUG("sem_post: conn=%p", conn);
-	sem_post(&conn->sem);
-
-	PRINT_DEBUG("Exited: id=%u", id);
-
-	free(thread_data);
-	pthread_exit(NULL);
+	PRINT_DEBUG("Exited: conn=%p", conn);
 }
 
 void tcp_in_fdf(struct finsFrame *ff) {
@@ -1937,35 +1893,23 @@ void tcp_in_fdf(struct finsFrame *ff) {
 
 	seg = fdf_to_tcp(ff);
 	if (seg) {
+		sem_t *list_sem = conn_list_sem(seg->dst_ip, seg->dst_port, seg->src_ip, seg->src_port);
 		/*#*/PRINT_DEBUG("");
-		if (sem_wait(&conn_list_sem)) {
+		if (sem_wait(list_sem)) {
 			PRINT_ERROR("conn_list_sem wait prob");
 			exit(-1);
 		}
 		conn = conn_list_find(seg->dst_ip, seg->dst_port, seg->src_ip, seg->src_port);
 		if (conn) {
-			start = (conn->threads < TCP_THREADS_MAX) ? ++conn->threads : 0;
+			//holds the conn until the worker gets to the segment, queued segments don't count against TCP_THREADS_MAX
+			conn->threads++;
 			/*#*/PRINT_DEBUG("");
-			sem_post(&conn_list_sem);
+			sem_post(list_sem);
 
-			if (start) {
-				thread_data = (struct tcp_thread_data *) malloc(sizeof(struct tcp_thread_data));
-				thread_data->id = tcp_gen_thread_id();
-				thread_data->conn = conn;
-				thread_data->seg = seg;
-
-				if (pthread_create(&thread, NULL, recv_thread, (void *) thread_data)) {
-					PRINT_ERROR("ERROR: unable to create recv_thread thread.");
-					exit(-1);
-				}
-				pthread_detach(thread);
-			} else {
-				PRINT_ERROR("Too many threads=%d. Dropping...", conn->threads);
-				seg_free(seg);
-			}
+			tcp_worker_recv(conn, seg);
 		} else {
 			/*#*/PRINT_DEBUG("");
-			sem_post(&conn_list_sem);
+			sem_post(list_sem);
 
 			if ((seg->flags & FLAG_SYN) && !(seg->flags & (FLAG_RST | FLAG_ACK | FLAG_FIN))) {
 				//TODO check security, send RST if lower, etc
@@ -2409,13 +2353,13 @@ void *recv_thread_test(void *local) {
 	}
 
 	/*#*/PRINT_DEBUG("");
-	if (sem_wait(&conn_list_sem)) {
+	if (sem_wait(conn->list_sem)) {
 		PRINT_ERROR("conn_list_sem wait prob");
 		exit(-1);
 	}
 	conn->threads--;
 	PRINT_DEBUG("leaving thread: conn=%p, threads=%d", conn, conn->threads);
-	sem_post(&conn_list_sem);
+	sem_post(conn->list_sem);
 
 	/*#*/PRINT_DEBUG("sem_post: conn=%p", conn);
 	sem_post(&conn->sem);
@@ -6,44 +6,6 @@
 
 #include "tcp.h"
 
-void *tcp_to_write_thread(void *local) {
-	struct tcp_to_thread_data *to_data = (struct tcp_to_thread_data *) local;
-	int id = to_data->id;
-	int fd = to_data->fd;
-	uint8_t *running = to_data->running;
-	uint8_t *flag = to_data->flag;
-	uint8_t *interrupt = to_data->waiting;
-	sem_t *sem = to_data->sem;
-	free(to_data);
-
-	int ret;
-	uint64_t exp;
-
-	PRINT_DEBUG("Entered: id=%u, fd=%d", id, fd);
-	while (*running) {
-		/*#*/PRINT_DEBUG("");
-		ret = read(fd, &exp, sizeof(uint64_t)); //blocking read
-		if (!(*running)) {
-			break;
-		}
-		if (ret != sizeof(uint64_t)) {
-			//read error
-			PRINT_ERROR("Read error: id=%u, fd=%d", id, fd);
-			continue;
-		}
-
-		PRINT_DEBUG("throwing flag: id=%u, fd=%d", id, fd);
-		*interrupt = 1;
-		*flag = 1;
-
-		PRINT_DEBUG("posting to wait_sem");
-		sem_post(sem);
-	}
-
-	PRINT_DEBUG("Exited: id=%u, fd=%d", id, fd);
-	pthread_exit(NULL);
-}
-
 void *write_thread(void *local) {
 	struct tcp_thread_data *thread_data = (struct tcp_thread_data *) local;
 	uint32_t id = thread_data->id;
@@ -68,19 +30,19 @@ void *write_thread(void *local) {
 		if (conn->state == TS_SYN_SENT || conn->state == TS_SYN_RECV) { //equiv to non blocking
 			PRINT_DEBUG("pre-connected non-blocking");
 
-			int space = conn->write_queue->max - conn->write_queue->len;
+			int space = conn_send_space(conn);
 			PRINT_DEBUG("space=%d, called_len=%u", space, called_len);
 			if (space >= called_len) {
-				node = node_create(called_data, called_len, 0, called_len - 1);
-				queue_append(conn->write_queue, node);
+				conn_send_write(conn, called_data, called_len);
+				free(called_data);
 
 				space -= called_len;
 
 				conn_send_fcf(conn, serial_num, EXEC_TCP_SEND, 1, called_len);
 
 				if (conn->main_wait_flag) {
-					PRINT_DEBUG("posting to wait_sem");
-					sem_post(&conn->main_wait_sem);
+					PRINT_DEBUG("waking main");
+					conn_wake(conn);
 				}
 			} else {
 				conn_send_fcf(conn, serial_num, EXEC_TCP_SEND, 0, EAGAIN);
@@ -111,37 +73,16 @@ void *write_thread(void *local) {
 			if (flags & (MSG_DONTWAIT)) {
 				PRINT_DEBUG("non-blocking");
 
-				request->to_fd = timerfd_create(CLOCK_REALTIME, 0);
-				if (request->to_fd == -1) {
-					PRINT_ERROR("ERROR: unable to create to_fd.");
-					exit(-1);
-				}
+				request->to_timer = tcp_timer_open(conn, &request->to_flag, &conn->request_interrupt);
 				request->to_running = 1;
 				request->to_flag = 0;
 
-				struct tcp_to_thread_data *to_write_data = (struct tcp_to_thread_data *) malloc(sizeof(struct tcp_to_thread_data));
-				if (to_write_data == NULL) {
-					PRINT_ERROR("alloc error.");
-					exit(-1);
-				}
-
-				to_write_data->id = tcp_gen_thread_id();
-				to_write_data->fd = request->to_fd;
-				to_write_data->running = &request->to_running;
-				to_write_data->flag = &request->to_flag;
-				to_write_data->waiting = &conn->request_interrupt;
-				to_write_data->sem = &conn->main_wait_sem;
-
-				PRINT_DEBUG("to_write: conn=%p, id=%u, to_fd=%d", conn, to_write_data->id, to_write_data->fd);
-				if (pthread_create(&request->to_thread, NULL, tcp_to_write_thread, (void *) to_write_data)) {
-					PRINT_ERROR("ERROR: unable to create recv_thread thread.");
-					exit(-1);
-				}
-				tcp_start_timer(request->to_fd, TCP_BLOCK_DEFAULT);
+				PRINT_DEBUG("to_write: conn=%p, to_fd=%d", conn, request->to_timer->fd);
+				tcp_start_timer(request->to_timer->fd, TCP_BLOCK_DEFAULT);
 			} else {
 				PRINT_DEBUG("blocking");
 
-				request->to_fd = -1;
+				request->to_timer = NULL;
 				request->to_running = 0;
 				request->to_flag = 0;
 			}
@@ -153,13 +94,17 @@ void *write_thread(void *local) {
 				handle_requests(conn);
 
 				if (conn->main_wait_flag) {
-					PRINT_DEBUG("posting to main_wait_sem");
-					sem_post(&conn->main_wait_sem);
+					PRINT_DEBUG("waking main");
+					conn_wake(conn);
 				}
 			} else {
 				PRINT_ERROR("request_list full, len=%u", conn->request_queue->len)
 				//send NACK to send handler
 				conn_send_fcf(conn, serial_num, EXEC_TCP_SEND, 0, 0);
+				if (request->to_running) {
+					tcp_timer_close(request->to_timer); //or it would go off on a conn that may be gone
+				}
+				free(request);
 				free(called_data);
 			}
 		} else {
@@ -178,13 +123,13 @@ void *write_thread(void *local) {
 	}
 
 	/*#*/PRINT_DEBUG("");
-	if (sem_wait(&conn_list_sem)) {
+	if (sem_wait(conn->list_sem)) {
 		PRINT_ERROR("conn_list_sem wait prob");
 		exit(-1);
 	}
 	conn->threads--;
 	PRINT_DEBUG("leaving thread: conn=%p, threads=%d", conn, conn->threads);
-	sem_post(&conn_list_sem);
+	sem_post(conn->list_sem);
 
 	/*#*/PRINT_DEBUG("sem_post: conn=%p", conn);
 	sem_post(&conn->sem);
@@ -223,8 +168,9 @@ void tcp_out_fdf(struct finsFrame *ff) {
 		PRINT_ERROR("todo error");
 	}
 
+	sem_t *list_sem = conn_list_sem(src_ip, (uint16_t) src_port, dst_ip, (uint16_t) dst_port);
 	/*#*/PRINT_DEBUG("");
-	if (sem_wait(&conn_list_sem)) {
+	if (sem_wait(list_sem)) {
 		PRINT_ERROR("conn_list_sem wait prob");
 		exit(-1);
 	}
@@ -232,7 +178,7 @@ void tcp_out_fdf(struct finsFrame *ff) {
 	int start = (conn->threads < TCP_THREADS_MAX) ? ++conn->threads : 0;
 	//if (start) {conn->write_threads++;}
 	/*#*/PRINT_DEBUG("");
-	sem_post(&conn_list_sem);
+	sem_post(list_sem);
 
 	if (conn) {
 		if (start) {
@@ -320,7 +266,7 @@ void *close_thread(void *local) {
 			PRINT_DEBUG( "host: seqs=(%u, %u) (%u, %u), win=(%u/%u), rem: seqs=(%u, %u) (%u, %u), win=(%u/%u)",
 					conn->send_seq_num-conn->issn, conn->send_seq_end-conn->issn, conn->send_seq_num, conn->send_seq_end, conn->recv_win, conn->recv_max_win, conn->recv_seq_num-conn->irsn, conn->recv_seq_end-conn->irsn, conn->recv_seq_num, conn->recv_seq_end, conn->send_win, conn->send_max_win);
 
-			PRINT_DEBUG("request_queue->len=%u, write_queue->len=%u", conn->request_queue->len, conn->write_queue->len);
+			PRINT_DEBUG("request_queue->len=%u, unsent=%u", conn->request_queue->len, conn->send_end - conn->send_next);
 			if (conn_is_finished(conn)) {
 				//send FIN
 				conn->fin_sent = 1;
@@ -374,13 +320,13 @@ void *close_thread(void *local) {
 	}
 
 	/*#*/PRINT_DEBUG("");
-	if (sem_wait(&conn_list_sem)) {
+	if (sem_wait(conn->list_sem)) {
 		PRINT_ERROR("conn_list_sem wait prob");
 		exit(-1);
 	}
 	conn->threads--;
 	PRINT_DEBUG("leaving thread: conn=%p, threads=%d", conn, conn->threads);
-	sem_post(&conn_list_sem);
+	sem_post(conn->list_sem);
 
 	/*#*/PRINT_DEBUG("sem_post: conn=%p", conn);
 	sem_post(&conn->sem);
@@ -393,7 +339,8 @@ void *close_thread(void *local) {
 void tcp_exec_close(struct finsFrame *ff, uint32_t host_ip, uint16_t host_port, uint32_t rem_ip, uint16_t rem_port) {
 	PRINT_DEBUG("Entered: host=%u/%u, rem=%u/%u", host_ip, host_port, rem_ip, rem_port);
 
-	if (sem_wait(&conn_list_sem)) {
+	sem_t *list_sem = conn_list_sem(host_ip, host_port, rem_ip, rem_port);
+	if (sem_wait(list_sem)) {
 		PRINT_ERROR("conn_list_sem wait prob");
 		exit(-1);
 	}
@@ -401,7 +348,7 @@ void tcp_exec_close(struct finsFrame *ff, uint32_t host_ip, uint16_t host_port,
 	if (conn) {
 		int start = (conn->threads < TCP_THREADS_MAX) ? ++conn->threads : 0;
 		/*#*/PRINT_DEBUG("");
-		sem_post(&conn_list_sem);
+		sem_post(list_sem);
 
 		if (start) {
 			struct tcp_thread_data *thread_data = (struct tcp_thread_data *) malloc(sizeof(struct tcp_thread_data));
@@ -420,7 +367,7 @@ void tcp_exec_close(struct finsFrame *ff, uint32_t host_ip, uint16_t host_port,
 		}
 	} else {
 		PRINT_ERROR("todo error");
-		sem_post(&conn_list_sem);
+		sem_post(list_sem);
 		//TODO error trying to close closed connection
 	}
 }
@@ -502,6 +449,8 @@ void tcp_exec_close_stub(struct finsFrame *ff, uint32_t host_ip, uint16_t host_p
 
 void tcp_exec_listen(struct finsFrame *ff, uint32_t host_ip, uint16_t host_port, uint32_t backlog) {
 	struct tcp_connection_stub *conn_stub;
+	struct tcp_cong_ops *ops;
+	char *name;
 
 	PRINT_DEBUG("Entered: addr=%u/%u, backlog=%u", host_ip, host_port, backlog);
 	if (sem_wait(&conn_stub_list_sem)) { //TODO change from conn_stub to conn in listen
@@ -512,6 +461,9 @@ void tcp_exec_listen(struct finsFrame *ff, uint32_t host_ip, uint16_t host_port,
 	if (conn_stub == NULL) {
 		if (conn_stub_list_has_space(1)) {
 			conn_stub = conn_stub_create(host_ip, host_port, backlog);
+			if (metadata_readFromElement(ff->metaData, "congestion", &name) == META_TRUE && (ops = cong_find(name))) {
+				conn_stub->cong_ops = ops; //set on the socket before listen()
+			}
 			if (conn_stub_list_insert(conn_stub)) {
 				/*#*/PRINT_DEBUG("");
 				sem_post(&conn_stub_list_sem);
@@ -567,8 +519,9 @@ void *accept_thread(void *local) { //this will need to be changed
 
 			seg = (struct tcp_segment *) node->data;
 
+			sem_t *list_sem = conn_list_sem(seg->dst_ip, seg->dst_port, seg->src_ip, seg->src_port);
 			/*#*/PRINT_DEBUG("");
-			if (sem_wait(&conn_list_sem)) {
+			if (sem_wait(list_sem)) {
 				PRINT_ERROR("conn_list_sem wait prob");
 				exit(-1);
 			}
@@ -579,7 +532,7 @@ void *accept_thread(void *local) { //this will need to be changed
 					if (conn_list_insert(conn)) {
 						conn->threads++;
 						/*#*/PRINT_DEBUG("");
-						sem_post(&conn_list_sem);
+						sem_post(list_sem);
 
 						/*#*/PRINT_DEBUG("sem_wait: conn=%p", conn);
 						if (sem_wait(&conn->sem)) {
@@ -593,6 +546,7 @@ void *accept_thread(void *local) { //this will need to be changed
 							conn->active_open = 0;
 							conn->ff = ff;
 							conn->poll_events = conn_stub->poll_events; //TODO specify more
+							conn->cong_ops = conn_stub->cong_ops;
 
 							if (flags & (1)) {
 								//TODO do specific flags/settings
@@ -626,7 +580,7 @@ void *accept_thread(void *local) { //this will need to be changed
 							seg_send(temp_seg);
 							seg_free(temp_seg);
 
-							tcp_start_timer(conn->to_gbn_fd, TCP_MSL_TO_DEFAULT);
+							tcp_start_timer(conn->to_gbn_timer->fd, TCP_MSL_TO_DEFAULT);
 							conn->to_gbn_flag = 0;
 						} else {
 							PRINT_ERROR("todo error");
@@ -634,13 +588,13 @@ void *accept_thread(void *local) { //this will need to be changed
 						}
 
 						/*#*/PRINT_DEBUG("");
-						if (sem_wait(&conn_list_sem)) {
+						if (sem_wait(list_sem)) {
 							PRINT_ERROR("conn_list_sem wait prob");
 							exit(-1);
 						}
 						conn->threads--;
 						PRINT_DEBUG("leaving thread: conn=%p, threads=%d", conn, conn->threads);
-						sem_post(&conn_list_sem);
+						sem_post(list_sem);
 
 						/*#*/PRINT_DEBUG("sem_post: conn=%p", conn);
 						sem_post(&conn->sem);
@@ -650,7 +604,7 @@ void *accept_thread(void *local) { //this will need to be changed
 						break;
 					} else {
 						PRINT_DEBUG("");
-						sem_post(&conn_list_sem);
+						sem_post(list_sem);
 
 						//error - shouldn't happen
 						PRINT_ERROR("conn_insert fail");
@@ -661,12 +615,12 @@ void *accept_thread(void *local) { //this will need to be changed
 					}
 				} else {
 					PRINT_ERROR("todo error");
-					sem_post(&conn_list_sem);
+					sem_post(list_sem);
 					//TODO throw minor error
 				}
 			} else {
 				PRINT_ERROR("todo error");
-				sem_post(&conn_list_sem);
+				sem_post(list_sem);
 				//TODO error
 			}
 
@@ -808,7 +762,7 @@ void *connect_thread(void *local) {
 			seg_free(temp_seg);
 
 			conn->timeout = TCP_GBN_TO_DEFAULT;
-			//startTimer(conn->to_gbn_fd, conn->timeout); //TODO fix
+			//startTimer(conn->to_gbn_timer->fd, conn->timeout); //TODO fix
 		} else {
 			//TODO error
 			PRINT_ERROR("todo error");
@@ -821,13 +775,13 @@ void *connect_thread(void *local) {
 	}
 
 	/*#*/PRINT_DEBUG("");
-	if (sem_wait(&conn_list_sem)) {
+	if (sem_wait(conn->list_sem)) {
 		PRINT_ERROR("conn_list_sem wait prob");
 		exit(-1);
 	}
 	conn->threads--;
 	PRINT_DEBUG("leaving thread: conn=%p, threads=%d", conn, conn->threads);
-	sem_post(&conn_list_sem);
+	sem_post(conn->list_sem);
 
 	/*#*/PRINT_DEBUG("sem_post: conn=%p", conn);
 	sem_post(&conn->sem);
@@ -837,9 +791,13 @@ void *connect_thread(void *local) {
 }
 
 void tcp_exec_connect(struct finsFrame *ff, uint32_t host_ip, uint16_t host_port, uint32_t rem_ip, uint16_t rem_port, uint32_t flags) {
+	struct tcp_cong_ops *ops;
+	char *name;
+
 	PRINT_DEBUG("Entered: host=%u/%u, rem=%u/%u", host_ip, host_port, rem_ip, rem_port);
 
-	if (sem_wait(&conn_list_sem)) {
+	sem_t *list_sem = conn_list_sem(host_ip, host_port, rem_ip, rem_port);
+	if (sem_wait(list_sem)) {
 		PRINT_ERROR("conn_list_sem wait prob");
 		exit(-1);
 	}
@@ -847,10 +805,13 @@ void tcp_exec_connect(struct finsFrame *ff, uint32_t host_ip, uint16_t host_port
 	if (conn == NULL) {
 		if (conn_list_has_space()) {
 			conn = conn_create(host_ip, host_port, rem_ip, rem_port);
+			if (metadata_readFromElement(ff->metaData, "congestion", &name) == META_TRUE && (ops = cong_find(name))) {
+				conn->cong_ops = ops; //set on the socket before connect()
+			}
 			if (conn_list_insert(conn)) {
 				conn->threads++;
 				/*#*/PRINT_DEBUG("");
-				sem_post(&conn_list_sem);
+				sem_post(list_sem);
 
 				//if listening stub remove
 				/*#*/PRINT_DEBUG("");
@@ -897,7 +858,7 @@ void tcp_exec_connect(struct finsFrame *ff, uint32_t host_ip, uint16_t host_port
 				pthread_detach(thread);
 			} else {
 				/*#*/PRINT_DEBUG("");
-				sem_post(&conn_list_sem);
+				sem_post(list_sem);
 
 				//error - shouldn't happen
 				PRINT_ERROR("conn_insert fail");
@@ -910,14 +871,14 @@ void tcp_exec_connect(struct finsFrame *ff, uint32_t host_ip, uint16_t host_port
 			}
 		} else {
 			PRINT_ERROR("todo error");
-			sem_post(&conn_list_sem);
+			sem_post(list_sem);
 
 			//TODO throw minor error, list full
 			//TODO send NACK
 		}
 	} else {
 		PRINT_ERROR("todo error");
-		sem_post(&conn_list_sem);
+		sem_post(list_sem);
 
 		//TODO error, existing connection already connected there
 		//TODO send NACK?
@@ -957,7 +918,7 @@ void *poll_thread(void *local) {
 
 		if (events & (POLLOUT | POLLWRNORM | POLLWRBAND)) {
 			if (queue_is_empty(conn->request_queue)) {
-				int space = conn->write_queue->max - conn->write_queue->len;
+				int space = conn_send_space(conn);
 				if (space > 0) {
 					mask |= POLLOUT | POLLWRNORM | POLLWRBAND;
 				} else {
@@ -991,13 +952,13 @@ void *poll_thread(void *local) {
 	}
 
 	/*#*/PRINT_DEBUG("");
-	if (sem_wait(&conn_list_sem)) {
+	if (sem_wait(conn->list_sem)) {
 		PRINT_ERROR("conn_list_sem wait prob");
 		exit(-1);
 	}
 	conn->threads--;
 	PRINT_DEBUG("leaving thread: conn=%p, threads=%d", conn, conn->threads);
-	sem_post(&conn_list_sem);
+	sem_post(conn->list_sem);
 
 	/*#*/PRINT_DEBUG("sem_post: conn=%p", conn);
 	sem_post(&conn->sem);
@@ -1088,7 +1049,8 @@ void tcp_exec_poll(struct finsFrame *ff, socket_state state, uint32_t host_ip, u
 
 	if (state > SS_UNCONNECTED) {
 		PRINT_DEBUG("Entered: state=%u, host=%u/%u, rem=%u/%u, initial=%u, events=0x%x", state, host_ip, host_port, rem_ip, rem_port, initial, flags);
-		if (sem_wait(&conn_list_sem)) {
+		sem_t *list_sem = conn_list_sem(host_ip, host_port, rem_ip, rem_port);
+		if (sem_wait(list_sem)) {
 			PRINT_ERROR("conn_list_sem wait prob");
 			exit(-1);
 		}
@@ -1096,7 +1058,7 @@ void tcp_exec_poll(struct finsFrame *ff, socket_state state, uint32_t host_ip, u
 		if (conn) {
 			start = (conn->threads < TCP_THREADS_MAX) ? ++conn->threads : 0;
 			/*#*/PRINT_DEBUG("");
-			sem_post(&conn_list_sem);
+			sem_post(list_sem);
 
 			if (start) {
 				thread_data = (struct tcp_thread_data *) malloc(sizeof(struct tcp_thread_data));
@@ -1117,7 +1079,7 @@ void tcp_exec_poll(struct finsFrame *ff, socket_state state, uint32_t host_ip, u
 			}
 		} else {
 			PRINT_ERROR("todo error");
-			sem_post(&conn_list_sem);
+			sem_post(list_sem);
 			//TODO error
 
 			tcp_reply_fcf(ff, 1, POLLERR); //TODO check on value?
@@ -1242,13 +1204,13 @@ void *read_param_conn_thread(void *local) {
 	}
 
 	/*#*/PRINT_DEBUG("");
-	if (sem_wait(&conn_list_sem)) {
+	if (sem_wait(conn->list_sem)) {
 		PRINT_ERROR("conn_list_sem wait prob");
 		exit(-1);
 	}
 	conn->threads--;
 	PRINT_DEBUG("leaving thread: conn=%p, threads=%d", conn, conn->threads);
-	sem_post(&conn_list_sem);
+	sem_post(conn->list_sem);
 
 	/*#*/PRINT_DEBUG("sem_post: conn=%p", conn);
 	sem_post(&conn->sem);
@@ -1383,7 +1345,8 @@ void tcp_read_param(struct finsFrame *ff) {
 	if (metadata_read_conn(params, &state, &host_ip, &host_port, &rem_ip, &rem_port)) {
 		if (state > SS_UNCONNECTED) {
 			PRINT_DEBUG("searching: host=%u/%u, rem=%u/%u", host_ip, host_port, rem_ip, rem_port);
-			if (sem_wait(&conn_list_sem)) {
+			sem_t *list_sem = conn_list_sem(host_ip, host_port, rem_ip, rem_port);
+			if (sem_wait(list_sem)) {
 				PRINT_ERROR("conn_list_sem wait prob");
 				exit(-1);
 			}
@@ -1391,7 +1354,7 @@ void tcp_read_param(struct finsFrame *ff) {
 			if (conn) {
 				start = (conn->threads < TCP_THREADS_MAX) ? ++conn->threads : 0;
 				/*#*/PRINT_DEBUG("");
-				sem_post(&conn_list_sem);
+				sem_post(list_sem);
 
 				if (start) {
 					thread_data = (struct tcp_thread_data *) malloc(sizeof(struct tcp_thread_data));
@@ -1409,7 +1372,7 @@ void tcp_read_param(struct finsFrame *ff) {
 				}
 			} else {
 				PRINT_ERROR("todo error");
-				sem_post(&conn_list_sem);
+				sem_post(list_sem);
 
 				//TODO error
 			}
@@ -1464,6 +1427,8 @@ void *set_param_conn_thread(void *local) {
 
 	uint32_t ret_val;
 	uint32_t value;
+	char *name;
+	struct tcp_cong_ops *ops;
 
 	metadata *params = ff->metaData;
 
@@ -1522,6 +1487,22 @@ void *set_param_conn_thread(void *local) {
 			ff->ctrlFrame.opcode = CTRL_SET_PARAM_REPLY;
 			ff->ctrlFrame.ret_val = ret_val;
 
+			tcp_to_switch(ff);
+			break;
+		case SET_PARAM_TCP_CONGESTION:
+			PRINT_DEBUG("param_id=SET_PARAM_TCP_CONGESTION (%d)", ff->ctrlFrame.param_id);
+			ret = metadata_readFromElement(params, "congestion", &name) == META_FALSE; //not "value", SO_REUSEADDR shares the param_id
+			if (ret || (ops = cong_find(name)) == NULL) {
+				PRINT_ERROR("ret=%d, name='%s'", ret, ret ? "" : name);
+				ret_val = 0;
+			} else {
+				cong_set(conn, ops);
+				ret_val = 1;
+			}
+
+			ff->ctrlFrame.opcode = CTRL_SET_PARAM_REPLY;
+			ff->ctrlFrame.ret_val = ret_val;
+
 			tcp_to_switch(ff);
 			break;
 		default:
@@ -1544,13 +1525,13 @@ void *set_param_conn_thread(void *local) {
 	}
 
 	/*#*/PRINT_DEBUG("");
-	if (sem_wait(&conn_list_sem)) {
+	if (sem_wait(conn->list_sem)) {
 		PRINT_ERROR("conn_list_sem wait prob");
 		exit(-1);
 	}
 	conn->threads--;
 	PRINT_DEBUG("leaving thread: conn=%p, threads=%d", conn, conn->threads);
-	sem_post(&conn_list_sem);
+	sem_post(conn->list_sem);
 
 	/*#*/PRINT_DEBUG("sem_post: conn=%p", conn);
 	sem_post(&conn->sem);
@@ -1571,6 +1552,8 @@ void *set_param_conn_stub_thread(void *local) {
 
 	uint32_t ret_val;
 	uint32_t value;
+	char *name;
+	struct tcp_cong_ops *ops;
 
 	int ret = 0;
 	metadata *params = ff->metaData;
@@ -1630,6 +1613,22 @@ void *set_param_conn_stub_thread(void *local) {
 			ff->ctrlFrame.opcode = CTRL_SET_PARAM_REPLY;
 			ff->ctrlFrame.ret_val = ret_val;
 
+			tcp_to_switch(ff);
+			break;
+		case SET_PARAM_TCP_CONGESTION:
+			PRINT_DEBUG("param_id=SET_PARAM_TCP_CONGESTION (%d)", ff->ctrlFrame.param_id);
+			ret = metadata_readFromElement(params, "congestion", &name) == META_FALSE; //not "value", SO_REUSEADDR shares the param_id
+			if (ret || (ops = cong_find(name)) == NULL) {
+				PRINT_ERROR("ret=%d, name='%s'", ret, ret ? "" : name);
+				ret_val = 0;
+			} else {
+				conn_stub->cong_ops = ops; //the conns it accepts start with it
+				ret_val = 1;
+			}
+
+			ff->ctrlFrame.opcode = CTRL_SET_PARAM_REPLY;
+			ff->ctrlFrame.ret_val = ret_val;
+
 			tcp_to_switch(ff);
 			break;
 		default:
@@ -1685,7 +1684,8 @@ void tcp_set_param(struct finsFrame *ff) {
 		if (metadata_read_conn(params, &state, &host_ip, &host_port, &rem_ip, &rem_port)) {
 			if (state > SS_UNCONNECTED) {
 				PRINT_DEBUG("searching: host=%u/%u, rem=%u/%u", host_ip, host_port, rem_ip, rem_port);
-				if (sem_wait(&conn_list_sem)) {
+				sem_t *list_sem = conn_list_sem(host_ip, host_port, rem_ip, rem_port);
+				if (sem_wait(list_sem)) {
 					PRINT_ERROR("conn_list_sem wait prob");
 					exit(-1);
 				}
@@ -1693,7 +1693,7 @@ void tcp_set_param(struct finsFrame *ff) {
 				if (conn) {
 					start = (conn->threads < TCP_THREADS_MAX) ? ++conn->threads : 0;
 					/*#*/PRINT_DEBUG("");
-					sem_post(&conn_list_sem);
+					sem_post(list_sem);
 
 					if (start) {
 						thread_data = (struct tcp_thread_data *) malloc(sizeof(struct tcp_thread_data));
@@ -1712,7 +1712,7 @@ void tcp_set_param(struct finsFrame *ff) {
 					}
 				} else {
 					PRINT_ERROR("todo error");
-					sem_post(&conn_list_sem);
+					sem_post(list_sem);
 
 					//TODO error
 
@@ -0,0 +1,192 @@
+/*
+ * @file tcp_sack.c
+ * @date Oct 18, 2026
+ * @brief selective ACKs, see RFC 2018 & RFC 6675. As the receiver, the holes in recv_queue are reported as
+ * SACK blocks. As the sender, the blocks the rem reports mark the send_queue nodes it already has, so during
+ * recovery only the nodes judged lost are resent and the bytes in flight (pipe) leave SACKed data out.
+ */
+
+#include "tcp.h"
+
+#define SEQ_LT(a, b) ((int32_t) ((a) - (b)) < 0)
+#define SEQ_LEQ(a, b) ((int32_t) ((a) - (b)) <= 0)
+
+int sack_blocks(struct tcp_connection *conn, uint32_t *blocks, int max) {
+	struct tcp_node *node;
+	uint32_t left;
+	uint32_t right;
+	uint8_t recent = 0;
+	int n = 0;
+	int i;
+
+	//recv_queue is in seq order, nodes that touch or overlap merge into a block, whose right edge is 1+last byte
+	node = conn->recv_queue->front;
+	while (node) {
+		if (node->len == 0) {
+			node = node->next; //FIN only
+			continue;
+		}
+		left = node->seq_num;
+		right = node->seq_num + node->len;
+		node = node->next;
+		while (node && SEQ_LEQ(node->seq_num, right)) {
+			if (SEQ_LT(right, node->seq_num + node->len)) {
+				right = node->seq_num + node->len;
+			}
+			node = node->next;
+		}
+
+		//the block holding the latest out of order seg goes first, the rest follow in seq order
+		if (SEQ_LEQ(left, conn->sack_recent) && SEQ_LT(conn->sack_recent, right)) {
+			if (n == max) {
+				n--;
+			}
+			for (i = n; i > 0; i--) {
+				blocks[2 * i] = blocks[2 * (i - 1)];
+				blocks[2 * i + 1] = blocks[2 * (i - 1) + 1];
+			}
+			blocks[0] = left;
+			blocks[1] = right;
+			n++;
+			recent = 1;
+		} else if (n < max) {
+			blocks[2 * n] = left;
+			blocks[2 * n + 1] = right;
+			n++;
+		} else if (recent) {
+			break;
+		}
+	}
+
+	return n;
+}
+
+void sack_recv(struct tcp_connection *conn, struct tcp_segment *seg) {
+	uint8_t *pt = seg->options;
+	int i = 0;
+	uint8_t kind;
+	uint8_t len;
+	uint32_t left;
+	uint32_t right;
+	struct tcp_node *node;
+	int j;
+
+	while (i < seg->opt_len) {
+		kind = pt[i++];
+		if (kind == TCP_OPT_EOL) {
+			break;
+		} else if (kind == TCP_OPT_NOP) {
+			continue;
+		}
+		if (i >= seg->opt_len) {
+			break;
+		}
+		len = pt[i++];
+		if (len < 2 || i + len - 2 > seg->opt_len) {
+			PRINT_ERROR("option len prob: conn=%p, kind=%u, len=%u", conn, kind, len);
+			break;
+		}
+
+		if (kind == TCP_OPT_SACK && TCP_OPT_SACK_MIN_BYTES < len && len <= TCP_OPT_SACK_MAX_BYTES) {
+			for (j = 0; j < TCP_OPT_SACK_LEN(len); j++) {
+				left = ntohl(*(uint32_t *) (pt + i + 8 * j));
+				right = ntohl(*(uint32_t *) (pt + i + 8 * j + 4));
+				PRINT_DEBUG("SACK block: conn=%p, (%u, %u)", conn, left-conn->issn, right-conn->issn);
+
+				//drop D-SACKs & anything outside of what is unACKed
+				if (!SEQ_LT(left, right) || SEQ_LEQ(left, seg->ack_num) || SEQ_LT(conn->send_seq_end, right)) {
+					continue;
+				}
+
+				for (node = conn->send_queue->front; node; node = node->next) {
+					if (SEQ_LEQ(right, node->seq_num)) {
+						break;
+					}
+					if (SEQ_LEQ(left, node->seq_num) && SEQ_LEQ(node->seq_num + node->len, right)) {
+						node->sacked = 1;
+					}
+				}
+			}
+		}
+		i += len - 2;
+	}
+}
+
+struct tcp_node *sack_scan(struct tcp_connection *conn, uint32_t *pipe) {
+	struct tcp_node *node;
+	struct tcp_node *lost = NULL;
+	uint32_t sacked = 0;
+	uint32_t sacked_bytes = 0;
+	uint32_t flight = 0;
+
+	for (node = conn->send_queue->front; node; node = node->next) {
+		if (node->sacked) {
+			sacked++;
+			sacked_bytes += node->len;
+		}
+	}
+
+	//IsLost(): DupThresh SACKed segs or more than (DupThresh-1)*MSS SACKed bytes above it
+	for (node = conn->send_queue->front; node; node = node->next) {
+		if (node->sacked) {
+			sacked--;
+			sacked_bytes -= node->len;
+			continue;
+		}
+		if (sacked >= TCP_SACK_DUP_THRESH || sacked_bytes > (TCP_SACK_DUP_THRESH - 1) * (uint32_t) conn->MSS) {
+			if (lost == NULL && !node->retrans) {
+				lost = node;
+			}
+		} else {
+			flight += node->len;
+		}
+		if (node->retrans) {
+			flight += node->len;
+		}
+	}
+
+	if (pipe) {
+		*pipe = flight;
+	}
+	return lost;
+}
+
+void sack_recovery(struct tcp_connection *conn) {
+	struct tcp_node *node;
+	uint32_t flight_size = conn->send_seq_end - conn->send_seq_num;
+
+	PRINT_DEBUG("Entered: conn=%p, flight=%u", conn, flight_size);
+
+	conn->sack_recover = conn->send_seq_end;
+
+	cong_loss(conn);
+	conn->cong_window = conn->threshhold;
+
+	for (node = conn->send_queue->front; node; node = node->next) {
+		node->retrans = 0;
+	}
+}
+
+int sack_retransmit(struct tcp_connection *conn) {
+	struct tcp_node *node;
+	uint32_t pipe;
+
+	node = sack_scan(conn, &pipe);
+	if (node == NULL || conn->cong_window - (double) pipe < (double) conn->MSS) {
+		return 0;
+	}
+
+	PRINT_DEBUG("resending: conn=%p, seqs=(%u, %u), pipe=%u, cong=%f", conn, node->seq_num-conn->issn, node->seq_num+node->len-conn->issn, pipe, conn->cong_window);
+	conn_send_node(conn, node, FLAG_ACK);
+	node->retrans = 1;
+
+	uint32_decrease(&conn->send_win, node->len);
+	return 1;
+}
+
+uint32_t sack_pipe(struct tcp_connection *conn) {
+	uint32_t pipe;
+
+	sack_scan(conn, &pipe);
+	return pipe;
+}
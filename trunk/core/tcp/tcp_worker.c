@@ -0,0 +1,374 @@
+/*
+ * @file tcp_worker.c
+ * @date Oct 18, 2026
+ * @brief the threads TCP runs on, see tcp.h. Each worker waits in epoll on the timers of its conns and on
+ * an eventfd written when its queue of segments & conns to run stops being empty. Conns and timers that are
+ * done with are freed at the end of a round, as events taken in that round may still point at them.
+ */
+
+#include "tcp.h"
+
+static struct tcp_worker tcp_workers[TCP_WORKERS];
+
+struct tcp_worker *tcp_worker_get(uint32_t hash) {
+	return &tcp_workers[hash & (TCP_WORKERS - 1)];
+}
+
+//must hold worker->sem
+static void tcp_worker_append(struct tcp_worker *worker, struct tcp_connection *conn, struct tcp_segment *seg) {
+	struct tcp_work *work = (struct tcp_work *) malloc(sizeof(struct tcp_work));
+	if (work == NULL) {
+		PRINT_ERROR("alloc error");
+		exit(-1);
+	}
+	work->next = NULL;
+	work->conn = conn;
+	work->seg = seg;
+
+	if (worker->end) {
+		worker->end->next = work;
+	} else {
+		worker->front = work;
+
+		uint64_t one = 1;
+		if (write(worker->event_fd, &one, sizeof(uint64_t)) != sizeof(uint64_t)) {
+			PRINT_ERROR("event_fd write prob: worker=%u", worker->id);
+			exit(-1);
+		}
+	}
+	worker->end = work;
+}
+
+/**@brief hands a segment to the worker of its conn, the caller has taken a conn->threads for it */
+void tcp_worker_recv(struct tcp_connection *conn, struct tcp_segment *seg) {
+	struct tcp_worker *worker = conn->worker;
+
+	PRINT_DEBUG("Entered: conn=%p, seg=%p, worker=%u", conn, seg, worker->id);
+
+	if (sem_wait(&worker->sem)) {
+		PRINT_ERROR("worker->sem wait prob");
+		exit(-1);
+	}
+	tcp_worker_append(worker, conn, seg);
+	sem_post(&worker->sem);
+}
+
+/**@brief has the conn's worker run conn_main(), where main_wait_sem used to be posted. Queues the conn once
+ * however many times it is called before the worker gets to it
+ * */
+void conn_wake(struct tcp_connection *conn) {
+	struct tcp_worker *worker = conn->worker;
+
+	PRINT_DEBUG("Entered: conn=%p, worker=%u", conn, worker->id);
+
+	if (sem_wait(&worker->sem)) {
+		PRINT_ERROR("worker->sem wait prob");
+		exit(-1);
+	}
+	if (!conn->wake_queued) {
+		conn->wake_queued = 1;
+		tcp_worker_append(worker, conn, NULL);
+	}
+	sem_post(&worker->sem);
+}
+
+/**@brief frees a stopped conn at the end of the worker's round */
+void tcp_worker_free(struct tcp_connection *conn) {
+	struct tcp_worker *worker = conn->worker;
+
+	if (sem_wait(&worker->sem)) {
+		PRINT_ERROR("worker->sem wait prob");
+		exit(-1);
+	}
+	conn->next = worker->dead_conns;
+	worker->dead_conns = conn;
+	sem_post(&worker->sem);
+}
+
+struct tcp_timer *tcp_timer_open(struct tcp_connection *conn, uint8_t *flag, uint8_t *interrupt) {
+	struct tcp_timer *timer = (struct tcp_timer *) malloc(sizeof(struct tcp_timer));
+	if (timer == NULL) {
+		PRINT_ERROR("alloc error");
+		exit(-1);
+	}
+
+	timer->fd = timerfd_create(CLOCK_REALTIME, TFD_NONBLOCK);
+	if (timer->fd == -1) {
+		PRINT_ERROR("ERROR: unable to create to_fd.");
+		exit(-1);
+	}
+	timer->conn = conn;
+	timer->flag = flag;
+	timer->interrupt = interrupt;
+	timer->next = NULL;
+
+	struct epoll_event event;
+	event.events = EPOLLIN;
+	event.data.ptr = timer;
+	if (epoll_ctl(conn->worker->epoll_fd, EPOLL_CTL_ADD, timer->fd, &event)) {
+		PRINT_ERROR("epoll_ctl prob: conn=%p, fd=%d, errno=%d", conn, timer->fd, errno);
+		exit(-1);
+	}
+
+	PRINT_DEBUG("Exited: conn=%p, fd=%d, worker=%u", conn, timer->fd, conn->worker->id);
+	return timer;
+}
+
+/**@brief stops a timer for good, must hold timer->conn->sem */
+void tcp_timer_close(struct tcp_timer *timer) {
+	struct tcp_worker *worker = timer->conn->worker;
+
+	PRINT_DEBUG("Entered: conn=%p, fd=%d", timer->conn, timer->fd);
+
+	epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, timer->fd, NULL);
+	close(timer->fd);
+	timer->fd = -1;
+
+	if (sem_wait(&worker->sem)) {
+		PRINT_ERROR("worker->sem wait prob");
+		exit(-1);
+	}
+	timer->next = worker->dead_timers;
+	worker->dead_timers = timer;
+	sem_post(&worker->sem);
+}
+
+static void tcp_timer_fire(struct tcp_timer *timer) {
+	struct tcp_connection *conn = timer->conn;
+	uint64_t exp;
+
+	if (timer->fd == -1) {
+		//closed earlier in the round, maybe with its conn
+		return;
+	}
+
+	/*#*/PRINT_DEBUG("sem_wait: conn=%p", conn);
+	if (sem_wait(&conn->sem)) {
+		PRINT_ERROR("conn->sem wait prob");
+		exit(-1);
+	}
+	if (timer->fd == -1 || read(timer->fd, &exp, sizeof(uint64_t)) != sizeof(uint64_t)) {
+		//closed by an exec thread, or set again since it went off
+		/*#*/PRINT_DEBUG("sem_post: conn=%p", conn);
+		sem_post(&conn->sem);
+		return;
+	}
+
+	PRINT_DEBUG("throwing flag: conn=%p, fd=%d", conn, timer->fd);
+	if (timer->interrupt) {
+		*timer->interrupt = 1;
+	}
+	*timer->flag = 1;
+	conn_main(conn);
+}
+
+static void tcp_worker_seg(struct tcp_connection *conn, struct tcp_segment *seg) {
+	/*#*/PRINT_DEBUG("sem_wait: conn=%p", conn);
+	if (sem_wait(&conn->sem)) {
+		PRINT_ERROR("conn->sem wait prob");
+		exit(-1);
+	}
+	conn_recv(conn, seg);
+
+	/*#*/PRINT_DEBUG("");
+	if (sem_wait(conn->list_sem)) {
+		PRINT_ERROR("conn_list_sem wait prob");
+		exit(-1);
+	}
+	conn->threads--;
+	PRINT_DEBUG("leaving thread: conn=%p, threads=%d", conn, conn->threads);
+	sem_post(conn->list_sem);
+
+	if (conn->running_flag) {
+		/*#*/PRINT_DEBUG("sem_post: conn=%p", conn);
+		sem_post(&conn->sem);
+	} else {
+		conn_main(conn); //finishes stopping it, if the segment was all that held it
+	}
+}
+
+static void *tcp_worker_thread(void *local) {
+	struct tcp_worker *worker = (struct tcp_worker *) local;
+	struct epoll_event events[TCP_WORKER_EVENTS];
+	struct tcp_work *work;
+	struct tcp_work *next_work;
+	struct tcp_connection *conn;
+	struct tcp_connection *next_conn;
+	struct tcp_timer *timer;
+	struct tcp_timer *next_timer;
+	uint64_t count;
+	int ret;
+	int i;
+
+	PRINT_DEBUG("Entered: worker=%u", worker->id);
+
+	while (worker->running) {
+		ret = epoll_wait(worker->epoll_fd, events, TCP_WORKER_EVENTS, -1);
+		if (ret == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			PRINT_ERROR("epoll_wait prob: worker=%u, errno=%d", worker->id, errno);
+			exit(-1);
+		}
+
+		for (i = 0; i < ret; i++) {
+			if (events[i].data.ptr == NULL) {
+				if (read(worker->event_fd, &count, sizeof(uint64_t)) != sizeof(uint64_t)) {
+					PRINT_DEBUG("event_fd already read: worker=%u", worker->id);
+				}
+			} else {
+				tcp_timer_fire((struct tcp_timer *) events[i].data.ptr);
+			}
+		}
+
+		//segments & conns to run, in the order they came in
+		if (sem_wait(&worker->sem)) {
+			PRINT_ERROR("worker->sem wait prob");
+			exit(-1);
+		}
+		work = worker->front;
+		worker->front = NULL;
+		worker->end = NULL;
+		sem_post(&worker->sem);
+
+		while (work) {
+			next_work = work->next;
+			conn = work->conn;
+			if (work->seg) {
+				tcp_worker_seg(conn, work->seg);
+			} else {
+				if (sem_wait(&worker->sem)) {
+					PRINT_ERROR("worker->sem wait prob");
+					exit(-1);
+				}
+				conn->wake_queued = 0;
+				sem_post(&worker->sem);
+
+				/*#*/PRINT_DEBUG("sem_wait: conn=%p", conn);
+				if (sem_wait(&conn->sem)) {
+					PRINT_ERROR("conn->sem wait prob");
+					exit(-1);
+				}
+				conn_main(conn);
+			}
+			free(work);
+			work = next_work;
+		}
+
+		//nothing from this round points at them anymore
+		if (sem_wait(&worker->sem)) {
+			PRINT_ERROR("worker->sem wait prob");
+			exit(-1);
+		}
+		conn = worker->dead_conns;
+		worker->dead_conns = NULL;
+		timer = worker->dead_timers;
+		worker->dead_timers = NULL;
+		sem_post(&worker->sem);
+
+		while (conn) {
+			next_conn = conn->next;
+			free(conn);
+			conn = next_conn;
+		}
+		while (timer) {
+			next_timer = timer->next;
+			free(timer);
+			timer = next_timer;
+		}
+	}
+
+	PRINT_DEBUG("Exited: worker=%u", worker->id);
+	pthread_exit(NULL);
+}
+
+void tcp_workers_init(void) {
+	struct tcp_worker *worker;
+	struct epoll_event event;
+	int i;
+
+	PRINT_DEBUG("Entered");
+
+	for (i = 0; i < TCP_WORKERS; i++) {
+		worker = &tcp_workers[i];
+		worker->id = i;
+		worker->running = 1;
+		sem_init(&worker->sem, 0, 1);
+		worker->front = NULL;
+		worker->end = NULL;
+		worker->dead_conns = NULL;
+		worker->dead_timers = NULL;
+
+		worker->epoll_fd = epoll_create1(0);
+		worker->event_fd = eventfd(0, EFD_NONBLOCK);
+		if (worker->epoll_fd == -1 || worker->event_fd == -1) {
+			PRINT_ERROR("unable to create fds: worker=%u, errno=%d", worker->id, errno);
+			exit(-1);
+		}
+
+		event.events = EPOLLIN;
+		event.data.ptr = NULL;
+		if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->event_fd, &event)) {
+			PRINT_ERROR("epoll_ctl prob: worker=%u, errno=%d", worker->id, errno);
+			exit(-1);
+		}
+	}
+}
+
+void tcp_workers_run(pthread_attr_t *fins_pthread_attr) {
+	int i;
+
+	PRINT_DEBUG("Entered");
+
+	for (i = 0; i < TCP_WORKERS; i++) {
+		if (pthread_create(&tcp_workers[i].thread, fins_pthread_attr, tcp_worker_thread, (void *) &tcp_workers[i])) {
+			PRINT_ERROR("ERROR: unable to create tcp_worker_thread thread.");
+			exit(-1);
+		}
+	}
+}
+
+void tcp_workers_shutdown(void) {
+	uint64_t one = 1;
+	int i;
+
+	PRINT_DEBUG("Entered");
+
+	for (i = 0; i < TCP_WORKERS; i++) {
+		tcp_workers[i].running = 0;
+		if (write(tcp_workers[i].event_fd, &one, sizeof(uint64_t)) != sizeof(uint64_t)) {
+			PRINT_ERROR("event_fd write prob: worker=%u", i);
+		}
+	}
+
+	for (i = 0; i < TCP_WORKERS; i++) {
+		PRINT_DEBUG("Joining tcp_worker_thread: worker=%u", i);
+		pthread_join(tcp_workers[i].thread, NULL);
+	}
+}
+
+void tcp_workers_release(void) {
+	struct tcp_worker *worker;
+	struct tcp_work *work;
+	int i;
+
+	PRINT_DEBUG("Entered");
+
+	for (i = 0; i < TCP_WORKERS; i++) {
+		worker = &tcp_workers[i];
+		while (worker->front) {
+			work = worker->front;
+			worker->front = work->next;
+			if (work->seg) {
+				seg_free(work->seg);
+			}
+			free(work);
+		}
+		worker->end = NULL;
+
+		close(worker->event_fd);
+		close(worker->epoll_fd);
+		sem_destroy(&worker->sem);
+	}
+}
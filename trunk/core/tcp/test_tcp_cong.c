@@ -0,0 +1,313 @@
+/**@file test_tcp_cong.c
+ *@brief runs a bulk transfer between two conns through an emulated bottleneck, once for each congestion control
+ * in tcp_cong.c. Data segs wait in a drop-tail queue drained at the link rate, then take the one way delay, while
+ * ACKs only take the delay. Goodput, the queueing delay data saw & the drops are compared. Results go to stderr,
+ * so run as ./test_tcp_cong [Mbit/s] [queue KB] [loss %] [bytes] > /dev/null to drop the debug output.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <queueModule.h>
+#include "tcp.h"
+
+#define TEST_HOST_IP 0x0a000001
+#define TEST_REM_IP 0x0a000002
+#define TEST_DELAY_NS 10000000ull //one way
+#define TEST_LINK_MAX 4096 //segments on a link
+#define TEST_CHUNK 16384 //bytes per sendmsg
+#define TEST_CHUNKS 4 //sendmsgs outstanding
+#define TEST_LIMIT_NS 120000000000ull
+
+struct finsEvent Switch_Event;
+
+extern finsRing TCP_to_Switch_Queue;
+extern sem_t TCP_to_Switch_Qsem;
+
+/** one direction, segments come out in order at when */
+struct test_link {
+	struct finsFrame *ff[TEST_LINK_MAX];
+	uint64_t when[TEST_LINK_MAX];
+	uint32_t head;
+	uint32_t tail;
+};
+
+struct test_result {
+	double goodput; //Mbit/s, 0 if the transfer failed
+	double queue_ms; //mean delay data waited in the bottleneck
+	uint32_t segs;
+	uint32_t drops;
+};
+
+uint64_t test_now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/** a conn that skipped the handshake, using ops */
+struct tcp_connection *test_conn(uint32_t host_ip, uint16_t host_port, uint32_t rem_ip, uint16_t rem_port, uint32_t issn, uint32_t irsn,
+		struct tcp_cong_ops *ops) {
+	struct tcp_connection *conn = conn_create(host_ip, host_port, rem_ip, rem_port);
+
+	conn->state = TS_ESTABLISHED;
+	conn->issn = issn;
+	conn->send_seq_num = issn;
+	conn->send_seq_end = issn;
+	conn->irsn = irsn;
+	conn->recv_seq_num = irsn;
+	conn->recv_seq_end = irsn + conn->recv_max_win;
+	conn->sack_enabled = 1;
+	conn->first_flag = 1;
+	conn->cong_ops = ops;
+	cong_init(conn);
+
+	sem_wait(conn->list_sem);
+	conn_list_insert(conn);
+	sem_post(conn->list_sem);
+	return conn;
+}
+
+void test_link_put(struct test_link *link, struct finsFrame *ff, uint64_t when) {
+	uint32_t protocol = IPPROTO_TCP;
+	uint32_t src_ip;
+	uint32_t dst_ip;
+	metadata *params;
+
+	metadata_readFromElement(ff->metaData, "send_src_ip", &src_ip);
+	metadata_readFromElement(ff->metaData, "send_dst_ip", &dst_ip);
+	metadata_destroy(ff->metaData);
+	params = (metadata *) malloc(sizeof(metadata));
+	metadata_create(params);
+	metadata_writeToElement(params, "recv_protocol", &protocol, META_TYPE_INT32);
+	metadata_writeToElement(params, "recv_src_ip", &src_ip, META_TYPE_INT32);
+	metadata_writeToElement(params, "recv_dst_ip", &dst_ip, META_TYPE_INT32);
+	ff->metaData = params;
+	ff->dataFrame.directionFlag = UP;
+
+	link->ff[link->head % TEST_LINK_MAX] = ff;
+	link->when[link->head++ % TEST_LINK_MAX] = when;
+}
+
+void test_link_run(struct test_link *link, uint64_t now) {
+	while (link->tail != link->head && link->when[link->tail % TEST_LINK_MAX] <= now) {
+		tcp_in_fdf(link->ff[link->tail++ % TEST_LINK_MAX]);
+	}
+}
+
+void test_link_free(struct test_link *link) {
+	while (link->tail != link->head) {
+		freeFinsFrame(link->ff[link->tail++ % TEST_LINK_MAX]);
+	}
+	free(link);
+}
+
+/** sends bytes from host to rem through a bottleneck of rate bytes/sec with a queue of limit bytes */
+struct test_result test_transfer(uint16_t port, struct tcp_cong_ops *ops, double rate, uint32_t limit, int loss, uint32_t bytes) {
+	struct test_link *fwd = (struct test_link *) calloc(1, sizeof(struct test_link));
+	struct test_link *rev = (struct test_link *) calloc(1, sizeof(struct test_link));
+	struct test_result result;
+	struct tcp_connection *host;
+	struct tcp_connection *rem;
+	struct finsFrame *ff;
+	metadata *params;
+	uint32_t src_ip, src_port, serial_num = 0, flags = 0, value, state = SS_CONNECTED, len;
+	uint32_t host_port = port, rem_port = port + 1;
+	uint32_t sent = 0, acked = 0, recv = 0, i;
+	uint64_t start, now, depart = 0, wait;
+	double queued_ns = 0;
+	int bad = 0;
+
+	memset(&result, 0, sizeof(struct test_result));
+	host = test_conn(TEST_HOST_IP, host_port, TEST_REM_IP, rem_port, 1000, 5000, ops);
+	rem = test_conn(TEST_REM_IP, rem_port, TEST_HOST_IP, host_port, 5000, 1000, ops);
+
+	start = test_now_ns();
+	while (recv < bytes && !bad) {
+		now = test_now_ns();
+		if (now - start > TEST_LIMIT_NS) {
+			fprintf(stderr, "%s: timed out at %u of %u bytes\n", ops->name, recv, bytes);
+			bad++;
+			break;
+		}
+
+		//the app, keeps a few sendmsgs going
+		if (sent < bytes && sent - acked < TEST_CHUNKS * TEST_CHUNK) {
+			len = bytes - sent < TEST_CHUNK ? bytes - sent : TEST_CHUNK;
+			params = (metadata *) malloc(sizeof(metadata));
+			metadata_create(params);
+			metadata_writeToElement(params, "flags", &flags, META_TYPE_INT32);
+			metadata_writeToElement(params, "serial_num", &serial_num, META_TYPE_INT32);
+			metadata_writeToElement(params, "host_ip", &host->host_ip, META_TYPE_INT32);
+			metadata_writeToElement(params, "host_port", &host_port, META_TYPE_INT32);
+			metadata_writeToElement(params, "rem_ip", &host->rem_ip, META_TYPE_INT32);
+			metadata_writeToElement(params, "rem_port", &rem_port, META_TYPE_INT32);
+
+			ff = (struct finsFrame *) malloc(sizeof(struct finsFrame));
+			ff->dataOrCtrl = DATA;
+			ff->destinationID.id = TCP_ID;
+			ff->destinationID.next = NULL;
+			ff->metaData = params;
+			ff->dataFrame.directionFlag = DOWN;
+			ff->dataFrame.pduLength = len;
+			ff->dataFrame.pdu = (uint8_t *) malloc(len);
+			for (i = 0; i < len; i++) {
+				ff->dataFrame.pdu[i] = (uint8_t) ((sent + i) * 7);
+			}
+			tcp_out_fdf(ff);
+			sent += len;
+			serial_num++;
+		}
+
+		test_link_run(fwd, now);
+		test_link_run(rev, now);
+
+		ff = read_ring(TCP_to_Switch_Queue);
+		if (ff == NULL) {
+			usleep(20);
+			continue;
+		}
+
+		src_port = 0;
+		if (ff->dataOrCtrl == CONTROL) {
+			metadata_readFromElement(ff->metaData, "host_port", &src_port);
+			if (src_port == host_port && ff->ctrlFrame.opcode == CTRL_EXEC_REPLY && ff->ctrlFrame.param_id == EXEC_TCP_SEND && ff->ctrlFrame.ret_val) {
+				acked += TEST_CHUNK;
+			}
+			freeFinsFrame(ff);
+			continue;
+		}
+
+		//the conns of earlier runs are left up, drop what they still send
+		if (ff->dataFrame.directionFlag == UP) {
+			metadata_readFromElement(ff->metaData, "recv_src_port", &src_port);
+		} else {
+			metadata_readFromElement(ff->metaData, "send_src_port", &src_port);
+		}
+		if (src_port != host_port && src_port != rem_port) {
+			freeFinsFrame(ff);
+			continue;
+		}
+
+		if (ff->dataFrame.directionFlag == UP) {
+			//the rem's daemon, check the bytes come in order
+			for (i = 0; i < ff->dataFrame.pduLength; i++) {
+				if (ff->dataFrame.pdu[i] != (uint8_t) ((recv + i) * 7)) {
+					fprintf(stderr, "%s: byte %u wrong\n", ops->name, recv + i);
+					bad++;
+					break;
+				}
+			}
+			recv += ff->dataFrame.pduLength;
+
+			//read right away, the window opens back up as the daemon's would
+			value = ff->dataFrame.pduLength;
+			metadata_destroy(ff->metaData);
+			params = (metadata *) malloc(sizeof(metadata));
+			metadata_create(params);
+			metadata_writeToElement(params, "value", &value, META_TYPE_INT32);
+			metadata_writeToElement(params, "state", &state, META_TYPE_INT32);
+			metadata_writeToElement(params, "host_ip", &rem->host_ip, META_TYPE_INT32);
+			metadata_writeToElement(params, "host_port", &rem_port, META_TYPE_INT32);
+			metadata_writeToElement(params, "rem_ip", &rem->rem_ip, META_TYPE_INT32);
+			metadata_writeToElement(params, "rem_port", &host_port, META_TYPE_INT32);
+
+			free(ff->dataFrame.pdu);
+			ff->dataOrCtrl = CONTROL;
+			ff->destinationID.id = TCP_ID;
+			ff->metaData = params;
+			ff->ctrlFrame.senderID = DAEMON_ID;
+			ff->ctrlFrame.serial_num = serial_num++;
+			ff->ctrlFrame.opcode = CTRL_SET_PARAM;
+			ff->ctrlFrame.param_id = SET_PARAM_TCP_HOST_WINDOW;
+			ff->ctrlFrame.data_len = 0;
+			ff->ctrlFrame.data = NULL;
+			tcp_set_param(ff);
+		} else {
+			metadata_readFromElement(ff->metaData, "send_src_ip", &src_ip);
+			if (src_ip != TEST_HOST_IP) {
+				//ACKs, only the delay
+				if (rev->head - rev->tail < TEST_LINK_MAX) {
+					test_link_put(rev, ff, now + TEST_DELAY_NS);
+				} else {
+					freeFinsFrame(ff);
+				}
+				continue;
+			}
+
+			result.segs++;
+			if (rand() % 100 < loss) {
+				freeFinsFrame(ff);
+				continue;
+			}
+
+			//the bottleneck, drop-tail once limit bytes are waiting
+			if (depart < now) {
+				depart = now;
+			}
+			wait = depart - now;
+			if ((double) wait * rate / 1e9 + ff->dataFrame.pduLength > (double) limit || fwd->head - fwd->tail == TEST_LINK_MAX) {
+				result.drops++;
+				freeFinsFrame(ff);
+				continue;
+			}
+			queued_ns += (double) wait;
+			depart += (uint64_t) (ff->dataFrame.pduLength * 1e9 / rate);
+			test_link_put(fwd, ff, depart + TEST_DELAY_NS);
+		}
+	}
+	now = test_now_ns();
+
+	test_link_free(fwd);
+	test_link_free(rev);
+
+	if (!bad) {
+		result.goodput = 8.0 * recv / ((now - start) / 1000.0);
+		result.queue_ms = queued_ns / 1e6 / (result.segs - result.drops);
+	}
+	return result;
+}
+
+int main(int argc, char *argv[]) {
+	double mbits = argc > 1 ? atof(argv[1]) : 10;
+	uint32_t limit = argc > 2 ? (uint32_t) atoi(argv[2]) * 1024 : 32 * 1024;
+	int loss = argc > 3 ? atoi(argv[3]) : 0;
+	uint32_t bytes = argc > 4 ? (uint32_t) atoi(argv[4]) : 4 * 1024 * 1024;
+	char *names[] = { "reno", "cubic", "bbr" };
+	struct test_result result;
+	struct tcp_cong_ops *ops;
+	int bad = 0;
+	int i;
+
+	TCP_to_Switch_Queue = init_ring("tcp_to_switch", 65536);
+	sem_init(&TCP_to_Switch_Qsem, 0, 1);
+	init_event(&Switch_Event);
+	tcp_init();
+	tcp_gso = 0; //the bottleneck queues wire segs, not super-segs
+	tcp_workers_run(NULL);
+
+	fprintf(stderr, "%u bytes, %.1f Mbit/s bottleneck, %u KB queue, %.1f ms RTT, %d%% data segs dropped\n", bytes, mbits, limit / 1024,
+			2 * TEST_DELAY_NS / 1e6, loss);
+	for (i = 0; i < (int) (sizeof(names) / sizeof(char *)); i++) {
+		ops = cong_find(names[i]);
+		if (ops == NULL) {
+			fprintf(stderr, "%s: not found\n", names[i]);
+			bad++;
+			continue;
+		}
+
+		srand(1);
+		result = test_transfer(3000 + 10 * i, ops, mbits * 1e6 / 8, limit, loss, bytes);
+		if (result.goodput == 0) {
+			bad++;
+		}
+		fprintf(stderr, "%-6s %.2f Mbit/s, %.2f ms queueing, %u data segs sent, %u dropped at the queue\n", names[i], result.goodput, result.queue_ms,
+				result.segs, result.drops);
+	}
+
+	tcp_workers_shutdown();
+	tcp_workers_release();
+	return bad != 0;
+}
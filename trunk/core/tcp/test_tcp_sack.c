@@ -0,0 +1,336 @@
+/**@file test_tcp_sack.c
+ *@brief checks selective ACKs: the blocks built from the recv_queue, the send_queue marked from them and the
+ * lost/pipe reckoning, then runs a bulk transfer between two conns over a loopback link that delays every
+ * segment and drops data segments at random, once with SACK and once with plain GBN, and compares goodput.
+ * A last lossless run has GSO on, checking super-segs make it through whole.
+ * Results go to stderr, so run as ./test_tcp_sack [loss %] [bytes] > /dev/null to drop the debug output.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <queueModule.h>
+#include "tcp.h"
+
+#define TEST_HOST_IP 0x0a000001
+#define TEST_REM_IP 0x0a000002
+#define TEST_DELAY_NS 5000000ull //one way
+#define TEST_LINK_MAX 4096 //segments in flight on the link
+#define TEST_CHUNK 16384 //bytes per sendmsg
+#define TEST_CHUNKS 4 //sendmsgs outstanding
+#define TEST_LIMIT_NS 120000000000ull
+
+struct finsEvent Switch_Event;
+
+extern finsRing TCP_to_Switch_Queue;
+extern sem_t TCP_to_Switch_Qsem;
+
+struct test_link {
+	struct finsFrame *ff[TEST_LINK_MAX];
+	uint64_t when[TEST_LINK_MAX];
+	uint32_t head;
+	uint32_t tail;
+};
+
+uint64_t test_now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/** a conn that skipped the handshake, with SACK on or off */
+struct tcp_connection *test_conn(uint32_t host_ip, uint16_t host_port, uint32_t rem_ip, uint16_t rem_port, uint32_t issn, uint32_t irsn, uint8_t sack) {
+	struct tcp_connection *conn = conn_create(host_ip, host_port, rem_ip, rem_port);
+
+	conn->state = TS_ESTABLISHED;
+	conn->issn = issn;
+	conn->send_seq_num = issn;
+	conn->send_seq_end = issn;
+	conn->irsn = irsn;
+	conn->recv_seq_num = irsn;
+	conn->recv_seq_end = irsn + conn->recv_max_win;
+	conn->threshhold = conn->send_max_win / 2.0;
+	conn->sack_enabled = sack;
+	conn->first_flag = 1;
+
+	sem_wait(conn->list_sem);
+	conn_list_insert(conn);
+	sem_post(conn->list_sem);
+	return conn;
+}
+
+struct tcp_segment *test_seg(uint32_t seq_num, uint32_t len) {
+	struct tcp_segment *seg = seg_create(TEST_HOST_IP, 1, TEST_REM_IP, 2, seq_num, seq_num + len);
+	seg->data_len = len;
+	return seg;
+}
+
+int test_blocks(void) {
+	struct tcp_connection *conn = conn_create(TEST_HOST_IP, 1000, TEST_REM_IP, 2000);
+	uint32_t blocks[2 * TCP_SACK_BLOCKS_MAX];
+	uint32_t seqs[] = { 2000, 3000, 5000, 7000, 9000, 11000 };
+	struct tcp_segment *seg;
+	uint32_t i;
+	int n;
+	int bad = 0;
+
+	conn->recv_seq_num = 1000;
+	conn->recv_seq_end = conn->recv_seq_num + conn->recv_max_win;
+
+	//2000-4000 merges, then 5000, 7000, 9000, 11000 apart
+	for (i = 0; i < sizeof(seqs) / sizeof(uint32_t); i++) {
+		seg = test_seg(seqs[i], 1000);
+		queue_insert(conn->recv_queue, node_create((uint8_t *) seg, 1000, seg->seq_num, seg->seq_end - 1), conn->recv_seq_num, conn->recv_seq_end);
+	}
+	conn->sack_recent = 9000;
+
+	n = sack_blocks(conn, blocks, TCP_SACK_BLOCKS_TS);
+	if (n != 3 || blocks[0] != 9000 || blocks[1] != 10000 || blocks[2] != 2000 || blocks[3] != 4000 || blocks[4] != 5000 || blocks[5] != 6000) {
+		bad++;
+	}
+	n = sack_blocks(conn, blocks, TCP_SACK_BLOCKS_MAX);
+	if (n != 4 || blocks[0] != 9000 || blocks[6] != 7000 || blocks[7] != 8000) {
+		bad++;
+	}
+	fprintf(stderr, "blocks: %d, first (%u, %u)\n", n, blocks[0], blocks[1]);
+
+	conn_free(conn);
+	return bad;
+}
+
+int test_scoreboard(void) {
+	struct tcp_connection *conn = conn_create(TEST_HOST_IP, 1001, TEST_REM_IP, 2001);
+	struct tcp_segment *seg;
+	struct tcp_node *node;
+	uint32_t pipe;
+	uint32_t i;
+	int bad = 0;
+
+	//10 segs of MSS out, the rem SACKs 3-5 & 7
+	conn->send_seq_num = 0;
+	for (i = 0; i < 10; i++) {
+		node = node_create(NULL, conn->MSS, i * conn->MSS, (i + 1) * conn->MSS - 1);
+		node->pos = i * conn->MSS;
+		queue_append(conn->send_queue, node);
+	}
+	conn->send_seq_end = 10 * conn->MSS;
+
+	seg = seg_create(TEST_REM_IP, 2001, TEST_HOST_IP, 1001, 0, 0);
+	seg->ack_num = 0;
+	seg->opt_len = 2 + TCP_OPT_SACK_BYTES(2) + 2;
+	seg->options[0] = TCP_OPT_NOP;
+	seg->options[1] = TCP_OPT_NOP;
+	seg->options[2] = TCP_OPT_SACK;
+	seg->options[3] = TCP_OPT_SACK_BYTES(2);
+	*(uint32_t *) (seg->options + 4) = htonl(7 * conn->MSS);
+	*(uint32_t *) (seg->options + 8) = htonl(8 * conn->MSS);
+	*(uint32_t *) (seg->options + 12) = htonl(3 * conn->MSS);
+	*(uint32_t *) (seg->options + 16) = htonl(6 * conn->MSS);
+	seg->options[20] = TCP_OPT_EOL;
+	sack_recv(conn, seg);
+	seg_free(seg);
+
+	for (node = conn->send_queue->front, i = 0; node; node = node->next, i++) {
+		if (node->sacked != (i == 3 || i == 4 || i == 5 || i == 7)) {
+			bad++;
+		}
+	}
+
+	//0-2 have 4 SACKed segs above, lost; 6 has 1, 8 & 9 none
+	node = sack_scan(conn, &pipe);
+	if (node != conn->send_queue->front || pipe != 3 * conn->MSS) {
+		bad++;
+	}
+	fprintf(stderr, "scoreboard: lost seq=%u, pipe=%u\n", node ? node->seq_num : 0, pipe);
+
+	node->retrans = 1;
+	node = sack_scan(conn, &pipe);
+	if (node != conn->send_queue->front->next || pipe != 4 * conn->MSS) {
+		bad++;
+	}
+
+	conn_free(conn);
+	return bad;
+}
+
+/** sends bytes from host to rem over a link dropping loss % of data segments, returns goodput in Mbit/s */
+double test_transfer(uint16_t port, uint8_t sack, int loss, uint32_t bytes, uint32_t *segs) {
+	struct test_link *link = (struct test_link *) calloc(1, sizeof(struct test_link));
+	struct tcp_connection *host;
+	struct tcp_connection *rem;
+	struct finsFrame *ff;
+	metadata *params;
+	uint32_t src_ip, dst_ip, serial_num = 0, protocol = IPPROTO_TCP, flags = 0, value, state = SS_CONNECTED;
+	uint32_t host_port = port, rem_port = port + 1;
+	uint32_t sent = 0, acked = 0, recv = 0, i;
+	uint64_t start, now;
+	int bad = 0;
+
+	host = test_conn(TEST_HOST_IP, host_port, TEST_REM_IP, rem_port, 1000, 5000, sack);
+	rem = test_conn(TEST_REM_IP, rem_port, TEST_HOST_IP, host_port, 5000, 1000, sack);
+
+	*segs = 0;
+	start = test_now_ns();
+	while (recv < bytes && !bad) {
+		now = test_now_ns();
+		if (now - start > TEST_LIMIT_NS) {
+			fprintf(stderr, "transfer: timed out at %u of %u bytes\n", recv, bytes);
+			bad++;
+			break;
+		}
+
+		//the app, keeps a few sendmsgs going
+		if (sent < bytes && sent - acked < TEST_CHUNKS * TEST_CHUNK) {
+			params = (metadata *) malloc(sizeof(metadata));
+			metadata_create(params);
+			metadata_writeToElement(params, "flags", &flags, META_TYPE_INT32);
+			metadata_writeToElement(params, "serial_num", &serial_num, META_TYPE_INT32);
+			metadata_writeToElement(params, "host_ip", &host->host_ip, META_TYPE_INT32);
+			metadata_writeToElement(params, "host_port", &host_port, META_TYPE_INT32);
+			metadata_writeToElement(params, "rem_ip", &host->rem_ip, META_TYPE_INT32);
+			metadata_writeToElement(params, "rem_port", &rem_port, META_TYPE_INT32);
+
+			ff = (struct finsFrame *) malloc(sizeof(struct finsFrame));
+			ff->dataOrCtrl = DATA;
+			ff->destinationID.id = TCP_ID;
+			ff->destinationID.next = NULL;
+			ff->metaData = params;
+			ff->dataFrame.directionFlag = DOWN;
+			ff->dataFrame.pduLength = TEST_CHUNK;
+			ff->dataFrame.pdu = (uint8_t *) malloc(TEST_CHUNK);
+			for (i = 0; i < TEST_CHUNK; i++) {
+				ff->dataFrame.pdu[i] = (uint8_t) ((sent + i) * 7);
+			}
+			tcp_out_fdf(ff);
+			sent += TEST_CHUNK;
+			serial_num++;
+		}
+
+		//the link, segments come back out the other side TEST_DELAY_NS later
+		while (link->tail != link->head && link->when[link->tail % TEST_LINK_MAX] <= now) {
+			tcp_in_fdf(link->ff[link->tail++ % TEST_LINK_MAX]);
+		}
+
+		ff = read_ring(TCP_to_Switch_Queue);
+		if (ff == NULL) {
+			usleep(50);
+			continue;
+		}
+
+		if (ff->dataOrCtrl == CONTROL) {
+			if (ff->ctrlFrame.opcode == CTRL_EXEC_REPLY && ff->ctrlFrame.param_id == EXEC_TCP_SEND && ff->ctrlFrame.ret_val) {
+				acked += TEST_CHUNK;
+			}
+			freeFinsFrame(ff);
+		} else if (ff->dataFrame.directionFlag == UP) {
+			//the rem's daemon, check the bytes come in order
+			for (i = 0; i < ff->dataFrame.pduLength; i++) {
+				if (ff->dataFrame.pdu[i] != (uint8_t) ((recv + i) * 7)) {
+					fprintf(stderr, "transfer: byte %u wrong\n", recv + i);
+					bad++;
+					break;
+				}
+			}
+			recv += ff->dataFrame.pduLength;
+
+			//read right away, the window opens back up as the daemon's would
+			value = ff->dataFrame.pduLength;
+			metadata_destroy(ff->metaData);
+			params = (metadata *) malloc(sizeof(metadata));
+			metadata_create(params);
+			metadata_writeToElement(params, "value", &value, META_TYPE_INT32);
+			metadata_writeToElement(params, "state", &state, META_TYPE_INT32);
+			metadata_writeToElement(params, "host_ip", &rem->host_ip, META_TYPE_INT32);
+			metadata_writeToElement(params, "host_port", &rem_port, META_TYPE_INT32);
+			metadata_writeToElement(params, "rem_ip", &rem->rem_ip, META_TYPE_INT32);
+			metadata_writeToElement(params, "rem_port", &host_port, META_TYPE_INT32);
+
+			free(ff->dataFrame.pdu);
+			ff->dataOrCtrl = CONTROL;
+			ff->destinationID.id = TCP_ID;
+			ff->metaData = params;
+			ff->ctrlFrame.senderID = DAEMON_ID;
+			ff->ctrlFrame.serial_num = serial_num++;
+			ff->ctrlFrame.opcode = CTRL_SET_PARAM;
+			ff->ctrlFrame.param_id = SET_PARAM_TCP_HOST_WINDOW;
+			ff->ctrlFrame.data_len = 0;
+			ff->ctrlFrame.data = NULL;
+			tcp_set_param(ff);
+		} else if (link->head - link->tail < TEST_LINK_MAX) {
+			metadata_readFromElement(ff->metaData, "send_src_ip", &src_ip);
+			metadata_readFromElement(ff->metaData, "send_dst_ip", &dst_ip);
+			if (src_ip == TEST_HOST_IP && ff->dataFrame.pduLength > MIN_TCP_HEADER_BYTES + 40) {
+				(*segs)++;
+				if (rand() % 100 < loss) {
+					freeFinsFrame(ff);
+					continue;
+				}
+			}
+
+			metadata_destroy(ff->metaData);
+			params = (metadata *) malloc(sizeof(metadata));
+			metadata_create(params);
+			metadata_writeToElement(params, "recv_protocol", &protocol, META_TYPE_INT32);
+			metadata_writeToElement(params, "recv_src_ip", &src_ip, META_TYPE_INT32);
+			metadata_writeToElement(params, "recv_dst_ip", &dst_ip, META_TYPE_INT32);
+			ff->metaData = params;
+			ff->dataFrame.directionFlag = UP;
+
+			link->ff[link->head % TEST_LINK_MAX] = ff;
+			link->when[link->head++ % TEST_LINK_MAX] = now + TEST_DELAY_NS;
+		} else {
+			freeFinsFrame(ff);
+		}
+	}
+	now = test_now_ns();
+
+	while (link->tail != link->head) {
+		freeFinsFrame(link->ff[link->tail++ % TEST_LINK_MAX]);
+	}
+	free(link);
+
+	return bad ? 0 : 8.0 * recv / ((now - start) / 1000.0);
+}
+
+int main(int argc, char *argv[]) {
+	int loss = argc > 1 ? atoi(argv[1]) : 2;
+	uint32_t bytes = argc > 2 ? (uint32_t) atoi(argv[2]) : 4 * 1024 * 1024;
+	double gbn, sack, gso;
+	uint32_t gbn_segs, sack_segs, gso_segs;
+	int bad = 0;
+	int i;
+
+	TCP_to_Switch_Queue = init_ring("tcp_to_switch", 65536);
+	sem_init(&TCP_to_Switch_Qsem, 0, 1);
+	init_event(&Switch_Event);
+	tcp_init();
+	tcp_gso = 0; //the link drops wire segs, not super-segs
+	tcp_workers_run(NULL);
+
+	bad += i = test_blocks();
+	fprintf(stderr, "blocks: %s\n", i ? "FAILED" : "ok");
+	bad += i = test_scoreboard();
+	fprintf(stderr, "scoreboard: %s\n", i ? "FAILED" : "ok");
+
+	srand(1);
+	gbn = test_transfer(3000, 0, loss, bytes, &gbn_segs);
+	srand(1);
+	sack = test_transfer(4000, 1, loss, bytes, &sack_segs);
+	tcp_gso = 1;
+	gso = test_transfer(5000, 1, 0, bytes, &gso_segs); //super-segs go to the rem whole, it takes them as one big seg
+	tcp_gso = 0;
+	if (gbn == 0 || sack == 0 || gso == 0) {
+		bad++;
+	}
+
+	fprintf(stderr, "\n%u bytes, %d%% data segs dropped, %.1f ms RTT\n", bytes, loss, 2 * TEST_DELAY_NS / 1e6);
+	fprintf(stderr, "GBN:  %.2f Mbit/s, %u data segs sent\n", gbn, gbn_segs);
+	fprintf(stderr, "SACK: %.2f Mbit/s, %u data segs sent\n", sack, sack_segs);
+	fprintf(stderr, "GSO:  %.2f Mbit/s, %u super-segs sent, no loss\n", gso, gso_segs);
+
+	tcp_workers_shutdown();
+	tcp_workers_release();
+	return bad != 0;
+}
@@ -25,11 +25,13 @@
 int udp_running;
 pthread_t switch_to_udp_thread;
 
-sem_t UDP_to_Switch_Qsem;
-finsQueue UDP_to_Switch_Queue;
+finsRing UDP_to_Switch_Queue;
+struct finsBatch udp_batch; //what a burst sends, see udp_get_ff()
 
-sem_t Switch_to_UDP_Qsem;
-finsQueue Switch_to_UDP_Queue;
+finsRing Switch_to_UDP_Queue;
+struct finsEvent Switch_to_UDP_Event;
+
+extern struct finsEvent Switch_Event;
 
 struct udp_statistics udpStat;
 
@@ -243,51 +245,52 @@ void udp_sent_list_gc(struct udp_sent_list *sent_list, double timeout) {
 	}
 }
 
+/**@brief queues a frame for the switch, it is sent with the rest of the burst being handled */
 int udp_to_switch(struct finsFrame *ff) {
 	PRINT_DEBUG("Entered: ff=%p, meta=%p", ff, ff->metaData);
-	if (sem_wait(&UDP_to_Switch_Qsem)) {
-		PRINT_ERROR("UDP_to_Switch_Qsem wait prob");
-		exit(-1);
-	}
-	if (write_queue(ff, UDP_to_Switch_Queue)) {
-		/*#*/PRINT_DEBUG("");
-		sem_post(&UDP_to_Switch_Qsem);
-		return 1;
-	}
-
-	PRINT_DEBUG("");
-	sem_post(&UDP_to_Switch_Qsem);
-	return 0;
+	return write_batch(ff, &udp_batch);
 }
 
+/**@brief handles a burst of frames from the switch. Runs of data frames going the same way are handled
+ * together, and everything sent goes to the switch at the end
+ */
 void udp_get_ff(void) {
-
+	struct finsFrame *ffs[RING_BURST];
 	struct finsFrame *ff;
-	do {
-		sem_wait(&Switch_to_UDP_Qsem);
-		ff = read_queue(Switch_to_UDP_Queue);
-		sem_post(&Switch_to_UDP_Qsem);
-	} while (udp_running && ff == NULL);
+	int n;
+	int i, j;
 
-	if (!udp_running) {
-		return;
+	n = read_ring_wait(ffs, RING_BURST, Switch_to_UDP_Queue, &Switch_to_UDP_Event, &udp_running);
+	for (i = 0; i < n; i++) {
+		ffs[i] = writableFinsFrame(ffs[i]); //frames delivered to several modules are shared
 	}
 
-	udpStat.totalRecieved++;
-	PRINT_DEBUG("UDP Total %d, ff=%p, meta=%p", udpStat.totalRecieved, ff, ff->metaData);
-	if (ff->dataOrCtrl == CONTROL) {
-		udp_fcf(ff);
-	} else if (ff->dataOrCtrl == DATA) {
-		if (ff->dataFrame.directionFlag == UP) {
-			udp_in_fdf(ff);
-			PRINT_DEBUG("");
-		} else if (ff->dataFrame.directionFlag == DOWN) {
-			udp_out_fdf(ff);
-			PRINT_DEBUG("");
+	udpStat.totalRecieved += n;
+	for (i = 0; i < n; i = j) {
+		ff = ffs[i];
+		j = i + 1;
+
+		PRINT_DEBUG("UDP Total %d, ff=%p, meta=%p", udpStat.totalRecieved, ff, ff->metaData);
+		if (ff->dataOrCtrl == CONTROL) {
+			udp_fcf(ff);
+		} else if (ff->dataOrCtrl == DATA) {
+			while (j < n && ffs[j]->dataOrCtrl == DATA && ffs[j]->dataFrame.directionFlag == ff->dataFrame.directionFlag) {
+				j++;
+			}
+
+			if (ff->dataFrame.directionFlag == UP) {
+				udp_in_fdf_burst(&ffs[i], j - i);
+				PRINT_DEBUG("");
+			} else if (ff->dataFrame.directionFlag == DOWN) {
+				udp_out_fdf_burst(&ffs[i], j - i);
+				PRINT_DEBUG("");
+			}
+		} else {
+			PRINT_ERROR("todo error");
 		}
-	} else {
-		PRINT_ERROR("todo error");
 	}
+
+	flush_batch(&udp_batch);
 }
 
 void udp_fcf(struct finsFrame *ff) {
@@ -498,6 +501,7 @@ void *switch_to_udp(void *local) {
 void udp_init(void) {
 	PRINT_DEBUG("Entered");
 	udp_running = 1;
+	init_batch(&udp_batch, &UDP_to_Switch_Queue, &Switch_Event);
 
 	udp_sent_packet_list = udp_sent_list_create(UDP_SENT_LIST_MAX);
 }
@@ -511,6 +515,7 @@ void udp_run(pthread_attr_t *fins_pthread_attr) {
 void udp_shutdown(void) {
 	PRINT_DEBUG("Entered");
 	udp_running = 0;
+	post_event(&Switch_to_UDP_Event);
 
 	//TODO expand this
 
@@ -525,6 +530,6 @@ void udp_release(void) {
 
 	//TODO free all module related mem
 
-	term_queue(UDP_to_Switch_Queue);
-	term_queue(Switch_to_UDP_Queue);
+	term_ring(UDP_to_Switch_Queue);
+	term_ring(Switch_to_UDP_Queue);
 }
@@ -11,6 +11,7 @@
 #include <finstypes.h>
 #include <metadata.h>
 #include <finsdebug.h>
+#include <finschecksum.h>
 #include <queueModule.h>
 #include <netinet/in.h>
 #include <pthread.h>
@@ -128,8 +129,10 @@ void udp_fcf(struct finsFrame *ff);
 void udp_error(struct finsFrame *ff);
 
 void udp_in_fdf(struct finsFrame *ff);
+void udp_in_fdf_burst(struct finsFrame **ffs, int num);
 
 void udp_out_fdf(struct finsFrame *ff);
+void udp_out_fdf_burst(struct finsFrame **ffs, int num);
 
 struct finsFrame *create_ff(int dataOrCtrl, int direction, int destID, int PDU_length, uint8_t *PDU, metadata *meta);
 int UDP_InputQueue_Read_local(struct finsFrame *pff_local);
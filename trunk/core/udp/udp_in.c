@@ -125,13 +125,7 @@ void udp_in_fdf(struct finsFrame* ff) {
 
 	//ff->dataFrame.pdu = ff->dataFrame.pdu + U_HEADER_LEN;
 
-	int leng = ff->dataFrame.pduLength;
-	ff->dataFrame.pduLength = leng - U_HEADER_LEN;
-
-	uint8_t *pdu = ff->dataFrame.pdu;
-	uint8_t *data = (uint8_t *) malloc(ff->dataFrame.pduLength);
-	memcpy(data, pdu + U_HEADER_LEN, ff->dataFrame.pduLength);
-	ff->dataFrame.pdu = data;
+	pullFinsPdu(ff, U_HEADER_LEN);
 
 	//#########################
 	uint8_t *temp = (uint8_t *) malloc(ff->dataFrame.pduLength + 1);
@@ -152,10 +146,14 @@ void udp_in_fdf(struct finsFrame* ff) {
 
 	//sendToSwitch(newFF);
 	udp_to_switch(ff);
+}
 
-	//PRINT_DEBUG("freeing: ff=%p", ff);
+/**@brief udp_in_fdf() for a run of datagrams from IPv4, what goes on to the daemon leaves with the burst */
+void udp_in_fdf_burst(struct finsFrame **ffs, int num) {
+	int i;
 
-	PRINT_DEBUG("Freeing pdu=%p", pdu);
-	free(pdu);
+	PRINT_DEBUG("Entered: ff=%p, num=%d", ffs[0], num);
+	for (i = 0; i < num; i++) {
+		udp_in_fdf(ffs[i]);
+	}
 }
-
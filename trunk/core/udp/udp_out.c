@@ -26,7 +26,7 @@ extern struct udp_statistics udpStat;
 
 extern struct udp_sent_list *udp_sent_packet_list;
 
-void udp_out_fdf(struct finsFrame* ff) {
+static void udp_out_stamped(struct finsFrame* ff, struct timeval *stamp) {
 
 	//struct finsFrame* newFF;
 	//struct udp_metadata_parsed parsed_meta;
@@ -57,8 +57,6 @@ void udp_out_fdf(struct finsFrame* ff) {
 	//print_finsFrame(ff);
 
 	packet_length = ff->dataFrame.pduLength + U_HEADER_LEN;
-	uint8_t *udp_dataunit = (uint8_t *) malloc(packet_length);
-	packet_netw = (struct udp_packet *) udp_dataunit;
 	uint8_t *pdu = ff->dataFrame.pdu;
 
 	/** constructs the UDP packet from the FDF and the meta data */
@@ -101,11 +99,11 @@ void udp_out_fdf(struct finsFrame* ff) {
 	//packet_host.u_dst = dstbuf16;
 	//packet_host.u_len = packet_length;
 	//packet_host.u_cksum = 0;
+	packet_netw = (struct udp_packet *) pushFinsPdu(ff, U_HEADER_LEN); //pdus from the daemon are malloc()ed, so this moves them to a pooled buffer once
 	packet_netw->u_src = htons((uint16_t) src_port);
 	packet_netw->u_dst = htons((uint16_t) dst_port);
 	packet_netw->u_len = htons(packet_length);
 	packet_netw->u_cksum = 0;
-	memcpy(packet_netw->u_data, pdu, ff->dataFrame.pduLength);
 
 	PRINT_DEBUG("src=%u/%u, dst=%u/%u, pkt_len=%u", src_ip, (uint16_t)src_port, dst_ip, (uint16_t)dst_port, packet_length);
 
@@ -120,7 +118,7 @@ void udp_out_fdf(struct finsFrame* ff) {
 
 	//ff->dataFrame.pdu = udp_dataunit;
 	/* creates a new FDF to be sent out */
-	PRINT_DEBUG("%p", udp_dataunit);
+	PRINT_DEBUG("%p", packet_netw);
 	//(int)ff->dataFrame.pdu);
 
 	//newFF = create_ff(DATA, DOWN, IPV4_ID, packet_length, udp_dataunit, meta);
@@ -130,8 +128,6 @@ void udp_out_fdf(struct finsFrame* ff) {
 	ff->destinationID.next = NULL;
 
 	//ff->dataFrame.directionFlag = DOWN;
-	ff->dataFrame.pduLength = packet_length;
-	ff->dataFrame.pdu = udp_dataunit;
 	//ff->metaData = params;
 
 	//PRINT_DEBUG("newff=0x%x, pdu=0x%x", (int)newFF, (int)newFF->dataFrame.pdu);
@@ -149,7 +145,7 @@ void udp_out_fdf(struct finsFrame* ff) {
 			udp_sent_list_append(udp_sent_packet_list, sent);
 			PRINT_DEBUG("sent_packet_list=%p, len=%u, max=%u", udp_sent_packet_list, udp_sent_packet_list->len, udp_sent_packet_list->max)
 
-			gettimeofday(&sent->stamp, 0);
+			sent->stamp = *stamp;
 		} else {
 			PRINT_DEBUG("Clearing sent_packet_list");
 			udp_sent_list_gc(udp_sent_packet_list, UDP_MSL_TO_DEFAULT);
@@ -158,7 +154,7 @@ void udp_out_fdf(struct finsFrame* ff) {
 				udp_sent_list_append(udp_sent_packet_list, sent);
 				PRINT_DEBUG("sent_packet_list=%p, len=%u, max=%u", udp_sent_packet_list, udp_sent_packet_list->len, udp_sent_packet_list->max)
 
-				gettimeofday(&sent->stamp, 0);
+				sent->stamp = *stamp;
 			} else {
 				PRINT_ERROR("todo error");
 				udp_sent_free(sent);
@@ -169,8 +165,26 @@ void udp_out_fdf(struct finsFrame* ff) {
 		freeFinsFrame(ff_clone);
 		freeFinsFrame(ff);
 	}
+}
+
+void udp_out_fdf(struct finsFrame* ff) {
+	struct timeval stamp;
+
+	gettimeofday(&stamp, 0);
+	udp_out_stamped(ff, &stamp);
+}
+
+/**@brief udp_out_fdf() for a run of datagrams from the daemon. They share one time stamp in the sent list,
+ * and go to IPv4 with the burst
+ */
+void udp_out_fdf_burst(struct finsFrame **ffs, int num) {
+	struct timeval stamp;
+	int i;
 
-	//PRINT_DEBUG("freeing: ff=%p", ff);
-	PRINT_DEBUG("freeing: pdu=%p", pdu);
-	free(pdu);
+	PRINT_DEBUG("Entered: ff=%p, num=%d", ffs[0], num);
+
+	gettimeofday(&stamp, 0);
+	for (i = 0; i < num; i++) {
+		udp_out_stamped(ffs[i], &stamp);
+	}
 }
@@ -24,10 +24,13 @@
 //#include <linux/sockios.h>
 //#include <linux/delay.h>	/* For sleep */
 #include <linux/if.h>		/* Needed for fins_ioctl */
+#include <linux/miscdevice.h>	/* Needed for the payload ring device */
+#include <linux/vmalloc.h>	/* Needed for the payload rings */
+#include <linux/mm.h>		/* Needed for mapping the payload rings */
 
 #include "fins_stack_wedge.h"	/* Defs for this module */
 
-#define RECV_BUFFER_SIZE	1024//4096//16384//8192	// Same as userspace, Pick an appropriate value here
+#define RECV_BUFFER_SIZE	16384//1024//4096//8192	// Same as NL_PART_SIZE in the daemon, Pick an appropriate value here
 #define AF_FINS 2
 #define PF_FINS AF_FINS
 #define NETLINK_FINS 20
@@ -62,6 +65,11 @@ struct sock *fins_nl_sk = NULL;
 int fins_daemon_pid; // holds the pid of the FINS daemon so we know who to send back to
 struct semaphore link_sem;
 
+/* Data for the payload rings */
+u_char *wedge_rings; // FINS_RING_SLOTS struct fins_ring_slot, vmalloc_user'd so the daemon can map them
+struct wedge_ring wedge_rings_tx[FINS_RING_SLOTS];
+int wedge_rings_mapped; // the daemon has the slots mapped, nothing goes through them until it does
+
 //extern static const struct net_proto_family __rcu *net_families[NPROTO] __read_mostly;
 
 int print_exit(const char *func, int line, int rc) {
@@ -197,6 +205,9 @@ int wedge_sockets_insert(unsigned long long sock_id, struct sock *sk) { //TODO m
 
 			wedge_sockets[i].release_flag = 0;
 			wedge_sockets[i].sk_new = NULL;
+			wedge_sockets[i].ring = -1;
+			wedge_sockets[i].ready = 0;
+			wedge_sockets[i].ready_exact = 0;
 
 			return print_exit(__FUNCTION__, __LINE__, i);
 			//return i;
@@ -254,6 +265,7 @@ int wedge_sockets_remove(unsigned long long sock_id, int sock_index, u_int call_
 		}
 	}
 
+	wedge_rings_unassign(sock_index);
 	wedge_sockets[sock_index].sock_id = -1;
 
 	return 0;
@@ -295,6 +307,7 @@ void wedge_socket_remove_all(void) {
 				}
 			}
 
+			wedge_rings_unassign(i);
 			wedge_sockets[i].sock_id = -1;
 		}
 	}
@@ -342,54 +355,222 @@ int checkConfirmation(int call_index) {
 	}
 }
 
-/* FINS Netlink functions  */
+/* FINS payload rings */
+void wedge_rings_init(void) {
+	int i;
+
+	for (i = 0; i < FINS_RING_SLOTS; i++) {
+		wedge_rings_tx[i].sock_index = -1;
+		sema_init(&wedge_rings_tx[i].sem, 1);
+	}
+	wedge_rings_mapped = 0;
+}
+
 /*
- * Sends len bytes from buffer buf to process pid, and sets the flags.
- * If buf is longer than RECV_BUFFER_SIZE, it's broken into sequential messages.
- * Returns 0 if successful or -1 if an error occurred.
+ * Gives the socket a ring slot if it has none and one is free. Called with wedge_sockets_sem held.
+ * Returns the slot or -1.
  */
+int wedge_rings_assign(int sock_index) {
+	int i;
 
-//assumes msg_buf is just the msg, does not have a prepended msg_len
-//break msg_buf into parts of size RECV_BUFFER_SIZE with a prepended header (header part of RECV...)
-//prepend msg header: total msg length, part length, part starting position
-int nl_send_msg(int pid, unsigned int seq, int type, void *buf, ssize_t len, int flags) {
-	struct nlmsghdr *nlh;
-	struct sk_buff *skb;
-	int ret_val;
+	if (wedge_sockets[sock_index].ring != -1 || wedge_rings == NULL || !wedge_rings_mapped) {
+		return wedge_sockets[sock_index].ring;
+	}
 
-	//####################
-	u_char *print_buf;
-	u_char *print_pt;
+	for (i = 0; i < FINS_RING_SLOTS; i++) {
+		if (wedge_rings_tx[i].sock_index == -1) {
+			wedge_rings_tx[i].sock_index = sock_index;
+			wedge_rings_tx[i].head = 0;
+			wedge_rings_tx[i].tail = 0;
+			wedge_sockets[sock_index].ring = i;
+			PRINT_DEBUG("sock_index=%d, slot=%d", sock_index, i);
+			return i;
+		}
+	}
+	return -1;
+}
+
+void wedge_rings_unassign(int sock_index) {
+	if (wedge_sockets[sock_index].ring != -1) {
+		wedge_rings_tx[wedge_sockets[sock_index].ring].sock_index = -1;
+		wedge_sockets[sock_index].ring = -1;
+	}
+}
+
+/*
+ * Copies len bytes from the user's iovec into the slot's sendmsg ring.
+ * Returns where the chunk starts or -1 if there isn't room, in which case the data goes in the netlink message.
+ */
+int wedge_ring_put(int slot, struct iovec *iov, int iovlen, u_int len) {
+	struct wedge_ring *ring = &wedge_rings_tx[slot];
+	u_char *data = ((struct fins_ring_slot *) wedge_rings)[slot].tx;
+	struct fins_ring_chunk *chunk;
+	u_int need = sizeof(struct fins_ring_chunk) + ((len + 7) & ~7u);
+	u_int state;
+	u_int pos;
+	u_int pad;
 	u_char *pt;
 	int i;
 
-	PRINT_DEBUG("Entered: pid=%d, seq=%d, type=%d, len=%d", pid, seq, type, len);
+	if (need > FINS_RING_SIZE / 2) {
+		return -1;
+	}
+
+	if (down_interruptible(&ring->sem)) {
+		PRINT_ERROR("ring sem acquire fail");
+		return -1;
+	}
+
+	//take back whatever the daemon is done with
+	while (ring->tail != ring->head) {
+		chunk = (struct fins_ring_chunk *) (data + (ring->tail & (FINS_RING_SIZE - 1)));
+		state = ACCESS_ONCE(chunk->state);
+		if (state != FINS_CHUNK_DONE && state != FINS_CHUNK_SKIP) {
+			break;
+		}
+		smp_rmb();
+		ring->tail += chunk->space;
+	}
+
+	pos = ring->head & (FINS_RING_SIZE - 1);
+	if (pos + need > FINS_RING_SIZE) {
+		pad = FINS_RING_SIZE - pos;
+		if (ring->head - ring->tail + pad + need > FINS_RING_SIZE) {
+			up(&ring->sem);
+			return -1;
+		}
+		chunk = (struct fins_ring_chunk *) (data + pos);
+		chunk->space = pad;
+		chunk->state = FINS_CHUNK_SKIP;
+		ring->head += pad;
+		pos = 0;
+	} else if (ring->head - ring->tail + need > FINS_RING_SIZE) {
+		up(&ring->sem);
+		return -1;
+	}
+
+	pt = data + pos + sizeof(struct fins_ring_chunk);
+	for (i = 0; i < iovlen; i++) {
+		if (copy_from_user(pt, iov[i].iov_base, iov[i].iov_len)) {
+			PRINT_ERROR("copy_from_user fail");
+			up(&ring->sem);
+			return -1;
+		}
+		pt += iov[i].iov_len;
+	}
+
+	chunk = (struct fins_ring_chunk *) (data + pos);
+	chunk->space = need;
+	smp_wmb();
+	chunk->state = FINS_CHUNK_BUSY;
+	ring->head += need;
+	up(&ring->sem);
+
+	return pos;
+}
+
+/*
+ * The recvmsg data the daemon put in the slot's ring at where, NULL if where and len don't make sense.
+ * Hand it back with wedge_ring_done() once copied out.
+ */
+u_char *wedge_ring_get(int slot, int where, u_int len) {
+	u_char *data;
+	struct fins_ring_chunk *chunk;
+
+	if (slot < 0 || slot >= FINS_RING_SLOTS || where < 0 || (where & 7) || where + sizeof(struct fins_ring_chunk) + len > FINS_RING_SIZE) {
+		return NULL;
+	}
+
+	data = ((struct fins_ring_slot *) wedge_rings)[slot].rx;
+	chunk = (struct fins_ring_chunk *) (data + where);
+	if (ACCESS_ONCE(chunk->state) != FINS_CHUNK_BUSY || chunk->space < sizeof(struct fins_ring_chunk) + len) {
+		return NULL;
+	}
+	smp_rmb();
+	return data + where + sizeof(struct fins_ring_chunk);
+}
+
+void wedge_ring_done(u_char *data, int where) {
+	struct fins_ring_chunk *chunk = (struct fins_ring_chunk *) (data + where);
+
+	smp_mb();
+	chunk->state = FINS_CHUNK_DONE;
+}
+
+static int fins_ring_mmap(struct file *file, struct vm_area_struct *vma) {
+	int ret;
+
+	if (vma->vm_pgoff != 0 || vma->vm_end - vma->vm_start != FINS_RING_SLOTS * sizeof(struct fins_ring_slot)) {
+		return -EINVAL;
+	}
+
+	ret = remap_vmalloc_range(vma, wedge_rings, 0);
+	if (ret == 0) {
+		wedge_rings_mapped = 1;
+	}
+	return ret;
+}
+
+static int fins_ring_release(struct inode *inode, struct file *file) {
+	//daemon gone, sockets keep their slots but nothing new goes through them
+	wedge_rings_mapped = 0;
+	return 0;
+}
+
+static const struct file_operations fins_ring_fops = { .owner = THIS_MODULE, .mmap = fins_ring_mmap, .release = fins_ring_release, };
+
+static struct miscdevice fins_ring_dev = { .minor = MISC_DYNAMIC_MINOR, .name = "fins_ring", .fops = &fins_ring_fops, };
+
+/* FINS Netlink functions  */
+#ifdef DEBUG_DUMP
+//hex dumps of everything sent, very slow, only for tracking down framing problems
+void nl_print_buf(u_char *buf, ssize_t len) {
+	u_char *print_buf;
+	u_char *print_pt;
+	int i;
 
 	print_buf = (u_char *) kmalloc(5 * len, GFP_KERNEL);
 	if (print_buf == NULL) {
 		PRINT_ERROR("print_buf allocation fail");
-	} else {
-		print_pt = print_buf;
-		pt = buf;
-		for (i = 0; i < len; i++) {
-			if (i == 0) {
-				sprintf(print_pt, "%02x", *(pt + i));
-				print_pt += 2;
-			} else if (i % 4 == 0) {
-				sprintf(print_pt, ":%02x", *(pt + i));
-				print_pt += 3;
-			} else {
-				sprintf(print_pt, " %02x", *(pt + i));
-				print_pt += 3;
-			}
+		return;
+	}
+
+	print_pt = print_buf;
+	for (i = 0; i < len; i++) {
+		if (i == 0) {
+			sprintf(print_pt, "%02x", *(buf + i));
+			print_pt += 2;
+		} else if (i % 4 == 0) {
+			sprintf(print_pt, ":%02x", *(buf + i));
+			print_pt += 3;
+		} else {
+			sprintf(print_pt, " %02x", *(buf + i));
+			print_pt += 3;
 		}
-		PRINT_DEBUG("buf='%s'", print_buf);
-		kfree(print_buf);
 	}
-	//####################
+	PRINT_DEBUG("buf='%s'", print_buf);
+	kfree(print_buf);
+}
+#else
+#define nl_print_buf(buf, len)
+#endif
+
+/*
+ * Sends one part of a message to process pid: the part header (total msg length, part length, part starting position)
+ * and part_len bytes from buf are put straight into the skb.
+ * Returns 0 if successful or -1 if an error occurred.
+ */
+int nl_send_msg(int pid, unsigned int seq, int type, ssize_t msg_len, int pos, void *buf, ssize_t part_len, int flags) {
+	struct nlmsghdr *nlh;
+	struct sk_buff *skb;
+	ssize_t header_size = 2 * sizeof(ssize_t) + sizeof(int);
+	u_char *pt;
+	int ret_val;
+
+	PRINT_DEBUG("Entered: pid=%d, seq=%d, type=%d, msg_len=%d, pos=%d, part_len=%d", pid, seq, type, msg_len, pos, part_len);
 
 	// Allocate a new netlink message
-	skb = nlmsg_new(len, 0); // nlmsg_new(size_t payload, gfp_t flags)
+	skb = nlmsg_new(header_size + part_len, GFP_KERNEL); // nlmsg_new(size_t payload, gfp_t flags)
 	if (skb == NULL) {
 		PRINT_ERROR("netlink Failed to allocate new skb");
 		return -1;
@@ -397,11 +578,18 @@ int nl_send_msg(int pid, unsigned int seq, int type, void *buf, ssize_t len, int
 
 	// Load nlmsg header
 	// nlmsg_put(struct sk_buff *skb, u32 pid, u32 seq, int type, int payload, int flags)
-	nlh = nlmsg_put(skb, KERNEL_PID, seq, type, len, flags);
+	nlh = nlmsg_put(skb, KERNEL_PID, seq, type, header_size + part_len, flags);
 	NETLINK_CB(skb).dst_group = 0; // not in a multicast group
 
-	// Copy data into buffer
-	memcpy(NLMSG_DATA(nlh), buf, len);
+	// Part header then the data
+	pt = NLMSG_DATA(nlh);
+	*(ssize_t *) pt = msg_len;
+	pt += sizeof(ssize_t);
+	*(ssize_t *) pt = part_len;
+	pt += sizeof(ssize_t);
+	*(int *) pt = pos;
+	pt += sizeof(int);
+	memcpy(pt, buf, part_len);
 
 	// Send the message
 	//ret_val = nlmsg_unicast(fins_nl_sk, skb, pid);
@@ -413,145 +601,81 @@ int nl_send_msg(int pid, unsigned int seq, int type, void *buf, ssize_t len, int
 		return -1;
 	}
 
-	PRINT_DEBUG("Exited: pid=%d, seq=%d, type=%d, len=%d, ret_val=%d", pid, seq, type, len, ret_val);
+	PRINT_DEBUG("Exited: pid=%d, seq=%d, type=%d, part_len=%d, ret_val=%d", pid, seq, type, part_len, ret_val);
 	return 0;
 }
 
+/*
+ * Sends msg_len bytes from msg_buf to process pid, and sets the flags.
+ * If msg_buf is longer than a part (RECV_BUFFER_SIZE with the part header), it's broken into sequential messages.
+ * The daemon reads a batch of datagrams at a time, so parts go out back to back.
+ * Returns 0 if successful or -1 if an error occurred.
+ */
 int nl_send(int pid, void *msg_buf, ssize_t msg_len, int flags) {
-	int ret;
-	void *part_buf;
 	u_char *msg_pt;
 	int pos;
 	u_int seq;
-	u_char *hdr_msg_len;
-	u_char *hdr_part_len;
-	u_char *hdr_pos;
-	u_char *msg_start;
-	ssize_t header_size;
-	ssize_t part_len;
-
-	//#################### Debug
-	u_char *print_buf;
-	u_char *print_pt;
-	u_char *pt;
-	int i;
-	//####################
+	ssize_t part_max;
+	int multi;
+	int ret = 0;
 
 	PRINT_DEBUG("Entered: pid=%d, msg_buf=%p, msg_len=%d, flags=0x%x", pid, msg_buf, msg_len, flags);
+	nl_print_buf(msg_buf, msg_len);
 
-	if (down_interruptible(&link_sem)) {
-		PRINT_ERROR("link_sem acquire fail");
-	}
-
-	//#################### Debug
-	print_buf = (u_char *) kmalloc(5 * msg_len, GFP_KERNEL);
-	if (print_buf == NULL) {
-		PRINT_ERROR("print_buf allocation fail");
-	} else {
-		print_pt = print_buf;
-		pt = msg_buf;
-		for (i = 0; i < msg_len; i++) {
-			if (i == 0) {
-				sprintf(print_pt, "%02x", *(pt + i));
-				print_pt += 2;
-			} else if (i % 4 == 0) {
-				sprintf(print_pt, ":%02x", *(pt + i));
-				print_pt += 3;
-			} else {
-				sprintf(print_pt, " %02x", *(pt + i));
-				print_pt += 3;
-			}
-		}
-		PRINT_DEBUG("msg_buf='%s'", print_buf);
-		kfree(print_buf);
-	}
-	//####################
+	part_max = RECV_BUFFER_SIZE - (2 * sizeof(ssize_t) + sizeof(int));
 
-	part_buf = (u_char *) kmalloc(RECV_BUFFER_SIZE, GFP_KERNEL);
-	if (part_buf == NULL) {
-		PRINT_ERROR("part_buf allocation fail");
-		up(&link_sem);
-		return -1;
+	//a call in one part can't be interleaved with anything, only multipart ones hold the link
+	multi = msg_len > part_max;
+	if (multi && down_interruptible(&link_sem)) {
+		PRINT_ERROR("link_sem acquire fail");
 	}
 
 	msg_pt = msg_buf;
 	pos = 0;
 	seq = 0;
 
-	hdr_msg_len = part_buf;
-	hdr_part_len = hdr_msg_len + sizeof(ssize_t);
-	hdr_pos = hdr_part_len + sizeof(ssize_t);
-	msg_start = hdr_pos + sizeof(int);
-
-	header_size = msg_start - hdr_msg_len;
-	part_len = RECV_BUFFER_SIZE - header_size;
-
-	*(ssize_t *) hdr_msg_len = msg_len;
-	*(ssize_t *) hdr_part_len = part_len;
-
-	while (msg_len - pos > part_len) {
-		PRINT_DEBUG("pos=%d", pos);
-
-		*(int *) hdr_pos = pos;
-
-		memcpy(msg_start, msg_pt, part_len);
-
-		PRINT_DEBUG("seq=%d", seq);
+	while (msg_len - pos > part_max) {
+		PRINT_DEBUG("seq=%d, pos=%d", seq, pos);
 
-		ret = nl_send_msg(pid, seq, 0x0, part_buf, RECV_BUFFER_SIZE, flags/*| NLM_F_MULTI*/);
+		ret = nl_send_msg(pid, seq, 0x0, msg_len, pos, msg_pt, part_max, flags/*| NLM_F_MULTI*/);
 		if (ret < 0) {
 			PRINT_ERROR("netlink error sending seq %d to user", seq);
-			up(&link_sem);
-			PRINT_DEBUG("Exited: pid=%d, msg_buf=%p, msg_len=%d, flags=0x%x, ret=%d", pid, msg_buf, msg_len, flags, -1);
-			return -1;
+			goto end;
 		}
-		msleep(10);
 
-		msg_pt += part_len;
-		pos += part_len;
+		msg_pt += part_max;
+		pos += part_max;
 		seq++;
 	}
 
-	part_len = msg_len - pos;
-	*(ssize_t *) hdr_part_len = part_len;
-	*(int *) hdr_pos = pos;
-
-	memcpy(msg_start, msg_pt, part_len);
-
-	ret = nl_send_msg(pid, seq, NLMSG_DONE, part_buf, header_size + part_len, flags);
+	ret = nl_send_msg(pid, seq, NLMSG_DONE, msg_len, pos, msg_pt, msg_len - pos, flags);
 	if (ret < 0) {
 		PRINT_ERROR("netlink error sending seq %d to user", seq);
-		up(&link_sem);
-		PRINT_DEBUG("Exited: pid=%d, msg_buf=%p, msg_len=%d, flags=0x%x, ret=%d", pid, msg_buf, msg_len, flags, -1);
-		return -1;
 	}
 
-	kfree(part_buf);
-	up(&link_sem);
+	end: //
+	if (multi) {
+		up(&link_sem);
+	}
 
-	PRINT_DEBUG("Exited: pid=%d, msg_buf=%p, msg_len=%d, flags=0x%x, ret=%d", pid, msg_buf, msg_len, flags, 0);
-	return 0;
+	PRINT_DEBUG("Exited: pid=%d, msg_buf=%p, msg_len=%d, flags=0x%x, ret=%d", pid, msg_buf, msg_len, flags, ret);
+	return ret < 0 ? -1 : 0;
 }
 
 /*
- * This function is automatically called when the kernel receives a datagram on the corresponding netlink socket.
+ * Handles one message from the daemon, a datagram can carry several.
  */
-void nl_data_ready(struct sk_buff *skb) {
-	struct nlmsghdr *nlh;
+void nl_reply(struct nlmsghdr *nlh) {
 	u_char *buf; // Pointer to data in payload
 	ssize_t len; // Payload length
 	int pid; // pid of sending process
 	struct nl_daemon_to_wedge *hdr;
 
 	u_int reply_call; // a number corresponding to the type of socketcall this packet is in response to
+	u_int ready_new; // poll bits a ready event newly set
 
-	PRINT_DEBUG("Entered: skb=%p", skb);
+	PRINT_DEBUG("Entered: nlh=%p", nlh);
 
-	if (skb == NULL) {
-		PRINT_DEBUG("Exiting: skb NULL \n");
-		return;
-	}
-	nlh = (struct nlmsghdr *) skb->data;
 	pid = nlh->nlmsg_pid; // get pid from the header
 
 	// Get a pointer to the start of the data in the buffer and the buffer (payload) length
@@ -636,6 +760,28 @@ void nl_data_ready(struct sk_buff *skb) {
 							hdr->sock_index, wedge_calls[hdr->sock_index].sock_id, hdr->sock_id);
 				}
 				up(&wedge_sockets_sem);
+			} else if (hdr->call_type == ready_event_call) {
+				if (hdr->sock_index < 0 || hdr->sock_index >= MAX_SOCKETS || len != sizeof(int)) {
+					PRINT_ERROR("invalid ready event: sock_index=%d, len=%d", hdr->sock_index, len);
+					goto end;
+				}
+				if (down_interruptible(&wedge_sockets_sem)) {
+					PRINT_ERROR("sockets_sem acquire fail");
+					//TODO error
+				}
+				if (wedge_sockets[hdr->sock_index].sock_id == hdr->sock_id) {
+					//only newly set bits can wake anyone, cleared ones just stop poll from answering early
+					ready_new = hdr->msg & ~wedge_sockets[hdr->sock_index].ready;
+					wedge_sockets[hdr->sock_index].ready = hdr->msg;
+					wedge_sockets[hdr->sock_index].ready_exact = *(int *) (buf + sizeof(struct nl_daemon_to_wedge));
+					PRINT_DEBUG("ready: sock_id=%llu, sock_index=%d, mask=0x%x, exact=%d",
+							hdr->sock_id, hdr->sock_index, hdr->msg, wedge_sockets[hdr->sock_index].ready_exact);
+
+					if (ready_new && waitqueue_active(sk_sleep(wedge_sockets[hdr->sock_index].sk))) {
+						wake_up_poll(sk_sleep(wedge_sockets[hdr->sock_index].sk), ready_new);
+					}
+				}
+				up(&wedge_sockets_sem);
 			} else if (hdr->call_type < MAX_CALL_TYPES) {
 				//This wedge version relies on the fact that each call gets a unique call ID and that value is only sent to the wedge once
 				//Under this assumption a lock-less implementation can be used
@@ -708,6 +854,30 @@ void nl_data_ready(struct sk_buff *skb) {
 	}
 
 	end: //
+	PRINT_DEBUG("Exited: nlh=%p", nlh);
+}
+
+/*
+ * This function is automatically called when the kernel receives a datagram on the corresponding netlink socket.
+ * The daemon packs the replies to a batch of calls into one datagram, so walk every message in it.
+ */
+void nl_data_ready(struct sk_buff *skb) {
+	struct nlmsghdr *nlh;
+	int remaining;
+
+	PRINT_DEBUG("Entered: skb=%p", skb);
+
+	if (skb == NULL) {
+		PRINT_DEBUG("Exiting: skb NULL \n");
+		return;
+	}
+
+	nlh = (struct nlmsghdr *) skb->data;
+	remaining = skb->len;
+	for (; NLMSG_OK(nlh, remaining); nlh = NLMSG_NEXT(nlh, remaining)) {
+		nl_reply(nlh);
+	}
+
 	PRINT_DEBUG("Exited: skb=%p", skb);
 }
 
@@ -1721,6 +1891,8 @@ static int fins_sendmsg(struct kiocb *iocb, struct socket *sock, struct msghdr *
 
 	int i = 0;
 	u_int data_len = 0;
+	int ring;
+	int where = -1;
 	char *temp;
 
 	ssize_t buf_len;
@@ -1760,6 +1932,11 @@ static int fins_sendmsg(struct kiocb *iocb, struct socket *sock, struct msghdr *
 		return print_exit(__FUNCTION__, __LINE__, -1);
 	}
 
+	for (i = 0; i < (msg->msg_iovlen); i++) {
+		data_len += msg->msg_iov[i].iov_len;
+	}
+	ring = data_len >= FINS_RING_MIN ? wedge_rings_assign(sock_index) : wedge_sockets[sock_index].ring;
+
 	wedge_sockets[sock_index].threads[call_type]++;
 	up(&wedge_sockets_sem); //TODO move to later? lock_sock should guarantee
 
@@ -1776,16 +1953,20 @@ static int fins_sendmsg(struct kiocb *iocb, struct socket *sock, struct msghdr *
 		goto end;
 	}
 
-	for (i = 0; i < (msg->msg_iovlen); i++) {
-		data_len += msg->msg_iov[i].iov_len;
+	//bulk data goes through the socket's ring, only where it is goes in the message
+	if (ring != -1 && data_len >= FINS_RING_MIN) {
+		where = wedge_ring_put(ring, msg->msg_iov, msg->msg_iovlen, data_len);
 	}
 
 	// Build the message
-	buf_len = sizeof(struct nl_wedge_to_daemon) + sizeof(int) + (msg->msg_namelen > 0 ? msg->msg_namelen : 0) + 3 * sizeof(u_int) + sizeof(unsigned long)
-			+ msg->msg_controllen + data_len;
+	buf_len = sizeof(struct nl_wedge_to_daemon) + 3 * sizeof(int) + (msg->msg_namelen > 0 ? msg->msg_namelen : 0) + 3 * sizeof(u_int) + sizeof(unsigned long)
+			+ msg->msg_controllen + (where == -1 ? data_len : 0);
 	buf = (u_char *) kmalloc(buf_len, GFP_KERNEL);
 	if (buf == NULL) {
 		PRINT_ERROR("buffer allocation error");
+		if (where != -1) {
+			wedge_ring_done(((struct fins_ring_slot *) wedge_rings)[ring].tx, where);
+		}
 		wedge_calls[call_index].call_id = -1;
 		rc = -ENOMEM;
 		goto end;
@@ -1824,13 +2005,20 @@ static int fins_sendmsg(struct kiocb *iocb, struct socket *sock, struct msghdr *
 	*(u_int *) pt = data_len;
 	pt += sizeof(u_int);
 
+	*(int *) pt = ring;
+	pt += sizeof(int);
+
+	*(int *) pt = where;
+	pt += sizeof(int);
+
 	temp = pt;
 
-	i = 0;
-	for (i = 0; i < msg->msg_iovlen; i++) {
-		memcpy(pt, msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
-		pt += msg->msg_iov[i].iov_len;
-		//PRINT_DEBUG("current element %d , element length = %d", i ,(msg->msg_iov[i]).iov_len );
+	if (where == -1) {
+		for (i = 0; i < msg->msg_iovlen; i++) {
+			memcpy(pt, msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
+			pt += msg->msg_iov[i].iov_len;
+			//PRINT_DEBUG("current element %d , element length = %d", i ,(msg->msg_iov[i]).iov_len );
+		}
 	}
 
 	if (pt - buf != buf_len) {
@@ -1851,6 +2039,9 @@ static int fins_sendmsg(struct kiocb *iocb, struct socket *sock, struct msghdr *
 	kfree(buf);
 	if (ret) {
 		PRINT_ERROR("nl_send failed");
+		if (where != -1) {
+			wedge_ring_done(((struct fins_ring_slot *) wedge_rings)[ring].tx, where);
+		}
 		wedge_calls[call_index].call_id = -1;
 		rc = -1;
 		goto end;
@@ -1920,6 +2111,9 @@ static int fins_recvmsg(struct kiocb *iocb, struct socket *sock, struct msghdr *
 	u_char * buf;
 	struct nl_wedge_to_daemon *hdr;
 	u_char * pt;
+	u_char *data_pt;
+	int ring;
+	int where;
 	int ret;
 	int i;
 
@@ -1954,6 +2148,8 @@ static int fins_recvmsg(struct kiocb *iocb, struct socket *sock, struct msghdr *
 		return print_exit(__FUNCTION__, __LINE__, -1);
 	}
 
+	ring = len >= FINS_RING_MIN ? wedge_rings_assign(sock_index) : wedge_sockets[sock_index].ring;
+
 	wedge_sockets[sock_index].threads[call_type]++;
 	up(&wedge_sockets_sem); //TODO move to later? lock_sock should guarantee
 
@@ -1971,7 +2167,7 @@ static int fins_recvmsg(struct kiocb *iocb, struct socket *sock, struct msghdr *
 	}
 
 	// Build the message
-	buf_len = sizeof(struct nl_wedge_to_daemon) + 2 * sizeof(int) + sizeof(u_int) + sizeof(unsigned long);
+	buf_len = sizeof(struct nl_wedge_to_daemon) + 3 * sizeof(int) + sizeof(u_int) + sizeof(unsigned long);
 	buf = (u_char *) kmalloc(buf_len, GFP_KERNEL);
 	if (buf == NULL) {
 		PRINT_ERROR("buffer allocation error");
@@ -2001,6 +2197,9 @@ static int fins_recvmsg(struct kiocb *iocb, struct socket *sock, struct msghdr *
 	*(int *) pt = flags;
 	pt += sizeof(int);
 
+	*(int *) pt = ring; //where the daemon can put the data
+	pt += sizeof(int);
+
 	//sk->sk_rcvtimeo;
 
 	PRINT_DEBUG("msg_namelen=%d, data_buf_len=%d, msg_controllen=%u, flags=0x%x", msg->msg_namelen, (int)len, msg->msg_controllen, flags);
@@ -2078,25 +2277,33 @@ static int fins_recvmsg(struct kiocb *iocb, struct socket *sock, struct msghdr *
 				buf_len = *(int *) pt; //reuse var since not needed anymore
 				pt += sizeof(int);
 
-				if (buf_len >= 0) {
-					//########
-					u_char *temp = (u_char *) kmalloc(buf_len + 1, GFP_KERNEL);
-					memcpy(temp, pt, buf_len);
-					temp[buf_len] = '\0';
-					PRINT_DEBUG("msg='%s'", temp);
-					//########
+				where = *(int *) pt;
+				pt += sizeof(int);
+
+				//the data is either next in the message or in the socket's ring
+				if (where == -1) {
+					data_pt = pt;
+					pt += buf_len > 0 ? buf_len : 0;
+				} else {
+					data_pt = wedge_ring_get(wedge_sockets[sock_index].ring, where, buf_len);
+					if (data_pt == NULL) {
+						PRINT_ERROR("bad ring chunk: ring=%d, where=%d, len=%d", wedge_sockets[sock_index].ring, where, buf_len);
+						buf_len = -1;
+					}
+				}
 
+				if (buf_len >= 0) {
 					ret = buf_len; //reuse as counter
 					i = 0;
 					while (ret > 0 && i < msg->msg_iovlen) {
 						if (ret > msg->msg_iov[i].iov_len) {
-							copy_to_user(msg->msg_iov[i].iov_base, pt, msg->msg_iov[i].iov_len);
-							pt += msg->msg_iov[i].iov_len;
+							copy_to_user(msg->msg_iov[i].iov_base, data_pt, msg->msg_iov[i].iov_len);
+							data_pt += msg->msg_iov[i].iov_len;
 							ret -= msg->msg_iov[i].iov_len;
 							i++;
 						} else {
-							copy_to_user(msg->msg_iov[i].iov_base, pt, ret);
-							pt += ret;
+							copy_to_user(msg->msg_iov[i].iov_base, data_pt, ret);
+							data_pt += ret;
 							ret = 0;
 							break;
 						}
@@ -2105,6 +2312,9 @@ static int fins_recvmsg(struct kiocb *iocb, struct socket *sock, struct msghdr *
 						//throw buffer overflow error?
 						PRINT_ERROR("user buffer overflow error, overflow=%d", ret);
 					}
+					if (where != -1) {
+						wedge_ring_done(((struct fins_ring_slot *) wedge_rings)[wedge_sockets[sock_index].ring].rx, where);
+					}
 
 					rc = buf_len;
 				} else {
@@ -3046,6 +3256,27 @@ static unsigned int fins_poll(struct file *file, struct socket *sock, poll_table
 		return print_exit(__FUNCTION__, __LINE__, 0);
 	}
 
+	PRINT_DEBUG("file=%p, sock=%p, table=%p", file, sock, table);
+	if (table) {
+		events = table->key;
+	} else {
+		events = 0;
+	}
+	PRINT_DEBUG("events=0x%x, ready=0x%x, exact=%d", events, wedge_sockets[sock_index].ready, wedge_sockets[sock_index].ready_exact);
+
+	//answer from what the daemon pushed when that settles it. Ready events take wedge_sockets_sem too,
+	//so one that comes in after the mask is read finds this task already waiting
+	if (wedge_sockets[sock_index].ready_exact || (events & wedge_sockets[sock_index].ready)) {
+		rc = wedge_sockets[sock_index].ready;
+		if (table && !(events & rc)) {
+			poll_wait(file, sk_sleep(sk), table);
+		}
+		up(&wedge_sockets_sem);
+
+		release_sock(sk);
+		return print_exit(__FUNCTION__, __LINE__, rc);
+	}
+
 	wedge_sockets[sock_index].threads[call_type]++;
 	up(&wedge_sockets_sem); //TODO move to later? lock_sock should guarantee
 
@@ -3062,14 +3293,6 @@ static unsigned int fins_poll(struct file *file, struct socket *sock, poll_table
 		goto end;
 	}
 
-	PRINT_DEBUG("file=%p, sock=%p, table=%p", file, sock, table);
-	if (table) {
-		events = table->key;
-	} else {
-		events = 0;
-	}
-	PRINT_DEBUG("events=0x%x", events);
-
 	// Build the message
 	buf_len = sizeof(struct nl_wedge_to_daemon) + sizeof(int);
 	buf = (u_char *) kmalloc(buf_len, GFP_KERNEL);
@@ -4074,7 +4297,18 @@ setup_fins_protocol();
  	 setup_fins_netlink();
 	wedge_calls_init();
 	wedge_sockets_init();
+	wedge_rings_init();
 	fins_daemon_pid = -1;
+
+	//the daemon falls back to carrying payloads in the netlink messages if there are no rings
+	wedge_rings = (u_char *) vmalloc_user(FINS_RING_SLOTS * sizeof(struct fins_ring_slot));
+	if (wedge_rings == NULL) {
+		PRINT_ERROR("payload ring allocation fail");
+	} else if (misc_register(&fins_ring_dev)) {
+		PRINT_ERROR("payload ring device fail");
+		vfree(wedge_rings);
+		wedge_rings = NULL;
+	}
 	PRINT_DEBUG("Made it through the fins_stack_wedge initialization");
 
 return 0;
@@ -4083,6 +4317,10 @@ return 0;
 static void __exit fins_stack_wedge_exit(void) {
 	PRINT_DEBUG("Unloading the fins_stack_wedge module");
 teardown_fins_netlink();
+	if (wedge_rings != NULL) {
+		misc_deregister(&fins_ring_dev);
+		vfree(wedge_rings);
+	}
 	teardown_fins_protocol(); //uncomment
 	PRINT_DEBUG("Made it through the fins_stack_wedge removal");
  //the system call wrapped by rmmod frees all memory that is allocated in the module
@@ -35,6 +35,7 @@
 #define daemon_start_call 19
 #define daemon_stop_call 20
 #define poll_event_call 21
+#define ready_event_call 22
 
 /** Additional calls
  * To hande special cases
@@ -42,12 +43,41 @@
  * in order to make sure that we cover as many applications as possible
  * This range of these functions will start from 30
  */
-#define MAX_CALL_TYPES 22
+#define MAX_CALL_TYPES 23
 
 #define ACK 	200
 #define NACK 	6666
-#define MAX_SOCKETS 100
+#define MAX_SOCKETS 4096 //the daemon keeps up to this many, see "daemon.sockets_max" in fins.cfg
 #define MAX_CALLS 100
+
+/** Payload rings, must match ringHandling.h in the daemon. The daemon maps FINS_RING_SLOTS slots from
+ * /dev/fins_ring, a socket moving bulk data gets one, and its sendmsg/recvmsg payloads then go through the
+ * slot with only (where, len) in the netlink messages. The producer of a ring keeps head and tail to itself,
+ * the consumer marks the chunks it is done with */
+#define FINS_RING_SLOTS 64
+#define FINS_RING_SIZE (256 * 1024) //per direction, a power of 2
+#define FINS_RING_MIN 512 //payloads smaller than this stay in the netlink message
+
+struct fins_ring_chunk {
+	u_int space; //bytes to the next chunk, this header included
+	u_int state;
+};
+
+#define FINS_CHUNK_BUSY 1
+#define FINS_CHUNK_DONE 2
+#define FINS_CHUNK_SKIP 3
+
+struct fins_ring_slot {
+	u_char tx[FINS_RING_SIZE]; //sendmsg data, written here
+	u_char rx[FINS_RING_SIZE]; //recvmsg data, written by the daemon
+};
+
+struct wedge_ring {
+	int sock_index; //-1 when free
+	u_int head;
+	u_int tail;
+	struct semaphore sem; //senders on the socket
+};
 //#define LOOP_LIMIT 10
 
 /* Data for protocol registration */
@@ -85,7 +115,8 @@ static ssize_t fins_sendpage(struct socket *sock, struct page *page, int offset,
 
 /* FINS netlink functions*/
 int nl_send(int pid, void *buf, ssize_t len, int flags);
-int nl_send_msg(int pid, unsigned int seq, int type, void *buf, ssize_t len, int flags);
+int nl_send_msg(int pid, unsigned int seq, int type, ssize_t msg_len, int pos, void *buf, ssize_t part_len, int flags);
+void nl_reply(struct nlmsghdr *nlh);
 void nl_data_ready(struct sk_buff *skb);
 
 // This function extracts a unique ID from the kernel-space perspective for each socket
@@ -156,6 +187,11 @@ struct fins_wedge_socket {
 	int release_flag;
 	struct socket *sock_new;
 	struct sock *sk_new;
+
+	int ring; //payload ring slot, -1 for none
+
+	u_int ready; //poll mask the daemon last pushed
+	int ready_exact; //the daemon knows the whole mask, so poll needn't ask it
 };
 
 void wedge_sockets_init(void);
@@ -166,6 +202,13 @@ void wedge_socket_remove_all(void);
 int wedge_sockets_wait(unsigned long long sock_id, int sock_index, u_int calltype);
 int checkConfirmation(int sock_index);
 
+void wedge_rings_init(void);
+int wedge_rings_assign(int sock_index);
+void wedge_rings_unassign(int sock_index);
+int wedge_ring_put(int slot, struct iovec *iov, int iovlen, u_int len);
+u_char *wedge_ring_get(int slot, int where, u_int len);
+void wedge_ring_done(u_char *data, int where);
+
 /* This is a flag to enable or disable the FINS stack passthrough */
 int fins_stack_passthrough_enabled;
 EXPORT_SYMBOL (fins_stack_passthrough_enabled);